@@ -19,12 +19,15 @@ namespace {
 template <typename Stream, typename Data>
 bool SerializeDB(Stream& stream, const Data& data)
 {
-    // Write and commit header, data
+    // Write and commit header, data. Serialize into memory first, so data is
+    // serialized (and the address manager locked) once, and not during the
+    // file writes.
     try {
-        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << FLATDATA(Params().MessageStart()) << data;
-        hasher << FLATDATA(Params().MessageStart()) << data;
-        stream << hasher.GetHash();
+        CDataStream ssData(SER_DISK, CLIENT_VERSION);
+        ssData << FLATDATA(Params().MessageStart()) << data;
+        uint256 hash = Hash(ssData.begin(), ssData.end());
+        stream.write(ssData.data(), ssData.size());
+        stream << hash;
     } catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
     }
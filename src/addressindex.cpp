@@ -0,0 +1,421 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addressindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <pubkey.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+#include <boost/variant/static_visitor.hpp>
+
+static const char DB_ADDRESS_INDEX = 'a';
+static const char DB_ADDRESS_UNSPENT = 'u';
+static const char DB_SPENT_INDEX = 'p';
+static const char DB_TIMESTAMP_INDEX = 's';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_FLAGS = 'F';
+
+//! Bits of DB_FLAGS
+static const uint8_t FLAG_ADDRESS_INDEX = 1;
+static const uint8_t FLAG_SPENT_INDEX = 2;
+static const uint8_t FLAG_TIMESTAMP_INDEX = 4;
+
+//! Blocks ThreadSync indexes between progress messages
+static const int SYNC_LOG_INTERVAL = 10000;
+//! Bytes of erased keys Wipe writes at a time
+static const size_t WIPE_BATCH_SIZE = 16 << 20;
+
+std::unique_ptr<CAddressIndex> paddressindex;
+
+namespace {
+/** A block by its timestamp, stored big endian so a seek finds the blocks from a time on */
+struct CTimestampIndexKey
+{
+    unsigned int nTime;
+    uint256 hashBlock;
+
+    CTimestampIndexKey() : nTime(0) {}
+    CTimestampIndexKey(unsigned int nTimeIn, const uint256& hashBlockIn) : nTime(nTimeIn), hashBlock(hashBlockIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata32be(s, nTime);
+        s << hashBlock;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        nTime = ser_readdata32be(s);
+        s >> hashBlock;
+    }
+};
+
+class CIndexAddressVisitor : public boost::static_visitor<CIndexAddress>
+{
+public:
+    CIndexAddress operator()(const CKeyID& id) const { return CIndexAddress(INDEX_ADDRESS_P2PKH, id); }
+    CIndexAddress operator()(const CScriptID& id) const { return CIndexAddress(INDEX_ADDRESS_P2SH, id); }
+    CIndexAddress operator()(const WitnessV0KeyHash& id) const { return CIndexAddress(INDEX_ADDRESS_P2WPKH, id); }
+
+    template <typename T>
+    CIndexAddress operator()(const T&) const { return CIndexAddress(); }
+};
+
+template <typename K>
+bool EraseAll(CDBWrapper& db, char prefix)
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(db);
+    std::pair<char, K> key;
+    for (pcursor->Seek(prefix); pcursor->Valid() && pcursor->GetKey(key) && key.first == prefix; pcursor->Next()) {
+        batch.Erase(key);
+        if (batch.SizeEstimate() > WIPE_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch);
+}
+} // namespace
+
+CIndexAddress CIndexAddress::FromScript(const CScript& scriptPubKey)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return CIndexAddress();
+    return FromDestination(dest);
+}
+
+CIndexAddress CIndexAddress::FromDestination(const CTxDestination& dest)
+{
+    return boost::apply_visitor(CIndexAddressVisitor(), dest);
+}
+
+CTxDestination CIndexAddress::GetDestination() const
+{
+    switch (nType) {
+    case INDEX_ADDRESS_P2PKH:
+        return CKeyID(hash);
+    case INDEX_ADDRESS_P2SH:
+        return CScriptID(hash);
+    case INDEX_ADDRESS_P2WPKH: {
+        WitnessV0KeyHash id;
+        std::copy(hash.begin(), hash.end(), id.begin());
+        return id;
+    }
+    }
+    return CNoDestination();
+}
+
+CAddressIndex::CAddressIndex(size_t nCacheSize, bool fAddressIndexIn, bool fSpentIndexIn, bool fTimestampIndexIn, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "indexes" / "address", nCacheSize, fMemory, fWipe, false, DBProfile::INDEX),
+      fAddressIndex(fAddressIndexIn), fSpentIndex(fSpentIndexIn), fTimestampIndex(fTimestampIndexIn)
+{
+}
+
+uint8_t CAddressIndex::GetFlags() const
+{
+    return (fAddressIndex ? FLAG_ADDRESS_INDEX : 0) | (fSpentIndex ? FLAG_SPENT_INDEX : 0) | (fTimestampIndex ? FLAG_TIMESTAMP_INDEX : 0);
+}
+
+bool CAddressIndex::Wipe()
+{
+    return EraseAll<CAddressIndexKey>(db, DB_ADDRESS_INDEX) &&
+           EraseAll<CAddressUnspentKey>(db, DB_ADDRESS_UNSPENT) &&
+           EraseAll<COutPoint>(db, DB_SPENT_INDEX) &&
+           EraseAll<CTimestampIndexKey>(db, DB_TIMESTAMP_INDEX) &&
+           db.Erase(DB_BEST_BLOCK) &&
+           db.Write(DB_FLAGS, GetFlags(), true);
+}
+
+bool CAddressIndex::ReadUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const
+{
+    CDiskBlockPos pos;
+    bool fCompact;
+    {
+        LOCK(cs_main);
+        if (!(pindex->nStatus & BLOCK_HAVE_UNDO))
+            return error("%s: no undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+        pos = pindex->GetUndoPos();
+        fCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+    }
+    if (!UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash(), fCompact))
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    return true;
+}
+
+bool CAddressIndex::ConnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block spends nothing and has no undo data.
+    CBlockUndo blockundo;
+    if (pindex->pprev && !ReadUndo(pindex, blockundo))
+        return false;
+    if (pindex->pprev && blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+
+    CDBBatch batch(db);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxOut& prev = txundo.vprevout[j].out;
+                const CIndexAddress address = CIndexAddress::FromScript(prev.scriptPubKey);
+                if (fAddressIndex && !address.IsNull()) {
+                    batch.Write(std::make_pair(DB_ADDRESS_INDEX, CAddressIndexKey(address, pindex->nHeight, txid, j, true)), -prev.nValue);
+                    batch.Erase(std::make_pair(DB_ADDRESS_UNSPENT, CAddressUnspentKey(address, prevout)));
+                }
+                if (fSpentIndex)
+                    batch.Write(std::make_pair(DB_SPENT_INDEX, prevout), CSpentIndexValue(txid, j, pindex->nHeight, prev.nValue, address));
+            }
+        }
+
+        if (fAddressIndex) {
+            for (uint32_t k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                const CIndexAddress address = CIndexAddress::FromScript(out.scriptPubKey);
+                if (address.IsNull())
+                    continue;
+                batch.Write(std::make_pair(DB_ADDRESS_INDEX, CAddressIndexKey(address, pindex->nHeight, txid, k, false)), out.nValue);
+                batch.Write(std::make_pair(DB_ADDRESS_UNSPENT, CAddressUnspentKey(address, COutPoint(txid, k))), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight));
+            }
+        }
+    }
+    if (fTimestampIndex)
+        batch.Write(std::make_pair(DB_TIMESTAMP_INDEX, CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())), '\0');
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    return db.WriteBatch(batch);
+}
+
+bool CAddressIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block is never disconnected.
+    assert(pindex->pprev);
+    CBlockUndo blockundo;
+    if (!ReadUndo(pindex, blockundo))
+        return false;
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+
+    // In reverse, so outputs spent within the block are erased after their
+    // spends made them unspent again.
+    CDBBatch batch(db);
+    for (size_t i = block.vtx.size(); i-- > 0;) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (fAddressIndex) {
+            for (uint32_t k = 0; k < tx.vout.size(); k++) {
+                const CIndexAddress address = CIndexAddress::FromScript(tx.vout[k].scriptPubKey);
+                if (address.IsNull())
+                    continue;
+                batch.Erase(std::make_pair(DB_ADDRESS_INDEX, CAddressIndexKey(address, pindex->nHeight, txid, k, false)));
+                batch.Erase(std::make_pair(DB_ADDRESS_UNSPENT, CAddressUnspentKey(address, COutPoint(txid, k))));
+            }
+        }
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const Coin& coin = txundo.vprevout[j];
+                const CIndexAddress address = CIndexAddress::FromScript(coin.out.scriptPubKey);
+                if (fAddressIndex && !address.IsNull()) {
+                    batch.Erase(std::make_pair(DB_ADDRESS_INDEX, CAddressIndexKey(address, pindex->nHeight, txid, j, true)));
+                    batch.Write(std::make_pair(DB_ADDRESS_UNSPENT, CAddressUnspentKey(address, prevout)), CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+                }
+                if (fSpentIndex)
+                    batch.Erase(std::make_pair(DB_SPENT_INDEX, prevout));
+            }
+        }
+    }
+    if (fTimestampIndex)
+        batch.Erase(std::make_pair(DB_TIMESTAMP_INDEX, CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())));
+    batch.Write(DB_BEST_BLOCK, pindex->pprev->GetBlockHash());
+    return db.WriteBatch(batch);
+}
+
+bool CAddressIndex::DisconnectBlock(const CBlockIndex* pindex)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    return DisconnectBlock(block, pindex);
+}
+
+void CAddressIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    // Until then ThreadSync gets to the block itself.
+    if (!fSynced)
+        return;
+
+    LOCK(cs_index);
+    if (pindex->pprev != pindexBest) {
+        // Announced before ThreadSync finished, which already indexed it
+        if (pindexBest && pindexBest->GetAncestor(pindex->nHeight) == pindex)
+            return;
+        LogPrintf("%s: block %s does not connect to the address index, restart to resume indexing\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    if (!ConnectBlock(*block, pindex)) {
+        LogPrintf("%s: failed to index block %s\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    pindexBest = pindex;
+}
+
+void CAddressIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (!fSynced)
+        return;
+
+    LOCK(cs_index);
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(block->GetHash());
+        pindex = it != mapBlockIndex.end() ? it->second : nullptr;
+    }
+    // ThreadSync undid it already, or never got to it
+    if (!pindex || pindex != pindexBest)
+        return;
+    if (!DisconnectBlock(*block, pindex)) {
+        LogPrintf("%s: failed to remove block %s from the address index\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    pindexBest = pindex->pprev;
+}
+
+void CAddressIndex::ThreadSync()
+{
+    RenameThread("globaltoken-addressindex");
+
+    {
+        LOCK(cs_index);
+        uint8_t nFlags = 0;
+        uint256 hashBest;
+        bool fHaveBest = db.Read(DB_BEST_BLOCK, hashBest);
+        db.Read(DB_FLAGS, nFlags);
+        if (fHaveBest && nFlags == GetFlags()) {
+            LOCK(cs_main);
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end())
+                pindexBest = it->second;
+        }
+        if (!pindexBest) {
+            if (fHaveBest)
+                LogPrintf("%s: rebuilding the address index from the genesis block\n", __func__);
+            if (!Wipe()) {
+                LogPrintf("%s: failed to clear the address index\n", __func__);
+                return;
+            }
+        }
+    }
+
+    int nIndexed = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        LOCK(cs_index);
+        const CBlockIndex* pindexNext = nullptr;
+        bool fHaveData = false;
+        {
+            LOCK(cs_main);
+            // Undo what the active chain left behind, after a reorg while the node was down too.
+            if (!pindexBest || chainActive.Contains(pindexBest)) {
+                pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+                if (!pindexNext) {
+                    fSynced = true;
+                    LogPrintf("%s: address index is synced at height %d\n", __func__, pindexBest ? pindexBest->nHeight : -1);
+                    return;
+                }
+                fHaveData = (pindexNext->nStatus & BLOCK_HAVE_DATA) && (!pindexNext->pprev || (pindexNext->nStatus & BLOCK_HAVE_UNDO));
+            }
+        }
+
+        if (!pindexNext) {
+            if (!DisconnectBlock(pindexBest)) {
+                LogPrintf("%s: failed to remove block %s, the address index stays at it\n", __func__, pindexBest->GetBlockHash().ToString());
+                return;
+            }
+            pindexBest = pindexBest->pprev;
+            continue;
+        }
+
+        CBlock block;
+        if (!fHaveData || !ReadBlockFromDisk(block, pindexNext, Params().GetConsensus()) || !ConnectBlock(block, pindexNext)) {
+            LogPrintf("%s: failed to index block %s, the address index stops before it\n", __func__, pindexNext->GetBlockHash().ToString());
+            return;
+        }
+        pindexBest = pindexNext;
+
+        if (++nIndexed % SYNC_LOG_INTERVAL == 0)
+            LogPrintf("%s: address index at height %d\n", __func__, pindexBest->nHeight);
+    }
+}
+
+bool CAddressIndex::ReadAddressIndex(const CIndexAddress& address, std::vector<std::pair<CAddressIndexKey, CAmount>>& entries, int nStart, int nEnd) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_INDEX, CAddressIndexKey(address, nStart, uint256(), 0, false)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_INDEX || !(key.second.address == address))
+            break;
+        if (nEnd > 0 && key.second.nHeight > nEnd)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to read address index entry", __func__);
+        entries.emplace_back(key.second, nValue);
+    }
+    return true;
+}
+
+bool CAddressIndex::ReadAddressUnspent(const CIndexAddress& address, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESS_UNSPENT, address));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESS_UNSPENT || !(key.second.address == address))
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read address unspent entry", __func__);
+        unspent.emplace_back(key.second, value);
+    }
+    return true;
+}
+
+bool CAddressIndex::ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value) const
+{
+    return db.Read(std::make_pair(DB_SPENT_INDEX, outpoint), value);
+}
+
+bool CAddressIndex::ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& hashes) const
+{
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    pcursor->Seek(std::make_pair(DB_TIMESTAMP_INDEX, CTimestampIndexKey(nLow, uint256())));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CTimestampIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIMESTAMP_INDEX || key.second.nTime >= nHigh)
+            break;
+        hashes.push_back(key.second.hashBlock);
+    }
+    return true;
+}
@@ -0,0 +1,228 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <dbwrapper.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class CBlockIndex;
+class CBlockUndo;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_TIMESTAMPINDEX = false;
+
+/** The kinds of addresses the address index knows, P2WSH and bare scripts are not indexed */
+enum IndexAddressType : uint8_t {
+    INDEX_ADDRESS_NONE = 0,
+    INDEX_ADDRESS_P2PKH = 1, //!< P2PKH and P2PK outputs, by key hash
+    INDEX_ADDRESS_P2SH = 2,
+    INDEX_ADDRESS_P2WPKH = 3,
+};
+
+/** An address as the indexes store it */
+struct CIndexAddress
+{
+    uint8_t nType;
+    uint160 hash;
+
+    CIndexAddress() : nType(INDEX_ADDRESS_NONE) {}
+    CIndexAddress(uint8_t nTypeIn, const uint160& hashIn) : nType(nTypeIn), hash(hashIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nType);
+        READWRITE(hash);
+    }
+
+    bool IsNull() const { return nType == INDEX_ADDRESS_NONE; }
+
+    /** The address an output script pays to, null if it is not one of the indexed kinds */
+    static CIndexAddress FromScript(const CScript& scriptPubKey);
+    /** The address of a destination, null if it is not one of the indexed kinds */
+    static CIndexAddress FromDestination(const CTxDestination& dest);
+    CTxDestination GetDestination() const;
+
+    friend bool operator==(const CIndexAddress& a, const CIndexAddress& b)
+    {
+        return a.nType == b.nType && a.hash == b.hash;
+    }
+};
+
+/**
+ * A change of an address' balance: an output paying to it, or with fSpending
+ * the input spending such an output. The height is stored big endian, so the
+ * entries of an address are in the order of the chain.
+ */
+struct CAddressIndexKey
+{
+    CIndexAddress address;
+    int nHeight;
+    uint256 txid;
+    uint32_t n; //!< index of the output, or of the input if fSpending
+    bool fSpending;
+
+    CAddressIndexKey() : nHeight(0), n(0), fSpending(false) {}
+    CAddressIndexKey(const CIndexAddress& addressIn, int nHeightIn, const uint256& txidIn, uint32_t nIn, bool fSpendingIn)
+        : address(addressIn), nHeight(nHeightIn), txid(txidIn), n(nIn), fSpending(fSpendingIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << address;
+        ser_writedata32be(s, nHeight);
+        s << txid << n << fSpending;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> address;
+        nHeight = ser_readdata32be(s);
+        s >> txid >> n >> fSpending;
+    }
+};
+
+/** An output of the active chain an address has not spent yet */
+struct CAddressUnspentKey
+{
+    CIndexAddress address;
+    COutPoint outpoint;
+
+    CAddressUnspentKey() {}
+    CAddressUnspentKey(const CIndexAddress& addressIn, const COutPoint& outpointIn) : address(addressIn), outpoint(outpointIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(address);
+        READWRITE(outpoint);
+    }
+};
+
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript scriptPubKey;
+    int nHeight;
+
+    CAddressUnspentValue() : nValue(0), nHeight(0) {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptPubKeyIn, int nHeightIn) : nValue(nValueIn), scriptPubKey(scriptPubKeyIn), nHeight(nHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(scriptPubKey);
+        READWRITE(nHeight);
+    }
+};
+
+/** Where an output of the active chain was spent, by outpoint */
+struct CSpentIndexValue
+{
+    uint256 txid;
+    uint32_t nInput;
+    int nHeight;
+    CAmount nValue;
+    CIndexAddress address; //!< of the spent output, null if it is not an indexed kind
+
+    CSpentIndexValue() : nInput(0), nHeight(0), nValue(0) {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIn, int nHeightIn, CAmount nValueIn, const CIndexAddress& addressIn)
+        : txid(txidIn), nInput(nInputIn), nHeight(nHeightIn), nValue(nValueIn), address(addressIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(nInput);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+        READWRITE(address);
+    }
+};
+
+/**
+ * The address (-addressindex), spent (-spentindex) and timestamp
+ * (-timestampindex) indexes of the active chain, in one database under
+ * indexes/address. Like the block filter index, ThreadSync indexes the
+ * blocks the node already has in the background, after which the blocks the
+ * validation interface connects and disconnects are applied. Every block is
+ * written in one batch together with the hash of the block the index is at,
+ * so the index is always at a block, from which a restart continues, undoing
+ * blocks that were reorganized away in the meantime. Changing which of the
+ * indexes are enabled rebuilds them from the genesis block, no reindex is
+ * needed.
+ */
+class CAddressIndex final : public CValidationInterface
+{
+private:
+    CDBWrapper db;
+    const bool fAddressIndex;
+    const bool fSpentIndex;
+    const bool fTimestampIndex;
+
+    //! Serializes applying blocks, between ThreadSync and the validation interface
+    mutable CCriticalSection cs_index;
+    //! The block the index is at, nullptr before the genesis block
+    const CBlockIndex* pindexBest = nullptr;
+    //! Whether ThreadSync reached the tip, the validation interface applies the blocks from then on
+    std::atomic<bool> fSynced{false};
+
+    //! Which of the indexes are enabled, as stored with them
+    uint8_t GetFlags() const;
+    //! Erase everything, for a rebuild with other indexes enabled
+    bool Wipe();
+    bool ReadUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const;
+    bool ConnectBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool DisconnectBlock(const CBlockIndex* pindex);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+public:
+    CAddressIndex(size_t nCacheSize, bool fAddressIndexIn, bool fSpentIndexIn, bool fTimestampIndexIn, bool fMemory = false, bool fWipe = false);
+
+    /** Index the blocks from the one the index is at up to the tip, run on a thread of its own */
+    void ThreadSync();
+
+    bool IsSynced() const { return fSynced; }
+    bool HasAddressIndex() const { return fAddressIndex; }
+    bool HasSpentIndex() const { return fSpentIndex; }
+    bool HasTimestampIndex() const { return fTimestampIndex; }
+
+    /** The balance changes of an address, of the blocks from nStart to nEnd (0 for no limit) */
+    bool ReadAddressIndex(const CIndexAddress& address, std::vector<std::pair<CAddressIndexKey, CAmount>>& entries, int nStart = 0, int nEnd = 0) const;
+    /** The unspent outputs of an address */
+    bool ReadAddressUnspent(const CIndexAddress& address, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent) const;
+    /** Where an output was spent, false if it was not */
+    bool ReadSpentIndex(const COutPoint& outpoint, CSpentIndexValue& value) const;
+    /** The hashes of the blocks with a timestamp from nLow up to but not including nHigh, oldest first */
+    bool ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& hashes) const;
+};
+
+/** The address, spent and timestamp indexes, if any of them is enabled */
+extern std::unique_ptr<CAddressIndex> paddressindex;
+
+#endif // BITCOIN_ADDRESSINDEX_H
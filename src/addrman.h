@@ -188,6 +188,9 @@ private:
     //! last used nId
     int nIdCount;
 
+    //! number of calls that changed the tables, see GetModificationCount
+    uint64_t nModifications{0};
+
     //! table with information about all nIds
     std::map<int, CAddrInfo> mapInfo;
 
@@ -459,6 +462,7 @@ public:
     void Clear()
     {
         LOCK(cs);
+        nModifications++;
         std::vector<int>().swap(vRandom);
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
@@ -498,6 +502,13 @@ public:
         return vRandom.size();
     }
 
+    //! Changes on every call that may have modified the tables, so unchanged ones need not be written again
+    uint64_t GetModificationCount() const
+    {
+        LOCK(cs);
+        return nModifications;
+    }
+
     //! Consistency check
     void Check()
     {
@@ -515,6 +526,7 @@ public:
     bool Add(const CAddress &addr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
         LOCK(cs);
+        nModifications++;
         bool fRet = false;
         Check();
         fRet |= Add_(addr, source, nTimePenalty);
@@ -529,6 +541,7 @@ public:
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64_t nTimePenalty = 0)
     {
         LOCK(cs);
+        nModifications++;
         int nAdd = 0;
         Check();
         for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
@@ -544,6 +557,7 @@ public:
     void Good(const CService &addr, int64_t nTime = GetAdjustedTime())
     {
         LOCK(cs);
+        nModifications++;
         Check();
         Good_(addr, nTime);
         Check();
@@ -553,6 +567,7 @@ public:
     void Attempt(const CService &addr, bool fCountFailure, int64_t nTime = GetAdjustedTime())
     {
         LOCK(cs);
+        nModifications++;
         Check();
         Attempt_(addr, fCountFailure, nTime);
         Check();
@@ -590,6 +605,7 @@ public:
     void Connected(const CService &addr, int64_t nTime = GetAdjustedTime())
     {
         LOCK(cs);
+        nModifications++;
         Check();
         Connected_(addr, nTime);
         Check();
@@ -598,6 +614,7 @@ public:
     void SetServices(const CService &addr, ServiceFlags nServices)
     {
         LOCK(cs);
+        nModifications++;
         Check();
         SetServices_(addr, nServices);
         Check();
@@ -176,6 +176,8 @@ public:
     base_uint& operator*=(uint32_t b32);
     base_uint& operator*=(const base_uint& b);
     base_uint& operator/=(const base_uint& b);
+    /** Same result as operator/= with b32 as a base_uint, in a single pass over the words */
+    base_uint& DivideByUint32(uint32_t b32);
 
     base_uint& operator++()
     {
@@ -156,6 +156,12 @@ public:
  * transaction's input (the coinbase script) contains the reference
  * to the actual merge-mined block.
  *
+ * Every auxpow is stored in full with its block. The parent coinbase commits
+ * to the merge-mined block hash (through the chain merkle root in its script)
+ * and the parent header commits to that coinbase, so no two blocks of this
+ * chain can have the same parent coinbase or header, and there is nothing to
+ * share between them.
+ *
  * Blockformat : AuxPOW 2.0.
  */
 class CAuxPow
@@ -26,21 +26,19 @@ void benchmark::ConsolePrinter::result(const State& state)
 
     double front = 0;
     double back = 0;
-    double median = 0;
+    double median = state.GetMedianElapsed();
 
     if (!results.empty()) {
         front = results.front();
         back = results.back();
-
-        size_t mid = results.size() / 2;
-        median = results[mid];
-        if (0 == results.size() % 2) {
-            median = (results[mid] + results[mid + 1]) / 2;
-        }
     }
 
     std::cout << std::setprecision(6);
-    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median << std::endl;
+    std::cout << state.m_name << ", " << state.m_num_evals << ", " << state.m_num_iters << ", " << total << ", " << front << ", " << back << ", " << median;
+    for (const auto& counter : state.counters) {
+        std::cout << ", " << counter.first << "=" << counter.second;
+    }
+    std::cout << std::endl;
 }
 
 void benchmark::ConsolePrinter::footer() {}
@@ -130,6 +128,20 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
     perf_fini();
 }
 
+double benchmark::State::GetMedianElapsed() const
+{
+    if (m_elapsed_results.empty())
+        return 0;
+
+    auto results = m_elapsed_results;
+    std::sort(results.begin(), results.end());
+
+    size_t mid = results.size() / 2;
+    if (0 == results.size() % 2)
+        return (results[mid - 1] + results[mid]) / 2;
+    return results[mid];
+}
+
 bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
 {
     if (m_start_time != time_point()) {
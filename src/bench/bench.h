@@ -60,9 +60,14 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    //! Extra named results a benchmark can report, printed after the timings (like Google Benchmark's counters)
+    std::map<std::string, double> counters;
 
     bool UpdateTimer(time_point finish_time);
 
+    //! Median of the elapsed time per iteration of the evaluations done so far
+    double GetMedianElapsed() const;
+
     State(std::string name, uint64_t num_evals, double num_iters, Printer& printer) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals)
     {
     }
@@ -3,7 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <bench/replay_blocks.h>
 
+#include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/hashlib/sph_echo.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/algos/yescrypt/yescrypt.h>
+#include <crypto/algos/yespower/yespower.h>
+#include <crypto/hash4way.h>
 #include <crypto/sha256.h>
 #include <key.h>
 #include <validation.h>
@@ -37,12 +44,19 @@ main(int argc, char** argv)
                   << HelpMessageOpt("-printer=(console|plot)", strprintf(_("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)"), DEFAULT_BENCH_PRINTER))
                   << HelpMessageOpt("-plot-plotlyurl=<uri>", strprintf(_("URL to use for plotly.js (default: %s)"), DEFAULT_PLOT_PLOTLYURL))
                   << HelpMessageOpt("-plot-width=<x>", strprintf(_("Plot width in pixel (default: %u)"), DEFAULT_PLOT_WIDTH))
-                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT));
+                  << HelpMessageOpt("-plot-height=<x>", strprintf(_("Plot height in pixel (default: %u)"), DEFAULT_PLOT_HEIGHT))
+                  << HelpMessageOpt("-replayblocks=<file>", _("Also benchmark CheckBlock, the input checks of ConnectBlock and the PoW of every algo on the blocks in <file>, a sequence of height, block and undo data records in disk serialization. Use -testnet or -regtest for blocks of those chains"));
 
         return 0;
     }
 
     SHA256AutoDetect();
+    sph_echo_autodetect();
+    Hash4WayAutoDetect();
+    EhIndexHashAutoDetect();
+    yescrypt_autodetect();
+    yespower_autodetect();
+    neoscrypt_autodetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -55,6 +69,13 @@ main(int argc, char** argv)
 
     double scaling_factor = boost::lexical_cast<double>(scaling_str);
 
+    if (gArgs.IsArgSet("-replayblocks")) {
+        std::string strError;
+        if (!RegisterReplayBenchmarks(gArgs.GetArg("-replayblocks", ""), strError)) {
+            fprintf(stderr, "Error: %s\n", strError.c_str());
+            return EXIT_FAILURE;
+        }
+    }
 
     std::unique_ptr<benchmark::Printer> printer(new benchmark::ConsolePrinter());
     std::string printer_arg = gArgs.GetArg("-printer", DEFAULT_BENCH_PRINTER);
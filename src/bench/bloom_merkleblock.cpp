@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <bloom.h>
+#include <merkleblock.h>
+#include <random.h>
+#include <streams.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+/** Number of SPV peers the block is served to, each with a filter of its own */
+static const int FILTERED_PEERS = 8;
+
+static std::vector<CBloomFilter> PeerFilters()
+{
+    std::vector<CBloomFilter> vFilters;
+    FastRandomContext rng(true);
+    for (int i = 0; i < FILTERED_PEERS; i++) {
+        CBloomFilter filter(20, 0.0001, rng.rand32(), BLOOM_UPDATE_ALL);
+        for (int j = 0; j < 20; j++)
+            filter.insert(rng.randbytes(20));
+        vFilters.push_back(filter);
+    }
+    return vFilters;
+}
+
+// Serve a block as merkleblock to FILTERED_PEERS peers, parsing the scripts
+// of its transactions for every one of them or once for all of them.
+
+static void FilteredBlock(benchmark::State& state, bool fPreparsed)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    const std::vector<CBloomFilter> vFilters = PeerFilters();
+
+    while (state.KeepRunning()) {
+        std::vector<CBloomTxElements> vElements;
+        if (fPreparsed) {
+            vElements.reserve(block.vtx.size());
+            for (const CTransactionRef& tx : block.vtx)
+                vElements.emplace_back(*tx);
+        }
+        for (CBloomFilter filter : vFilters) {
+            CMerkleBlock merkleBlock = fPreparsed ? CMerkleBlock(block, filter, vElements) : CMerkleBlock(block, filter);
+        }
+    }
+}
+
+static void FilteredBlockParsePerPeer(benchmark::State& state)
+{
+    FilteredBlock(state, false);
+}
+
+static void FilteredBlockPreparsed(benchmark::State& state)
+{
+    FilteredBlock(state, true);
+}
+
+BENCHMARK(FilteredBlockParsePerPeer, 50);
+BENCHMARK(FilteredBlockPreparsed, 100);
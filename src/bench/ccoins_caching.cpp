@@ -85,3 +85,30 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Fill a cache with coins, spend half of them and flush it to its (dummy)
+// parent, which is what the coins map does all day while connecting blocks.
+static void CCoinsCacheFill(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CMutableTransaction tx;
+    tx.vout.resize(1000);
+    for (CTxOut& txout : tx.vout) {
+        txout.nValue = CENT;
+        txout.scriptPubKey << OP_1;
+    }
+
+    uint32_t nCounter = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache coins(&coinsDummy);
+        tx.nLockTime = nCounter++;
+        AddCoins(coins, tx, 1);
+        const uint256 txid = tx.GetHash();
+        for (uint32_t n = 0; n < tx.vout.size(); n += 2) {
+            coins.SpendCoin(COutPoint(txid, n));
+        }
+        coins.Flush();
+    }
+}
+
+BENCHMARK(CCoinsCacheFill, 1500);
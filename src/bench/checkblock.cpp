@@ -32,6 +32,25 @@ static void DeserializeBlockTest(benchmark::State& state)
     }
 }
 
+// Same as DeserializeBlockTest, with the transactions allocated from an arena
+static void DeserializeBlockArenaTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        {
+            CBlockArenaScope arena;
+            stream >> block;
+        }
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+    }
+}
+
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
     CDataStream stream((const char*)block_bench::block413567,
@@ -53,4 +72,5 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
 }
 
 BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(DeserializeBlockArenaTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
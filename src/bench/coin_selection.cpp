@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <random.h>
+#include <wallet/coinselection.h>
 #include <wallet/wallet.h>
 
+#include <memory>
 #include <set>
 
 static void addCoin(const CAmount& nValue, const CWallet& wallet, std::vector<COutput>& vCoins)
@@ -58,3 +61,45 @@ static void CoinSelection(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection, 650);
+
+// Compare the coin selection strategies on a large wallet: 20000 coins of
+// assorted round values, and a target some of them add up to exactly.
+static const int LARGE_POOL_SIZE = 20000;
+
+static void CoinSelectionLargePool(benchmark::State& state, const CCoinSelector& selector)
+{
+    const CWallet wallet;
+    std::vector<std::unique_ptr<CWalletTx>> wtxs;
+    std::vector<CInputCoin> vCoins;
+    FastRandomContext rand(true);
+    for (int i = 0; i < LARGE_POOL_SIZE; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = (1 + rand.randrange(10000)) * CENT;
+        wtxs.emplace_back(new CWalletTx(&wallet, MakeTransactionRef(std::move(tx))));
+        vCoins.emplace_back(wtxs.back().get(), 0);
+    }
+    const CAmount nTarget = vCoins[1].txout.nValue + vCoins[2].txout.nValue + vCoins[3].txout.nValue;
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = selector.Select(vCoins, nTarget, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= nTarget);
+    }
+}
+
+static void CoinSelectionKnapsackLargePool(benchmark::State& state)
+{
+    CoinSelectionLargePool(state, CKnapsackSelector());
+}
+
+static void CoinSelectionBnBLargePool(benchmark::State& state)
+{
+    CoinSelectionLargePool(state, CBranchAndBoundSelector(546 /* about the dust threshold of a change output */));
+}
+
+BENCHMARK(CoinSelectionKnapsackLargePool, 5);
+BENCHMARK(CoinSelectionBnBLargePool, 5);
@@ -10,10 +10,12 @@
 #include <random.h>
 #include <uint256.h>
 #include <utiltime.h>
+#include <crypto/hash4way.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
+#include <globaltoken/multihasher.h>
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -52,6 +54,42 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+// Hashes 1024 groups of four 64-byte inputs, like the middle of a chain
+static void Blake512_4way_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(4 * 64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < in.size(); i += 4 * 64)
+            Blake512_4way(&in[i], &in[i], 64);
+    }
+}
+
+static void Skein512_4way_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(4 * 64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < in.size(); i += 4 * 64)
+            Skein512_4way(&in[i], &in[i], 64);
+    }
+}
+
+static void Keccak512_4way_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(4 * 64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < in.size(); i += 4 * 64)
+            Keccak512_4way(&in[i], &in[i], 64);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -69,6 +107,30 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void Multihasher_AllAlgos(benchmark::State& state)
+{
+    // Every algo once per iteration, over an 80 byte header sized buffer.
+    std::vector<uint8_t> in(80, 0);
+    while (state.KeepRunning()) {
+        for (uint8_t nAlgo = 0; nAlgo < NUM_ALGOS_IMPL; nAlgo++) {
+            CMultihasher ss(SER_GETHASH, PROTOCOL_VERSION, nAlgo);
+            ss.write((const char*)in.data(), in.size());
+            *((uint64_t*)in.data()) += ss.GetHash().GetCheapHash();
+        }
+    }
+}
+
+static void Multihasher_SHA256D_Equihash(benchmark::State& state)
+{
+    // Streaming a full Equihash (200,9) header through the bulk SHA256D path.
+    std::vector<uint8_t> in(MULTIHASHER_INLINE_SIZE, 0);
+    while (state.KeepRunning()) {
+        CMultihasher ss(SER_GETHASH, PROTOCOL_VERSION, ALGO_EQUIHASH);
+        ss.write((const char*)in.data(), in.size());
+        *((uint64_t*)in.data()) += ss.GetHash().GetCheapHash();
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -93,6 +155,12 @@ BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(Blake512_4way_1024, 500);
+BENCHMARK(Skein512_4way_1024, 500);
+BENCHMARK(Keccak512_4way_1024, 500);
+BENCHMARK(Multihasher_AllAlgos, 5);
+BENCHMARK(Multihasher_SHA256D_Equihash, 200 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -0,0 +1,273 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <activemasternode.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <instantx.h>
+#include <key.h>
+#include <masternode-payments.h>
+#include <masternode-sync.h>
+#include <masternodeman.h>
+#include <net.h>
+#include <netbase.h>
+#include <protocol.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <utiltime.h>
+#include <validation.h>
+#include <version.h>
+
+#include <memory>
+#include <vector>
+
+// The masternode list, payment and InstantSend code at the size of a large
+// network. The masternodes share their keys, which only the signature checks
+// look at, and their collaterals are coins in a throwaway pcoinsTip on top of
+// a chain of bare block indexes that is longer than the list, so all of them
+// are old enough to be paid.
+
+namespace {
+
+/** Synthetic chain and masternode list, torn down again when it goes out of scope */
+class MasternodeBenchSetup
+{
+public:
+    static const int CHAIN_EXTRA_BLOCKS = 1000;
+
+    CKey keyCollateral;
+    CKey keyMasternode;
+    std::vector<COutPoint> vecOutpoints;
+    std::unique_ptr<CConnman> connman;
+
+    explicit MasternodeBenchSetup(int nMasternodes)
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        connman.reset(new CConnman(0x1337, 0x1337));
+        keyCollateral.MakeNewKey(true);
+        keyMasternode.MakeNewKey(true);
+        activeMasternode.keyMasternode = keyMasternode;
+        activeMasternode.pubKeyMasternode = keyMasternode.GetPubKey();
+
+        const int nChainHeight = nMasternodes + CHAIN_EXTRA_BLOCKS;
+        vecHashes.resize(nChainHeight + 1);
+        vecBlocks.resize(nChainHeight + 1);
+        for (int i = 0; i <= nChainHeight; i++) {
+            vecHashes[i] = GetRandHash();
+            vecBlocks[i].nHeight = i;
+            vecBlocks[i].pprev = i ? &vecBlocks[i - 1] : nullptr;
+            vecBlocks[i].phashBlock = &vecHashes[i];
+            vecBlocks[i].BuildSkip();
+        }
+
+        const CScript scriptCollateral = GetScriptForDestination(keyCollateral.GetPubKey().GetID());
+        const CAmount nCollateral = Params().GetConsensus().nMasternodeColleteralPaymentAmount * COIN;
+        {
+            LOCK(cs_main);
+            chainActive.SetTip(&vecBlocks.back());
+            pcoinsTip.reset(new CCoinsViewCache(&viewDummy));
+            for (int i = 0; i < nMasternodes; i++) {
+                COutPoint outpoint(GetRandHash(), 0);
+                pcoinsTip->AddCoin(outpoint, Coin(CTxOut(nCollateral, scriptCollateral), 1, false), false);
+                vecOutpoints.push_back(outpoint);
+            }
+        }
+
+        for (int i = 0; i < nMasternodes; i++) {
+            CService addr = LookupNumeric(strprintf("1.%d.%d.%d", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff).c_str(), Params().GetDefaultPort());
+            CMasternode mn(addr, vecOutpoints[i], keyCollateral.GetPubKey(), keyMasternode.GetPubKey(), PROTOCOL_VERSION);
+            // signed long enough ago to be in the payment queue already
+            mn.sigTime = GetAdjustedTime() - nMasternodes * 2.6 * 60 * 2;
+            mnodeman.Add(mn);
+        }
+
+        masternodeSync.Reset();
+        while (!masternodeSync.IsSynced()) {
+            masternodeSync.SwitchToNextAsset(*connman);
+        }
+    }
+
+    ~MasternodeBenchSetup()
+    {
+        masternodeSync.Reset();
+        mnodeman.Clear();
+        mnpayments.Clear();
+        activeMasternode.keyMasternode = CKey();
+        activeMasternode.pubKeyMasternode = CPubKey();
+        LOCK(cs_main);
+        chainActive.SetTip(nullptr);
+        pcoinsTip.reset();
+    }
+
+    int Height() const { return vecBlocks.size() - 1; }
+    const CBlockIndex* Tip() const { return &vecBlocks.back(); }
+
+    /** The masternodes with the ten best scores at a height, i.e. the ones allowed to vote */
+    std::vector<COutPoint> GetTopRanked(int nBlockHeight, int nMinProtocol)
+    {
+        CMasternodeMan::rank_pair_vec_t vecRanks;
+        assert(mnodeman.GetMasternodeRanks(vecRanks, nBlockHeight, nMinProtocol));
+        std::vector<COutPoint> vecTop;
+        for (size_t i = 0; i < vecRanks.size() && i < 10; i++) {
+            vecTop.push_back(vecRanks[i].second.outpoint);
+        }
+        return vecTop;
+    }
+
+private:
+    CCoinsView viewDummy;
+    std::vector<uint256> vecHashes;
+    std::vector<CBlockIndex> vecBlocks;
+};
+
+/** A peer the vote messages come from */
+std::unique_ptr<CNode> MakeBenchNode()
+{
+    CAddress addr(LookupNumeric("2.0.0.1", Params().GetDefaultPort()), NODE_NETWORK);
+    std::unique_ptr<CNode> pnode(new CNode(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true));
+    pnode->nVersion = PROTOCOL_VERSION;
+    pnode->SetSendVersion(PROTOCOL_VERSION);
+    return pnode;
+}
+
+/** Rank the list for a block it has no scores cached for */
+void MasternodeRanks(benchmark::State& state, int nMasternodes)
+{
+    MasternodeBenchSetup setup(nMasternodes);
+    CMasternodeMan::rank_pair_vec_t vecRanks;
+    int i = 0;
+    while (state.KeepRunning()) {
+        const int nBlockHeight = setup.Height() - (i++ % MasternodeBenchSetup::CHAIN_EXTRA_BLOCKS);
+        assert(mnodeman.GetMasternodeRanks(vecRanks, nBlockHeight));
+    }
+}
+
+/** Pick the next masternode to pay, as CreateNewBlock and the payment votes do */
+void NextMasternodeInQueue(benchmark::State& state, int nMasternodes)
+{
+    MasternodeBenchSetup setup(nMasternodes);
+    int i = 0;
+    while (state.KeepRunning()) {
+        const int nBlockHeight = setup.Height() - (i++ % MasternodeBenchSetup::CHAIN_EXTRA_BLOCKS);
+        int nCount;
+        masternode_info_t mnInfo;
+        assert(mnodeman.GetNextMasternodeInQueueForPayment(nBlockHeight, true, nCount, mnInfo));
+    }
+}
+
+/** Check the whole list, the clock moves on far enough between the runs for every masternode to be due */
+void MasternodeCheckAndRemove(benchmark::State& state, int nMasternodes)
+{
+    MasternodeBenchSetup setup(nMasternodes);
+    int64_t nTime = GetTime();
+    while (state.KeepRunning()) {
+        nTime += MASTERNODE_CHECK_SECONDS;
+        SetMockTime(nTime);
+        mnodeman.CheckAndRemove(*setup.connman);
+    }
+    SetMockTime(0);
+}
+
+/**
+ * Receive the votes of the ten top ranked masternodes for 100 inputs of
+ * transactions we have no lock request for, each run into an empty
+ * CInstantSend. The signatures are checked on this thread.
+ */
+void InstantSendVotes(benchmark::State& state, int nMasternodes)
+{
+    MasternodeBenchSetup setup(nMasternodes);
+    const int nMinProtocol = std::max(MIN_INSTANTSEND_PROTO_VERSION, mnpayments.GetMinMasternodePaymentsProto());
+
+    std::vector<CDataStream> vecMessages;
+    for (int i = 0; i < 100; i++) {
+        // lock inputs of different heights, so the votes are ranked at different blocks
+        const int nCoinHeight = setup.Height() - Params().GetConsensus().nInstantSendConfirmationsRequired - (i % 20);
+        const COutPoint outpoint(GetRandHash(), 0);
+        {
+            LOCK(cs_main);
+            pcoinsTip->AddCoin(outpoint, Coin(CTxOut(COIN, CScript() << OP_TRUE), nCoinHeight, false), false);
+        }
+        const uint256 txHash = GetRandHash();
+        const int nLockInputHeight = nCoinHeight + Params().GetConsensus().nInstantSendConfirmationsRequired - 2;
+        for (const COutPoint& outpointMasternode : setup.GetTopRanked(nLockInputHeight, nMinProtocol)) {
+            CTxLockVote vote(txHash, outpoint, outpointMasternode);
+            assert(vote.Sign());
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << vote;
+            vecMessages.push_back(ss);
+        }
+    }
+
+    std::unique_ptr<CNode> pnode = MakeBenchNode();
+    while (state.KeepRunning()) {
+        CInstantSend is;
+        is.UpdatedBlockTip(setup.Tip());
+        for (const CDataStream& message : vecMessages) {
+            CDataStream vRecv(message);
+            is.ProcessMessage(pnode.get(), NetMsgType::TXLOCKVOTE, vRecv, *setup.connman);
+        }
+    }
+}
+
+/**
+ * Receive the votes of the ten top ranked masternodes for each of the next 20
+ * blocks, each run into an empty CMasternodePayments.
+ */
+void MasternodePaymentVotes(benchmark::State& state, int nMasternodes)
+{
+    MasternodeBenchSetup setup(nMasternodes);
+    const CScript payee = GetScriptForDestination(setup.keyCollateral.GetPubKey().GetID());
+
+    std::vector<CDataStream> vecMessages;
+    for (int nBlockHeight = setup.Height() + 1; nBlockHeight <= setup.Height() + 20; nBlockHeight++) {
+        for (const COutPoint& outpointMasternode : setup.GetTopRanked(nBlockHeight - 101, mnpayments.GetMinMasternodePaymentsProto())) {
+            CMasternodePaymentVote vote(outpointMasternode, nBlockHeight, payee);
+            assert(vote.Sign());
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << vote;
+            vecMessages.push_back(ss);
+        }
+    }
+
+    std::unique_ptr<CNode> pnode = MakeBenchNode();
+    while (state.KeepRunning()) {
+        CMasternodePayments payments;
+        payments.UpdatedBlockTip(setup.Tip(), *setup.connman);
+        for (const CDataStream& message : vecMessages) {
+            CDataStream vRecv(message);
+            payments.ProcessMessage(pnode.get(), NetMsgType::MASTERNODEPAYMENTVOTE, vRecv, *setup.connman);
+        }
+    }
+}
+
+/** Registers every benchmark above for a mid-sized and a large network */
+class MasternodeBenchRegistrar
+{
+public:
+    MasternodeBenchRegistrar()
+    {
+        for (int nMasternodes : {5000, 50000}) {
+            const std::string strSuffix = "_" + std::to_string(nMasternodes);
+            const int nScale = nMasternodes / 5000;
+            benchmark::BenchRunner("MasternodeRanks" + strSuffix,
+                [nMasternodes](benchmark::State& state) { MasternodeRanks(state, nMasternodes); }, 200 / nScale);
+            benchmark::BenchRunner("NextMasternodeInQueue" + strSuffix,
+                [nMasternodes](benchmark::State& state) { NextMasternodeInQueue(state, nMasternodes); }, 200 / nScale);
+            benchmark::BenchRunner("MasternodeCheckAndRemove" + strSuffix,
+                [nMasternodes](benchmark::State& state) { MasternodeCheckAndRemove(state, nMasternodes); }, 50 / nScale);
+            benchmark::BenchRunner("InstantSendVotes" + strSuffix,
+                [nMasternodes](benchmark::State& state) { InstantSendVotes(state, nMasternodes); }, 10);
+            benchmark::BenchRunner("MasternodePaymentVotes" + strSuffix,
+                [nMasternodes](benchmark::State& state) { MasternodePaymentVotes(state, nMasternodes); }, 20);
+        }
+    }
+};
+
+} // namespace
+
+static MasternodeBenchRegistrar g_masternode_bench_registrar;
@@ -111,4 +111,38 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// Add a long chain of transactions each spending the previous one, confirm
+// its first transactions one by one and evict the rest, so every step walks
+// the whole chain of ancestors or descendants.
+static void MempoolLongChain(benchmark::State& state)
+{
+    const unsigned int nChainLength = 100;
+    std::vector<CTransactionRef> vChain;
+    uint256 hashPrev;
+    for (unsigned int i = 0; i < nChainLength; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 0);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = (nChainLength - i) * COIN;
+        vChain.push_back(MakeTransactionRef(tx));
+        hashPrev = vChain.back()->GetHash();
+    }
+
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vChain) {
+            AddTx(*tx, 1000LL, pool);
+        }
+        for (unsigned int i = 0; i < 10; i++) {
+            pool.removeForBlock({vChain[i]}, 1);
+        }
+        pool.removeRecursive(*vChain[10]);
+    }
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolLongChain, 200);
@@ -0,0 +1,73 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const int TXS_PER_BLOCK = 100;
+
+static std::vector<CTransactionRef> MakeTransactions()
+{
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < TXS_PER_BLOCK; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.nLockTime = i;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+// Feed the estimator one block worth of transactions at the tip height and
+// confirm them all in the next block.
+static void AddBlock(CBlockPolicyEstimator& estimator, const std::vector<CTransactionRef>& txs, unsigned int nHeight)
+{
+    LockPoints lp;
+    std::vector<CTxMemPoolEntry> entries;
+    entries.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        entries.emplace_back(txs[i], CAmount(1000 + 500 * (i % 40)), 0, nHeight, false, 4, lp);
+        estimator.processTransaction(entries.back(), true);
+    }
+    std::vector<const CTxMemPoolEntry*> block;
+    for (const CTxMemPoolEntry& entry : entries) {
+        block.push_back(&entry);
+    }
+    estimator.processBlock(nHeight + 1, block);
+}
+
+static void PolicyEstimatorProcessBlock(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    const std::vector<CTransactionRef> txs = MakeTransactions();
+    unsigned int nHeight = 0;
+    while (state.KeepRunning()) {
+        AddBlock(estimator, txs, nHeight++);
+    }
+}
+
+static void PolicyEstimatorSmartFee(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    const std::vector<CTransactionRef> txs = MakeTransactions();
+    for (unsigned int nHeight = 0; nHeight < 200; nHeight++) {
+        AddBlock(estimator, txs, nHeight);
+    }
+    while (state.KeepRunning()) {
+        for (int target = 1; target <= 50; target++) {
+            estimator.estimateSmartFee(target, nullptr, false);
+            estimator.estimateSmartFee(target, nullptr, true);
+        }
+    }
+}
+
+BENCHMARK(PolicyEstimatorProcessBlock, 2000);
+BENCHMARK(PolicyEstimatorSmartFee, 50000);
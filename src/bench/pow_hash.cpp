@@ -0,0 +1,125 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/common.h>
+#include <globaltoken/multihasher.h>
+#include <globaltoken/powalgorithm.h>
+#include <primitives/pureheader.h>
+
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
+/** Peak resident set size of this process in KiB, or 0 if unknown. */
+static double GetPeakRSSKiB()
+{
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024.0; // bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+/**
+ * Hash a block header with the given algo through CPureBlockHeader::GetPoWHash.
+ * Besides the timings this reports hashes per second and how far the peak
+ * resident memory of the process grew. The latter is only meaningful when the
+ * algo is benchmarked on its own, e.g. -filter=PoWHash_argon2d.
+ */
+static void PoWHash(benchmark::State& state, uint8_t nAlgo)
+{
+    CPureBlockHeader header;
+    header.nVersion = 4;
+    header.SetAlgo(nAlgo);
+    header.nTime = 1577365200;
+    header.nBits = 0x1e0fffff;
+    if (IsEquihashBasedAlgo(nAlgo)) {
+        // Size of an Equihash (200,9) solution, the PoW hash of these algos is the SHA256D of the full header.
+        header.nSolution.resize(1344);
+    }
+    const int nHashVersion = LoadMultiHasherVersionFlags(true);
+
+    const double nPeakRSSBefore = GetPeakRSSKiB();
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.nBigNonce = header.GetPoWHash(SER_GETHASH, nHashVersion);
+    }
+
+    const double nMedian = state.GetMedianElapsed();
+    if (nMedian > 0)
+        state.counters["hashes/s"] = 1.0 / nMedian;
+    state.counters["peak_rss_growth_kib"] = GetPeakRSSKiB() - nPeakRSSBefore;
+}
+
+/**
+ * Hash an 80 byte header with one of the neoscrypt engines built in, whether
+ * or not neoscrypt_autodetect() selects it on this CPU.
+ */
+static void NeoscryptEngine(benchmark::State& state, neoscrypt_engine_t hash)
+{
+    unsigned char input[80] = {}, output[32];
+    uint32_t nNonce = 0;
+    while (state.KeepRunning()) {
+        WriteLE32(input + 76, ++nNonce);
+        hash(input, output, 0x0);
+    }
+}
+
+/**
+ * Hash the 512 indices of an Equihash (200,9) solution from the state after
+ * the header, as CheckEquihashSolution does, with the implementation
+ * EhIndexHashAutoDetect() selected.
+ */
+static void EquihashIndexHashes(benchmark::State& state)
+{
+    unsigned char input[140] = {};
+    eh_IndexHashState base_state;
+    EhInitialiseState(200, 9, base_state, "ZcashPoW");
+    blake2b_update(&base_state, input, sizeof(input));
+
+    std::vector<eh_index> g(512);
+    std::vector<unsigned char> hashes(g.size() * 50);
+    eh_index nIndex = 0;
+    while (state.KeepRunning()) {
+        for (eh_index& i : g) i = nIndex++ & 0xfffff;
+        GenerateHashes(base_state, g.data(), g.size(), hashes.data(), 50);
+    }
+}
+
+namespace {
+
+/** Registers one PoWHash_<algo> benchmark per implemented algo, and one Neoscrypt_<engine> per neoscrypt engine. */
+class PoWHashBenchRegistrar
+{
+public:
+    PoWHashBenchRegistrar()
+    {
+        for (uint8_t nAlgo = 0; nAlgo < NUM_ALGOS_IMPL; nAlgo++) {
+            benchmark::BenchRunner("PoWHash_" + GetAlgoName(nAlgo),
+                [nAlgo](benchmark::State& state) { PoWHash(state, nAlgo); },
+                GetAlgoDescriptor(nAlgo).nScratchBytes > 0 ? 20 : 2000);
+        }
+
+        const char* name;
+        for (unsigned int i = 0; neoscrypt_engine_t hash = neoscrypt_get_engine(i, &name); i++) {
+            benchmark::BenchRunner(std::string("Neoscrypt_") + name,
+                [hash](benchmark::State& state) { NeoscryptEngine(state, hash); }, 3000);
+        }
+    }
+};
+
+} // namespace
+
+static PoWHashBenchRegistrar g_pow_hash_bench_registrar;
+
+BENCHMARK(EquihashIndexHashes, 500);
@@ -0,0 +1,173 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/replay_blocks.h>
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <chainparamsbase.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <consensus/tx_verify.h>
+#include <consensus/validation.h>
+#include <globaltoken/powalgorithm.h>
+#include <pow.h>
+#include <script/sigcache.h>
+#include <streams.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks);
+
+namespace {
+
+/** A block to replay, with the coins it spends */
+struct ReplayBlock
+{
+    int nHeight;
+    CBlock block;
+    CBlockUndo undo;
+};
+
+std::vector<ReplayBlock> g_replay_blocks;
+
+/**
+ * Script flags of a block at the given height. The deployments that need the
+ * block index to evaluate (CSV and segwit) are taken as active, which holds
+ * for any recent range of blocks.
+ */
+unsigned int ReplayScriptFlags(int nHeight, const Consensus::Params& consensusParams)
+{
+    unsigned int flags = SCRIPT_VERIFY_CHECKSEQUENCEVERIFY | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_NULLDUMMY;
+    if (nHeight >= consensusParams.BIP16Height)
+        flags |= SCRIPT_VERIFY_P2SH;
+    if (nHeight >= consensusParams.BIP66Height)
+        flags |= SCRIPT_VERIFY_DERSIG;
+    if (nHeight >= consensusParams.BIP65Height)
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return flags;
+}
+
+/** CheckBlock of one block after the other, without the PoW which ReplayPoW_<algo> measures */
+void ReplayCheckBlock(benchmark::State& state)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const CBlock& block = g_replay_blocks[i++ % g_replay_blocks.size()].block;
+        block.fChecked = false;
+        CValidationState validationState;
+        assert(CheckBlock(block, validationState, consensusParams, false));
+    }
+}
+
+/**
+ * The UTXO work of ConnectBlock for one block after the other: fill a
+ * throwaway coins view with the coins the block spends, then check the inputs
+ * and scripts of every transaction and apply it to the view. The checks that
+ * need the block index or the masternode state (sequence locks, block reward
+ * and payee) are left out.
+ */
+void ReplayConnectBlock(benchmark::State& state)
+{
+    const CChainParams& chainparams = Params();
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const ReplayBlock& replay = g_replay_blocks[i++ % g_replay_blocks.size()];
+        const unsigned int flags = ReplayScriptFlags(replay.nHeight, chainparams.GetConsensus());
+
+        CCoinsView viewDummy;
+        CCoinsViewCache view(&viewDummy);
+        for (size_t j = 1; j < replay.block.vtx.size(); j++) {
+            const CTransaction& tx = *replay.block.vtx[j];
+            const CTxUndo& txundo = replay.undo.vtxundo[j - 1];
+            for (size_t k = 0; k < tx.vin.size(); k++) {
+                Coin coin = txundo.vprevout[k];
+                view.AddCoin(tx.vin[k].prevout, std::move(coin), true);
+            }
+        }
+
+        for (const auto& ptx : replay.block.vtx) {
+            const CTransaction& tx = *ptx;
+            if (!tx.IsCoinBase()) {
+                CValidationState validationState;
+                CAmount txfee = 0;
+                assert(Consensus::CheckTxInputs(tx, validationState, view, replay.nHeight, txfee, chainparams));
+                PrecomputedTransactionData txdata(tx);
+                assert(CheckInputs(tx, validationState, view, true, flags, false, false, txdata, nullptr));
+            }
+            UpdateCoins(tx, view, replay.nHeight);
+        }
+    }
+}
+
+/** CheckProofOfWork of the blocks mined with one algo, auxpow included */
+void ReplayPoW(benchmark::State& state, const std::vector<const CBlock*>& vBlocks)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        assert(CheckProofOfWork(*vBlocks[i++ % vBlocks.size()], consensusParams));
+    }
+}
+
+} // namespace
+
+bool RegisterReplayBenchmarks(const std::string& strPath, std::string& strError)
+{
+    try {
+        SelectParams(ChainNameFromCommandLine());
+    } catch (const std::exception& e) {
+        strError = e.what();
+        return false;
+    }
+
+    CAutoFile file(fopen(strPath.c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "Unable to open " + strPath;
+        return false;
+    }
+    try {
+        int c;
+        while ((c = fgetc(file.Get())) != EOF) {
+            ungetc(c, file.Get());
+            ReplayBlock replay;
+            file >> replay.nHeight >> replay.block >> replay.undo;
+            if (replay.undo.vtxundo.size() + 1 != replay.block.vtx.size()) {
+                strError = strprintf("Undo data does not match block %s", replay.block.GetHash().ToString());
+                return false;
+            }
+            g_replay_blocks.push_back(std::move(replay));
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Failed to read %s: %s", strPath, e.what());
+        return false;
+    }
+    if (g_replay_blocks.empty()) {
+        strError = "No blocks in " + strPath;
+        return false;
+    }
+
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
+    std::map<uint8_t, std::vector<const CBlock*> > mapBlocksByAlgo;
+    for (const ReplayBlock& replay : g_replay_blocks) {
+        mapBlocksByAlgo[replay.block.GetAlgo()].push_back(&replay.block);
+    }
+
+    benchmark::BenchRunner("ReplayCheckBlock", ReplayCheckBlock, 500);
+    benchmark::BenchRunner("ReplayConnectBlock", ReplayConnectBlock, 50);
+    for (const auto& entry : mapBlocksByAlgo) {
+        const std::vector<const CBlock*>& vBlocks = entry.second;
+        benchmark::BenchRunner("ReplayPoW_" + GetAlgoName(entry.first),
+            [vBlocks](benchmark::State& state) { ReplayPoW(state, vBlocks); },
+            GetAlgoDescriptor(entry.first).nScratchBytes > 0 ? 20 : 2000);
+    }
+    return true;
+}
@@ -0,0 +1,17 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_REPLAY_BLOCKS_H
+#define BITCOIN_BENCH_REPLAY_BLOCKS_H
+
+#include <string>
+
+/**
+ * Read the blocks to replay from a file of (int32 height, CBlock, CBlockUndo)
+ * records in disk serialization, and register the Replay* benchmarks for
+ * them. The chain is the one selected by -testnet/-regtest.
+ */
+bool RegisterReplayBenchmarks(const std::string& strPath, std::string& strError);
+
+#endif // BITCOIN_BENCH_REPLAY_BLOCKS_H
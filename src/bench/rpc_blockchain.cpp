@@ -0,0 +1,65 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <core_io.h>
+#include <jsonwriter.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <univalue.h>
+#include <uint256.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// The transactions of a block described as getblock with verbosity 2 does,
+// once through a UniValue tree and once written straight to JSON text.
+
+static CBlock ReadBenchBlock()
+{
+    SelectParams(CBaseChainParams::MAIN);
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    return block;
+}
+
+static void BlockTxToUniv(benchmark::State& state)
+{
+    const CBlock block = ReadBenchBlock();
+
+    while (state.KeepRunning()) {
+        UniValue txs(UniValue::VARR);
+        for (const auto& tx : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToUniv(*tx, uint256(), objTx, true);
+            txs.push_back(objTx);
+        }
+        std::string strJSON = txs.write();
+        assert(!strJSON.empty());
+    }
+}
+
+static void BlockTxToJSON(benchmark::State& state)
+{
+    const CBlock block = ReadBenchBlock();
+
+    while (state.KeepRunning()) {
+        std::string strJSON;
+        CJSONWriter writer(strJSON);
+        writer.BeginArray();
+        for (const auto& tx : block.vtx)
+            TxToJSON(*tx, uint256(), writer, true);
+        writer.EndArray();
+        assert(!strJSON.empty());
+    }
+}
+
+BENCHMARK(BlockTxToUniv, 10);
+BENCHMARK(BlockTxToJSON, 10);
@@ -0,0 +1,48 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <rpc/server.h>
+#include <univalue.h>
+#include <utilstrencodings.h>
+
+#include <vector>
+
+// Parsing the body of a request, as the HTTP server does before the call:
+// UniValue::read and JSONRPCRequest::parse on a large hex parameter.
+
+static std::string MakeRequestBody(const std::string& strMethod, size_t nBytes)
+{
+    std::vector<unsigned char> vData(nBytes);
+    for (size_t i = 0; i < nBytes; i++)
+        vData[i] = i * 7;
+    return "{\"jsonrpc\":\"1.0\",\"id\":\"bench\",\"method\":\"" + strMethod + "\",\"params\":[\"" + HexStr(vData) + "\"]}";
+}
+
+static void ParseRequest(benchmark::State& state, const std::string& strBody)
+{
+    while (state.KeepRunning()) {
+        UniValue valRequest;
+        bool fRead = valRequest.read(strBody);
+        assert(fRead);
+        JSONRPCRequest jreq;
+        jreq.parse(valRequest);
+        assert(jreq.params[0].get_str().size() > 0);
+    }
+}
+
+// A transaction of 10 kB and a 400 kB block, the size of an Equihash block with its solution
+static void RPCParseSendRawTransaction(benchmark::State& state)
+{
+    ParseRequest(state, MakeRequestBody("sendrawtransaction", 10000));
+}
+
+static void RPCParseSubmitBlock(benchmark::State& state)
+{
+    ParseRequest(state, MakeRequestBody("submitblock", 400000));
+}
+
+BENCHMARK(RPCParseSendRawTransaction, 1000);
+BENCHMARK(RPCParseSubmitBlock, 50);
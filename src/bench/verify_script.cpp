@@ -7,8 +7,10 @@
 #if defined(HAVE_CONSENSUS_LIB)
 #include <script/bitcoinconsensus.h>
 #endif
+#include <policy/policy.h>
 #include <script/script.h>
 #include <script/sign.h>
+#include <script/standard.h>
 #include <streams.h>
 
 #include <array>
@@ -105,4 +107,73 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+static CKey BenchKey(unsigned char n)
+{
+    std::array<unsigned char, 32> vchKey{};
+    vchKey[31] = n;
+    CKey key;
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    return key;
+}
+
+static void VerifyScriptSpend(benchmark::State& state, const CScript& scriptPubKey, const CScript& scriptSig, const CMutableTransaction& txSpend, const CTransaction& txCredit)
+{
+    const int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(
+            scriptSig,
+            scriptPubKey,
+            &txSpend.vin[0].scriptWitness,
+            flags,
+            MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue),
+            &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
+// P2PKH spend, the most common script on chain.
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    CKey key = BenchKey(1);
+    CPubKey pubkey = key.GetPubKey();
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkey.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    std::vector<unsigned char> vchSig;
+    key.Sign(SignatureHash(scriptPubKey, txSpend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE), vchSig);
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+
+    VerifyScriptSpend(state, scriptPubKey, txSpend.vin[0].scriptSig, txSpend, txCredit);
+}
+
+// 2-of-3 multisig wrapped in P2SH, as the treasury outputs are.
+static void VerifyScriptP2SHMultisig(benchmark::State& state)
+{
+    std::vector<CKey> keys = {BenchKey(1), BenchKey(2), BenchKey(3)};
+    CScript redeemScript = CScript() << OP_2;
+    for (const CKey& key : keys)
+        redeemScript << ToByteVector(key.GetPubKey());
+    redeemScript << OP_3 << OP_CHECKMULTISIG;
+    CScript scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    CTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    uint256 hash = SignatureHash(redeemScript, txSpend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    CScript scriptSig = CScript() << OP_0;
+    for (int i : {0, 2}) {
+        std::vector<unsigned char> vchSig;
+        keys[i].Sign(hash, vchSig);
+        vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        scriptSig << vchSig;
+    }
+    scriptSig << ToByteVector(redeemScript);
+    txSpend.vin[0].scriptSig = scriptSig;
+
+    VerifyScriptSpend(state, scriptPubKey, txSpend.vin[0].scriptSig, txSpend, txCredit);
+}
+
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptP2PKH, 6300);
+BENCHMARK(VerifyScriptP2SHMultisig, 3000);
@@ -0,0 +1,279 @@
+// Copyright (c) 2012-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <random.h>
+#include <streams.h>
+#include <univalue.h>
+#include <validation.h>
+#include <wallet/coincontrol.h>
+#include <wallet/db.h>
+#include <wallet/rpcwallet.h>
+#include <wallet/wallet.h>
+
+#include <memory>
+#include <vector>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// Benchmarks of the wallet operations whose cost grows with the size of the
+// wallet, on synthetic wallets of 10k, 100k and 1M transactions.
+
+//! Blocks in the active chain the synthetic transactions are confirmed in
+static const int BENCH_CHAIN_BLOCKS = 1000;
+//! Keys the synthetic transactions pay to
+static const int BENCH_WALLET_KEYS = 100;
+
+namespace {
+/** Block indexes set as chainActive for as long as this exists, there are no blocks behind them. */
+class BenchChain
+{
+public:
+    BenchChain()
+    {
+        CBlockIndex* pprev = nullptr;
+        for (int i = 0; i < BENCH_CHAIN_BLOCKS; i++) {
+            std::unique_ptr<CBlockIndex> pindex(new CBlockIndex);
+            pindex->nHeight = i;
+            pindex->nTime = 1500000000 + i * 60;
+            pindex->pprev = pprev;
+            pindex->phashBlock = &mapBlockIndex.emplace(GetRandHash(), pindex.get()).first->first;
+            pindex->BuildSkip();
+            pprev = pindex.get();
+            vIndexes.push_back(std::move(pindex));
+        }
+        LOCK(cs_main);
+        chainActive.SetTip(pprev);
+    }
+
+    ~BenchChain()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(nullptr);
+        for (const auto& pindex : vIndexes)
+            mapBlockIndex.erase(pindex->GetBlockHash());
+    }
+
+    const CBlockIndex* operator[](int nHeight) const { return vIndexes[nHeight].get(); }
+
+private:
+    std::vector<std::unique_ptr<CBlockIndex>> vIndexes;
+};
+
+/**
+ * A wallet with nTxs confirmed transactions paying 1 coin to it. With
+ * fSpends, every tenth transaction instead spends the one before it, half
+ * of it to an outside address and the rest back to the wallet.
+ */
+class BenchWallet
+{
+public:
+    BenchWallet(int nTxs, bool fSpends, std::unique_ptr<CWalletDBWrapper> dbw = nullptr)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+
+        // Without a database the writes do nothing, there is nothing to load either
+        if (dbw) {
+            wallet.reset(new CWallet(std::move(dbw)));
+            bool fFirstRun;
+            wallet->LoadWallet(fFirstRun);
+        } else {
+            wallet.reset(new CWallet());
+        }
+
+        std::vector<CScript> vScripts;
+        {
+            LOCK(wallet->cs_wallet);
+            for (int i = 0; i < BENCH_WALLET_KEYS; i++) {
+                CKey key;
+                key.MakeNewKey(true);
+                wallet->AddKeyPubKey(key, key.GetPubKey());
+                vScripts.push_back(GetScriptForDestination(key.GetPubKey().GetID()));
+            }
+        }
+        CKey keyExternal;
+        keyExternal.MakeNewKey(true);
+        const CScript scriptExternal = GetScriptForDestination(keyExternal.GetPubKey().GetID());
+
+        FastRandomContext rand(true);
+        uint256 hashPrev;
+        for (int i = 0; i < nTxs; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            if (fSpends && i % 10 == 9) {
+                mtx.vin[0].prevout = COutPoint(hashPrev, 0);
+                mtx.vout.emplace_back(COIN / 2, scriptExternal);
+                mtx.vout.emplace_back(COIN / 2 - 1000, vScripts[i % BENCH_WALLET_KEYS]);
+            } else {
+                mtx.vin[0].prevout = COutPoint(rand.rand256(), 0);
+                mtx.vout.emplace_back(COIN, vScripts[i % BENCH_WALLET_KEYS]);
+            }
+            CWalletTx wtx(wallet.get(), MakeTransactionRef(std::move(mtx)));
+            // Leave the last blocks empty, so every coin has enough confirmations to be spent
+            wtx.SetMerkleBranch(chain[1 + (int64_t)i * (BENCH_CHAIN_BLOCKS - 10) / nTxs], i);
+            hashPrev = wtx.GetHash();
+            wallet->AddToWallet(wtx, false);
+        }
+    }
+
+    BenchChain chain;
+    std::unique_ptr<CWallet> wallet;
+};
+} // namespace
+
+// The balance and coin benchmarks mark the wallet dirty every time, to
+// measure the pass over all transactions and not the cached totals.
+static void WalletGetBalance(benchmark::State& state, int nTxs)
+{
+    BenchWallet bench(nTxs, true);
+    CWallet& wallet = *bench.wallet;
+
+    while (state.KeepRunning()) {
+        wallet.MarkDirty();
+        CAmount nBalance = wallet.GetBalance();
+        assert(nBalance > 0);
+    }
+}
+
+static void WalletAvailableCoins(benchmark::State& state, int nTxs)
+{
+    BenchWallet bench(nTxs, true);
+    CWallet& wallet = *bench.wallet;
+
+    while (state.KeepRunning()) {
+        wallet.MarkDirty();
+        std::vector<COutput> vCoins;
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.AvailableCoins(vCoins);
+        assert(!vCoins.empty());
+    }
+}
+
+// Like listtransactions "*" with a count that covers the whole wallet
+static void WalletListTransactions(benchmark::State& state, int nTxs)
+{
+    BenchWallet bench(nTxs, true);
+    CWallet& wallet = *bench.wallet;
+
+    while (state.KeepRunning()) {
+        UniValue ret(UniValue::VARR);
+        LOCK2(cs_main, wallet.cs_wallet);
+        for (const auto& entry : wallet.wtxOrdered) {
+            if (entry.second.first)
+                ListTransactions(&wallet, *entry.second.first, "*", 0, true, ret, ISMINE_SPENDABLE);
+        }
+        assert(ret.size() >= (size_t)nTxs);
+    }
+}
+
+// Reads the records written through a mock (in memory) database back into a
+// new wallet every time.
+static void WalletLoadWallet(benchmark::State& state, int nTxs)
+{
+    bitdb.MakeMock();
+    {
+        BenchWallet bench(nTxs, true, std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_bench.dat")));
+        bench.wallet.reset();
+
+        while (state.KeepRunning()) {
+            CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_bench.dat")));
+            bool fFirstRun;
+            DBErrors nLoadWalletRet = wallet.LoadWallet(fFirstRun);
+            assert(nLoadWalletRet == DB_LOAD_OK);
+            assert(wallet.mapWallet.size() == (size_t)nTxs);
+        }
+    }
+    bitdb.Flush(true);
+    bitdb.Reset();
+}
+
+// What connecting a block costs a wallet with many keys: the IsMine check of
+// every output, which for a wallet that is not involved all come out ISMINE_NO.
+static void WalletIsMineBlock(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    CWallet wallet;
+    {
+        LOCK(wallet.cs_wallet);
+        for (int i = 0; i < 1000; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            wallet.AddKeyPubKey(key, key.GetPubKey());
+        }
+    }
+
+    while (state.KeepRunning()) {
+        int nMine = 0;
+        for (const CTransactionRef& tx : block.vtx) {
+            for (const CTxOut& txout : tx->vout) {
+                if (wallet.IsMine(txout) != ISMINE_NO)
+                    nMine++;
+            }
+        }
+        assert(nMine == 0);
+    }
+}
+
+// Sends the whole balance of a wallet of 500 coins, so every one of them is
+// selected and signed for.
+static void WalletCreateTransaction500Inputs(benchmark::State& state)
+{
+    BenchWallet bench(500, false);
+    CWallet& wallet = *bench.wallet;
+
+    CKey keyRecipient;
+    keyRecipient.MakeNewKey(true);
+    std::vector<CRecipient> vecSend = {{GetScriptForDestination(keyRecipient.GetPubKey().GetID()), 500 * COIN, true}};
+    CCoinControl coin_control;
+    // Change to a key the wallet has, so the keypool is left alone
+    coin_control.destChange = CTxDestination(*wallet.GetKeys().begin());
+
+    while (state.KeepRunning()) {
+        CWalletTx wtx;
+        CReserveKey reservekey(&wallet);
+        CAmount nFeeRet;
+        int nChangePosInOut = -1;
+        std::string strFailReason;
+        bool success = wallet.CreateTransaction(vecSend, wtx, reservekey, nFeeRet, nChangePosInOut, strFailReason, coin_control);
+        assert(success);
+        assert(wtx.tx->vin.size() == 500);
+    }
+}
+
+static void WalletGetBalance10K(benchmark::State& state) { WalletGetBalance(state, 10000); }
+static void WalletGetBalance100K(benchmark::State& state) { WalletGetBalance(state, 100000); }
+static void WalletGetBalance1M(benchmark::State& state) { WalletGetBalance(state, 1000000); }
+static void WalletAvailableCoins10K(benchmark::State& state) { WalletAvailableCoins(state, 10000); }
+static void WalletAvailableCoins100K(benchmark::State& state) { WalletAvailableCoins(state, 100000); }
+static void WalletAvailableCoins1M(benchmark::State& state) { WalletAvailableCoins(state, 1000000); }
+static void WalletListTransactions10K(benchmark::State& state) { WalletListTransactions(state, 10000); }
+static void WalletListTransactions100K(benchmark::State& state) { WalletListTransactions(state, 100000); }
+static void WalletListTransactions1M(benchmark::State& state) { WalletListTransactions(state, 1000000); }
+static void WalletLoadWallet10K(benchmark::State& state) { WalletLoadWallet(state, 10000); }
+static void WalletLoadWallet100K(benchmark::State& state) { WalletLoadWallet(state, 100000); }
+static void WalletLoadWallet1M(benchmark::State& state) { WalletLoadWallet(state, 1000000); }
+
+BENCHMARK(WalletGetBalance10K, 50);
+BENCHMARK(WalletGetBalance100K, 5);
+BENCHMARK(WalletGetBalance1M, 1);
+BENCHMARK(WalletAvailableCoins10K, 50);
+BENCHMARK(WalletAvailableCoins100K, 5);
+BENCHMARK(WalletAvailableCoins1M, 1);
+BENCHMARK(WalletListTransactions10K, 20);
+BENCHMARK(WalletListTransactions100K, 2);
+BENCHMARK(WalletListTransactions1M, 1);
+BENCHMARK(WalletLoadWallet10K, 5);
+BENCHMARK(WalletLoadWallet100K, 1);
+BENCHMARK(WalletLoadWallet1M, 1);
+BENCHMARK(WalletIsMineBlock, 20);
+BENCHMARK(WalletCreateTransaction500Inputs, 5);
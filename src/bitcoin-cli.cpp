@@ -18,6 +18,8 @@
 
 #include <stdio.h>
 
+#include <sstream>
+
 #include <event2/buffer.h>
 #include <event2/keyvalq_struct.h>
 #include <support/events.h>
@@ -26,6 +28,8 @@
 
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
+static const int DEFAULT_RPC_BATCH_SIZE=100;
+static const int DEFAULT_RPC_BATCH_CONCURRENCY=4;
 static const bool DEFAULT_NAMED=false;
 static const int CONTINUE_EXECUTION=-1;
 
@@ -41,6 +45,8 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-getinfo", _("Get general information from the remote server. Note that unlike server-side RPC calls, the results of -getinfo is the result of multiple non-atomic requests. Some entries in the result may represent results from different states (e.g. wallet balance may be as of a different block from the chain state reported)"));
     AppendParamsHelpMessages(strUsage);
     strUsage += HelpMessageOpt("-named", strprintf(_("Pass named instead of positional arguments (default: %s)"), DEFAULT_NAMED));
+    strUsage += HelpMessageOpt("-rpcbatchconcurrency=<n>", strprintf(_("Number of connections -stdinbatch sends its batches over (default: %d)"), DEFAULT_RPC_BATCH_CONCURRENCY));
+    strUsage += HelpMessageOpt("-rpcbatchsize=<n>", strprintf(_("Number of commands -stdinbatch sends in one JSON-RPC batch request (default: %d)"), DEFAULT_RPC_BATCH_SIZE));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
     strUsage += HelpMessageOpt("-rpcconnect=<ip>", strprintf(_("Send commands to node running on <ip> (default: %s)"), DEFAULT_RPCCONNECT));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
@@ -49,6 +55,7 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcwait", _("Wait for RPC server to start"));
     strUsage += HelpMessageOpt("-rpcwallet=<walletname>", _("Send RPC for non-default wallet on RPC server (argument is wallet filename in globaltokend directory, required if globaltokend/-Qt runs with multiple wallets)"));
     strUsage += HelpMessageOpt("-stdin", _("Read extra arguments from standard input, one per line until EOF/Ctrl-D (recommended for sensitive information such as passphrases).  When combined with -stdinrpcpass, the first line from standard input is used for the RPC password."));
+    strUsage += HelpMessageOpt("-stdinbatch", _("Read commands from standard input, one per line until EOF/Ctrl-D, as the command and its arguments separated by whitespace or as a JSON array of them. The commands are sent as JSON-RPC batch requests over keep-alive connections and their replies printed in order, one JSON object per line with the number of the command as id. When combined with -stdinrpcpass, the first line from standard input is used for the RPC password."));
     strUsage += HelpMessageOpt("-stdinrpcpass", strprintf(_("Read RPC password from standard input as a single line.  When combined with -stdin, the first line from standard input is used for the RPC password.")));
 
     return strUsage;
@@ -89,6 +96,7 @@ static int AppInitRPC(int argc, char* argv[])
             strUsage += "\n" + _("Usage:") + "\n" +
                   "  globaltoken-cli [options] <command> [params]  " + strprintf(_("Send command to %s"), _(PACKAGE_NAME)) + "\n" +
                   "  globaltoken-cli [options] -named <command> [name=value] ... " + strprintf(_("Send command to %s (with named arguments)"), _(PACKAGE_NAME)) + "\n" +
+                  "  globaltoken-cli [options] -stdinbatch < commands   " + strprintf(_("Send the commands read from standard input to %s"), _(PACKAGE_NAME)) + "\n" +
                   "  globaltoken-cli [options] help                " + _("List commands") + "\n" +
                   "  globaltoken-cli [options] help <command>      " + _("Get help for a command") + "\n";
 
@@ -286,79 +294,89 @@ public:
     }
 };
 
-static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+/** Where to send requests and the credentials to send them with */
+struct RPCConnectionParams
 {
     std::string host;
+    int port;
+    std::string endpoint;
+    std::string strRPCUserColonPass;
+};
+
+static RPCConnectionParams GetRPCConnectionParams()
+{
+    RPCConnectionParams params;
     // In preference order, we choose the following for the port:
     //     1. -rpcport
     //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
     //     3. default port for chain
-    int port = BaseParams().RPCPort();
-    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
-    port = gArgs.GetArg("-rpcport", port);
-
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
-
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == nullptr)
-        throw std::runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
+    params.port = BaseParams().RPCPort();
+    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), params.port, params.host);
+    params.port = gArgs.GetArg("-rpcport", params.port);
 
     // Get credentials
-    std::string strRPCUserColonPass;
     if (gArgs.GetArg("-rpcpassword", "") == "") {
         // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
+        if (!GetAuthCookie(&params.strRPCUserColonPass)) {
             throw std::runtime_error(strprintf(
                 _("Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.  See -rpcpassword and -stdinrpcpass.  Configuration file: (%s)"),
                     GetConfigFile(gArgs.GetArg("-conf", BITCOIN_CONF_FILENAME)).string().c_str()));
 
         }
     } else {
-        strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+        params.strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
     }
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
     // check if we should use a special wallet endpoint
-    std::string endpoint = "/";
+    params.endpoint = "/";
     std::string walletName = gArgs.GetArg("-rpcwallet", "");
     if (!walletName.empty()) {
         char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
         if (encodedURI) {
-            endpoint = "/wallet/"+ std::string(encodedURI);
+            params.endpoint = "/wallet/"+ std::string(encodedURI);
             free(encodedURI);
         }
         else {
             throw CConnectionFailed("uri-encode failed");
         }
     }
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+    return params;
+}
+
+/**
+ * Queue a POST of strRequest on the connection. Without fKeepAlive the server
+ * closes the connection after replying, with it further requests can follow.
+ */
+static void MakeRPCRequest(struct evhttp_connection* evcon, const RPCConnectionParams& params, const std::string& strRequest, void (*cb)(struct evhttp_request*, void*), HTTPReply* reply, bool fKeepAlive)
+{
+    raii_evhttp_request req = obtain_evhttp_request(cb, (void*)reply);
+    if (req == nullptr)
+        throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
+
+    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+    assert(output_headers);
+    evhttp_add_header(output_headers, "Host", params.host.c_str());
+    evhttp_add_header(output_headers, "Connection", fKeepAlive ? "keep-alive" : "close");
+    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(params.strRPCUserColonPass)).c_str());
+
+    // Attach request data
+    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+    assert(output_buffer);
+    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+    int r = evhttp_make_request(evcon, req.get(), EVHTTP_REQ_POST, params.endpoint.c_str());
     req.release(); // ownership moved to evcon in above call
     if (r != 0) {
         throw CConnectionFailed("send http request failed");
     }
+}
 
-    event_base_dispatch(base.get());
-
+/** Check the HTTP status of a reply that arrived and parse its body */
+static UniValue ParseRPCReply(const HTTPReply& response)
+{
     if (response.status == 0)
         throw CConnectionFailed(strprintf("couldn't connect to server: %s (code %d)\n(make sure server is running and you are connecting to the correct RPC port)", http_errorstring(response.error), response.error));
     else if (response.status == HTTP_UNAUTHORIZED)
@@ -368,17 +386,209 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     else if (response.body.empty())
         throw std::runtime_error("no response from server");
 
-    // Parse reply
     UniValue valReply(UniValue::VSTR);
     if (!valReply.read(response.body))
         throw std::runtime_error("couldn't parse reply from server");
-    const UniValue reply = rh->ProcessReply(valReply);
+    return valReply;
+}
+
+static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+{
+    const RPCConnectionParams params = GetRPCConnectionParams();
+
+    // Obtain event base
+    raii_event_base base = obtain_event_base();
+
+    // Synchronously look up hostname
+    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), params.host, params.port);
+    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+    HTTPReply response;
+    const std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
+    MakeRPCRequest(evcon.get(), params, strRequest, http_request_done, &response, false);
+
+    event_base_dispatch(base.get());
+
+    // Parse reply
+    const UniValue reply = rh->ProcessReply(ParseRPCReply(response));
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
 
     return reply;
 }
 
+/** Reply to one JSON-RPC batch of -stdinbatch, the last one to arrive ends the event loop */
+struct HTTPBatchReply : public HTTPReply
+{
+    struct event_base* base;
+    size_t* pnPending;
+};
+
+static void http_batch_request_done(struct evhttp_request *req, void *ctx)
+{
+    http_request_done(req, ctx);
+    HTTPBatchReply *reply = static_cast<HTTPBatchReply*>(static_cast<HTTPReply*>(ctx));
+    // Idle keep-alive connections would keep event_base_dispatch running
+    if (--*reply->pnPending == 0) {
+        event_base_loopbreak(reply->base);
+    }
+}
+
+/**
+ * Split a -stdinbatch line into the method and its arguments. The line is
+ * either a JSON array, for arguments with whitespace in them, or words
+ * separated by whitespace.
+ */
+static std::vector<std::string> ParseBatchCommand(const std::string& line)
+{
+    std::vector<std::string> command;
+    const size_t nStart = line.find_first_not_of(" \t\r");
+    if (nStart != std::string::npos && line[nStart] == '[') {
+        UniValue val;
+        if (!val.read(line) || !val.isArray()) {
+            throw std::runtime_error("invalid JSON array: " + line);
+        }
+        for (size_t i = 0; i < val.size(); i++) {
+            command.push_back(val[i].isStr() ? val[i].get_str() : val[i].write());
+        }
+    } else {
+        std::istringstream ss(line);
+        std::string word;
+        while (ss >> word) {
+            command.push_back(word);
+        }
+    }
+    return command;
+}
+
+/**
+ * Send the commands as JSON-RPC batches of -rpcbatchsize commands, over
+ * -rpcbatchconcurrency keep-alive connections that each have their share of
+ * the batches queued on them. Returns one reply per command, in order, with
+ * the index of the command as id. Commands whose batch got no reply have a
+ * connection error as theirs; if no batch got one, CConnectionFailed is thrown
+ * so -rpcwait can retry.
+ */
+static std::vector<UniValue> CallRPCBatch(const std::vector<std::vector<std::string> >& commands)
+{
+    const RPCConnectionParams params = GetRPCConnectionParams();
+    const size_t nBatchSize = std::max<int64_t>(1, gArgs.GetArg("-rpcbatchsize", DEFAULT_RPC_BATCH_SIZE));
+    const size_t nBatches = (commands.size() + nBatchSize - 1) / nBatchSize;
+    const size_t nConnections = std::min<size_t>(nBatches, std::max<int64_t>(1, gArgs.GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY)));
+    const bool fNamed = gArgs.GetBoolArg("-named", DEFAULT_NAMED);
+
+    std::vector<UniValue> replies(commands.size());
+    std::vector<std::string> vRequests(nBatches);
+    for (size_t nBatch = 0; nBatch < nBatches; nBatch++) {
+        UniValue batch(UniValue::VARR);
+        for (size_t i = nBatch * nBatchSize; i < std::min(commands.size(), (nBatch + 1) * nBatchSize); i++) {
+            // Commands the client cannot convert get their error without being sent
+            try {
+                const std::string& method = commands[i][0];
+                const std::vector<std::string> args(commands[i].begin() + 1, commands[i].end());
+                const UniValue rpcParams = fNamed ? RPCConvertNamedValues(method, args) : RPCConvertValues(method, args);
+                batch.push_back(JSONRPCRequestObj(method, rpcParams, i - nBatch * nBatchSize));
+            } catch (const std::exception& e) {
+                replies[i] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INVALID_PARAMS, e.what()), i);
+            }
+        }
+        if (!batch.empty()) {
+            vRequests[nBatch] = batch.write() + "\n";
+        }
+    }
+
+    raii_event_base base = obtain_event_base();
+    std::vector<raii_evhttp_connection> vConnections;
+    for (size_t i = 0; i < nConnections; i++) {
+        vConnections.push_back(obtain_evhttp_connection_base(base.get(), params.host, params.port));
+        evhttp_connection_set_timeout(vConnections.back().get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+    }
+
+    std::vector<HTTPBatchReply> vResponses(nBatches);
+    size_t nPending = 0;
+    size_t nSent = 0;
+    for (size_t nBatch = 0; nBatch < nBatches; nBatch++) {
+        if (vRequests[nBatch].empty()) continue;
+        vResponses[nBatch].base = base.get();
+        vResponses[nBatch].pnPending = &nPending;
+        MakeRPCRequest(vConnections[nBatch % nConnections].get(), params, vRequests[nBatch], http_batch_request_done, &vResponses[nBatch], true);
+        nPending++;
+        nSent++;
+    }
+
+    if (nSent > 0) {
+        event_base_dispatch(base.get());
+    }
+
+    bool fConnected = nSent == 0;
+    const HTTPReply* pFailed = nullptr;
+    for (size_t nBatch = 0; nBatch < nBatches; nBatch++) {
+        if (vRequests[nBatch].empty()) continue;
+        const size_t nBegin = nBatch * nBatchSize;
+        const size_t nEnd = std::min(commands.size(), nBegin + nBatchSize);
+        if (vResponses[nBatch].status == 0) {
+            pFailed = &vResponses[nBatch];
+            const std::string strError = strprintf("couldn't connect to server: %s (code %d)", http_errorstring(vResponses[nBatch].error), vResponses[nBatch].error);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (replies[i].isNull()) {
+                    replies[i] = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_MISC_ERROR, strError), i);
+                }
+            }
+            continue;
+        }
+        fConnected = true;
+        const std::vector<UniValue> batch = JSONRPCProcessBatchReply(ParseRPCReply(vResponses[nBatch]), nEnd - nBegin);
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const UniValue& reply = batch[i - nBegin];
+            if (reply.isObject()) {
+                replies[i] = JSONRPCReplyObj(find_value(reply, "result"), find_value(reply, "error"), i);
+            }
+        }
+    }
+    if (!fConnected) {
+        // Let ParseRPCReply describe the failure
+        ParseRPCReply(*pFailed);
+    }
+    return replies;
+}
+
+/** -stdinbatch: run the commands on standard input and print their replies, one line each */
+static int CommandLineRPCBatch()
+{
+    std::vector<std::vector<std::string> > commands;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::vector<std::string> command = ParseBatchCommand(line);
+        if (!command.empty()) {
+            commands.push_back(std::move(command));
+        }
+    }
+
+    std::vector<UniValue> replies;
+    const bool fWait = gArgs.GetBoolArg("-rpcwait", false);
+    do {
+        try {
+            replies = CallRPCBatch(commands);
+            break;
+        }
+        catch (const CConnectionFailed&) {
+            if (fWait)
+                MilliSleep(1000);
+            else
+                throw;
+        }
+    } while (fWait);
+
+    int nRet = 0;
+    for (const UniValue& reply : replies) {
+        if (!find_value(reply, "error").isNull()) {
+            nRet = EXIT_FAILURE;
+        }
+        fprintf(stdout, "%s\n", reply.write().c_str());
+    }
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -396,6 +606,12 @@ int CommandLineRPC(int argc, char *argv[])
             }
             gArgs.ForceSetArg("-rpcpassword", rpcPass);
         }
+        if (gArgs.GetBoolArg("-stdinbatch", false)) {
+            if (argc > 1 || gArgs.GetBoolArg("-stdin", false) || gArgs.GetBoolArg("-getinfo", false)) {
+                throw std::runtime_error("-stdinbatch reads the commands from standard input and cannot be combined with a command, -stdin or -getinfo");
+            }
+            return CommandLineRPCBatch();
+        }
         std::vector<std::string> args = std::vector<std::string>(&argv[1], &argv[argc]);
         if (gArgs.GetBoolArg("-stdin", false)) {
             // Read one arg per line from stdin and append
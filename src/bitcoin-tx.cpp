@@ -24,6 +24,7 @@
 #include <utilmoneystr.h>
 #include <utilstrencodings.h>
 
+#include <iostream>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp>
@@ -60,12 +61,17 @@ static int AppInitRawTx(int argc, char* argv[])
             _("Usage:") + "\n" +
               "  globaltoken-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded globaltoken transaction") + "\n" +
               "  globaltoken-tx [options] -create [commands]   " + _("Create hex-encoded globaltoken transaction") + "\n" +
+              "  globaltoken-tx [options] -batch               " + _("Create or update globaltoken transactions from JSON jobs on standard input") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-batch", _("Read one job per line from standard input and write one result per line to standard output, until the input ends. "
+            "A job is a JSON object with the optional fields \"tx\" (hex-encoded TX to update, a new, empty TX if missing), \"registers\" (object of register names and their JSON values), "
+            "\"ops\" (array of commands as below, e.g. \"sign=ALL\") and \"id\" (copied to the result). "
+            "A result is a JSON object with the \"id\" and either \"hex\" and \"txid\" of the TX, or \"error\". With -json it also has the decoded \"tx\"."));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
@@ -674,19 +680,25 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     tx = mergedTx;
 }
 
+/** Keeps the ECC context up while any instance lives, so a batch can set it up once for all its jobs */
 class Secp256k1Init
 {
+    static int nInstances;
     ECCVerifyHandle globalVerifyHandle;
 
 public:
     Secp256k1Init() {
-        ECC_Start();
+        if (nInstances++ == 0)
+            ECC_Start();
     }
     ~Secp256k1Init() {
-        ECC_Stop();
+        if (--nInstances == 0)
+            ECC_Stop();
     }
 };
 
+int Secp256k1Init::nInstances = 0;
+
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
                      const std::string& commandVal)
 {
@@ -855,6 +867,91 @@ static int CommandLineRawTx(int argc, char* argv[])
     return nRet;
 }
 
+static void RunBatchJob(const UniValue& job, UniValue& result)
+{
+    if (!job.isObject())
+        throw std::runtime_error("job is not a JSON object");
+    if (job.exists("id"))
+        result.pushKV("id", job["id"]);
+
+    // every job starts from empty registers
+    registers.clear();
+    const UniValue& regs = job["registers"];
+    if (!regs.isNull()) {
+        if (!regs.isObject())
+            throw std::runtime_error("registers is not a JSON object");
+        const std::vector<std::string>& keys = regs.getKeys();
+        for (size_t i = 0; i < keys.size(); i++)
+            registers[keys[i]] = regs[keys[i]];
+    }
+
+    CMutableTransaction tx;
+    const UniValue& txVal = job["tx"];
+    if (!txVal.isNull()) {
+        if (!txVal.isStr() || !DecodeHexTx(tx, txVal.get_str(), true))
+            throw std::runtime_error("invalid transaction encoding");
+    }
+
+    const UniValue& ops = job["ops"];
+    if (!ops.isNull() && !ops.isArray())
+        throw std::runtime_error("ops is not a JSON array");
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (!ops[i].isStr())
+            throw std::runtime_error("op is not a string");
+        const std::string& arg = ops[i].get_str();
+        size_t eqpos = arg.find('=');
+        if (eqpos == std::string::npos)
+            MutateTx(tx, arg, "");
+        else
+            MutateTx(tx, arg.substr(0, eqpos), arg.substr(eqpos + 1));
+    }
+
+    const CTransaction txFinal(tx);
+    result.pushKV("hex", EncodeHexTx(txFinal));
+    result.pushKV("txid", txFinal.GetHash().GetHex());
+    if (gArgs.GetBoolArg("-json", false)) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(txFinal, uint256(), entry);
+        result.pushKV("tx", entry);
+    }
+}
+
+/**
+ * Run the jobs on standard input one after the other, see -batch. A job that
+ * fails gets an error result and does not stop the batch, but makes the exit
+ * code EXIT_FAILURE.
+ */
+static int BatchRawTx()
+{
+    Secp256k1Init ecc;
+    int nRet = EXIT_SUCCESS;
+    std::string strLine;
+    while (std::getline(std::cin, strLine)) {
+        boost::algorithm::trim(strLine);
+        if (strLine.empty())
+            continue;
+
+        UniValue result(UniValue::VOBJ);
+        try {
+            UniValue job;
+            if (!job.read(strLine))
+                throw std::runtime_error("invalid JSON job");
+            RunBatchJob(job, result);
+        }
+        catch (const std::exception& e) {
+            result.pushKV("error", std::string(e.what()));
+            nRet = EXIT_FAILURE;
+        }
+
+        // results are written as they come, the caller may be waiting for them to send the next job
+        fprintf(stdout, "%s\n", result.write().c_str());
+        fflush(stdout);
+    }
+    if (std::cin.bad())
+        throw std::runtime_error("error reading stdin");
+    return nRet;
+}
+
 int main(int argc, char* argv[])
 {
     SetupEnvironment();
@@ -873,6 +970,18 @@ int main(int argc, char* argv[])
     }
 
     int ret = EXIT_FAILURE;
+    if (gArgs.GetBoolArg("-batch", false)) {
+        try {
+            ret = BatchRawTx();
+        }
+        catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "BatchRawTx()");
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "BatchRawTx()");
+        }
+        return ret;
+    }
+
     try {
         ret = CommandLineRawTx(argc, argv);
     }
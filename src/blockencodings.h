@@ -7,6 +7,7 @@
 
 #include <primitives/block.h>
 
+#include <map>
 #include <memory>
 
 class CTxMemPool;
@@ -136,29 +137,16 @@ private:
     void FillShortTxIDSelector() const;
 
     friend class PartiallyDownloadedBlock;
+    friend class CBlockHeaderRefAndShortTxIDs;
 
     static const int SHORTTXIDS_LENGTH = 6;
 protected:
     std::vector<uint64_t> shorttxids;
     std::vector<PrefilledTransaction> prefilledtxn;
 
-public:
-    CBlockHeader header;
-
-    // Dummy for deserialization
-    CBlockHeaderAndShortTxIDs() {}
-
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
-
-    uint64_t GetShortID(const uint256& txhash) const;
-
-    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
-
-    ADD_SERIALIZE_METHODS;
-
+    /** Everything but the header */
     template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(header);
+    inline void SerializationOpShortTxIDs(Stream& s, Operation ser_action) {
         READWRITE(nonce);
 
         uint64_t shorttxids_size = (uint64_t)shorttxids.size();
@@ -185,10 +173,193 @@ public:
         }
 
         READWRITE(prefilledtxn);
+    }
+
+public:
+    CBlockHeader header;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(header);
+        SerializationOpShortTxIDs(s, ser_action);
 
         if (ser_action.ForRead())
             FillShortTxIDSelector();
     }
+
+    /** Set the header of a compact block read from a CBlockHeaderRefAndShortTxIDs */
+    void SetHeader(const CBlockHeader& headerIn);
+};
+
+/**
+ * A compact block with its header replaced by the block hash, the "cmpctref"
+ * message. It is sent to peers known to have the header already, sparing
+ * them the auxpow or Equihash solution they got with it. After reading, the
+ * header must be added with SetHeader.
+ */
+class CBlockHeaderRefAndShortTxIDs {
+public:
+    uint256 blockhash;
+    CBlockHeaderAndShortTxIDs& cmpctblock;
+
+    explicit CBlockHeaderRefAndShortTxIDs(CBlockHeaderAndShortTxIDs& cmpctblockIn) : cmpctblock(cmpctblockIn) {}
+    explicit CBlockHeaderRefAndShortTxIDs(const CBlockHeaderAndShortTxIDs& cmpctblockIn) :
+        blockhash(cmpctblockIn.header.GetHash()), cmpctblock(REF(cmpctblockIn)) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(blockhash);
+        cmpctblock.SerializationOpShortTxIDs(s, ser_action);
+    }
+};
+
+/**
+ * Headers in chain order as the "cmpcthdrs" message carries them. A header
+ * leaves out what the receiver can work out from the headers before it: the
+ * previous block hash when it is the hash of the header before, the version
+ * when it is the same as that of the header before and nBits when it is the
+ * same as that of the last header of its algo. The time is sent as the
+ * difference to the time of the header before. The rest, like the Equihash
+ * solution or the auxpow, is sent as in a "headers" message.
+ *
+ * Header is CBlockHeader or CBlock, of which only the header is sent.
+ */
+template <typename Header>
+class CCompressedHeaders {
+private:
+    enum : uint8_t {
+        FLAG_PREV_BLOCK = (1 << 0),
+        FLAG_VERSION    = (1 << 1),
+        FLAG_BITS       = (1 << 2),
+        FLAGS_ALL       = FLAG_PREV_BLOCK | FLAG_VERSION | FLAG_BITS,
+    };
+
+    uint64_t nMaxCount = std::numeric_limits<uint64_t>::max();
+
+public:
+    std::vector<Header>& headers;
+    /** Number of headers in the message read, headers is left empty when there are more than nMaxCount */
+    uint64_t nCount = 0;
+
+    CCompressedHeaders(std::vector<Header>& headersIn, uint64_t nMaxCountIn) : nMaxCount(nMaxCountIn), headers(headersIn) {}
+    explicit CCompressedHeaders(const std::vector<Header>& headersIn) : headers(REF(headersIn)) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, headers.size());
+        std::map<uint8_t, uint32_t> mapLastBits;
+        const CBlockHeader* pprev = nullptr;
+        for (const CBlockHeader& header : headers) {
+            const uint8_t nAlgo = header.GetAlgo();
+            auto itBits = mapLastBits.find(nAlgo);
+            uint8_t nFlags = 0;
+            if (!pprev || header.hashPrevBlock != pprev->GetHash()) nFlags |= FLAG_PREV_BLOCK;
+            if (!pprev || header.nVersion != pprev->nVersion) nFlags |= FLAG_VERSION;
+            if (itBits == mapLastBits.end() || itBits->second != header.nBits) nFlags |= FLAG_BITS;
+            // zigzag, so a time going back a bit stays short too
+            const int64_t nTimeDiff = (int64_t)header.nTime - (pprev ? (int64_t)pprev->nTime : 0);
+            uint64_t nTimeCode = ((uint64_t)nTimeDiff << 1) ^ (uint64_t)(nTimeDiff >> 63);
+
+            s << nFlags;
+            if (nFlags & FLAG_VERSION) s << header.nVersion;
+            if (nFlags & FLAG_PREV_BLOCK) s << header.hashPrevBlock;
+            s << header.hashMerkleRoot;
+            if (IsEquihashBasedAlgo(nAlgo)) s << header.hashReserved;
+            s << VARINT(nTimeCode);
+            if (nFlags & FLAG_BITS) s << header.nBits;
+            if (IsEquihashBasedAlgo(nAlgo)) {
+                s << header.nBigNonce;
+                s << header.nSolution;
+            } else {
+                s << header.nNonce;
+            }
+            if (header.IsAuxpow()) {
+                assert(header.auxpow);
+                s << *header.auxpow;
+            }
+
+            mapLastBits[nAlgo] = header.nBits;
+            pprev = &header;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        headers.clear();
+        nCount = ReadCompactSize(s);
+        if (nCount > nMaxCount) return;
+        headers.reserve(nCount);
+        std::map<uint8_t, uint32_t> mapLastBits;
+        uint256 hashPrev;
+        for (uint64_t i = 0; i < nCount; i++) {
+            headers.emplace_back();
+            CBlockHeader& header = headers.back();
+            const CBlockHeader* pprev = i > 0 ? &headers[i - 1] : nullptr;
+
+            uint8_t nFlags;
+            s >> nFlags;
+            if (nFlags & ~FLAGS_ALL)
+                throw std::ios_base::failure("Unknown compressed header flags");
+            if (!pprev && (nFlags & (FLAG_PREV_BLOCK | FLAG_VERSION)) != (FLAG_PREV_BLOCK | FLAG_VERSION))
+                throw std::ios_base::failure("First compressed header lacks its previous block or version");
+
+            if (nFlags & FLAG_VERSION) {
+                s >> header.nVersion;
+            } else {
+                header.nVersion = pprev->nVersion;
+            }
+            const uint8_t nAlgo = header.GetAlgo();
+            if (nFlags & FLAG_PREV_BLOCK) {
+                s >> header.hashPrevBlock;
+            } else {
+                header.hashPrevBlock = hashPrev;
+            }
+            s >> header.hashMerkleRoot;
+            if (IsEquihashBasedAlgo(nAlgo)) s >> header.hashReserved;
+            uint64_t nTimeCode;
+            s >> VARINT(nTimeCode);
+            const int64_t nTime = (pprev ? (int64_t)pprev->nTime : 0) + ((int64_t)(nTimeCode >> 1) ^ -(int64_t)(nTimeCode & 1));
+            if (nTime < 0 || nTime > std::numeric_limits<uint32_t>::max())
+                throw std::ios_base::failure("Compressed header time out of range");
+            header.nTime = nTime;
+            if (nFlags & FLAG_BITS) {
+                s >> header.nBits;
+            } else {
+                auto itBits = mapLastBits.find(nAlgo);
+                if (itBits == mapLastBits.end())
+                    throw std::ios_base::failure("Compressed header lacks nBits");
+                header.nBits = itBits->second;
+            }
+            if (IsEquihashBasedAlgo(nAlgo)) {
+                s >> header.nBigNonce;
+                s >> header.nSolution;
+            } else {
+                s >> header.nNonce;
+            }
+            if (header.IsAuxpow()) {
+                header.auxpow.reset(new CAuxPow());
+                s >> *header.auxpow;
+            }
+
+            mapLastBits[nAlgo] = header.nBits;
+            hashPrev = header.GetHash();
+        }
+    }
 };
 
 class PartiallyDownloadedBlock {
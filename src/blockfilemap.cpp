@@ -0,0 +1,132 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+
+#include <chain.h>
+#include <consensus/consensus.h>
+#include <crypto/common.h>
+#include <protocol.h>
+#include <sync.h>
+#include <util.h>
+#include <validation.h>
+
+#include <list>
+#include <utility>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+CCriticalSection cs_blockfilemaps;
+/** The mapped files by block file number, most recently used first */
+std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile>>> listBlockFileMaps;
+size_t nMaxBlockFileMaps = DEFAULT_BLOCK_FILE_MAPS;
+
+/** Map the whole file nFile if it holds at least nEnd bytes */
+std::shared_ptr<const CMappedBlockFile> MapBlockFile(int nFile, uint64_t nEnd)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    const fs::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size < nEnd) {
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrintf("Unable to map %s\n", path.string());
+        return nullptr;
+    }
+    return std::make_shared<const CMappedBlockFile>((const unsigned char*)p, (size_t)st.st_size);
+#endif
+}
+
+/** The mapping of nFile holding at least nEnd bytes, from the list or mapped now */
+std::shared_ptr<const CMappedBlockFile> GetBlockFileMap(int nFile, uint64_t nEnd)
+{
+    LOCK(cs_blockfilemaps);
+    if (nMaxBlockFileMaps == 0)
+        return nullptr;
+    for (auto it = listBlockFileMaps.begin(); it != listBlockFileMaps.end(); ++it) {
+        if (it->first != nFile)
+            continue;
+        if (it->second->size() >= nEnd) {
+            listBlockFileMaps.splice(listBlockFileMaps.begin(), listBlockFileMaps, it);
+            return it->second;
+        }
+        // The file grew since, map it again
+        listBlockFileMaps.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> mapped = MapBlockFile(nFile, nEnd);
+    if (!mapped)
+        return nullptr;
+    listBlockFileMaps.emplace_front(nFile, mapped);
+    // Readers still holding an evicted mapping keep it until they are done
+    while (listBlockFileMaps.size() > nMaxBlockFileMaps)
+        listBlockFileMaps.pop_back();
+    return mapped;
+}
+
+} // namespace
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+void SetBlockFileMaps(int nMaps)
+{
+    LOCK(cs_blockfilemaps);
+    nMaxBlockFileMaps = std::max(0, std::min(nMaps, MAX_BLOCK_FILE_MAPS));
+    while (listBlockFileMaps.size() > nMaxBlockFileMaps)
+        listBlockFileMaps.pop_back();
+}
+
+std::shared_ptr<const CMappedBlockFile> MapBlock(const CDiskBlockPos& pos, const unsigned char*& pblock, unsigned int& nBlockSize)
+{
+    // The message start and size WriteBlockToDisk puts in front of the block
+    if (pos.IsNull() || pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int))
+        return nullptr;
+    // The file is mapped shared, the writes become visible in place
+    WaitForBlockFileWrites(pos.nFile);
+    std::shared_ptr<const CMappedBlockFile> mapped = GetBlockFileMap(pos.nFile, pos.nPos);
+    if (!mapped)
+        return nullptr;
+
+    nBlockSize = ReadLE32(mapped->data() + pos.nPos - sizeof(unsigned int));
+    if (nBlockSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return nullptr;
+    const uint64_t nEnd = (uint64_t)pos.nPos + nBlockSize;
+    if (mapped->size() < nEnd) {
+        mapped = GetBlockFileMap(pos.nFile, nEnd);
+        if (!mapped)
+            return nullptr;
+    }
+    pblock = mapped->data() + pos.nPos;
+    return mapped;
+}
+
+void UnmapBlockFile(int nFile)
+{
+    LOCK(cs_blockfilemaps);
+    listBlockFileMaps.remove_if([nFile](const std::pair<int, std::shared_ptr<const CMappedBlockFile>>& entry) {
+        return entry.first == nFile;
+    });
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+struct CDiskBlockPos;
+
+/** Default for -blockfilemaps, none where the address space is too small for them */
+static const int DEFAULT_BLOCK_FILE_MAPS = sizeof(void*) >= 8 ? 8 : 0;
+/** Maximum for -blockfilemaps */
+static const int MAX_BLOCK_FILE_MAPS = 64;
+
+/** A read-only mapping of a whole blk?????.dat file, unmapped with the last reference */
+class CMappedBlockFile
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+
+public:
+    CMappedBlockFile(const unsigned char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+    CMappedBlockFile(const CMappedBlockFile&) = delete;
+    CMappedBlockFile& operator=(const CMappedBlockFile&) = delete;
+
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/** Set how many block files stay mapped (-blockfilemaps), 0 reads every block through OpenBlockFile */
+void SetBlockFileMaps(int nMaps);
+
+/**
+ * Find the block WriteBlockToDisk wrote at pos in a mapping of its file, so it
+ * can be deserialized from the mapped pages without reading it into a buffer
+ * first. The most recently used files stay mapped, a file that grew since it
+ * was mapped is mapped again. Returns nullptr if mapping is disabled or fails,
+ * or the size in front of the block does not fit the file; the caller reads
+ * through OpenBlockFile then.
+ *
+ * @param[out] pblock      The block, followed by at least nBlockSize bytes.
+ * @param[out] nBlockSize  The size WriteBlockToDisk wrote in front of the block.
+ * @return The mapping, which must be kept while pblock is used.
+ */
+std::shared_ptr<const CMappedBlockFile> MapBlock(const CDiskBlockPos& pos, const unsigned char*& pblock, unsigned int& nBlockSize);
+
+/** Drop the mapping of a block file that was pruned */
+void UnmapBlockFile(int nFile);
+
+#endif // BITCOIN_BLOCKFILEMAP_H
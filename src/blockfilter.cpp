@@ -0,0 +1,230 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <streams.h>
+#include <undo.h>
+#include <version.h>
+
+#include <algorithm>
+
+namespace {
+
+/** Appends bits to a byte vector, most significant bit first */
+class BitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    uint8_t nBuffer = 0;
+    int nOffset = 0;
+
+public:
+    explicit BitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn) {}
+
+    /** Write the lowest nBits (at most 64) bits of nData */
+    void Write(uint64_t nData, int nBits)
+    {
+        while (nBits > 0) {
+            int nNow = std::min(8 - nOffset, nBits);
+            nBuffer |= (nData << (64 - nBits)) >> (64 - 8 + nOffset);
+            nOffset += nNow;
+            nBits -= nNow;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    /** Write out a partially filled last byte, padded with zeros */
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+/** Reads bits written by BitWriter from a byte range */
+class BitReader
+{
+private:
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    uint8_t nBuffer = 0;
+    int nOffset = 8;
+
+public:
+    BitReader(const unsigned char* pbeginIn, const unsigned char* pendIn) : pbegin(pbeginIn), pend(pendIn) {}
+
+    uint64_t Read(int nBits)
+    {
+        uint64_t nData = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                if (pbegin == pend)
+                    throw std::ios_base::failure("BitReader::Read(): end of data");
+                nBuffer = *pbegin++;
+                nOffset = 0;
+            }
+            int nNow = std::min(8 - nOffset, nBits);
+            nData <<= nNow;
+            nData |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - nNow);
+            nOffset += nNow;
+            nBits -= nNow;
+        }
+        return nData;
+    }
+};
+
+void GolombRiceEncode(BitWriter& writer, uint8_t nP, uint64_t x)
+{
+    // The quotient in unary, then the remainder in nP bits.
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? static_cast<int>(q) : 64;
+        writer.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, nP);
+}
+
+uint64_t GolombRiceDecode(BitReader& reader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        ++q;
+    uint64_t r = reader.Read(nP);
+    return (q << nP) + r;
+}
+
+/** Map x uniformly to [0, n), as (x * n) >> 64 */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(x) * n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+    uint64_t hi = x_hi * n_hi, mid1 = x_hi * n_lo, mid2 = x_lo * n_hi, lo = x_lo * n_lo;
+    uint64_t carry = ((mid1 & 0xFFFFFFFF) + (mid2 & 0xFFFFFFFF) + (lo >> 32)) >> 32;
+    return hi + (mid1 >> 32) + (mid2 >> 32) + carry;
+#endif
+}
+
+} // namespace
+
+CGCSFilter::CGCSFilter() : CGCSFilter(0, 0, BASIC_P, BASIC_M, ElementSet())
+{
+}
+
+CGCSFilter::CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const ElementSet& elements)
+    : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn), nN(elements.size()), nF(nN * nM)
+{
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vEncoded, 0) << COMPACTSIZE(nN);
+
+    BitWriter writer(vEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nValue : BuildHashedSet(elements)) {
+        GolombRiceEncode(writer, nP, nValue - nLast);
+        nLast = nValue;
+    }
+    writer.Flush();
+}
+
+CGCSFilter::CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, std::vector<unsigned char> vEncodedIn)
+    : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn), vEncoded(std::move(vEncodedIn))
+{
+    CDataStream ss(vEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    nN = ReadCompactSize(ss);
+    nF = nN * nM;
+}
+
+uint64_t CGCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t> CGCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element& element : elements)
+        vHashed.push_back(HashToRange(element));
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool CGCSFilter::MatchSorted(const std::vector<uint64_t>& vQuery) const
+{
+    if (vQuery.empty())
+        return false;
+
+    // Walk the encoded values and the sorted query side by side.
+    const size_t nHeader = GetSizeOfCompactSize(nN);
+    BitReader reader(vEncoded.data() + nHeader, vEncoded.data() + vEncoded.size());
+    uint64_t nValue = 0;
+    auto it = vQuery.begin();
+    for (uint64_t i = 0; i < nN; ++i) {
+        nValue += GolombRiceDecode(reader, nP);
+        while (*it < nValue) {
+            if (++it == vQuery.end())
+                return false;
+        }
+        if (*it == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element& element) const
+{
+    if (nN == 0)
+        return false;
+    return MatchSorted(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nN == 0)
+        return false;
+    return MatchSorted(BuildHashedSet(elements));
+}
+
+CBlockFilter::CBlockFilter(const CBlock& block, const CBlockUndo& blockundo) : hashBlock(block.GetHash())
+{
+    // OP_RETURN outputs can never be spent, so no wallet looks for them.
+    CGCSFilter::ElementSet elements;
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    for (const CTxUndo& txundo : blockundo.vtxundo) {
+        for (const Coin& coin : txundo.vprevout) {
+            const CScript& script = coin.out.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    filter = CGCSFilter(hashBlock.GetUint64(0), hashBlock.GetUint64(1), CGCSFilter::BASIC_P, CGCSFilter::BASIC_M, elements);
+}
+
+void CBlockFilter::SetKey(const uint256& hashBlockIn, std::vector<unsigned char> vEncoded)
+{
+    hashBlock = hashBlockIn;
+    filter = CGCSFilter(hashBlock.GetUint64(0), hashBlock.GetUint64(1), CGCSFilter::BASIC_P, CGCSFilter::BASIC_M, std::move(vEncoded));
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-Rice coded set (BIP 158): a compact probabilistic set of byte
+ * strings that never misses an element it was built from, and matches
+ * anything else with a probability of 1/M.
+ */
+class CGCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    //! Golomb-Rice parameter of the basic filter type
+    static const uint8_t BASIC_P = 19;
+    //! Inverse false positive rate of the basic filter type
+    static const uint32_t BASIC_M = 784931;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    //! Number of elements
+    uint64_t nN;
+    //! Range the elements are hashed to, nN * nM
+    uint64_t nF;
+    std::vector<unsigned char> vEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    bool MatchSorted(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    CGCSFilter();
+    /** Build a filter of elements, keyed by k0 and k1 */
+    CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const ElementSet& elements);
+    /** Use an encoded filter, throws std::ios_base::failure if it is malformed */
+    CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, std::vector<unsigned char> vEncodedIn);
+
+    uint64_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vEncoded; }
+
+    bool Match(const Element& element) const;
+    /** Whether any of elements may be in the set, cheaper than matching them one by one */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/** The basic BIP 158 filter of a block: its output scripts and the scripts of the outputs it spends */
+class CBlockFilter
+{
+private:
+    uint256 hashBlock;
+    CGCSFilter filter;
+
+    void SetKey(const uint256& hashBlockIn, std::vector<unsigned char> vEncoded);
+
+public:
+    CBlockFilter() {}
+    CBlockFilter(const CBlock& block, const CBlockUndo& blockundo);
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const CGCSFilter& GetFilter() const { return filter; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        std::vector<unsigned char> vEncoded;
+        if (!ser_action.ForRead())
+            vEncoded = filter.GetEncoded();
+        READWRITE(vEncoded);
+        if (ser_action.ForRead())
+            SetKey(hashBlock, std::move(vEncoded));
+    }
+};
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -0,0 +1,133 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilterindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+static const char DB_BLOCK_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Blocks ThreadSync indexes between writes of the block it got to
+static const int SYNC_LOCATOR_INTERVAL = 1000;
+
+std::unique_ptr<CBlockFilterIndex> pblockfilterindex;
+
+CBlockFilterIndex::CBlockFilterIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "indexes" / "blockfilter", nCacheSize, fMemory, fWipe, false, DBProfile::INDEX)
+{
+}
+
+bool CBlockFilterIndex::WriteFilter(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block spends nothing and has no undo data.
+    CBlockUndo blockundo;
+    if (pindex->pprev) {
+        CDiskBlockPos pos;
+        bool fCompact;
+        {
+            LOCK(cs_main);
+            if (!(pindex->nStatus & BLOCK_HAVE_UNDO))
+                return error("%s: no undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+            pos = pindex->GetUndoPos();
+            fCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+        }
+        if (!UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash(), fCompact))
+            return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return db.Write(std::make_pair(DB_BLOCK_FILTER, pindex->GetBlockHash()), CBlockFilter(block, blockundo));
+}
+
+bool CBlockFilterIndex::WriteBestBlock(const CBlockLocator& locator)
+{
+    return db.Write(DB_BEST_BLOCK, locator);
+}
+
+void CBlockFilterIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    // Until then ThreadSync gets to the block itself.
+    if (!fSynced)
+        return;
+    if (!WriteFilter(*block, pindex))
+        LogPrintf("%s: failed to index block %s\n", __func__, pindex->GetBlockHash().ToString());
+}
+
+void CBlockFilterIndex::SetBestChain(const CBlockLocator& locator)
+{
+    if (fSynced)
+        WriteBestBlock(locator);
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    RenameThread("globaltoken-blockfilter");
+
+    const CBlockIndex* pindex = nullptr;
+    {
+        CBlockLocator locator;
+        db.Read(DB_BEST_BLOCK, locator);
+        LOCK(cs_main);
+        pindex = FindForkInGlobalIndex(chainActive, locator);
+        if (locator.IsNull())
+            pindex = nullptr;
+    }
+
+    int nIndexed = 0;
+    int nMissing = 0;
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            const CBlockIndex* pindexNext;
+            bool fHaveData;
+            {
+                LOCK(cs_main);
+                // Continue from where the active chain left what was indexed, after a reorg too.
+                if (pindex && !chainActive.Contains(pindex))
+                    pindex = chainActive.FindFork(pindex);
+                pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+                if (!pindexNext) {
+                    fSynced = true;
+                    if (pindex)
+                        WriteBestBlock(chainActive.GetLocator(pindex));
+                    LogPrintf("%s: block filter index is synced at height %d, %d blocks could not be indexed\n", __func__, pindex ? pindex->nHeight : -1, nMissing);
+                    return;
+                }
+                fHaveData = (pindexNext->nStatus & BLOCK_HAVE_DATA) && (!pindexNext->pprev || (pindexNext->nStatus & BLOCK_HAVE_UNDO));
+            }
+
+            CBlock block;
+            if (!fHaveData || !ReadBlockFromDisk(block, pindexNext, Params().GetConsensus()) || !WriteFilter(block, pindexNext)) {
+                // Pruned blocks are left without a filter.
+                ++nMissing;
+            }
+            pindex = pindexNext;
+
+            if (++nIndexed % SYNC_LOCATOR_INTERVAL == 0) {
+                LOCK(cs_main);
+                WriteBestBlock(chainActive.GetLocator(pindex));
+                LogPrintf("%s: block filter index at height %d\n", __func__, pindex->nHeight);
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (pindex) {
+            LOCK(cs_main);
+            WriteBestBlock(chainActive.GetLocator(pindex));
+        }
+        throw;
+    }
+}
+
+bool CBlockFilterIndex::LookUpFilter(const CBlockIndex* pindex, CBlockFilter& filter) const
+{
+    return db.Read(std::make_pair(DB_BLOCK_FILTER, pindex->GetBlockHash()), filter);
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTERINDEX_H
+#define BITCOIN_BLOCKFILTERINDEX_H
+
+#include <blockfilter.h>
+#include <dbwrapper.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <memory>
+
+class CBlockIndex;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+
+/**
+ * BIP 158 basic filters of the blocks of the active chain (-blockfilterindex),
+ * kept in a database of their own under indexes/blockfilter. ThreadSync
+ * builds the filters of the blocks the node already has in the background,
+ * after which the blocks the validation interface announces are added.
+ * Filters are stored by block hash, so reorgs do not have to remove any.
+ * Blocks without a filter, because they were pruned or not reached yet,
+ * have to be read in full by whoever wants to know what is in them.
+ */
+class CBlockFilterIndex final : public CValidationInterface
+{
+private:
+    CDBWrapper db;
+    //! Whether ThreadSync reached the tip, BlockConnected adds the blocks from then on
+    std::atomic<bool> fSynced{false};
+
+    bool WriteFilter(const CBlock& block, const CBlockIndex* pindex);
+    bool WriteBestBlock(const CBlockLocator& locator);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void SetBestChain(const CBlockLocator& locator) override;
+
+public:
+    CBlockFilterIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Build the missing filters from the last block synced up to the tip, run on a thread of its own */
+    void ThreadSync();
+
+    bool IsSynced() const { return fSynced; }
+
+    /** Read the filter of a block, false if it has none */
+    bool LookUpFilter(const CBlockIndex* pindex, CBlockFilter& filter) const;
+};
+
+/** The block filter index, if -blockfilterindex is enabled */
+extern std::unique_ptr<CBlockFilterIndex> pblockfilterindex;
+
+#endif // BITCOIN_BLOCKFILTERINDEX_H
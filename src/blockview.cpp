@@ -0,0 +1,76 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockview.h>
+
+#include <blockfilemap.h>
+#include <chain.h>
+#include <clientversion.h>
+#include <streams.h>
+#include <sync.h>
+#include <util.h>
+#include <validation.h>
+
+bool CRawBlockView::Read(const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+
+    vtx.clear();
+    vchBlock.clear();
+    const unsigned char* pblock;
+    unsigned int nBlockSize;
+    mapped = MapBlock(pos, pblock, nBlockSize);
+    if (mapped) {
+        if (memcmp(pblock - CMessageHeader::MESSAGE_START_SIZE - sizeof(unsigned int), messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        pbegin = pblock;
+        nSize = nBlockSize;
+    } else {
+        if (!ReadRawBlockFromDisk(vchBlock, pindex, messageStart))
+            return false;
+        pbegin = vchBlock.data();
+        nSize = vchBlock.size();
+    }
+    return Parse(pindex);
+}
+
+bool CRawBlockView::Parse(const CBlockIndex* pindex)
+{
+    try {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, nSize);
+        reader >> header;
+        nTxCount = ReadCompactSize(reader);
+        nNextTxOffset = nSize - reader.size();
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s for %s", __func__, e.what(), pindex->GetBlockHash().ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s", __func__, pindex->GetBlockHash().ToString());
+    // nTx is 0 for a block whose transactions were not validated yet
+    if (pindex->nTx != 0 && nTxCount != pindex->nTx)
+        return error("%s: %u transactions instead of %u for %s", __func__, nTxCount, pindex->nTx, pindex->GetBlockHash().ToString());
+    if (nTxCount > nSize - nNextTxOffset)
+        return error("%s: %u transactions cannot fit %u bytes for %s", __func__, nTxCount, nSize, pindex->GetBlockHash().ToString());
+    return true;
+}
+
+CTransactionRef CRawBlockView::GetTransaction(size_t i)
+{
+    assert(i < nTxCount);
+    if (i < vtx.size())
+        return vtx[i];
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin + nNextTxOffset, nSize - nNextTxOffset);
+    while (vtx.size() <= i) {
+        CTransactionRef tx;
+        reader >> tx;
+        vtx.push_back(std::move(tx));
+        nNextTxOffset = nSize - reader.size();
+    }
+    return vtx[i];
+}
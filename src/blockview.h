@@ -0,0 +1,60 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKVIEW_H
+#define BITCOIN_BLOCKVIEW_H
+
+#include <primitives/block.h>
+#include <protocol.h>
+
+#include <memory>
+#include <vector>
+
+class CBlockIndex;
+class CMappedBlockFile;
+
+/**
+ * A block as it is stored in its block file, for the readers that pass it on
+ * serialized: getblock with verbosity 0, REST and the ZMQ rawblock
+ * notification. The bytes are the ones a CBlock of the block serializes to
+ * without RPCSerializationFlags, they stay in the mapped block file when it
+ * is mapped (see MapBlock). Only the header is deserialized on reading, to
+ * check the hash against the index; the transactions are deserialized on
+ * first access, up to the one asked for. Not thread safe.
+ */
+class CRawBlockView
+{
+private:
+    //! Keeps pbegin valid when the block is read from a mapping
+    std::shared_ptr<const CMappedBlockFile> mapped;
+    //! The block otherwise
+    std::vector<unsigned char> vchBlock;
+    const unsigned char* pbegin;
+    size_t nSize;
+
+    CBlockHeader header;
+    uint64_t nTxCount;
+    //! The transactions deserialized so far and where the next one starts
+    std::vector<CTransactionRef> vtx;
+    size_t nNextTxOffset;
+
+    bool Parse(const CBlockIndex* pindex);
+
+public:
+    CRawBlockView() : pbegin(nullptr), nSize(0), nTxCount(0), nNextTxOffset(0) {}
+
+    /** Read the block of pindex, false if it cannot be read or does not match the index */
+    bool Read(const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+
+    const CBlockHeader& GetHeader() const { return header; }
+    uint64_t GetTxCount() const { return nTxCount; }
+    /** The transaction at index i < GetTxCount(), throws std::ios_base::failure if it cannot be deserialized */
+    CTransactionRef GetTransaction(size_t i);
+};
+
+#endif // BITCOIN_BLOCKVIEW_H
@@ -200,6 +200,83 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     return false;
 }
 
+bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx, const CBloomTxElements& elements)
+{
+    bool fFound = false;
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    const uint256& hash = tx.GetHash();
+    if (contains(hash))
+        fFound = true;
+
+    size_t nElement = 0;
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        for (; nElement < elements.vOutputEnd[i]; nElement++)
+        {
+            if (contains(elements.vElements[nElement]))
+            {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                    insert(COutPoint(hash, i));
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && elements.vOutputPubKey[i])
+                    insert(COutPoint(hash, i));
+                break;
+            }
+        }
+        nElement = elements.vOutputEnd[i];
+    }
+
+    if (fFound)
+        return true;
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        if (contains(tx.vin[i].prevout))
+            return true;
+
+        for (; nElement < elements.vInputEnd[i]; nElement++)
+            if (contains(elements.vElements[nElement]))
+                return true;
+    }
+
+    return false;
+}
+
+static void AppendPushes(const CScript& script, std::vector<std::vector<unsigned char> >& vElements)
+{
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            vElements.push_back(data);
+    }
+}
+
+CBloomTxElements::CBloomTxElements(const CTransaction& tx)
+{
+    vOutputEnd.reserve(tx.vout.size());
+    vOutputPubKey.reserve(tx.vout.size());
+    for (const CTxOut& txout : tx.vout) {
+        AppendPushes(txout.scriptPubKey, vElements);
+        vOutputEnd.push_back(vElements.size());
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        vOutputPubKey.push_back(Solver(txout.scriptPubKey, type, vSolutions) && (type == TX_PUBKEY || type == TX_MULTISIG));
+    }
+    vInputEnd.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        AppendPushes(txin.scriptSig, vElements);
+        vInputEnd.push_back(vElements.size());
+    }
+}
+
 void CBloomFilter::UpdateEmptyFull()
 {
     bool full = true;
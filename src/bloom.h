@@ -13,6 +13,25 @@ class COutPoint;
 class CTransaction;
 class uint256;
 
+/**
+ * The script data elements of a transaction CBloomFilter::IsRelevantAndUpdate
+ * looks for, parsed once so a block served to several SPV peers is matched
+ * against their filters without parsing its scripts again for each of them.
+ */
+struct CBloomTxElements
+{
+    //! Non-empty pushes of every scriptPubKey and then of every scriptSig, up to the first one that does not parse
+    std::vector<std::vector<unsigned char> > vElements;
+    //! Where the pushes of output i end in vElements
+    std::vector<uint32_t> vOutputEnd;
+    //! Where the pushes of the scriptSig of input i end in vElements
+    std::vector<uint32_t> vInputEnd;
+    //! Whether output i is pay-to-pubkey or multisig, the outputs BLOOM_UPDATE_P2PUBKEY_ONLY adds
+    std::vector<bool> vOutputPubKey;
+
+    explicit CBloomTxElements(const CTransaction& tx);
+};
+
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
 static const unsigned int MAX_HASH_FUNCS = 50;
@@ -97,6 +116,8 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! Same as above, with the script data elements of tx parsed before
+    bool IsRelevantAndUpdate(const CTransaction& tx, const CBloomTxElements& elements);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -6,32 +6,129 @@
 #include <chain.h>
 #include <bignum.h>
 #include <globaltoken/hardfork.h>
+#include <sync.h>
+#include <txdb.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+
+namespace {
+
+/** Recently used header parts by block hash, most recent first, so headers can be served without disk reads */
+template <typename Ptr>
+class CHeaderPartCache
+{
+private:
+    typedef std::list<std::pair<uint256, Ptr> > PartList;
+
+    const size_t nMaxSize;
+    CCriticalSection cs;
+    PartList listParts;
+    std::unordered_map<uint256, typename PartList::iterator, BlockHasher> mapParts;
+
+public:
+    explicit CHeaderPartCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    Ptr Get(const uint256& hash)
+    {
+        LOCK(cs);
+        auto it = mapParts.find(hash);
+        if (it == mapParts.end())
+            return Ptr();
+        listParts.splice(listParts.begin(), listParts, it->second);
+        return it->second->second;
+    }
+
+    void Put(const uint256& hash, const Ptr& part)
+    {
+        LOCK(cs);
+        auto it = mapParts.find(hash);
+        if (it != mapParts.end()) {
+            listParts.splice(listParts.begin(), listParts, it->second);
+            return;
+        }
+        listParts.emplace_front(hash, part);
+        mapParts.emplace(hash, listParts.begin());
+        if (listParts.size() > nMaxSize) {
+            mapParts.erase(listParts.back().first);
+            listParts.pop_back();
+        }
+    }
+};
+
+CHeaderPartCache<boost::shared_ptr<CAuxPow> > auxpowCache(AUXPOW_CACHE_SIZE);
+CHeaderPartCache<std::shared_ptr<const CEquihashFields> > equihashFieldsCache(EQUIHASH_FIELDS_CACHE_SIZE);
+
+}
+
+void CacheBlockAuxpow(const uint256& hash, const CBlockHeader& block)
+{
+    if (block.IsAuxpow() && block.auxpow)
+        auxpowCache.Put(hash, block.auxpow);
+}
+
 CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParams) const
 {
     CBlockHeader block;
     block.nVersion       = nVersion;
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       Take it from the auxpow cache, or else read the header from disk.
+       We only have to read the actual *header*, not the full block.  */
     if (block.IsAuxpow())
     {
-        ReadBlockHeaderFromDisk(block, this, consensusParams);
-        return block;
+        boost::shared_ptr<CAuxPow> auxpow = auxpowCache.Get(GetBlockHash());
+        if (!auxpow)
+        {
+            if (ReadBlockHeaderFromDisk(block, this, consensusParams))
+                CacheBlockAuxpow(GetBlockHash(), block);
+            return block;
+        }
+        block.auxpow = auxpow;
     }
     if (pprev)
         block.hashPrevBlock = pprev->GetBlockHash();
     block.hashMerkleRoot = hashMerkleRoot;
-    block.hashReserved   = hashReserved;
     block.nTime          = nTime;
     block.nBits          = nBits;
     block.nNonce         = nNonce;
-    block.nBigNonce      = nBigNonce;
-    block.nSolution      = nSolution;
+    if (IsEquihashBasedAlgo(GetAlgo()))
+    {
+        std::shared_ptr<const CEquihashFields> fields = GetEquihashFields();
+        block.hashReserved = fields->hashReserved;
+        block.nBigNonce    = fields->nBigNonce;
+        block.nSolution    = fields->nSolution;
+    }
     return block;
 }
 
+std::shared_ptr<const CEquihashFields> CBlockIndex::GetEquihashFields() const
+{
+    std::shared_ptr<const CEquihashFields> fields = pEquihashFields.Load();
+    if (fields || !IsEquihashBasedAlgo(GetAlgo()))
+        return fields ? fields : std::make_shared<const CEquihashFields>();
+
+    const uint256 hash = GetBlockHash();
+    fields = equihashFieldsCache.Get(hash);
+    if (fields)
+        return fields;
+
+    // The fields are only released after the entry was synced to the block
+    // tree DB, so a miss means the DB is corrupt and the header can't be served.
+    CDiskBlockIndex diskindex;
+    if (!pblocktree || !pblocktree->ReadBlockIndex(hash, diskindex)) {
+        LogPrintf("ERROR: %s: block index %s missing from the block tree DB\n", __func__, hash.ToString());
+        assert(!"block index missing from the block tree DB");
+    }
+    std::shared_ptr<CEquihashFields> stored = std::make_shared<CEquihashFields>();
+    stored->hashReserved = diskindex.hashReserved;
+    stored->nBigNonce    = diskindex.nBigNonce;
+    stored->nSolution    = diskindex.nSolution;
+    equihashFieldsCache.Put(hash, stored);
+    return stored;
+}
+
 /**
  * CChain implementation
  */
@@ -145,6 +242,24 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildPrevAlgo()
+{
+    const uint8_t nAlgo = GetAlgo();
+    pprevAlgo = nullptr;
+    // Also remember the lowest timestamp we walked over, so GetPrevBlockIndexForAlgo
+    // can apply the same hardfork cut-offs as a full walk through GetLastBlockIndexForAlgo.
+    nPrevAlgoTimeMin = std::numeric_limits<uint32_t>::max();
+    for (CBlockIndex* pindex = pprev; pindex; pindex = pindex->pprev)
+    {
+        nPrevAlgoTimeMin = std::min(nPrevAlgoTimeMin, pindex->nTime);
+        if (pindex->GetAlgo() == nAlgo)
+        {
+            pprevAlgo = pindex;
+            break;
+        }
+    }
+}
+
 arith_uint256 GetBlockProofBase(const CBlockIndex& block)
 {
     arith_uint256 bnTarget;
@@ -178,7 +293,7 @@ double CalculateAlgoHashrate(const CBlockIndex& block, int algo, int lookup, con
     int64_t maxTime = minTime;
     for (int i = 0; i < lookup; i++) 
     {
-        pPreviousAlgoBlock = GetLastBlockIndexForAlgo(pLastAlgoBlock->pprev, algo, params);
+        pPreviousAlgoBlock = GetPrevBlockIndexForAlgo(pLastAlgoBlock, params);
         if(pPreviousAlgoBlock == nullptr)
         {
             break;
@@ -202,6 +317,119 @@ double CalculateAlgoHashrate(const CBlockIndex& block, int algo, int lookup, con
     return totalAlgoWork.getdouble() / timeDiff;
 }
 
+void CAlgoHashrateIndex::Clear()
+{
+    for (std::vector<Entry>& entries : vEntries) {
+        entries.clear();
+    }
+    pindexTip = nullptr;
+}
+
+void CAlgoHashrateIndex::Connect(const CBlockIndex* pindex, const Consensus::Params& params)
+{
+    std::vector<Entry>& entries = vEntries[pindex->GetAlgo()];
+    Entry entry;
+    entry.pindex = pindex;
+    entry.nAlgoChainWork = GetBlockProofBase(*pindex);
+    entry.nSegmentStart = entries.size();
+    if (!entries.empty()) {
+        entry.nAlgoChainWork += entries.back().nAlgoChainWork;
+        if (pindex->pprev && GetPrevBlockIndexForAlgo(pindex, params) == entries.back().pindex)
+            entry.nSegmentStart = entries.back().nSegmentStart;
+    }
+    entries.push_back(entry);
+    pindexTip = pindex;
+}
+
+void CAlgoHashrateIndex::Disconnect(const CBlockIndex* pindex)
+{
+    std::vector<Entry>& entries = vEntries[pindex->GetAlgo()];
+    assert(!entries.empty() && entries.back().pindex == pindex);
+    entries.pop_back();
+    pindexTip = pindex->pprev;
+}
+
+void CAlgoHashrateIndex::SetTip(const CChain& chain, const Consensus::Params& params)
+{
+    while (pindexTip && !chain.Contains(pindexTip)) {
+        Disconnect(pindexTip);
+    }
+    for (int nHeight = pindexTip ? pindexTip->nHeight + 1 : 0; nHeight <= chain.Height(); nHeight++) {
+        Connect(chain[nHeight], params);
+    }
+}
+
+void CAlgoHashrateIndex::GetStats(uint8_t algo, size_t nBegin, size_t nEnd, CAlgoHashrateStats& stats) const
+{
+    const std::vector<Entry>& entries = vEntries[algo];
+    stats.nWork = entries[nEnd].nAlgoChainWork;
+    if (nBegin > 0)
+        stats.nWork -= entries[nBegin - 1].nAlgoChainWork;
+    stats.nBlocks = nEnd - nBegin + 1;
+    stats.pindexFirst = entries[nBegin].pindex;
+    stats.pindexLast = entries[nEnd].pindex;
+
+    // Timestamps are not monotonic, so look at every block in the range
+    int64_t minTime = entries[nEnd].pindex->GetBlockTime();
+    int64_t maxTime = minTime;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        int64_t time = entries[i].pindex->GetBlockTime();
+        minTime = std::min(time, minTime);
+        maxTime = std::max(time, maxTime);
+    }
+    stats.nTimeSpan = maxTime - minTime;
+}
+
+CAlgoHashrateStats CAlgoHashrateIndex::GetRecent(const CBlockIndex* pindex, uint8_t algo, int lookup, const Consensus::Params& params) const
+{
+    CAlgoHashrateStats stats;
+    const std::vector<Entry>& entries = vEntries[algo];
+    auto it = std::upper_bound(entries.begin(), entries.end(), pindex->nHeight,
+                               [](int nHeight, const Entry& entry) { return nHeight < entry.pindex->nHeight; });
+    if (it == entries.begin())
+        return stats;
+    --it;
+
+    // Apply the hardfork cut-offs GetLastBlockIndexForAlgo applies on its way back to the last block
+    if (GetLastBlockIndexForAlgo(pindex, algo, params) != it->pindex)
+        return stats;
+
+    const size_t nEnd = it - entries.begin();
+    const size_t nBegin = std::max<size_t>(it->nSegmentStart, nEnd - std::min<size_t>(nEnd, std::max(lookup, 0)));
+    GetStats(algo, nBegin, nEnd, stats);
+    return stats;
+}
+
+CAlgoHashrateStats CAlgoHashrateIndex::GetHeightRange(uint8_t algo, int nStartHeight, int nEndHeight) const
+{
+    CAlgoHashrateStats stats;
+    const std::vector<Entry>& entries = vEntries[algo];
+    auto first = std::lower_bound(entries.begin(), entries.end(), nStartHeight,
+                                  [](const Entry& entry, int nHeight) { return entry.pindex->nHeight < nHeight; });
+    auto last = std::upper_bound(first, entries.end(), nEndHeight,
+                                 [](int nHeight, const Entry& entry) { return nHeight < entry.pindex->nHeight; });
+    if (first == last)
+        return stats;
+    GetStats(algo, first - entries.begin(), last - entries.begin() - 1, stats);
+    return stats;
+}
+
+std::vector<const CBlockIndex*> CAlgoHashrateIndex::GetBlocks(uint8_t algo, int nStartHeight, int nEndHeight, size_t nMaxCount) const
+{
+    std::vector<const CBlockIndex*> blocks;
+    const std::vector<Entry>& entries = vEntries[algo];
+    auto first = std::lower_bound(entries.begin(), entries.end(), nStartHeight,
+                                  [](const Entry& entry, int nHeight) { return entry.pindex->nHeight < nHeight; });
+    auto last = std::upper_bound(first, entries.end(), nEndHeight,
+                                 [](int nHeight, const Entry& entry) { return nHeight < entry.pindex->nHeight; });
+    if ((size_t)(last - first) > nMaxCount)
+        first = last - nMaxCount;
+    blocks.reserve(last - first);
+    for (auto it = first; it != last; ++it)
+        blocks.push_back(it->pindex);
+    return blocks;
+}
+
 arith_uint256 GetPrevWorkForAlgoWithDecay(const CBlockIndex& block, int algo, const Consensus::Params& params)
 {
     int nDistance = 0;
@@ -14,6 +14,8 @@
 #include <uint256.h>
 #include <chainparams.h>
 
+#include <memory>
+#include <utility>
 #include <vector>
 
 /**
@@ -162,6 +164,48 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_POW_VERIFIED      =   256, //!< proof of work of the (non-auxpow) header has been verified, see -checkpowonload
+    BLOCK_UNDO_COMPACT      =   512, //!< undo data in rev*.dat uses the compact encoding, see -compactundo
+};
+
+/** Header fields only Equihash based blocks use */
+struct CEquihashFields
+{
+    uint256 hashReserved;
+    uint256 nBigNonce;
+    std::vector<unsigned char> nSolution;
+};
+
+/**
+ * The Equihash fields of a CBlockIndex. They are released by the thread that
+ * writes the block tree DB while others may read them, so every load, store
+ * and copy of the pointer is atomic.
+ */
+class CEquihashFieldsPtr
+{
+private:
+    std::shared_ptr<const CEquihashFields> ptr;
+
+public:
+    CEquihashFieldsPtr() {}
+    CEquihashFieldsPtr(const CEquihashFieldsPtr& other) : ptr(other.Load()) {}
+
+    CEquihashFieldsPtr& operator=(const CEquihashFieldsPtr& other)
+    {
+        Store(other.Load());
+        return *this;
+    }
+
+    std::shared_ptr<const CEquihashFields> Load() const
+    {
+        return std::atomic_load(&ptr);
+    }
+
+    void Store(std::shared_ptr<const CEquihashFields> fields)
+    {
+        std::atomic_store(&ptr, std::move(fields));
+    }
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -181,6 +225,12 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    //! (memory only) pointer to the index of the closest predecessor mined with the same algo as this block
+    CBlockIndex* pprevAlgo;
+
+    //! (memory only) lowest nTime of the blocks from pprev back to pprevAlgo (inclusive), 0 until BuildPrevAlgo() ran
+    uint32_t nPrevAlgoTimeMin;
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -211,12 +261,13 @@ public:
     //! block header
     int32_t nVersion;
     uint256 hashMerkleRoot;
-	uint256 hashReserved;
     uint32_t nTime;
     uint32_t nBits;
     uint32_t nNonce;
-    uint256 nBigNonce;
-	std::vector<unsigned char> nSolution;
+
+    //! Equihash header fields, only kept in memory until the entry is written to the block tree DB.
+    //! After that GetEquihashFields reads them back from there. Null for other algos.
+    CEquihashFieldsPtr pEquihashFields;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
@@ -229,6 +280,8 @@ public:
         phashBlock = nullptr;
         pprev = nullptr;
         pskip = nullptr;
+        pprevAlgo = nullptr;
+        nPrevAlgoTimeMin = 0;
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -242,12 +295,10 @@ public:
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
-		hashReserved   = uint256();
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
-        nBigNonce      = uint256();
-		nSolution.clear();
+        pEquihashFields.Store(nullptr);
     }
 
     CBlockIndex()
@@ -261,12 +312,16 @@ public:
 
         nVersion       = block.nVersion;
         hashMerkleRoot = block.hashMerkleRoot;
-		hashReserved   = block.hashReserved;
         nTime          = block.nTime;
         nBits          = block.nBits;
         nNonce         = block.nNonce;
-        nBigNonce      = block.nBigNonce;
-		nSolution      = block.nSolution;
+        if (IsEquihashBasedAlgo(GetAlgo())) {
+            std::shared_ptr<CEquihashFields> fields = std::make_shared<CEquihashFields>();
+            fields->hashReserved = block.hashReserved;
+            fields->nBigNonce    = block.nBigNonce;
+            fields->nSolution    = block.nSolution;
+            pEquihashFields.Store(std::move(fields));
+        }
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -289,6 +344,15 @@ public:
     
     CBlockHeader GetBlockHeader(const Consensus::Params& consensusParams) const;
 
+    /** The Equihash header fields, from memory or else from the block tree DB (which must have them). Empty for other algos. */
+    std::shared_ptr<const CEquihashFields> GetEquihashFields() const;
+
+    /** Drop the Equihash header fields from memory, once the block tree DB has them. */
+    void ReleaseEquihashFields()
+    {
+        pEquihashFields.Store(nullptr);
+    }
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -298,7 +362,7 @@ public:
     {
         const Consensus::Params& consensusParams = Params().GetConsensus();
         CBlockHeader block = GetBlockHeader(consensusParams);
-        return block.GetPoWHash(SER_GETHASH, LoadMultiHasherVersionFlags(consensusParams.Hardfork3.IsActivated(block.nTime)));
+        return GetCachedPoWHash(block, block.GetAlgo(), LoadMultiHasherVersionFlags(consensusParams.Hardfork3.IsActivated(block.nTime)));
     }
 
     uint8_t GetAlgo() const
@@ -380,11 +444,22 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the same-algo predecessor pointer for this entry. Requires pprev to be set.
+    void BuildPrevAlgo();
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/** Number of auxpows kept in memory for CBlockIndex::GetBlockHeader, enough for a full headers message */
+static const size_t AUXPOW_CACHE_SIZE = 2000;
+/** Number of Equihash header fields read back from the block tree DB that are kept in memory */
+static const size_t EQUIHASH_FIELDS_CACHE_SIZE = 2000;
+
+/** Remember the auxpow of a block header, so its CBlockIndex can serve the header without reading the block file. */
+void CacheBlockAuxpow(const uint256& hash, const CBlockHeader& block);
+
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 arith_uint256 GetBlockProof(const CBlockIndex& block, const Consensus::Params&);
 double CalculateAlgoHashrate(const CBlockIndex& block, int algo, int lookup, const Consensus::Params&);
@@ -399,6 +474,9 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    uint256 hashReserved;
+    uint256 nBigNonce;
+    std::vector<unsigned char> nSolution;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
@@ -406,6 +484,13 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        pEquihashFields.Store(nullptr);
+        if (IsEquihashBasedAlgo(GetAlgo())) {
+            std::shared_ptr<const CEquihashFields> fields = pindex->GetEquihashFields();
+            hashReserved = fields->hashReserved;
+            nBigNonce    = fields->nBigNonce;
+            nSolution    = fields->nSolution;
+        }
     }
 
     ADD_SERIALIZE_METHODS;
@@ -446,19 +531,25 @@ public:
         }
     }
 
-    uint256 GetBlockHash() const
+    /** The stored header, without the auxpow */
+    CBlockHeader GetStoredBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
         block.hashPrevBlock   = hashPrev;
         block.hashMerkleRoot  = hashMerkleRoot;
-		block.hashReserved    = hashReserved;
+        block.hashReserved    = hashReserved;
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
         block.nBigNonce       = nBigNonce;
-		block.nSolution       = nSolution;
-        return block.GetHash();
+        block.nSolution       = nSolution;
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        return GetStoredBlockHeader().GetHash();
     }
 
 
@@ -533,4 +624,63 @@ public:
     CBlockIndex* FindEarliestAtLeast(int64_t nTime) const;
 };
 
+/** Work, time span and number of the blocks of one algo in a range of the active chain. */
+struct CAlgoHashrateStats
+{
+    arith_uint256 nWork;
+    int64_t nTimeSpan;
+    int nBlocks;
+    const CBlockIndex* pindexFirst;
+    const CBlockIndex* pindexLast;
+
+    CAlgoHashrateStats() : nTimeSpan(0), nBlocks(0), pindexFirst(nullptr), pindexLast(nullptr) {}
+
+    /** Hashes per second, 0 if the blocks span no time. */
+    double GetHashrate() const { return nTimeSpan > 0 ? nWork.getdouble() / nTimeSpan : 0; }
+};
+
+/**
+ * Cumulative per-algo work along a chain, kept in step with that chain's tip.
+ * Answers the same questions as CalculateAlgoHashrate without walking the
+ * block index, and for any height range of the chain.
+ */
+class CAlgoHashrateIndex
+{
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        //! Work of this and all earlier blocks of the same algo in the chain
+        arith_uint256 nAlgoChainWork;
+        //! First entry GetPrevBlockIndexForAlgo can walk back to from this one
+        uint32_t nSegmentStart;
+    };
+
+    std::vector<Entry> vEntries[NUM_ALGOS];
+    const CBlockIndex* pindexTip;
+
+    void Connect(const CBlockIndex* pindex, const Consensus::Params& params);
+    void Disconnect(const CBlockIndex* pindex);
+    /** Sum up entries [nBegin, nEnd] of algo into stats. */
+    void GetStats(uint8_t algo, size_t nBegin, size_t nEnd, CAlgoHashrateStats& stats) const;
+
+public:
+    CAlgoHashrateIndex() : pindexTip(nullptr) {}
+
+    void Clear();
+    /** Disconnect blocks no longer in chain and connect the new ones, usually a single block. */
+    void SetTip(const CChain& chain, const Consensus::Params& params);
+    const CBlockIndex* Tip() const { return pindexTip; }
+
+    /**
+     * Same as CalculateAlgoHashrate(*pindex, algo, lookup, params): the last
+     * block of algo at or before pindex and up to lookup earlier ones.
+     * pindex must be on the chain this index follows.
+     */
+    CAlgoHashrateStats GetRecent(const CBlockIndex* pindex, uint8_t algo, int lookup, const Consensus::Params& params) const;
+    /** All blocks of algo with a height in [nStartHeight, nEndHeight]. */
+    CAlgoHashrateStats GetHeightRange(uint8_t algo, int nStartHeight, int nEndHeight) const;
+    /** The last nMaxCount blocks of algo with a height in [nStartHeight, nEndHeight], oldest first. */
+    std::vector<const CBlockIndex*> GetBlocks(uint8_t algo, int nStartHeight, int nEndHeight, size_t nMaxCount) const;
+};
+
 #endif // BITCOIN_CHAIN_H
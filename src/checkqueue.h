@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +19,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Maximum number of per-thread deques of a CCheckQueue, further workers share them */
+static const unsigned int MAX_CHECKQUEUE_SLOTS = 64;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +31,25 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread owns a deque of its own (the master slot 0, the workers the
+  * following ones in the order they started), which the master spreads added
+  * checks over. A thread takes work from the back of its own deque and, when
+  * that runs empty, steals from the front of the others', so threads only
+  * contend on the deque they take from. The global mutex is only taken to
+  * sleep and to wake sleeping threads.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    struct Slot {
+        //! Protects checks, held only to push or take a batch
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Mutex for sleeping and waking up threads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,88 +58,95 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per-thread deques
+    std::vector<std::unique_ptr<Slot>> vSlots;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that started, without the master
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are sleeping or about to.
+    std::atomic<unsigned int> nIdle;
+
+    //! The slot Add puts its next checks in
+    unsigned int nNextSlot;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
+
+    //! Number of verifications that sit in a deque
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    //! The number of slots in use
+    unsigned int GetSlotCount() const
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        return std::min<unsigned int>(nWorkers.load() + 1, vSlots.size());
+    }
+
+    /**
+     * Move a batch of checks from slot nSlot into vChecks, from the back of
+     * the owner's deque or the front of another's. Take at most half of what
+     * is queued there, so the rest is left for the other threads.
+     */
+    bool TakeBatch(unsigned int nSlot, bool fOwn, std::vector<T>& vChecks)
+    {
+        Slot& slot = *vSlots[nSlot];
+        boost::unique_lock<boost::mutex> lock(slot.mutex);
+        if (slot.checks.empty())
+            return false;
+        const size_t nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, slot.checks.size() / 2));
+        vChecks.resize(nNow);
+        for (T& check : vChecks) {
+            if (fOwn) {
+                check.swap(slot.checks.back());
+                slot.checks.pop_back();
+            } else {
+                check.swap(slot.checks.front());
+                slot.checks.pop_front();
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    //! Take a batch from slot nSlot, or steal one from the other slots
+    bool FindBatch(unsigned int nSlot, std::vector<T>& vChecks)
+    {
+        if (TakeBatch(nSlot, true, vChecks))
+            return true;
+        const unsigned int nSlots = GetSlotCount();
+        for (unsigned int i = 1; i < nSlots && nQueued.load() > 0; i++) {
+            if (TakeBatch((nSlot + i) % nSlots, false, vChecks))
+                return true;
+        }
+        return false;
+    }
+
+    //! Run a batch, unless a check failed already, and destroy it
+    void RunBatch(std::vector<T>& vChecks, bool fMaster)
+    {
+        bool fOk = fAllOk.load();
+        for (T& check : vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk)
+            fAllOk = false;
+        const unsigned int nNow = vChecks.size();
+        vChecks.clear();
+        if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
     }
 
 public:
@@ -128,32 +154,80 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nIdle(0), nNextSlot(0), fAllOk(true), nQueued(0), nTodo(0), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < MAX_CHECKQUEUE_SLOTS; i++)
+            vSlots.emplace_back(new Slot());
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        // Workers beyond the last slot share the worker slots
+        const unsigned int nWorker = nWorkers++;
+        const unsigned int nSlot = 1 + nWorker % (MAX_CHECKQUEUE_SLOTS - 1);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (FindBatch(nSlot, vChecks)) {
+                RunBatch(vChecks, false);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Add checks nIdle after it queued, so either it wakes us or we see its checks
+            nIdle++;
+            while (nQueued.load() == 0)
+                condWorker.wait(lock); // wait
+            nIdle--;
+        }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (true) {
+            if (FindBatch(0, vChecks)) {
+                RunBatch(vChecks, true);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nTodo.load() != 0 && nQueued.load() == 0)
+                condMaster.wait(lock); // wait
+            if (nTodo.load() == 0)
+                break;
+        }
+        // reset the status for new work later
+        return fAllOk.exchange(true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
+        // Count the checks first, a worker may finish them before we return
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        // Spread the checks over the slots round-robin, in chunks of an equal share
+        const unsigned int nSlots = GetSlotCount();
+        const size_t nChunk = std::max<size_t>(1, vChecks.size() / nSlots);
+        for (size_t i = 0; i < vChecks.size(); i += nChunk) {
+            Slot& slot = *vSlots[nNextSlot];
+            nNextSlot = (nNextSlot + 1) % nSlots;
+            boost::unique_lock<boost::mutex> lock(slot.mutex);
+            for (size_t j = i; j < std::min(i + nChunk, vChecks.size()); j++) {
+                slot.checks.push_back(T());
+                vChecks[j].swap(slot.checks.back());
+            }
+        }
+        if (nIdle.load() == 0)
+            return;
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -31,7 +31,8 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &cacheCoinsMemoryResource), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -204,9 +205,21 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    // Clearing keeps the pool chunks, and with them the memory usage of the cache.
+    ReallocateCache();
     return fOk;
 }
 
+void CCoinsViewCache::ReallocateCache()
+{
+    assert(cacheCoins.empty());
+    SaltedOutpointHasher hasher = cacheCoins.hash_function();
+    cacheCoins.~CCoinsMap();
+    cacheCoinsMemoryResource.~CCoinsMapMemoryResource();
+    ::new (&cacheCoinsMemoryResource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, hasher, CCoinsMap::key_equal(), &cacheCoinsMemoryResource);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -216,6 +229,52 @@ void CCoinsViewCache::Uncache(const COutPoint& hash)
     }
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin&& coin) {
+    auto inserted = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (!inserted.second)
+        return;
+    if (inserted.first->second.coin.IsSpent())
+        inserted.first->second.flags = CCoinsCacheEntry::FRESH;
+    cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
+size_t CCoinsViewCache::ExtractOldDirtyCoins(CCoinsMap &mapCoins, int nMaxHeight, size_t nMaxBytes) {
+    size_t nBytes = 0;
+    size_t nExtracted = 0;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && nBytes < nMaxBytes;) {
+        // Spent coins have height 0, their removal is always taken.
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY) || it->second.coin.nHeight > (unsigned int)std::max(nMaxHeight, 0)) {
+            ++it;
+            continue;
+        }
+        // The base never saw a spent FRESH coin, there is nothing to write.
+        if (it->second.coin.IsSpent() && (it->second.flags & CCoinsCacheEntry::FRESH)) {
+            it = cacheCoins.erase(it);
+            continue;
+        }
+        nBytes += sizeof(CCoinsMap::value_type) + it->second.coin.DynamicMemoryUsage();
+        CCoinsCacheEntry& entry = mapCoins[it->first];
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        nExtracted++;
+        if (it->second.coin.IsSpent()) {
+            entry.coin = std::move(it->second.coin);
+            it = cacheCoins.erase(it);
+        } else {
+            entry.coin = it->second.coin;
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    return nExtracted;
+}
+
+void CCoinsViewCache::GetDirtyCoins(std::vector<std::pair<COutPoint, Coin> >& vCoins) const {
+    for (const auto& entry : cacheCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY)
+            vCoins.emplace_back(entry.first, entry.second.coin);
+    }
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
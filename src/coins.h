@@ -12,6 +12,7 @@
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -119,7 +120,14 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of the coins map come from a pool, which saves the malloc overhead
+ * of every entry. A block fits a node with up to four pointers of bookkeeping.
+ */
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4> > CCoinsMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -206,6 +214,8 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    //! Memory of the cacheCoins nodes, so it has to be declared (and constructed) first
+    mutable CCoinsMapMemoryResource cacheCoinsMemoryResource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -274,6 +284,28 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    /**
+     * Add a coin read from the backing view ahead of time, unless the cache
+     * has an entry for the outpoint already. The coin must be what GetCoin
+     * of the backing view returns for this outpoint.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin&& coin);
+
+    /**
+     * Hand modifications of coins created at or below nMaxHeight (and all
+     * spends) to mapCoins, as Flush would pass them to the base, stopping once
+     * about nMaxBytes of entries were taken. Unspent coins stay cached as
+     * unmodified, spent ones are dropped. The caller has to write mapCoins to
+     * the base. Returns the number of entries taken.
+     */
+    size_t ExtractOldDirtyCoins(CCoinsMap &mapCoins, int nMaxHeight, size_t nMaxBytes);
+
+    /**
+     * Append copies of the modified entries, spent ones included, to vCoins:
+     * the difference Flush would make to the base.
+     */
+    void GetDirtyCoins(std::vector<std::pair<COutPoint, Coin> >& vCoins) const;
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
@@ -295,6 +327,12 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /**
+     * Start over with an empty cacheCoins and a new memory pool, giving back
+     * the memory of the old one. The cache has to be empty.
+     */
+    void ReallocateCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
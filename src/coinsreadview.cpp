@@ -0,0 +1,153 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsreadview.h>
+
+#include <chain.h>
+#include <sync.h>
+#include <txdb.h>
+#include <util.h>
+#include <utiltime.h>
+#include <validation.h>
+
+bool fCoinsReadView = DEFAULT_COINS_READ_VIEW;
+
+CCoinsReadView::CCoinsReadView(const CCoinsViewDB& dbIn, std::vector<std::pair<COutPoint, Coin> >&& vCoins, const uint256& hashBlockIn, int nHeightIn)
+    : db(dbIn), hashBlock(hashBlockIn), nHeight(nHeightIn)
+{
+    // The coins still being written in the background are older than vCoins.
+    std::vector<std::pair<COutPoint, Coin> > vBackground;
+    psnapshot = db.GetSnapshot(vBackground);
+    if (vBackground.empty() && vCoins.empty())
+        return;
+
+    std::shared_ptr<Layer> layer = std::make_shared<Layer>();
+    layer->mapCoins.reserve(vBackground.size() + vCoins.size());
+    for (auto& entry : vBackground)
+        layer->mapCoins[entry.first] = std::move(entry.second);
+    for (auto& entry : vCoins)
+        layer->mapCoins[entry.first] = std::move(entry.second);
+    top = std::move(layer);
+}
+
+CCoinsReadView::CCoinsReadView(const CCoinsReadView& prev, std::vector<std::pair<COutPoint, Coin> >&& vCoins, const uint256& hashBlockIn, int nHeightIn)
+    : db(prev.db), psnapshot(prev.psnapshot), top(prev.top), hashBlock(hashBlockIn), nHeight(nHeightIn)
+{
+    if (vCoins.empty())
+        return;
+
+    std::shared_ptr<Layer> layer = std::make_shared<Layer>();
+    layer->mapCoins.reserve(vCoins.size());
+    for (auto& entry : vCoins)
+        layer->mapCoins[entry.first] = std::move(entry.second);
+    layer->parent = top;
+
+    // Fold the layer below into this one while it is not much larger, so the
+    // sizes grow geometrically towards the bottom and there are only
+    // logarithmically many of them. The layers of prev are left alone.
+    while (layer->parent && layer->parent->mapCoins.size() <= 2 * layer->mapCoins.size()) {
+        std::shared_ptr<Layer> merged = std::make_shared<Layer>(*layer->parent);
+        for (auto& entry : layer->mapCoins)
+            merged->mapCoins[entry.first] = std::move(entry.second);
+        layer = std::move(merged);
+    }
+    top = std::move(layer);
+}
+
+bool CCoinsReadView::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    for (const Layer* layer = top.get(); layer; layer = layer->parent.get()) {
+        auto it = layer->mapCoins.find(outpoint);
+        if (it != layer->mapCoins.end()) {
+            if (it->second.IsSpent())
+                return false;
+            coin = it->second;
+            return true;
+        }
+    }
+    return db.GetCoin(outpoint, coin, *psnapshot);
+}
+
+bool CCoinsReadView::HaveCoin(const COutPoint &outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+size_t CCoinsReadView::GetLayerCount() const
+{
+    size_t nLayers = 0;
+    for (const Layer* layer = top.get(); layer; layer = layer->parent.get())
+        nLayers++;
+    return nLayers;
+}
+
+namespace {
+
+CCriticalSection cs_coinsreadview;
+//! The view of the chain tip, replaced as a whole
+std::shared_ptr<CCoinsReadView> pcoinsreadview;
+
+void SetCoinsReadView(std::shared_ptr<CCoinsReadView> pview)
+{
+    LOCK(cs_coinsreadview);
+    pcoinsreadview.swap(pview);
+    // The old view is released outside of the lock.
+}
+
+/** A view of pcoinsTip made from scratch, which copies its modified entries */
+std::shared_ptr<CCoinsReadView> NewCoinsReadView(const CBlockIndex* pindexTip)
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMicros();
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    pcoinsTip->GetDirtyCoins(vCoins);
+    const size_t nCoins = vCoins.size();
+    std::shared_ptr<CCoinsReadView> pview = std::make_shared<CCoinsReadView>(*pcoinsdbview, std::move(vCoins), pindexTip->GetBlockHash(), pindexTip->nHeight);
+    LogPrint(BCLog::BENCH, "- New coins read view at %s with %u modified coins: %.2fms\n", pindexTip->GetBlockHash().ToString(), (unsigned int)nCoins, (GetTimeMicros() - nStart) * 0.001);
+    return pview;
+}
+
+} // namespace
+
+std::shared_ptr<CCoinsReadView> GetCoinsReadView()
+{
+    LOCK(cs_coinsreadview);
+    return pcoinsreadview;
+}
+
+void UpdateCoinsReadView(const uint256& hashPrev, const CBlockIndex* pindexNew, std::vector<std::pair<COutPoint, Coin> >&& vCoins)
+{
+    AssertLockHeld(cs_main);
+    if (!fCoinsReadView || IsInitialBlockDownload()) {
+        SetCoinsReadView(nullptr);
+        return;
+    }
+
+    std::shared_ptr<CCoinsReadView> pprev = GetCoinsReadView();
+    if (pprev && pprev->GetBestBlock() == hashPrev) {
+        SetCoinsReadView(std::make_shared<CCoinsReadView>(*pprev, std::move(vCoins), pindexNew->GetBlockHash(), pindexNew->nHeight));
+    } else {
+        SetCoinsReadView(NewCoinsReadView(pindexNew));
+    }
+}
+
+void RebaseCoinsReadView()
+{
+    AssertLockHeld(cs_main);
+    // Only keep a view going, the next block starts one after the initial block download.
+    if (!GetCoinsReadView())
+        return;
+    BlockMap::const_iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+    if (it == mapBlockIndex.end()) {
+        SetCoinsReadView(nullptr);
+        return;
+    }
+    SetCoinsReadView(NewCoinsReadView(it->second));
+}
+
+void ResetCoinsReadView()
+{
+    SetCoinsReadView(nullptr);
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSREADVIEW_H
+#define BITCOIN_COINSREADVIEW_H
+
+#include <coins.h>
+#include <uint256.h>
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+class CCoinsViewDB;
+class CDBSnapshot;
+
+static const bool DEFAULT_COINS_READ_VIEW = true;
+
+/** Whether a read view of the chainstate is published for every connected block (-coinsreadview) */
+extern bool fCoinsReadView;
+
+/**
+ * A read-only version of the UTXO set as of one block: a snapshot of the coins
+ * database with layers of the coins changed since then on top. Every version
+ * shares the snapshot and the older layers with the one it was made from, the
+ * layers are merged as they grow so a lookup only has to check a few of them.
+ * Nothing changes a view once it is made, so it can be read by any thread
+ * without locks. The coins database has to outlive it.
+ */
+class CCoinsReadView : public CCoinsView
+{
+private:
+    struct Layer
+    {
+        std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> mapCoins;
+        std::shared_ptr<const Layer> parent;
+    };
+
+    const CCoinsViewDB& db;
+    std::shared_ptr<const CDBSnapshot> psnapshot;
+    std::shared_ptr<const Layer> top;
+    uint256 hashBlock;
+    int nHeight;
+
+public:
+    /** The coins database as of now, with the modifications not written to it yet in vCoins applied */
+    CCoinsReadView(const CCoinsViewDB& dbIn, std::vector<std::pair<COutPoint, Coin> >&& vCoins, const uint256& hashBlockIn, int nHeightIn);
+    /** The coins of prev, with the changes vCoins of the block hashBlockIn applied */
+    CCoinsReadView(const CCoinsReadView& prev, std::vector<std::pair<COutPoint, Coin> >&& vCoins, const uint256& hashBlockIn, int nHeightIn);
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override { return hashBlock; }
+    int GetHeight() const { return nHeight; }
+
+    //! Number of layers on top of the database snapshot
+    size_t GetLayerCount() const;
+};
+
+/** The read view of the chain tip, or nullptr while there is none (then pcoinsTip under cs_main has to be used) */
+std::shared_ptr<CCoinsReadView> GetCoinsReadView();
+
+/**
+ * Publish the view after the coins of the block that moved pcoinsTip from
+ * hashPrev to pindexNew were flushed to it; vCoins are the entries that
+ * changed, as taken by CCoinsViewCache::GetDirtyCoins. No view is kept
+ * during the initial block download. Requires cs_main.
+ */
+void UpdateCoinsReadView(const uint256& hashPrev, const CBlockIndex* pindexNew, std::vector<std::pair<COutPoint, Coin> >&& vCoins);
+/** pcoinsTip was flushed to the coins database, start the view over from a new snapshot. Requires cs_main. */
+void RebaseCoinsReadView();
+/** Drop the view, before the coins database goes away */
+void ResetCoinsReadView();
+
+#endif // BITCOIN_COINSREADVIEW_H
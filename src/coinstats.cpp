@@ -0,0 +1,155 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstats.h>
+
+#include <chain.h>
+#include <consensus/params.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+#include <version.h>
+
+#include <string.h>
+
+CCoinStatsIndex coinstatsindex;
+
+uint256 FinalizeMuHash(MuHash3072& muhash)
+{
+    uint256 hash;
+    muhash.Finalize(hash.begin());
+    return hash;
+}
+
+void ApplyCoin(MuHash3072& muhash, CCoinStatsEntry& stats, const COutPoint& outpoint, const Coin& coin, bool fAdd)
+{
+    std::vector<unsigned char> ser;
+    CVectorWriter ss(SER_DISK, PROTOCOL_VERSION, ser, 0);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+
+    const uint64_t nBogoSize = 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                               2 /* scriptPubKey len */ + coin.out.scriptPubKey.size() /* scriptPubKey */;
+    if (fAdd) {
+        muhash.Insert(ser.data(), ser.size());
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += coin.out.nValue;
+        stats.nBogoSize += nBogoSize;
+    } else {
+        muhash.Remove(ser.data(), ser.size());
+        stats.nTransactionOutputs--;
+        stats.nTotalAmount -= coin.out.nValue;
+        stats.nBogoSize -= nBogoSize;
+    }
+}
+
+namespace {
+
+/** Add or remove the outputs a block created and restore or remove the ones it spent */
+void ApplyBlock(MuHash3072& muhash, CCoinStatsEntry& stats, const CBlock& block, const CBlockUndo& blockundo, int nHeight, bool fConnect)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        // Unspendable outputs never enter the UTXO set, see AddCoins.
+        for (uint32_t j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            ApplyCoin(muhash, stats, COutPoint(tx.GetHash(), j), Coin(tx.vout[j], nHeight, tx.IsCoinBase()), fConnect);
+        }
+        if (tx.IsCoinBase())
+            continue;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            ApplyCoin(muhash, stats, tx.vin[j].prevout, txundo.vprevout[j], !fConnect);
+        }
+    }
+}
+
+} // namespace
+
+bool CCoinStatsIndex::WriteStats(const uint256& hashBlock)
+{
+    stats.hashMuHash = FinalizeMuHash(muhash);
+    std::vector<unsigned char> state(Num3072::BYTE_SIZE);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    muhash.GetState().ToBytes(bytes);
+    memcpy(state.data(), bytes, sizeof(bytes));
+
+    hashBestBlock = hashBlock;
+    vStatesSinceFlush.push_back(hashBlock);
+    return pblocktree->WriteCoinStats(hashBlock, stats, state);
+}
+
+bool CCoinStatsIndex::Init(const CBlockIndex* pindexTip, const Consensus::Params& consensusParams)
+{
+    muhash = MuHash3072();
+    stats.SetNull();
+    vStatesSinceFlush.clear();
+
+    if (!pindexTip || !pindexTip->pprev) {
+        // Nothing in the genesis block is spendable, the UTXO set starts out empty.
+        stats.hashMuHash = FinalizeMuHash(muhash);
+        hashBestBlock = consensusParams.hashGenesisBlock;
+        return true;
+    }
+
+    const uint256 hashTip = pindexTip->GetBlockHash();
+    std::vector<unsigned char> state;
+    if (!pblocktree->ReadCoinStats(hashTip, stats) || !pblocktree->ReadCoinStatsState(hashTip, state) ||
+        state.size() != Num3072::BYTE_SIZE) {
+        return error("%s: no coin stats for the chain tip %s", __func__, hashTip.ToString());
+    }
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    memcpy(bytes, state.data(), sizeof(bytes));
+    muhash.SetState(Num3072(bytes));
+    hashBestBlock = hashTip;
+    vStatesSinceFlush.push_back(hashTip);
+    return true;
+}
+
+bool CCoinStatsIndex::ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    if (pindex->pprev->GetBlockHash() != hashBestBlock)
+        return error("%s: block %s does not extend the coin stats index tip %s", __func__, pindex->GetBlockHash().ToString(), hashBestBlock.ToString());
+
+    ApplyBlock(muhash, stats, block, blockundo, pindex->nHeight, true);
+    return WriteStats(pindex->GetBlockHash());
+}
+
+bool CCoinStatsIndex::DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    if (pindex->GetBlockHash() != hashBestBlock)
+        return error("%s: block %s is not the coin stats index tip %s", __func__, pindex->GetBlockHash().ToString(), hashBestBlock.ToString());
+
+    ApplyBlock(muhash, stats, block, blockundo, pindex->nHeight, false);
+    return WriteStats(pindex->pprev->GetBlockHash());
+}
+
+void CCoinStatsIndex::ChainStateFlushed(const uint256& hashBlock)
+{
+    std::vector<uint256> vErase;
+    for (const uint256& hash : vStatesSinceFlush) {
+        if (hash != hashBlock)
+            vErase.push_back(hash);
+    }
+    if (!pblocktree->EraseCoinStatsStates(vErase)) {
+        // Only wastes some space, the states are not read for older blocks.
+        LogPrintf("%s: failed to erase old coin stats states\n", __func__);
+    }
+    vStatesSinceFlush.assign(1, hashBlock);
+}
+
+bool CCoinStatsIndex::LookUpStats(const CBlockIndex* pindex, CCoinStatsEntry& entry) const
+{
+    if (!pindex->pprev) {
+        MuHash3072 empty;
+        entry.SetNull();
+        entry.hashMuHash = FinalizeMuHash(empty);
+        return true;
+    }
+    return pblocktree->ReadCoinStats(pindex->GetBlockHash(), entry);
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include <crypto/muhash.h>
+#include <txdb.h>
+#include <uint256.h>
+
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class CCoinStatsIndex;
+class COutPoint;
+class Coin;
+
+namespace Consensus { struct Params; }
+
+static const bool DEFAULT_COINSTATSINDEX = false;
+
+extern CCoinStatsIndex coinstatsindex;
+
+/** Add or remove an unspent output, serialized for the MuHash like gettxoutsetinfo hashes it */
+void ApplyCoin(MuHash3072& muhash, CCoinStatsEntry& stats, const COutPoint& outpoint, const Coin& coin, bool fAdd);
+uint256 FinalizeMuHash(MuHash3072& muhash);
+
+/**
+ * Totals of the UTXO set kept up to date as blocks are connected to and
+ * disconnected from the active chain (-coinstatsindex), so gettxoutsetinfo
+ * does not have to walk the chainstate. An entry is stored in the block tree
+ * database for every block, together with the MuHash state to continue from,
+ * which is only kept for blocks the chainstate on disk may still be at.
+ * Protected by cs_main.
+ */
+class CCoinStatsIndex
+{
+private:
+    MuHash3072 muhash;
+    CCoinStatsEntry stats;
+    uint256 hashBestBlock;
+    //! Blocks whose MuHash state was written since the chainstate was last flushed
+    std::vector<uint256> vStatesSinceFlush;
+
+    bool WriteStats(const uint256& hashBlock);
+
+public:
+    /** Start from the stored state of the chain tip, or from the empty set at genesis */
+    bool Init(const CBlockIndex* pindexTip, const Consensus::Params& consensusParams);
+
+    /** Apply a block connected on top of the current best block */
+    bool ConnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    /** Revert the current best block */
+    bool DisconnectBlock(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+    /** The chainstate was flushed at hashBlock, drop the states it cannot fall back to anymore */
+    void ChainStateFlushed(const uint256& hashBlock);
+
+    const uint256& GetBestBlock() const { return hashBestBlock; }
+
+    /** Read the totals as of a block the index went through */
+    bool LookUpStats(const CBlockIndex* pindex, CCoinStatsEntry& entry) const;
+};
+
+#endif // BITCOIN_COINSTATS_H
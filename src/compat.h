@@ -48,6 +48,23 @@
 #include <unistd.h>
 #endif
 
+// Event-driven socket backends for the socket handler thread (-socketevents),
+// which unlike select() do not limit the number of connections to FD_SETSIZE.
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#elif defined(HAVE_SYS_EVENT_H)
+#include <sys/event.h>
+#define USE_KQUEUE
+#endif
+
+// poll() waits on a single socket without the FD_SETSIZE limit. It is broken
+// for this use on Windows and macOS, where select() is kept.
+#if defined(__linux__)
+#include <poll.h>
+#define USE_POLL
+#endif
+
 #ifndef WIN32
 typedef unsigned int SOCKET;
 #include <errno.h>
@@ -11,6 +11,7 @@
 #include <vector>
 
 class CBlock;
+class CJSONWriter;
 class CScript;
 class CTransaction;
 class CPOSTransaction;
@@ -33,6 +34,10 @@ std::string FormatScript(const CScript& script);
 std::string EncodeHexTx(const CTransaction& tx, const int serializeFlags = 0);
 void ScriptPubKeyToUniv(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_hex = true, int serialize_flags = 0);
+/** Like ScriptPubKeyToUniv, writing the object straight to JSON text */
+void ScriptPubKeyToJSON(const CScript& scriptPubKey, CJSONWriter& writer, bool fIncludeHex);
+/** Like TxToUniv, writing the object straight to JSON text */
+void TxToJSON(const CTransaction& tx, const uint256& hashBlock, CJSONWriter& writer, bool include_hex = true, int serialize_flags = 0);
 void POSTxToUniv(const CPOSTransaction& tx, const uint256& hashBlock, UniValue& entry, int serialize_flags = 0);
 
 #endif // BITCOIN_CORE_IO_H
@@ -7,6 +7,7 @@
 #include <base58.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <jsonwriter.h>
 #include <script/script.h>
 #include <script/standard.h>
 #include <serialize.h>
@@ -213,6 +214,100 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
     }
 }
 
+// The JSON writer variants below describe the same as their UniValue
+// counterparts, for the RPCs that return many transactions at once.
+
+void ScriptPubKeyToJSON(const CScript& scriptPubKey, CJSONWriter& writer, bool fIncludeHex)
+{
+    txnouttype type;
+    std::vector<CTxDestination> addresses;
+    int nRequired;
+
+    writer.BeginObject();
+    writer.KV("asm", ScriptToAsmStr(scriptPubKey));
+    if (fIncludeHex)
+        writer.KV("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end()));
+
+    if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired)) {
+        writer.KV("type", GetTxnOutputType(type));
+        writer.EndObject();
+        return;
+    }
+
+    writer.KV("reqSigs", nRequired);
+    writer.KV("type", GetTxnOutputType(type));
+
+    writer.Key("addresses");
+    writer.BeginArray();
+    for (const CTxDestination& addr : addresses) {
+        writer.Value(EncodeDestination(addr));
+    }
+    writer.EndArray();
+    writer.EndObject();
+}
+
+void TxToJSON(const CTransaction& tx, const uint256& hashBlock, CJSONWriter& writer, bool include_hex, int serialize_flags)
+{
+    writer.BeginObject();
+    writer.KV("txid", tx.GetHash().GetHex());
+    writer.KV("hash", tx.GetWitnessHash().GetHex());
+    writer.KV("version", tx.nVersion);
+    writer.KV("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    writer.KV("vsize", (int64_t)((GetTransactionWeight(tx) + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR));
+    writer.KV("locktime", (int64_t)tx.nLockTime);
+
+    writer.Key("vin");
+    writer.BeginArray();
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const CTxIn& txin = tx.vin[i];
+        writer.BeginObject();
+        if (tx.IsCoinBase())
+            writer.KV("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+        else {
+            writer.KV("txid", txin.prevout.hash.GetHex());
+            writer.KV("vout", (int64_t)txin.prevout.n);
+            writer.Key("scriptSig");
+            writer.BeginObject();
+            writer.KV("asm", ScriptToAsmStr(txin.scriptSig, true));
+            writer.KV("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+            writer.EndObject();
+            if (!tx.vin[i].scriptWitness.IsNull()) {
+                writer.Key("txinwitness");
+                writer.BeginArray();
+                for (const auto& item : tx.vin[i].scriptWitness.stack) {
+                    writer.Value(HexStr(item.begin(), item.end()));
+                }
+                writer.EndArray();
+            }
+        }
+        writer.KV("sequence", (int64_t)txin.nSequence);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("vout");
+    writer.BeginArray();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut& txout = tx.vout[i];
+        writer.BeginObject();
+        writer.Key("value");
+        writer.RawValue(ValueFromAmount(txout.nValue).getValStr());
+        writer.KV("n", (int64_t)i);
+        writer.Key("scriptPubKey");
+        ScriptPubKeyToJSON(txout.scriptPubKey, writer, true);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    if (!hashBlock.IsNull())
+        writer.KV("blockhash", hashBlock.GetHex());
+
+    if (include_hex) {
+        writer.KV("hex", EncodeHexTx(tx, serialize_flags));
+    }
+    writer.EndObject();
+}
+
 void POSTxToUniv(const CPOSTransaction& tx, const uint256& hashBlock, UniValue& entry, int serialize_flags)
 {
     entry.pushKV("txid", tx.GetHash().GetHex());
@@ -24,6 +24,40 @@
 #include "Lyra2.h"
 #include "Sponge.h"
 
+/*
+ * The memory matrix and its row pointers are reused across calls on the same
+ * thread instead of being allocated for every hash. Callers clear the matrix
+ * before use, so only the size needs to be tracked.
+ */
+static __thread uint64_t *scratch_matrix = NULL;
+static __thread size_t scratch_matrix_size = 0;
+static __thread uint64_t **scratch_rows = NULL;
+static __thread size_t scratch_rows_count = 0;
+
+static uint64_t *lyra2_scratch_matrix(size_t bytes) {
+    if (bytes > scratch_matrix_size) {
+        uint64_t *matrix = realloc(scratch_matrix, bytes);
+        if (matrix == NULL) {
+            return NULL;
+        }
+        scratch_matrix = matrix;
+        scratch_matrix_size = bytes;
+    }
+    return scratch_matrix;
+}
+
+static uint64_t **lyra2_scratch_rows(size_t nRows) {
+    if (nRows > scratch_rows_count) {
+        uint64_t **rows = realloc(scratch_rows, nRows * sizeof (uint64_t*));
+        if (rows == NULL) {
+            return NULL;
+        }
+        scratch_rows = rows;
+        scratch_rows_count = nRows;
+    }
+    return scratch_rows;
+}
+
 /**
  * Executes Lyra2 based on the G function from Blake2b. This version supports salts and passwords
  * whose combined length is smaller than the size of the memory matrix, (i.e., (nRows x nCols x b) bits,
@@ -64,14 +98,14 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
     const int64_t ROW_LEN_BYTES = ROW_LEN_INT64 * 8;
 
     i = (int64_t) ((int64_t) nRows * (int64_t) ROW_LEN_BYTES);
-    uint64_t *wholeMatrix = malloc(i);
+    uint64_t *wholeMatrix = lyra2_scratch_matrix(i);
     if (wholeMatrix == NULL) {
       return -1;
     }
 	memset(wholeMatrix, 0, i);
 
     //Allocates pointers to each row of the matrix
-    uint64_t **memMatrix = malloc(nRows * sizeof (uint64_t*));
+    uint64_t **memMatrix = lyra2_scratch_rows(nRows);
     if (memMatrix == NULL) {
       return -1;
     }
@@ -123,10 +157,7 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
 
     //======================= Initializing the Sponge State ====================//
     //Sponge state: 16 uint64_t, BLOCK_LEN_INT64 words of them for the bitrate (b) and the remainder for the capacity (c)
-    uint64_t *state = malloc(16 * sizeof (uint64_t));
-    if (state == NULL) {
-      return -1;
-    }
+    uint64_t state[16];
     initState(state);
     //==========================================================================/
 
@@ -201,12 +232,10 @@ int LYRA2(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void *
     //==========================================================================/
 
     //========================= Freeing the memory =============================//
-    free(memMatrix);
-    free(wholeMatrix);
+    //The matrix and row pointers are kept for the next call on this thread
 
-    //Wiping out the sponge's internal state before freeing it
+    //Wiping out the sponge's internal state
     memset(state, 0, 16 * sizeof (uint64_t));
-    free(state);
     //==========================================================================/
 
     return 0;
@@ -233,14 +262,14 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
     const int64_t ROW_LEN_BYTES = ROW_LEN_INT64 * 8;
 
     i = (int64_t) ((int64_t) nRows * (int64_t) ROW_LEN_BYTES);
-    uint64_t *wholeMatrix = malloc(i);
+    uint64_t *wholeMatrix = lyra2_scratch_matrix(i);
     if (wholeMatrix == NULL) {
       return -1;
     }
 	memset(wholeMatrix, 0, i);
 
     //Allocates pointers to each row of the matrix
-    uint64_t **memMatrix = malloc(nRows * sizeof (uint64_t*));
+    uint64_t **memMatrix = lyra2_scratch_rows(nRows);
     if (memMatrix == NULL) {
       return -1;
     }
@@ -292,10 +321,7 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
 
     //======================= Initializing the Sponge State ====================//
     //Sponge state: 16 uint64_t, BLOCK_LEN_INT64 words of them for the bitrate (b) and the remainder for the capacity (c)
-    uint64_t *state = malloc(16 * sizeof (uint64_t));
-    if (state == NULL) {
-      return -1;
-    }
+    uint64_t state[16];
     initState(state);
     //==========================================================================/
 
@@ -370,12 +396,10 @@ int LYRA2_old(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const vo
     //==========================================================================/
 
     //========================= Freeing the memory =============================//
-    free(memMatrix);
-    free(wholeMatrix);
+    //The matrix and row pointers are kept for the next call on this thread
 
-    //Wiping out the sponge's internal state before freeing it
+    //Wiping out the sponge's internal state
     memset(state, 0, 16 * sizeof (uint64_t));
-    free(state);
     //==========================================================================/
 
     return 0;
@@ -421,14 +445,14 @@ int LYRA2_3(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void
     const int64_t ROW_LEN_BYTES = ROW_LEN_INT64 * 8;
 
     i = (int64_t) ((int64_t) nRows * (int64_t) ROW_LEN_BYTES);
-    uint64_t *wholeMatrix = malloc(i);
+    uint64_t *wholeMatrix = lyra2_scratch_matrix(i);
     if (wholeMatrix == NULL) {
       return -1;
     }
 	  memset(wholeMatrix, 0, i);
 
     //Allocates pointers to each row of the matrix
-    uint64_t **memMatrix = malloc(nRows * sizeof (uint64_t*));
+    uint64_t **memMatrix = lyra2_scratch_rows(nRows);
     if (memMatrix == NULL) {
       return -1;
     }
@@ -480,10 +504,7 @@ int LYRA2_3(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void
 
     //======================= Initializing the Sponge State ====================//
     //Sponge state: 16 uint64_t, BLOCK_LEN_INT64 words of them for the bitrate (b) and the remainder for the capacity (c)
-    uint64_t *state = malloc(16 * sizeof (uint64_t));
-    if (state == NULL) {
-      return -1;
-    }
+    uint64_t state[16];
     initState(state);
     //==========================================================================/
 
@@ -561,12 +582,10 @@ int LYRA2_3(void *K, uint64_t kLen, const void *pwd, uint64_t pwdlen, const void
     //==========================================================================/
 
     //========================= Freeing the memory =============================//
-    free(memMatrix);
-    free(wholeMatrix);
+    //The matrix and row pointers are kept for the next call on this thread
 
-    //Wiping out the sponge's internal state before freeing it
+    //Wiping out the sponge's internal state
     memset(state, 0, 16 * sizeof (uint64_t));
-    free(state);
     //==========================================================================/
 
     return 0;
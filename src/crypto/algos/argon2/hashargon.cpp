@@ -6,11 +6,244 @@
 #include "argon2.h"
 #include "hashargon.h"
 
+extern "C" {
+#include "core.h"
+#include "../powscratch.h"
+}
+
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
 #include <cstdlib>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 #include <assert.h>
 
+/**
+ * Argon2 block memory is kept per thread and reused by the next hash instead
+ * of being allocated and freed on every call. argon2_ctx still wipes the
+ * memory before handing it back through ReleaseScratch.
+ */
+static __thread uint8_t* argon2_scratch = nullptr;
+static __thread size_t argon2_scratch_size = 0;
+//! Nonzero if argon2_scratch was mapped by pow_scratch_alloc
+static __thread size_t argon2_scratch_mapped_size = 0;
+
+static int AllocateScratch(uint8_t** memory, size_t bytes_to_allocate)
+{
+    if (bytes_to_allocate > argon2_scratch_size) {
+        if (argon2_scratch_mapped_size) {
+            pow_scratch_free(argon2_scratch, argon2_scratch_mapped_size);
+            argon2_scratch_mapped_size = 0;
+        } else {
+            free(argon2_scratch);
+        }
+        if (pow_scratch_hugepages()) {
+            argon2_scratch = static_cast<uint8_t*>(pow_scratch_alloc(bytes_to_allocate, &argon2_scratch_mapped_size));
+            if (!argon2_scratch)
+                argon2_scratch_mapped_size = 0;
+        } else {
+            argon2_scratch = static_cast<uint8_t*>(malloc(bytes_to_allocate));
+        }
+        argon2_scratch_size = argon2_scratch ? bytes_to_allocate : 0;
+    }
+    *memory = argon2_scratch;
+    return argon2_scratch ? ARGON2_OK : ARGON2_MEMORY_ALLOCATION_ERROR;
+}
+
+static void ReleaseScratch(uint8_t* memory, size_t bytes_to_allocate)
+{
+    assert(memory == argon2_scratch);
+}
+
+/**
+ * Workers that fill the segments of the lanes of one argon2 hash together
+ * with the thread hashing, one slice after the other. The threads of
+ * argon2/thread.c are created for every slice, which costs more than filling
+ * the few hundred KiB of these algos takes, so these stay around instead.
+ */
+class Argon2LanePool
+{
+private:
+    /** A slice to fill, workers copy it under mutex */
+    struct Slice
+    {
+        const argon2_instance_t* instance;
+        argon2_position_t position;
+        uint32_t nLanes;
+        uint32_t nGeneration;
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cvWork;
+    std::condition_variable cvDone;
+    //! Changes for every slice, under mutex
+    Slice slice;
+    bool fStop = false;
+
+    //! The generation of the slice in the top 32 bits, the next lane to fill in the bottom 32.
+    //! A worker that is late for a slice cannot claim a lane of the next one.
+    std::atomic<uint64_t> nNextLane{0};
+    std::atomic<uint32_t> nLanesDone{0};
+
+    void FillLanes(const Slice& current)
+    {
+        uint32_t nFilled = 0;
+        uint64_t nTicket = nNextLane.load();
+        while ((nTicket >> 32) == current.nGeneration && (uint32_t)nTicket < current.nLanes) {
+            if (!nNextLane.compare_exchange_weak(nTicket, nTicket + 1))
+                continue;
+            argon2_position_t pos = current.position;
+            pos.lane = (uint32_t)nTicket;
+            fill_segment(current.instance, pos);
+            nFilled++;
+            nTicket = nNextLane.load();
+        }
+        if (nFilled && nLanesDone.fetch_add(nFilled) + nFilled == current.nLanes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cvDone.notify_one();
+        }
+    }
+
+    void ThreadWorker()
+    {
+        uint32_t nSeen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cvWork.wait(lock, [&] { return fStop || slice.nGeneration != nSeen; });
+            if (fStop)
+                return;
+            const Slice current = slice;
+            nSeen = current.nGeneration;
+            lock.unlock();
+            FillLanes(current);
+            lock.lock();
+        }
+    }
+
+public:
+    //! Held by the hash using the workers, the others fill their lanes themselves
+    std::mutex csBusy;
+
+    Argon2LanePool() { slice.nGeneration = 0; }
+    ~Argon2LanePool() { SetThreads(1); }
+
+    int GetThreads() const { return threads.size() + 1; }
+
+    void SetThreads(int nThreads)
+    {
+        std::lock_guard<std::mutex> busy(csBusy);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cvWork.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+        threads.clear();
+        fStop = false;
+        for (int i = 1; i < nThreads; i++)
+            threads.emplace_back(&Argon2LanePool::ThreadWorker, this);
+    }
+
+    /** Fill the memory of an instance, csBusy must be held */
+    void Fill(const argon2_instance_t* instance)
+    {
+        for (uint32_t r = 0; r < instance->passes; r++) {
+            for (uint8_t s = 0; s < ARGON2_SYNC_POINTS; s++) {
+                Slice current;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    slice.instance = instance;
+                    slice.position = {r, 0, s, 0};
+                    slice.nLanes = instance->lanes;
+                    slice.nGeneration++;
+                    current = slice;
+                    nLanesDone = 0;
+                    nNextLane = (uint64_t)current.nGeneration << 32;
+                }
+                cvWork.notify_all();
+                FillLanes(current);
+                std::unique_lock<std::mutex> lock(mutex);
+                cvDone.wait(lock, [&] { return nLanesDone == current.nLanes; });
+            }
+        }
+    }
+};
+
+/**
+ * Segments of fewer blocks are filled by the hashing thread alone, waking the
+ * workers for every slice costs more than they save. Argon2dHash has segments
+ * of 48 blocks, Argon2iHash of 5.
+ */
+static const uint32_t ARGON2_MIN_PARALLEL_SEGMENT = 32;
+
+static Argon2LanePool argon2_lane_pool;
+static __thread bool argon2_parallel = false;
+
+void SetArgon2LaneThreads(int nThreads)
+{
+    argon2_lane_pool.SetThreads(nThreads);
+}
+
+CArgon2ParallelScope::CArgon2ParallelScope(bool fEnable) : fPrevious(argon2_parallel)
+{
+    argon2_parallel = fPrevious || fEnable;
+}
+
+CArgon2ParallelScope::~CArgon2ParallelScope()
+{
+    argon2_parallel = fPrevious;
+}
+
+/**
+ * argon2_ctx, filling the lanes on the lane pool when this thread is in a
+ * CArgon2ParallelScope, the segments are long enough and the pool has
+ * workers that are not busy with another hash.
+ */
+static int Argon2Ctx(argon2_context* context, argon2_type type)
+{
+    if (!argon2_parallel || context->lanes < 2)
+        return argon2_ctx(context, type);
+
+    // The memory layout of argon2_ctx
+    uint32_t memory_blocks = context->m_cost;
+    if (memory_blocks < 2 * ARGON2_SYNC_POINTS * context->lanes)
+        memory_blocks = 2 * ARGON2_SYNC_POINTS * context->lanes;
+    const uint32_t segment_length = memory_blocks / (context->lanes * ARGON2_SYNC_POINTS);
+    if (segment_length < ARGON2_MIN_PARALLEL_SEGMENT)
+        return argon2_ctx(context, type);
+
+    std::unique_lock<std::mutex> busy(argon2_lane_pool.csBusy, std::try_to_lock);
+    if (!busy || argon2_lane_pool.GetThreads() < 2)
+        return argon2_ctx(context, type);
+
+    int result = glt_argon2_validate_inputs(context);
+    if (result != ARGON2_OK)
+        return result;
+
+    argon2_instance_t instance;
+    instance.version = context->version;
+    instance.memory = nullptr;
+    instance.passes = context->t_cost;
+    instance.memory_blocks = segment_length * (context->lanes * ARGON2_SYNC_POINTS);
+    instance.segment_length = segment_length;
+    instance.lane_length = segment_length * ARGON2_SYNC_POINTS;
+    instance.lanes = context->lanes;
+    instance.threads = context->threads;
+    instance.type = type;
+
+    result = glt_argon2_initialize(&instance, context);
+    if (result != ARGON2_OK)
+        return result;
+    argon2_lane_pool.Fill(&instance);
+    glt_argon2_finalize(context, &instance);
+    return ARGON2_OK;
+}
+
 int cpu23R_hash_argon2i(void *out, size_t outlen, const void *in, size_t inlen,
                  const void *salt, size_t saltlen, unsigned int t_cost,
                  unsigned int m_cost) {
@@ -47,8 +280,8 @@ int cpu23R_hash_argon2i(void *out, size_t outlen, const void *in, size_t inlen,
     context.m_cost = m_cost;
     context.lanes = 1;
     context.threads = 1;
-    context.allocate_cbk = NULL;
-    context.free_cbk = NULL;
+    context.allocate_cbk = AllocateScratch;
+    context.free_cbk = ReleaseScratch;
     context.flags = ARGON2_DEFAULT_FLAGS;
 
     return argon2_ctx(&context, Argon2_i);
@@ -89,8 +322,8 @@ int cpu23R_hash_argon2d(void *out, size_t outlen, const void *in, size_t inlen,
     context.m_cost = m_cost;
     context.lanes = 1;
     context.threads = 1;
-    context.allocate_cbk = NULL;
-    context.free_cbk = NULL;
+    context.allocate_cbk = AllocateScratch;
+    context.free_cbk = ReleaseScratch;
     context.flags = ARGON2_DEFAULT_FLAGS;
 
     return argon2_ctx(&context, Argon2_d);
@@ -120,10 +353,10 @@ void Argon2dHash (const void* input, const size_t inlen, void* output, const siz
     ctx.lanes           = 2;
     ctx.threads         = 1;
 
-    ctx.allocate_cbk    = nullptr;
-    ctx.free_cbk        = nullptr;
+    ctx.allocate_cbk    = AllocateScratch;
+    ctx.free_cbk        = ReleaseScratch;
 
-    const int result = argon2_ctx (&ctx, Argon2_d);
+    const int result = Argon2Ctx(&ctx, Argon2_d);
     assert (result == ARGON2_OK);
 }
 
@@ -151,9 +384,9 @@ void Argon2iHash (const void* input, const size_t inlen, void* output, const siz
     ctx.lanes           = 6;
     ctx.threads         = 1;
 
-    ctx.allocate_cbk    = nullptr;
-    ctx.free_cbk        = nullptr;
+    ctx.allocate_cbk    = AllocateScratch;
+    ctx.free_cbk        = ReleaseScratch;
 
-    const int result = argon2_ctx (&ctx, Argon2_i);
+    const int result = Argon2Ctx(&ctx, Argon2_i);
     assert (result == ARGON2_OK);
 }
\ No newline at end of file
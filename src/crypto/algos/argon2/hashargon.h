@@ -6,11 +6,36 @@
 #ifndef HASH_ARGON_H
 #define HASH_ARGON_H
 
+#include <cstddef>
 #include <cstdint>
 
 void Argon2dHash(const void* input, const size_t inlen, void* output, const size_t outlen, const void *salthash, const size_t salthashlen, const void *secrethash, const size_t secrethashlen);
 void Argon2iHash(const void* input, const size_t inlen, void* output, const size_t outlen, const void *salthash, const size_t salthashlen, const void *secrethash, const size_t secrethashlen);
 
+/**
+ * Keep nThreads - 1 worker threads that fill the lanes of an Argon2dHash or
+ * Argon2iHash together with the thread hashing, or none with 1 or less.
+ * Only hashes in a CArgon2ParallelScope use them, and only Argon2dHash has
+ * segments long enough to be worth it.
+ */
+void SetArgon2LaneThreads(int nThreads);
+
+/**
+ * While one with fEnable exists, the Argon2dHash and Argon2iHash of this
+ * thread fill their lanes on the worker threads, if no other hash is using
+ * them. Meant for a single header checked while the cores are idle; when
+ * many headers are checked at once they are better spread over the cores.
+ */
+class CArgon2ParallelScope
+{
+private:
+    const bool fPrevious;
+
+public:
+    explicit CArgon2ParallelScope(bool fEnable);
+    ~CArgon2ParallelScope();
+};
+
 /**
  * Function to hash the inputs in the memory-hard fashion (uses Argon2i)
  * @param  out  Pointer to the memory where the hash digest will be written
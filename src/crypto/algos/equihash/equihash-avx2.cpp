@@ -0,0 +1,126 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include <crypto/algos/blake/blake2b.h>
+#include <crypto/common.h>
+
+namespace equihash_avx2 {
+namespace {
+
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull};
+
+const uint8_t sigma[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+
+/** The rotations by whole bytes are byte shuffles within each 64-bit lane. */
+__m256i inline RotR32(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+__m256i inline RotR24(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10)); }
+__m256i inline RotR16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9)); }
+__m256i inline RotR63(__m256i x) { return _mm256_or_si256(_mm256_add_epi64(x, x), _mm256_srli_epi64(x, 63)); }
+
+/** Gather the little endian word at offset from each of the 4 consecutive inputs of stride bytes. */
+__m256i inline Read4LE(const unsigned char* in, size_t stride, size_t offset)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 3 * stride + offset), ReadLE64(in + 2 * stride + offset), ReadLE64(in + stride + offset), ReadLE64(in + offset));
+}
+
+/** Scatter a word of each of the 4 lanes, little endian, to consecutive 64-byte outputs. */
+void inline Write4LE(unsigned char* out, int offset, __m256i v)
+{
+    WriteLE64(out + offset, _mm256_extract_epi64(v, 0));
+    WriteLE64(out + 64 + offset, _mm256_extract_epi64(v, 1));
+    WriteLE64(out + 128 + offset, _mm256_extract_epi64(v, 2));
+    WriteLE64(out + 192 + offset, _mm256_extract_epi64(v, 3));
+}
+
+void inline G(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i x, __m256i y)
+{
+    a = Add(a, b, x);
+    d = RotR32(Xor(d, a));
+    c = Add(c, d);
+    b = RotR24(Xor(b, c));
+    a = Add(a, b, y);
+    d = RotR16(Xor(d, a));
+    c = Add(c, d);
+    b = RotR63(Xor(b, c));
+}
+
+} // namespace
+
+/**
+ * Finish four copies of base_state with the little endian indices g[0..4),
+ * like blake2b_update() and blake2b_final() would. The index must fit the
+ * block base_state buffers, that is base_state.buflen + 4 <= 128.
+ */
+void GenerateHash_4way(const blake2b_state& base_state, const uint32_t* g, unsigned char* hashes, size_t hLen)
+{
+    // The last blocks of the four hashes differ in the index only.
+    unsigned char blocks[4 * BLAKE2B_BLOCKBYTES];
+    memset(blocks, 0, sizeof(blocks));
+    for (int i = 0; i < 4; ++i) {
+        memcpy(blocks + i * BLAKE2B_BLOCKBYTES, base_state.buf, base_state.buflen);
+        WriteLE32(blocks + i * BLAKE2B_BLOCKBYTES + base_state.buflen, g[i]);
+    }
+    __m256i m[16];
+    for (int i = 0; i < 16; ++i) m[i] = Read4LE(blocks, BLAKE2B_BLOCKBYTES, i * 8);
+
+    uint64_t t0 = base_state.t[0] + base_state.buflen + 4;
+    uint64_t t1 = base_state.t[1] + (t0 < base_state.t[0]);
+    __m256i v[16];
+    for (int i = 0; i < 8; ++i) v[i] = K(base_state.h[i]);
+    v[8] = K(IV[0]);
+    v[9] = K(IV[1]);
+    v[10] = K(IV[2]);
+    v[11] = K(IV[3]);
+    v[12] = K(IV[4] ^ t0);
+    v[13] = K(IV[5] ^ t1);
+    v[14] = K(~IV[6]);
+    v[15] = K(base_state.last_node ? ~IV[7] : IV[7]);
+
+    for (int r = 0; r < 12; ++r) {
+        const uint8_t* s = sigma[r];
+        G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+        G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+    }
+
+    unsigned char out[4 * BLAKE2B_OUTBYTES];
+    for (int i = 0; i < 8; ++i) Write4LE(out, i * 8, Xor(K(base_state.h[i]), v[i], v[i + 8]));
+    for (int i = 0; i < 4; ++i) memcpy(hashes + i * hLen, out + i * BLAKE2B_OUTBYTES, hLen);
+}
+
+} // namespace equihash_avx2
+
+#endif
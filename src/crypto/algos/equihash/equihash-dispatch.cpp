@@ -0,0 +1,135 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/algos/equihash/equihash.h>
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#if defined(__x86_64__) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+#define EQUIHASH_HAVE_AVX2 1
+#endif
+
+#ifdef EQUIHASH_HAVE_AVX2
+namespace equihash_avx2
+{
+void GenerateHash_4way(const blake2b_state& base_state, const uint32_t* g, unsigned char* hashes, size_t hLen);
+}
+#endif
+
+namespace
+{
+void GenerateHash(const eh_IndexHashState& base_state, eh_index g,
+                  unsigned char* hash, size_t hLen)
+{
+    eh_IndexHashState state = base_state;
+    eh_index lei = htole32(g);
+    blake2b_update(&state, &lei, sizeof(eh_index));
+    blake2b_final(&state, hash, hLen);
+}
+
+void GenerateHash_1way(const eh_IndexHashState& base_state, const eh_index* g,
+                       unsigned char* hashes, size_t hLen)
+{
+    for (int i = 0; i < 4; ++i) {
+        GenerateHash(base_state, g[i], hashes + i * hLen, hLen);
+    }
+}
+
+typedef void (*GenerateHash4WayFunction)(const eh_IndexHashState&, const eh_index*, unsigned char*, size_t);
+
+GenerateHash4WayFunction GenerateHash_4way = GenerateHash_1way;
+const char* eh_index_hash_impl_name = "standard";
+
+/**
+ * Check hash4way against GenerateHash_1way, for the output length of each
+ * Equihash parameter set and with the index around the end of a block.
+ */
+bool SelfTest(GenerateHash4WayFunction hash4way)
+{
+    unsigned char header[256];
+    for (size_t i = 0; i < sizeof(header); ++i) header[i] = i * 7 + 3;
+    const eh_index g[4] = {0, 1, 0x12345, 0xfffffff};
+
+    for (size_t outlen : {48, 50, 54, 60, 64}) {
+        for (size_t len : {0, 1, 108, 124, 129, 140, 251}) {
+            blake2b_param P;
+            memset(&P, 0, sizeof(P));
+            P.digest_length = outlen;
+            P.fanout = 1;
+            P.depth = 1;
+            memcpy(P.personal, "ZcashPoW\xc8\0\0\0\x09\0\0\0", sizeof(P.personal));
+            eh_IndexHashState state;
+            blake2b_init_param(&state, &P);
+            blake2b_update(&state, header, len);
+
+            unsigned char out[4 * 64], expected[4 * 64];
+            GenerateHash_1way(state, g, expected, outlen);
+            hash4way(state, g, out, outlen);
+            if (memcmp(out, expected, 4 * outlen)) return false;
+        }
+    }
+    return true;
+}
+
+#if defined(__x86_64__)
+/** Whether the OS saves the AVX register state, as required before using AVX2. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string EhIndexHashAutoDetect()
+{
+    GenerateHash_4way = GenerateHash_1way;
+    eh_index_hash_impl_name = "standard";
+#if defined(__x86_64__)
+    bool have_avx2 = false;
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = have_avx && ((ebx >> 5) & 1);
+        }
+    }
+
+#ifdef EQUIHASH_HAVE_AVX2
+    if (have_avx2 && SelfTest(equihash_avx2::GenerateHash_4way)) {
+        GenerateHash_4way = equihash_avx2::GenerateHash_4way;
+        eh_index_hash_impl_name = "avx2(4way)";
+    }
+#endif
+    (void)have_avx2; // Unused when built without the matching intrinsics.
+#endif
+    return eh_index_hash_impl_name;
+}
+
+std::string EhIndexHashImplementation()
+{
+    return eh_index_hash_impl_name;
+}
+
+void GenerateHashes(const eh_IndexHashState& base_state, const eh_index* g, size_t count,
+                    unsigned char* hashes, size_t hLen)
+{
+    size_t i = 0;
+    // The four hashes share all blocks but the last when the index fits the buffered one.
+    if (base_state.buflen + sizeof(eh_index) <= BLAKE2B_BLOCKBYTES) {
+        for (; i + 4 <= count; i += 4) {
+            GenerateHash_4way(base_state, g + i, hashes + i * hLen, hLen);
+        }
+    }
+    for (; i < count; ++i) {
+        GenerateHash(base_state, g[i], hashes + i * hLen, hLen);
+    }
+}
@@ -28,7 +28,11 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <utility>
 
 #include <boost/optional.hpp>
 
@@ -50,6 +54,41 @@ int Equihash<N,K>::InitialiseState(eh_HashState& base_state, const std::string s
                                                          personalization);
 }
 
+/** Personalizations whose initialised state InitialiseState keeps, per (N, K) */
+static const size_t EH_MAX_CACHED_STATES = 16;
+
+template<unsigned int N, unsigned int K>
+int Equihash<N,K>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring)
+{
+    // Every header is checked against the personalization of its algo, copy
+    // the state initialised for it rather than building the parameters again.
+    static std::mutex cs_states;
+    static std::vector<std::pair<std::string, eh_IndexHashState>> states;
+    std::lock_guard<std::mutex> lock(cs_states);
+    for (const auto& entry : states) {
+        if (entry.first == strPersonalstring) {
+            base_state = entry.second;
+            return 0;
+        }
+    }
+
+    uint32_t le_N = htole32(N);
+    uint32_t le_K = htole32(K);
+    blake2b_param P;
+    memset(&P, 0, sizeof(P));
+    P.digest_length = (512/N)*N/8;
+    P.fanout = 1;
+    P.depth = 1;
+    memcpy(P.personal, strPersonalstring.data(), std::min<size_t>(strPersonalstring.size(), 8));
+    memcpy(P.personal+8,  &le_N, 4);
+    memcpy(P.personal+12, &le_K, 4);
+    if (blake2b_init_param(&base_state, &P) != 0)
+        return -1;
+    if (states.size() < EH_MAX_CACHED_STATES)
+        states.emplace_back(strPersonalstring, base_state);
+    return 0;
+}
+
 void GenerateHash(const eh_HashState& base_state, eh_index g,
                   unsigned char* hash, size_t hLen)
 {
@@ -725,30 +764,239 @@ invalidsolution:
     return false;
 }
 
+/** Read the bit_len wide big-endian field starting at bit pos of in. */
+static inline uint32_t ReadCollisionField(const unsigned char* in, size_t pos, size_t bit_len)
+{
+    assert(bit_len + 7 <= 8*sizeof(uint32_t));
+    const unsigned char* p = in + pos/8;
+    size_t bits = pos % 8 + bit_len;
+    uint32_t acc = 0;
+    for (size_t i = 0; i < (bits+7)/8; i++) {
+        acc = (acc << 8) | p[i];
+    }
+    return (acc >> ((8 - bits % 8) % 8)) & (((uint32_t)1 << bit_len) - 1);
+}
+
+/** Run func(0) .. func(nThreads-1) in parallel, func(0) on the calling thread. */
+static void RunSolverThreads(unsigned int nThreads, const std::function<void(unsigned int)>& func)
+{
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < nThreads; t++) {
+        threads.emplace_back(func, t);
+    }
+    func(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * A list of the bucket solver. Every row keeps only the collision fields it
+ * was not collided on yet, plus the numbers of the two rows of the previous
+ * list it is the XOR of. Rows of the first list are their own index. The
+ * indices of a row are only expanded for the final candidates.
+ */
+struct EhBucketList
+{
+    size_t nFields;
+    std::vector<uint32_t> vFields;
+    std::vector<uint32_t> vRefs;
+
+    size_t size() const { return vFields.size() / nFields; }
+};
+
+static const size_t EH_MAX_BUCKET_BITS = 12;
+
+/**
+ * Pair up all rows of list whose first nKeyFields fields are equal. The rows
+ * are counting sorted into buckets by the top bits of their first field and
+ * the buckets are split over the threads in contiguous ranges, so the order
+ * in which pairs are found does not depend on the number of threads.
+ */
+static void FindCollisions(const EhBucketList& list, size_t bit_len, size_t nKeyFields, unsigned int nThreads,
+                    const std::function<void(unsigned int, uint32_t, uint32_t)>& onPair)
+{
+    const size_t nRows = list.size();
+    const size_t nBucketBits = std::min(bit_len, EH_MAX_BUCKET_BITS);
+    const size_t nBuckets = (size_t)1 << nBucketBits;
+    auto bucket = [&](uint32_t row) { return list.vFields[row*list.nFields] >> (bit_len - nBucketBits); };
+    auto key = [&](uint32_t row) {
+        uint64_t k = list.vFields[row*list.nFields];
+        for (size_t f = 1; f < nKeyFields; f++) {
+            k = (k << bit_len) | list.vFields[row*list.nFields + f];
+        }
+        return k;
+    };
+
+    std::vector<uint32_t> start(nBuckets + 1, 0);
+    for (uint32_t row = 0; row < nRows; row++) {
+        start[bucket(row) + 1]++;
+    }
+    for (size_t b = 0; b < nBuckets; b++) {
+        start[b + 1] += start[b];
+    }
+    std::vector<uint32_t> sorted(nRows);
+    {
+        std::vector<uint32_t> pos(start.begin(), start.end() - 1);
+        for (uint32_t row = 0; row < nRows; row++) {
+            sorted[pos[bucket(row)]++] = row;
+        }
+    }
+
+    RunSolverThreads(nThreads, [&](unsigned int t) {
+        std::vector<std::pair<uint64_t, uint32_t>> rows;
+        for (size_t b = nBuckets*t/nThreads; b < nBuckets*(t+1)/nThreads; b++) {
+            rows.clear();
+            for (size_t i = start[b]; i < start[b + 1]; i++) {
+                rows.emplace_back(key(sorted[i]), sorted[i]);
+            }
+            std::sort(rows.begin(), rows.end());
+            for (size_t i = 0; i < rows.size(); ) {
+                size_t j = i + 1;
+                while (j < rows.size() && rows[j].first == rows[i].first) {
+                    j++;
+                }
+                for (size_t l = i; l < j; l++) {
+                    for (size_t m = l + 1; m < j; m++) {
+                        onPair(t, rows[l].second, rows[m].second);
+                    }
+                }
+                i = j;
+            }
+        }
+    });
+}
+
+/** Expand a row of list nList to its indices, ordering every subtree by its first index. */
+static std::vector<eh_index> GetBucketRowIndices(const std::vector<EhBucketList>& lists, size_t nList, uint32_t row)
+{
+    if (nList == 0) {
+        return std::vector<eh_index>(1, row);
+    }
+    std::vector<eh_index> left = GetBucketRowIndices(lists, nList - 1, lists[nList].vRefs[2*row]);
+    std::vector<eh_index> right = GetBucketRowIndices(lists, nList - 1, lists[nList].vRefs[2*row + 1]);
+    if (right[0] < left[0]) {
+        std::swap(left, right);
+    }
+    left.insert(left.end(), right.begin(), right.end());
+    return left;
+}
+
 template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+bool Equihash<N,K>::BucketSolve(const eh_HashState& base_state,
+                                const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                unsigned int nThreads)
 {
-    if (soln.size() != SolutionWidth) {
-        LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
-                 soln.size(), SolutionWidth);
-        return false;
+    const eh_index init_size { 1 << (CollisionBitLength + 1) };
+    nThreads = std::max(1u, nThreads);
+
+    // 1) Generate first list, with all K+1 collision fields of every index
+    LogPrint(BCLog::POW, "Generating first list\n");
+    std::vector<EhBucketList> lists(K);
+    lists[0].nFields = K + 1;
+    lists[0].vFields.resize((size_t)init_size * (K + 1));
+    const eh_index nHashes = (init_size + IndicesPerHashOutput - 1) / IndicesPerHashOutput;
+    RunSolverThreads(nThreads, [&](unsigned int t) {
+        unsigned char tmpHash[HashOutput];
+        for (eh_index g = (uint64_t)nHashes*t/nThreads; g < (uint64_t)nHashes*(t+1)/nThreads; g++) {
+            GenerateHash(base_state, g, tmpHash, HashOutput);
+            for (eh_index i = 0; i < IndicesPerHashOutput && g*IndicesPerHashOutput + i < init_size; i++) {
+                uint32_t* fields = &lists[0].vFields[(size_t)(g*IndicesPerHashOutput + i) * (K + 1)];
+                for (size_t f = 0; f <= K; f++) {
+                    fields[f] = ReadCollisionField(tmpHash + i*N/8, f*CollisionBitLength, CollisionBitLength);
+                }
+            }
+        }
+    });
+    if (cancelled(ListGeneration)) throw solver_cancelled;
+
+    // 2) Collide on one field per round until two fields remain
+    for (unsigned int r = 1; r < K; r++) {
+        LogPrint(BCLog::POW, "Round %u: %u rows\n", r, lists[r-1].size());
+        const EhBucketList& prev = lists[r-1];
+        const size_t nFields = prev.nFields - 1;
+        std::vector<EhBucketList> parts(nThreads);
+        FindCollisions(prev, CollisionBitLength, 1, nThreads, [&](unsigned int t, uint32_t a, uint32_t b) {
+            // Cheap part of the distinct indices check, the rest is done on the final candidates
+            if (r > 1) {
+                const uint32_t* ra = &prev.vRefs[2*a];
+                const uint32_t* rb = &prev.vRefs[2*b];
+                if (ra[0] == rb[0] || ra[0] == rb[1] || ra[1] == rb[0] || ra[1] == rb[1])
+                    return;
+            }
+            const uint32_t* fa = &prev.vFields[a*prev.nFields];
+            const uint32_t* fb = &prev.vFields[b*prev.nFields];
+            for (size_t f = 1; f <= nFields; f++) {
+                parts[t].vFields.push_back(fa[f] ^ fb[f]);
+            }
+            parts[t].vRefs.push_back(a);
+            parts[t].vRefs.push_back(b);
+        });
+        if (cancelled(ListColliding)) throw solver_cancelled;
+
+        EhBucketList& next = lists[r];
+        next.nFields = nFields;
+        for (const EhBucketList& part : parts) {
+            next.vFields.insert(next.vFields.end(), part.vFields.begin(), part.vFields.end());
+            next.vRefs.insert(next.vRefs.end(), part.vRefs.begin(), part.vRefs.end());
+        }
+        // Only the references of the earlier lists are needed from here on
+        lists[r-1].vFields.clear();
+        lists[r-1].vFields.shrink_to_fit();
+        if (next.size() == 0 || next.size() > std::numeric_limits<uint32_t>::max() / 2) {
+            return false;
+        }
+        if (cancelled(RoundEnd)) throw solver_cancelled;
     }
 
-    std::vector<FullStepRow<FinalFullWidth>> X;
-    X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * N/8),
-                       N/8, HashLength, CollisionBitLength, i);
+    // k+1) Find a collision on the last two fields
+    LogPrint(BCLog::POW, "Final round: %u rows\n", lists[K-1].size());
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> candidates(nThreads);
+    FindCollisions(lists[K-1], CollisionBitLength, 2, nThreads, [&](unsigned int t, uint32_t a, uint32_t b) {
+        candidates[t].emplace_back(a, b);
+    });
+    if (cancelled(FinalSorting)) throw solver_cancelled;
+
+    for (const auto& part : candidates) {
+        for (const std::pair<uint32_t, uint32_t>& candidate : part) {
+            std::vector<eh_index> left = GetBucketRowIndices(lists, K - 1, candidate.first);
+            std::vector<eh_index> right = GetBucketRowIndices(lists, K - 1, candidate.second);
+            if (right[0] < left[0]) {
+                std::swap(left, right);
+            }
+            left.insert(left.end(), right.begin(), right.end());
+
+            std::vector<eh_index> sortedIndices(left);
+            std::sort(sortedIndices.begin(), sortedIndices.end());
+            if (std::adjacent_find(sortedIndices.begin(), sortedIndices.end()) != sortedIndices.end()) {
+                continue;
+            }
+            auto soln = GetMinimalFromIndices(left, CollisionBitLength);
+            assert(soln.size() == equihash_solution_size(N, K));
+            if (validBlock(soln)) {
+                return true;
+            }
+        }
+        if (cancelled(FinalColliding)) throw solver_cancelled;
     }
 
-    size_t hashLen = HashLength;
+    return false;
+}
+
+/**
+ * Collide the rows of a solution pairwise, round after round, checking the
+ * collisions, the order of the index subtrees and that the indices are
+ * distinct. The solution is valid if the last row is zero.
+ */
+template<size_t WIDTH>
+static bool IsValidSolutionTree(std::vector<FullStepRow<WIDTH>> X, size_t hashLen, size_t collisionByteLength)
+{
     size_t lenIndices = sizeof(eh_index);
     while (X.size() > 1) {
-        std::vector<FullStepRow<FinalFullWidth>> Xc;
+        std::vector<FullStepRow<WIDTH>> Xc;
         for (size_t i = 0; i < X.size(); i += 2) {
-            if (!HasCollision(X[i], X[i+1], CollisionByteLength)) {
+            if (!HasCollision(X[i], X[i+1], collisionByteLength)) {
                 LogPrint(BCLog::POW, "Invalid solution: invalid collision length between StepRows\n");
                 LogPrint(BCLog::POW, "X[i]   = %s\n", X[i].GetHex(hashLen));
                 LogPrint(BCLog::POW, "X[i+1] = %s\n", X[i+1].GetHex(hashLen));
@@ -762,10 +1010,10 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
                 LogPrint(BCLog::POW, "Invalid solution: duplicate indices\n");
                 return false;
             }
-            Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, CollisionByteLength);
+            Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, collisionByteLength);
         }
         X = Xc;
-        hashLen -= CollisionByteLength;
+        hashLen -= collisionByteLength;
         lenIndices *= 2;
     }
 
@@ -773,6 +1021,55 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+{
+    if (soln.size() != SolutionWidth) {
+        LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    std::vector<FullStepRow<FinalFullWidth>> X;
+    X.reserve(1 << K);
+    unsigned char tmpHash[HashOutput];
+    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
+        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput);
+        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * N/8),
+                       N/8, HashLength, CollisionBitLength, i);
+    }
+
+    return IsValidSolutionTree(std::move(X), HashLength, CollisionByteLength);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln)
+{
+    if (soln.size() != SolutionWidth) {
+        LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    // Hash all the indices at once, so GenerateHashes can take them four at a time.
+    std::vector<eh_index> indices = GetIndicesFromMinimal(soln, CollisionBitLength);
+    std::vector<eh_index> g(indices.size());
+    for (size_t j = 0; j < indices.size(); j++) {
+        g[j] = indices[j]/IndicesPerHashOutput;
+    }
+    std::vector<unsigned char> hashes(indices.size() * HashOutput);
+    GenerateHashes(base_state, g.data(), g.size(), hashes.data(), HashOutput);
+
+    std::vector<FullStepRow<FinalFullWidth>> X;
+    X.reserve(1 << K);
+    for (size_t j = 0; j < indices.size(); j++) {
+        X.emplace_back(hashes.data() + j * HashOutput + ((indices[j] % IndicesPerHashOutput) * N/8),
+                       N/8, HashLength, CollisionBitLength, indices[j]);
+    }
+
+    return IsValidSolutionTree(std::move(X), HashLength, CollisionByteLength);
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
 template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
@@ -781,7 +1078,13 @@ template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<96,3>::BucketSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         unsigned int nThreads);
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<96,3>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<96,3>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
@@ -791,7 +1094,13 @@ template bool Equihash<200,9>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<200,9>::BucketSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          unsigned int nThreads);
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<200,9>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<200,9>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<144,5>
 template int Equihash<144,5>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
@@ -801,7 +1110,13 @@ template bool Equihash<144,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<144,5>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<144,5>::BucketSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          unsigned int nThreads);
 template bool Equihash<144,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<144,5>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<144,5>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
@@ -811,7 +1126,13 @@ template bool Equihash<96,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<96,5>::BucketSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         unsigned int nThreads);
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<96,5>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<96,5>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
@@ -821,7 +1142,13 @@ template bool Equihash<48,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<48,5>::BucketSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         unsigned int nThreads);
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<48,5>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<48,5>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 // Explicit instantiations for Equihash<192,7>
 template int Equihash<192,7>::InitialiseState(eh_HashState& base_state, const std::string strPersonalstring);
 template bool Equihash<192,7>::BasicSolve(const eh_HashState& base_state,
@@ -830,4 +1157,10 @@ template bool Equihash<192,7>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<192,7>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
-template bool Equihash<192,7>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
\ No newline at end of file
+template bool Equihash<192,7>::BucketSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          unsigned int nThreads);
+template bool Equihash<192,7>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<192,7>::InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring);
+template bool Equihash<192,7>::IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
\ No newline at end of file
@@ -9,6 +9,7 @@
 #define BITCOIN_EQUIHASH_H
 
 #include <compat/endian.h>
+#include <crypto/algos/blake/blake2b.h>
 #include <crypto/sha256.h>
 #include <utilstrencodings.h>
 
@@ -19,14 +20,37 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <boost/static_assert.hpp>
 
 typedef crypto_generichash_blake2b_state eh_HashState;
+/**
+ * BLAKE2b state of the in-tree implementation. Its layout is known, so the
+ * indices of a solution can be hashed from the state after the header, four
+ * at a time where the CPU allows.
+ */
+typedef blake2b_state eh_IndexHashState;
 typedef uint32_t eh_index;
 typedef uint8_t eh_trunc;
 
+/** Autodetect the best available implementation of GenerateHashes().
+ *  Returns the name of the implementation.
+ */
+std::string EhIndexHashAutoDetect();
+/** The implementation EhIndexHashAutoDetect() selected. */
+std::string EhIndexHashImplementation();
+
+/**
+ * Hash the indices g[0..count) like GenerateHash, from a state that has
+ * absorbed the header. The hashes of hLen bytes each are written one after
+ * the other to hashes.
+ */
+void GenerateHashes(const eh_IndexHashState& base_state, const eh_index* g, size_t count,
+                    unsigned char* hashes, size_t hLen);
+
 void ExpandArray(const unsigned char* in, size_t in_len,
                  unsigned char* out, size_t out_len,
                  size_t bit_len, size_t byte_pad=0);
@@ -191,7 +215,24 @@ public:
     bool OptimisedSolve(const eh_HashState& base_state,
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
+    /**
+     * Solve using compact per-round lists of collision fields and parent
+     * references, colliding bucket ranges on nThreads threads. Finds the
+     * same solutions as BasicSolve with much less memory.
+     */
+    bool BucketSolve(const eh_HashState& base_state,
+                     const std::function<bool(std::vector<unsigned char>)> validBlock,
+                     const std::function<bool(EhSolverCancelCheck)> cancelled,
+                     unsigned int nThreads);
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+
+    /**
+     * Initialise the in-tree BLAKE2b state from a copy of the one kept for
+     * each personalization, and check a solution against it after the
+     * header was absorbed with blake2b_update().
+     */
+    int InitialiseState(eh_IndexHashState& base_state, const std::string strPersonalstring="ZcashPoW");
+    bool IsValidSolution(const eh_IndexHashState& base_state, std::vector<unsigned char> soln);
 };
 
 #include "equihash.tcc"
@@ -276,6 +317,36 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
                             [](EhSolverCancelCheck pos) { return false; });
 }
 
+inline bool EhBucketSolve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    unsigned int nThreads)
+{
+    if (n == 96 && k == 3) {
+        return Eh96_3.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else if (n == 200 && k == 9) {
+        return Eh200_9.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else if (n == 144 && k == 5) {
+        return Eh144_5.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else if (n == 96 && k == 5) {
+        return Eh96_5.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else if (n == 48 && k == 5) {
+        return Eh48_5.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else if (n == 192 && k == 7) {
+        return Eh192_7.BucketSolve(base_state, validBlock, cancelled, nThreads);
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
+inline bool EhBucketSolveUncancellable(unsigned int n, unsigned int k, const eh_HashState& base_state,
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    unsigned int nThreads)
+{
+    return EhBucketSolve(n, k, base_state, validBlock,
+                         [](EhSolverCancelCheck pos) { return false; }, nThreads);
+}
+
 #define EhIsValidSolution(n, k, base_state, soln, ret)   \
     if (n == 96 && k == 3) {                             \
         ret = Eh96_3.IsValidSolution(base_state, soln);  \
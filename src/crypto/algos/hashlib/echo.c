@@ -727,6 +727,147 @@ echo_big_compress(sph_echo_big_context *sc)
 	COMPRESS_BIG(sc);
 }
 
+#if SPH_ECHO_64 && defined __GNUC__ && (defined __x86_64__ || defined __amd64__)
+
+/*
+ * AES-NI variant of the compression functions. Each of the 16 state words
+ * is a full AES state, so one BIG.SubWords step is two AESENC instructions
+ * per word: the first keyed with the 128-bit counter, the second with zero.
+ * The functions are compiled for AES-NI through the target attribute and
+ * only called once echo_autodetect() has checked the CPU for support.
+ */
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+
+#define ECHO_AESNI   __attribute__((target("aes")))
+
+static ECHO_AESNI inline __m128i
+echo_aesni_mul2(__m128i x)
+{
+	__m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+		_mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+static ECHO_AESNI inline void
+echo_aesni_round(__m128i W[16],
+	sph_u32 *pK0, sph_u32 *pK1, sph_u32 *pK2, sph_u32 *pK3)
+{
+	const __m128i zero = _mm_setzero_si128();
+	sph_u32 K0 = *pK0;
+	sph_u32 K1 = *pK1;
+	sph_u32 K2 = *pK2;
+	sph_u32 K3 = *pK3;
+	__m128i tmp;
+	int n;
+
+	/* BIG.SubWords */
+	for (n = 0; n < 16; n ++) {
+		__m128i K = _mm_set_epi32((int)K3, (int)K2, (int)K1, (int)K0);
+		W[n] = _mm_aesenc_si128(_mm_aesenc_si128(W[n], K), zero);
+		if ((K0 = T32(K0 + 1)) == 0) {
+			if ((K1 = T32(K1 + 1)) == 0)
+				if ((K2 = T32(K2 + 1)) == 0)
+					K3 = T32(K3 + 1);
+		}
+	}
+	*pK0 = K0;
+	*pK1 = K1;
+	*pK2 = K2;
+	*pK3 = K3;
+
+	/* BIG.ShiftRows */
+	tmp = W[1]; W[1] = W[5]; W[5] = W[9]; W[9] = W[13]; W[13] = tmp;
+	tmp = W[2]; W[2] = W[10]; W[10] = tmp;
+	tmp = W[6]; W[6] = W[14]; W[14] = tmp;
+	tmp = W[15]; W[15] = W[11]; W[11] = W[7]; W[7] = W[3]; W[3] = tmp;
+
+	/* BIG.MixColumns */
+	for (n = 0; n < 16; n += 4) {
+		__m128i a = W[n];
+		__m128i b = W[n + 1];
+		__m128i c = W[n + 2];
+		__m128i d = W[n + 3];
+		__m128i ab = _mm_xor_si128(a, b);
+		__m128i bc = _mm_xor_si128(b, c);
+		__m128i cd = _mm_xor_si128(c, d);
+		__m128i abx = echo_aesni_mul2(ab);
+		__m128i bcx = echo_aesni_mul2(bc);
+		__m128i cdx = echo_aesni_mul2(cd);
+
+		W[n] = _mm_xor_si128(_mm_xor_si128(abx, bc), d);
+		W[n + 1] = _mm_xor_si128(_mm_xor_si128(bcx, a), cd);
+		W[n + 2] = _mm_xor_si128(_mm_xor_si128(cdx, ab), d);
+		W[n + 3] = _mm_xor_si128(_mm_xor_si128(abx, bcx),
+			_mm_xor_si128(_mm_xor_si128(cdx, ab), c));
+	}
+}
+
+static ECHO_AESNI void
+echo_small_compress_aesni(sph_echo_small_context *sc)
+{
+	__m128i W[16];
+	__m128i *V = (__m128i *)sc->u.Vb;
+	const __m128i *B = (const __m128i *)sc->buf;
+	sph_u32 K0 = sc->C0;
+	sph_u32 K1 = sc->C1;
+	sph_u32 K2 = sc->C2;
+	sph_u32 K3 = sc->C3;
+	unsigned u;
+
+	for (u = 0; u < 4; u ++)
+		W[u] = _mm_loadu_si128(V + u);
+	for (u = 0; u < 12; u ++)
+		W[u + 4] = _mm_loadu_si128(B + u);
+	for (u = 0; u < 8; u ++)
+		echo_aesni_round(W, &K0, &K1, &K2, &K3);
+	for (u = 0; u < 4; u ++) {
+		__m128i t = _mm_xor_si128(_mm_loadu_si128(B + u),
+			_mm_loadu_si128(B + u + 4));
+		t = _mm_xor_si128(t, _mm_loadu_si128(B + u + 8));
+		t = _mm_xor_si128(t, _mm_xor_si128(W[u], W[u + 4]));
+		t = _mm_xor_si128(t, _mm_xor_si128(W[u + 8], W[u + 12]));
+		_mm_storeu_si128(V + u, _mm_xor_si128(_mm_loadu_si128(V + u), t));
+	}
+}
+
+static ECHO_AESNI void
+echo_big_compress_aesni(sph_echo_big_context *sc)
+{
+	__m128i W[16];
+	__m128i *V = (__m128i *)sc->u.Vb;
+	const __m128i *B = (const __m128i *)sc->buf;
+	sph_u32 K0 = sc->C0;
+	sph_u32 K1 = sc->C1;
+	sph_u32 K2 = sc->C2;
+	sph_u32 K3 = sc->C3;
+	unsigned u;
+
+	for (u = 0; u < 8; u ++)
+		W[u] = _mm_loadu_si128(V + u);
+	for (u = 0; u < 8; u ++)
+		W[u + 8] = _mm_loadu_si128(B + u);
+	for (u = 0; u < 10; u ++)
+		echo_aesni_round(W, &K0, &K1, &K2, &K3);
+	for (u = 0; u < 8; u ++) {
+		__m128i t = _mm_xor_si128(_mm_loadu_si128(B + u),
+			_mm_xor_si128(W[u], W[u + 8]));
+		_mm_storeu_si128(V + u, _mm_xor_si128(_mm_loadu_si128(V + u), t));
+	}
+}
+
+#define ECHO_HAVE_AESNI   1
+
+#endif
+
+static void (*echo_small_compress_impl)(sph_echo_small_context *sc)
+	= echo_small_compress;
+static void (*echo_big_compress_impl)(sph_echo_big_context *sc)
+	= echo_big_compress;
+static const char *echo_impl_name = "standard";
+
 static void
 echo_small_core(sph_echo_small_context *sc,
 	const unsigned char *data, size_t len)
@@ -755,7 +896,7 @@ echo_small_core(sph_echo_small_context *sc,
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
 			INCR_COUNTER(sc, 1536);
-			echo_small_compress(sc);
+			echo_small_compress_impl(sc);
 			ptr = 0;
 		}
 	}
@@ -790,7 +931,7 @@ echo_big_core(sph_echo_big_context *sc,
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
 			INCR_COUNTER(sc, 1024);
-			echo_big_compress(sc);
+			echo_big_compress_impl(sc);
 			ptr = 0;
 		}
 	}
@@ -838,13 +979,13 @@ echo_small_close(sph_echo_small_context *sc, unsigned ub, unsigned n,
 	buf[ptr ++] = ((ub & -z) | z) & 0xFF;
 	memset(buf + ptr, 0, (sizeof sc->buf) - ptr);
 	if (ptr > ((sizeof sc->buf) - 18)) {
-		echo_small_compress(sc);
+		echo_small_compress_impl(sc);
 		sc->C0 = sc->C1 = sc->C2 = sc->C3 = 0;
 		memset(buf, 0, sizeof sc->buf);
 	}
 	sph_enc16le(buf + (sizeof sc->buf) - 18, out_size_w32 << 5);
 	memcpy(buf + (sizeof sc->buf) - 16, u.tmp, 16);
-	echo_small_compress(sc);
+	echo_small_compress_impl(sc);
 #if SPH_ECHO_64
 	for (VV = &sc->u.Vb[0][0], k = 0; k < ((out_size_w32 + 1) >> 1); k ++)
 		sph_enc64le_aligned(u.tmp + (k << 3), VV[k]);
@@ -897,13 +1038,13 @@ echo_big_close(sph_echo_big_context *sc, unsigned ub, unsigned n,
 	buf[ptr ++] = ((ub & -z) | z) & 0xFF;
 	memset(buf + ptr, 0, (sizeof sc->buf) - ptr);
 	if (ptr > ((sizeof sc->buf) - 18)) {
-		echo_big_compress(sc);
+		echo_big_compress_impl(sc);
 		sc->C0 = sc->C1 = sc->C2 = sc->C3 = 0;
 		memset(buf, 0, sizeof sc->buf);
 	}
 	sph_enc16le(buf + (sizeof sc->buf) - 18, out_size_w32 << 5);
 	memcpy(buf + (sizeof sc->buf) - 16, u.tmp, 16);
-	echo_big_compress(sc);
+	echo_big_compress_impl(sc);
 #if SPH_ECHO_64
 	for (VV = &sc->u.Vb[0][0], k = 0; k < ((out_size_w32 + 1) >> 1); k ++)
 		sph_enc64le_aligned(u.tmp + (k << 3), VV[k]);
@@ -1026,6 +1167,67 @@ sph_echo512_addbits_and_close(void *cc, unsigned ub, unsigned n, void *dst)
 {
 	echo_big_close(cc, ub, n, dst, 16);
 }
+
+#ifdef ECHO_HAVE_AESNI
+
+/*
+ * Hash a message spanning several blocks with both ECHO-256 and ECHO-512,
+ * using whatever compression functions are currently selected.
+ */
+static void
+echo_selftest_hash(unsigned char out[96])
+{
+	unsigned char msg[300];
+	sph_echo256_context cs;
+	sph_echo512_context cb;
+	size_t u;
+
+	for (u = 0; u < sizeof msg; u ++)
+		msg[u] = (unsigned char)(u * 7 + 1);
+	sph_echo256_init(&cs);
+	sph_echo256(&cs, msg, sizeof msg);
+	sph_echo256_close(&cs, out);
+	sph_echo512_init(&cb);
+	sph_echo512(&cb, msg, sizeof msg);
+	sph_echo512_close(&cb, out + 32);
+}
+
+#endif
+
+/* see sph_echo.h */
+const char *
+sph_echo_autodetect(void)
+{
+#ifdef ECHO_HAVE_AESNI
+	unsigned eax, ebx, ecx, edx;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 25) & 1)) {
+		unsigned char expected[96], actual[96];
+
+		echo_small_compress_impl = echo_small_compress;
+		echo_big_compress_impl = echo_big_compress;
+		echo_selftest_hash(expected);
+		echo_small_compress_impl = echo_small_compress_aesni;
+		echo_big_compress_impl = echo_big_compress_aesni;
+		echo_selftest_hash(actual);
+		if (memcmp(expected, actual, sizeof expected) == 0) {
+			echo_impl_name = "aesni";
+			return echo_impl_name;
+		}
+		echo_small_compress_impl = echo_small_compress;
+		echo_big_compress_impl = echo_big_compress;
+	}
+#endif
+	echo_impl_name = "standard";
+	return echo_impl_name;
+}
+
+/* see sph_echo.h */
+const char *
+sph_echo_implementation(void)
+{
+	return echo_impl_name;
+}
 #ifdef __cplusplus
 }
 #endif
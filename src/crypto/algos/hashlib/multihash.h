@@ -18,6 +18,7 @@
 
 #include <arith_uint256.h>
 #include <uint256.h>
+#include <crypto/hash4way.h>
 #include <crypto/algos/hashlib/sph_blake.h>
 #include <crypto/algos/hashlib/sph_bmw.h>
 #include <crypto/algos/hashlib/sph_groestl.h>
@@ -48,6 +49,9 @@
 #include <crypto/algos/dedal/dedal.h>
 #include <openssl/sha.h>
 
+#include <algorithm>
+#include <string.h>
+
 #ifdef GLOBALDEFINED
 #define GLOBAL
 #else
@@ -288,25 +292,14 @@ inline uint256 HashX25X(const T1 pbegin, const T1 pend)
     return output;
 }
 
-template<typename T1>
-inline uint256 Tribus(const T1 pbegin, const T1 pend)
-
+/** The functions of Tribus after jh512 */
+inline uint256 TribusTail(const uint512& hashJH)
 {
-    sph_jh512_context        ctx_jh;
     sph_keccak512_context    ctx_keccak;
     sph_echo512_context      ctx_echo;
-    static unsigned char pblank[1];
 
-#ifndef QT_NO_DEBUG
-    //std::string strhash;
-    //strhash = "";
-#endif
-    
     uint512 hash[3];
-
-    sph_jh512_init(&ctx_jh);
-    sph_jh512 (&ctx_jh, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_jh512_close(&ctx_jh, static_cast<void*>(&hash[0]));
+    hash[0] = hashJH;
 
     sph_keccak512_init(&ctx_keccak);
     sph_keccak512 (&ctx_keccak, static_cast<const void*>(&hash[0]), 64);
@@ -319,6 +312,21 @@ inline uint256 Tribus(const T1 pbegin, const T1 pend)
     return hash[2].trim256();
 }
 
+template<typename T1>
+inline uint256 Tribus(const T1 pbegin, const T1 pend)
+{
+    sph_jh512_context        ctx_jh;
+    static unsigned char pblank[1];
+
+    uint512 hash;
+
+    sph_jh512_init(&ctx_jh);
+    sph_jh512 (&ctx_jh, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
+    sph_jh512_close(&ctx_jh, static_cast<void*>(&hash));
+
+    return TribusTail(hash);
+}
+
 template<typename T1>
 inline uint256 PHI2(const T1 pbegin, const T1 pend)
 {
@@ -370,27 +378,17 @@ inline uint256 PHI2(const T1 pbegin, const T1 pend)
 
 /* ----------- Phi1612 Hash ------------------------------------------------ */
 
-template<typename T1>
-inline uint256 Phi1612(const T1 pbegin, const T1 pend)
+/** The functions of Phi1612 after skein512 */
+inline uint256 Phi1612Tail(const uint512& hashSkein)
 {
-    sph_skein512_context     ctx_skein;
     sph_jh512_context ctx_jh;
     sph_cubehash512_context   ctx_cubehash;
     sph_fugue512_context      ctx_fugue;
     sph_gost512_context      ctx_gost;
     sph_echo512_context ctx_echo;
-    static unsigned char pblank[1];
-
-#ifndef QT_NO_DEBUG
-    //std::string strhash;
-    //strhash = "";
-#endif
 
     uint512 hash[6];
-
-    sph_skein512_init(&ctx_skein);
-    sph_skein512 (&ctx_skein, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash[0]));
+    hash[0] = hashSkein;
 
     sph_jh512_init(&ctx_jh);
     sph_jh512 (&ctx_jh, static_cast<const void*>(&hash[0]), 64);
@@ -415,6 +413,21 @@ inline uint256 Phi1612(const T1 pbegin, const T1 pend)
     return hash[5].trim256();
 }
 
+template<typename T1>
+inline uint256 Phi1612(const T1 pbegin, const T1 pend)
+{
+    sph_skein512_context     ctx_skein;
+    static unsigned char pblank[1];
+
+    uint512 hash;
+
+    sph_skein512_init(&ctx_skein);
+    sph_skein512 (&ctx_skein, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
+    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash));
+
+    return Phi1612Tail(hash);
+}
+
 /** ----------- ChainCoin Hash ------------------------------------------------ */
 template<typename T1>
 inline uint256 HashC11(const T1 pbegin, const T1 pend)
@@ -1343,26 +1356,16 @@ inline uint256 QUARK(const T1 pbegin, const T1 pend)
     return hash[8].trim256();
 }
 
-template<typename T1>
-inline uint256 SkunkHash5(const T1 pbegin, const T1 pend)
+/** The functions of SkunkHash5 after skein512 */
+inline uint256 SkunkHash5Tail(const uint512& hashSkein)
 {
-    sph_skein512_context       ctx_skein;
     sph_cubehash512_context    ctx_cubehash;
     sph_fugue512_context       ctx_fugue;
     sph_gost512_context        ctx_gost;
-    static unsigned char pblank[1];
 
-#ifndef QT_NO_DEBUG
-    //std::string strhash;
-    //strhash = "";
-#endif
-    
     uint512 hash[4];
+    hash[0] = hashSkein;
 
-    sph_skein512_init(&ctx_skein);
-    sph_skein512 (&ctx_skein, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash[0]));
-    
     sph_cubehash512_init(&ctx_cubehash);
     sph_cubehash512 (&ctx_cubehash, static_cast<const void*>(&hash[0]), 64);
     sph_cubehash512_close(&ctx_cubehash, static_cast<void*>(&hash[1]));
@@ -1379,26 +1382,30 @@ inline uint256 SkunkHash5(const T1 pbegin, const T1 pend)
 }
 
 template<typename T1>
-inline uint256 HashQubit(const T1 pbegin, const T1 pend)
+inline uint256 SkunkHash5(const T1 pbegin, const T1 pend)
+{
+    sph_skein512_context       ctx_skein;
+    static unsigned char pblank[1];
+
+    uint512 hash;
+
+    sph_skein512_init(&ctx_skein);
+    sph_skein512 (&ctx_skein, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
+    sph_skein512_close(&ctx_skein, static_cast<void*>(&hash));
+
+    return SkunkHash5Tail(hash);
+}
+
+/** The functions of HashQubit after luffa512 */
+inline uint256 HashQubitTail(const uint512& hashLuffa)
 {
-    sph_luffa512_context	 ctx_luffa;
     sph_cubehash512_context  ctx_cubehash;
     sph_shavite512_context	 ctx_shavite;
     sph_simd512_context		 ctx_simd;
     sph_echo512_context		 ctx_echo;
-    static unsigned char pblank[1];
-
-#ifndef QT_NO_DEBUG
-//std::string strhash;
-//strhash = "";
-#endif
-
 
     uint512 hash[5];
-
-    sph_luffa512_init(&ctx_luffa);
-    sph_luffa512 (&ctx_luffa, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_luffa512_close(&ctx_luffa, static_cast<void*>(&hash[0]));
+    hash[0] = hashLuffa;
 
     sph_cubehash512_init(&ctx_cubehash);
     sph_cubehash512 (&ctx_cubehash, static_cast<const void*>(&hash[0]), 64);
@@ -1419,6 +1426,21 @@ inline uint256 HashQubit(const T1 pbegin, const T1 pend)
     return hash[4].trim256();
 }
 
+template<typename T1>
+inline uint256 HashQubit(const T1 pbegin, const T1 pend)
+{
+    sph_luffa512_context	 ctx_luffa;
+    static unsigned char pblank[1];
+
+    uint512 hash;
+
+    sph_luffa512_init(&ctx_luffa);
+    sph_luffa512 (&ctx_luffa, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
+    sph_luffa512_close(&ctx_luffa, static_cast<void*>(&hash));
+
+    return HashQubitTail(hash);
+}
+
 template<typename T1>
 inline uint256 HashGroestl(const T1 pbegin, const T1 pend)
 {
@@ -1437,6 +1459,14 @@ inline uint256 HashGroestl(const T1 pbegin, const T1 pend)
     return hash2;
 }
 
+/** The SHA256 HashSkein does after skein512 */
+inline uint256 HashSkeinTail(const uint512& hashSkein)
+{
+    uint256 hash2;
+    SHA256((const unsigned char*)&hashSkein, 64, (unsigned char*)&hash2);
+    return hash2;
+}
+
 template<typename T1>
 inline uint256 HashSkein(const T1 pbegin, const T1 pend)
 {
@@ -1444,15 +1474,12 @@ inline uint256 HashSkein(const T1 pbegin, const T1 pend)
     static unsigned char pblank[1];
 
     uint512 hash1;
-    uint256 hash2;
 
     sph_skein512_init(&ctx_skein);
     sph_skein512(&ctx_skein, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
     sph_skein512_close(&ctx_skein, static_cast<void*>(&hash1));
 
-    SHA256((unsigned char*)&hash1, 64, (unsigned char*)&hash2);
-
-    return hash2;
+    return HashSkeinTail(hash1);
 }
 
 template<typename T1>
@@ -3656,4 +3683,105 @@ inline uint256 GlobalHash(const T1 pbegin, const T1 pend)
     
     return finalhash;
 }
+/* ----------- Header midstates ------------------------------------------- */
+
+/*
+ * For grinding the nonce in the last 4 bytes of an 80 byte header, the first
+ * function of a chain can absorb the 76 bytes before it once and be copied
+ * for every nonce. This only saves work for functions with blocks of at most
+ * 76 bytes: skein512 and jh512 compress one block before the nonce, luffa512
+ * two. The blake512 the X-series starts with takes 128 byte blocks and
+ * compresses nothing before the nonce, so those algos have no midstate.
+ */
+
+/** Size of the header bytes a midstate absorbs, the nonce follows */
+static const size_t HEADER_MIDSTATE_SIZE = 76;
+
+inline void Skein512Midstate(sph_skein512_context& ctx, const unsigned char* pheader)
+{
+    sph_skein512_init(&ctx);
+    sph_skein512(&ctx, pheader, HEADER_MIDSTATE_SIZE);
+}
+
+/** skein512 of the header the midstate was made of, with the 4 nonce bytes at pnonce */
+inline uint512 Skein512FromMidstate(const sph_skein512_context& midstate, const unsigned char* pnonce)
+{
+    sph_skein512_context ctx = midstate;
+    uint512 hash;
+    sph_skein512(&ctx, pnonce, 4);
+    sph_skein512_close(&ctx, static_cast<void*>(&hash));
+    return hash;
+}
+
+inline void JH512Midstate(sph_jh512_context& ctx, const unsigned char* pheader)
+{
+    sph_jh512_init(&ctx);
+    sph_jh512(&ctx, pheader, HEADER_MIDSTATE_SIZE);
+}
+
+inline uint512 JH512FromMidstate(const sph_jh512_context& midstate, const unsigned char* pnonce)
+{
+    sph_jh512_context ctx = midstate;
+    uint512 hash;
+    sph_jh512(&ctx, pnonce, 4);
+    sph_jh512_close(&ctx, static_cast<void*>(&hash));
+    return hash;
+}
+
+inline void Luffa512Midstate(sph_luffa512_context& ctx, const unsigned char* pheader)
+{
+    sph_luffa512_init(&ctx);
+    sph_luffa512(&ctx, pheader, HEADER_MIDSTATE_SIZE);
+}
+
+inline uint512 Luffa512FromMidstate(const sph_luffa512_context& midstate, const unsigned char* pnonce)
+{
+    sph_luffa512_context ctx = midstate;
+    uint512 hash;
+    sph_luffa512(&ctx, pnonce, 4);
+    sph_luffa512_close(&ctx, static_cast<void*>(&hash));
+    return hash;
+}
+
+/* ----------- 4-way ------------------------------------------------------ */
+
+/*
+ * Chains for four inputs of the same length at once. The functions with a
+ * 4-way version (see crypto/hash4way.h) hash the four together, the others
+ * one after the other.
+ */
+
+/** A 512-bit function on four consecutive 64 byte inputs */
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+inline void Hash512Each4(unsigned char* out, const unsigned char* in)
+{
+    Context ctx;
+    for (int i = 0; i < 4; i++) {
+        Init(&ctx);
+        Update(&ctx, in + i * 64, 64);
+        Close(&ctx, out + i * 64);
+    }
+}
+
+/** HashX11 of the four consecutive inputs of len bytes at pinput */
+inline void HashX11_4way(const unsigned char* pinput, size_t len, uint256* phashes)
+{
+    unsigned char a[4 * 64], b[4 * 64];
+
+    Blake512_4way(a, pinput, len);
+    Hash512Each4<sph_bmw512_context, sph_bmw512_init, sph_bmw512, sph_bmw512_close>(b, a);
+    Hash512Each4<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>(a, b);
+    Skein512_4way(b, a, 64);
+    Hash512Each4<sph_jh512_context, sph_jh512_init, sph_jh512, sph_jh512_close>(a, b);
+    Keccak512_4way(b, a, 64);
+    Hash512Each4<sph_luffa512_context, sph_luffa512_init, sph_luffa512, sph_luffa512_close>(a, b);
+    Hash512Each4<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>(b, a);
+    Hash512Each4<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>(a, b);
+    Hash512Each4<sph_simd512_context, sph_simd512_init, sph_simd512, sph_simd512_close>(b, a);
+    Hash512Each4<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>(a, b);
+
+    for (int i = 0; i < 4; i++)
+        memcpy(phashes[i].begin(), a + i * 64, 32);
+}
+
 #endif // MULTIHASH_H
@@ -312,6 +312,23 @@ void sph_echo512_close(void *cc, void *dst);
  */
 void sph_echo512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
+
+/**
+ * Select the fastest ECHO compression function this CPU supports. The
+ * accelerated variant is only used if it matches the portable code on a
+ * self-test message. This must be called before any hashing threads are
+ * started.
+ *
+ * @return  the name of the selected implementation
+ */
+const char *sph_echo_autodetect(void);
+
+/**
+ * Get the name of the ECHO implementation currently in use.
+ *
+ * @return  <code>"aesni"</code> or <code>"standard"</code>
+ */
+const char *sph_echo_implementation(void);
 	
 #ifdef __cplusplus
 }
@@ -0,0 +1,104 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "neoscrypt.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(ENABLE_NEOSCRYPT_ASM) && !defined(BUILD_BITCOIN_INTERNAL)
+#define NEOSCRYPT_HAVE_ASM 1
+#endif
+
+#ifdef NEOSCRYPT_HAVE_ASM
+extern "C" void neoscrypt_asm(const unsigned char* password, unsigned char* output, unsigned int profile);
+#endif
+
+namespace
+{
+struct NeoscryptEngine {
+    neoscrypt_engine_t hash;
+    const char* name;
+};
+
+const NeoscryptEngine NEOSCRYPT_ENGINES[] = {
+    {neoscrypt_generic, "generic"},
+#ifdef NEOSCRYPT_HAVE_ASM
+    {neoscrypt_asm, "asm"},
+#endif
+};
+
+const size_t NUM_NEOSCRYPT_ENGINES = sizeof(NEOSCRYPT_ENGINES) / sizeof(NEOSCRYPT_ENGINES[0]);
+
+/** The engine neoscrypt() uses for the default profile */
+const NeoscryptEngine* neoscrypt_engine = &NEOSCRYPT_ENGINES[0];
+
+/** Times each engine runs the self-test, the fastest run counts */
+const int NEOSCRYPT_SELFTEST_RUNS = 3;
+
+/**
+ * Hash a fixed header with the default profile and compare the result to
+ * expected. Returns the duration of the fastest run in nanoseconds, or -1 if
+ * the result differs.
+ */
+int64_t TimeEngine(neoscrypt_engine_t hash, const unsigned char* expected)
+{
+    unsigned char input[80];
+    for (size_t i = 0; i < sizeof(input); ++i) input[i] = i * 7 + 1;
+
+    int64_t best = -1;
+    for (int i = 0; i < NEOSCRYPT_SELFTEST_RUNS; ++i) {
+        unsigned char output[32];
+        auto start = std::chrono::steady_clock::now();
+        hash(input, output, 0x0);
+        int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (memcmp(output, expected, sizeof(output))) return -1;
+        if (best < 0 || duration < best) best = duration;
+    }
+    return best;
+}
+
+} // namespace
+
+const char* neoscrypt_autodetect(void)
+{
+    neoscrypt_engine = &NEOSCRYPT_ENGINES[0];
+
+    unsigned char input[80], expected[32];
+    for (size_t i = 0; i < sizeof(input); ++i) input[i] = i * 7 + 1;
+    neoscrypt_generic(input, expected, 0x0);
+
+    // The assembly engine predates current compilers, it is not faster on every CPU.
+    int64_t best = TimeEngine(neoscrypt_generic, expected);
+    for (size_t i = 1; i < NUM_NEOSCRYPT_ENGINES; ++i) {
+        int64_t duration = TimeEngine(NEOSCRYPT_ENGINES[i].hash, expected);
+        if (duration >= 0 && duration < best) {
+            best = duration;
+            neoscrypt_engine = &NEOSCRYPT_ENGINES[i];
+        }
+    }
+    return neoscrypt_engine->name;
+}
+
+const char* neoscrypt_implementation(void)
+{
+    return neoscrypt_engine->name;
+}
+
+neoscrypt_engine_t neoscrypt_get_engine(unsigned int index, const char** name)
+{
+    if (index >= NUM_NEOSCRYPT_ENGINES) return nullptr;
+    if (name) *name = NEOSCRYPT_ENGINES[index].name;
+    return NEOSCRYPT_ENGINES[index].hash;
+}
+
+void neoscrypt(const unsigned char* password, unsigned char* output, unsigned int profile)
+{
+    if (profile == 0x0) {
+        neoscrypt_engine->hash(password, output, profile);
+    } else {
+        neoscrypt_generic(password, output, profile);
+    }
+}
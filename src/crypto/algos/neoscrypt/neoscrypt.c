@@ -2547,7 +2547,8 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
 }
 
 
-/* NeoScrypt core engine:
+/* NeoScrypt core engine, the portable one neoscrypt() in neoscrypt-dispatch.cpp
+ * falls back to:
  * p = 1, salt = password;
  * Basic customisation (required):
  *   profile bit 0:
@@ -2578,7 +2579,7 @@ static void neoscrypt_blkmix(uint *X, uint *Y, uint r, uint mixmode) {
  *     .....
  *     11110 = N of 2147483648;
  *   profile bits 30 to 13 are reserved */
-void neoscrypt(const uchar *password, uchar *output, uint profile) {
+void neoscrypt_generic(const uchar *password, uchar *output, uint profile) {
     const size_t stack_align = 0x40;
     uint N = 128, r = 2, dblmix = 1, mixmode = 0x14;
     uint kdf, i, j;
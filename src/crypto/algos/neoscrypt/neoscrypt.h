@@ -5,6 +5,27 @@ extern "C" {
 void neoscrypt(const unsigned char *password, unsigned char *output,
   unsigned int profile);
 
+/* The engines neoscrypt() selects between: the portable C one, always
+ * available, and the INT/SSE2 assembly one of x86-64 builds. The latter only
+ * supports the default profile 0x0, neoscrypt() uses the C one for others. */
+typedef void (*neoscrypt_engine_t)(const unsigned char *password,
+  unsigned char *output, unsigned int profile);
+
+void neoscrypt_generic(const unsigned char *password, unsigned char *output,
+  unsigned int profile);
+
+/* Select the fastest engine for the default profile that matches the portable
+ * one on a self-test message. This must be called before any hashing threads
+ * are started. Returns the name of the selected engine. */
+const char *neoscrypt_autodetect(void);
+
+/* Get the name of the engine currently in use: "generic" or "asm". */
+const char *neoscrypt_implementation(void);
+
+/* Get the index-th engine built in and its name, for benchmarks.
+ * Returns NULL past the last one. */
+neoscrypt_engine_t neoscrypt_get_engine(unsigned int index, const char **name);
+
 void neoscrypt_blake2s(const void *input, const unsigned int input_size,
   const void *key, const unsigned char key_size,
   void *output, const unsigned char output_size);
@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "powscratch.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#if defined(__linux__) && defined(MAP_ANON) && defined(MAP_HUGETLB)
+#define POW_SCRATCH_HAVE_HUGEPAGES
+#endif
+
+static int pow_scratch_hugepages_enabled = 0;
+static uint64_t pow_scratch_total = 0;
+static uint64_t pow_scratch_hugetlb = 0;
+static uint64_t pow_scratch_thp = 0;
+
+int pow_scratch_set_hugepages(int enable)
+{
+#ifdef POW_SCRATCH_HAVE_HUGEPAGES
+	pow_scratch_hugepages_enabled = enable;
+	return 1;
+#else
+	(void)enable;
+	return 0;
+#endif
+}
+
+int pow_scratch_hugepages(void)
+{
+	return pow_scratch_hugepages_enabled;
+}
+
+#ifdef POW_SCRATCH_HAVE_HUGEPAGES
+void *pow_scratch_alloc(size_t size, size_t *mapped_size)
+{
+	const size_t hugepage_mask = (size_t)POW_SCRATCH_HUGEPAGE_SIZE - 1;
+	const size_t rounded = (size + hugepage_mask) & ~hugepage_mask;
+	uint8_t *base, *aligned;
+
+	if (size == 0 || rounded < size)
+		return NULL;
+	__sync_fetch_and_add(&pow_scratch_total, 1);
+
+	base = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+	if (base != MAP_FAILED) {
+		__sync_fetch_and_add(&pow_scratch_hugetlb, 1);
+		*mapped_size = rounded;
+		return base;
+	}
+
+/*
+ * No huge pages reserved, map one huge page more than needed and trim it to
+ * a huge page boundary, so that the whole region can be backed by
+ * transparent huge pages.
+ */
+	if (rounded + POW_SCRATCH_HUGEPAGE_SIZE < rounded)
+		return NULL;
+	base = mmap(NULL, rounded + POW_SCRATCH_HUGEPAGE_SIZE,
+	    PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+	aligned = (uint8_t *)(((uintptr_t)base + hugepage_mask) & ~(uintptr_t)hugepage_mask);
+	if (aligned > base)
+		munmap(base, aligned - base);
+	munmap(aligned + rounded, base + POW_SCRATCH_HUGEPAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+	if (madvise(aligned, rounded, MADV_HUGEPAGE) == 0)
+		__sync_fetch_and_add(&pow_scratch_thp, 1);
+#endif
+	*mapped_size = rounded;
+	return aligned;
+}
+
+void pow_scratch_free(void *ptr, size_t mapped_size)
+{
+	if (ptr)
+		munmap(ptr, mapped_size);
+}
+#else
+void *pow_scratch_alloc(size_t size, size_t *mapped_size)
+{
+	(void)size;
+	(void)mapped_size;
+	return NULL;
+}
+
+void pow_scratch_free(void *ptr, size_t mapped_size)
+{
+	(void)ptr;
+	(void)mapped_size;
+}
+#endif
+
+void pow_scratch_stats(uint64_t *total, uint64_t *hugetlb, uint64_t *thp)
+{
+	*total = __sync_fetch_and_add(&pow_scratch_total, 0);
+	*hugetlb = __sync_fetch_and_add(&pow_scratch_hugetlb, 0);
+	*thp = __sync_fetch_and_add(&pow_scratch_thp, 0);
+}
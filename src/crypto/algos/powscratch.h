@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef POW_SCRATCH_H
+#define POW_SCRATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The huge page size scratch memory is rounded up to with -powhugepages */
+#define POW_SCRATCH_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Back the scratch memory of the memory-hard algos (yescrypt, yespower,
+ * argon2 and scrypt) allocated from now on with huge pages. Must be called
+ * before any hashing threads are started. Returns 0 if huge pages are not
+ * supported on this platform, in which case nothing changes.
+ */
+int pow_scratch_set_hugepages(int enable);
+
+/** Whether pow_scratch_set_hugepages enabled huge pages */
+int pow_scratch_hugepages(void);
+
+/**
+ * Map size bytes of scratch memory, rounded up to POW_SCRATCH_HUGEPAGE_SIZE
+ * and aligned to it. MAP_HUGETLB is tried first, if no huge pages are
+ * reserved the region is advised for transparent huge pages instead. Only
+ * to be called with huge pages enabled. The size to unmap the region with
+ * is stored in *mapped_size. Returns NULL on failure.
+ */
+void *pow_scratch_alloc(size_t size, size_t *mapped_size);
+
+/** Unmap a region of pow_scratch_alloc */
+void pow_scratch_free(void *ptr, size_t mapped_size);
+
+/**
+ * The regions pow_scratch_alloc mapped since startup: in total, with
+ * MAP_HUGETLB and advised for transparent huge pages. Whether the kernel
+ * actually backs the latter with huge pages shows in AnonHugePages of
+ * /proc/self/smaps.
+ */
+void pow_scratch_stats(uint64_t *total, uint64_t *hugetlb, uint64_t *thp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POW_SCRATCH_H
@@ -28,6 +28,7 @@
  */
 
 #include "crypto/algos/scrypt/scrypt.h"
+#include "crypto/algos/powscratch.h"
 //#include "util.h"
 #include <stdlib.h>
 #include <stdint.h>
@@ -327,6 +328,21 @@ std::string scrypt_detect_sse2()
 
 void scrypt_1024_1_1_256(const char *input, char *output)
 {
+    // With -powhugepages each thread keeps a scratchpad on a huge page instead of the stack
+    static __thread char *huge_scratchpad = nullptr;
+    static __thread bool huge_scratchpad_tried = false;
+    if (pow_scratch_hugepages()) {
+        if (!huge_scratchpad_tried) {
+            size_t mapped_size;
+            huge_scratchpad = static_cast<char*>(pow_scratch_alloc(SCRYPT_SCRATCHPAD_SIZE, &mapped_size));
+            huge_scratchpad_tried = true;
+        }
+        if (huge_scratchpad) {
+            scrypt_1024_1_1_256_sp(input, output, huge_scratchpad);
+            return;
+        }
+    }
+
 	char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
     scrypt_1024_1_1_256_sp(input, output, scratchpad);
 }
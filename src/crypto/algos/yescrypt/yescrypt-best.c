@@ -1,3 +1,11 @@
+/*
+ * yescrypt_kdf() is defined in yescrypt-dispatch.cpp, it calls the one of
+ * this build or that of yescrypt-avx.c or yescrypt-xop.c.
+ */
+#ifndef yescrypt_kdf
+#define yescrypt_kdf yescrypt_kdf_default
+#endif
+
 #if defined (__x86_64__)
 #include "yescrypt-simd.c"
 #else
@@ -0,0 +1,159 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "yescrypt.h"
+
+#include <chrono>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#if defined(__x86_64__) && !defined(BUILD_BITCOIN_INTERNAL)
+#if defined(ENABLE_YESCRYPT_AVX)
+#define YESCRYPT_HAVE_AVX 1
+#endif
+#if defined(ENABLE_YESCRYPT_XOP)
+#define YESCRYPT_HAVE_XOP 1
+#endif
+#endif
+
+#define YESCRYPT_KDF_ARGS const yescrypt_shared_t* shared, yescrypt_local_t* local, \
+    const uint8_t* passwd, size_t passwdlen, const uint8_t* salt, size_t saltlen, \
+    uint64_t N, uint32_t r, uint32_t p, uint32_t t, yescrypt_flags_t flags, uint8_t* buf, size_t buflen
+
+extern "C" {
+int yescrypt_kdf_default(YESCRYPT_KDF_ARGS);
+#ifdef YESCRYPT_HAVE_AVX
+int yescrypt_kdf_avx(YESCRYPT_KDF_ARGS);
+#endif
+#ifdef YESCRYPT_HAVE_XOP
+int yescrypt_kdf_xop(YESCRYPT_KDF_ARGS);
+#endif
+}
+
+namespace
+{
+typedef int (*YescryptKdfFunction)(YESCRYPT_KDF_ARGS);
+
+#if defined(__x86_64__)
+const char* const YESCRYPT_DEFAULT_NAME = "sse2";
+#else
+const char* const YESCRYPT_DEFAULT_NAME = "generic";
+#endif
+
+YescryptKdfFunction yescrypt_kdf_impl = yescrypt_kdf_default;
+const char* yescrypt_impl_name = YESCRYPT_DEFAULT_NAME;
+
+/** Times the candidate runs the self-test, the fastest run counts */
+const int YESCRYPT_SELFTEST_RUNS = 3;
+
+/** Hash a fixed message with the parameters of yescrypt_hash(). */
+bool SelfTestHash(YescryptKdfFunction kdf, const yescrypt_shared_t* shared, yescrypt_local_t* local, uint8_t* buf)
+{
+    uint8_t passwd[80];
+    for (size_t i = 0; i < sizeof(passwd); ++i) passwd[i] = i * 7 + 1;
+    return kdf(shared, local, passwd, sizeof(passwd), passwd, sizeof(passwd), 2048, 8, 1, 0,
+               (yescrypt_flags_t)(YESCRYPT_RW | YESCRYPT_PWXFORM), buf, 32) == 0;
+}
+
+/**
+ * Run SelfTestHash() and compare the result to expected. Returns the duration
+ * of the fastest run in nanoseconds, or -1 if the result differs.
+ */
+int64_t TimeKdf(YescryptKdfFunction kdf, const yescrypt_shared_t* shared, yescrypt_local_t* local, const uint8_t* expected)
+{
+    int64_t best = -1;
+    for (int i = 0; i < YESCRYPT_SELFTEST_RUNS; ++i) {
+        uint8_t buf[32];
+        auto start = std::chrono::steady_clock::now();
+        if (!SelfTestHash(kdf, shared, local, buf) || memcmp(buf, expected, sizeof(buf))) return -1;
+        int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (best < 0 || duration < best) best = duration;
+    }
+    return best;
+}
+
+#if defined(__x86_64__)
+/** Whether the OS saves the AVX register state, as required before using AVX or XOP. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+/* see yescrypt.h */
+const char* yescrypt_autodetect(void)
+{
+    bool have_avx = false, have_xop = false;
+#if defined(__x86_64__)
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    }
+    if (have_avx && __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) {
+        have_xop = (ecx >> 11) & 1;
+    }
+#endif
+
+    yescrypt_kdf_impl = yescrypt_kdf_default;
+    yescrypt_impl_name = YESCRYPT_DEFAULT_NAME;
+    if (!have_avx) return yescrypt_impl_name;
+
+    yescrypt_shared_t shared;
+    yescrypt_local_t local;
+    if (yescrypt_init_shared(&shared, NULL, 0, 0, 0, 0, YESCRYPT_SHARED_DEFAULTS, 0, NULL, 0)) {
+        return yescrypt_impl_name;
+    }
+    if (yescrypt_init_local(&local)) {
+        yescrypt_free_shared(&shared);
+        return yescrypt_impl_name;
+    }
+
+    uint8_t expected[32];
+    int64_t best = -1;
+    if (SelfTestHash(yescrypt_kdf_default, &shared, &local, expected)) {
+        best = TimeKdf(yescrypt_kdf_default, &shared, &local, expected);
+    }
+
+    if (best >= 0) {
+        // The builds for AVX and XOP are not always faster than the SSE2 one, so time them.
+        auto consider = [&](YescryptKdfFunction kdf, const char* name) {
+            int64_t duration = TimeKdf(kdf, &shared, &local, expected);
+            if (duration >= 0 && duration < best) {
+                best = duration;
+                yescrypt_kdf_impl = kdf;
+                yescrypt_impl_name = name;
+            }
+        };
+#ifdef YESCRYPT_HAVE_AVX
+        consider(yescrypt_kdf_avx, "avx");
+#endif
+#ifdef YESCRYPT_HAVE_XOP
+        if (have_xop) consider(yescrypt_kdf_xop, "xop");
+#endif
+        (void)consider; // Unused when built without the other builds.
+    }
+    (void)have_xop;
+
+    yescrypt_free_local(&local);
+    yescrypt_free_shared(&shared);
+    return yescrypt_impl_name;
+}
+
+/* see yescrypt.h */
+const char* yescrypt_implementation(void)
+{
+    return yescrypt_impl_name;
+}
+
+int yescrypt_kdf(YESCRYPT_KDF_ARGS)
+{
+    return yescrypt_kdf_impl(shared, local, passwd, passwdlen, salt, saltlen, N, r, p, t, flags, buf, buflen);
+}
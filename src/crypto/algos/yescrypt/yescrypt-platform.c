@@ -24,6 +24,7 @@
 #include <sys/mman.h>
 #endif
 #include "yescrypt.h"
+#include "../powscratch.h"
 #define HUGEPAGE_THRESHOLD		(12 * 1024 * 1024)
 
 #ifdef __x86_64__
@@ -37,6 +38,16 @@ alloc_region(yescrypt_region_t * region, size_t size)
 {
 	size_t base_size = size;
 	uint8_t * base, * aligned;
+
+/* -powhugepages, only ever enabled where the region is unmapped with munmap */
+	if (pow_scratch_hugepages()) {
+		base = pow_scratch_alloc(size, &base_size);
+		region->base = region->aligned = base;
+		region->base_size = base ? base_size : 0;
+		region->aligned_size = base ? size : 0;
+		return base;
+	}
+
 #ifdef MAP_ANON
 	int flags =
 #ifdef MAP_NOCORE
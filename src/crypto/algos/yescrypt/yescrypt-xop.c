@@ -0,0 +1,13 @@
+/*
+ * yescrypt-best.c built again with -mxop, yescrypt_autodetect() selects its
+ * yescrypt_kdf_xop() on CPUs with XOP. The other functions are the same as
+ * those of the default build and are not used.
+ */
+#if defined(__x86_64__)
+#define yescrypt_kdf yescrypt_kdf_xop
+#define yescrypt_init_shared yescrypt_init_shared_xop
+#define yescrypt_free_shared yescrypt_free_shared_xop
+#define yescrypt_init_local yescrypt_init_local_xop
+#define yescrypt_free_local yescrypt_free_local_xop
+#include "yescrypt-best.c"
+#endif
@@ -45,6 +45,24 @@ extern void yescrypt_r24_hash(const char *input, char *output);
 extern void yescrypt_r8_hash(const char *input, char *output);
 extern void yescrypt_r32_hash(const char *input, char *output);
 
+/**
+ * yescrypt_autodetect():
+ * Select the fastest build of yescrypt_kdf() this CPU supports: the default
+ * one, or those for AVX and XOP. A build is only used if it matches the
+ * default one on a self-test message. This must be called before any hashing
+ * threads are started.
+ *
+ * Return the name of the selected build.
+ */
+extern const char *yescrypt_autodetect(void);
+
+/**
+ * yescrypt_implementation():
+ * Return the name of the build of yescrypt_kdf() currently in use:
+ * "sse2", "avx" or "xop" on x86-64, "generic" elsewhere.
+ */
+extern const char *yescrypt_implementation(void);
+
 
 
 /**
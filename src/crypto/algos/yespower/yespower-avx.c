@@ -0,0 +1,12 @@
+/*
+ * yespower-opt.c built again with -mavx, yespower_autodetect() selects its
+ * yespower_avx() and yespower_tls_avx() on CPUs with AVX. The other
+ * functions are the same as those of the default build and are not used.
+ */
+#if defined(__x86_64__)
+#define yespower yespower_avx
+#define yespower_tls yespower_tls_avx
+#define yespower_init_local yespower_init_local_avx
+#define yespower_free_local yespower_free_local_avx
+#include "yespower-opt.c"
+#endif
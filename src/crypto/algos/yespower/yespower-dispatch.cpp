@@ -0,0 +1,169 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "yespower.h"
+
+#include <chrono>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#if defined(__x86_64__) && !defined(BUILD_BITCOIN_INTERNAL)
+#if defined(ENABLE_YESCRYPT_AVX)
+#define YESPOWER_HAVE_AVX 1
+#endif
+#if defined(ENABLE_YESCRYPT_XOP)
+#define YESPOWER_HAVE_XOP 1
+#endif
+#endif
+
+extern "C" {
+int yespower_default(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_default(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+#ifdef YESPOWER_HAVE_AVX
+int yespower_avx(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_avx(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+#endif
+#ifdef YESPOWER_HAVE_XOP
+int yespower_xop(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+int yespower_tls_xop(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst);
+#endif
+}
+
+namespace
+{
+typedef int (*YespowerFunction)(yespower_local_t*, const uint8_t*, size_t, const yespower_params_t*, yespower_binary_t*);
+typedef int (*YespowerTlsFunction)(const uint8_t*, size_t, const yespower_params_t*, yespower_binary_t*);
+
+#if defined(__x86_64__) && defined(__SSE4_1__)
+const char* const YESPOWER_DEFAULT_NAME = "sse4.1";
+#elif defined(__x86_64__)
+const char* const YESPOWER_DEFAULT_NAME = "sse2";
+#else
+const char* const YESPOWER_DEFAULT_NAME = "generic";
+#endif
+
+YespowerFunction yespower_impl = yespower_default;
+YespowerTlsFunction yespower_tls_impl = yespower_tls_default;
+const char* yespower_impl_name = YESPOWER_DEFAULT_NAME;
+
+/** Times the candidate runs the self-test, the fastest run counts */
+const int YESPOWER_SELFTEST_RUNS = 3;
+
+/** The parameters of yespower_hash(), and those of yespower 0.5 for its other code path */
+const yespower_params_t YESPOWER_SELFTEST_PARAMS[2] = {
+    {YESPOWER_1_0, 2048, 32, NULL, 0},
+    {YESPOWER_0_5, 2048, 8, (const uint8_t*)"Client Key", 10},
+};
+
+/** Hash a fixed message with each of YESPOWER_SELFTEST_PARAMS. */
+bool SelfTestHash(YespowerFunction hash, yespower_local_t* local, yespower_binary_t* dst)
+{
+    uint8_t src[80];
+    for (size_t i = 0; i < sizeof(src); ++i) src[i] = i * 7 + 1;
+    for (int i = 0; i < 2; ++i) {
+        if (hash(local, src, sizeof(src), &YESPOWER_SELFTEST_PARAMS[i], &dst[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * Run SelfTestHash() and compare the results to expected. Returns the duration
+ * of the fastest run in nanoseconds, or -1 if the results differ.
+ */
+int64_t TimeYespower(YespowerFunction hash, yespower_local_t* local, const yespower_binary_t* expected)
+{
+    int64_t best = -1;
+    for (int i = 0; i < YESPOWER_SELFTEST_RUNS; ++i) {
+        yespower_binary_t dst[2];
+        auto start = std::chrono::steady_clock::now();
+        if (!SelfTestHash(hash, local, dst) || memcmp(dst, expected, sizeof(dst))) return -1;
+        int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (best < 0 || duration < best) best = duration;
+    }
+    return best;
+}
+
+#if defined(__x86_64__)
+/** Whether the OS saves the AVX register state, as required before using AVX or XOP. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+/* see yespower.h */
+const char* yespower_autodetect(void)
+{
+    bool have_avx = false, have_xop = false;
+#if defined(__x86_64__)
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    }
+    if (have_avx && __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) {
+        have_xop = (ecx >> 11) & 1;
+    }
+#endif
+
+    yespower_impl = yespower_default;
+    yespower_tls_impl = yespower_tls_default;
+    yespower_impl_name = YESPOWER_DEFAULT_NAME;
+    if (!have_avx) return yespower_impl_name;
+
+    yespower_local_t local;
+    if (yespower_init_local(&local)) return yespower_impl_name;
+
+    yespower_binary_t expected[2];
+    int64_t best = -1;
+    if (SelfTestHash(yespower_default, &local, expected)) {
+        best = TimeYespower(yespower_default, &local, expected);
+    }
+
+    if (best >= 0) {
+        // The builds for AVX and XOP are not always faster than the SSE2 one, so time them.
+        auto consider = [&](YespowerFunction hash, YespowerTlsFunction hash_tls, const char* name) {
+            int64_t duration = TimeYespower(hash, &local, expected);
+            if (duration >= 0 && duration < best) {
+                best = duration;
+                yespower_impl = hash;
+                yespower_tls_impl = hash_tls;
+                yespower_impl_name = name;
+            }
+        };
+#ifdef YESPOWER_HAVE_AVX
+        consider(yespower_avx, yespower_tls_avx, "avx");
+#endif
+#ifdef YESPOWER_HAVE_XOP
+        if (have_xop) consider(yespower_xop, yespower_tls_xop, "xop");
+#endif
+        (void)consider; // Unused when built without the other builds.
+    }
+    (void)have_xop;
+
+    yespower_free_local(&local);
+    return yespower_impl_name;
+}
+
+/* see yespower.h */
+const char* yespower_implementation(void)
+{
+    return yespower_impl_name;
+}
+
+int yespower(yespower_local_t* local, const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst)
+{
+    return yespower_impl(local, src, srclen, params, dst);
+}
+
+int yespower_tls(const uint8_t* src, size_t srclen, const yespower_params_t* params, yespower_binary_t* dst)
+{
+    return yespower_tls_impl(src, srclen, params, dst);
+}
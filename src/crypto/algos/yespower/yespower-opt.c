@@ -40,6 +40,15 @@
 
 #ifndef _YESPOWER_OPT_C_PASS_
 #define _YESPOWER_OPT_C_PASS_ 1
+
+/*
+ * yespower() and yespower_tls() are defined in yespower-dispatch.cpp, they
+ * call the ones of this build or those of yespower-avx.c or yespower-xop.c.
+ */
+#ifndef yespower_tls
+#define yespower yespower_default
+#define yespower_tls yespower_tls_default
+#endif
 #endif
 
 #if _YESPOWER_OPT_C_PASS_ == 1
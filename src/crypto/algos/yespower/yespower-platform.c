@@ -21,6 +21,7 @@
 #ifdef __unix__
 #include <sys/mman.h>
 #endif
+#include "../powscratch.h"
 
 #define HUGEPAGE_THRESHOLD		(12 * 1024 * 1024)
 
@@ -34,6 +35,16 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 {
 	size_t base_size = size;
 	uint8_t *base, *aligned;
+
+/* -powhugepages, only ever enabled where the region is unmapped with munmap */
+	if (pow_scratch_hugepages()) {
+		base = pow_scratch_alloc(size, &base_size);
+		region->base = region->aligned = base;
+		region->base_size = base ? base_size : 0;
+		region->aligned_size = base ? size : 0;
+		return base;
+	}
+
 #ifdef MAP_ANON
 	int flags =
 #ifdef MAP_NOCORE
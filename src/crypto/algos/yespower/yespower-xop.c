@@ -0,0 +1,12 @@
+/*
+ * yespower-opt.c built again with -mxop, yespower_autodetect() selects its
+ * yespower_xop() and yespower_tls_xop() on CPUs with XOP. The other
+ * functions are the same as those of the default build and are not used.
+ */
+#if defined(__x86_64__)
+#define yespower yespower_xop
+#define yespower_tls yespower_tls_xop
+#define yespower_init_local yespower_init_local_xop
+#define yespower_free_local yespower_free_local_xop
+#include "yespower-opt.c"
+#endif
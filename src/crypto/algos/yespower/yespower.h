@@ -128,6 +128,24 @@ extern int yespower_tls(const uint8_t *src, size_t srclen,
  */
 int yespower_hash(const char *input, char *output);
 
+/**
+ * yespower_autodetect():
+ * Select the fastest build of yespower() and yespower_tls() this CPU
+ * supports: the default one, or those for AVX and XOP. A build is only used
+ * if it matches the default one on self-test messages. This must be called
+ * before any hashing threads are started.
+ *
+ * Return the name of the selected build.
+ */
+extern const char *yespower_autodetect(void);
+
+/**
+ * yespower_implementation():
+ * Return the name of the build of yespower() currently in use: "sse2" (or
+ * "sse4.1" when built with it), "avx" or "xop" on x86-64, "generic" elsewhere.
+ */
+extern const char *yespower_implementation(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/hash4way.h>
+
+#include <crypto/algos/hashlib/sph_blake.h>
+#include <crypto/algos/hashlib/sph_keccak.h>
+#include <crypto/algos/hashlib/sph_skein.h>
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__)
+#include <cpuid.h>
+#endif
+
+namespace hash4way_avx2
+{
+void Blake512_4way(unsigned char* out, const unsigned char* in, size_t len);
+void Skein512_4way(unsigned char* out, const unsigned char* in, size_t len);
+void Keccak512_4way(unsigned char* out, const unsigned char* in, size_t len);
+}
+
+namespace
+{
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+void Hash1way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    Context ctx;
+    for (int i = 0; i < 4; ++i) {
+        Init(&ctx);
+        Update(&ctx, in + i * len, len);
+        Close(&ctx, out + i * 64);
+    }
+}
+
+typedef void (*Hash4WayFunction)(unsigned char*, const unsigned char*, size_t);
+
+Hash4WayFunction Blake512 = Hash1way<sph_blake512_context, sph_blake512_init, sph_blake512, sph_blake512_close>;
+Hash4WayFunction Skein512 = Hash1way<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>;
+Hash4WayFunction Keccak512 = Hash1way<sph_keccak512_context, sph_keccak512_init, sph_keccak512, sph_keccak512_close>;
+
+/** Check the 4-way functions against the sph ones, over lengths around the block sizes. */
+bool SelfTest()
+{
+    unsigned char in[4 * 160], out[4 * 64], expected[4 * 64];
+    for (size_t i = 0; i < sizeof(in); ++i) in[i] = i * 7 + 3;
+    for (size_t len : {0, 1, 64, 65, 71, 72, 80, 111, 112, 128, 129, 160}) {
+        Hash1way<sph_blake512_context, sph_blake512_init, sph_blake512, sph_blake512_close>(expected, in, len);
+        Blake512(out, in, len);
+        if (memcmp(out, expected, sizeof(out))) return false;
+        Hash1way<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>(expected, in, len);
+        Skein512(out, in, len);
+        if (memcmp(out, expected, sizeof(out))) return false;
+        Hash1way<sph_keccak512_context, sph_keccak512_init, sph_keccak512, sph_keccak512_close>(expected, in, len);
+        Keccak512(out, in, len);
+        if (memcmp(out, expected, sizeof(out))) return false;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__amd64__)
+/** Whether the OS saves the AVX register state, as required before using AVX2. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+std::string Hash4WayAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(__x86_64__) || defined(__amd64__)
+    bool have_avx2 = false;
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+        if (__get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            have_avx2 = have_avx && ((ebx >> 5) & 1);
+        }
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        Blake512 = hash4way_avx2::Blake512_4way;
+        Skein512 = hash4way_avx2::Skein512_4way;
+        Keccak512 = hash4way_avx2::Keccak512_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+    (void)have_avx2; // Unused when built without the matching intrinsics.
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void Blake512_4way(unsigned char* output, const unsigned char* input, size_t len)
+{
+    Blake512(output, input, len);
+}
+
+void Skein512_4way(unsigned char* output, const unsigned char* input, size_t len)
+{
+    Skein512(output, input, len);
+}
+
+void Keccak512_4way(unsigned char* output, const unsigned char* input, size_t len)
+{
+    Keccak512(output, input, len);
+}
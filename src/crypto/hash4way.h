@@ -0,0 +1,27 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_HASH4WAY_H
+#define BITCOIN_CRYPTO_HASH4WAY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** Autodetect the best available implementation of the 4-way hashes below.
+ *  Returns the name of the implementation.
+ */
+std::string Hash4WayAutoDetect();
+
+/** Compute four 512-bit hashes of messages of the same length, like the sph
+ *  functions of the same name. Without AVX2 they are hashed one by one.
+ *  output:  pointer to a 4*64 byte output buffer
+ *  input:   pointer to a 4*len byte input buffer, the messages one after the other
+ *  len:     the length of each message.
+ */
+void Blake512_4way(unsigned char* output, const unsigned char* input, size_t len);
+void Skein512_4way(unsigned char* output, const unsigned char* input, size_t len);
+void Keccak512_4way(unsigned char* output, const unsigned char* input, size_t len);
+
+#endif // BITCOIN_CRYPTO_HASH4WAY_H
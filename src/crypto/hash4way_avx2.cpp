@@ -0,0 +1,358 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace hash4way_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+template <int n> __m256i inline RotL(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+template <int n> __m256i inline RotR(__m256i x) { return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n)); }
+
+/** Gather the big endian word at offset from each of the 4 consecutive inputs of stride bytes. */
+__m256i inline Read4BE(const unsigned char* in, size_t stride, size_t offset)
+{
+    return _mm256_set_epi64x(ReadBE64(in + 3 * stride + offset), ReadBE64(in + 2 * stride + offset), ReadBE64(in + stride + offset), ReadBE64(in + offset));
+}
+
+/** Gather the little endian word at offset from each of the 4 consecutive inputs of stride bytes. */
+__m256i inline Read4LE(const unsigned char* in, size_t stride, size_t offset)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 3 * stride + offset), ReadLE64(in + 2 * stride + offset), ReadLE64(in + stride + offset), ReadLE64(in + offset));
+}
+
+/** Scatter a word of each of the 4 lanes, big endian, to consecutive 64-byte outputs. */
+void inline Write4BE(unsigned char* out, int offset, __m256i v)
+{
+    WriteBE64(out + offset, _mm256_extract_epi64(v, 0));
+    WriteBE64(out + 64 + offset, _mm256_extract_epi64(v, 1));
+    WriteBE64(out + 128 + offset, _mm256_extract_epi64(v, 2));
+    WriteBE64(out + 192 + offset, _mm256_extract_epi64(v, 3));
+}
+
+/** Scatter a word of each of the 4 lanes, little endian, to consecutive 64-byte outputs. */
+void inline Write4LE(unsigned char* out, int offset, __m256i v)
+{
+    WriteLE64(out + offset, _mm256_extract_epi64(v, 0));
+    WriteLE64(out + 64 + offset, _mm256_extract_epi64(v, 1));
+    WriteLE64(out + 128 + offset, _mm256_extract_epi64(v, 2));
+    WriteLE64(out + 192 + offset, _mm256_extract_epi64(v, 3));
+}
+
+/** Copy the last len bytes of each of the 4 inputs into 4 zeroed blocks of stride bytes. */
+void inline CopyTail(unsigned char* buf, size_t stride, const unsigned char* in, size_t len, size_t offset, size_t tail)
+{
+    memset(buf, 0, 4 * stride);
+    for (int i = 0; i < 4; ++i) memcpy(buf + i * stride, in + i * len + offset, tail);
+}
+
+namespace blake512 {
+
+const uint64_t CB[16] = {
+    0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull,
+    0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull,
+    0x9216D5D98979FB1Bull, 0xD1310BA698DFB5ACull, 0x2FFD72DBD01ADFB7ull, 0xB8E1AFED6A267E96ull,
+    0xBA7C9045F12C7F99ull, 0x24A19947B3916CF7ull, 0x0801F2E2858EFC16ull, 0x636920D871574E69ull};
+
+const uint8_t sigma[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+
+void inline G(const __m256i* m, const uint8_t* s, int i, __m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(a, b, Xor(m[s[2 * i]], K(CB[s[2 * i + 1]])));
+    d = _mm256_shuffle_epi32(Xor(d, a), 0xB1);
+    c = Add(c, d);
+    b = RotR<25>(Xor(b, c));
+    a = Add(a, b, Xor(m[s[2 * i + 1]], K(CB[s[2 * i]])));
+    d = RotR<16>(Xor(d, a));
+    c = Add(c, d);
+    b = RotR<11>(Xor(b, c));
+}
+
+/** Compress one 128-byte block per lane into the state h, t counts the message bits up to its end. */
+void Compress(__m256i* h, const __m256i* m, uint64_t t)
+{
+    __m256i v[16];
+    for (int i = 0; i < 8; ++i) v[i] = h[i];
+    for (int i = 0; i < 4; ++i) v[8 + i] = K(CB[i]);
+    v[12] = K(t ^ CB[4]);
+    v[13] = K(t ^ CB[5]);
+    v[14] = K(CB[6]);
+    v[15] = K(CB[7]);
+    for (int r = 0; r < 16; ++r) {
+        const uint8_t* s = sigma[r % 10];
+        G(m, s, 0, v[0], v[4], v[8], v[12]);
+        G(m, s, 1, v[1], v[5], v[9], v[13]);
+        G(m, s, 2, v[2], v[6], v[10], v[14]);
+        G(m, s, 3, v[3], v[7], v[11], v[15]);
+        G(m, s, 4, v[0], v[5], v[10], v[15]);
+        G(m, s, 5, v[1], v[6], v[11], v[12]);
+        G(m, s, 6, v[2], v[7], v[8], v[13]);
+        G(m, s, 7, v[3], v[4], v[9], v[14]);
+    }
+    for (int i = 0; i < 8; ++i) h[i] = Xor(h[i], v[i], v[i + 8]);
+}
+
+void Compress(__m256i* h, const unsigned char* in, size_t stride, size_t offset, uint64_t t)
+{
+    __m256i m[16];
+    for (int i = 0; i < 16; ++i) m[i] = Read4BE(in, stride, offset + 8 * i);
+    Compress(h, m, t);
+}
+
+} // namespace blake512
+
+namespace skein512 {
+
+const uint64_t IV[8] = {
+    0x4903ADFF749C51CEull, 0x0D95DE399746DF03ull, 0x8FD1934127C79BCEull, 0x9A255629FF352CB1ull,
+    0x5DB62599DF6CA7B0ull, 0xEABE394CA9D5C3F4ull, 0x991112C71A75B523ull, 0xAE18A40B660FCC33ull};
+
+template <int n>
+void inline Mix(__m256i& x0, __m256i& x1)
+{
+    x0 = Add(x0, x1);
+    x1 = Xor(RotL<n>(x1), x0);
+}
+
+/** The four rounds after an even subkey. */
+void inline RoundsEven(__m256i* p)
+{
+    Mix<46>(p[0], p[1]); Mix<36>(p[2], p[3]); Mix<19>(p[4], p[5]); Mix<37>(p[6], p[7]);
+    Mix<33>(p[2], p[1]); Mix<27>(p[4], p[7]); Mix<14>(p[6], p[5]); Mix<42>(p[0], p[3]);
+    Mix<17>(p[4], p[1]); Mix<49>(p[6], p[3]); Mix<36>(p[0], p[5]); Mix<39>(p[2], p[7]);
+    Mix<44>(p[6], p[1]); Mix<9>(p[0], p[7]); Mix<54>(p[2], p[5]); Mix<56>(p[4], p[3]);
+}
+
+/** The four rounds after an odd subkey. */
+void inline RoundsOdd(__m256i* p)
+{
+    Mix<39>(p[0], p[1]); Mix<30>(p[2], p[3]); Mix<34>(p[4], p[5]); Mix<24>(p[6], p[7]);
+    Mix<13>(p[2], p[1]); Mix<50>(p[4], p[7]); Mix<10>(p[6], p[5]); Mix<17>(p[0], p[3]);
+    Mix<25>(p[4], p[1]); Mix<29>(p[6], p[3]); Mix<39>(p[0], p[5]); Mix<43>(p[2], p[7]);
+    Mix<8>(p[6], p[1]); Mix<35>(p[0], p[7]); Mix<56>(p[2], p[5]); Mix<22>(p[4], p[3]);
+}
+
+/** Process one block per lane with the tweak (t0, t1): Threefish-512 keyed by h, fed forward. */
+void UBI(__m256i* h, const __m256i* m, uint64_t t0, uint64_t t1)
+{
+    // The key and the tweak repeated, so subkey s starts at k[s] and t[s].
+    __m256i k[26], p[8];
+    const uint64_t t[20] = {t0, t1, t0 ^ t1, t0, t1, t0 ^ t1, t0, t1, t0 ^ t1, t0, t1, t0 ^ t1, t0, t1, t0 ^ t1, t0, t1, t0 ^ t1, t0, t1};
+    k[8] = K(0x1BD11BDAA9FC1A22ull);
+    for (int i = 0; i < 8; ++i) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+        p[i] = m[i];
+    }
+    for (int i = 9; i < 26; ++i) k[i] = k[i - 9];
+    for (int s = 0; s <= 18; ++s) {
+        for (int i = 0; i < 8; ++i) p[i] = Add(p[i], k[s + i]);
+        p[5] = Add(p[5], K(t[s]));
+        p[6] = Add(p[6], K(t[s + 1]));
+        p[7] = Add(p[7], K(s));
+        if (s == 18) break;
+        if (s & 1) {
+            RoundsOdd(p);
+        } else {
+            RoundsEven(p);
+        }
+    }
+    for (int i = 0; i < 8; ++i) h[i] = Xor(m[i], p[i]);
+}
+
+void UBI(__m256i* h, const unsigned char* in, size_t stride, size_t offset, uint64_t t0, uint64_t t1)
+{
+    __m256i m[8];
+    for (int i = 0; i < 8; ++i) m[i] = Read4LE(in, stride, offset + 8 * i);
+    UBI(h, m, t0, t1);
+}
+
+} // namespace skein512
+
+namespace keccak512 {
+
+const uint64_t RC[24] = {
+    0x0000000000000001ull, 0x0000000000008082ull, 0x800000000000808Aull, 0x8000000080008000ull,
+    0x000000000000808Bull, 0x0000000080000001ull, 0x8000000080008081ull, 0x8000000000008009ull,
+    0x000000000000008Aull, 0x0000000000000088ull, 0x0000000080008009ull, 0x000000008000000Aull,
+    0x000000008000808Bull, 0x800000000000008Bull, 0x8000000000008089ull, 0x8000000000008003ull,
+    0x8000000000008002ull, 0x8000000000000080ull, 0x000000000000800Aull, 0x800000008000000Aull,
+    0x8000000080008081ull, 0x8000000000008080ull, 0x0000000080000001ull, 0x8000000080008008ull};
+//! Bytes absorbed per permutation
+const size_t RATE = 72;
+
+/** Rotate the lane t into place j and carry on with the lane that was there. */
+template <int j, int n>
+void inline RhoPi(__m256i* st, __m256i& t)
+{
+    __m256i b = st[j];
+    st[j] = RotL<n>(t);
+    t = b;
+}
+
+void inline Theta(__m256i* st, int i, __m256i d)
+{
+    st[i] = Xor(st[i], d);
+    st[i + 5] = Xor(st[i + 5], d);
+    st[i + 10] = Xor(st[i + 10], d);
+    st[i + 15] = Xor(st[i + 15], d);
+    st[i + 20] = Xor(st[i + 20], d);
+}
+
+void inline Chi(__m256i* st, int j)
+{
+    __m256i a0 = st[j], a1 = st[j + 1], a2 = st[j + 2], a3 = st[j + 3], a4 = st[j + 4];
+    st[j] = Xor(a0, AndNot(a1, a2));
+    st[j + 1] = Xor(a1, AndNot(a2, a3));
+    st[j + 2] = Xor(a2, AndNot(a3, a4));
+    st[j + 3] = Xor(a3, AndNot(a4, a0));
+    st[j + 4] = Xor(a4, AndNot(a0, a1));
+}
+
+/** Keccak-f[1600] on 4 states at once. */
+void Permute(__m256i* st)
+{
+    __m256i bc[5];
+    for (int r = 0; r < 24; ++r) {
+        // Theta
+        bc[0] = Xor(Xor(st[0], st[5], st[10]), st[15], st[20]);
+        bc[1] = Xor(Xor(st[1], st[6], st[11]), st[16], st[21]);
+        bc[2] = Xor(Xor(st[2], st[7], st[12]), st[17], st[22]);
+        bc[3] = Xor(Xor(st[3], st[8], st[13]), st[18], st[23]);
+        bc[4] = Xor(Xor(st[4], st[9], st[14]), st[19], st[24]);
+        Theta(st, 0, Xor(bc[4], RotL<1>(bc[1])));
+        Theta(st, 1, Xor(bc[0], RotL<1>(bc[2])));
+        Theta(st, 2, Xor(bc[1], RotL<1>(bc[3])));
+        Theta(st, 3, Xor(bc[2], RotL<1>(bc[4])));
+        Theta(st, 4, Xor(bc[3], RotL<1>(bc[0])));
+        // Rho and pi
+        __m256i t = st[1];
+        RhoPi<10, 1>(st, t); RhoPi<7, 3>(st, t); RhoPi<11, 6>(st, t); RhoPi<17, 10>(st, t);
+        RhoPi<18, 15>(st, t); RhoPi<3, 21>(st, t); RhoPi<5, 28>(st, t); RhoPi<16, 36>(st, t);
+        RhoPi<8, 45>(st, t); RhoPi<21, 55>(st, t); RhoPi<24, 2>(st, t); RhoPi<4, 14>(st, t);
+        RhoPi<15, 27>(st, t); RhoPi<23, 41>(st, t); RhoPi<19, 56>(st, t); RhoPi<13, 8>(st, t);
+        RhoPi<12, 25>(st, t); RhoPi<2, 43>(st, t); RhoPi<20, 62>(st, t); RhoPi<14, 18>(st, t);
+        RhoPi<22, 39>(st, t); RhoPi<9, 61>(st, t); RhoPi<6, 20>(st, t); RhoPi<1, 44>(st, t);
+        // Chi
+        Chi(st, 0);
+        Chi(st, 5);
+        Chi(st, 10);
+        Chi(st, 15);
+        Chi(st, 20);
+        // Iota
+        st[0] = Xor(st[0], K(RC[r]));
+    }
+}
+
+void Absorb(__m256i* st, const unsigned char* in, size_t stride, size_t offset)
+{
+    for (size_t i = 0; i < RATE / 8; ++i) st[i] = Xor(st[i], Read4LE(in, stride, offset + 8 * i));
+    Permute(st);
+}
+
+} // namespace keccak512
+
+} // namespace
+
+void Blake512_4way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    static const uint64_t IV[8] = {
+        0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull, 0x3C6EF372FE94F82Bull, 0xA54FF53A5F1D36F1ull,
+        0x510E527FADE682D1ull, 0x9B05688C2B3E6C1Full, 0x1F83D9ABFB41BD6Bull, 0x5BE0CD19137E2179ull};
+    __m256i h[8];
+    for (int i = 0; i < 8; ++i) h[i] = K(IV[i]);
+
+    size_t offset = 0;
+    for (; offset + 128 <= len; offset += 128) blake512::Compress(h, in, len, offset, (offset + 128) * 8);
+
+    // The rest of the message, the padding bits and the length, in one or two blocks. The counter
+    // of a block without message bits is 0.
+    const size_t tail = len - offset;
+    unsigned char buf[4 * 256];
+    const size_t stride = tail <= 111 ? 128 : 256;
+    CopyTail(buf, stride, in, len, offset, tail);
+    for (int i = 0; i < 4; ++i) {
+        unsigned char* p = buf + i * stride;
+        p[tail] = 0x80;
+        p[stride - 17] |= 0x01;
+        WriteBE64(p + stride - 8, (uint64_t)len * 8);
+    }
+    blake512::Compress(h, buf, stride, 0, tail ? (uint64_t)len * 8 : 0);
+    if (stride == 256) blake512::Compress(h, buf, stride, 128, 0);
+
+    for (int i = 0; i < 8; ++i) Write4BE(out, 8 * i, h[i]);
+}
+
+void Skein512_4way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    __m256i h[8];
+    for (int i = 0; i < 8; ++i) h[i] = K(skein512::IV[i]);
+
+    // Every block but the last, which is the final one even if it is full.
+    size_t offset = 0;
+    uint64_t type = 96 + 128; // message, first block
+    for (; offset + 64 < len; offset += 64) {
+        skein512::UBI(h, in, len, offset, offset + 64, type << 55);
+        type = 96;
+    }
+    const size_t tail = len - offset;
+    unsigned char buf[4 * 64];
+    CopyTail(buf, 64, in, len, offset, tail);
+    skein512::UBI(h, buf, 64, 0, len, (type + 256) << 55);
+
+    // The output block, of the counter 0.
+    __m256i m[8];
+    for (int i = 0; i < 8; ++i) m[i] = K(0);
+    skein512::UBI(h, m, 8, (uint64_t)510 << 55);
+
+    for (int i = 0; i < 8; ++i) Write4LE(out, 8 * i, h[i]);
+}
+
+void Keccak512_4way(unsigned char* out, const unsigned char* in, size_t len)
+{
+    __m256i st[25];
+    for (int i = 0; i < 25; ++i) st[i] = K(0);
+
+    size_t offset = 0;
+    for (; offset + keccak512::RATE <= len; offset += keccak512::RATE) keccak512::Absorb(st, in, len, offset);
+
+    // The original Keccak padding, like sph_keccak512, not the one of SHA-3.
+    const size_t tail = len - offset;
+    unsigned char buf[4 * keccak512::RATE];
+    CopyTail(buf, keccak512::RATE, in, len, offset, tail);
+    for (int i = 0; i < 4; ++i) {
+        buf[i * keccak512::RATE + tail] |= 0x01;
+        buf[i * keccak512::RATE + keccak512::RATE - 1] |= 0x80;
+    }
+    keccak512::Absorb(st, buf, keccak512::RATE, 0);
+
+    for (int i = 0; i < 8; ++i) Write4LE(out, 8 * i, st[i]);
+}
+
+} // namespace hash4way_avx2
+
+#endif
@@ -0,0 +1,209 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <limits>
+
+namespace {
+
+/** 2^3072 - MAX_PRIME_DIFF is the modulus. */
+const Num3072::limb_t MAX_PRIME_DIFF = 1103717;
+
+/** The exponent p - 2 is (2^3051 - 1) * 2^21 + INVERSE_TAIL. */
+const uint32_t INVERSE_TAIL = (1 << 21) - MAX_PRIME_DIFF - 2;
+
+Num3072::limb_t ReadLimb(const unsigned char* ptr)
+{
+    return sizeof(Num3072::limb_t) == 8 ? ReadLE64(ptr) : ReadLE32(ptr);
+}
+
+void WriteLimb(unsigned char* ptr, Num3072::limb_t x)
+{
+    if (sizeof(Num3072::limb_t) == 8) {
+        WriteLE64(ptr, x);
+    } else {
+        WriteLE32(ptr, x);
+    }
+}
+
+} // namespace
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLimb(data + i * sizeof(limb_t));
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLimb(out + i * sizeof(limb_t), limbs[i]);
+    }
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<limb_t>::max()) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // Subtracting the modulus is adding MAX_PRIME_DIFF modulo 2^3072.
+    double_limb_t c = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        c += limbs[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Reduce(const limb_t (&product)[2 * LIMBS])
+{
+    // hi * 2^3072 + lo is congruent to hi * MAX_PRIME_DIFF + lo.
+    double_limb_t c = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        c += (double_limb_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+    // Fold the carry (below 2^22) back in the same way. If that wraps around
+    // 2^3072 once more, the low limbs are small and the last fold cannot.
+    while (c) {
+        c *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS; ++i) {
+            c += limbs[i];
+            limbs[i] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t c = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            c += (double_limb_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)c;
+    }
+    Reduce(product);
+}
+
+void Num3072::Square()
+{
+    // Sum the products below the diagonal once, double them, then add the squares.
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t c = 0;
+        for (int j = i + 1; j < LIMBS; ++j) {
+            c += (double_limb_t)limbs[i] * limbs[j] + product[i + j];
+            product[i + j] = (limb_t)c;
+            c >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)c;
+    }
+    limb_t top = 0;
+    for (int i = 0; i < 2 * LIMBS; ++i) {
+        limb_t next = product[i] >> (LIMB_SIZE - 1);
+        product[i] = (product[i] << 1) | top;
+        top = next;
+    }
+    double_limb_t c = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        c += (double_limb_t)limbs[i] * limbs[i] + product[2 * i];
+        product[2 * i] = (limb_t)c;
+        c >>= LIMB_SIZE;
+        c += product[2 * i + 1];
+        product[2 * i + 1] = (limb_t)c;
+        c >>= LIMB_SIZE;
+    }
+    Reduce(product);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat's little theorem: the inverse is this^(p - 2). Build this^(2^k - 1)
+    // for k = 2^i by doubling, as x^(2^(a + b) - 1) = (x^(2^a - 1))^(2^b) * x^(2^b - 1).
+    Num3072 pow2[12];
+    pow2[0] = *this;
+    for (int i = 1; i < 12; ++i) {
+        pow2[i] = pow2[i - 1];
+        for (int j = 0; j < (1 << (i - 1)); ++j) {
+            pow2[i].Square();
+        }
+        pow2[i].Multiply(pow2[i - 1]);
+    }
+    // this^(2^3051 - 1), adding the bits of 3051 below the top one.
+    Num3072 out = pow2[11];
+    for (int i = 10; i >= 0; --i) {
+        if ((3051 >> i) & 1) {
+            for (int j = 0; j < (1 << i); ++j) {
+                out.Square();
+            }
+            out.Multiply(pow2[i]);
+        }
+    }
+    for (int i = 20; i >= 0; --i) {
+        out.Square();
+        if ((INVERSE_TAIL >> i) & 1) {
+            out.Multiply(*this);
+        }
+    }
+    return out;
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(bytes, sizeof(bytes));
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char out[OUTPUT_SIZE])
+{
+    numerator.Multiply(denominator.GetInverse());
+    denominator = Num3072();
+
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    numerator.ToBytes(bytes);
+    CSHA256().Write(bytes, sizeof(bytes)).Finalize(out);
+}
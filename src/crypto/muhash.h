@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = 8 * sizeof(limb_t);
+    static const int LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+
+    limb_t limbs[LIMBS];
+
+    //! Initialize to 1
+    Num3072();
+    //! Read from BYTE_SIZE little endian bytes, which must be below the modulus
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    void Multiply(const Num3072& a);
+    void Square();
+    Num3072 GetInverse() const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    //! Reduce the product of two numbers, as 2 * LIMBS limbs
+    void Reduce(const limb_t (&product)[2 * LIMBS]);
+};
+
+/**
+ * Hash of a set of byte strings, which can be updated by adding and removing
+ * elements in any order: adding A then B gives the same hash as adding B, C
+ * and A, then removing C.
+ *
+ * Each element is mapped to a number modulo a 3072 bit prime. The state
+ * keeps the products of the added and of the removed elements, and the hash
+ * is SHA256 of their quotient. Finalizing costs a modular inverse, updates
+ * one multiplication each.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Compute the hash of the set. Also folds the removed elements into the
+     *  numerator, so the state can be stored as a single number. */
+    void Finalize(unsigned char out[OUTPUT_SIZE]);
+
+    //! State, only valid right after Finalize
+    const Num3072& GetState() const { return numerator; }
+    //! Restore a state returned by GetState
+    void SetState(const Num3072& state)
+    {
+        numerator = state;
+        denominator = Num3072();
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
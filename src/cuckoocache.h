@@ -369,6 +369,27 @@ public:
         return setup(bytes/sizeof(Element));
     }
 
+    /** The number of elements storable, as returned by setup() */
+    uint32_t capacity() const
+    {
+        return size;
+    }
+
+    /** count_occupied scans the table for entries that are not marked as
+     * discardable. It is linear in the size of the table, so it is meant for
+     * statistics only.
+     *
+     * @returns the number of entries that have not been erased or collected
+     */
+    uint32_t count_occupied() const
+    {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                ++n;
+        return n;
+    }
+
     /** insert loops at most depth_limit times trying to insert a hash
      * at various locations in the table via a variant of the Cuckoo Algorithm
      * with eight hash locations.
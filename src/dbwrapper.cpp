@@ -71,14 +71,51 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+namespace {
+
+/** How GetOptions tunes LevelDB for a DBProfile */
+struct DBProfileOptions {
+    //! Eighths of the cache size for the block cache and for each of the (up to two) write buffers
+    int nBlockCacheEighths;
+    int nWriteBufferEighths;
+    leveldb::CompressionType compression;
+    //! Eighths of the file descriptor budget
+    int nOpenFilesEighths;
+};
+
+DBProfileOptions GetProfileOptions(DBProfile profile)
+{
+    switch (profile) {
+    case DBProfile::CHAINSTATE:
+        // Obfuscated values do not compress
+        return {4, 2, leveldb::kNoCompression, 3};
+    case DBProfile::INDEX:
+        // Random reads of a large database want the cache, writes come one block at a time
+        return {6, 1, leveldb::kSnappyCompression, 1};
+    case DBProfile::DEFAULT:
+        break;
+    }
+    return {4, 2, leveldb::kNoCompression, 1};
+}
+
+int nDBFileDescriptorBudget = 0;
+
+} // namespace
+
+void SetDBFileDescriptorBudget(int nFiles)
 {
+    nDBFileDescriptorBudget = std::max(nFiles, 0);
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, DBProfile profile)
+{
+    const DBProfileOptions profileOptions = GetProfileOptions(profile);
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_cache = leveldb::NewLRUCache(nCacheSize / 8 * profileOptions.nBlockCacheEighths);
+    options.write_buffer_size = nCacheSize / 8 * profileOptions.nWriteBufferEighths; // up to two write buffers may be held in memory simultaneously
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.compression = profileOptions.compression;
+    options.max_open_files = std::min(DEFAULT_DB_MAX_OPEN_FILES + nDBFileDescriptorBudget / 8 * profileOptions.nOpenFilesEighths, MAX_DB_MAX_OPEN_FILES);
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -88,14 +125,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, DBProfile profile)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -112,6 +149,10 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint(BCLog::LEVELDB, "LevelDB in %s: %.1fMiB block cache, %.1fMiB write buffer, %d open files, %s\n", path.string(),
+        nCacheSize / 8 * GetProfileOptions(profile).nBlockCacheEighths * (1.0 / 1024 / 1024),
+        options.write_buffer_size * (1.0 / 1024 / 1024), options.max_open_files,
+        options.compression == leveldb::kSnappyCompression ? "snappy" : "uncompressed");
 
     if (gArgs.GetBoolArg("-forcecompactdb", false)) {
         LogPrintf("Starting database compaction of %s\n", path.string());
@@ -153,6 +194,15 @@ CDBWrapper::~CDBWrapper()
     options.env = nullptr;
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper& db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot())
+{
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    pdb->ReleaseSnapshot(psnapshot);
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
@@ -19,6 +19,28 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/** What a database holds, CDBWrapper tunes LevelDB for the way it is accessed */
+enum class DBProfile {
+    //! Small and mostly read right after being written, like the block index
+    DEFAULT,
+    //! The UTXO set, written in large batches by coins cache flushes, its values are obfuscated
+    CHAINSTATE,
+    //! Large optional indexes, written once per block and read at random
+    INDEX,
+};
+
+/** max_open_files of a database when no descriptors beyond the reserved ones are available */
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+/** Most table files one database keeps open, however many descriptors are available */
+static const int MAX_DB_MAX_OPEN_FILES = 1000;
+
+/**
+ * Set how many file descriptors the databases opened afterwards may keep open
+ * beyond DEFAULT_DB_MAX_OPEN_FILES each. Every database gets a share of them
+ * depending on its profile.
+ */
+void SetDBFileDescriptorBudget(int nFiles);
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -114,6 +136,26 @@ public:
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/**
+ * The contents of a CDBWrapper at the time the snapshot was taken, unaffected
+ * by later writes. Has to be destroyed before the database is.
+ */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper& db);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+};
+
 class CDBIterator
 {
 private:
@@ -176,6 +218,7 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -209,20 +252,8 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
-public:
-    /**
-     * @param[in] path        Location in the filesystem where leveldb data will be stored.
-     * @param[in] nCacheSize  Configures various leveldb cache settings.
-     * @param[in] fMemory     If true, use leveldb's memory environment.
-     * @param[in] fWipe       If true, remove all existing data.
-     * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
-     *                        with a zero'd byte array.
-     */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
-    ~CDBWrapper();
-
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool ReadWithOptions(const leveldb::ReadOptions& options, const K& key, V& value) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -230,7 +261,7 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -247,6 +278,35 @@ public:
         return true;
     }
 
+public:
+    /**
+     * @param[in] path        Location in the filesystem where leveldb data will be stored.
+     * @param[in] nCacheSize  Configures various leveldb cache settings.
+     * @param[in] fMemory     If true, use leveldb's memory environment.
+     * @param[in] fWipe       If true, remove all existing data.
+     * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
+     *                        with a zero'd byte array.
+     * @param[in] profile     How the cache is split, whether tables are compressed and
+     *                        how many files may be kept open.
+     */
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, DBProfile profile = DBProfile::DEFAULT);
+    ~CDBWrapper();
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        return ReadWithOptions(readoptions, key, value);
+    }
+
+    /** Read the value key had when snapshot was taken */
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const CDBSnapshot& snapshot) const
+    {
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot.psnapshot;
+        return ReadWithOptions(options, key, value);
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
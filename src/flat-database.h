@@ -13,6 +13,9 @@
 
 #include <boost/filesystem.hpp>
 
+/** Default number of seconds between dumps of the masternode caches while running, 0 to only dump on shutdown */
+static const int64_t DEFAULT_MNCACHE_FLUSH_INTERVAL = 15 * 60;
+
 /** 
 *   Generic Dumping and Loading
 *   ---------------------------
@@ -51,11 +54,13 @@ private:
         uint256 hash = Hash(ssObj.begin(), ssObj.end());
         ssObj << hash;
 
-        // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        // write to a temporary file first, so a crash while writing leaves the previous file intact
+        boost::filesystem::path pathTmp = pathDB;
+        pathTmp += ".new";
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
         // Write and commit header, data
         try {
@@ -64,8 +69,12 @@ private:
         catch (std::exception &e) {
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        if (!RenameOver(pathTmp, pathDB))
+            return error("%s: Rename-into-place failed for %s", __func__, pathDB.string());
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
@@ -92,13 +101,13 @@ private:
         // Don't try to resize to a negative number if file is small
         if (dataSize < 0)
             dataSize = 0;
-        std::vector<unsigned char> vchData;
-        vchData.resize(dataSize);
+        CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+        ssObj.resize(dataSize);
         uint256 hashIn;
 
         // read data and checksum from file
         try {
-            filein.read((char *)&vchData[0], dataSize);
+            filein.read(ssObj.data(), dataSize);
             filein >> hashIn;
         }
         catch (std::exception &e) {
@@ -107,8 +116,6 @@ private:
         }
         filein.fclose();
 
-        CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
         // verify stored checksum matches input data
         uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
         if (hashIn != hashTmp)
@@ -163,6 +170,31 @@ private:
     }
 
 
+    /** Only check the magic message and network magic number of an existing file */
+    ReadResult ReadHeader()
+    {
+        FILE *file = fopen(pathDB.string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return FileError;
+
+        unsigned char pchMsgTmp[4];
+        std::string strMagicMessageTmp;
+        try {
+            filein >> strMagicMessageTmp;
+            if (strMagicMessage != strMagicMessageTmp)
+                return IncorrectMagicMessage;
+
+            filein >> FLATDATA(pchMsgTmp);
+            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+                return IncorrectMagicNumber;
+        }
+        catch (std::exception &e) {
+            return IncorrectFormat;
+        }
+        return Ok;
+    }
+
 public:
     CFlatDB(std::string strFilenameIn, std::string strMagicMessageIn)
     {
@@ -197,9 +229,10 @@ public:
     {
         int64_t nStart = GetTimeMillis();
 
+        // Decoding the whole file again just to check it is ours would double the cost
+        // of every dump, the header is enough to not overwrite somebody else's file
         LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        ReadResult readResult = ReadHeader();
 
         // there was an error and it was not an error on file opening => do not proceed
         if (readResult == FileError)
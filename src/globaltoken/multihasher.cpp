@@ -15,349 +15,212 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <globaltoken/multihasher.h>
 #include <globaltoken/powalgorithm.h>
 #include <crypto/algos/hashlib/multihash.h>
-#include <crypto/algos/neoscrypt/neoscrypt.h>
-#include <crypto/algos/scrypt/scrypt.h>
-#include <crypto/algos/yescrypt/yescrypt.h>
-#include <crypto/algos/Lyra2RE/Lyra2RE.h>
-#include <crypto/algos/Lyra2RE/Lyra2Z.h>
-#include <crypto/algos/blake/hashblake.h>
-#include <crypto/algos/argon2/hashargon.h>
-#include <crypto/algos/yespower/yespower.h>
-#include <crypto/algos/honeycomb/hash_honeycomb.h>
-#include <crypto/algos/allium/allium.h>
+#include <crypto/common.h>
 #include <uint256.h>
 #include <hash.h>
 #include <version.h>
 
+#include <assert.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace {
+
+#ifdef HAVE_THREAD_LOCAL
+thread_local HashPurpose threadHashPurpose = HashPurpose::OTHER;
+#endif
+
+struct CAtomicHashingStats
+{
+    std::atomic<uint64_t> nHashes{0};
+    std::atomic<uint64_t> nNanos{0};
+};
+
+CAtomicHashingStats hashingStats[NUM_ALGOS_IMPL][(int)HashPurpose::COUNT];
+
+} // namespace
+
+const char* GetHashPurposeName(HashPurpose purpose)
+{
+    switch (purpose) {
+        case HashPurpose::OTHER: return "other";
+        case HashPurpose::HEADER_SYNC: return "headersync";
+        case HashPurpose::BLOCK_READ: return "blockread";
+        case HashPurpose::STARTUP_LOAD: return "startupload";
+        case HashPurpose::MINING: return "mining";
+        case HashPurpose::RPC: return "rpc";
+        case HashPurpose::COUNT: break;
+    }
+    assert(false);
+    return "";
+}
+
+#ifdef HAVE_THREAD_LOCAL
+HashPurpose GetHashPurpose()
+{
+    return threadHashPurpose;
+}
+
+CHashPurposeScope::CHashPurposeScope(HashPurpose purpose) : prevPurpose(threadHashPurpose)
+{
+    threadHashPurpose = purpose;
+}
+
+CHashPurposeScope::~CHashPurposeScope()
+{
+    threadHashPurpose = prevPurpose;
+}
+#else
+// Every hash is counted as OTHER without thread_local
+HashPurpose GetHashPurpose()
+{
+    return HashPurpose::OTHER;
+}
+
+CHashPurposeScope::CHashPurposeScope(HashPurpose purpose) : prevPurpose(HashPurpose::OTHER) {}
+CHashPurposeScope::~CHashPurposeScope() {}
+#endif
+
+static uint64_t GetHashClockNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CPoWHashTimer::CPoWHashTimer(uint8_t nAlgoIn, uint64_t nHashesIn) : nAlgo(nAlgoIn), nHashes(nHashesIn), purpose(GetHashPurpose()), nStart(0)
+{
+    assert(nHashes > 0 && nHashes <= HASH_TIMING_SAMPLE_INTERVAL);
+    if (nAlgo >= NUM_ALGOS_IMPL)
+        return;
+    const uint64_t nPrev = hashingStats[nAlgo][(int)purpose].nHashes.fetch_add(nHashes, std::memory_order_relaxed);
+    if (nPrev / HASH_TIMING_SAMPLE_INTERVAL != (nPrev + nHashes) / HASH_TIMING_SAMPLE_INTERVAL)
+        nStart = GetHashClockNanos();
+}
+
+CPoWHashTimer::~CPoWHashTimer()
+{
+    if (nStart == 0)
+        return;
+    const uint64_t nNanos = GetHashClockNanos() - nStart;
+    hashingStats[nAlgo][(int)purpose].nNanos.fetch_add(nNanos * HASH_TIMING_SAMPLE_INTERVAL / nHashes, std::memory_order_relaxed);
+}
+
+CHashingStats GetHashingStats(uint8_t nAlgo, HashPurpose purpose)
+{
+    assert(nAlgo < NUM_ALGOS_IMPL && purpose < HashPurpose::COUNT);
+    const CAtomicHashingStats& stats = hashingStats[nAlgo][(int)purpose];
+    return CHashingStats{stats.nHashes.load(std::memory_order_relaxed), stats.nNanos.load(std::memory_order_relaxed)};
+}
 
 uint256 CMultihasher::GetSHA256Hash() const
 {
-    CHashWriter ss(nType, nVersion);
-    for(size_t i = 0; i < buf.size(); i++)
-        ss << buf[i];
-    return ss.GetHash();
+    uint256 result;
+    CHash256().Write(buf.data(), buf.size()).Finalize(result.begin());
+    return result;
 }
 
 uint256 CMultihasher::GetHash() const 
 {
-    switch (nAlgo)
-    {
-        case ALGO_SHA256D:
-        {
-            return this->GetSHA256Hash();
-        }
-        case ALGO_SCRYPT:
-        {
-            uint256 thash;
-            assert(buf.size() == 80);
-            scrypt_1024_1_1_256((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_X11:
-        {
-            return HashX11(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_NEOSCRYPT:
-        {
-            unsigned int profile = 0x0;
-            uint256 thash;
-            assert(buf.size() == 80);
-            neoscrypt(buf.data(), (unsigned char *)&thash, profile);				
-            return thash;
-        }
-        case ALGO_EQUIHASH:
-        {
-            return this->GetSHA256Hash();
-        }
-        case ALGO_YESCRYPT:
-        {
-            uint256 thash;
-            assert(buf.size() == 80);
-            yescrypt_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_HMQ1725:
-        {
-            return HMQ1725(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_XEVAN:
-        {
-            return XEVAN(buf.data(), buf.data() + buf.size());	    
-        }
-        case ALGO_NIST5:
-        {
-            return NIST5(buf.data(), buf.data() + buf.size());	    
-        }
-        case ALGO_TIMETRAVEL10:
-        {
-            assert(buf.size() == 80);
-            uint32_t nTime;
-            memcpy(&nTime, buf.data() + 68, 4);
-            return HashTimeTravel(buf.data(), buf.data() + buf.size(), nTime);	    
-        }
-        case ALGO_PAWELHASH:
-        {
-            return PawelHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X13:
-        {
-            return HashX13(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X14:
-        {
-            return HashX14(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X15:
-        {
-            return HashX15(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X17:
-        {
-            return HashX17(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_LYRA2REV2:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            lyra2re2_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_BLAKE2S:
-        {
-            return HashBlake2S(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_BLAKE2B:
-        {
-            return HashBlake2B(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_ASTRALHASH:
-        {
-            return AstralHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_PADIHASH:
-        {
-            return PadiHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_JEONGHASH:
-        {
-            return JeongHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_KECCAKC:
-        {
-            return HashKeccakC(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_ZHASH:
-        {
-            return this->GetSHA256Hash();
-        }
-        case ALGO_GLOBALHASH:
-        {
-            return GlobalHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_GROESTL:
-        {
-            return HashGroestl(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_SKEIN:
-        {
-            return HashSkein(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_QUBIT:
-        {
-            return HashQubit(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_SKUNKHASH:
-        {
-            return SkunkHash5(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_QUARK:
-        {
-            return QUARK(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X16R:
-        {
-            assert(buf.size() == 80);
-            uint256 hashPrevBlock;
-            memcpy(&hashPrevBlock, buf.data() + 4, 32);
-            return HashX16R(buf.data(), buf.data() + buf.size(), hashPrevBlock);
-        }
-        case ALGO_LYRA2REV3:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            lyra2re3_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_YESCRYPT_R16V2:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            yescrypt_r16v2_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_YESCRYPT_R24:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            yescrypt_r24_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_YESCRYPT_R8:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            if(this->nVersion & MULTIHASHER_YESCRYPT_R8_NEW)
-                yescrypt_r8_hash((const char*)buf.data(), (char*)&thash);
-            else
-                yescrypt_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_YESCRYPT_R32:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            yescrypt_r32_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_X25X:
-        {
-            return HashX25X(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_ARGON2D:
-        {
-            uint256 salt, pepper, finalhash;
-            salt = GlobalHash(buf.data(), buf.data() + buf.size());
-            pepper = HashX16R(buf.data(), buf.data() + buf.size(), salt);
-            Argon2dHash(buf.data(), buf.size(), finalhash.begin(), 32, salt.begin(), 32, pepper.begin(), 32);
-            return finalhash;
-        }
-        case ALGO_ARGON2I:
-        {
-            uint256 salt, pepper, finalhash;
-            salt = GlobalHash(buf.data(), buf.data() + buf.size());
-            pepper = HashCPU23R(buf.data(), buf.data() + buf.size(), salt);
-            Argon2iHash(buf.data(), buf.size(), finalhash.begin(), 32, salt.begin(), 32, pepper.begin(), 32);
-            return finalhash;
-        }
-        case ALGO_CPU23R:
-        {
-            assert(buf.size() == 80);
-            uint256 hashPrevBlock;
-            memcpy(&hashPrevBlock, buf.data() + 4, 32);
-            return HashCPU23R(buf.data(), buf.data() + buf.size(), hashPrevBlock);
-        }
-        case ALGO_YESPOWER:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            yespower_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_X21S:
-        {
-            assert(buf.size() == 80);
-            uint256 hashPrevBlock;
-            memcpy(&hashPrevBlock, buf.data() + 4, 32);
-            return HashX21S(buf.data(), buf.data() + buf.size(), hashPrevBlock);
-        }
-        case ALGO_X16S:
-        {
-            assert(buf.size() == 80);
-            uint256 hashPrevBlock;
-            memcpy(&hashPrevBlock, buf.data() + 4, 32);
-            return HashX16s(buf.data(), buf.data() + buf.size(), hashPrevBlock);
-        }
-        case ALGO_X22I:
-        {
-            return HashX22I(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_LYRA2Z:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            lyra2z_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_HONEYCOMB:
-        {
-            return HashHoneyComb(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_EH192:
-        {
-            return this->GetSHA256Hash();
-        }
-        case ALGO_MARS:
-        {
-            return this->GetSHA256Hash();
-        }
-        case ALGO_X12:
-        {
-            return HashX12(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_HEX:
-        {
-            return HashHEX(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_DEDAL:
-        {
-            return HashDedal(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_C11:
-        {
-            return HashC11(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_PHI1612:
-        {
-            return Phi1612(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_PHI2:
-        {
-            return PHI2(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_X16RT:
-        {
-            assert(buf.size() == 80);
-            uint32_t nTime;
-            memcpy(&nTime, buf.data() + 68, 4);
-            int32_t nTimeX16r = nTime & 0xffffff80;
-            uint256 hashTime = Hash(static_cast<char*>(static_cast<void*>(&nTimeX16r)), static_cast<char*>(static_cast<void*>(&nTimeX16r))+4);
-            return HashX16R(buf.data(), buf.data() + buf.size(), hashTime);
-        }
-        case ALGO_TRIBUS:
-        {
-            return Tribus(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_ALLIUM:
-        {
-            assert(buf.size() == 80);
-            uint256 thash;
-            allium_hash((const char*)buf.data(), (char*)&thash);
-            return thash;
-        }
-        case ALGO_ARCTICHASH:
-        {
-            return ArcticHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_DESERTHASH:
-        {
-            return DesertHash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_CRYPTOANDCOFFEE:
-        {
-            return cryptoandcoffee_hash(buf.data(), buf.data() + buf.size());
-        }
-        case ALGO_RICKHASH:
-        {
-            return RickHash(buf.data(), buf.data() + buf.size());
-        }
-    }
-    return this->GetSHA256Hash();
+    if (nAlgo >= NUM_ALGOS_IMPL)
+        return this->GetSHA256Hash();
+
+    const CAlgoDescriptor& algo = GetAlgoDescriptor(nAlgo);
+    assert(algo.nInputSize == 0 || buf.size() == algo.nInputSize);
+    CPoWHashTimer timer(nAlgo, 1);
+    return algo.hash(buf.data(), buf.data() + buf.size(), nVersion);
 }
 
 int LoadMultiHasherVersionFlags(bool fHardfork3Activated)
 {
     return fHardfork3Activated ? PROTOCOL_VERSION | MULTIHASHER_YESCRYPT_R8_NEW : PROTOCOL_VERSION;
-}
\ No newline at end of file
+}
+
+struct CNonceHasher::Midstate
+{
+    enum First { SKEIN512, JH512, LUFFA512 };
+
+    First first;
+    //! The functions of the algo after the first
+    uint256 (*tail)(const uint512& hashFirst);
+    sph_skein512_context skein;
+    sph_jh512_context jh;
+    sph_luffa512_context luffa;
+};
+
+CNonceHasher::CNonceHasher(uint8_t nAlgoIn, const std::vector<unsigned char>& vHeaderIn, int nVersionIn)
+    : nAlgo(nAlgoIn), nVersion(nVersionIn), vHeader(vHeaderIn)
+{
+    // The algos whose first function compresses blocks before the nonce
+    static const struct {
+        uint8_t nAlgo;
+        Midstate::First first;
+        uint256 (*tail)(const uint512& hashFirst);
+    } midstateAlgos[] = {
+        {ALGO_SKEIN,     Midstate::SKEIN512, HashSkeinTail},
+        {ALGO_SKUNKHASH, Midstate::SKEIN512, SkunkHash5Tail},
+        {ALGO_PHI1612,   Midstate::SKEIN512, Phi1612Tail},
+        {ALGO_TRIBUS,    Midstate::JH512,    TribusTail},
+        {ALGO_QUBIT,     Midstate::LUFFA512, HashQubitTail},
+    };
+
+    assert(vHeader.size() == 80);
+    for (const auto& algo : midstateAlgos) {
+        if (algo.nAlgo != nAlgo)
+            continue;
+        midstate.reset(new Midstate());
+        midstate->first = algo.first;
+        midstate->tail = algo.tail;
+        switch (algo.first) {
+            case Midstate::SKEIN512: Skein512Midstate(midstate->skein, vHeader.data()); break;
+            case Midstate::JH512: JH512Midstate(midstate->jh, vHeader.data()); break;
+            case Midstate::LUFFA512: Luffa512Midstate(midstate->luffa, vHeader.data()); break;
+        }
+    }
+}
+
+CNonceHasher::~CNonceHasher() {}
+
+uint256 CNonceHasher::GetHash(uint32_t nNonce)
+{
+    if (nAlgo == ALGO_X11) {
+        // The group of four nonces this one is in, so counting up hashes each group once
+        const uint32_t nFirst = nNonce & ~3u;
+        if (!fBatch || nBatchNonce != nFirst) {
+            unsigned char headers[4 * 80];
+            for (int i = 0; i < 4; i++) {
+                memcpy(headers + i * 80, vHeader.data(), 80);
+                WriteLE32(headers + i * 80 + HEADER_MIDSTATE_SIZE, nFirst + i);
+            }
+            CPoWHashTimer timer(nAlgo, 4);
+            HashX11_4way(headers, 80, batchHashes);
+            nBatchNonce = nFirst;
+            fBatch = true;
+        }
+        return batchHashes[nNonce - nFirst];
+    }
+
+    unsigned char* pnonce = vHeader.data() + HEADER_MIDSTATE_SIZE;
+    WriteLE32(pnonce, nNonce);
+    if (!midstate) {
+        CMultihasher hasher(SER_GETHASH, nVersion, nAlgo);
+        hasher.write((const char*)vHeader.data(), vHeader.size());
+        return hasher.GetHash();
+    }
+
+    CPoWHashTimer timer(nAlgo, 1);
+    uint512 hashFirst;
+    switch (midstate->first) {
+        case Midstate::SKEIN512: hashFirst = Skein512FromMidstate(midstate->skein, pnonce); break;
+        case Midstate::JH512: hashFirst = JH512FromMidstate(midstate->jh, pnonce); break;
+        case Midstate::LUFFA512: hashFirst = Luffa512FromMidstate(midstate->luffa, pnonce); break;
+    }
+    return midstate->tail(hashFirst);
+}
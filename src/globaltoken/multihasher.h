@@ -8,19 +8,26 @@
 #define GLOBALTOKEN_MULTIHASHER_H
 
 #include <globaltoken/powalgorithm.h>
+#include <prevector.h>
 #include <serialize.h>
 #include <version.h>
 #include <uint256.h>
 
+#include <stdint.h>
+
+#include <memory>
 #include <vector>
 
 static const int MULTIHASHER_YESCRYPT_R8_NEW = 0x40000000;
 
+/** Serialized size of the largest default header (Equihash 200,9 with solution), kept inline without heap allocation */
+static const unsigned int MULTIHASHER_INLINE_SIZE = 1487;
+
 /** A writer stream (for serialization) that computes a 256-bit hash, with selected algorithm. */
 class CMultihasher
 {
 private:
-    std::vector<unsigned char> buf;
+    prevector<MULTIHASHER_INLINE_SIZE, unsigned char> buf;
 
     const int nType;
     const int nVersion;
@@ -58,4 +65,97 @@ uint256 SerializeMultiAlgoHash(const T& obj, uint8_t nAlgo, int nType=SER_GETHAS
 
 int LoadMultiHasherVersionFlags(bool fHardfork3Activated);
 
+/** What the PoW hashes computed on a thread are for, the hashing stats are split by it */
+enum class HashPurpose : uint8_t {
+    OTHER,
+    HEADER_SYNC,    //!< headers and blocks received from peers
+    BLOCK_READ,     //!< blocks read back from disk with their PoW checked again
+    STARTUP_LOAD,   //!< loading and verifying the block index, reindex and -loadblock
+    MINING,         //!< generate and stratum
+    RPC,            //!< any other RPC call
+    COUNT
+};
+
+const char* GetHashPurposeName(HashPurpose purpose);
+
+/** The purpose the hashes on this thread are counted under, OTHER if no CHashPurposeScope is active */
+HashPurpose GetHashPurpose();
+
+/**
+ * Counts the PoW hashes computed on this thread while in scope under the
+ * given purpose. Scopes nest, the innermost one wins. Threads doing the work
+ * for another thread (e.g. the header check queue) have to set the purpose of
+ * that thread themselves.
+ */
+class CHashPurposeScope
+{
+private:
+    const HashPurpose prevPurpose;
+
+public:
+    explicit CHashPurposeScope(HashPurpose purpose);
+    ~CHashPurposeScope();
+};
+
+/** Number and cumulative time of the PoW hashes computed with one algo for one purpose */
+struct CHashingStats
+{
+    uint64_t nHashes;
+    uint64_t nNanos;
+};
+
+/** One in this many PoW hashes is timed, reading the clock for every hash would slow them down */
+static const uint64_t HASH_TIMING_SAMPLE_INTERVAL = 64;
+
+/**
+ * Counts nHashes PoW hashes of nAlgo computed while in scope under the
+ * purpose of this thread. Only the hashing that reaches the next multiple of
+ * HASH_TIMING_SAMPLE_INTERVAL in the count is timed, and its time is counted
+ * for the whole interval. nHashes must not exceed the interval.
+ */
+class CPoWHashTimer
+{
+private:
+    const uint8_t nAlgo;
+    const uint64_t nHashes;
+    const HashPurpose purpose;
+    uint64_t nStart;    //!< 0 if this hashing is not timed
+
+public:
+    CPoWHashTimer(uint8_t nAlgoIn, uint64_t nHashesIn);
+    ~CPoWHashTimer();
+};
+
+CHashingStats GetHashingStats(uint8_t nAlgo, HashPurpose purpose);
+
+/**
+ * Computes the PoW hashes of an 80 byte header for one nonce after the other,
+ * for mining. For the algos whose first function has a midstate (see
+ * multihash.h) it absorbs the header bytes before the nonce once. X11 hashes
+ * four nonces at once (HashX11_4way) and hands them out one by one. The
+ * others hash the whole header every time.
+ */
+class CNonceHasher
+{
+private:
+    struct Midstate;
+
+    const uint8_t nAlgo;
+    const int nVersion;
+    std::vector<unsigned char> vHeader;
+    //! nullptr if the algo has no midstate
+    std::unique_ptr<Midstate> midstate;
+    //! The hashes of the nonces from nBatchNonce on, X11 only
+    uint256 batchHashes[4];
+    uint32_t nBatchNonce = 0;
+    bool fBatch = false;
+
+public:
+    /** vHeaderIn is the header serialized for hashing, it must be 80 bytes */
+    CNonceHasher(uint8_t nAlgoIn, const std::vector<unsigned char>& vHeaderIn, int nVersionIn);
+    ~CNonceHasher();
+
+    uint256 GetHash(uint32_t nNonce);
+};
+
 #endif // GLOBALTOKEN_MULTIHASHER_H
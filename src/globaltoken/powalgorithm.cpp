@@ -5,267 +5,298 @@
 
 #include <globaltoken/powalgorithm.h>
 
+#include <crypto/algos/argon2/hashargon.h>
+#include <crypto/algos/allium/allium.h>
+#include <crypto/algos/blake/hashblake.h>
+#include <crypto/algos/hashlib/multihash.h>
+#include <crypto/algos/honeycomb/hash_honeycomb.h>
+#include <crypto/algos/Lyra2RE/Lyra2RE.h>
+#include <crypto/algos/Lyra2RE/Lyra2Z.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/algos/scrypt/scrypt.h>
+#include <crypto/algos/yescrypt/yescrypt.h>
+#include <crypto/algos/yespower/yespower.h>
+#include <globaltoken/multihasher.h>
+#include <hash.h>
+
+#include <algorithm>
+#include <assert.h>
 #include <sstream>
+#include <string.h>
+#include <utility>
 #include <vector>
-#include <algorithm>
+
+namespace {
+
+/** Algos that hash the input as it is */
+template <uint256 (*F)(const unsigned char*, const unsigned char*)>
+uint256 HashRange(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    return F(pbegin, pend);
+}
+
+/** Algos with a C implementation that hashes an 80 byte header */
+template <void (*F)(const char*, char*)>
+uint256 HashHeader(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 thash;
+    F((const char*)pbegin, (char*)thash.begin());
+    return thash;
+}
+
+uint256 HashSHA256D(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 result;
+    CHash256().Write(pbegin, pend - pbegin).Finalize(result.begin());
+    return result;
+}
+
+uint256 HashNeoscrypt(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    unsigned int profile = 0x0;
+    uint256 thash;
+    neoscrypt(pbegin, (unsigned char*)&thash, profile);
+    return thash;
+}
+
+uint256 HashTimeTravel10(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint32_t nTime;
+    memcpy(&nTime, pbegin + 68, 4);
+    return HashTimeTravel(pbegin, pend, nTime);
+}
+
+/** The hash of the previous block seeds the order of the X16R like algos */
+uint256 GetPrevBlockHash(const unsigned char* pbegin)
+{
+    uint256 hashPrevBlock;
+    memcpy(&hashPrevBlock, pbegin + 4, 32);
+    return hashPrevBlock;
+}
+
+uint256 HashX16RPrev(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    return HashX16R(pbegin, pend, GetPrevBlockHash(pbegin));
+}
+
+uint256 HashX16SPrev(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    return HashX16s(pbegin, pend, GetPrevBlockHash(pbegin));
+}
+
+uint256 HashX21SPrev(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    return HashX21S(pbegin, pend, GetPrevBlockHash(pbegin));
+}
+
+uint256 HashCPU23RPrev(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    return HashCPU23R(pbegin, pend, GetPrevBlockHash(pbegin));
+}
+
+uint256 HashX16RT(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint32_t nTime;
+    memcpy(&nTime, pbegin + 68, 4);
+    int32_t nTimeX16r = nTime & 0xffffff80;
+    uint256 hashTime = Hash(static_cast<char*>(static_cast<void*>(&nTimeX16r)), static_cast<char*>(static_cast<void*>(&nTimeX16r))+4);
+    return HashX16R(pbegin, pend, hashTime);
+}
+
+uint256 HashYescryptR8(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 thash;
+    if (nVersion & MULTIHASHER_YESCRYPT_R8_NEW)
+        yescrypt_r8_hash((const char*)pbegin, (char*)&thash);
+    else
+        yescrypt_hash((const char*)pbegin, (char*)&thash);
+    return thash;
+}
+
+uint256 HashYespower(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 thash;
+    yespower_hash((const char*)pbegin, (char*)&thash);
+    return thash;
+}
+
+uint256 HashArgon2d(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 salt, pepper, finalhash;
+    salt = GlobalHash(pbegin, pend);
+    pepper = HashX16R(pbegin, pend, salt);
+    Argon2dHash(pbegin, pend - pbegin, finalhash.begin(), 32, salt.begin(), 32, pepper.begin(), 32);
+    return finalhash;
+}
+
+uint256 HashArgon2i(const unsigned char* pbegin, const unsigned char* pend, int nVersion)
+{
+    uint256 salt, pepper, finalhash;
+    salt = GlobalHash(pbegin, pend);
+    pepper = HashCPU23R(pbegin, pend, salt);
+    Argon2iHash(pbegin, pend - pbegin, finalhash.begin(), 32, salt.begin(), 32, pepper.begin(), 32);
+    return finalhash;
+}
+
+typedef const unsigned char* CBytePtr;
+
+const size_t KiB = 1024;
+const size_t MiB = 1024 * KiB;
+
+/**
+ * One entry per algo, in the order of the algo IDs. The scratch sizes are
+ * those of the parameters the hashes are called with, e.g. 128 * N * r bytes
+ * for the scrypt family.
+ */
+constexpr CAlgoDescriptor algoDescriptors[] = {
+    // algo                  version bits                   name               hash                                          input  scratch    <HF2   Equihash personalization
+    {ALGO_SHA256D,           BLOCK_VERSION_SHA256D,         "sha256d",         HashSHA256D,                                  0,     0,          true,  nullptr},
+    {ALGO_SCRYPT,            BLOCK_VERSION_SCRYPT,          "scrypt",          HashHeader<scrypt_1024_1_1_256>,              80,    128 * KiB,  true,  nullptr},
+    {ALGO_X11,               BLOCK_VERSION_X11,             "x11",             HashRange<HashX11<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_NEOSCRYPT,         BLOCK_VERSION_NEOSCRYPT,       "neoscrypt",       HashNeoscrypt,                                80,    32 * KiB,   true,  nullptr},
+    {ALGO_EQUIHASH,          BLOCK_VERSION_EQUIHASH,        "equihash",        HashSHA256D,                                  0,     0,          true,  "ZcashPoW"},
+    {ALGO_YESCRYPT,          BLOCK_VERSION_YESCRYPT,        "yescrypt",        HashHeader<yescrypt_hash>,                    80,    2 * MiB,    true,  nullptr},
+    {ALGO_HMQ1725,           BLOCK_VERSION_HMQ1725,         "hmq1725",         HashRange<HMQ1725<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_XEVAN,             BLOCK_VERSION_XEVAN,           "xevan",           HashRange<XEVAN<CBytePtr>>,                   0,     0,          true,  nullptr},
+    {ALGO_NIST5,             BLOCK_VERSION_NIST5,           "nist5",           HashRange<NIST5<CBytePtr>>,                   0,     0,          true,  nullptr},
+    {ALGO_TIMETRAVEL10,      BLOCK_VERSION_TIMETRAVEL10,    "timetravel10",    HashTimeTravel10,                             80,    0,          true,  nullptr},
+    {ALGO_PAWELHASH,         BLOCK_VERSION_PAWELHASH,       "pawelhash",       HashRange<PawelHash<CBytePtr>>,               0,     0,          true,  nullptr},
+    {ALGO_X13,               BLOCK_VERSION_X13,             "x13",             HashRange<HashX13<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_X14,               BLOCK_VERSION_X14,             "x14",             HashRange<HashX14<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_X15,               BLOCK_VERSION_X15,             "x15",             HashRange<HashX15<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_X17,               BLOCK_VERSION_X17,             "x17",             HashRange<HashX17<CBytePtr>>,                 0,     0,          true,  nullptr},
+    {ALGO_LYRA2REV2,         BLOCK_VERSION_LYRA2REV2,       "lyra2rev2",       HashHeader<lyra2re2_hash>,                    80,    2 * KiB,    true,  nullptr},
+    {ALGO_BLAKE2S,           BLOCK_VERSION_BLAKE2S,         "blake2s",         HashRange<HashBlake2S<CBytePtr>>,             0,     0,          true,  nullptr},
+    {ALGO_BLAKE2B,           BLOCK_VERSION_BLAKE2B,         "blake2b",         HashRange<HashBlake2B<CBytePtr>>,             0,     0,          true,  nullptr},
+    {ALGO_ASTRALHASH,        BLOCK_VERSION_ASTRALHASH,      "astralhash",      HashRange<AstralHash<CBytePtr>>,              0,     0,          true,  nullptr},
+    {ALGO_PADIHASH,          BLOCK_VERSION_PADIHASH,        "padihash",        HashRange<PadiHash<CBytePtr>>,                0,     0,          true,  nullptr},
+    {ALGO_JEONGHASH,         BLOCK_VERSION_JEONGHASH,       "jeonghash",       HashRange<JeongHash<CBytePtr>>,               0,     0,          true,  nullptr},
+    {ALGO_KECCAKC,           BLOCK_VERSION_KECCAKC,         "keccakc",         HashRange<HashKeccakC<CBytePtr>>,             0,     0,          true,  nullptr},
+    {ALGO_ZHASH,             BLOCK_VERSION_ZHASH,           "zhash",           HashSHA256D,                                  0,     0,          true,  "GLTZhash"},
+    {ALGO_GLOBALHASH,        BLOCK_VERSION_GLOBALHASH,      "globalhash",      HashRange<GlobalHash<CBytePtr>>,              0,     0,          true,  nullptr},
+    {ALGO_SKEIN,             BLOCK_VERSION_SKEIN,           "skein",           HashRange<HashSkein<CBytePtr>>,               0,     0,          true,  nullptr},
+    {ALGO_GROESTL,           BLOCK_VERSION_GROESTL,         "groestl",         HashRange<HashGroestl<CBytePtr>>,             0,     0,          true,  nullptr},
+    {ALGO_QUBIT,             BLOCK_VERSION_QUBIT,           "qubit",           HashRange<HashQubit<CBytePtr>>,               0,     0,          true,  nullptr},
+    {ALGO_SKUNKHASH,         BLOCK_VERSION_SKUNKHASH,       "skunkhash",       HashRange<SkunkHash5<CBytePtr>>,              0,     0,          true,  nullptr},
+    {ALGO_QUARK,             BLOCK_VERSION_QUARK,           "quark",           HashRange<QUARK<CBytePtr>>,                   0,     0,          true,  nullptr},
+    {ALGO_X16R,              BLOCK_VERSION_X16R,            "x16r",            HashX16RPrev,                                 80,    0,          true,  nullptr},
+    {ALGO_LYRA2REV3,         BLOCK_VERSION_LYRA2REV3,       "lyra2rev3",       HashHeader<lyra2re3_hash>,                    80,    2 * KiB,    false, nullptr},
+    {ALGO_YESCRYPT_R16V2,    BLOCK_VERSION_YESCRYPT_R16V2,  "yescryptr16v2",   HashHeader<yescrypt_r16v2_hash>,              80,    8 * MiB,    false, nullptr},
+    {ALGO_YESCRYPT_R24,      BLOCK_VERSION_YESCRYPT_R24,    "yescryptr24",     HashHeader<yescrypt_r24_hash>,                80,    12 * MiB,   false, nullptr},
+    {ALGO_YESCRYPT_R8,       BLOCK_VERSION_YESCRYPT_R8,     "yescryptr8",      HashYescryptR8,                               80,    8 * MiB,    false, nullptr},
+    {ALGO_YESCRYPT_R32,      BLOCK_VERSION_YESCRYPT_R32,    "yescryptr32",     HashHeader<yescrypt_r32_hash>,                80,    16 * MiB,   false, nullptr},
+    {ALGO_X25X,              BLOCK_VERSION_X25X,            "x25x",            HashRange<HashX25X<CBytePtr>>,                0,     0,          false, nullptr},
+    {ALGO_ARGON2D,           BLOCK_VERSION_ARGON2D,         "argon2d",         HashArgon2d,                                  0,     384 * KiB,  false, nullptr},
+    {ALGO_ARGON2I,           BLOCK_VERSION_ARGON2I,         "argon2i",         HashArgon2i,                                  0,     128 * KiB,  false, nullptr},
+    {ALGO_CPU23R,            BLOCK_VERSION_CPU23R,          "cpu23r",          HashCPU23RPrev,                               80,    0,          false, nullptr},
+    {ALGO_YESPOWER,          BLOCK_VERSION_YESPOWER,        "yespower",        HashYespower,                                 80,    8 * MiB,    false, nullptr},
+    {ALGO_X21S,              BLOCK_VERSION_X21S,            "x21s",            HashX21SPrev,                                 80,    0,          false, nullptr},
+    {ALGO_X16S,              BLOCK_VERSION_X16S,            "x16s",            HashX16SPrev,                                 80,    0,          false, nullptr},
+    {ALGO_X22I,              BLOCK_VERSION_X22I,            "x22i",            HashRange<HashX22I<CBytePtr>>,                0,     0,          false, nullptr},
+    {ALGO_LYRA2Z,            BLOCK_VERSION_LYRA2Z,          "lyra2z",          HashHeader<lyra2z_hash>,                      80,    6 * KiB,    false, nullptr},
+    {ALGO_HONEYCOMB,         BLOCK_VERSION_HONEYCOMB,       "honeycomb",       HashRange<HashHoneyComb<CBytePtr>>,           0,     0,          false, nullptr},
+    {ALGO_EH192,             BLOCK_VERSION_EH192,           "equihash192",     HashSHA256D,                                  0,     0,          false, "GLTEh192"},
+    {ALGO_MARS,              BLOCK_VERSION_MARS,            "mars",            HashSHA256D,                                  0,     0,          false, "GLT-Mars"},
+    {ALGO_X12,               BLOCK_VERSION_X12,             "x12",             HashRange<HashX12<CBytePtr>>,                 0,     0,          false, nullptr},
+    {ALGO_HEX,               BLOCK_VERSION_HEX,             "hex",             HashRange<HashHEX<unsigned char>>,            0,     0,          false, nullptr},
+    {ALGO_DEDAL,             BLOCK_VERSION_DEDAL,           "dedal",           HashRange<HashDedal<unsigned char>>,          0,     0,          false, nullptr},
+    {ALGO_C11,               BLOCK_VERSION_C11,             "c11",             HashRange<HashC11<CBytePtr>>,                 0,     0,          false, nullptr},
+    {ALGO_PHI1612,           BLOCK_VERSION_PHI1612,         "phi1612",         HashRange<Phi1612<CBytePtr>>,                 0,     0,          false, nullptr},
+    {ALGO_PHI2,              BLOCK_VERSION_PHI2,            "phi2",            HashRange<PHI2<CBytePtr>>,                    0,     0,          false, nullptr},
+    {ALGO_X16RT,             BLOCK_VERSION_X16RT,           "x16rt",           HashX16RT,                                    80,    0,          false, nullptr},
+    {ALGO_TRIBUS,            BLOCK_VERSION_TRIBUS,          "tribus",          HashRange<Tribus<CBytePtr>>,                  0,     0,          false, nullptr},
+    {ALGO_ALLIUM,            BLOCK_VERSION_ALLIUM,          "allium",          HashHeader<allium_hash>,                      80,    6 * KiB,    false, nullptr},
+    {ALGO_ARCTICHASH,        BLOCK_VERSION_ARCTICHASH,      "arctichash",      HashRange<ArcticHash<CBytePtr>>,              0,     0,          false, nullptr},
+    {ALGO_DESERTHASH,        BLOCK_VERSION_DESERTHASH,      "deserthash",      HashRange<DesertHash<CBytePtr>>,              0,     0,          false, nullptr},
+    {ALGO_CRYPTOANDCOFFEE,   BLOCK_VERSION_CRYPTOANDCOFFEE, "cryptoandcoffee", HashRange<cryptoandcoffee_hash<CBytePtr>>,    0,     0,          false, nullptr},
+    {ALGO_RICKHASH,          BLOCK_VERSION_RICKHASH,        "rickhash",        HashRange<RickHash<CBytePtr>>,                0,     0,          false, nullptr},
+};
+
+static_assert(sizeof(algoDescriptors) / sizeof(algoDescriptors[0]) == NUM_ALGOS_IMPL, "every algo needs a descriptor");
+
+/** Whether the descriptors from nIndex on are at the index of their algo, with the version bits of it */
+constexpr bool CheckAlgoDescriptors(size_t nIndex)
+{
+    return nIndex == NUM_ALGOS_IMPL ||
+        (algoDescriptors[nIndex].nAlgo == nIndex &&
+         algoDescriptors[nIndex].nVersionBits == (int)((nIndex + 1) << 9) &&
+         CheckAlgoDescriptors(nIndex + 1));
+}
+
+static_assert(CheckAlgoDescriptors(0), "algo descriptors must be in the order of the algo IDs");
+
+/** Names GetAlgoByName accepts besides the ones of the descriptors */
+const std::pair<const char*, uint8_t> algoAliases[] = {
+    {"sha", ALGO_SHA256D},
+    {"sha256", ALGO_SHA256D},
+    {"zcash", ALGO_EQUIHASH},
+    {"equihash200", ALGO_EQUIHASH},
+    {"equihash2009", ALGO_EQUIHASH},
+    {"equihash200.9", ALGO_EQUIHASH},
+    {"timetravel", ALGO_TIMETRAVEL10},
+    {"lyra", ALGO_LYRA2REV2},
+    {"lyra2re", ALGO_LYRA2REV2},
+    {"lyra2", ALGO_LYRA2REV2},
+    {"sia", ALGO_BLAKE2B},
+    {"keccak", ALGO_KECCAKC},
+    {"sha3-keccak", ALGO_KECCAKC},
+    {"sha3keccak", ALGO_KECCAKC},
+    {"equihash144", ALGO_ZHASH},
+    {"equihash1445", ALGO_ZHASH},
+    {"equihash144_5", ALGO_ZHASH},
+    {"equihash144.5", ALGO_ZHASH},
+    {"groestlsha2", ALGO_GROESTL},
+    {"skeinsha2", ALGO_SKEIN},
+    {"q2c", ALGO_QUBIT},
+    {"skunk", ALGO_SKUNKHASH},
+    {"equihash1927", ALGO_EH192},
+    {"equihash192.7", ALGO_EH192},
+    {"equihash192_7", ALGO_EH192},
+    {"equihash96", ALGO_MARS},
+    {"equihash965", ALGO_MARS},
+    {"equihash96_5", ALGO_MARS},
+    {"equihash96.5", ALGO_MARS},
+    {"phi1", ALGO_PHI1612},
+    {"phi", ALGO_PHI1612},
+};
+
+} // namespace
+
+const CAlgoDescriptor& GetAlgoDescriptor(uint8_t nAlgo)
+{
+    assert(nAlgo < NUM_ALGOS_IMPL);
+    return algoDescriptors[nAlgo];
+}
+
+uint8_t GetAlgoByVersion(int nVersion)
+{
+    const int nIndex = ((nVersion & BLOCK_VERSION_ALGO) >> 9) - 1;
+    if (nIndex < 0 || nIndex >= NUM_ALGOS_IMPL)
+        return ALGO_SHA256D;
+    return nIndex;
+}
 
 std::string GetAlgoName(uint8_t Algo)
 {
-    switch (Algo)
-    {
-        case ALGO_SHA256D:
-            return std::string("sha256d");
-        case ALGO_SCRYPT:
-            return std::string("scrypt");
-        case ALGO_X11:
-            return std::string("x11");
-        case ALGO_NEOSCRYPT:
-            return std::string("neoscrypt");
-        case ALGO_YESCRYPT:
-            return std::string("yescrypt");
-        case ALGO_EQUIHASH:
-            return std::string("equihash");
-        case ALGO_HMQ1725:
-            return std::string("hmq1725");
-        case ALGO_XEVAN:
-            return std::string("xevan");
-        case ALGO_NIST5:
-            return std::string("nist5");
-        case ALGO_TIMETRAVEL10:
-            return std::string("timetravel10");
-        case ALGO_PAWELHASH:
-            return std::string("pawelhash");
-        case ALGO_X13:
-            return std::string("x13");
-        case ALGO_X14:
-            return std::string("x14");
-        case ALGO_X15:
-            return std::string("x15");
-        case ALGO_X17:
-            return std::string("x17");
-        case ALGO_LYRA2REV2:
-            return std::string("lyra2rev2");
-        case ALGO_BLAKE2S:
-            return std::string("blake2s");
-        case ALGO_BLAKE2B:
-            return std::string("blake2b");
-        case ALGO_ASTRALHASH:
-            return std::string("astralhash");
-        case ALGO_PADIHASH:
-            return std::string("padihash");
-        case ALGO_JEONGHASH:
-            return std::string("jeonghash");
-        case ALGO_KECCAKC:
-            return std::string("keccakc");
-        case ALGO_ZHASH:
-            return std::string("zhash");
-        case ALGO_GLOBALHASH:
-            return std::string("globalhash");
-        case ALGO_SKEIN:
-            return std::string("skein");
-        case ALGO_GROESTL:
-            return std::string("groestl");
-        case ALGO_QUBIT:
-            return std::string("qubit");
-        case ALGO_SKUNKHASH:
-            return std::string("skunkhash");
-        case ALGO_QUARK:
-            return std::string("quark");
-        case ALGO_X16R:
-            return std::string("x16r");
-        case ALGO_LYRA2REV3:
-            return std::string("lyra2rev3");
-        case ALGO_YESCRYPT_R16V2:
-            return std::string("yescryptr16v2");
-        case ALGO_YESCRYPT_R24:
-            return std::string("yescryptr24");
-        case ALGO_YESCRYPT_R8:
-            return std::string("yescryptr8");
-        case ALGO_YESCRYPT_R32:
-            return std::string("yescryptr32");
-        case ALGO_X25X:
-            return std::string("x25x");
-        case ALGO_ARGON2D:
-            return std::string("argon2d");
-        case ALGO_ARGON2I:
-            return std::string("argon2i");
-        case ALGO_CPU23R:
-            return std::string("cpu23r");
-        case ALGO_YESPOWER:
-            return std::string("yespower");
-        case ALGO_X21S:
-            return std::string("x21s");
-        case ALGO_X16S:
-            return std::string("x16s");
-        case ALGO_X22I:
-            return std::string("x22i");
-        case ALGO_LYRA2Z:
-            return std::string("lyra2z");
-        case ALGO_HONEYCOMB:
-            return std::string("honeycomb");
-        case ALGO_EH192:
-            return std::string("equihash192");
-        case ALGO_MARS:
-            return std::string("mars");
-        case ALGO_X12:
-            return std::string("x12");
-        case ALGO_HEX:
-            return std::string("hex");
-        case ALGO_DEDAL:
-            return std::string("dedal");
-        case ALGO_C11:
-            return std::string("c11");
-        case ALGO_PHI1612:
-            return std::string("phi1612");
-        case ALGO_PHI2:
-            return std::string("phi2");
-        case ALGO_X16RT:
-            return std::string("x16rt");
-        case ALGO_TRIBUS:
-            return std::string("tribus");
-        case ALGO_ALLIUM:
-            return std::string("allium");
-        case ALGO_ARCTICHASH:
-            return std::string("arctichash");
-        case ALGO_DESERTHASH:
-            return std::string("deserthash");
-        case ALGO_CRYPTOANDCOFFEE:
-            return std::string("cryptoandcoffee");
-        case ALGO_RICKHASH:
-            return std::string("rickhash");
-    }
-    return std::string("unknown");       
+    if (Algo >= NUM_ALGOS_IMPL)
+        return std::string("unknown");
+    return std::string(algoDescriptors[Algo].pszName);
 }
 
 uint8_t GetAlgoByName(std::string strAlgo, uint8_t fallback, bool &fAlgoFound)
 {
     transform(strAlgo.begin(),strAlgo.end(),strAlgo.begin(),::tolower);
     fAlgoFound = true;
-    if (strAlgo == "sha" || strAlgo == "sha256" || strAlgo == "sha256d")
-        return ALGO_SHA256D;
-    else if (strAlgo == "scrypt")
-        return ALGO_SCRYPT;
-    else if (strAlgo == "neoscrypt")
-        return ALGO_NEOSCRYPT;
-    else if (strAlgo == "equihash" || strAlgo == "zcash" || strAlgo == "equihash200" || strAlgo == "equihash2009" || strAlgo == "equihash200.9")
-        return ALGO_EQUIHASH;
-    else if (strAlgo == "yescrypt")
-        return ALGO_YESCRYPT;
-    else if (strAlgo == "hmq1725")
-        return ALGO_HMQ1725;
-    else if (strAlgo == "xevan")
-        return ALGO_XEVAN;
-    else if (strAlgo == "nist5")
-        return ALGO_NIST5;
-    else if (strAlgo == "timetravel" || strAlgo == "timetravel10")
-        return ALGO_TIMETRAVEL10;
-    else if (strAlgo == "pawelhash")
-        return ALGO_PAWELHASH;
-    else if (strAlgo == "x11")
-        return ALGO_X11;
-    else if (strAlgo == "x13")
-        return ALGO_X13;
-    else if (strAlgo == "x14")
-        return ALGO_X14;
-    else if (strAlgo == "x15")
-        return ALGO_X15;
-    else if (strAlgo == "x16r")
-        return ALGO_X16R;
-    else if (strAlgo == "x17")
-        return ALGO_X17;
-    else if (strAlgo == "lyra" || strAlgo == "lyra2re" || strAlgo == "lyra2" || strAlgo == "lyra2rev2")
-        return ALGO_LYRA2REV2;
-    else if (strAlgo == "blake2s")
-        return ALGO_BLAKE2S;
-    else if (strAlgo == "blake2b" || strAlgo == "sia")
-        return ALGO_BLAKE2B;
-    else if (strAlgo == "astralhash")
-        return ALGO_ASTRALHASH;
-    else if (strAlgo == "padihash")
-        return ALGO_PADIHASH;
-    else if (strAlgo == "jeonghash")
-        return ALGO_JEONGHASH;
-    else if (strAlgo == "keccak" || strAlgo == "keccakc" || strAlgo == "sha3-keccak" || strAlgo == "sha3keccak")
-        return ALGO_KECCAKC;
-    else if (strAlgo == "zhash" || strAlgo == "equihash144" || strAlgo == "equihash1445" || strAlgo == "equihash144_5" || strAlgo == "equihash144.5")
-        return ALGO_ZHASH;
-    else if (strAlgo == "globalhash")
-        return ALGO_GLOBALHASH;
-    else if (strAlgo == "groestl" || strAlgo == "groestlsha2")
-        return ALGO_GROESTL;
-    else if (strAlgo == "skein" || strAlgo == "skeinsha2")
-        return ALGO_SKEIN;
-    else if (strAlgo == "q2c" || strAlgo == "qubit")
-        return ALGO_QUBIT;
-    else if (strAlgo == "skunk" || strAlgo == "skunkhash")
-        return ALGO_SKUNKHASH;
-    else if (strAlgo == "quark")
-        return ALGO_QUARK;
-    else if (strAlgo == "lyra2rev3")
-        return ALGO_LYRA2REV3;
-    else if (strAlgo == "yescryptr16v2")
-        return ALGO_YESCRYPT_R16V2;
-    else if (strAlgo == "yescryptr24")
-        return ALGO_YESCRYPT_R24;
-    else if (strAlgo == "yescryptr8")
-        return ALGO_YESCRYPT_R8;
-    else if (strAlgo == "yescryptr32")
-        return ALGO_YESCRYPT_R32;
-    else if (strAlgo == "x25x")
-        return ALGO_X25X;
-    else if (strAlgo == "argon2d")
-        return ALGO_ARGON2D;
-    else if (strAlgo == "argon2i")
-        return ALGO_ARGON2I;
-    else if (strAlgo == "cpu23r")
-        return ALGO_CPU23R;
-    else if (strAlgo == "yespower")
-        return ALGO_YESPOWER;
-    else if (strAlgo == "x21s")
-        return ALGO_X21S;
-    else if (strAlgo == "x16s")
-        return ALGO_X16S;
-    else if (strAlgo == "x22i")
-        return ALGO_X22I;
-    else if (strAlgo == "lyra2z")
-        return ALGO_LYRA2Z;
-    else if (strAlgo == "honeycomb")
-        return ALGO_HONEYCOMB;
-    else if (strAlgo == "equihash192" || strAlgo == "equihash1927" || strAlgo == "equihash192.7" || strAlgo == "equihash192_7")
-        return ALGO_EH192;
-    else if (strAlgo == "mars" || strAlgo == "equihash96" || strAlgo == "equihash965" || strAlgo == "equihash96_5" || strAlgo == "equihash96.5")
-        return ALGO_MARS;
-    else if (strAlgo == "x12")
-        return ALGO_X12;
-    else if (strAlgo == "hex")
-        return ALGO_HEX;
-    else if (strAlgo == "dedal")
-        return ALGO_DEDAL;
-    else if (strAlgo == "c11")
-        return ALGO_C11;
-    else if (strAlgo == "phi1612" || strAlgo == "phi1" || strAlgo == "phi")
-        return ALGO_PHI1612;
-    else if (strAlgo == "phi2")
-        return ALGO_PHI2;
-    else if (strAlgo == "x16rt")
-        return ALGO_X16RT;
-    else if (strAlgo == "tribus")
-        return ALGO_TRIBUS;
-    else if (strAlgo == "allium")
-        return ALGO_ALLIUM;
-    else if (strAlgo == "arctichash")
-        return ALGO_ARCTICHASH;
-    else if (strAlgo == "deserthash")
-        return ALGO_DESERTHASH;
-    else if (strAlgo == "cryptoandcoffee")
-        return ALGO_CRYPTOANDCOFFEE;
-    else if (strAlgo == "rickhash")
-        return ALGO_RICKHASH;
-    else
-    {
-        fAlgoFound = false;
-        return fallback;
+    for (const CAlgoDescriptor& algo : algoDescriptors) {
+        if (strAlgo == algo.pszName)
+            return algo.nAlgo;
     }
+    for (const auto& alias : algoAliases) {
+        if (strAlgo == alias.first)
+            return alias.second;
+    }
+    fAlgoFound = false;
+    return fallback;
 }
 
 std::string GetAlgoRangeString()
@@ -292,28 +323,16 @@ std::string GetAlgoRangeString()
 
 bool IsAlgoAllowedBeforeHF2(uint8_t nAlgo)
 {
-    // Hardfork 1 starts with algo sha256 and ends with last algo id x16r
-    return (nAlgo <= ALGO_X16R);
+    return nAlgo < NUM_ALGOS_IMPL && algoDescriptors[nAlgo].fBeforeHF2;
 }
 
 bool IsEquihashBasedAlgo(uint8_t nAlgo)
 {
-    return (nAlgo == ALGO_EQUIHASH || nAlgo == ALGO_ZHASH || nAlgo == ALGO_EH192 || nAlgo == ALGO_MARS);
+    return nAlgo < NUM_ALGOS_IMPL && algoDescriptors[nAlgo].pszEquihashPersonalize != nullptr;
 }
 
 std::string GetEquihashBasedDefaultPersonalize(uint8_t nAlgo)
 {
     assert(IsEquihashBasedAlgo(nAlgo));
-    switch(nAlgo)
-    {
-        case ALGO_EQUIHASH:
-            return std::string("ZcashPoW");
-        case ALGO_ZHASH:
-            return std::string("GLTZhash");
-        case ALGO_EH192:
-            return std::string("GLTEh192");
-        case ALGO_MARS:
-            return std::string("GLT-Mars");
-    }
-    return std::string("Unknown!"); // should not happen
-}
\ No newline at end of file
+    return std::string(algoDescriptors[nAlgo].pszEquihashPersonalize);
+}
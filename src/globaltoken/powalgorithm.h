@@ -9,6 +9,8 @@
 #include <arith_uint256.h>
 #include <uint256.h>
 
+#include <stddef.h>
+#include <string>
 
 /** Algos */
 enum : uint8_t { 
@@ -141,6 +143,38 @@ enum {
 const int NUM_ALGOS_OLD = 30;
 const int NUM_ALGOS = 60;
 
+/** Computes the PoW hash of a serialized header, nVersion carries the multihasher version flags */
+typedef uint256 (*AlgoHashFunction)(const unsigned char* pbegin, const unsigned char* pend, int nVersion);
+
+/**
+ * What there is to know about an algo regardless of the chain. All of them
+ * are in one table in powalgorithm.cpp, indexed by algo ID, which the block
+ * version, name and PoW hash lookups use instead of switching over the IDs.
+ * Code that handles every algo can iterate over it the same way.
+ */
+struct CAlgoDescriptor
+{
+    uint8_t nAlgo;
+    //! The BLOCK_VERSION_* bits that select this algo
+    int nVersionBits;
+    //! As GetAlgoName returns it
+    const char* pszName;
+    AlgoHashFunction hash;
+    //! Size of the input the hash requires, 0 if it hashes any size
+    unsigned int nInputSize;
+    //! About how much memory one hash uses, 0 if it is not memory hard
+    size_t nScratchBytes;
+    //! Whether blocks of it are valid before Hardfork 2
+    bool fBeforeHF2;
+    //! Default Equihash personalization, nullptr if the algo is not based on Equihash
+    const char* pszEquihashPersonalize;
+};
+
+/** The descriptor of an algo, nAlgo must be below NUM_ALGOS_IMPL */
+const CAlgoDescriptor& GetAlgoDescriptor(uint8_t nAlgo);
+/** The algo the BLOCK_VERSION_* bits of a block version select, ALGO_SHA256D if none */
+uint8_t GetAlgoByVersion(int nVersion);
+
 std::string GetAlgoName(uint8_t Algo);
 uint8_t GetAlgoByName(std::string strAlgo, uint8_t fallback, bool &fAlgoFound);
 std::string GetAlgoRangeString();
@@ -3,14 +3,23 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <globaltoken/treasury.h>
+#include <core_memusage.h>
 #include <uint256.h>
 #include <hash.h>
+#include <memusage.h>
 #include <script/script.h>
 
+#include <algorithm>
+
 #include <boost/filesystem.hpp>
 
 CTreasuryMempool activeTreasury;
 
+size_t TreasuryScriptHasher::operator()(const CScript& script) const
+{
+    return Hash(script.begin(), script.end()).GetCheapHash();
+}
+
 bool CTreasuryProposal::IsNull() const
 {
     return (*this == CTreasuryProposal());
@@ -104,6 +113,8 @@ uint256 CTreasuryProposal::GetHash() const
 void CTreasuryMempool::SetTreasuryFilePath (const std::string &path)
 {
     filePath = boost::filesystem::path(path);
+    // a new file doesn't have anything of this mempool yet
+    ClearPersisted();
 }
 
 boost::filesystem::path CTreasuryMempool::GetTreasuryFilePath () const
@@ -136,23 +147,70 @@ uint32_t CTreasuryMempool::GetLastSaved() const
     return nLastSaved;
 }
 
+static size_t StringMemoryUsage(const std::string& str)
+{
+    // short strings are stored in the string object itself
+    return str.capacity() > 15 ? memusage::MallocUsage(str.capacity() + 1) : 0;
+}
+
+size_t CTreasuryMempool::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vTreasuryProposals) + memusage::DynamicUsage(vRedeemScripts);
+    for (const CTreasuryProposal& proposal : vTreasuryProposals) {
+        nUsage += StringMemoryUsage(proposal.strHeadline) + StringMemoryUsage(proposal.strDescription);
+        nUsage += RecursiveDynamicUsage(proposal.mtx);
+    }
+    for (const CScript& script : vRedeemScripts) {
+        nUsage += RecursiveDynamicUsage(script);
+    }
+    nUsage += RecursiveDynamicUsage(scriptChangeAddress);
+    nUsage += memusage::DynamicUsage(mapProposalIndex);
+    nUsage += memusage::DynamicUsage(mapScriptIndex);
+    for (const auto& entry : mapScriptIndex) {
+        nUsage += RecursiveDynamicUsage(entry.first);
+    }
+    nUsage += memusage::DynamicUsage(mapPersistedProposals);
+    return nUsage;
+}
+
 uint256 CTreasuryMempool::GetHash() const
 {
     return SerializeHash(*this);
 }
 
-void CTreasuryMempool::DeleteExpiredProposals(const uint32_t nSystemTime)
+void CTreasuryMempool::RebuildProposalIndex()
 {
-    for(size_t i = vTreasuryProposals.size(); i > 0; i--)
+    mapProposalIndex.clear();
+    mapProposalIndex.reserve(vTreasuryProposals.size());
+    for(size_t i = 0; i < vTreasuryProposals.size(); i++)
     {
-        size_t index = i - 1;
-        if(vTreasuryProposals[index].IsExpired(nSystemTime))
-        {
-            vTreasuryProposals.erase(vTreasuryProposals.begin() + index);
-        }
+        // keep the first one on duplicates, like the old linear search did
+        mapProposalIndex.emplace(vTreasuryProposals[i].hashID, i);
     }
 }
 
+void CTreasuryMempool::RebuildScriptIndex()
+{
+    mapScriptIndex.clear();
+    mapScriptIndex.reserve(vRedeemScripts.size());
+    for(size_t i = 0; i < vRedeemScripts.size(); i++)
+    {
+        mapScriptIndex.emplace(vRedeemScripts[i], i);
+    }
+}
+
+void CTreasuryMempool::DeleteExpiredProposals(const uint32_t nSystemTime)
+{
+    auto itFirstExpired = std::remove_if(vTreasuryProposals.begin(), vTreasuryProposals.end(), [nSystemTime](const CTreasuryProposal& proposal) {
+        return proposal.IsExpired(nSystemTime);
+    });
+    if(itFirstExpired == vTreasuryProposals.end())
+        return;
+    
+    vTreasuryProposals.erase(itFirstExpired, vTreasuryProposals.end());
+    RebuildProposalIndex();
+}
+
 void CTreasuryMempool::InsertDummyInputs()
 {
     for(size_t i = 0; i < vTreasuryProposals.size(); i++)
@@ -169,17 +227,23 @@ void CTreasuryMempool::RemoveDummyInputs()
     }
 }
 
+bool CTreasuryMempool::AddScript(const CScript &script)
+{
+    if(!mapScriptIndex.emplace(script, vRedeemScripts.size()).second)
+        return false; // Already exists
+    
+    vRedeemScripts.push_back(script);
+    return true;
+}
+
 bool CTreasuryMempool::SearchScriptByScript(const CScript &script, size_t &nIndex) const
 {
-    for(size_t i = 0; i < vRedeemScripts.size(); i++)
-    {
-        if(vRedeemScripts[i] == script)
-        {
-            nIndex = i;
-            return true;
-        }
-    }
-    return false;
+    auto it = mapScriptIndex.find(script);
+    if(it == mapScriptIndex.end())
+        return false;
+    
+    nIndex = it->second;
+    return true;
 }
 
 bool CTreasuryMempool::RemoveScriptByID(const size_t nIndex)
@@ -188,18 +252,165 @@ bool CTreasuryMempool::RemoveScriptByID(const size_t nIndex)
         return false;
     
     vRedeemScripts.erase(vRedeemScripts.begin() + nIndex);
+    // every script behind the removed one moved down by one
+    RebuildScriptIndex();
+    return true;
+}
+
+void CTreasuryMempool::ClearScripts()
+{
+    vRedeemScripts.clear();
+    mapScriptIndex.clear();
+}
+
+bool CTreasuryMempool::AddProposal(const CTreasuryProposal& proposal)
+{
+    if(!mapProposalIndex.emplace(proposal.hashID, vTreasuryProposals.size()).second)
+        return false; // Already exists
+    
+    vTreasuryProposals.push_back(proposal);
     return true;
 }
 
 bool CTreasuryMempool::GetProposalvID(const uint256& hash, size_t& nIndex) const
 {
-    for(size_t i = 0; i < activeTreasury.vTreasuryProposals.size(); i++)
+    auto it = mapProposalIndex.find(hash);
+    if(it == mapProposalIndex.end())
+        return false;
+    
+    nIndex = it->second;
+    return true;
+}
+
+void CTreasuryMempool::ClearProposals()
+{
+    vTreasuryProposals.clear();
+    mapProposalIndex.clear();
+}
+
+boost::filesystem::path CTreasuryMempool::GetJournalFilePath() const
+{
+    return boost::filesystem::path(filePath.string() + ".journal");
+}
+
+bool CTreasuryMempool::HasSnapshot() const
+{
+    return !hashSnapshot.IsNull();
+}
+
+uint256 CTreasuryMempool::GetSnapshotHash() const
+{
+    return hashSnapshot;
+}
+
+uint64_t CTreasuryMempool::GetSnapshotSize() const
+{
+    return nSnapshotSize;
+}
+
+uint64_t CTreasuryMempool::GetJournalSize() const
+{
+    return nJournalSize;
+}
+
+uint256 CTreasuryMempool::GetScriptsHash() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << vRedeemScripts << scriptChangeAddress;
+    return ss.GetHash();
+}
+
+void CTreasuryMempool::SetPersisted(const uint256& hashSnapshotIn, const uint64_t nSnapshotSizeIn, const uint64_t nJournalSizeIn)
+{
+    hashSnapshot = hashSnapshotIn;
+    nSnapshotSize = nSnapshotSizeIn;
+    nJournalSize = nJournalSizeIn;
+    
+    mapPersistedProposals.clear();
+    mapPersistedProposals.reserve(vTreasuryProposals.size());
+    for(const CTreasuryProposal& proposal : vTreasuryProposals)
+    {
+        mapPersistedProposals[proposal.hashID] = proposal.GetHash();
+    }
+    hashPersistedScripts = GetScriptsHash();
+}
+
+void CTreasuryMempool::ClearPersisted()
+{
+    hashSnapshot.SetNull();
+    nSnapshotSize = 0;
+    nJournalSize = 0;
+    mapPersistedProposals.clear();
+    hashPersistedScripts.SetNull();
+}
+
+void CTreasuryMempool::GetUnpersistedChanges(std::vector<CTreasuryJournalEntry>& vEntries) const
+{
+    for(const CTreasuryProposal& proposal : vTreasuryProposals)
+    {
+        auto it = mapPersistedProposals.find(proposal.hashID);
+        if(it != mapPersistedProposals.end() && it->second == proposal.GetHash())
+            continue;
+        
+        CTreasuryJournalEntry entry;
+        entry.nType = CTreasuryJournalEntry::PROPOSAL;
+        entry.proposal = proposal;
+        // same as in the treasury file, a tx without inputs would not deserialize
+        entry.proposal.InsertTxDummyInputIfNeeded();
+        vEntries.push_back(std::move(entry));
+    }
+    
+    for(const auto& persisted : mapPersistedProposals)
     {
-        if(activeTreasury.vTreasuryProposals[i].hashID == hash)
+        if(mapProposalIndex.count(persisted.first))
+            continue;
+        
+        CTreasuryJournalEntry entry;
+        entry.nType = CTreasuryJournalEntry::ERASE_PROPOSAL;
+        entry.hashID = persisted.first;
+        vEntries.push_back(std::move(entry));
+    }
+    
+    if(GetScriptsHash() != hashPersistedScripts)
+    {
+        CTreasuryJournalEntry entry;
+        entry.nType = CTreasuryJournalEntry::SCRIPTS;
+        entry.vRedeemScripts = vRedeemScripts;
+        entry.scriptChangeAddress = scriptChangeAddress;
+        vEntries.push_back(std::move(entry));
+    }
+}
+
+bool CTreasuryMempool::ApplyJournalEntry(const CTreasuryJournalEntry& entry)
+{
+    size_t nIndex = 0;
+    switch(entry.nType)
+    {
+        case CTreasuryJournalEntry::PROPOSAL:
         {
-            nIndex = i;
+            CTreasuryProposal proposal = entry.proposal;
+            proposal.RemoveTxDummyInputIfNeeded();
+            if(GetProposalvID(proposal.hashID, nIndex))
+                vTreasuryProposals[nIndex] = proposal;
+            else
+                AddProposal(proposal);
             return true;
         }
+        case CTreasuryJournalEntry::ERASE_PROPOSAL:
+            if(GetProposalvID(entry.hashID, nIndex))
+            {
+                vTreasuryProposals.erase(vTreasuryProposals.begin() + nIndex);
+                RebuildProposalIndex();
+            }
+            return true;
+        case CTreasuryJournalEntry::SCRIPTS:
+            vRedeemScripts = entry.vRedeemScripts;
+            scriptChangeAddress = entry.scriptChangeAddress;
+            RebuildScriptIndex();
+            return true;
+        case CTreasuryJournalEntry::COMMIT:
+            nLastSaved = entry.nLastSaved;
+            return true;
     }
     return false;
-}
\ No newline at end of file
+}
@@ -13,6 +13,7 @@
 #include <uint256.h>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class CTreasuryProposal
@@ -110,6 +111,59 @@ public:
     }
 };
 
+/** One record of the journal that is appended to the treasury file on save */
+class CTreasuryJournalEntry
+{
+public:
+    enum Type : uint8_t {
+        PROPOSAL = 1,       // add or replace a proposal
+        ERASE_PROPOSAL = 2, // remove the proposal with hashID
+        SCRIPTS = 3,        // all scripts and the change address
+        COMMIT = 4,         // the records since the previous commit form one complete save
+    };
+    
+    uint8_t nType;
+    uint256 hashID;
+    CTreasuryProposal proposal;
+    std::vector<CScript> vRedeemScripts;
+    CScript scriptChangeAddress;
+    uint32_t nLastSaved;
+    
+    CTreasuryJournalEntry() : nType(0), nLastSaved(0) {}
+    
+    bool IsKnownType() const
+    {
+        return nType >= PROPOSAL && nType <= COMMIT;
+    }
+    
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nType);
+        if (nType == PROPOSAL) {
+            READWRITE(proposal);
+        } else if (nType == ERASE_PROPOSAL) {
+            READWRITE(hashID);
+        } else if (nType == SCRIPTS) {
+            READWRITE(vRedeemScripts);
+            READWRITE(scriptChangeAddress);
+        } else if (nType == COMMIT) {
+            READWRITE(nLastSaved);
+        }
+    }
+};
+
+struct TreasuryProposalHasher
+{
+    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+};
+
+struct TreasuryScriptHasher
+{
+    size_t operator()(const CScript& script) const;
+};
+
 class CTreasuryMempool {
 
 private:
@@ -123,6 +177,27 @@ private:
     /* Directory of the current treasury file */
     boost::filesystem::path filePath;
     
+    /* Position of every proposal in vTreasuryProposals by hashID (memory-only) */
+    std::unordered_map<uint256, size_t, TreasuryProposalHasher> mapProposalIndex;
+    
+    /* Position of every script in vRedeemScripts (memory-only) */
+    std::unordered_map<CScript, size_t, TreasuryScriptHasher> mapScriptIndex;
+    
+    /* Hash and size of the treasury file this mempool was last loaded from or saved to, null if none (memory-only) */
+    uint256 hashSnapshot;
+    uint64_t nSnapshotSize;
+    
+    /* Committed bytes of the journal next to that file (memory-only) */
+    uint64_t nJournalSize;
+    
+    /* Hash of every proposal and of the scripts as the file and its journal have them (memory-only) */
+    std::unordered_map<uint256, uint256, TreasuryProposalHasher> mapPersistedProposals;
+    uint256 hashPersistedScripts;
+    
+    void RebuildProposalIndex();
+    void RebuildScriptIndex();
+    uint256 GetScriptsHash() const;
+    
     void BasicInit()
     {
         SetNull();
@@ -131,10 +206,10 @@ private:
     
 public:
 
-    /* All treasury proposals */
+    /* All treasury proposals, only add or remove them through the methods below to keep the index in sync */
     std::vector<CTreasuryProposal> vTreasuryProposals;
     
-    /* All treasury redeemscripts and other scripts */
+    /* All treasury redeemscripts and other scripts, same as above */
     std::vector<CScript> vRedeemScripts;
     
     /* The current treasury change address script */
@@ -159,6 +234,9 @@ public:
         vTreasuryProposals.clear();
         vRedeemScripts.clear();
         scriptChangeAddress.clear();
+        mapProposalIndex.clear();
+        mapScriptIndex.clear();
+        ClearPersisted();
     }
     
     ADD_SERIALIZE_METHODS;
@@ -170,6 +248,10 @@ public:
         READWRITE(vTreasuryProposals);
         READWRITE(vRedeemScripts);
         READWRITE(scriptChangeAddress);
+        if (ser_action.ForRead()) {
+            RebuildProposalIndex();
+            RebuildScriptIndex();
+        }
     }
     
     void SetTreasuryFilePath (const std::string &path);
@@ -180,16 +262,32 @@ public:
     uint32_t GetVersion() const;
     uint32_t GetLastSaved() const;
     uint256 GetHash() const;
+    /* Estimated bytes used by the proposals, scripts and indexes, cs_treasury must be held */
+    size_t DynamicMemoryUsage() const;
     void DeleteExpiredProposals(const uint32_t nSystemTime);
     void InsertDummyInputs();
     void RemoveDummyInputs();
+    bool AddScript(const CScript &script);
     bool SearchScriptByScript(const CScript &script, size_t &nIndex) const;
     bool RemoveScriptByID(const size_t nIndex);
+    void ClearScripts();
+    bool AddProposal(const CTreasuryProposal& proposal);
     bool GetProposalvID(const uint256& hash, size_t& nIndex) const;
+    void ClearProposals();
+    boost::filesystem::path GetJournalFilePath() const;
+    bool HasSnapshot() const;
+    uint256 GetSnapshotHash() const;
+    uint64_t GetSnapshotSize() const;
+    uint64_t GetJournalSize() const;
+    void SetPersisted(const uint256& hashSnapshotIn, const uint64_t nSnapshotSizeIn, const uint64_t nJournalSizeIn);
+    void ClearPersisted();
+    void GetUnpersistedChanges(std::vector<CTreasuryJournalEntry>& vEntries) const;
+    bool ApplyJournalEntry(const CTreasuryJournalEntry& entry);
 };
 
 /** Treasury Stuff */
 const std::string CONST_TREASURY_FILE_MARKER = "GlobalTokenTreasuryProposalFileMagic";
+const std::string CONST_TREASURY_JOURNAL_MARKER = "GlobalTokenTreasuryJournalMagic";
 extern CTreasuryMempool activeTreasury;
 
 #endif // GLOBALTOKEN_TREASURY_H
@@ -17,6 +17,10 @@
 #include <crypto/hmac_sha256.h>
 #include <stdio.h>
 
+#include <functional>
+#include <map>
+#include <set>
+
 #include <boost/algorithm/string.hpp> // boost::trim
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
@@ -59,6 +63,37 @@ private:
 };
 
 
+/** Sends the result of a single request as a chunked HTTP reply, see JSONRPCReplyObj */
+class HTTPRPCResultStream : public JSONRPCResultStream
+{
+private:
+    HTTPRequest* req;
+    const UniValue& id;
+    bool fStarted;
+
+public:
+    HTTPRPCResultStream(HTTPRequest* reqIn, const UniValue& idIn) : req(reqIn), id(idIn), fStarted(false) {}
+
+    void Write(const std::string& strPart) override
+    {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartChunkedReply(HTTP_OK);
+            req->WriteReplyChunk("{\"result\":");
+            fStarted = true;
+        }
+        req->WriteReplyChunk(strPart);
+    }
+
+    bool IsStarted() const { return fStarted; }
+
+    void Finish()
+    {
+        req->WriteReplyChunk(",\"error\":null,\"id\":" + id.write() + "}\n");
+        req->EndChunkedReply();
+    }
+};
+
 /* Pre-base64-encoded authentication token */
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
@@ -142,6 +177,71 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+//! Methods -rpcslowthreads run, set up by StartHTTPRPC
+static std::set<std::string> setSlowMethods;
+
+/** Whether a request calls a slow method, for a batch any of its requests */
+static bool IsSlowRequest(const UniValue& valRequest)
+{
+    if (valRequest.isObject())
+        return valRequest["method"].isStr() && setSlowMethods.count(valRequest["method"].get_str());
+    if (valRequest.isArray()) {
+        for (size_t i = 0; i < valRequest.size(); i++) {
+            if (IsSlowRequest(valRequest[i]))
+                return true;
+        }
+    }
+    return false;
+}
+
+/** Execute a parsed request and reply to it */
+static bool ExecJSONRPC(HTTPRequest* req, JSONRPCRequest jreq, const UniValue& valRequest)
+{
+    try {
+        std::string strReply;
+        // singleton request
+        if (valRequest.isObject()) {
+            jreq.parse(valRequest);
+
+            HTTPRPCResultStream stream(req, jreq.id);
+            jreq.resultStream = &stream;
+            UniValue result;
+            try {
+                result = tableRPC.execute(jreq);
+            } catch (...) {
+                if (!stream.IsStarted())
+                    throw;
+                // Too late for an error reply, the client is left with an incomplete result
+                LogPrintf("%s: %s failed while streaming its result\n", __func__, jreq.strMethod);
+                req->EndChunkedReply();
+                return false;
+            }
+            if (stream.IsStarted()) {
+                stream.Finish();
+                return true;
+            }
+
+            // Send reply
+            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+
+        // array of requests
+        } else if (valRequest.isArray())
+            strReply = JSONRPCExecBatch(jreq, valRequest.get_array(), QueueHTTPWork, gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS) - 1);
+        else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strReply);
+    } catch (const UniValue& objError) {
+        JSONErrorReply(req, objError, jreq.id);
+        return false;
+    } catch (const std::exception& e) {
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        return false;
+    }
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -171,43 +271,152 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
-    try {
-        // Parse request
-        UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
-            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+    // Parse request
+    UniValue valRequest;
+    if (!valRequest.read(req->ReadBody())) {
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, "Parse error"), jreq.id);
+        return false;
+    }
 
-        // Set the URI
-        jreq.URI = req->GetURI();
+    // Set the URI
+    jreq.URI = req->GetURI();
 
-        std::string strReply;
-        // singleton request
-        if (valRequest.isObject()) {
-            jreq.parse(valRequest);
+    // Slow calls go on to workers of their own, so the ones taking requests
+    // stay free for quick calls like getblocktemplate. When the slow workers'
+    // queue is full the call runs here after all.
+    if (IsSlowRequest(valRequest) && req->Defer(std::bind(ExecJSONRPC, std::placeholders::_1, jreq, valRequest)))
+        return true;
+    return ExecJSONRPC(req, jreq, valRequest);
+}
 
-            UniValue result = tableRPC.execute(jreq);
+/** A call startjob runs on a slow worker, until getjobresult collected its result */
+struct HTTPRPCJob
+{
+    std::string strMethod;
+    int64_t nStartTime;
+    bool fDone;
+    UniValue result;
+    UniValue error;
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+    HTTPRPCJob() : nStartTime(0), fDone(false) {}
+};
 
-        // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
-        else
-            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+static CCriticalSection cs_jobs;
+static std::map<std::string, HTTPRPCJob> mapJobs;
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
+static void RunJob(const std::string& strJobId, JSONRPCRequest jreq)
+{
+    UniValue result;
+    UniValue error;
+    try {
+        result = tableRPC.execute(jreq);
     } catch (const UniValue& objError) {
-        JSONErrorReply(req, objError, jreq.id);
-        return false;
+        error = objError;
     } catch (const std::exception& e) {
-        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
-        return false;
+        error = JSONRPCError(RPC_MISC_ERROR, e.what());
     }
-    return true;
+
+    LOCK(cs_jobs);
+    HTTPRPCJob& job = mapJobs[strJobId];
+    job.fDone = true;
+    job.result = result;
+    job.error = error;
 }
 
+static UniValue startjob(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "startjob \"method\" ( params )\n"
+            "\nStart a call that runs on one of the -rpcslowthreads workers, and return right away.\n"
+            "Its result is collected with getjobresult.\n"
+            "\nArguments:\n"
+            "1. \"method\"      (string, required) The method to call\n"
+            "2. params        (array or object, optional) Its positional or named arguments\n"
+            "\nResult:\n"
+            "\"jobid\"         (string) The id of the job, for getjobresult\n"
+            "\nExamples:\n"
+            + HelpExampleCli("startjob", "\"gettxoutsetinfo\"")
+            + HelpExampleRpc("startjob", "\"rescanblockchain\", [100000]")
+        );
+
+    JSONRPCRequest jreq;
+    jreq.strMethod = request.params[0].get_str();
+    if (jreq.strMethod == "startjob" || jreq.strMethod == "getjobresult")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Jobs cannot start or collect jobs");
+    jreq.params = request.params[1].isNull() ? UniValue(UniValue::VARR) : request.params[1];
+    if (!jreq.params.isArray() && !jreq.params.isObject())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Params must be an array or object");
+    jreq.URI = request.URI;
+    jreq.authUser = request.authUser;
+
+    const std::string strJobId = GetRandHash().GetHex().substr(0, 16);
+    {
+        LOCK(cs_jobs);
+        if (mapJobs.size() >= MAX_RPC_JOBS)
+            throw JSONRPCError(RPC_MISC_ERROR, "Too many jobs, collect the results of finished ones with getjobresult");
+        HTTPRPCJob& job = mapJobs[strJobId];
+        job.strMethod = jreq.strMethod;
+        job.nStartTime = GetTime();
+    }
+    if (!QueueSlowHTTPWork(std::bind(RunJob, strJobId, jreq))) {
+        LOCK(cs_jobs);
+        mapJobs.erase(strJobId);
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot queue the job, it needs -rpcslowthreads and room in their queue");
+    }
+    return strJobId;
+}
+
+static UniValue getjobresult(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getjobresult \"jobid\"\n"
+            "\nReturn the status of a job started with startjob, and its result once it finished.\n"
+            "A finished job is forgotten once its result was returned.\n"
+            "\nArguments:\n"
+            "1. \"jobid\"       (string, required) The id startjob returned\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\": \"method\",   (string) The method the job calls\n"
+            "  \"status\": \"status\",   (string) \"running\", \"done\" or \"failed\"\n"
+            "  \"elapsed\": n,         (numeric) Seconds since the job was started\n"
+            "  \"result\": xxx,        (any) The result of the call, if it is done\n"
+            "  \"error\": {...}        (object) The error of the call, if it failed\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getjobresult", "\"4f2e7bd81c9a3065\"")
+            + HelpExampleRpc("getjobresult", "\"4f2e7bd81c9a3065\"")
+        );
+
+    const std::string strJobId = request.params[0].get_str();
+    LOCK(cs_jobs);
+    auto it = mapJobs.find(strJobId);
+    if (it == mapJobs.end())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown job, or its result was returned already");
+
+    const HTTPRPCJob& job = it->second;
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("method", job.strMethod);
+    obj.pushKV("status", !job.fDone ? "running" : job.error.isNull() ? "done" : "failed");
+    obj.pushKV("elapsed", GetTime() - job.nStartTime);
+    if (job.fDone) {
+        if (job.error.isNull())
+            obj.pushKV("result", job.result);
+        else
+            obj.pushKV("error", job.error);
+        mapJobs.erase(it);
+    }
+    return obj;
+}
+
+static const CRPCCommand jobCommands[] =
+{ //  category              name                      actor (function)         argNames
+  //  --------------------- ------------------------  -----------------------  ----------
+    { "control",            "startjob",               &startjob,               {"method","params"} },
+    { "control",            "getjobresult",           &getjobresult,           {"jobid"} },
+};
+
 static bool InitRPCAuthentication()
 {
     if (gArgs.GetArg("-rpcpassword", "") == "")
@@ -232,6 +441,15 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
+    setSlowMethods.clear();
+    std::vector<std::string> vSlowMethods;
+    boost::split(vSlowMethods, DEFAULT_RPC_SLOW_METHODS, boost::is_any_of(","));
+    for (const std::string& strMethod : gArgs.GetArgs("-rpcslowmethod"))
+        vSlowMethods.push_back(strMethod);
+    setSlowMethods.insert(vSlowMethods.begin(), vSlowMethods.end());
+    for (const CRPCCommand& command : jobCommands)
+        tableRPC.appendCommand(command.name, &command);
+
     RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
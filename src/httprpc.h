@@ -8,6 +8,14 @@
 #include <string>
 #include <map>
 
+/** Methods run by the -rpcslowthreads workers besides those given with -rpcslowmethod */
+static const char* const DEFAULT_RPC_SLOW_METHODS = "gettxoutsetinfo,verifychain,rescanblockchain,importwallet,dumpwallet,importmulti,"
+    "waitfornewblock,waitforblock,waitforblockheight";
+/** Jobs startjob keeps at most, running or waiting for getjobresult */
+static const size_t MAX_RPC_JOBS = 100;
+/** Whether REST serves the RPC call stats at /rest/rpcstats */
+static const bool DEFAULT_REST_RPCSTATS = false;
+
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <deque>
 #include <future>
 
 #include <event2/thread.h>
@@ -60,6 +61,22 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Work item running a function */
+class HTTPFunctionItem final : public HTTPClosure
+{
+public:
+    explicit HTTPFunctionItem(const std::function<void()>& _func) : func(_func)
+    {
+    }
+    void operator()() override
+    {
+        func();
+    }
+
+private:
+    std::function<void()> func;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -143,6 +160,8 @@ struct evhttp* eventHTTP = nullptr;
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Work queue for the slow requests handlers hand on, nullptr with -rpcslowthreads=0
+static WorkQueue<HTTPClosure>* slowWorkQueue = nullptr;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -398,6 +417,9 @@ bool InitHTTPServer()
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    if (gArgs.GetArg("-rpcslowthreads", DEFAULT_HTTP_SLOW_THREADS) > 0) {
+        slowWorkQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    }
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
@@ -434,6 +456,13 @@ bool StartHTTPServer()
     for (int i = 0; i < rpcThreads; i++) {
         g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue);
     }
+    if (slowWorkQueue) {
+        int slowThreads = gArgs.GetArg("-rpcslowthreads", DEFAULT_HTTP_SLOW_THREADS);
+        LogPrintf("HTTP: starting %d worker threads for slow requests\n", slowThreads);
+        for (int i = 0; i < slowThreads; i++) {
+            g_thread_http_workers.emplace_back(HTTPWorkQueueRun, slowWorkQueue);
+        }
+    }
     return true;
 }
 
@@ -450,6 +479,8 @@ void InterruptHTTPServer()
     }
     if (workQueue)
         workQueue->Interrupt();
+    if (slowWorkQueue)
+        slowWorkQueue->Interrupt();
 }
 
 void StopHTTPServer()
@@ -463,6 +494,8 @@ void StopHTTPServer()
         g_thread_http_workers.clear();
         delete workQueue;
         workQueue = nullptr;
+        delete slowWorkQueue;
+        slowWorkQueue = nullptr;
     }
     if (eventBase) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP event thread to exit\n");
@@ -491,6 +524,27 @@ void StopHTTPServer()
     LogPrint(BCLog::HTTP, "Stopped HTTP server\n");
 }
 
+static bool QueueHTTPFunction(WorkQueue<HTTPClosure>* queue, const std::function<void()>& func)
+{
+    if (!queue)
+        return false;
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(func));
+    if (!queue->Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
+bool QueueHTTPWork(const std::function<void()>& func)
+{
+    return QueueHTTPFunction(workQueue, func);
+}
+
+bool QueueSlowHTTPWork(const std::function<void()>& func)
+{
+    return QueueHTTPFunction(slowWorkQueue, func);
+}
+
 struct event_base* EventBase()
 {
     return eventBase;
@@ -523,12 +577,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       fChunked(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (fChunked && !replySent) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -574,6 +632,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply was sent. This is the
+ * second part of the libevent workaround in http_request_cb.
+ */
+static void ReenableRequestReading(evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -581,7 +655,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !fChunked && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
@@ -589,17 +663,62 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
-        }
+        ReenableRequestReading(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+bool HTTPRequest::Defer(const std::function<void(HTTPRequest*)>& func)
+{
+    assert(!replySent && !fChunked && req);
+    std::shared_ptr<HTTPRequest> deferred(new HTTPRequest(req));
+    if (!QueueSlowHTTPWork([deferred, func] { func(deferred.get()); })) {
+        // Still this one's to reply to
+        deferred->replySent = true;
+        deferred->req = nullptr;
+        return false;
+    }
+    replySent = true;
+    req = nullptr; // transferred to the slow worker
+    return true;
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !fChunked && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    fChunked = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && fChunked && req);
+    if (strChunk.empty())
+        return;
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, strChunk]{
+        struct evbuffer* evb = evbuffer_new();
+        assert(evb);
+        evbuffer_add(evb, strChunk.data(), strChunk.size());
+        evhttp_send_reply_chunk(req_copy, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && fChunked && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy]{
+        evhttp_send_reply_end(req_copy);
+        ReenableRequestReading(req_copy);
     });
     ev->trigger(nullptr);
     replySent = true;
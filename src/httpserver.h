@@ -10,6 +10,7 @@
 #include <functional>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_SLOW_THREADS=2;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
@@ -46,6 +47,19 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/**
+ * Run func on one of the -rpcthreads workers, after the requests queued
+ * before it. False if the queue is full.
+ */
+bool QueueHTTPWork(const std::function<void()>& func);
+
+/**
+ * Run func on one of the -rpcslowthreads workers, which take the work that
+ * would otherwise hold up the -rpcthreads ones for long. False if there are
+ * no such workers or their queue is full.
+ */
+bool QueueSlowHTTPWork(const std::function<void()>& func);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -59,6 +73,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool fChunked;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req);
@@ -114,6 +129,32 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Continue handling the request with func on one of the workers of
+     * QueueSlowHTTPWork, so it does not hold up the one handling it now.
+     * False if it could not be queued, the request is then left as it was.
+     *
+     * @note Like WriteReply, this hands the request on, do not call any other
+     * HTTPRequest methods after it returned true.
+     */
+    bool Defer(const std::function<void(HTTPRequest*)>& func);
+
+    /**
+     * Start a reply whose body is sent in parts, as they are passed to
+     * WriteReplyChunk. The parts are sent from the main http thread in the
+     * order they were written.
+     *
+     * @note Call this instead of WriteReply, and finish with EndChunkedReply.
+     */
+    void StartChunkedReply(int nStatus);
+    void WriteReplyChunk(const std::string& strChunk);
+    /**
+     * Finish a reply started with StartChunkedReply.
+     *
+     * @note Like WriteReply, this gives the request back to the main thread.
+     */
+    void EndChunkedReply();
 };
 
 /** Event handler closure.
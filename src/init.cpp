@@ -12,15 +12,21 @@
 
 #include <init.h>
 
+#include <addressindex.h>
 #include <addrman.h>
 #include <amount.h>
+#include <blockfilemap.h>
 #include <base58.h>
+#include <blockfilterindex.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <coinsreadview.h>
+#include <coinstats.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <fs.h>
+#include <globaltoken/multihasher.h>
 #include <httpserver.h>
 #include <httprpc.h>
 #include <key.h>
@@ -32,15 +38,20 @@
 #include <policy/feerate.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <rpc/server.h>
 #include <rpc/register.h>
 #include <rpc/safemode.h>
 #include <rpc/blockchain.h>
+#include <rpc/mining.h>
 #include <script/standard.h>
 #include <script/sigcache.h>
 #include <scheduler.h>
+#include <snapshot.h>
+#include <stratum.h>
 #include <timedata.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <torcontrol.h>
 #include <ui_interface.h>
@@ -71,6 +82,7 @@
 #include <warnings.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <future>
 #include <memory>
 
 #ifndef WIN32
@@ -86,9 +98,20 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include <zmq/zmqabstractnotifier.h>
 #include <zmq/zmqnotificationinterface.h>
+#include <zmq/zmqrpc.h>
 #endif
 
+#include <crypto/algos/argon2/hashargon.h>
+#include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/hashlib/sph_echo.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/algos/powscratch.h>
+#include <crypto/algos/yescrypt/yescrypt.h>
+#include <crypto/algos/yespower/yespower.h>
+#include <crypto/hash4way.h>
+
 #ifdef USE_SSE2
 #include <crypto/algos/scrypt/scrypt.h>
 #endif
@@ -101,10 +124,6 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = nullptr;
-#endif
-
 static CGLTNotificationInterface* pgltNotificationInterface = nullptr;
 
 #ifdef WIN32
@@ -186,6 +205,11 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
 
+const CScheduler& GetScheduler()
+{
+    return scheduler;
+}
+
 void Interrupt()
 {
     InterruptHTTPServer();
@@ -193,11 +217,90 @@ void Interrupt()
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     InterruptMapPort();
+    InterruptSnapshotValidation();
     if (g_connman)
         g_connman->Interrupt();
 }
 
+/** Write mempool.dat every -mempooldumpinterval seconds once it was loaded, if the mempool changed */
+static void PeriodicDumpMempool()
+{
+    if (fDumpMempoolLater) {
+        DumpMempool(true);
+    }
+}
+
+/** Write the masternode, payment and fulfilled request caches, on shutdown and every -mncacheflushinterval seconds */
+static void DumpMasternodeCaches()
+{
+    static CCriticalSection cs_dumpCaches;
+    LOCK(cs_dumpCaches);
+    CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
+    flatdb1.Dump(mnodeman);
+    CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
+    flatdb2.Dump(mnpayments);
+    CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
+    flatdb4.Dump(netfulfilledman);
+    CFlatDB<CInstantSend> flatdb5("instantsend.dat", "magicInstantSendCache");
+    flatdb5.Dump(instantsend);
+}
+
+/**
+ * Read the masternode, payment, fulfilled request and InstantSend caches, on
+ * a thread of their own while the block index loads. They need nothing but the
+ * chain params and the data directory. Returns the error to report, if any.
+ */
+static std::string LoadMasternodeCaches()
+{
+    boost::filesystem::path pathDB = GetDataDir();
+    std::string strDBName;
+
+    strDBName = "mncache.dat";
+    CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
+    if(!flatdb1.Load(mnodeman)) {
+        return _("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string();
+    }
+
+    if(mnodeman.size()) {
+        strDBName = "mnpayments.dat";
+        CFlatDB<CMasternodePayments> flatdb2(strDBName, "magicMasternodePaymentsCache");
+        if(!flatdb2.Load(mnpayments)) {
+            return _("Failed to load masternode payments cache from") + "\n" + (pathDB / strDBName).string();
+        }
+    } else {
+        LogPrintf("Masternode cache is empty, skipping payments cache\n");
+    }
+
+    strDBName = "netfulfilled.dat";
+    CFlatDB<CNetFulfilledRequestManager> flatdb4(strDBName, "magicFulfilledCache");
+    if(!flatdb4.Load(netfulfilledman)) {
+        return _("Failed to load fulfilled requests cache from") + "\n" + (pathDB / strDBName).string();
+    }
+
+    strDBName = "instantsend.dat";
+    CFlatDB<CInstantSend> flatdb5(strDBName, "magicInstantSendCache");
+    if(!flatdb5.Load(instantsend)) {
+        return _("Failed to load InstantSend data cache from") + "\n" + (pathDB / strDBName).string();
+    }
+    return "";
+}
+
+static std::future<std::string> futureMasternodeCaches;
+
+/** Wait for LoadMasternodeCaches to finish, if it was started, and return its error */
+static std::string WaitForMasternodeCaches()
+{
+    if (!futureMasternodeCaches.valid())
+        return "";
+    try {
+        return futureMasternodeCaches.get();
+    } catch (const std::exception& e) {
+        return strprintf(_("Failed to load masternode caches: %s"), e.what());
+    }
+}
+
 void Shutdown()
 {
     LogPrintf("%s: In progress...\n", __func__);
@@ -217,6 +320,7 @@ void Shutdown()
     StopREST();
     StopRPC();
     StopHTTPServer();
+    StopStratumServer();
 #ifdef ENABLE_WALLET
     FlushWallets();
 #endif
@@ -231,12 +335,9 @@ void Shutdown()
     
     // STORE DATA CACHES INTO SERIALIZED DAT FILES
     if (!fLiteMode) {
-        CFlatDB<CMasternodeMan> flatdb1("mncache.dat", "magicMasternodeCache");
-        flatdb1.Dump(mnodeman);
-        CFlatDB<CMasternodePayments> flatdb2("mnpayments.dat", "magicMasternodePaymentsCache");
-        flatdb2.Dump(mnpayments);
-        CFlatDB<CNetFulfilledRequestManager> flatdb4("netfulfilled.dat", "magicFulfilledCache");
-        flatdb4.Dump(netfulfilledman);
+        // Writing the caches while they are read would lose what is not read yet
+        WaitForMasternodeCaches();
+        DumpMasternodeCaches();
     }
 
     StopTorControl();
@@ -245,6 +346,7 @@ void Shutdown()
     // CScheduler/checkqueue threadGroup
     threadGroup.interrupt_all();
     threadGroup.join_all();
+    StopSnapshotValidation();
 
     if (fDumpMempoolLater && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool();
@@ -288,6 +390,7 @@ void Shutdown()
 
     {
         LOCK(cs_main);
+        ResetCoinsReadView();
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
@@ -300,11 +403,26 @@ void Shutdown()
     StopWallets();
 #endif
 
+    if (pblockfilterindex) {
+        UnregisterValidationInterface(pblockfilterindex.get());
+        pblockfilterindex.reset();
+    }
+
+    if (paddressindex) {
+        UnregisterValidationInterface(paddressindex.get());
+        paddressindex.reset();
+    }
+
+    if (ptxindex) {
+        UnregisterValidationInterface(ptxindex.get());
+        ptxindex.reset();
+    }
+
 #if ENABLE_ZMQ
-    if (pzmqNotificationInterface) {
-        UnregisterValidationInterface(pzmqNotificationInterface);
-        delete pzmqNotificationInterface;
-        pzmqNotificationInterface = nullptr;
+    if (g_zmq_notification_interface) {
+        UnregisterValidationInterface(g_zmq_notification_interface);
+        delete g_zmq_notification_interface;
+        g_zmq_notification_interface = nullptr;
     }
 #endif
 
@@ -390,6 +508,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-headersonly", strprintf(_("Only sync and validate the block headers of the best chain, do not download or serve blocks. This mode is incompatible with -masternode and -txindex (default: %u)"), DEFAULT_HEADERSONLY));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -400,11 +519,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     if (showDebug) {
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
+        strUsage += HelpMessageOpt("-dbpartialflush", strprintf("Write older coins cache changes to disk in the background once the cache is %u%% full (default: %u)", COINS_PARTIAL_FLUSH_THRESHOLD, DEFAULT_DB_PARTIAL_FLUSH));
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), DEFAULT_DEBUGLOGFILE));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-headerverifythreads=<n>", strprintf(_("Set the number of threads verifying the proof of work of received headers (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_HEADERVERIFY_THREADS, DEFAULT_HEADERVERIFY_THREADS));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-parallelargon2", strprintf("Fill the two lanes of the argon2d proof of work of a single header or block received near the tip on two cores (default: %u)", DEFAULT_PARALLEL_ARGON2));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -414,11 +538,16 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf("Set the number of threads running background tasks and the validation callbacks of the wallet, indexes, ZMQ and the network code, each of which runs in order on a queue of its own (1 to %d, default: %d)",
+            MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-mempooldumpinterval=<n>", strprintf(_("With -persistmempool, also save the mempool every <n> seconds if it changed, 0 to only save it on shutdown (default: %u)"), DEFAULT_MEMPOOL_DUMP_INTERVAL));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
-    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+    strUsage += HelpMessageOpt("-powhugepages", strprintf(_("Back the scratch memory of the memory-hard proof of work algorithms (yescrypt, yespower, argon2, scrypt) with huge pages, falling back to transparent huge pages if none are reserved (Linux only, default: %u)"), DEFAULT_POW_HUGEPAGES));
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex, -addressindex, -spentindex, -timestampindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
@@ -426,7 +555,12 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call. It is built in the background when enabled, without a reindex (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain UTXO set statistics for every block, used by the gettxoutsetinfo rpc call (default: %u)"), DEFAULT_COINSTATSINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain compact filters of the scripts in every block, used to skip blocks during wallet rescans (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain the balance changes and unspent outputs of every address, used by the getaddressbalance, getaddresstxids and getaddressutxos rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain where every output was spent, used by the getspentinfo rpc call (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain an index of the blocks by timestamp, used by the getblockhashes rpc call (default: %u)"), DEFAULT_TIMESTAMPINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -454,6 +588,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Method to wait for network activity with, one of: %s. Only select limits the number of connections to what fits in FD_SETSIZE (default: %s)"), SupportedSocketEventsModes(), DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -474,12 +609,17 @@ std::string HelpMessage(HelpMessageMode mode)
 
 #if ENABLE_ZMQ
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
+    strUsage += HelpMessageOpt("-zmqpubblocktemplate=<address>", _("Enable publish block template changes for every algo in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtxlock=<address>", _("Enable publish hash transaction (locked via InstantSend) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubmasternode=<address>", _("Enable publish masternode list changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubmasternodewinner=<address>", _("Enable publish masternode payment winner changes in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via InstantSend) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish hash block and tx sequence in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<type>hwm=<n>", strprintf(_("Set the outbound message high water mark of the <type> notification, the messages queued for a subscriber before new ones are dropped (default: %d)"), DEFAULT_ZMQ_SNDHWM));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -490,11 +630,17 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-checkpowonload=<mode>", strprintf("Which block headers get their proof of work re-checked when loading the block index (0 = none, 1 = not yet verified, full = all, default: %s)", DEFAULT_CHECKPOWONLOAD));
+        strUsage += HelpMessageOpt("-coinsreadview", strprintf("Keep a read-only view of the UTXO set of every new chain tip once the initial block download is done, so gettxout and the REST getutxos can look up coins without waiting for block validation (default: %u)", DEFAULT_COINS_READ_VIEW));
+        strUsage += HelpMessageOpt("-compactundo", strprintf("Write undo data for new blocks without the legacy version field; versions before this one cannot read it back (default: %u)", DEFAULT_COMPACT_UNDO));
+        strUsage += HelpMessageOpt("-paranoidblockreads", strprintf("Re-check the proof of work of every block read from disk, not only of blocks that were not validated yet (default: %u)", DEFAULT_PARANOID_BLOCK_READS));
+        strUsage += HelpMessageOpt("-blockfilemaps=<n>", strprintf("Keep the <n> most recently read block files mapped into memory and read blocks from there (0 to %d, 0 = read through the C library, default: %d)", MAX_BLOCK_FILE_MAPS, DEFAULT_BLOCK_FILE_MAPS));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used");
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", "Randomly fuzz 1 of every <n> network messages");
+        strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf("Number of threads to process peer messages with, each handling a share of the peers. More than one is experimental: the masternode, payment and InstantSend message handlers are not safe to run in parallel (1 to %d, default: %d)", MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT));
         strUsage += HelpMessageOpt("-stopatheight", strprintf("Stop running after reaching the given height in the main chain (default: %u)", DEFAULT_STOPATHEIGHT));
 
@@ -508,12 +654,15 @@ std::string HelpMessage(HelpMessageMode mode)
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + ListLogCategories() + ".");
     strUsage += HelpMessageOpt("-debugexclude=<category>", strprintf(_("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories.")));
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-lockprofile", strprintf(_("Record per call site how long cs_main, cs_wallet and the masternode and InstantSend locks are waited for and held, see getlockcontention (default: %u)"), DEFAULT_LOCK_PROFILE));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
+        strUsage += HelpMessageOpt("-maxequihashcachesize=<n>", strprintf("Limit size of the Equihash solution cache to <n> MiB (default: %u)", DEFAULT_MAX_EQUIHASH_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxmsgsigcachesize=<n>", strprintf("Limit size of the cache of verified masternode, InstantSend and spork message signatures to <n> MiB (default: %u)", DEFAULT_MAX_MSG_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
@@ -535,6 +684,7 @@ std::string HelpMessage(HelpMessageMode mode)
     
     strUsage += HelpMessageGroup(_("Masternode options:"));
     strUsage += HelpMessageOpt("-masternode=<n>", strprintf(_("Enable the client to act as a masternode (0-1, default: %u)"), 0));
+    strUsage += HelpMessageOpt("-mncacheflushinterval=<n>", strprintf(_("Write the masternode caches to disk every <n> seconds, 0 to only write them on shutdown (default: %u)"), DEFAULT_MNCACHE_FLUSH_INTERVAL));
     strUsage += HelpMessageOpt("-mnconf=<file>", strprintf(_("Specify masternode configuration file (default: %s)"), "masternode.conf"));
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), 1));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
@@ -571,8 +721,22 @@ std::string HelpMessage(HelpMessageMode mode)
 		
     strUsage += HelpMessageOpt("-coinbasetxnaddress=<address>", _("If you mine with getblocktemplate coinbasetxn, you need to paste an address here. It will be used to generate the coinbasetxn"));
     strUsage += HelpMessageOpt("-enableequihash", _("Activate this option, to mine equihash based algorithms in this wallet. (default: disabled)"));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-equihashsolver=<solver>", strprintf("Equihash solver used by the generate RPCs, bucket or basic (default: %s)", DEFAULT_EQUIHASH_SOLVER));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-incrementalassembly", strprintf("Reuse the transaction selection of the previous block template if everything in the mempool fit into it (default: %u)", DEFAULT_INCREMENTAL_ASSEMBLY));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-speculativeassembly", strprintf("Once a block template was requested, select the transactions of the next block in the background while a new block on top of the tip is being connected (needs -incrementalassembly, default: %u)", DEFAULT_SPECULATIVE_ASSEMBLY));
+    strUsage += HelpMessageGroup(_("Stratum server options:"));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Serve work to miners over stratum, only algorithms that are not based on Equihash are supported (default: %u)"), DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt("-stratumaddress=<address>", _("Address the blocks mined through the stratum server pay to"));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>[:port]", _("Bind to given address to listen for stratum connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost)"));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Share difficulty sent to stratum miners (default: %s)"), DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for stratum connections on <port> (default: %u)"), DEFAULT_STRATUM_PORT));
+
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-rest", strprintf(_("Accept public REST requests (default: %u)"), DEFAULT_REST_ENABLE));
+    strUsage += HelpMessageOpt("-restrpcstats", strprintf(_("Serve the RPC call stats in the Prometheus text format at /rest/rpcstats, needs -rest (default: %u)"), DEFAULT_REST_RPCSTATS));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcbind=<addr>[:port]", _("Bind to given address to listen for JSON-RPC connections. This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost, or if -rpcallowip has been specified, 0.0.0.0 and :: i.e., all addresses)"));
@@ -582,6 +746,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcserialversion", strprintf(_("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)"), DEFAULT_RPC_SERIALIZE_VERSION));
     if (showDebug)
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
+    strUsage += HelpMessageOpt("-rpcslowmethod=<method>", strprintf(_("Run calls of <method> on the -rpcslowthreads threads, besides %s. This option can be specified multiple times"), DEFAULT_RPC_SLOW_METHODS));
+    strUsage += HelpMessageOpt("-rpcslowthreads=<n>", strprintf(_("Set the number of threads to run slow RPC calls and the jobs of startjob on, 0 runs them on the -rpcthreads threads (default: %d)"), DEFAULT_HTTP_SLOW_THREADS));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     if (showDebug)
@@ -700,6 +866,7 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CChainParams& chainparams = Params();
     RenameThread("globaltoken-loadblk");
+    CHashPurposeScope hashPurpose(HashPurpose::STARTUP_LOAD);
 
     {
     CImportingNow imp;
@@ -871,6 +1038,16 @@ void InitParameterInteraction()
             LogPrintf("%s: parameter interaction: -externalip set -> setting -discover=0\n", __func__);
     }
 
+    // without blocks there is no UTXO set to check transactions or wallets against
+    if (gArgs.GetBoolArg("-headersonly", DEFAULT_HEADERSONLY)) {
+        if (gArgs.SoftSetBoolArg("-blocksonly", true))
+            LogPrintf("%s: parameter interaction: -headersonly=1 -> setting -blocksonly=1\n", __func__);
+        if (gArgs.SoftSetBoolArg("-disablewallet", true))
+            LogPrintf("%s: parameter interaction: -headersonly=1 -> setting -disablewallet=1\n", __func__);
+        if (gArgs.SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s: parameter interaction: -headersonly=1 -> setting -txindex=0\n", __func__);
+    }
+
     // disable whitelistrelay in blocksonly mode
     if (gArgs.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY)) {
         if (gArgs.SoftSetBoolArg("-whitelistrelay", false))
@@ -909,6 +1086,7 @@ void InitLogging()
     fLogTimestamps = gArgs.GetBoolArg("-logtimestamps", DEFAULT_LOGTIMESTAMPS);
     fLogTimeMicros = gArgs.GetBoolArg("-logtimemicros", DEFAULT_LOGTIMEMICROS);
     fLogIPs = gArgs.GetBoolArg("-logips", DEFAULT_LOGIPS);
+    g_lock_profiling = gArgs.GetBoolArg("-lockprofile", DEFAULT_LOCK_PROFILE);
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     std::string version_string = FormatFullVersion();
@@ -925,6 +1103,7 @@ namespace { // Variables internal to initialization process only
 int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
+SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
 
 } // namespace
@@ -1001,6 +1180,16 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex, -spentindex and -timestampindex."));
+    }
+
+    // a headers-only node has no blocks to index, nor collateral to check masternodes against
+    if (gArgs.GetBoolArg("-headersonly", DEFAULT_HEADERSONLY)) {
+        if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+            return InitError(_("Headers-only mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-masternode", false))
+            return InitError(_("Headers-only mode is incompatible with -masternode."));
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1014,12 +1203,29 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    int64_t nMessageHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    if (nMessageHandlerThreads < 1 || nMessageHandlerThreads > MAX_MSGHANDLER_THREADS) {
+        return InitError(strprintf(_("-msghandlerthreads must be between 1 and %d"), MAX_MSGHANDLER_THREADS));
+    }
+    if (nMessageHandlerThreads > 1) {
+        InitWarning(_("-msghandlerthreads above 1 is experimental and only meant for testing; the masternode, payment and InstantSend messages may be processed incorrectly."));
+    }
+
+    std::string strSocketEvents = gArgs.GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!SocketEventsModeFromString(strSocketEvents, socketEventsMode)) {
+        return InitError(strprintf(_("Invalid -socketevents mode '%s', it must be one of: %s"), strSocketEvents, SupportedSocketEventsModes()));
+    }
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
+    if (socketEventsMode == SocketEventsMode::SELECT) {
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS - MAX_OUTBOUND_MASTERNODE_CONNECTIONS)), 0);
+    }
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS + MAX_OUTBOUND_MASTERNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
-    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS, nMaxConnections);
+    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS - MAX_OUTBOUND_MASTERNODE_CONNECTIONS, nMaxConnections);
+    // The descriptors left over let the databases keep more table files open
+    SetDBFileDescriptorBudget(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS - MAX_OUTBOUND_MASTERNODE_CONNECTIONS - nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
@@ -1078,6 +1284,21 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fParanoidBlockReads = gArgs.GetBoolArg("-paranoidblockreads", DEFAULT_PARANOID_BLOCK_READS);
+    fCompactUndo = gArgs.GetBoolArg("-compactundo", DEFAULT_COMPACT_UNDO);
+    fCoinsReadView = gArgs.GetBoolArg("-coinsreadview", DEFAULT_COINS_READ_VIEW);
+    SetBlockFileMaps(gArgs.GetArg("-blockfilemaps", DEFAULT_BLOCK_FILE_MAPS));
+
+    const std::string strCheckPoWOnLoad = gArgs.GetArg("-checkpowonload", DEFAULT_CHECKPOWONLOAD);
+    if (strCheckPoWOnLoad == "0") {
+        checkPoWOnLoad = CheckPoWOnLoad::NONE;
+    } else if (strCheckPoWOnLoad == "1") {
+        checkPoWOnLoad = CheckPoWOnLoad::UNVERIFIED;
+    } else if (strCheckPoWOnLoad == "full") {
+        checkPoWOnLoad = CheckPoWOnLoad::FULL;
+    } else {
+        return InitError(strprintf(_("Invalid -checkpowonload mode: '%s' (must be 0, 1 or full)"), strCheckPoWOnLoad));
+    }
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1123,6 +1344,33 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // Same semantics as -par, the message handler thread takes part in the checks
+    nHeaderVerifyThreads = gArgs.GetArg("-headerverifythreads", DEFAULT_HEADERVERIFY_THREADS);
+    if (nHeaderVerifyThreads <= 0)
+        nHeaderVerifyThreads += GetNumCores();
+    if (nHeaderVerifyThreads <= 1)
+        nHeaderVerifyThreads = 0;
+    else if (nHeaderVerifyThreads > MAX_HEADERVERIFY_THREADS)
+        nHeaderVerifyThreads = MAX_HEADERVERIFY_THREADS;
+
+    if (gArgs.GetBoolArg("-parallelargon2", DEFAULT_PARALLEL_ARGON2) && GetNumCores() > 1)
+        SetArgon2LaneThreads(2);
+
+    if (gArgs.GetBoolArg("-powhugepages", DEFAULT_POW_HUGEPAGES)) {
+        if (!pow_scratch_set_hugepages(1)) {
+            InitWarning(_("Huge pages for the proof of work scratch memory are not supported on this platform, ignoring -powhugepages."));
+        } else {
+            // Map one region to tell the operator right away which kind of huge pages the hashes get
+            size_t nMappedSize;
+            void* pProbe = pow_scratch_alloc(POW_SCRATCH_HUGEPAGE_SIZE, &nMappedSize);
+            uint64_t nTotal, nHugeTLB, nTHP;
+            pow_scratch_stats(&nTotal, &nHugeTLB, &nTHP);
+            LogPrintf("PoW scratch memory: %s\n", !pProbe ? "mapping failed" : nHugeTLB ? "on reserved huge pages (MAP_HUGETLB)" :
+                nTHP ? "no huge pages reserved, advised for transparent huge pages" : "no huge pages reserved and transparent huge pages unavailable");
+            pow_scratch_free(pProbe, nMappedSize);
+        }
+    }
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1141,6 +1389,11 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    fHeadersOnly = gArgs.GetBoolArg("-headersonly", DEFAULT_HEADERSONLY);
+    if (fHeadersOnly) {
+        LogPrintf("Headers-only mode enabled, blocks will not be downloaded.\n");
+    }
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1214,6 +1467,10 @@ bool AppInitParameterInteraction()
         fEnableReplacement = (std::find(vstrReplacementModes.begin(), vstrReplacementModes.end(), "fee") != vstrReplacementModes.end());
     }
 
+    const std::string strEquihashSolver = gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER);
+    if (strEquihashSolver != "bucket" && strEquihashSolver != "basic")
+        return InitError(strprintf("Unknown -equihashsolver (%s), expecting bucket or basic", strEquihashSolver));
+
     if (gArgs.IsArgSet("-vbparams")) {
         // Allow overriding version bits parameters for testing
         if (!chainparams.MineBlocksOnDemand()) {
@@ -1267,6 +1524,18 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string echo_algo = sph_echo_autodetect();
+    LogPrintf("Using the '%s' ECHO implementation\n", echo_algo);
+    std::string hash4way_algo = Hash4WayAutoDetect();
+    LogPrintf("Using the '%s' 4-way blake512/skein512/keccak512 implementation\n", hash4way_algo);
+    std::string eh_index_hash_algo = EhIndexHashAutoDetect();
+    LogPrintf("Using the '%s' Equihash index BLAKE2b implementation\n", eh_index_hash_algo);
+    std::string yescrypt_algo = yescrypt_autodetect();
+    LogPrintf("Using the '%s' yescrypt implementation\n", yescrypt_algo);
+    std::string yespower_algo = yespower_autodetect();
+    LogPrintf("Using the '%s' yespower implementation\n", yespower_algo);
+    std::string neoscrypt_algo = neoscrypt_autodetect();
+    LogPrintf("Using the '%s' neoscrypt implementation\n", neoscrypt_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1330,6 +1599,8 @@ bool AppInitMain()
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitEquihashSolutionCache();
+    InitMessageSignatureCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
@@ -1337,9 +1608,19 @@ bool AppInitMain()
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
-    // Start the lightweight task scheduler thread
+    LogPrintf("Using %u threads for header proof of work verification\n", nHeaderVerifyThreads);
+    if (nHeaderVerifyThreads) {
+        for (int i=0; i<nHeaderVerifyThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderVerify);
+    }
+
+    // Start the lightweight task scheduler threads, the validation listeners
+    // are served in parallel by them
+    int nSchedulerThreads = std::max(1, std::min((int)gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
+    LogPrintf("Using %u scheduler threads\n", nSchedulerThreads);
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
@@ -1351,6 +1632,9 @@ bool AppInitMain()
 #ifdef ENABLE_WALLET
     RegisterWalletRPC(tableRPC);
 #endif
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1387,7 +1671,7 @@ bool AppInitMain()
     CConnman& connman = *g_connman;
 
     peerLogic.reset(new PeerLogicValidation(&connman, scheduler));
-    RegisterValidationInterface(peerLogic.get());
+    RegisterValidationInterface(peerLogic.get(), "peerlogic");
 
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
@@ -1486,15 +1770,15 @@ bool AppInitMain()
     }
 
 #if ENABLE_ZMQ
-    pzmqNotificationInterface = CZMQNotificationInterface::Create();
+    g_zmq_notification_interface = CZMQNotificationInterface::Create();
 
-    if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+    if (g_zmq_notification_interface) {
+        RegisterValidationInterface(g_zmq_notification_interface, "zmq");
     }
 #endif
 
     pgltNotificationInterface = new CGLTNotificationInterface(connman);
-    RegisterValidationInterface(pgltNotificationInterface);
+    RegisterValidationInterface(pgltNotificationInterface, "globaltoken");
 
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
     uint64_t nMaxOutboundTimeframe = MAX_UPLOAD_TIMEFRAME;
@@ -1505,7 +1789,13 @@ bool AppInitMain()
 
     // ********************************************************* Step 7: load block chain
 
+    // The masternode caches do not depend on the chain, read them meanwhile
+    if (!gArgs.GetBoolArg("-litemode", false)) {
+        futureMasternodeCaches = std::async(std::launch::async, LoadMasternodeCaches);
+    }
+
     fReindex = gArgs.GetBoolArg("-reindex", false);
+    fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
     bool fReindexChainState = gArgs.GetBoolArg("-reindex-chainstate", false);
 
     // cache size calculations
@@ -1513,8 +1803,26 @@ bool AppInitMain()
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
+    nBlockTreeDBCache = std::min(nBlockTreeDBCache, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = 0;
+    if (fTxIndex) {
+        nTxIndexCache = std::min(nTotalCache / 8, nMaxTxIndexCache << 20);
+        nTotalCache -= nTxIndexCache;
+    }
+    int64_t nBlockFilterIndexCache = 0;
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        nBlockFilterIndexCache = std::min(nTotalCache / 8, nMaxBlockFilterIndexCache << 20);
+        nTotalCache -= nBlockFilterIndexCache;
+    }
+    const bool fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    const bool fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    const bool fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    int64_t nAddressIndexCache = 0;
+    if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+        nAddressIndexCache = std::min(nTotalCache / 8, nMaxAddressIndexCache << 20);
+        nTotalCache -= nAddressIndexCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1522,10 +1830,20 @@ bool AppInitMain()
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nTxIndexCache > 0) {
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (nBlockFilterIndexCache > 0) {
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (nAddressIndexCache > 0) {
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
+    CHashPurposeScope hashPurpose(HashPurpose::STARTUP_LOAD);
     while (!fLoaded && !fRequestShutdown) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1536,6 +1854,7 @@ bool AppInitMain()
         do {
             try {
                 UnloadBlockIndex();
+                ResetCoinsReadView();
                 pcoinsTip.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
@@ -1551,10 +1870,15 @@ bool AppInitMain()
                         CleanupBlockRevFiles();
                 }
 
+                // The chainstate is rebuilt from the blocks, the snapshot it was loaded from is gone with it
+                if (fReindexChainState) {
+                    pblocktree->EraseSnapshotBase();
+                    fs::remove_all(GetDataDir() / "chainstate_history");
+                }
+
                 if (fRequestShutdown) break;
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing. It will also load fHavePruned if we've
+                // LoadBlockIndex will load fHavePruned if we've
                 // ever removed a block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
                 // From here on out fReindex and fReset mean something different!
@@ -1568,9 +1892,9 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
+                // Check for changed -coinstatsindex state
+                if (fCoinStatsIndex != gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -coinstatsindex");
                     break;
                 }
 
@@ -1622,6 +1946,11 @@ bool AppInitMain()
                     assert(chainActive.Tip() != nullptr);
                 }
 
+                if (fCoinStatsIndex && !coinstatsindex.Init(chainActive.Tip(), chainparams.GetConsensus())) {
+                    strLoadError = _("Error loading the coin stats index, you will need to rebuild the database using -reindex-chainstate");
+                    break;
+                }
+
                 if (!fReset) {
                     // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
                     // It both disconnects blocks based on chainActive, and drops block data in
@@ -1695,10 +2024,36 @@ bool AppInitMain()
         LogPrintf("Shutdown requested. Exiting.\n");
         return false;
     }
+    if (pow_scratch_hugepages()) {
+        uint64_t nTotal, nHugeTLB, nTHP;
+        pow_scratch_stats(&nTotal, &nHugeTLB, &nTHP);
+        LogPrintf("PoW scratch regions mapped so far: %u, %u on reserved huge pages (%.0f%%), %u advised for transparent huge pages\n",
+            nTotal, nHugeTLB, nTotal ? 100.0 * nHugeTLB / nTotal : 0.0, nTHP);
+    }
     if (fLoaded) {
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
     }
 
+    // The indexes need the blocks below a snapshot base, which are not connected
+    if (pindexSnapshotBase && (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX) || fAddressIndex || fSpentIndex || fTimestampIndex || fTxIndex)) {
+        return InitError(_("The chainstate was loaded from a snapshot, restart with -reindex-chainstate to use -txindex, -blockfilterindex, -addressindex, -spentindex or -timestampindex."));
+    }
+
+    // Filters are added from here on, ThreadSync fills in what is missing once the import thread runs.
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        pblockfilterindex.reset(new CBlockFilterIndex(nBlockFilterIndexCache));
+        RegisterValidationInterface(pblockfilterindex.get(), "blockfilterindex");
+    }
+    if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+        paddressindex.reset(new CAddressIndex(nAddressIndexCache, fAddressIndex, fSpentIndex, fTimestampIndex));
+        RegisterValidationInterface(paddressindex.get(), "addressindex");
+    }
+    if (fTxIndex) {
+        // Block positions change with a reindex, so the index starts over.
+        ptxindex.reset(new CTxIndex(nTxIndexCache, false, fReindex));
+        RegisterValidationInterface(ptxindex.get(), "txindex");
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1735,6 +2090,12 @@ bool AppInitMain()
 
     // ********************************************************* Step 10: data directory maintenance
 
+    // blocks are not stored at all in headers-only mode, so none can be served
+    if (fHeadersOnly) {
+        LogPrintf("Unsetting NODE_NETWORK and NODE_NETWORK_LIMITED on headers-only mode\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~(NODE_NETWORK | NODE_NETWORK_LIMITED));
+    }
+
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
     if (fPruneMode) {
@@ -1776,7 +2137,24 @@ bool AppInitMain()
         vImportFiles.push_back(strFile);
     }
 
+    // Started once the coins database is loaded and stays up, it reads from it.
+    threadGroup.create_thread(&ThreadBlockReadAhead);
+    threadGroup.create_thread(&ThreadBlockFileWriter);
+    if (gArgs.GetBoolArg("-speculativeassembly", DEFAULT_SPECULATIVE_ASSEMBLY) && gArgs.GetBoolArg("-incrementalassembly", DEFAULT_INCREMENTAL_ASSEMBLY)) {
+        RegisterValidationInterface(GetSpeculativeAssemblyInterface(), "speculativeassembly");
+        threadGroup.create_thread(&ThreadSpeculativeAssembly);
+    }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (pblockfilterindex) {
+        threadGroup.create_thread(boost::bind(&CBlockFilterIndex::ThreadSync, pblockfilterindex.get()));
+    }
+    if (paddressindex) {
+        threadGroup.create_thread(boost::bind(&CAddressIndex::ThreadSync, paddressindex.get()));
+    }
+    if (ptxindex) {
+        threadGroup.create_thread(boost::bind(&CTxIndex::ThreadSync, ptxindex.get()));
+    }
+    StartSnapshotValidation();
 
     // Wait for genesis block to be processed
     {
@@ -1876,33 +2254,10 @@ bool AppInitMain()
     // LOAD SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
 
     if (!fLiteMode) {
-        boost::filesystem::path pathDB = GetDataDir();
-        std::string strDBName;
-
-        strDBName = "mncache.dat";
         uiInterface.InitMessage(_("Loading masternode cache..."));
-        CFlatDB<CMasternodeMan> flatdb1(strDBName, "magicMasternodeCache");
-        if(!flatdb1.Load(mnodeman)) {
-            return InitError(_("Failed to load masternode cache from") + "\n" + (pathDB / strDBName).string());
-        }
-
-        if(mnodeman.size()) {
-            strDBName = "mnpayments.dat";
-            uiInterface.InitMessage(_("Loading masternode payment cache..."));
-            CFlatDB<CMasternodePayments> flatdb2(strDBName, "magicMasternodePaymentsCache");
-            if(!flatdb2.Load(mnpayments)) {
-                return InitError(_("Failed to load masternode payments cache from") + "\n" + (pathDB / strDBName).string());
-            }
-
-        } else {
-            uiInterface.InitMessage(_("Masternode cache is empty, skipping payments cache..."));
-        }
-
-        strDBName = "netfulfilled.dat";
-        uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
-        CFlatDB<CNetFulfilledRequestManager> flatdb4(strDBName, "magicFulfilledCache");
-        if(!flatdb4.Load(netfulfilledman)) {
-            return InitError(_("Failed to load fulfilled requests cache from") + "\n" + (pathDB / strDBName).string());
+        const std::string strCacheError = WaitForMasternodeCaches();
+        if (!strCacheError.empty()) {
+            return InitError(strCacheError);
         }
     }
 
@@ -1918,6 +2273,23 @@ bool AppInitMain()
 
     threadGroup.create_thread(boost::bind(&ThreadCheckMasternodes, boost::ref(*g_connman)));
 
+    if (!fLiteMode) {
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+            threadGroup.create_thread(&ThreadMasternodeSigCheck);
+            threadGroup.create_thread(&ThreadTxLockVoteCheck);
+        }
+    }
+
+    const int64_t nMempoolDumpInterval = gArgs.GetArg("-mempooldumpinterval", DEFAULT_MEMPOOL_DUMP_INTERVAL);
+    if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL) && nMempoolDumpInterval > 0) {
+        scheduler.scheduleEvery(PeriodicDumpMempool, nMempoolDumpInterval * 1000, CScheduler::PRIORITY_LOW, "mempool dump");
+    }
+
+    const int64_t nCacheFlushInterval = gArgs.GetArg("-mncacheflushinterval", DEFAULT_MNCACHE_FLUSH_INTERVAL);
+    if (!fLiteMode && nCacheFlushInterval > 0) {
+        scheduler.scheduleEvery(DumpMasternodeCaches, nCacheFlushInterval * 1000, CScheduler::PRIORITY_LOW, "masternode cache dump");
+    }
+
     // ********************************************************* Step 13: start node
 
     int chain_active_height;
@@ -1933,6 +2305,9 @@ bool AppInitMain()
     if (gArgs.GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl();
 
+    if (gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) && !StartStratumServer())
+        return InitError(_("Unable to start the stratum server. See debug log for details."));
+
     Discover();
 
     // Map ports with UPnP
@@ -1952,6 +2327,8 @@ bool AppInitMain()
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nMessageHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
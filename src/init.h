@@ -62,6 +62,9 @@ enum HelpMessageMode {
     HMM_BITCOIN_QT
 };
 
+/** The scheduler running the background tasks */
+const CScheduler& GetScheduler();
+
 /** Help for options shared between UI and daemon (for -help) */
 std::string HelpMessage(HelpMessageMode mode);
 /** Returns licensing information (for -version) */
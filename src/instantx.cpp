@@ -4,12 +4,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <activemasternode.h>
+#include <checkqueue.h>
 #include <instantx.h>
 #include <key.h>
 #include <validation.h>
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
+#include <memusage.h>
 #include <messagesigner.h>
 #include <net.h>
 #include <netmessagemaker.h>
@@ -25,6 +27,8 @@
 #include <wallet/wallet.h>
 #endif // ENABLE_WALLET
 
+#include <algorithm>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
@@ -36,6 +40,15 @@ int nCompleteTXLocks;
 
 CInstantSend instantsend;
 
+const std::string CInstantSend::SERIALIZATION_VERSION_STRING = "CInstantSend-Version-1";
+
+static CCheckQueue<CTxLockVoteCheck> txlockvotecheckqueue(128);
+
+void ThreadTxLockVoteCheck() {
+    RenameThread("globaltoken-txlvch");
+    txlockvotecheckqueue.Thread();
+}
+
 // Transaction Locks
 //
 // step 1) Some node announces intention to lock transaction inputs via "txlockrequest" message (ix)
@@ -76,17 +89,25 @@ void CInstantSend::ProcessMessage(CNode* pfrom, const std::string& strCommand, C
 
         {
             LOCK(cs_instantsend);
-            auto ret = mapTxLockVotes.emplace(nVoteHash, vote);
-            if (!ret.second) return;
+            if (!AddTxLockVote(nVoteHash, vote)) return;
         }
 
-        ProcessNewTxLockVote(pfrom, vote, connman);
+        // A lock request gets SIGNATURES_TOTAL votes per input at once, so queue
+        // them up while the peer has more messages waiting and check them together
+        bool fMoreWork;
+        {
+            LOCK(pfrom->cs_vProcessMsg);
+            fMoreWork = !pfrom->vProcessMsg.empty();
+        }
+        if (QueueTxLockVote(pfrom, vote) >= MAX_PENDING_TXLOCK_VOTES || !fMoreWork) {
+            ProcessPendingTxLockVotes(connman);
+        }
 
         return;
     }
 }
 
-bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman)
+bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman, bool fCheckInputs)
 {
     LOCK(cs_main);
             
@@ -100,7 +121,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
 
         // Check to see if we conflict with existing completed lock
         for (const auto& txin : txLockRequest.tx->vin) {
-            std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(txin.prevout);
+            auto it = mapLockedOutpoints.find(txin.prevout);
             if(it != mapLockedOutpoints.end() && it->second != txLockRequest.GetHash()) {
                 // Conflicting with complete lock, proceed to see if we should cancel them both
                 LogPrintf("CInstantSend::ProcessTxLockRequest -- WARNING: Found conflicting completed Transaction Lock, txid=%s, completed lock txid=%s\n",
@@ -111,7 +132,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
         // Check to see if there are votes for conflicting request,
         // if so - do not fail, just warn user
         for (const auto& txin : txLockRequest.tx->vin) {
-            std::map<COutPoint, std::set<uint256> >::iterator it = mapVotedOutpoints.find(txin.prevout);
+            auto it = mapVotedOutpoints.find(txin.prevout);
             if(it != mapVotedOutpoints.end()) {
                 for (const auto& hash : it->second) {
                     if(hash != txLockRequest.GetHash()) {
@@ -123,7 +144,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
             }
         }
 
-        if(!CreateTxLockCandidate(txLockRequest)) {
+        if(!CreateTxLockCandidate(txLockRequest, fCheckInputs)) {
             // smth is not right
             LogPrintf("CInstantSend::ProcessTxLockRequest -- CreateTxLockCandidate failed, txid=%s\n", txHash.ToString());
             return false;
@@ -134,11 +155,11 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
         // If this just happened - process orphan votes, lock inputs, resolve conflicting locks,
         // update transaction status forcing external script/zmq notifications.
 #ifdef ENABLE_WALLET
-        ProcessOrphanTxLockVotes(pwallet);
+        ProcessOrphanTxLockVotes(txHash, pwallet);
 #else
-        ProcessOrphanTxLockVotes();
+        ProcessOrphanTxLockVotes(txHash);
 #endif
-        std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+        auto itLockCandidate = mapTxLockCandidates.find(txHash);
 #ifdef ENABLE_WALLET
         TryToFinalizeLockCandidate(itLockCandidate->second, pwallet);
 #else
@@ -150,15 +171,15 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
     return true;
 }
 
-bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
+bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest, bool fCheckInputs)
 {
-    if(!txLockRequest.IsValid()) return false;
+    if(!txLockRequest.IsValid(fCheckInputs)) return false;
 
     LOCK(cs_instantsend);
 
     uint256 txHash = txLockRequest.GetHash();
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) {
         LogPrintf("CInstantSend::CreateTxLockCandidate -- new, txid=%s\n", txHash.ToString());
 
@@ -195,6 +216,50 @@ void CInstantSend::CreateEmptyTxLockCandidate(const uint256& txHash)
     LogPrintf("CInstantSend::CreateEmptyTxLockCandidate -- new, txid=%s\n", txHash.ToString());
     const CTxLockRequest txLockRequest = CTxLockRequest();
     mapTxLockCandidates.insert(std::make_pair(txHash, CTxLockCandidate(txLockRequest)));
+
+    // Votes for unknown txes are free to make, so only keep the newest empty candidates
+    dequeEmptyCandidates.push_back(txHash);
+    while (dequeEmptyCandidates.size() > MAX_EMPTY_TXLOCK_CANDIDATES) {
+        auto it = mapTxLockCandidates.find(dequeEmptyCandidates.front());
+        if (it != mapTxLockCandidates.end() && !it->second.txLockRequest) {
+            LogPrint(BCLog::INSTANTSEND, "CInstantSend::CreateEmptyTxLockCandidate -- too many, removing txid=%s\n", it->first.ToString());
+            mapTxLockCandidates.erase(it);
+        }
+        dequeEmptyCandidates.pop_front();
+    }
+}
+
+bool CInstantSend::AddTxLockVote(const uint256& nVoteHash, const CTxLockVote& vote)
+{
+    AssertLockHeld(cs_instantsend);
+
+    if (!mapTxLockVotes.emplace(nVoteHash, vote).second)
+        return false;
+    dequeVotesByTime.emplace_back(vote.GetTimeCreated(), nVoteHash);
+
+    while (mapTxLockVotes.size() > MAX_TXLOCK_VOTES && !dequeVotesByTime.empty()) {
+        const uint256& hash = dequeVotesByTime.front().second;
+        if (hash != nVoteHash) {
+            mapTxLockVotes.erase(hash);
+            EraseOrphanTxLockVote(hash);
+        }
+        dequeVotesByTime.pop_front();
+    }
+    return true;
+}
+
+void CInstantSend::SetCandidateConfirmedHeight(const uint256& txHash, CTxLockCandidate& txLockCandidate, int nHeight)
+{
+    txLockCandidate.SetConfirmedHeight(nHeight);
+    if (nHeight != -1)
+        mapCandidatesByConfirmedHeight[nHeight].push_back(txHash);
+}
+
+void CInstantSend::SetVoteConfirmedHeight(const uint256& nVoteHash, CTxLockVote& vote, int nHeight)
+{
+    vote.SetConfirmedHeight(nHeight);
+    if (nHeight != -1)
+        mapVotesByConfirmedHeight[nHeight].push_back(nVoteHash);
 }
 
 void CInstantSend::Vote(const uint256& txHash, CConnman& connman)
@@ -269,14 +334,14 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 
         LogPrint(BCLog::INSTANTSEND, "CInstantSend::Vote -- In the top %d (%d)\n", nSignaturesTotal, nRank);
 
-        std::map<COutPoint, std::set<uint256> >::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
+        auto itVoted = mapVotedOutpoints.find(itOutpointLock->first);
 
         // Check to see if we already voted for this outpoint,
         // refuse to vote twice or to include the same outpoint in another tx
         bool fAlreadyVoted = false;
         if(itVoted != mapVotedOutpoints.end()) {
             for (const auto& hash : itVoted->second) {
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                auto it2 = mapTxLockCandidates.find(hash);
                 if(it2->second.HasMasternodeVoted(itOutpointLock->first, activeMasternode.outpoint)) {
                     // we already voted for this outpoint to be included either in the same tx or in a competing one,
                     // skip it anyway
@@ -306,7 +371,7 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 
         // vote constructed sucessfully, let's store and relay it
         uint256 nVoteHash = vote.GetHash();
-        mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        AddTxLockVote(nVoteHash, vote);
         if(itOutpointLock->second.AddVote(vote)) {
             LogPrintf("CInstantSend::Vote -- Vote created successfully, relaying: txHash=%s, outpoint=%s, vote=%s\n",
                     txHash.ToString(), itOutpointLock->first.ToStringShort(), nVoteHash.ToString());
@@ -331,91 +396,194 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
     }
 }
 
-bool CInstantSend::ProcessNewTxLockVote(CNode* pfrom, const CTxLockVote& vote, CConnman& connman)
+size_t CInstantSend::QueueTxLockVote(CNode* pfrom, const CTxLockVote& vote)
 {
-    uint256 txHash = vote.GetTxHash();
-    uint256 nVoteHash = vote.GetHash();
+    LOCK(cs_vecPendingVotes);
+    pfrom->AddRef();
+    vecPendingVotes.emplace_back(pfrom, vote);
+    return vecPendingVotes.size();
+}
 
-    if(!vote.IsValid(pfrom, connman)) {
-        // could be because of missing MN
-        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Vote is invalid, txid=%s\n", __func__, txHash.ToString());
-        return false;
+void CInstantSend::ProcessPendingTxLockVotes(CConnman& connman)
+{
+    std::vector<std::pair<CNode*, CTxLockVote> > vecVotes;
+    {
+        LOCK(cs_vecPendingVotes);
+        vecVotes.swap(vecPendingVotes);
+    }
+    if (vecVotes.empty()) return;
+
+    // Ranks need the masternode list and the UTXO set, so look them up one
+    // by one, then check all the signatures at once, without cs_instantsend
+    std::vector<char> vValid(vecVotes.size(), 0);
+    std::vector<CTxLockVoteCheck> vChecks;
+    vChecks.reserve(vecVotes.size());
+    for (size_t i = 0; i < vecVotes.size(); i++) {
+        const CTxLockVote& vote = vecVotes[i].second;
+        if (!mnodeman.Has(vote.GetMasternodeOutpoint())) {
+            // keep it until we learn about the masternode, the vote won't be sent to us again
+            mnodeman.AskForMN(vecVotes[i].first, vote.GetMasternodeOutpoint(), connman);
+            LOCK(cs_vecPendingVotes);
+            if (nVotesWaitingForMasternode < MAX_VOTES_WAITING_FOR_MASTERNODE) {
+                LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Unknown masternode %s, txid=%s\n", __func__,
+                        vote.GetMasternodeOutpoint().ToStringShort(), vote.GetTxHash().ToString());
+                mapVotesWaitingForMasternode[vote.GetMasternodeOutpoint()].push_back(vote);
+                nVotesWaitingForMasternode++;
+            }
+            continue;
+        }
+        CPubKey pubKeyMasternode;
+        if (!vote.IsValidRank(vecVotes[i].first, connman, pubKeyMasternode)) {
+            // could be because of missing MN
+            LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Vote is invalid, txid=%s\n", __func__, vote.GetTxHash().ToString());
+            continue;
+        }
+        vChecks.emplace_back(vote, pubKeyMasternode, vValid[i]);
     }
 
-    // relay valid vote asap
-    vote.Relay(connman);
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- checking %d signatures for %d votes\n", __func__, vChecks.size(), vecVotes.size());
+        CCheckQueueControl<CTxLockVoteCheck> control(&txlockvotecheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (auto& check : vChecks) {
+            check();
+        }
+    }
 
-    LOCK(cs_main);
+    std::vector<const CTxLockVote*> vecAccepted;
+    for (size_t i = 0; i < vecVotes.size(); i++) {
+        if (!vValid[i]) continue;
+        // relay valid vote asap
+        vecVotes[i].second.Relay(connman);
+        vecAccepted.push_back(&vecVotes[i].second);
+    }
+
+    if (!vecAccepted.empty()) {
+        LOCK(cs_main);
 #ifdef ENABLE_WALLET
-    for (CWalletRef pwallet : vpwallets) {
-        LOCK(pwallet->cs_wallet);
+        for (CWalletRef pwallet : vpwallets) {
+            LOCK(pwallet->cs_wallet);
 #endif
-        LOCK2(mempool.cs, cs_instantsend);
+            LOCK2(mempool.cs, cs_instantsend);
+            for (const CTxLockVote* pvote : vecAccepted) {
+#ifdef ENABLE_WALLET
+                ApplyTxLockVote(*pvote, pwallet);
+#else
+                ApplyTxLockVote(*pvote);
+#endif
+            }
+#ifdef ENABLE_WALLET
+        }
+#endif
+    }
 
-        // Masternodes will sometimes propagate votes before the transaction is known to the client,
-        // will actually process only after the lock request itself has arrived
+    for (auto& entry : vecVotes) {
+        if (entry.first)
+            entry.first->Release();
+    }
+}
 
-        std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
-        if(it == mapTxLockCandidates.end() || !it->second.txLockRequest) {
-            // no or empty tx lock candidate
-            if(it == mapTxLockCandidates.end()) {
-                // start timeout countdown after the very first vote
-                CreateEmptyTxLockCandidate(txHash);
-            }
-            bool fInserted = mapTxLockVotesOrphan.emplace(nVoteHash, vote).second;
-            LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Orphan vote: txid=%s  masternode=%s %s\n",
-                    __func__, txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort(), fInserted ? "new" : "seen");
+void CInstantSend::ProcessVotesWaitingForMasternode(const COutPoint& outpointMasternode, CConnman& connman)
+{
+    {
+        LOCK(cs_vecPendingVotes);
+        auto it = mapVotesWaitingForMasternode.find(outpointMasternode);
+        if (it == mapVotesWaitingForMasternode.end()) return;
+        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- %d votes of masternode %s\n", __func__, it->second.size(), outpointMasternode.ToStringShort());
+        for (auto& vote : it->second) {
+            vecPendingVotes.emplace_back(nullptr, std::move(vote));
+        }
+        nVotesWaitingForMasternode -= it->second.size();
+        mapVotesWaitingForMasternode.erase(it);
+    }
+    ProcessPendingTxLockVotes(connman);
+}
 
-            // This tracks those messages and allows only the same rate as of the rest of the network
-            // TODO: make sure this works good enough for multi-quorum
+#ifdef ENABLE_WALLET
+bool CInstantSend::ApplyTxLockVote(const CTxLockVote& vote, CWallet *wallet)
+#else
+bool CInstantSend::ApplyTxLockVote(const CTxLockVote& vote)
+#endif
+{
+    AssertLockHeld(cs_main);
+#ifdef ENABLE_WALLET
+    if(wallet)
+        AssertLockHeld(wallet->cs_wallet);
+#endif
+    AssertLockHeld(cs_instantsend);
 
-            int nMasternodeOrphanExpireTime = GetTime() + 60*10; // keep time data for 10 minutes
-            auto itMnOV = mapMasternodeOrphanVotes.find(vote.GetMasternodeOutpoint());
-            if(itMnOV == mapMasternodeOrphanVotes.end()) {
-                mapMasternodeOrphanVotes.emplace(vote.GetMasternodeOutpoint(), nMasternodeOrphanExpireTime);
-            } else {
-                if(itMnOV->second > GetTime() && itMnOV->second > GetAverageMasternodeOrphanVoteTime()) {
-                    LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- masternode is spamming orphan Transaction Lock Votes: txid=%s  masternode=%s\n",
-                            __func__, txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort());
-                    // Misbehaving(pfrom->id, 1);
-                    return false;
-                }
-                // not spamming, refresh
-                itMnOV->second = nMasternodeOrphanExpireTime;
-            }
+    uint256 txHash = vote.GetTxHash();
+    uint256 nVoteHash = vote.GetHash();
+
+    // Masternodes will sometimes propagate votes before the transaction is known to the client,
+    // will actually process only after the lock request itself has arrived
 
-            return true;
+    auto it = mapTxLockCandidates.find(txHash);
+    if(it == mapTxLockCandidates.end() || !it->second.txLockRequest) {
+        // no or empty tx lock candidate
+        if(it == mapTxLockCandidates.end()) {
+            // start timeout countdown after the very first vote
+            CreateEmptyTxLockCandidate(txHash);
+        }
+        bool fInserted = mapTxLockVotesOrphan.emplace(nVoteHash, vote).second;
+        if (fInserted) {
+            mapTxLockVotesOrphanByTx[txHash].insert(nVoteHash);
+            dequeOrphanVotesByTime.emplace_back(vote.GetTimeCreated(), nVoteHash);
         }
+        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Orphan vote: txid=%s  masternode=%s %s\n",
+                __func__, txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort(), fInserted ? "new" : "seen");
 
-        // We have a valid (non-empty) tx lock candidate
-        CTxLockCandidate& txLockCandidate = it->second;
+        // This tracks those messages and allows only the same rate as of the rest of the network
+        // TODO: make sure this works good enough for multi-quorum
 
-        if (txLockCandidate.IsTimedOut()) {
-            LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- too late, Transaction Lock timed out, txid=%s\n", __func__, txHash.ToString());
-            return false;
+        int nMasternodeOrphanExpireTime = GetTime() + 60*10; // keep time data for 10 minutes
+        auto itMnOV = mapMasternodeOrphanVotes.find(vote.GetMasternodeOutpoint());
+        if(itMnOV == mapMasternodeOrphanVotes.end()) {
+            mapMasternodeOrphanVotes.emplace(vote.GetMasternodeOutpoint(), nMasternodeOrphanExpireTime);
+        } else {
+            if(itMnOV->second > GetTime() && itMnOV->second > GetAverageMasternodeOrphanVoteTime()) {
+                LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- masternode is spamming orphan Transaction Lock Votes: txid=%s  masternode=%s\n",
+                        __func__, txHash.ToString(), vote.GetMasternodeOutpoint().ToStringShort());
+                // Misbehaving(pfrom->id, 1);
+                return false;
+            }
+            // not spamming, refresh
+            itMnOV->second = nMasternodeOrphanExpireTime;
         }
 
-        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Transaction Lock Vote, txid=%s\n", __func__, txHash.ToString());
+        return true;
+    }
+
+    // We have a valid (non-empty) tx lock candidate
+    CTxLockCandidate& txLockCandidate = it->second;
 
-        UpdateVotedOutpoints(vote, txLockCandidate);
+    if (txLockCandidate.IsTimedOut()) {
+        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- too late, Transaction Lock timed out, txid=%s\n", __func__, txHash.ToString());
+        return false;
+    }
 
-        if(!txLockCandidate.AddVote(vote)) {
-            // this should never happen
-            return false;
-        }
+    LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Transaction Lock Vote, txid=%s\n", __func__, txHash.ToString());
 
-        int nSignatures = txLockCandidate.CountVotes();
-        int nSignaturesMax = txLockCandidate.txLockRequest.GetMaxSignatures();
-        LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Transaction Lock signatures count: %d/%d, vote hash=%s\n", __func__,
-                nSignatures, nSignaturesMax, nVoteHash.ToString());
+    UpdateVotedOutpoints(vote, txLockCandidate);
+
+    if(!txLockCandidate.AddVote(vote)) {
+        // this should never happen
+        return false;
+    }
+    // more votes can arrive for a completed lock
+    UpdateLockedTx(txHash);
+
+    int nSignatures = txLockCandidate.CountVotes();
+    int nSignaturesMax = txLockCandidate.txLockRequest.GetMaxSignatures();
+    LogPrint(BCLog::INSTANTSEND, "CInstantSend::%s -- Transaction Lock signatures count: %d/%d, vote hash=%s\n", __func__,
+            nSignatures, nSignaturesMax, nVoteHash.ToString());
 
 #ifdef ENABLE_WALLET
-        TryToFinalizeLockCandidate(txLockCandidate, pwallet);
+    TryToFinalizeLockCandidate(txLockCandidate, wallet);
 #else
-        TryToFinalizeLockCandidate(txLockCandidate);
-#endif
-#ifdef ENABLE_WALLET
-    }
+    TryToFinalizeLockCandidate(txLockCandidate);
 #endif
     return true;
 }
@@ -437,7 +605,7 @@ bool CInstantSend::ProcessOrphanTxLockVote(const CTxLockVote& vote)
     uint256 txHash = vote.GetTxHash();
 
     // We shouldn't process orphan votes without a valid tx lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    auto it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end() || !it->second.txLockRequest)
         return false; // this shouldn never happen
 
@@ -456,6 +624,8 @@ bool CInstantSend::ProcessOrphanTxLockVote(const CTxLockVote& vote)
         // this should never happen
         return false;
     }
+    // more votes can arrive for a completed lock
+    UpdateLockedTx(txHash);
 
     int nSignatures = txLockCandidate.CountVotes();
     int nSignaturesMax = txLockCandidate.txLockRequest.GetMaxSignatures();
@@ -471,14 +641,14 @@ void CInstantSend::UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidat
 
     uint256 txHash = vote.GetTxHash();
 
-    std::map<COutPoint, std::set<uint256> >::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
+    auto it1 = mapVotedOutpoints.find(vote.GetOutpoint());
     if(it1 != mapVotedOutpoints.end()) {
         for (const auto& hash : it1->second) {
             if(hash != txHash) {
                 // same outpoint was already voted to be locked by another tx lock request,
                 // let's see if it was the same masternode who voted on this outpoint
                 // for another tx lock request
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                auto it2 = mapTxLockCandidates.find(hash);
                 if(it2 !=mapTxLockCandidates.end() && it2->second.HasMasternodeVoted(vote.GetOutpoint(), vote.GetMasternodeOutpoint())) {
                     // yes, it was the same masternode
                     LogPrintf("CInstantSend::%s -- masternode sent conflicting votes! %s\n", __func__, vote.GetMasternodeOutpoint().ToStringShort());
@@ -502,25 +672,44 @@ void CInstantSend::UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidat
     }
 }
 
+void CInstantSend::EraseOrphanTxLockVote(const uint256& nVoteHash)
+{
+    AssertLockHeld(cs_instantsend);
+
+    auto it = mapTxLockVotesOrphan.find(nVoteHash);
+    if (it == mapTxLockVotesOrphan.end()) return;
+    auto itByTx = mapTxLockVotesOrphanByTx.find(it->second.GetTxHash());
+    if (itByTx != mapTxLockVotesOrphanByTx.end()) {
+        itByTx->second.erase(nVoteHash);
+        if (itByTx->second.empty())
+            mapTxLockVotesOrphanByTx.erase(itByTx);
+    }
+    mapTxLockVotesOrphan.erase(it);
+}
+
 #ifdef ENABLE_WALLET
-void CInstantSend::ProcessOrphanTxLockVotes(CWallet *wallet)
+void CInstantSend::ProcessOrphanTxLockVotes(const uint256& txHash, CWallet *wallet)
 #else
-void CInstantSend::ProcessOrphanTxLockVotes()
+void CInstantSend::ProcessOrphanTxLockVotes(const uint256& txHash)
 #endif
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
+    auto itByTx = mapTxLockVotesOrphanByTx.find(txHash);
+    if (itByTx == mapTxLockVotesOrphanByTx.end()) return;
+
+    // orphan votes only wait for their own lock request, so that is all there is to retry
+    const std::set<uint256> setVoteHashes = itByTx->second;
+    for (const uint256& nVoteHash : setVoteHashes) {
+        auto it = mapTxLockVotesOrphan.find(nVoteHash);
+        if (it == mapTxLockVotesOrphan.end()) continue;
 #ifdef ENABLE_WALLET
         if(ProcessOrphanTxLockVote(it->second, wallet)) {
 #else
         if(ProcessOrphanTxLockVote(it->second)) {
 #endif
-            mapTxLockVotesOrphan.erase(it++);
-        } else {
-            ++it;
+            EraseOrphanTxLockVote(nVoteHash);
         }
     }
 }
@@ -570,6 +759,8 @@ void CInstantSend::UpdateLockedTransaction(const CTxLockCandidate& txLockCandida
 
     if(!IsLockedInstantSendTransaction(txHash)) return; // not a locked tx, do not update/notify
 
+    mempool.SetInstantSendLocked(txHash);
+
 #ifdef ENABLE_WALLET
         if(wallet) {
         {
@@ -615,13 +806,14 @@ void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate
         mapLockedOutpoints.insert(std::make_pair(it->first, txHash));
         ++it;
     }
+    UpdateLockedTx(txHash);
     LogPrint(BCLog::INSTANTSEND, "CInstantSend::LockTransactionInputs -- done, txid=%s\n", txHash.ToString());
 }
 
 bool CInstantSend::GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet)
 {
     LOCK(cs_instantsend);
-    std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(outpoint);
+    auto it = mapLockedOutpoints.find(outpoint);
     if(it == mapLockedOutpoints.end()) return false;
     hashRet = it->second;
     return true;
@@ -644,8 +836,8 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
         if(GetLockedOutPointTxHash(txin.prevout, hashConflicting) && txHash != hashConflicting) {
             // completed lock which conflicts with another completed one?
             // this means that majority of MNs in the quorum for this specific tx input are malicious!
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
+            auto itLockCandidate = mapTxLockCandidates.find(txHash);
+            auto itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
             if(itLockCandidate == mapTxLockCandidates.end() || itLockCandidateConflicting == mapTxLockCandidates.end()) {
                 // safety check, should never really happen
                 LogPrintf("CInstantSend::ResolveConflicts -- ERROR: Found conflicting completed Transaction Lock, but one of txLockCandidate-s is missing, txid=%s, conflicting txid=%s\n",
@@ -656,8 +848,8 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
                     txHash.ToString(), hashConflicting.ToString());
             CTxLockRequest txLockRequest = itLockCandidate->second.txLockRequest;
             CTxLockRequest txLockRequestConflicting = itLockCandidateConflicting->second.txLockRequest;
-            itLockCandidate->second.SetConfirmedHeight(0); // expired
-            itLockCandidateConflicting->second.SetConfirmedHeight(0); // expired
+            SetCandidateConfirmedHeight(txHash, itLockCandidate->second, 0); // expired
+            SetCandidateConfirmedHeight(hashConflicting, itLockCandidateConflicting->second, 0); // expired
             CheckAndRemove(); // clean up
             // AlreadyHave should still return "true" for both of them
             mapLockRequestRejected.insert(std::make_pair(txHash, txLockRequest));
@@ -709,7 +901,7 @@ int64_t CInstantSend::GetAverageMasternodeOrphanVoteTime()
     // NOTE: should never actually call this function when mapMasternodeOrphanVotes is empty
     if(mapMasternodeOrphanVotes.empty()) return 0;
 
-    std::map<COutPoint, int64_t>::iterator it = mapMasternodeOrphanVotes.begin();
+    auto it = mapMasternodeOrphanVotes.begin();
     int64_t total = 0;
 
     while(it != mapMasternodeOrphanVotes.end()) {
@@ -726,67 +918,93 @@ void CInstantSend::CheckAndRemove()
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
+    const int nKeepLock = Params().GetConsensus().nInstantSendKeepLock;
+    const int64_t nNow = GetTime();
 
     // remove expired candidates
-    while(itLockCandidate != mapTxLockCandidates.end()) {
-        CTxLockCandidate &txLockCandidate = itLockCandidate->second;
-        uint256 txHash = txLockCandidate.GetHash();
-        if(txLockCandidate.IsExpired(nCachedBlockHeight)) {
+    auto itCandidateBucket = mapCandidatesByConfirmedHeight.begin();
+    while(itCandidateBucket != mapCandidatesByConfirmedHeight.end() && nCachedBlockHeight - itCandidateBucket->first > nKeepLock) {
+        for (const uint256& txHash : itCandidateBucket->second) {
+            auto itLockCandidate = mapTxLockCandidates.find(txHash);
+            if(itLockCandidate == mapTxLockCandidates.end() || !itLockCandidate->second.IsExpired(nCachedBlockHeight)) continue;
             LogPrintf("CInstantSend::CheckAndRemove -- Removing expired Transaction Lock Candidate: txid=%s\n", txHash.ToString());
-            std::map<COutPoint, COutPointLock>::iterator itOutpointLock = txLockCandidate.mapOutPointLocks.begin();
-            while(itOutpointLock != txLockCandidate.mapOutPointLocks.end()) {
-                mapLockedOutpoints.erase(itOutpointLock->first);
-                mapVotedOutpoints.erase(itOutpointLock->first);
-                ++itOutpointLock;
+            for (const auto& outpointLock : itLockCandidate->second.mapOutPointLocks) {
+                mapLockedOutpoints.erase(outpointLock.first);
+                mapVotedOutpoints.erase(outpointLock.first);
             }
             mapLockRequestAccepted.erase(txHash);
             mapLockRequestRejected.erase(txHash);
-            mapTxLockCandidates.erase(itLockCandidate++);
-        } else {
-            ++itLockCandidate;
+            mapTxLockCandidates.erase(itLockCandidate);
         }
+        itCandidateBucket = mapCandidatesByConfirmedHeight.erase(itCandidateBucket);
     }
+    UpdateLockedTxes();
 
     // remove expired votes
-    std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
-        if(itVote->second.IsExpired(nCachedBlockHeight)) {
+    auto itVoteBucket = mapVotesByConfirmedHeight.begin();
+    while(itVoteBucket != mapVotesByConfirmedHeight.end() && nCachedBlockHeight - itVoteBucket->first > nKeepLock) {
+        for (const uint256& nVoteHash : itVoteBucket->second) {
+            auto itVote = mapTxLockVotes.find(nVoteHash);
+            if(itVote == mapTxLockVotes.end() || !itVote->second.IsExpired(nCachedBlockHeight)) continue;
             LogPrint(BCLog::INSTANTSEND, "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  masternode=%s\n",
                     itVote->second.GetTxHash().ToString(), itVote->second.GetMasternodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
-        } else {
-            ++itVote;
+            mapTxLockVotes.erase(itVote);
         }
+        itVoteBucket = mapVotesByConfirmedHeight.erase(itVoteBucket);
     }
 
     // remove timed out orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.IsTimedOut()) {
+    while(!dequeOrphanVotesByTime.empty() && nNow - dequeOrphanVotesByTime.front().first > INSTANTSEND_LOCK_TIMEOUT_SECONDS) {
+        auto itOrphanVote = mapTxLockVotesOrphan.find(dequeOrphanVotesByTime.front().second);
+        if(itOrphanVote != mapTxLockVotesOrphan.end() && itOrphanVote->second.IsTimedOut()) {
             LogPrint(BCLog::INSTANTSEND, "CInstantSend::CheckAndRemove -- Removing timed out orphan vote: txid=%s  masternode=%s\n",
                     itOrphanVote->second.GetTxHash().ToString(), itOrphanVote->second.GetMasternodeOutpoint().ToStringShort());
             mapTxLockVotes.erase(itOrphanVote->first);
-            mapTxLockVotesOrphan.erase(itOrphanVote++);
-        } else {
-            ++itOrphanVote;
+            EraseOrphanTxLockVote(itOrphanVote->first);
         }
+        dequeOrphanVotesByTime.pop_front();
     }
 
-    // remove invalid votes and votes for failed lock attempts
-    itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
+    // remove votes that waited too long for their masternode to be announced
+    {
+        LOCK(cs_vecPendingVotes);
+        auto itWaiting = mapVotesWaitingForMasternode.begin();
+        while(itWaiting != mapVotesWaitingForMasternode.end()) {
+            std::vector<CTxLockVote>& vecVotes = itWaiting->second;
+            size_t nSizeBefore = vecVotes.size();
+            vecVotes.erase(std::remove_if(vecVotes.begin(), vecVotes.end(), [nNow](const CTxLockVote& vote) {
+                return nNow - vote.GetTimeCreated() > INSTANTSEND_FAILED_TIMEOUT_SECONDS;
+            }), vecVotes.end());
+            nVotesWaitingForMasternode -= nSizeBefore - vecVotes.size();
+            if (vecVotes.empty()) {
+                itWaiting = mapVotesWaitingForMasternode.erase(itWaiting);
+            } else {
+                ++itWaiting;
+            }
+        }
+    }
+
+    // remove invalid votes and votes for failed lock attempts,
+    // votes for completed locks are looked at again a timeout later
+    std::vector<uint256> vecVotesToRecheck;
+    while(!dequeVotesByTime.empty() && nNow - dequeVotesByTime.front().first > INSTANTSEND_FAILED_TIMEOUT_SECONDS) {
+        auto itVote = mapTxLockVotes.find(dequeVotesByTime.front().second);
+        dequeVotesByTime.pop_front();
+        if(itVote == mapTxLockVotes.end()) continue;
         if(itVote->second.IsFailed()) {
             LogPrint(BCLog::INSTANTSEND, "CInstantSend::CheckAndRemove -- Removing vote for failed lock attempt: txid=%s  masternode=%s\n",
                     itVote->second.GetTxHash().ToString(), itVote->second.GetMasternodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
+            mapTxLockVotes.erase(itVote);
         } else {
-            ++itVote;
+            vecVotesToRecheck.push_back(itVote->first);
         }
     }
+    for (const uint256& nVoteHash : vecVotesToRecheck) {
+        dequeVotesByTime.emplace_back(nNow, nVoteHash);
+    }
 
     // remove timed out masternode orphan votes (DOS protection)
-    std::map<COutPoint, int64_t>::iterator itMasternodeOrphan = mapMasternodeOrphanVotes.begin();
+    auto itMasternodeOrphan = mapMasternodeOrphanVotes.begin();
     while(itMasternodeOrphan != mapMasternodeOrphanVotes.end()) {
         if(itMasternodeOrphan->second < GetTime()) {
             LogPrint(BCLog::INSTANTSEND, "CInstantSend::CheckAndRemove -- Removing timed out orphan masternode vote: masternode=%s\n",
@@ -829,7 +1047,7 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    auto it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end() || !it->second.txLockRequest) return false;
     txLockRequestRet = it->second.txLockRequest;
 
@@ -840,7 +1058,7 @@ bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotes.find(hash);
+    auto it = mapTxLockVotes.find(hash);
     if(it == mapTxLockVotes.end()) return false;
     txLockVoteRet = it->second;
 
@@ -855,19 +1073,16 @@ bool CInstantSend::IsInstantSendReadyToLock(const uint256& txHash)
     LOCK(cs_instantsend);
     // There must be a successfully verified lock request
     // and all outputs must be locked (i.e. have enough signatures)
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    auto it = mapTxLockCandidates.find(txHash);
     return it != mapTxLockCandidates.end() && it->second.IsAllOutPointsReady();
 }
 
-bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
+bool CInstantSend::IsTxLockComplete(const uint256& txHash)
 {
-    if(!fEnableInstantSend || GetfLargeWorkForkFound() || GetfLargeWorkInvalidChainFound() ||
-        !sporkManager.IsSporkActive(SPORK_2_INSTANTSEND_BLOCK_FILTERING)) return false;
-
-    LOCK(cs_instantsend);
+    AssertLockHeld(cs_instantsend);
 
     // there must be a lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) return false;
 
     // which should have outpoints
@@ -884,15 +1099,72 @@ bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
     return true;
 }
 
+void CInstantSend::UpdateLockedTx(const uint256& txHash)
+{
+    AssertLockHeld(cs_instantsend);
+
+    std::shared_ptr<const locked_tx_map_t> pLocked = std::atomic_load(&pLockedTxes);
+    auto itLocked = pLocked ? pLocked->find(txHash) : locked_tx_map_t::const_iterator();
+    bool fWasLocked = pLocked && itLocked != pLocked->end();
+
+    if (!IsTxLockComplete(txHash)) {
+        if (!fWasLocked) return;
+        auto pNew = std::make_shared<locked_tx_map_t>(*pLocked);
+        pNew->erase(txHash);
+        std::atomic_store(&pLockedTxes, std::shared_ptr<const locked_tx_map_t>(pNew));
+        return;
+    }
+
+    int nSignatures = mapTxLockCandidates.at(txHash).CountVotes();
+    if (fWasLocked && itLocked->second == nSignatures) return;
+    auto pNew = pLocked ? std::make_shared<locked_tx_map_t>(*pLocked) : std::make_shared<locked_tx_map_t>();
+    (*pNew)[txHash] = nSignatures;
+    std::atomic_store(&pLockedTxes, std::shared_ptr<const locked_tx_map_t>(pNew));
+}
+
+void CInstantSend::UpdateLockedTxes()
+{
+    AssertLockHeld(cs_instantsend);
+
+    std::shared_ptr<const locked_tx_map_t> pLocked = std::atomic_load(&pLockedTxes);
+    if (!pLocked) return;
+
+    // removing candidates or locked outpoints can only complete fewer locks
+    auto pNew = std::make_shared<locked_tx_map_t>();
+    for (const auto& entry : *pLocked) {
+        if (IsTxLockComplete(entry.first)) {
+            pNew->emplace(entry.first, mapTxLockCandidates.at(entry.first).CountVotes());
+        }
+    }
+    if (pNew->size() != pLocked->size()) {
+        std::atomic_store(&pLockedTxes, std::shared_ptr<const locked_tx_map_t>(pNew));
+    }
+}
+
+bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
+{
+    if(!fEnableInstantSend || GetfLargeWorkForkFound() || GetfLargeWorkInvalidChainFound() ||
+        !sporkManager.IsSporkActive(SPORK_2_INSTANTSEND_BLOCK_FILTERING)) return false;
+
+    std::shared_ptr<const locked_tx_map_t> pLocked = std::atomic_load(&pLockedTxes);
+    return pLocked && pLocked->count(txHash);
+}
+
 int CInstantSend::GetTransactionLockSignatures(const uint256& txHash)
 {
     if(!fEnableInstantSend) return -1;
     if(GetfLargeWorkForkFound() || GetfLargeWorkInvalidChainFound()) return -2;
     if(!sporkManager.IsSporkActive(SPORK_1_INSTANTSEND_ENABLED)) return -3;
 
+    std::shared_ptr<const locked_tx_map_t> pLocked = std::atomic_load(&pLockedTxes);
+    if (pLocked) {
+        auto itLocked = pLocked->find(txHash);
+        if (itLocked != pLocked->end()) return itLocked->second;
+    }
+
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         return itLockCandidate->second.CountVotes();
     }
@@ -913,7 +1185,7 @@ bool CInstantSend::IsTxLockCandidateTimedOut(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         return !itLockCandidate->second.IsAllOutPointsReady() &&
                 itLockCandidate->second.IsTimedOut();
@@ -926,7 +1198,7 @@ void CInstantSend::Relay(const uint256& txHash, CConnman& connman)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         itLockCandidate->second.Relay(connman);
     }
@@ -957,25 +1229,24 @@ void CInstantSend::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex
     LogPrint(BCLog::INSTANTSEND, "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d\n", txHash.ToString(), nHeightNew);
 
     // Check lock candidates
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    auto itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         LogPrint(BCLog::INSTANTSEND, "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d lock candidate updated\n",
                 txHash.ToString(), nHeightNew);
-        itLockCandidate->second.SetConfirmedHeight(nHeightNew);
+        SetCandidateConfirmedHeight(txHash, itLockCandidate->second, nHeightNew);
         // Loop through outpoint locks
         std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.begin();
         while(itOutpointLock != itLockCandidate->second.mapOutPointLocks.end()) {
             // Check corresponding lock votes
             std::vector<CTxLockVote> vVotes = itOutpointLock->second.GetVotes();
             std::vector<CTxLockVote>::iterator itVote = vVotes.begin();
-            std::map<uint256, CTxLockVote>::iterator it;
             while(itVote != vVotes.end()) {
                 uint256 nVoteHash = itVote->GetHash();
                 LogPrint(BCLog::INSTANTSEND, "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
                         txHash.ToString(), nHeightNew, nVoteHash.ToString());
-                it = mapTxLockVotes.find(nVoteHash);
+                auto it = mapTxLockVotes.find(nVoteHash);
                 if(it != mapTxLockVotes.end()) {
-                    it->second.SetConfirmedHeight(nHeightNew);
+                    SetVoteConfirmedHeight(nVoteHash, it->second, nHeightNew);
                 }
                 ++itVote;
             }
@@ -984,18 +1255,120 @@ void CInstantSend::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex
     }
 
     // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.GetTxHash() == txHash) {
+    auto itOrphanVotes = mapTxLockVotesOrphanByTx.find(txHash);
+    if(itOrphanVotes != mapTxLockVotesOrphanByTx.end()) {
+        for (const uint256& nVoteHash : itOrphanVotes->second) {
             LogPrint(BCLog::INSTANTSEND, "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                    txHash.ToString(), nHeightNew, itOrphanVote->first.ToString());
-            mapTxLockVotes[itOrphanVote->first].SetConfirmedHeight(nHeightNew);
+                    txHash.ToString(), nHeightNew, nVoteHash.ToString());
+            auto it = mapTxLockVotes.find(nVoteHash);
+            if(it != mapTxLockVotes.end()) {
+                SetVoteConfirmedHeight(it->first, it->second, nHeightNew);
+            }
         }
-        ++itOrphanVote;
     }
 }
 
-std::string CInstantSend::ToString()
+void CInstantSend::Clear()
+{
+    LOCK(cs_instantsend);
+
+    mapLockRequestAccepted.clear();
+    mapLockRequestRejected.clear();
+    mapTxLockVotes.clear();
+    mapTxLockVotesOrphan.clear();
+    mapTxLockCandidates.clear();
+    mapVotedOutpoints.clear();
+    mapLockedOutpoints.clear();
+    RebuildIndexes();
+}
+
+void CInstantSend::RebuildIndexes()
+{
+    AssertLockHeld(cs_instantsend);
+
+    mapTxLockVotesOrphanByTx.clear();
+    mapCandidatesByConfirmedHeight.clear();
+    mapVotesByConfirmedHeight.clear();
+    dequeVotesByTime.clear();
+    dequeOrphanVotesByTime.clear();
+    dequeEmptyCandidates.clear();
+
+    for (const auto& pair : mapTxLockVotes) {
+        dequeVotesByTime.emplace_back(pair.second.GetTimeCreated(), pair.first);
+        if (pair.second.GetConfirmedHeight() != -1)
+            mapVotesByConfirmedHeight[pair.second.GetConfirmedHeight()].push_back(pair.first);
+    }
+    for (const auto& pair : mapTxLockVotesOrphan) {
+        mapTxLockVotesOrphanByTx[pair.second.GetTxHash()].insert(pair.first);
+        dequeOrphanVotesByTime.emplace_back(pair.second.GetTimeCreated(), pair.first);
+    }
+    std::sort(dequeVotesByTime.begin(), dequeVotesByTime.end());
+    std::sort(dequeOrphanVotesByTime.begin(), dequeOrphanVotesByTime.end());
+
+    std::vector<std::pair<int64_t, uint256> > vecEmptyCandidates;
+    auto pLocked = std::make_shared<locked_tx_map_t>();
+    for (const auto& pair : mapTxLockCandidates) {
+        if (pair.second.GetConfirmedHeight() != -1)
+            mapCandidatesByConfirmedHeight[pair.second.GetConfirmedHeight()].push_back(pair.first);
+        if (!pair.second.txLockRequest)
+            vecEmptyCandidates.emplace_back(pair.second.GetTimeCreated(), pair.first);
+        if (IsTxLockComplete(pair.first))
+            pLocked->emplace(pair.first, pair.second.CountVotes());
+    }
+    std::sort(vecEmptyCandidates.begin(), vecEmptyCandidates.end());
+    for (const auto& pair : vecEmptyCandidates) {
+        dequeEmptyCandidates.push_back(pair.second);
+    }
+    std::atomic_store(&pLockedTxes, std::shared_ptr<const locked_tx_map_t>(pLocked));
+}
+
+template<typename X>
+static size_t DequeMemoryUsage(const std::deque<X>& d)
+{
+    return memusage::MallocUsage(sizeof(X) * d.size());
+}
+
+template<typename X>
+static size_t IndexMemoryUsage(const X& index)
+{
+    size_t nUsage = memusage::DynamicUsage(index);
+    for (const auto& entry : index) {
+        nUsage += memusage::DynamicUsage(entry.second);
+    }
+    return nUsage;
+}
+
+size_t CInstantSend::DynamicMemoryUsage() const
+{
+    size_t nUsage = 0;
+    {
+        LOCK(cs_instantsend);
+        nUsage += memusage::DynamicUsage(mapLockRequestAccepted);
+        nUsage += memusage::DynamicUsage(mapLockRequestRejected);
+        nUsage += memusage::DynamicUsage(mapTxLockVotes);
+        nUsage += memusage::DynamicUsage(mapTxLockVotesOrphan);
+        nUsage += IndexMemoryUsage(mapTxLockVotesOrphanByTx);
+        nUsage += memusage::DynamicUsage(mapTxLockCandidates);
+        for (const auto& pair : mapTxLockCandidates) {
+            nUsage += pair.second.DynamicMemoryUsage();
+        }
+        nUsage += IndexMemoryUsage(mapVotedOutpoints);
+        nUsage += memusage::DynamicUsage(mapLockedOutpoints);
+        nUsage += memusage::DynamicUsage(mapMasternodeOrphanVotes);
+        nUsage += IndexMemoryUsage(mapCandidatesByConfirmedHeight);
+        nUsage += IndexMemoryUsage(mapVotesByConfirmedHeight);
+        nUsage += DequeMemoryUsage(dequeVotesByTime);
+        nUsage += DequeMemoryUsage(dequeOrphanVotesByTime);
+        nUsage += DequeMemoryUsage(dequeEmptyCandidates);
+    }
+    std::shared_ptr<const locked_tx_map_t> pLocked = std::atomic_load(&pLockedTxes);
+    if (pLocked) {
+        nUsage += memusage::DynamicUsage(*pLocked);
+    }
+    return nUsage;
+}
+
+std::string CInstantSend::ToString() const
 {
     LOCK(cs_instantsend);
     return strprintf("Lock Candidates: %llu, Votes %llu", mapTxLockCandidates.size(), mapTxLockVotes.size());
@@ -1005,7 +1378,7 @@ std::string CInstantSend::ToString()
 // CTxLockRequest
 //
 
-bool CTxLockRequest::IsValid() const
+bool CTxLockRequest::IsValid(bool fCheckInputs) const
 {
     if(tx->vout.size() < 1) return false;
 
@@ -1019,6 +1392,8 @@ bool CTxLockRequest::IsValid() const
         return false;
     }
 
+    if(!fCheckInputs) return true;
+
     CAmount nValueIn = 0;
 
     int nInstantSendConfirmationsRequired = Params().GetConsensus().nInstantSendConfirmationsRequired;
@@ -1060,10 +1435,21 @@ bool CTxLockRequest::IsValid() const
     return true;
 }
 
+const CTransactionRef& CTxLockRequest::EmptyTransaction()
+{
+    static const CTransactionRef txEmpty = MakeTransactionRef();
+    return txEmpty;
+}
+
 CAmount CTxLockRequest::GetMinFee() const
+{
+    return GetMinFee(tx->vin.size());
+}
+
+CAmount CTxLockRequest::GetMinFee(size_t nInputs)
 {
     CAmount nMinFee = MIN_FEE;
-    return std::max(nMinFee, CAmount(tx->vin.size() * nMinFee));
+    return std::max(nMinFee, CAmount(nInputs * nMinFee));
 }
 
 int CTxLockRequest::GetMaxSignatures() const
@@ -1077,7 +1463,22 @@ int CTxLockRequest::GetMaxSignatures() const
 
 bool CTxLockVote::IsValid(CNode* pnode, CConnman& connman) const
 {
-    if(!mnodeman.Has(outpointMasternode)) {
+    CPubKey pubKeyMasternode;
+    if(!IsValidRank(pnode, connman, pubKeyMasternode))
+        return false;
+
+    if(!CheckSignature(pubKeyMasternode)) {
+        LogPrintf("CTxLockVote::IsValid -- Signature invalid\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool CTxLockVote::IsValidRank(CNode* pnode, CConnman& connman, CPubKey& pubKeyMasternodeRet) const
+{
+    masternode_info_t infoMn;
+    if(!mnodeman.GetMasternodeInfo(outpointMasternode, infoMn)) {
         LogPrint(BCLog::INSTANTSEND, "CTxLockVote::IsValid -- Unknown masternode %s\n", outpointMasternode.ToStringShort());
         mnodeman.AskForMN(pnode, outpointMasternode, connman);
         return false;
@@ -1107,11 +1508,7 @@ bool CTxLockVote::IsValid(CNode* pnode, CConnman& connman) const
         return false;
     }
 
-    if(!CheckSignature()) {
-        LogPrintf("CTxLockVote::IsValid -- Signature invalid\n");
-        return false;
-    }
-
+    pubKeyMasternodeRet = infoMn.pubKeyMasternode;
     return true;
 }
 
@@ -1127,8 +1524,6 @@ uint256 CTxLockVote::GetSignatureHash() const
 
 bool CTxLockVote::CheckSignature() const
 {
-    std::string strError;
-
     masternode_info_t infoMn;
 
     if(!mnodeman.GetMasternodeInfo(outpointMasternode, infoMn)) {
@@ -1136,13 +1531,20 @@ bool CTxLockVote::CheckSignature() const
         return false;
     }
 
+    return CheckSignature(infoMn.pubKeyMasternode);
+}
+
+bool CTxLockVote::CheckSignature(const CPubKey& pubKeyMasternode) const
+{
+    std::string strError;
+
     if (sporkManager.IsSporkActive(SPORK_4_NEW_SIGS)) {
         uint256 hash = GetSignatureHash();
 
-        if (!CHashSigner::VerifyHash(hash, infoMn.pubKeyMasternode, vchMasternodeSignature, strError)) {
+        if (!CHashSigner::VerifyHash(hash, pubKeyMasternode, vchMasternodeSignature, strError)) {
             // could be a signature in old format
             std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
-            if(!CMessageSigner::VerifyMessage(infoMn.pubKeyMasternode, vchMasternodeSignature, strMessage, strError)) {
+            if(!CMessageSigner::VerifyMessage(pubKeyMasternode, vchMasternodeSignature, strMessage, strError)) {
                 // nope, not in old format either
                 LogPrintf("CTxLockVote::CheckSignature -- VerifyMessage() failed, error: %s\n", strError);
                 return false;
@@ -1150,7 +1552,7 @@ bool CTxLockVote::CheckSignature() const
         }
     } else {
         std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
-        if(!CMessageSigner::VerifyMessage(infoMn.pubKeyMasternode, vchMasternodeSignature, strMessage, strError)) {
+        if(!CMessageSigner::VerifyMessage(pubKeyMasternode, vchMasternodeSignature, strMessage, strError)) {
             LogPrintf("CTxLockVote::CheckSignature -- VerifyMessage() failed, error: %s\n", strError);
             return false;
         }
@@ -1159,6 +1561,12 @@ bool CTxLockVote::CheckSignature() const
     return true;
 }
 
+bool CTxLockVoteCheck::operator()()
+{
+    *pfValid = pvote->CheckSignature(pubKeyMasternode) ? 1 : 0;
+    return true;
+}
+
 bool CTxLockVote::Sign()
 {
     std::string strError;
@@ -1242,6 +1650,11 @@ bool COutPointLock::HasMasternodeVoted(const COutPoint& outpointMasternodeIn) co
     return mapMasternodeVotes.count(outpointMasternodeIn);
 }
 
+size_t COutPointLock::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(mapMasternodeVotes);
+}
+
 void COutPointLock::Relay(CConnman& connman) const
 {
     std::map<COutPoint, CTxLockVote>::const_iterator itVote = mapMasternodeVotes.begin();
@@ -1315,6 +1728,15 @@ bool CTxLockCandidate::IsTimedOut() const
     return GetTime() - nTimeCreated > INSTANTSEND_LOCK_TIMEOUT_SECONDS;
 }
 
+size_t CTxLockCandidate::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(mapOutPointLocks);
+    for (const auto& pair : mapOutPointLocks) {
+        nUsage += pair.second.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 void CTxLockCandidate::Relay(CConnman& connman) const
 {
     RelayTransactionFromExtern(*txLockRequest.tx, &connman);
@@ -7,6 +7,11 @@
 #include <chain.h>
 #include <net.h>
 #include <primitives/transaction.h>
+#include <pubkey.h>
+#include <txmempool.h>
+
+#include <deque>
+#include <unordered_map>
 
 #ifdef ENABLE_WALLET
 #include <wallet/wallet.h>
@@ -20,6 +25,9 @@ class CInstantSend;
 
 extern CInstantSend instantsend;
 
+/** Run a worker thread for the txlvote signature check queue */
+void ThreadTxLockVoteCheck();
+
 /*
     At 15 signatures, 1/2 of the masternode network can be owned by
     one party without compromising the security of InstantSend
@@ -57,37 +65,91 @@ extern int nCompleteTXLocks;
 class CInstantSend
 {
 private:
+    static const std::string SERIALIZATION_VERSION_STRING;
+
     // Keep track of current block height
     int nCachedBlockHeight;
 
     // maps for AlreadyHave
-    std::map<uint256, CTxLockRequest> mapLockRequestAccepted; ///< Tx hash - Tx
-    std::map<uint256, CTxLockRequest> mapLockRequestRejected; ///< Tx hash - Tx
-    std::map<uint256, CTxLockVote> mapTxLockVotes; ///< Vote hash - Vote
-    std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; ///< Vote hash - Vote
+    std::unordered_map<uint256, CTxLockRequest, SaltedTxidHasher> mapLockRequestAccepted; ///< Tx hash - Tx
+    std::unordered_map<uint256, CTxLockRequest, SaltedTxidHasher> mapLockRequestRejected; ///< Tx hash - Tx
+    std::unordered_map<uint256, CTxLockVote, SaltedTxidHasher> mapTxLockVotes; ///< Vote hash - Vote
+    std::unordered_map<uint256, CTxLockVote, SaltedTxidHasher> mapTxLockVotesOrphan; ///< Vote hash - Vote
+    /// Hashes of mapTxLockVotesOrphan by the tx they wait for, so a lock request only retries its own votes
+    std::unordered_map<uint256, std::set<uint256>, SaltedTxidHasher> mapTxLockVotesOrphanByTx; ///< Tx hash - Vote hash set
 
-    std::map<uint256, CTxLockCandidate> mapTxLockCandidates; ///< Tx hash - Lock candidate
+    std::unordered_map<uint256, CTxLockCandidate, SaltedTxidHasher> mapTxLockCandidates; ///< Tx hash - Lock candidate
 
-    std::map<COutPoint, std::set<uint256> > mapVotedOutpoints; ///< UTXO - Tx hash set
-    std::map<COutPoint, uint256> mapLockedOutpoints; ///< UTXO - Tx hash
+    std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher> mapVotedOutpoints; ///< UTXO - Tx hash set
+    std::unordered_map<COutPoint, uint256, SaltedOutpointHasher> mapLockedOutpoints; ///< UTXO - Tx hash
 
     /// Track masternodes who voted with no txlockrequest (for DOS protection)
-    std::map<COutPoint, int64_t> mapMasternodeOrphanVotes; ///< MN outpoint - Time
-
-    bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest);
+    std::unordered_map<COutPoint, int64_t, SaltedOutpointHasher> mapMasternodeOrphanVotes; ///< MN outpoint - Time
+
+    // Expiry indexes so CheckAndRemove only visits entries that may have expired.
+    // Entries are not removed when the map entry goes away or changes, they are
+    // checked again when their bucket or deadline comes up.
+
+    /// Tx hashes of candidates and hashes of votes by the height their tx was confirmed at
+    std::map<int, std::vector<uint256> > mapCandidatesByConfirmedHeight;
+    std::map<int, std::vector<uint256> > mapVotesByConfirmedHeight;
+    /// Hashes of mapTxLockVotes in the order they were added, with the time to check them from
+    std::deque<std::pair<int64_t, uint256> > dequeVotesByTime;
+    /// Hashes of mapTxLockVotesOrphan in the order they were added, with their creation time
+    std::deque<std::pair<int64_t, uint256> > dequeOrphanVotesByTime;
+    /// Tx hashes of empty candidates in the order they were created
+    std::deque<uint256> dequeEmptyCandidates;
+
+    typedef std::unordered_map<uint256, int, SaltedTxidHasher> locked_tx_map_t;
+    /// Completed locks with their signature count, only accessed with std::atomic_load/store
+    /// so the wallet and mempool can query them without cs_instantsend
+    std::shared_ptr<const locked_tx_map_t> pLockedTxes;
+
+    /// Publish the lock state of txHash in pLockedTxes if it changed
+    void UpdateLockedTx(const uint256& txHash);
+    /// Drop entries from pLockedTxes that are no longer locked, after candidates or locked outpoints were removed
+    void UpdateLockedTxes();
+    /// Whether all outpoints of the candidate are locked to it, cs_instantsend must be held
+    bool IsTxLockComplete(const uint256& txHash);
+    /// Rebuild the expiry indexes and pLockedTxes from the maps after they were read from disk
+    void RebuildIndexes();
+
+    /// Add to mapTxLockVotes, evicting the oldest votes beyond MAX_TXLOCK_VOTES
+    bool AddTxLockVote(const uint256& nVoteHash, const CTxLockVote& vote);
+    void SetCandidateConfirmedHeight(const uint256& txHash, CTxLockCandidate& txLockCandidate, int nHeight);
+    void SetVoteConfirmedHeight(const uint256& nVoteHash, CTxLockVote& vote, int nHeight);
+
+    bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest, bool fCheckInputs = true);
     void CreateEmptyTxLockCandidate(const uint256& txHash);
     void Vote(CTxLockCandidate& txLockCandidate, CConnman& connman);
 
-    /// Process consensus vote message
-    bool ProcessNewTxLockVote(CNode* pfrom, const CTxLockVote& vote, CConnman& connman);
+    /// Votes received but not verified yet, with their peer referenced by AddRef() or nullptr
+    std::vector<std::pair<CNode*, CTxLockVote> > vecPendingVotes;
+    /// Votes of masternodes not in our list yet, checked again once the masternode is announced
+    std::unordered_map<COutPoint, std::vector<CTxLockVote>, SaltedOutpointHasher> mapVotesWaitingForMasternode; ///< MN outpoint - Votes
+    size_t nVotesWaitingForMasternode = 0;
+    /// Protects vecPendingVotes and mapVotesWaitingForMasternode
+    CCriticalSection cs_vecPendingVotes;
+
+    /// Queue a consensus vote message, returns the number of votes pending
+    size_t QueueTxLockVote(CNode* pfrom, const CTxLockVote& vote);
+    /// Check the ranks of all pending votes, their signatures in parallel, then apply the valid ones
+    void ProcessPendingTxLockVotes(CConnman& connman);
+    /// Apply a verified vote, cs_main, cs_wallet, mempool.cs and cs_instantsend must be held
+#ifdef ENABLE_WALLET
+    bool ApplyTxLockVote(const CTxLockVote& vote, CWallet *wallet);
+#else
+    bool ApplyTxLockVote(const CTxLockVote& vote);
+#endif
 
     void UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidate& txLockCandidate);
+    void EraseOrphanTxLockVote(const uint256& nVoteHash);
 #ifdef ENABLE_WALLET
     bool ProcessOrphanTxLockVote(const CTxLockVote& vote, CWallet *wallet);
-    void ProcessOrphanTxLockVotes(CWallet *wallet);
+    void ProcessOrphanTxLockVotes(const uint256& txHash, CWallet *wallet);
 #else
     bool ProcessOrphanTxLockVote(const CTxLockVote& vote);
-    void ProcessOrphanTxLockVotes();
+    void ProcessOrphanTxLockVotes(const uint256& txHash);
 #endif
     int64_t GetAverageMasternodeOrphanVoteTime();
 
@@ -108,11 +170,53 @@ private:
     bool IsInstantSendReadyToLock(const uint256 &txHash);
 
 public:
-    CCriticalSection cs_instantsend;
+    static const size_t MAX_PENDING_TXLOCK_VOTES = 1000;
+    /// Caps on the state that peers can create without a valid lock request
+    static const size_t MAX_TXLOCK_VOTES = 50000;
+    static const size_t MAX_EMPTY_TXLOCK_CANDIDATES = 10000;
+    static const size_t MAX_VOTES_WAITING_FOR_MASTERNODE = 1000;
+
+    mutable CInstrumentedCriticalSection cs_instantsend;
+
+    ADD_SERIALIZE_METHODS;
+
+    /// Requests, votes and candidates are kept across restarts so locks are known
+    /// before the network is synced again, they expire by height as usual afterwards
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        LOCK(cs_instantsend);
+        std::string strVersion;
+        if(ser_action.ForRead()) {
+            READWRITE(strVersion);
+        }
+        else {
+            strVersion = SERIALIZATION_VERSION_STRING;
+            READWRITE(strVersion);
+        }
+
+        READWRITE(mapLockRequestAccepted);
+        READWRITE(mapLockRequestRejected);
+        READWRITE(mapTxLockVotes);
+        READWRITE(mapTxLockVotesOrphan);
+        READWRITE(mapTxLockCandidates);
+        READWRITE(mapVotedOutpoints);
+        READWRITE(mapLockedOutpoints);
+        if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
+            Clear();
+        }
+        if(ser_action.ForRead()) {
+            RebuildIndexes();
+        }
+    }
+
+    void Clear();
 
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 
-    bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman);
+    /// fCheckInputs false: the wallet that created the request already checked its inputs against IsValid's rules
+    bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman, bool fCheckInputs = true);
+    /// Check the votes that were waiting for this masternode to be announced
+    void ProcessVotesWaitingForMasternode(const COutPoint& outpointMasternode, CConnman& connman);
     void Vote(const uint256& txHash, CConnman& connman);
 
     bool AlreadyHave(const uint256& hash);
@@ -126,9 +230,9 @@ public:
 
     bool GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet);
 
-    /// Verify if transaction is currently locked
+    /// Verify if transaction is currently locked, does not take cs_instantsend
     bool IsLockedInstantSendTransaction(const uint256& txHash);
-    /// Get the actual number of accepted lock signatures
+    /// Get the actual number of accepted lock signatures, does not take cs_instantsend for locked transactions
     int GetTransactionLockSignatures(const uint256& txHash);
     /// Get instantsend confirmations (only)
     int GetConfirmations(const uint256 &nTXHash);
@@ -143,7 +247,9 @@ public:
     void UpdatedBlockTip(const CBlockIndex *pindex);
     void SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pindex = nullptr, int posInBlock = 0);
 
-    std::string ToString();
+    std::string ToString() const;
+    /// Estimated bytes used by the maps and indexes, not counting the transactions and signatures
+    size_t DynamicMemoryUsage() const;
 };
 
 /**
@@ -154,6 +260,8 @@ class CTxLockRequest
 private:
     static const CAmount MIN_FEE            = 0.0001 * COIN;
 
+    static const CTransactionRef& EmptyTransaction();
+
 public:
     /// Warn for a large number of inputs to an IS tx - fees could be substantial
     /// and the number txlvote responses requested large (10 * # of inputs)
@@ -161,8 +269,11 @@ public:
 
     CTransactionRef tx;
 
-    CTxLockRequest() : tx(MakeTransactionRef()) {}
-    CTxLockRequest(const CTransaction& _tx) : tx(MakeTransactionRef(_tx)) {};
+    /// Empty requests, like those of candidates that only have votes yet, share one empty transaction
+    CTxLockRequest() : tx(EmptyTransaction()) {}
+    /// Copies _tx, construct from the CTransactionRef wherever there is one
+    explicit CTxLockRequest(const CTransaction& _tx) : tx(MakeTransactionRef(_tx)) {};
+    explicit CTxLockRequest(const CTransactionRef& _tx) : tx(_tx) {};
 
     ADD_SERIALIZE_METHODS;
 
@@ -171,8 +282,11 @@ public:
         READWRITE(tx);
     }
 
-    bool IsValid() const;
+    /// fCheckInputs false leaves out the checks that look up the inputs in the UTXO set
+    bool IsValid(bool fCheckInputs = true) const;
     CAmount GetMinFee() const;
+    /// The minimum fee of a lock request for a transaction with nInputs inputs
+    static CAmount GetMinFee(size_t nInputs);
     int GetMaxSignatures() const;
 
     const uint256 &GetHash() const {
@@ -246,6 +360,10 @@ public:
         if (!(s.GetType() & SER_GETHASH)) {
             READWRITE(vchMasternodeSignature);
         }
+        if (s.GetType() & SER_DISK) {
+            READWRITE(nConfirmedHeight);
+            READWRITE(nTimeCreated);
+        }
     }
 
     uint256 GetHash() const;
@@ -256,17 +374,47 @@ public:
     COutPoint GetMasternodeOutpoint() const { return outpointMasternode; }
 
     bool IsValid(CNode* pnode, CConnman& connman) const;
+    /// All of IsValid but the signature check, returns the key to check it with
+    bool IsValidRank(CNode* pnode, CConnman& connman, CPubKey& pubKeyMasternodeRet) const;
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
+    int GetConfirmedHeight() const { return nConfirmedHeight; }
     bool IsExpired(int nHeight) const;
     bool IsTimedOut() const;
     bool IsFailed() const;
+    int64_t GetTimeCreated() const { return nTimeCreated; }
 
     bool Sign();
     bool CheckSignature() const;
+    bool CheckSignature(const CPubKey& pubKeyMasternode) const;
 
     void Relay(CConnman& connman) const;
 };
 
+/** Signature check of a txlvote, run on the check queue before the vote is applied */
+class CTxLockVoteCheck
+{
+private:
+    const CTxLockVote* pvote;
+    CPubKey pubKeyMasternode;
+    /// Set to 1 if the signature is valid, a char each since the checks run concurrently
+    char* pfValid;
+
+public:
+    CTxLockVoteCheck() : pvote(nullptr), pfValid(nullptr) {}
+    CTxLockVoteCheck(const CTxLockVote& vote, const CPubKey& pubKeyMasternodeIn, char& fValid) :
+        pvote(&vote), pubKeyMasternode(pubKeyMasternodeIn), pfValid(&fValid) {}
+
+    // Always succeeds, the result is stored in *pfValid so one bad vote doesn't fail the batch
+    bool operator()();
+
+    void swap(CTxLockVoteCheck& check)
+    {
+        std::swap(pvote, check.pvote);
+        std::swap(pubKeyMasternode, check.pubKeyMasternode);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
 /**
  * An InstantSend OutpointLock.
  */
@@ -281,11 +429,22 @@ public:
     static const int SIGNATURES_REQUIRED        = 6;
     static const int SIGNATURES_TOTAL           = 10;
 
+    COutPointLock() {}
+
     COutPointLock(const COutPoint& outpointIn) :
         outpoint(outpointIn),
         mapMasternodeVotes()
         {}
 
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(outpoint);
+        READWRITE(mapMasternodeVotes);
+        READWRITE(fAttacked);
+    }
+
     COutPoint GetOutpoint() const { return outpoint; }
 
     bool AddVote(const CTxLockVote& vote);
@@ -294,6 +453,7 @@ public:
     int CountVotes() const { return fAttacked ? 0 : mapMasternodeVotes.size(); }
     bool IsReady() const { return !fAttacked && CountVotes() >= SIGNATURES_REQUIRED; }
     void MarkAsAttacked() { fAttacked = true; }
+    size_t DynamicMemoryUsage() const;
 
     void Relay(CConnman& connman) const;
 };
@@ -308,6 +468,11 @@ private:
     int64_t nTimeCreated;
 
 public:
+    CTxLockCandidate() :
+        nConfirmedHeight(-1),
+        nTimeCreated(GetTime())
+        {}
+
     CTxLockCandidate(const CTxLockRequest& txLockRequestIn) :
         nConfirmedHeight(-1),
         nTimeCreated(GetTime()),
@@ -318,6 +483,16 @@ public:
     CTxLockRequest txLockRequest;
     std::map<COutPoint, COutPointLock> mapOutPointLocks;
 
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txLockRequest);
+        READWRITE(mapOutPointLocks);
+        READWRITE(nTimeCreated);
+        READWRITE(nConfirmedHeight);
+    }
+
     uint256 GetHash() const { return txLockRequest.GetHash(); }
 
     void AddOutPointLock(const COutPoint& outpoint);
@@ -329,8 +504,11 @@ public:
     int CountVotes() const;
 
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
+    int GetConfirmedHeight() const { return nConfirmedHeight; }
+    int64_t GetTimeCreated() const { return nTimeCreated; }
     bool IsExpired(int nHeight) const;
     bool IsTimedOut() const;
+    size_t DynamicMemoryUsage() const;
 
     void Relay(CConnman& connman) const;
 };
@@ -0,0 +1,112 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <jsonwriter.h>
+
+#include <tinyformat.h>
+#include <univalue.h>
+
+#include <assert.h>
+
+void CJSONWriter::Separate()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vHasMember.empty()) {
+        if (vHasMember.back())
+            str += ',';
+        vHasMember.back() = true;
+    }
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separate();
+    str += '{';
+    vHasMember.push_back(false);
+}
+
+void CJSONWriter::EndObject()
+{
+    assert(!vHasMember.empty() && !fAfterKey);
+    vHasMember.pop_back();
+    str += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separate();
+    str += '[';
+    vHasMember.push_back(false);
+}
+
+void CJSONWriter::EndArray()
+{
+    assert(!vHasMember.empty() && !fAfterKey);
+    vHasMember.pop_back();
+    str += ']';
+}
+
+void CJSONWriter::Key(const std::string& key)
+{
+    Value(key);
+    str += ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::Value(const std::string& val)
+{
+    Separate();
+    str += '"';
+    for (const char c : val) {
+        const unsigned char ch = c;
+        switch (ch) {
+        case '"': str += "\\\""; break;
+        case '\\': str += "\\\\"; break;
+        case '\b': str += "\\b"; break;
+        case '\t': str += "\\t"; break;
+        case '\n': str += "\\n"; break;
+        case '\f': str += "\\f"; break;
+        case '\r': str += "\\r"; break;
+        default:
+            if (ch < 0x20 || ch == 0x7f)
+                str += strprintf("\\u%04x", ch);
+            else
+                str += c;
+        }
+    }
+    str += '"';
+}
+
+void CJSONWriter::Value(int64_t val)
+{
+    Separate();
+    str += strprintf("%d", val);
+}
+
+void CJSONWriter::Value(uint64_t val)
+{
+    Separate();
+    str += strprintf("%u", val);
+}
+
+void CJSONWriter::Value(bool val)
+{
+    Separate();
+    str += val ? "true" : "false";
+}
+
+void CJSONWriter::Value(const UniValue& val)
+{
+    Separate();
+    str += val.write();
+}
+
+void CJSONWriter::RawValue(const std::string& json)
+{
+    Separate();
+    str += json;
+}
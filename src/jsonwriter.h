@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/**
+ * Appends JSON text to a string as it is described, without building a
+ * UniValue tree first. The text is the same UniValue::write() produces
+ * without indentation. Separators are added by the writer, the caller only
+ * has to describe keys and values in order. The string may be taken and
+ * cleared at any point, to send what was written so far.
+ */
+class CJSONWriter
+{
+private:
+    std::string& str;
+    //! Whether the object or array at each level has a member yet
+    std::vector<bool> vHasMember;
+    //! Whether the last thing written was a key, its value needs no separator
+    bool fAfterKey;
+
+    void Separate();
+
+public:
+    explicit CJSONWriter(std::string& strIn) : str(strIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& key);
+
+    /** A string, escaped like UniValue does */
+    void Value(const std::string& val);
+    void Value(const char* val) { Value(std::string(val)); }
+    void Value(int64_t val);
+    void Value(int val) { Value((int64_t)val); }
+    void Value(uint64_t val);
+    void Value(bool val);
+    /** Any value, through UniValue::write() */
+    void Value(const UniValue& val);
+    /** Text that is JSON already, like the numbers ValueFromAmount formats */
+    void RawValue(const std::string& json);
+
+    template <typename T>
+    void KV(const std::string& key, const T& val)
+    {
+        Key(key);
+        Value(val);
+    }
+};
+
+#endif // BITCOIN_JSONWRITER_H
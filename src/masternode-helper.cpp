@@ -39,6 +39,7 @@ void ThreadCheckMasternodes(CConnman& connman)
 
             // make sure to check all masternodes first
             mnodeman.Check();
+            mnodeman.NotifyMasternodeChanges();
 
             mnodeman.ProcessPendingMnbRequests(connman);
             mnodeman.ProcessPendingMnvRequests(connman);
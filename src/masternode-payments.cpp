@@ -9,20 +9,22 @@
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
+#include <memusage.h>
 #include <messagesigner.h>
 #include <netfulfilledman.h>
 #include <netmessagemaker.h>
 #include <spork.h>
 #include <util.h>
+#include <validationinterface.h>
 
 #include <boost/lexical_cast.hpp>
 
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments mnpayments;
 
-CCriticalSection cs_vecPayees;
-CCriticalSection cs_mapMasternodeBlocks;
-CCriticalSection cs_mapMasternodePaymentVotes;
+CInstrumentedCriticalSection cs_vecPayees;
+CInstrumentedCriticalSection cs_mapMasternodeBlocks;
+CInstrumentedCriticalSection cs_mapMasternodePaymentVotes;
 
 bool IsBlockPayeeValid(const CTransaction& txNew, int nBlockHeight, CAmount blockReward)
 {
@@ -63,6 +65,83 @@ void CMasternodePayments::Clear()
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
     mapMasternodeBlocks.clear();
     mapMasternodePaymentVotes.clear();
+    mapVoteHashesByHeight.clear();
+    nVotesMemoryUsage = 0;
+}
+
+static size_t VoteMemoryUsage(const CMasternodePaymentVote& vote)
+{
+    // map node holding the vote, its heap data and the copies of its hash kept
+    // in mapVoteHashesByHeight and in the payee tally of the block
+    return memusage::MallocUsage(sizeof(std::pair<const uint256, CMasternodePaymentVote>) + 4 * sizeof(void*)) +
+           memusage::DynamicUsage(static_cast<const CScriptBase&>(vote.payee)) +
+           memusage::DynamicUsage(vote.vchSig) + 2 * sizeof(uint256);
+}
+
+void CMasternodePayments::IndexVote(const uint256& nVoteHash, const CMasternodePaymentVote& vote)
+{
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    auto it = mapVoteHashesByHeight.find(vote.nBlockHeight);
+    if (it == mapVoteHashesByHeight.end()) {
+        it = mapVoteHashesByHeight.emplace(vote.nBlockHeight, std::vector<uint256>()).first;
+        nVotesMemoryUsage += memusage::IncrementalDynamicUsage(mapVoteHashesByHeight);
+    }
+    it->second.push_back(nVoteHash);
+    nVotesMemoryUsage += VoteMemoryUsage(vote);
+}
+
+void CMasternodePayments::EraseVotesAtHeight(std::map<int, std::vector<uint256>>::iterator it)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    for (const auto& hash : it->second) {
+        const auto itVote = mapMasternodePaymentVotes.find(hash);
+        if (itVote == mapMasternodePaymentVotes.end()) continue;
+        nVotesMemoryUsage -= VoteMemoryUsage(itVote->second);
+        mapMasternodePaymentVotes.erase(itVote);
+    }
+    nVotesMemoryUsage -= memusage::IncrementalDynamicUsage(mapVoteHashesByHeight);
+    mapMasternodeBlocks.erase(it->first);
+    mapVoteHashesByHeight.erase(it);
+}
+
+void CMasternodePayments::PruneVotesBelow(int nHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    while (!mapVoteHashesByHeight.empty() && mapVoteHashesByHeight.begin()->first < nHeight) {
+        LogPrint(BCLog::MNPAYMENTS, "CMasternodePayments::PruneVotesBelow -- Removing old Masternode payments: nBlockHeight=%d\n", mapVoteHashesByHeight.begin()->first);
+        EraseVotesAtHeight(mapVoteHashesByHeight.begin());
+    }
+    // Tallies loaded from an older cache may have no votes left to index
+    mapMasternodeBlocks.erase(mapMasternodeBlocks.begin(), mapMasternodeBlocks.lower_bound(nHeight));
+}
+
+void CMasternodePayments::LimitVotesMemoryUsage()
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    while (nVotesMemoryUsage > MAX_MNPAYMENTS_MEMORY_USAGE && !mapVoteHashesByHeight.empty()) {
+        LogPrint(BCLog::MNPAYMENTS, "CMasternodePayments::LimitVotesMemoryUsage -- usage %u over limit, dropping payments for nBlockHeight=%d\n",
+                    nVotesMemoryUsage, mapVoteHashesByHeight.begin()->first);
+        EraseVotesAtHeight(mapVoteHashesByHeight.begin());
+    }
+}
+
+void CMasternodePayments::RebuildVoteIndex()
+{
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    mapVoteHashesByHeight.clear();
+    nVotesMemoryUsage = 0;
+    for (const auto& pair : mapMasternodePaymentVotes) {
+        IndexVote(pair.first, pair.second);
+    }
+}
+
+size_t CMasternodePayments::DynamicMemoryUsage() const
+{
+    LOCK(cs_mapMasternodePaymentVotes);
+    return nVotesMemoryUsage;
 }
 
 bool CMasternodePayments::UpdateLastVote(const CMasternodePaymentVote& vote)
@@ -186,8 +265,15 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, const std::string& strCom
         // Ignore any payments messages until masternode list is synced
         if(!masternodeSync.IsMasternodeListSynced()) return;
 
+        // Check the range before storing anything, votes for far away heights would never be pruned
+        int nFirstBlock = nCachedBlockHeight - GetStorageLimit();
+        if(vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > nCachedBlockHeight+20) {
+            LogPrint(BCLog::MNPAYMENTS, "MASTERNODEPAYMENTVOTE -- vote out of range: nFirstBlock=%d, nBlockHeight=%d, nHeight=%d\n", nFirstBlock, vote.nBlockHeight, nCachedBlockHeight);
+            return;
+        }
+
         {
-            LOCK(cs_mapMasternodePaymentVotes);
+            LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
             auto res = mapMasternodePaymentVotes.emplace(nHash, vote);
 
@@ -201,12 +287,10 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, const std::string& strCom
             // Mark vote as non-verified when it's seen for the first time,
             // AddOrUpdatePaymentVote() below should take care of it if vote is actually ok
             res.first->second.MarkAsNotVerified();
-        }
-
-        int nFirstBlock = nCachedBlockHeight - GetStorageLimit();
-        if(vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > nCachedBlockHeight+20) {
-            LogPrint(BCLog::MNPAYMENTS, "MASTERNODEPAYMENTVOTE -- vote out of range: nFirstBlock=%d, nBlockHeight=%d, nHeight=%d\n", nFirstBlock, vote.nBlockHeight, nCachedBlockHeight);
-            return;
+            if(res.second) {
+                IndexVote(nHash, res.first->second);
+                LimitVotesMemoryUsage();
+            }
         }
 
         std::string strError = "";
@@ -352,10 +436,26 @@ bool CMasternodePayments::AddOrUpdatePaymentVote(const CMasternodePaymentVote& v
 
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    mapMasternodePaymentVotes[nVoteHash] = vote;
+    auto res = mapMasternodePaymentVotes.emplace(nVoteHash, vote);
+    if(res.second) {
+        IndexVote(nVoteHash, vote);
+    } else {
+        // Replaces an unverified copy, only the signature size can differ
+        nVotesMemoryUsage -= VoteMemoryUsage(res.first->second);
+        res.first->second = vote;
+        nVotesMemoryUsage += VoteMemoryUsage(vote);
+    }
 
-    auto it = mapMasternodeBlocks.emplace(vote.nBlockHeight, CMasternodeBlockPayees(vote.nBlockHeight)).first;
+    auto resBlock = mapMasternodeBlocks.emplace(vote.nBlockHeight, CMasternodeBlockPayees(vote.nBlockHeight));
+    auto it = resBlock.first;
+    CScript payeeBefore, payeeAfter;
+    bool fHadPayee = !resBlock.second && it->second.GetBestPayee(payeeBefore);
     it->second.AddPayee(vote);
+    if (vote.nBlockHeight > nCachedBlockHeight && it->second.GetBestPayee(payeeAfter) && (!fHadPayee || payeeAfter != payeeBefore)) {
+        GetMainSignals().NotifyMasternodePaymentWinner(vote.nBlockHeight, payeeAfter);
+    }
+
+    LimitVotesMemoryUsage();
 
     LogPrint(BCLog::MNPAYMENTS, "CMasternodePayments::AddOrUpdatePaymentVote -- added, hash=%s\n", nVoteHash.ToString());
 
@@ -378,6 +478,9 @@ void CMasternodeBlockPayees::AddPayee(const CMasternodePaymentVote& vote)
     for (auto& payee : vecPayees) {
         if (payee.GetPayee() == vote.payee) {
             payee.AddVoteHash(nVoteHash);
+            if (payee.GetVoteCount() == MNPAYMENTS_SIGNATURES_REQUIRED) {
+                UpdateRequiredPayees();
+            }
             return;
         }
     }
@@ -385,6 +488,19 @@ void CMasternodeBlockPayees::AddPayee(const CMasternodePaymentVote& vote)
     vecPayees.push_back(payeeNew);
 }
 
+void CMasternodeBlockPayees::UpdateRequiredPayees()
+{
+    LOCK(cs_vecPayees);
+
+    vecRequiredPayees.clear();
+    for (const auto& payee : vecPayees) {
+        if (payee.GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED) {
+            vecRequiredPayees.push_back(payee.GetPayee());
+        }
+    }
+    mapCheckedTxs.clear();
+}
+
 bool CMasternodeBlockPayees::GetBestPayee(CScript& payeeRet) const
 {
     LOCK(cs_vecPayees);
@@ -423,41 +539,35 @@ bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew) const
 {
     LOCK(cs_vecPayees);
 
-    int nMaxSignatures = 0;
+    // if we don't have at least MNPAYMENTS_SIGNATURES_REQUIRED signatures on a payee, approve whichever is the longest chain
+    if(vecRequiredPayees.empty()) return true;
+
+    const auto itChecked = mapCheckedTxs.find(txNew.GetHash());
+    if (itChecked != mapCheckedTxs.end()) return itChecked->second;
+
     std::string strPayeesPossible = "";
 
     CAmount nMasternodePayment = GetMasternodePayment(nBlockHeight, txNew.GetValueOut());
 
-    //require at least MNPAYMENTS_SIGNATURES_REQUIRED signatures
-
-    for (const auto& payee : vecPayees) {
-        if (payee.GetVoteCount() >= nMaxSignatures) {
-            nMaxSignatures = payee.GetVoteCount();
+    for (const auto& txout : txNew.vout) {
+        if (nMasternodePayment == txout.nValue && std::find(vecRequiredPayees.begin(), vecRequiredPayees.end(), txout.scriptPubKey) != vecRequiredPayees.end()) {
+            LogPrint(BCLog::MNPAYMENTS, "CMasternodeBlockPayees::IsTransactionValid -- Found required payment\n");
+            mapCheckedTxs.emplace(txNew.GetHash(), true);
+            return true;
         }
     }
 
-    // if we don't have at least MNPAYMENTS_SIGNATURES_REQUIRED signatures on a payee, approve whichever is the longest chain
-    if(nMaxSignatures < MNPAYMENTS_SIGNATURES_REQUIRED) return true;
-
-    for (const auto& payee : vecPayees) {
-        if (payee.GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-            for (const auto& txout : txNew.vout) {
-                if (payee.GetPayee() == txout.scriptPubKey && nMasternodePayment == txout.nValue) {
-                    LogPrint(BCLog::MNPAYMENTS, "CMasternodeBlockPayees::IsTransactionValid -- Found required payment\n");
-                    return true;
-                }
-            }
-
-            CTxDestination address;
-            ExtractDestination(payee.GetPayee(), address);
+    for (const auto& payee : vecRequiredPayees) {
+        CTxDestination address;
+        ExtractDestination(payee, address);
 
-            if(strPayeesPossible == "") {
-                strPayeesPossible = EncodeDestination(address);
-            } else {
-                strPayeesPossible += "," + EncodeDestination(address);
-            }
+        if(strPayeesPossible == "") {
+            strPayeesPossible = EncodeDestination(address);
+        } else {
+            strPayeesPossible += "," + EncodeDestination(address);
         }
     }
+    mapCheckedTxs.emplace(txNew.GetHash(), false);
 
     LogPrintf("CMasternodeBlockPayees::IsTransactionValid -- ERROR: Missing required payment, possible payees: '%s', amount: %f GLT\n", strPayeesPossible, (float)nMasternodePayment/COIN);
     return false;
@@ -508,20 +618,9 @@ void CMasternodePayments::CheckAndRemove()
 
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    int nLimit = GetStorageLimit();
-
-    std::map<uint256, CMasternodePaymentVote>::iterator it = mapMasternodePaymentVotes.begin();
-    while(it != mapMasternodePaymentVotes.end()) {
-        CMasternodePaymentVote vote = (*it).second;
+    PruneVotesBelow(nCachedBlockHeight - GetStorageLimit());
+    LimitVotesMemoryUsage();
 
-        if(nCachedBlockHeight - vote.nBlockHeight > nLimit) {
-            LogPrint(BCLog::MNPAYMENTS, "CMasternodePayments::CheckAndRemove -- Removing old Masternode payment: nBlockHeight=%d\n", vote.nBlockHeight);
-            mapMasternodePaymentVotes.erase(it++);
-            mapMasternodeBlocks.erase(vote.nBlockHeight);
-        } else {
-            ++it;
-        }
-    }
     LogPrintf("CMasternodePayments::CheckAndRemove -- %s\n", ToString());
 }
 
@@ -900,7 +999,8 @@ std::string CMasternodePayments::ToString() const
     std::ostringstream info;
 
     info << "Votes: " << (int)mapMasternodePaymentVotes.size() <<
-            ", Blocks: " << (int)mapMasternodeBlocks.size();
+            ", Blocks: " << (int)mapMasternodeBlocks.size() <<
+            ", Usage: " << nVotesMemoryUsage;
 
     return info.str();
 }
@@ -26,9 +26,12 @@ static const int MNPAYMENTS_SIGNATURES_TOTAL            = 10;
 static const int MIN_MASTERNODE_PAYMENT_PROTO_VERSION_1 = 80001;
 static const int MIN_MASTERNODE_PAYMENT_PROTO_VERSION_2 = 80002;
 
-extern CCriticalSection cs_vecPayees;
-extern CCriticalSection cs_mapMasternodeBlocks;
-extern CCriticalSection cs_mapMasternodePayeeVotes;
+//! hard cap on the memory used by stored payment votes, oldest heights are dropped first
+static const size_t MAX_MNPAYMENTS_MEMORY_USAGE = 64 * 1000000;
+
+extern CInstrumentedCriticalSection cs_vecPayees;
+extern CInstrumentedCriticalSection cs_mapMasternodeBlocks;
+extern CInstrumentedCriticalSection cs_mapMasternodePaymentVotes;
 
 extern CMasternodePayments mnpayments;
 
@@ -74,6 +77,14 @@ public:
 // Keep track of votes for payees from masternodes
 class CMasternodeBlockPayees
 {
+private:
+    // Payees with MNPAYMENTS_SIGNATURES_REQUIRED votes, one of which the block has to pay, kept up to date as votes are added
+    std::vector<CScript> vecRequiredPayees;
+    // IsTransactionValid results by coinbase hash, for blocks connected again after a reorg, until vecRequiredPayees changes
+    mutable std::map<uint256, bool> mapCheckedTxs;
+
+    void UpdateRequiredPayees();
+
 public:
     int nBlockHeight;
     std::vector<CMasternodePayee> vecPayees;
@@ -93,6 +104,9 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(nBlockHeight);
         READWRITE(vecPayees);
+        if (ser_action.ForRead()) {
+            UpdateRequiredPayees();
+        }
     }
 
     void AddPayee(const CMasternodePaymentVote& vote);
@@ -185,20 +199,37 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    // Hashes of the stored votes by the height they vote for, so old heights
+    // can be dropped without scanning every vote. Guarded by cs_mapMasternodePaymentVotes.
+    std::map<int, std::vector<uint256>> mapVoteHashesByHeight;
+    // Approximate memory used by mapMasternodePaymentVotes and the index above
+    size_t nVotesMemoryUsage;
+
+    void IndexVote(const uint256& nVoteHash, const CMasternodePaymentVote& vote);
+    void EraseVotesAtHeight(std::map<int, std::vector<uint256>>::iterator it);
+    void PruneVotesBelow(int nHeight);
+    void LimitVotesMemoryUsage();
+    void RebuildVoteIndex();
+
 public:
     std::map<uint256, CMasternodePaymentVote> mapMasternodePaymentVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
     std::map<COutPoint, int> mapMasternodesLastVote;
     std::map<COutPoint, int> mapMasternodesDidNotVote;
 
-    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(6000) {}
+    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(6000), nVotesMemoryUsage(0) {}
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
+        // Dumped periodically while the network thread keeps adding votes
+        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
         READWRITE(mapMasternodePaymentVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead()) {
+            RebuildVoteIndex();
+        }
     }
 
     void Clear();
@@ -226,6 +257,7 @@ public:
 
     int GetBlockCount() const { return mapMasternodeBlocks.size(); }
     int GetVoteCount() const { return mapMasternodePaymentVotes.size(); }
+    size_t DynamicMemoryUsage() const;
 
     bool IsEnoughData() const;
     int GetStorageLimit() const;
@@ -0,0 +1,33 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <masternode-stats.h>
+#include <protocol.h>
+
+CMasternodeMessageStats mnmsgstats;
+
+bool CMasternodeMessageStats::IsTracked(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::MNANNOUNCE ||
+           strCommand == NetMsgType::MNPING ||
+           strCommand == NetMsgType::MNVERIFY ||
+           strCommand == NetMsgType::MASTERNODEPAYMENTVOTE ||
+           strCommand == NetMsgType::SYNCSTATUSCOUNT ||
+           strCommand == NetMsgType::SPORK ||
+           strCommand == NetMsgType::TXLOCKREQUEST ||
+           strCommand == NetMsgType::TXLOCKVOTE;
+}
+
+void CMasternodeMessageStats::Add(const std::string& strCommand, int64_t nMicros)
+{
+    if (!IsTracked(strCommand)) return;
+    LOCK(cs);
+    mapHistograms[strCommand].Add(nMicros);
+}
+
+std::map<std::string, CTimingHistogram> CMasternodeMessageStats::GetHistograms() const
+{
+    LOCK(cs);
+    return mapHistograms;
+}
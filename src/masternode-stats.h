@@ -0,0 +1,35 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_STATS_H
+#define MASTERNODE_STATS_H
+
+#include <net.h>
+#include <sync.h>
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+class CMasternodeMessageStats;
+
+extern CMasternodeMessageStats mnmsgstats;
+
+/** Time spent in ProcessMessage for the masternode and InstantSend messages */
+class CMasternodeMessageStats
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<std::string, CTimingHistogram> mapHistograms;
+
+public:
+    /// True for the message types a histogram is kept for
+    static bool IsTracked(const std::string& strCommand);
+
+    void Add(const std::string& strCommand, int64_t nMicros);
+    std::map<std::string, CTimingHistogram> GetHistograms() const;
+};
+
+#endif // MASTERNODE_STATS_H
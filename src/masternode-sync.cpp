@@ -32,18 +32,35 @@ void CMasternodeSync::Reset()
     nTimeAssetSyncStarted = GetTime();
     nTimeLastBumped = GetTime();
     nTimeLastFailure = 0;
+
+    LOCK(cs_stats);
+    mapAssetStats.clear();
+    mapAssetStats[MASTERNODE_SYNC_INITIAL].nTimeStarted = nTimeAssetSyncStarted;
 }
 
 void CMasternodeSync::BumpAssetLastTime(const std::string& strFuncName)
 {
     if(IsSynced() || IsFailed()) return;
     nTimeLastBumped = GetTime();
+    {
+        LOCK(cs_stats);
+        auto it = mapAssetStats.find(nRequestedMasternodeAssets);
+        if (it != mapAssetStats.end())
+            it->second.nItemsReceived++;
+    }
     LogPrint(BCLog::MNSYNC, "CMasternodeSync::BumpAssetLastTime -- %s\n", strFuncName);
 }
 
-std::string CMasternodeSync::GetAssetName()
+std::vector<std::pair<int, CMasternodeSyncAssetStats> > CMasternodeSync::GetAssetStats() const
 {
-    switch(nRequestedMasternodeAssets)
+    LOCK(cs_stats);
+    // the asset IDs are in sync order
+    return std::vector<std::pair<int, CMasternodeSyncAssetStats> >(mapAssetStats.begin(), mapAssetStats.end());
+}
+
+std::string CMasternodeSync::GetAssetName(int nAsset)
+{
+    switch(nAsset)
     {
         case(MASTERNODE_SYNC_INITIAL):      return "MASTERNODE_SYNC_INITIAL";
         case(MASTERNODE_SYNC_WAITING):      return "MASTERNODE_SYNC_WAITING";
@@ -93,6 +110,15 @@ void CMasternodeSync::SwitchToNextAsset(CConnman& connman)
     }
     nRequestedMasternodeAttempt = 0;
     nTimeAssetSyncStarted = GetTime();
+    {
+        LOCK(cs_stats);
+        for (auto& asset : mapAssetStats) {
+            if (asset.second.nTimeFinished == 0)
+                asset.second.nTimeFinished = nTimeAssetSyncStarted;
+        }
+        if (nRequestedMasternodeAssets != MASTERNODE_SYNC_FINISHED)
+            mapAssetStats[nRequestedMasternodeAssets].nTimeStarted = nTimeAssetSyncStarted;
+    }
     BumpAssetLastTime("CMasternodeSync::SwitchToNextAsset");
 }
 
@@ -121,13 +147,75 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, const std::string& strCommand
         vRecv >> nItemID >> nCount;
 
         LogPrintf("SYNCSTATUSCOUNT -- got inventory count: nItemID=%d  nCount=%d  peer=%d\n", nItemID, nCount, pfrom->GetId());
+
+        LOCK(cs_stats);
+        auto it = mapAssetStats.find(nItemID);
+        if (it == mapAssetStats.end() || it->second.nTimeFinished != 0 || !it->second.setPeersAsked.count(pfrom->GetId())) return;
+        if (it->second.setPeersReported.insert(pfrom->GetId()).second)
+            it->second.nItemsReported += nCount;
+        // the items it announced are yet to arrive, start the quiet period over
+        nTimeLastBumped = GetTime();
+    }
+}
+
+bool CMasternodeSync::IsAssetComplete()
+{
+    LOCK(cs_stats);
+    auto it = mapAssetStats.find(nRequestedMasternodeAssets);
+    if (it == mapAssetStats.end() || it->second.setPeersAsked.empty()) return false;
+    for (NodeId nodeid : it->second.setPeersAsked) {
+        if (!it->second.setPeersReported.count(nodeid)) return false;
+    }
+    return GetTime() - nTimeLastBumped >= MASTERNODE_SYNC_QUIET_SECONDS;
+}
+
+void CMasternodeSync::RequestAssets(const std::vector<CNode*>& vPeers, CConnman& connman)
+{
+    for (CNode* pnode : vPeers) {
+        // request from three peers max
+        if (nRequestedMasternodeAttempt >= MASTERNODE_SYNC_MAX_PEERS) return;
+
+        CNetMsgMaker msgMaker(pnode->GetSendVersion());
+
+        if (nRequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
+            // only request once from each peer
+            if(netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-list-sync")) continue;
+            netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-list-sync");
+
+            if (pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
+
+            mnodeman.DsegUpdate(pnode, connman);
+        } else if (nRequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
+            // only request once from each peer
+            if(netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-payment-sync")) continue;
+            netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-payment-sync");
+
+            if(pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
+
+            // ask node for all payment votes it has (new nodes will only return votes for future payments)
+            //sync payment votes
+            if(pnode->nVersion == 70208) {
+                connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC, mnpayments.GetStorageLimit()));
+            } else {
+                connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC));
+            }
+            // ask node for missing pieces only (old nodes will not be asked)
+            mnpayments.RequestLowDataPaymentBlocks(pnode, connman);
+        } else {
+            return;
+        }
+
+        nRequestedMasternodeAttempt++;
+        LogPrintf("CMasternodeSync::RequestAssets -- requesting %s from peer=%d\n", GetAssetName(), pnode->GetId());
+        LOCK(cs_stats);
+        mapAssetStats[nRequestedMasternodeAssets].setPeersAsked.insert(pnode->GetId());
     }
 }
 
 void CMasternodeSync::ProcessTick(CConnman& connman)
 {
     static int nTick = 0;
-    if(nTick++ % MASTERNODE_SYNC_TICK_SECONDS != 0) return;
+    nTick++;
 
     // reset the sync process if the last call to this function was more than 60 minutes ago (client was in sleep mode)
     static int64_t nTimeLastProcess = GetTime();
@@ -157,12 +245,17 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
         return;
     }
 
+    // QUICK MODE (REGTEST ONLY!) steps through the assets every MASTERNODE_SYNC_TICK_SECONDS
+    const bool fQuickMode = Params().NetworkIDString() == CBaseChainParams::REGTEST;
+    if(fQuickMode && nTick % MASTERNODE_SYNC_TICK_SECONDS != 1) return;
+
     // Calculate "progress" for LOG reporting / GUI notification
     double nSyncProgress = double(nRequestedMasternodeAttempt + (nRequestedMasternodeAssets - 1) * 5) / (5*4);
-    LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nRequestedMasternodeAttempt %d nSyncProgress %f\n", nTick, nRequestedMasternodeAssets, nRequestedMasternodeAttempt, nSyncProgress);
+    LogPrint(BCLog::MNSYNC, "CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nRequestedMasternodeAttempt %d nSyncProgress %f\n", nTick, nRequestedMasternodeAssets, nRequestedMasternodeAttempt, nSyncProgress);
     uiInterface.NotifyAdditionalDataSyncProgressChanged(nSyncProgress);
 
     std::vector<CNode*> vNodesCopy = connman.CopyNodeVector(CConnman::FullyConnectedOnly);
+    std::vector<CNode*> vPeers;
 
     for (auto& pnode : vNodesCopy)
     {
@@ -174,8 +267,7 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
         // initiated from another node, so skip it too.
         if(pnode->fMasternode || (fMasternodeMode && pnode->fInbound)) continue;
 
-        // QUICK MODE (REGTEST ONLY!)
-        if(Params().NetworkIDString() == CBaseChainParams::REGTEST)
+        if(fQuickMode)
         {
             if(nRequestedMasternodeAttempt <= 2) {
                 connman.PushMessage(pnode, msgMaker.Make(NetMsgType::GETSPORKS)); //get current network sporks
@@ -197,139 +289,95 @@ void CMasternodeSync::ProcessTick(CConnman& connman)
         }
 
         // NORMAL NETWORK MODE - TESTNET/MAINNET
-        {
-            if(netfulfilledman.HasFulfilledRequest(pnode->addr, "full-sync")) {
-                // We already fully synced from this node recently,
-                // disconnect to free this connection slot for another peer.
-                pnode->fDisconnect = true;
-                LogPrintf("CMasternodeSync::ProcessTick -- disconnecting from recently synced peer=%d\n", pnode->GetId());
-                continue;
-            }
-
-            // SPORK : ALWAYS ASK FOR SPORKS AS WE SYNC
-
-            if(!netfulfilledman.HasFulfilledRequest(pnode->addr, "spork-sync")) {
-                // always get sporks first, only request once from each peer
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "spork-sync");
-                // get current network sporks
-                connman.PushMessage(pnode, msgMaker.Make(NetMsgType::GETSPORKS));
-                LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- requesting sporks from peer=%d\n", nTick, nRequestedMasternodeAssets, pnode->GetId());
-            }
-
-            // INITIAL TIMEOUT
-
-            if(nRequestedMasternodeAssets == MASTERNODE_SYNC_WAITING) {
-                if(GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    // At this point we know that:
-                    // a) there are peers (because we are looping on at least one of them);
-                    // b) we waited for at least MASTERNODE_SYNC_TIMEOUT_SECONDS since we reached
-                    //    the headers tip the last time (i.e. since we switched from
-                    //     MASTERNODE_SYNC_INITIAL to MASTERNODE_SYNC_WAITING and bumped time);
-                    // c) there were no blocks (UpdatedBlockTip, NotifyHeaderTip) or headers (AcceptedBlockHeader)
-                    //    for at least MASTERNODE_SYNC_TIMEOUT_SECONDS.
-                    // We must be at the tip already, let's move to the next asset.
-                    SwitchToNextAsset(connman);
-                }
-            }
+        if(netfulfilledman.HasFulfilledRequest(pnode->addr, "full-sync")) {
+            // We already fully synced from this node recently,
+            // disconnect to free this connection slot for another peer.
+            pnode->fDisconnect = true;
+            LogPrintf("CMasternodeSync::ProcessTick -- disconnecting from recently synced peer=%d\n", pnode->GetId());
+            continue;
+        }
 
-            // MNLIST : SYNC MASTERNODE LIST FROM OTHER CONNECTED CLIENTS
-
-            if(nRequestedMasternodeAssets == MASTERNODE_SYNC_LIST) {
-                LogPrint(BCLog::MASTERNODE, "CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                if(GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
-                    if (nRequestedMasternodeAttempt == 0) {
-                        LogPrintf("CMasternodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // there is no way we can continue without masternode list, fail here and try later
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+        // SPORK : ALWAYS ASK FOR SPORKS AS WE SYNC
 
-                // request from three peers max
-                if (nRequestedMasternodeAttempt > 2) {
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+        if(!netfulfilledman.HasFulfilledRequest(pnode->addr, "spork-sync")) {
+            // always get sporks first, only request once from each peer
+            netfulfilledman.AddFulfilledRequest(pnode->addr, "spork-sync");
+            // get current network sporks
+            connman.PushMessage(pnode, msgMaker.Make(NetMsgType::GETSPORKS));
+            LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- requesting sporks from peer=%d\n", nTick, nRequestedMasternodeAssets, pnode->GetId());
+        }
 
-                // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-list-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-list-sync");
+        vPeers.push_back(pnode);
+    }
 
-                if (pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
-                nRequestedMasternodeAttempt++;
+    // the timeouts only run while there are peers to sync from
+    if(vPeers.empty()) {
+        connman.ReleaseNodeVector(vNodesCopy);
+        return;
+    }
 
-                mnodeman.DsegUpdate(pnode, connman);
+    // INITIAL TIMEOUT
+
+    if(nRequestedMasternodeAssets == MASTERNODE_SYNC_WAITING) {
+        if(GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
+            // At this point we know that:
+            // a) there are peers;
+            // b) we waited for at least MASTERNODE_SYNC_TIMEOUT_SECONDS since we reached
+            //    the headers tip the last time (i.e. since we switched from
+            //     MASTERNODE_SYNC_INITIAL to MASTERNODE_SYNC_WAITING and bumped time);
+            // c) there were no blocks (UpdatedBlockTip, NotifyHeaderTip) or headers (AcceptedBlockHeader)
+            //    for at least MASTERNODE_SYNC_TIMEOUT_SECONDS.
+            // We must be at the tip already, let's move to the next asset.
+            SwitchToNextAsset(connman);
+        }
+    }
 
+    // MNLIST : SYNC MASTERNODE LIST FROM OTHER CONNECTED CLIENTS
+    // MNW : SYNC MASTERNODE PAYMENT VOTES FROM OTHER CONNECTED CLIENTS
+    // The votes are checked against the list, so they are only requested once it is synced.
+
+    if(nRequestedMasternodeAssets == MASTERNODE_SYNC_LIST || nRequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
+        LogPrint(BCLog::MNSYNC, "CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
+        // check for timeout first
+        // MNW might take a lot longer than MASTERNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
+        // but that should be OK and it should timeout eventually.
+        if(GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
+            LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
+            {
+                LOCK(cs_stats);
+                mapAssetStats[nRequestedMasternodeAssets].fTimedOut = true;
+            }
+            if (nRequestedMasternodeAttempt == 0) {
+                LogPrintf("CMasternodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
+                // there is no way we can continue without masternode list,
+                // and probably not a good idea to proceed without winner list, fail here and try later
+                Fail();
                 connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+                return;
             }
+            SwitchToNextAsset(connman);
+            connman.ReleaseNodeVector(vNodesCopy);
+            return;
+        }
 
-            // MNW : SYNC MASTERNODE PAYMENT VOTES FROM OTHER CONNECTED CLIENTS
-
-            if(nRequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
-                LogPrint(BCLog::MNPAYMENTS, "CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedMasternodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                // This might take a lot longer than MASTERNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
-                // but that should be OK and it should timeout eventually.
-                if(GetTime() - nTimeLastBumped > MASTERNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- timeout\n", nTick, nRequestedMasternodeAssets);
-                    if (nRequestedMasternodeAttempt == 0) {
-                        LogPrintf("CMasternodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // probably not a good idea to proceed without winner list
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-
-                // check for data
-                // if mnpayments already has enough blocks and votes, switch to the next asset
-                // try to fetch data from at least two peers though
-                if(nRequestedMasternodeAttempt > 1 && mnpayments.IsEnoughData()) {
-                    LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- found enough data\n", nTick, nRequestedMasternodeAssets);
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-
-                // request from three peers max
-                if (nRequestedMasternodeAttempt > 2) {
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-
-                // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "masternode-payment-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "masternode-payment-sync");
-
-                if(pnode->nVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
-                nRequestedMasternodeAttempt++;
-
-                // ask node for all payment votes it has (new nodes will only return votes for future payments)
-                //sync payment votes
-                if(pnode->nVersion == 70208) {
-                    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC, mnpayments.GetStorageLimit()));
-                } else {
-                    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MASTERNODEPAYMENTSYNC));
-                }
-                // ask node for missing pieces only (old nodes will not be asked)
-                mnpayments.RequestLowDataPaymentBlocks(pnode, connman);
-
+        // check for data
+        // every peer we asked told us what it sent and all of it arrived, or,
+        // if mnpayments already has enough blocks and votes, switch to the next asset
+        // (try to fetch the votes from at least two peers though)
+        if(IsAssetComplete() ||
+                (nRequestedMasternodeAssets == MASTERNODE_SYNC_MNW && nRequestedMasternodeAttempt > 1 && mnpayments.IsEnoughData())) {
+            LogPrintf("CMasternodeSync::ProcessTick -- nTick %d nRequestedMasternodeAssets %d -- found enough data\n", nTick, nRequestedMasternodeAssets);
+            SwitchToNextAsset(connman);
+            if(nRequestedMasternodeAssets != MASTERNODE_SYNC_MNW) {
                 connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+                return;
             }
         }
+
+        // ask all the peers at once rather than one per tick
+        RequestAssets(vPeers, connman);
     }
-    // looped through all nodes, release them
+
     connman.ReleaseNodeVector(vNodesCopy);
 }
 
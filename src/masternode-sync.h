@@ -9,6 +9,10 @@
 
 #include <univalue.h>
 
+#include <map>
+#include <set>
+#include <vector>
+
 class CMasternodeSync;
 
 static const int MASTERNODE_SYNC_FAILED          = -1;
@@ -18,13 +22,31 @@ static const int MASTERNODE_SYNC_LIST            = 2;
 static const int MASTERNODE_SYNC_MNW             = 3;
 static const int MASTERNODE_SYNC_FINISHED        = 999;
 
-static const int MASTERNODE_SYNC_TICK_SECONDS    = 6;
+static const int MASTERNODE_SYNC_TICK_SECONDS    = 6; // steps of the regtest quick mode
 static const int MASTERNODE_SYNC_TIMEOUT_SECONDS = 12; // our blocks are 60 seconds so 12 seconds should be fine
+static const int MASTERNODE_SYNC_QUIET_SECONDS   = 2; // an asset every asked peer reported as sent is complete once nothing arrived for this long
 
 static const int MASTERNODE_SYNC_ENOUGH_PEERS    = 6;
+static const int MASTERNODE_SYNC_MAX_PEERS       = 3; // peers an asset is requested from, all at once
 
 extern CMasternodeSync masternodeSync;
 
+/** Progress of a sync asset, for mnsync status */
+struct CMasternodeSyncAssetStats
+{
+    int64_t nTimeStarted = 0;
+    //! 0 while it is being synced
+    int64_t nTimeFinished = 0;
+    //! Peers the asset was requested from
+    std::set<NodeId> setPeersAsked;
+    //! Those of them that reported with SYNCSTATUSCOUNT how many items they sent
+    std::set<NodeId> setPeersReported;
+    int nItemsReported = 0;
+    //! Items received while the asset was being synced, headers and blocks for the blockchain assets
+    int nItemsReceived = 0;
+    bool fTimedOut = false;
+};
+
 //
 // CMasternodeSync : Sync masternode assets in stages
 //
@@ -44,7 +66,15 @@ private:
     // ... or failed
     int64_t nTimeLastFailure;
 
+    // Protects mapAssetStats
+    mutable CCriticalSection cs_stats;
+    std::map<int, CMasternodeSyncAssetStats> mapAssetStats;
+
     void Fail();
+    /** Whether every peer the current asset was asked from reported and nothing arrived for MASTERNODE_SYNC_QUIET_SECONDS */
+    bool IsAssetComplete();
+    /** Request the current asset from every peer not asked for it yet, up to MASTERNODE_SYNC_MAX_PEERS */
+    void RequestAssets(const std::vector<CNode*>& vPeers, CConnman& connman);
 
 public:
     CMasternodeSync() { Reset(); }
@@ -60,7 +90,10 @@ public:
     int GetAttempt() { return nRequestedMasternodeAttempt; }
     void BumpAssetLastTime(const std::string& strFuncName);
     int64_t GetAssetStartTime() { return nTimeAssetSyncStarted; }
-    std::string GetAssetName();
+    std::string GetAssetName() { return GetAssetName(nRequestedMasternodeAssets); }
+    static std::string GetAssetName(int nAsset);
+    /** The assets synced since the last reset, in the order they were started */
+    std::vector<std::pair<int, CMasternodeSyncAssetStats> > GetAssetStats() const;
     std::string GetSyncStatus();
 
     void Reset();
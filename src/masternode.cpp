@@ -7,6 +7,7 @@
 #include <base58.h>
 #include <clientversion.h>
 #include <init.h>
+#include <limitedmap.h>
 #include <netbase.h>
 #include <masternode.h>
 #include <masternode-payments.h>
@@ -21,6 +22,23 @@
 
 #include <boost/lexical_cast.hpp>
 
+/** Good masternode announce and ping signatures, so a message is only verified once */
+static CCriticalSection cs_mapVerifiedSignatures;
+static limitedmap<uint256, int64_t> mapVerifiedSignatures(MAX_VERIFIED_MASTERNODE_SIGNATURES);
+static int64_t nVerifiedSignaturesCounter = 0;
+
+static bool IsSignatureCached(const uint256& nCacheKey)
+{
+    LOCK(cs_mapVerifiedSignatures);
+    return mapVerifiedSignatures.count(nCacheKey);
+}
+
+static void AddSignatureToCache(const uint256& nCacheKey)
+{
+    LOCK(cs_mapVerifiedSignatures);
+    // limitedmap keeps the highest values, i.e. the most recently added keys
+    mapVerifiedSignatures.insert(std::make_pair(nCacheKey, ++nVerifiedSignaturesCounter));
+}
 
 CMasternode::CMasternode() :
     masternode_info_t{ MASTERNODE_ENABLED, PROTOCOL_VERSION, GetAdjustedTime()}
@@ -125,11 +143,33 @@ CMasternode::CollateralStatus CMasternode::CheckCollateral(const COutPoint& outp
     return COLLATERAL_OK;
 }
 
+bool CMasternode::IsCheckDue(bool fForce) const
+{
+    LOCK(cs);
+    return !ShutdownRequested() && (fForce || GetTime() - nTimeLastChecked >= MASTERNODE_CHECK_SECONDS) && !IsOutpointSpent();
+}
+
 void CMasternode::Check(bool fForce)
 {
     AssertLockHeld(cs_main);
     LOCK(cs);
 
+    bool fCollateralUnspent = true;
+    int nHeight = 0;
+    // skip the lookup if the check returns before using it
+    if(!fUnitTest && IsCheckDue(fForce)) {
+        Coin coin;
+        fCollateralUnspent = GetUTXOCoin(outpoint, coin);
+        nHeight = chainActive.Height();
+    }
+
+    Check(fForce, fCollateralUnspent, nHeight);
+}
+
+void CMasternode::Check(bool fForce, bool fCollateralUnspent, int nHeight)
+{
+    LOCK(cs);
+
     if(ShutdownRequested()) return;
 
     if(!fForce && (GetTime() - nTimeLastChecked < MASTERNODE_CHECK_SECONDS)) return;
@@ -140,16 +180,10 @@ void CMasternode::Check(bool fForce)
     //once spent, stop doing the checks
     if(IsOutpointSpent()) return;
 
-    int nHeight = 0;
-    if(!fUnitTest) {
-        Coin coin;
-        if(!GetUTXOCoin(outpoint, coin)) {
-            nActiveState = MASTERNODE_OUTPOINT_SPENT;
-            LogPrint(BCLog::MASTERNODE, "CMasternode::Check -- Failed to find Masternode UTXO, masternode=%s\n", outpoint.ToStringShort());
-            return;
-        }
-
-        nHeight = chainActive.Height();
+    if(!fCollateralUnspent) {
+        nActiveState = MASTERNODE_OUTPOINT_SPENT;
+        LogPrint(BCLog::MASTERNODE, "CMasternode::Check -- Failed to find Masternode UTXO, masternode=%s\n", outpoint.ToStringShort());
+        return;
     }
 
     if(IsPoSeBanned()) {
@@ -629,37 +663,39 @@ bool CMasternodeBroadcast::Sign(const CKey& keyCollateralAddress)
     return true;
 }
 
+bool CMasternodeBroadcast::VerifySignature(std::string& strErrorRet) const
+{
+    const bool fNewSigs = sporkManager.IsSporkActive(SPORK_4_NEW_SIGS);
+
+    // the signature hash covers every field of the old format message too
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << GetSignatureHash() << pubKeyCollateralAddress << vchSig << fNewSigs;
+    const uint256 nCacheKey = ss.GetHash();
+    if (IsSignatureCached(nCacheKey)) return true;
+
+    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
+                    pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
+                    boost::lexical_cast<std::string>(nProtocolVersion);
+
+    // maybe it's in old format
+    if (!(fNewSigs && CHashSigner::VerifyHash(GetSignatureHash(), pubKeyCollateralAddress, vchSig, strErrorRet)) &&
+        !CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strErrorRet)) {
+        return false;
+    }
+
+    AddSignatureToCache(nCacheKey);
+    return true;
+}
+
 bool CMasternodeBroadcast::CheckSignature(int& nDos) const
 {
     std::string strError = "";
     nDos = 0;
 
-    if (sporkManager.IsSporkActive(SPORK_4_NEW_SIGS)) {
-        uint256 hash = GetSignatureHash();
-
-        if (!CHashSigner::VerifyHash(hash, pubKeyCollateralAddress, vchSig, strError)) {
-            // maybe it's in old format
-            std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
-                            pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
-                            boost::lexical_cast<std::string>(nProtocolVersion);
-
-            if (!CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError)){
-                // nope, not in old format either
-                LogPrintf("CMasternodeBroadcast::CheckSignature -- Got bad Masternode announce signature, error: %s\n", strError);
-                nDos = 100;
-                return false;
-            }
-        }
-    } else {
-        std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) +
-                        pubKeyCollateralAddress.GetID().ToString() + pubKeyMasternode.GetID().ToString() +
-                        boost::lexical_cast<std::string>(nProtocolVersion);
-
-        if (!CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError)){
-            LogPrintf("CMasternodeBroadcast::CheckSignature -- Got bad Masternode announce signature, error: %s\n", strError);
-            nDos = 100;
-            return false;
-        }
+    if (!VerifySignature(strError)) {
+        LogPrintf("CMasternodeBroadcast::CheckSignature -- Got bad Masternode announce signature, error: %s\n", strError);
+        nDos = 100;
+        return false;
     }
 
     return true;
@@ -747,35 +783,51 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
     return true;
 }
 
+bool CMasternodePing::VerifySignature(const CPubKey& pubKeyMasternode, std::string& strErrorRet) const
+{
+    const bool fNewSigs = sporkManager.IsSporkActive(SPORK_4_NEW_SIGS);
+
+    // GetSignatureHash() skips blockHash in the old format, so key on every field
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << masternodeOutpoint << blockHash << sigTime << nDaemonVersion << pubKeyMasternode << vchSig << fNewSigs;
+    const uint256 nCacheKey = ss.GetHash();
+    if (IsSignatureCached(nCacheKey)) return true;
+
+    std::string strMessage = CTxIn(masternodeOutpoint).ToString() + blockHash.ToString() +
+                boost::lexical_cast<std::string>(sigTime);
+
+    if (!(fNewSigs && CHashSigner::VerifyHash(GetSignatureHash(), pubKeyMasternode, vchSig, strErrorRet)) &&
+        !CMessageSigner::VerifyMessage(pubKeyMasternode, vchSig, strMessage, strErrorRet)) {
+        return false;
+    }
+
+    AddSignatureToCache(nCacheKey);
+    return true;
+}
+
 bool CMasternodePing::CheckSignature(const CPubKey& pubKeyMasternode, int &nDos) const
 {
     std::string strError = "";
     nDos = 0;
 
-    if (sporkManager.IsSporkActive(SPORK_4_NEW_SIGS)) {
-        uint256 hash = GetSignatureHash();
-
-        if (!CHashSigner::VerifyHash(hash, pubKeyMasternode, vchSig, strError)) {
-            std::string strMessage = CTxIn(masternodeOutpoint).ToString() + blockHash.ToString() +
-                        boost::lexical_cast<std::string>(sigTime);
+    if (!VerifySignature(pubKeyMasternode, strError)) {
+        LogPrintf("CMasternodePing::CheckSignature -- Got bad Masternode ping signature, masternode=%s, error: %s\n", masternodeOutpoint.ToStringShort(), strError);
+        nDos = 33;
+        return false;
+    }
 
-            if (!CMessageSigner::VerifyMessage(pubKeyMasternode, vchSig, strMessage, strError)) {
-                LogPrintf("CMasternodePing::CheckSignature -- Got bad Masternode ping signature, masternode=%s, error: %s\n", masternodeOutpoint.ToStringShort(), strError);
-                nDos = 33;
-                return false;
-            }
-        }
-    } else {
-        std::string strMessage = CTxIn(masternodeOutpoint).ToString() + blockHash.ToString() +
-                    boost::lexical_cast<std::string>(sigTime);
+    return true;
+}
 
-        if (!CMessageSigner::VerifyMessage(pubKeyMasternode, vchSig, strMessage, strError)) {
-            LogPrintf("CMasternodePing::CheckSignature -- Got bad Masternode ping signature, masternode=%s, error: %s\n", masternodeOutpoint.ToStringShort(), strError);
-            nDos = 33;
-            return false;
-        }
+bool CMasternodeSigCheck::operator()()
+{
+    std::string strError;
+    if (pmnb) {
+        pmnb->VerifySignature(strError);
+    }
+    if (pmnp) {
+        pmnp->VerifySignature(pubKeyMasternode, strError);
     }
-
     return true;
 }
 
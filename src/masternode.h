@@ -21,6 +21,9 @@ static const int MASTERNODE_NEW_START_REQUIRED_SECONDS  = 180 * 60;
 
 static const int MASTERNODE_POSE_BAN_MAX_SCORE          = 5;
 
+//! number of good announce and ping signatures remembered, a few times the size of the list
+static const unsigned int MAX_VERIFIED_MASTERNODE_SIGNATURES = 50000;
+
 //
 // The Masternode Ping Class : Contains a different serialize method for sending pings from masternodes throughout the network
 //
@@ -87,6 +90,7 @@ public:
     bool IsExpired() const { return GetAdjustedTime() - sigTime > MASTERNODE_NEW_START_REQUIRED_SECONDS; }
 
     bool Sign(const CKey& keyMasternode, const CPubKey& pubKeyMasternode);
+    bool VerifySignature(const CPubKey& pubKeyMasternode, std::string& strErrorRet) const;
     bool CheckSignature(const CPubKey& pubKeyMasternode, int &nDos) const;
     bool SimpleCheck(int& nDos);
     bool CheckAndUpdate(CMasternode* pmn, bool fFromNewBroadcast, int& nDos, CConnman& connman);
@@ -228,6 +232,10 @@ public:
     static CollateralStatus CheckCollateral(const COutPoint& outpoint, const CPubKey& pubkey);
     static CollateralStatus CheckCollateral(const COutPoint& outpoint, const CPubKey& pubkey, int& nHeightRet);
     void Check(bool fForce = false);
+    /// Check using the result of a collateral lookup done by the caller, doesn't need cs_main
+    void Check(bool fForce, bool fCollateralUnspent, int nHeight);
+    /// Whether Check(fForce) would do anything, i.e. it is worth looking up the collateral
+    bool IsCheckDue(bool fForce) const;
 
     bool IsBroadcastedWithin(int nSeconds) { return GetAdjustedTime() - sigTime < nSeconds; }
 
@@ -368,10 +376,41 @@ public:
     bool CheckOutpoint(int& nDos);
 
     bool Sign(const CKey& keyCollateralAddress);
+    bool VerifySignature(std::string& strErrorRet) const;
     bool CheckSignature(int& nDos) const;
     void Relay(CConnman& connman) const;
 };
 
+/**
+ * Signature check of a queued masternode announce or ping, run on a
+ * CCheckQueue before the messages are applied in order. Good signatures
+ * are remembered, so the CheckSignature() calls made while applying the
+ * messages don't verify them again.
+ */
+class CMasternodeSigCheck
+{
+private:
+    const CMasternodeBroadcast* pmnb;
+    const CMasternodePing* pmnp;
+    CPubKey pubKeyMasternode;
+
+public:
+    CMasternodeSigCheck() : pmnb(nullptr), pmnp(nullptr) {}
+    explicit CMasternodeSigCheck(const CMasternodeBroadcast& mnb) : pmnb(&mnb), pmnp(nullptr) {}
+    CMasternodeSigCheck(const CMasternodePing& mnp, const CPubKey& pubKeyMasternodeIn) :
+        pmnb(nullptr), pmnp(&mnp), pubKeyMasternode(pubKeyMasternodeIn) {}
+
+    // Always succeeds, failures are reported again when the message is applied
+    bool operator()();
+
+    void swap(CMasternodeSigCheck& check)
+    {
+        std::swap(pmnb, check.pmnb);
+        std::swap(pmnp, check.pmnp);
+        std::swap(pubKeyMasternode, check.pubKeyMasternode);
+    }
+};
+
 class CMasternodeVerification
 {
 public:
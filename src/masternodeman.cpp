@@ -5,18 +5,26 @@
 
 #include <activemasternode.h>
 #include <addrman.h>
+#include <checkqueue.h>
 #include <clientversion.h>
+#include <hash.h>
+#include <instantx.h>
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
+#include <memusage.h>
 #include <messagesigner.h>
 #include <netfulfilledman.h>
 #include <netmessagemaker.h>
+#include <random.h>
 #include <script/standard.h>
 #include <ui_interface.h>
 #include <util.h>
+#include <validationinterface.h>
 #include <warnings.h>
 
+#include <limits>
+
 /** Masternode manager */
 CMasternodeMan mnodeman;
 
@@ -24,14 +32,12 @@ const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = "CMasternodeMan
 const int CMasternodeMan::LAST_PAID_SCAN_BLOCKS = 100;
 const int CMasternodeMan::MAX_POSE_CONNECTIONS = 10;
 
-struct CompareLastPaidBlock
-{
-    bool operator()(const std::pair<int, const CMasternode*>& t1,
-                    const std::pair<int, const CMasternode*>& t2) const
-    {
-        return (t1.first != t2.first) ? (t1.first < t2.first) : (t1.second->outpoint < t2.second->outpoint);
-    }
-};
+static CCheckQueue<CMasternodeSigCheck> mnsigcheckqueue(128);
+
+void ThreadMasternodeSigCheck() {
+    RenameThread("globaltoken-mnsigch");
+    mnsigcheckqueue.Thread();
+}
 
 struct CompareScoreMN
 {
@@ -42,16 +48,6 @@ struct CompareScoreMN
     }
 };
 
-struct CompareByAddr
-
-{
-    bool operator()(const CMasternode* t1,
-                    const CMasternode* t2) const
-    {
-        return t1->addr < t2->addr;
-    }
-};
-
 CMasternodeMan::CMasternodeMan():
     cs(),
     mapMasternodes(),
@@ -64,6 +60,7 @@ CMasternodeMan::CMasternodeMan():
     listScheduledMnbRequestConnections(),
     fMasternodesAdded(false),
     fMasternodesRemoved(false),
+    fSnapshotDirty(true),
     mapSeenMasternodeBroadcast(),
     mapSeenMasternodePing()
 {}
@@ -76,7 +73,11 @@ bool CMasternodeMan::Add(CMasternode &mn)
 
     LogPrint(BCLog::MASTERNODE, "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapMasternodes[mn.outpoint] = mn;
+    IndexMasternode(mn);
     fMasternodesAdded = true;
+    fSnapshotDirty = true;
+    MarkChanged(mn.outpoint, CT_NEW);
+    InvalidateScoreCache();
     return true;
 }
 
@@ -123,20 +124,57 @@ bool CMasternodeMan::PoSeBan(const COutPoint &outpoint)
         return false;
     }
     pmn->PoSeBan();
+    fSnapshotDirty = true;
+    MarkChanged(outpoint, CT_UPDATED);
 
     return true;
 }
 
 void CMasternodeMan::Check()
 {
-    LOCK2(cs_main, cs);
-
     LogPrint(BCLog::MASTERNODE, "CMasternodeMan::Check -- Checking ...\n");
 
-    for (auto& mnpair : mapMasternodes) {
-        // NOTE: internally it checks only every MASTERNODE_CHECK_SECONDS seconds
-        // since the last time, so expect some MNs to skip this
-        mnpair.second.Check();
+    // Only the collateral lookups need cs_main. Do them first, in batches so
+    // cs_main is not held across the whole list, then run the rest of the
+    // checks under cs alone. mapMasternodes is sorted by outpoint, which keeps
+    // the lookups of a batch close together in pcoinsTip.
+    std::vector<COutPoint> vecOutpoints;
+    {
+        LOCK(cs);
+        for (const auto& mnpair : mapMasternodes) {
+            // NOTE: internally it checks only every MASTERNODE_CHECK_SECONDS seconds
+            // since the last time, so expect some MNs to skip this
+            if (mnpair.second.IsCheckDue(false)) {
+                vecOutpoints.push_back(mnpair.first);
+            }
+        }
+    }
+    if (vecOutpoints.empty()) return;
+
+    // unspent flag and tip height of the lookup, per outpoint
+    std::vector<std::pair<bool, int> > vecCollateral(vecOutpoints.size());
+    for (size_t nStart = 0; nStart < vecOutpoints.size(); nStart += MAX_COLLATERAL_LOOKUP_BATCH) {
+        size_t nEnd = nStart + MAX_COLLATERAL_LOOKUP_BATCH;
+        if (nEnd > vecOutpoints.size()) nEnd = vecOutpoints.size();
+        LOCK(cs_main);
+        int nHeight = chainActive.Height();
+        for (size_t i = nStart; i < nEnd; i++) {
+            Coin coin;
+            vecCollateral[i] = std::make_pair(GetUTXOCoin(vecOutpoints[i], coin), nHeight);
+        }
+    }
+
+    LOCK(cs);
+    for (size_t i = 0; i < vecOutpoints.size(); i++) {
+        CMasternode* pmn = Find(vecOutpoints[i]);
+        if (pmn) {
+            const int nActiveStatePrev = pmn->nActiveState;
+            pmn->Check(false, vecCollateral[i].first, vecCollateral[i].second);
+            if (pmn->nActiveState != nActiveStatePrev) {
+                fSnapshotDirty = true;
+                MarkChanged(pmn->outpoint, CT_UPDATED);
+            }
+        }
     }
 }
 
@@ -146,13 +184,14 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
 
     LogPrintf("CMasternodeMan::CheckAndRemove\n");
 
+    // takes cs_main only for its collateral lookups
+    Check();
+
     {
         // Need LOCK2 here to ensure consistent locking order because code below locks cs_main
         // in CheckMnbAndUpdateMasternodeList()
         LOCK2(cs_main, cs);
 
-        Check();
-
         // Remove spent masternodes, prepare structures and make requests to reasure the state of inactive ones
         rank_pair_vec_t vecMasternodeRanks;
         // ask for up to MNB_RECOVERY_MAX_ASK_ENTRIES masternode entries at a time
@@ -170,8 +209,12 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
                 mWeAskedForMasternodeListEntry.erase(it->first);
 
                 // and finally remove it from the list
+                UnindexMasternode(it->second);
+                MarkChanged(it->first, CT_DELETED);
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
+                fSnapshotDirty = true;
+                InvalidateScoreCache();
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
                             masternodeSync.IsSynced() &&
@@ -316,6 +359,9 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
         }
 
         LogPrintf("CMasternodeMan::CheckAndRemove -- %s\n", ToString());
+
+        // Check() above updated the state of every entry
+        PublishSnapshot();
     }
 
     if(fMasternodesRemoved) {
@@ -326,7 +372,17 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
+    for (const auto& mnpair : mapMasternodes) {
+        MarkChanged(mnpair.first, CT_DELETED);
+    }
     mapMasternodes.clear();
+    mapOutpointsByPubKey.clear();
+    mapOutpointsByCollateral.clear();
+    setOutpointsByLastPaid.clear();
+    mapOutpointsByAddr.clear();
+    setDuplicateAddrs.clear();
+    fSnapshotDirty = true;
+    InvalidateScoreCache();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -395,7 +451,10 @@ void CMasternodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
         }
     }
 
-    if (pnode->GetSendVersion() == 70208) {
+    if (pnode->nVersion >= MASTERNODE_LIST_DIGEST_VERSION) {
+        // only ask for what our list is missing or has an older version of
+        connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTDIGEST, GetListDigest()));
+    } else if (pnode->GetSendVersion() == 70208) {
         connman.PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, CTxIn()));
     } else {
         connman.PushMessage(pnode, msgMaker.Make(NetMsgType::DSEG, COutPoint()));
@@ -440,26 +499,141 @@ bool CMasternodeMan::GetMasternodeInfo(const COutPoint& outpoint, masternode_inf
 bool CMasternodeMan::GetMasternodeInfo(const CPubKey& pubKeyMasternode, masternode_info_t& mnInfoRet)
 {
     LOCK(cs);
-    for (const auto& mnpair : mapMasternodes) {
-        if (mnpair.second.pubKeyMasternode == pubKeyMasternode) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
-        }
-    }
-    return false;
+    const CMasternode* pmn = FindIndexed(mapOutpointsByPubKey, pubKeyMasternode.GetID());
+    if (!pmn || pmn->pubKeyMasternode != pubKeyMasternode)
+        return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeInfo(const CScript& payee, masternode_info_t& mnInfoRet)
+{
+    // Collateral addresses are always P2PKH, so the key is all we need to look up
+    CTxDestination dest;
+    if (!ExtractDestination(payee, dest) || !boost::get<CKeyID>(&dest) || GetScriptForDestination(dest) != payee)
+        return false;
+
+    LOCK(cs);
+    const CMasternode* pmn = FindIndexed(mapOutpointsByCollateral, boost::get<CKeyID>(dest));
+    if (!pmn)
+        return false;
+    mnInfoRet = pmn->GetInfo();
+    return true;
+}
+
+void CMasternodeMan::IndexMasternode(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    mapOutpointsByPubKey[mn.pubKeyMasternode.GetID()].insert(mn.outpoint);
+    mapOutpointsByCollateral[mn.pubKeyCollateralAddress.GetID()].insert(mn.outpoint);
+    setOutpointsByLastPaid.emplace(mn.GetLastPaidBlock(), mn.outpoint);
+    std::set<COutPoint>& setOutpoints = mapOutpointsByAddr[mn.addr];
+    setOutpoints.insert(mn.outpoint);
+    if (setOutpoints.size() > 1)
+        setDuplicateAddrs.insert(mn.addr);
+}
+
+static void EraseFromIndex(std::unordered_map<CKeyID, std::set<COutPoint>, CMasternodeKeyIDHasher>& index, const CKeyID& keyID, const COutPoint& outpoint)
+{
+    auto it = index.find(keyID);
+    if (it == index.end())
+        return;
+    it->second.erase(outpoint);
+    if (it->second.empty())
+        index.erase(it);
+}
+
+void CMasternodeMan::UnindexMasternode(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    EraseFromIndex(mapOutpointsByPubKey, mn.pubKeyMasternode.GetID(), mn.outpoint);
+    EraseFromIndex(mapOutpointsByCollateral, mn.pubKeyCollateralAddress.GetID(), mn.outpoint);
+    setOutpointsByLastPaid.erase(std::make_pair(mn.GetLastPaidBlock(), mn.outpoint));
+    auto it = mapOutpointsByAddr.find(mn.addr);
+    if (it != mapOutpointsByAddr.end()) {
+        it->second.erase(mn.outpoint);
+        if (it->second.size() < 2)
+            setDuplicateAddrs.erase(mn.addr);
+        if (it->second.empty())
+            mapOutpointsByAddr.erase(it);
+    }
+}
+
+void CMasternodeMan::RebuildIndexes()
 {
     LOCK(cs);
+    mapOutpointsByPubKey.clear();
+    mapOutpointsByCollateral.clear();
+    setOutpointsByLastPaid.clear();
+    mapOutpointsByAddr.clear();
+    setDuplicateAddrs.clear();
     for (const auto& mnpair : mapMasternodes) {
-        CScript scriptCollateralAddress = GetScriptForDestination(mnpair.second.pubKeyCollateralAddress.GetID());
-        if (scriptCollateralAddress == payee) {
-            mnInfoRet = mnpair.second.GetInfo();
-            return true;
+        IndexMasternode(mnpair.second);
+    }
+}
+
+void CMasternodeMan::PublishSnapshot()
+{
+    AssertLockHeld(cs);
+    fSnapshotDirty = false;
+    std::atomic_store(&pSnapshot, masternode_snapshot_t(std::make_shared<const std::map<COutPoint, CMasternode> >(mapMasternodes)));
+}
+
+CMasternodeMan::masternode_snapshot_t CMasternodeMan::GetMasternodeListSnapshot(bool fWait)
+{
+    if (fSnapshotDirty && fWait) {
+        LOCK(cs);
+        if (fSnapshotDirty) {
+            PublishSnapshot();
         }
+    } else if (fSnapshotDirty) {
+        // Whoever holds cs will be done soon enough, until then the previous snapshot will do
+        TRY_LOCK(cs, fLockAcquired);
+        if (fLockAcquired && fSnapshotDirty) {
+            PublishSnapshot();
+        }
+    }
+    masternode_snapshot_t pRet = std::atomic_load(&pSnapshot);
+    return pRet ? pRet : std::make_shared<const std::map<COutPoint, CMasternode> >();
+}
+
+void CMasternodeMan::MarkChanged(const COutPoint& outpoint, ChangeType status)
+{
+    AssertLockHeld(cs);
+
+    auto it = mapChangedMasternodes.find(outpoint);
+    if (it == mapChangedMasternodes.end()) {
+        mapChangedMasternodes.emplace(outpoint, status);
+    } else if (status == CT_DELETED) {
+        // never reported, so there is nothing to remove either
+        if (it->second == CT_NEW) {
+            mapChangedMasternodes.erase(it);
+        } else {
+            it->second = CT_DELETED;
+        }
+    } else if (it->second == CT_DELETED) {
+        it->second = CT_UPDATED;
     }
-    return false;
+}
+
+void CMasternodeMan::NotifyMasternodeChanges()
+{
+    LOCK(cs);
+    for (const auto& change : mapChangedMasternodes) {
+        const CMasternode* pmn = change.second == CT_DELETED ? nullptr : Find(change.first);
+        uiInterface.NotifyMasternodeChanged(change.first, pmn, pmn ? change.second : CT_DELETED);
+        GetMainSignals().NotifyMasternodeChanged(change.first, pmn ? std::make_shared<const masternode_info_t>(pmn->GetInfo()) : nullptr);
+    }
+    mapChangedMasternodes.clear();
+}
+
+CMasternode* CMasternodeMan::FindIndexed(const outpoint_index_t& index, const CKeyID& keyID)
+{
+    AssertLockHeld(cs);
+    auto it = index.find(keyID);
+    if (it == index.end() || it->second.empty())
+        return nullptr;
+    return Find(*it->second.begin());
 }
 
 bool CMasternodeMan::Has(const COutPoint& outpoint)
@@ -471,12 +645,12 @@ bool CMasternodeMan::Has(const COutPoint& outpoint)
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
-bool CMasternodeMan::GetNextMasternodeInQueueForPayment(bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet)
+bool CMasternodeMan::GetNextMasternodeInQueueForPayment(bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet, bool fCountAll)
 {
-    return GetNextMasternodeInQueueForPayment(nCachedBlockHeight, fFilterSigTime, nCountRet, mnInfoRet);
+    return GetNextMasternodeInQueueForPayment(nCachedBlockHeight, fFilterSigTime, nCountRet, mnInfoRet, fCountAll);
 }
 
-bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet)
+bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet, bool fCountAll)
 {
     mnInfoRet = masternode_info_t();
     nCountRet = 0;
@@ -489,63 +663,65 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool f
     // Need LOCK2 here to ensure consistent locking order because the GetBlockHash call below locks cs_main
     LOCK2(cs_main,cs);
 
-    std::vector<std::pair<int, const CMasternode*> > vecMasternodeLastPaid;
-
-    /*
-        Make a vector with all of the last paid times
-    */
+    uint256 blockHash;
+    bool fHaveBlockHash = GetBlockHash(blockHash, nBlockHeight - 101);
+    if(!fHaveBlockHash) {
+        LogPrintf("CMasternode::GetNextMasternodeInQueueForPayment -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight - 101);
+        // there is no winner without the block hash, only the count is left to do
+        if (!fCountAll) return false;
+    }
 
     int nMnCount = CountMasternodes();
 
-    for (const auto& mnpair : mapMasternodes) {
-        if(!mnpair.second.IsValidForPayment()) continue;
+    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
+    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
+    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
+    //  -- (chance per block * chances before IsScheduled will fire)
+    // setOutpointsByLastPaid is already in that order, so the walk can stop as soon as the tenth
+    // is scored and enough masternodes qualified to rule out the fallback below.
+    int nTenthNetwork = nMnCount/10;
+    int nCountTenth = 0;
+    arith_uint256 nHighest = 0;
+    const CMasternode *pBestMasternode = nullptr;
+    const CMasternodeScoreCacheEntry* pscores = fHaveBlockHash ? GetCachedMasternodeScores(blockHash, 0) : nullptr;
+
+    for (const auto& entry : setOutpointsByLastPaid) {
+        if (!fCountAll && nCountTenth > 0 && nCountTenth >= nTenthNetwork && (!fFilterSigTime || nCountRet >= nMnCount/3)) break;
+
+        auto it = mapMasternodes.find(entry.second);
+        if (it == mapMasternodes.end()) continue;
+        const CMasternode& mn = it->second;
+
+        if(!mn.IsValidForPayment()) continue;
 
         //check protocol version
-        if(mnpair.second.nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
+        if(mn.nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
 
         //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if(mnpayments.IsScheduled(mnpair.second, nBlockHeight)) continue;
+        if(mnpayments.IsScheduled(mn, nBlockHeight)) continue;
 
         //it's too new, wait for a cycle
-        if(fFilterSigTime && mnpair.second.sigTime + (nMnCount*2.6*60) > GetAdjustedTime()) continue;
+        if(fFilterSigTime && mn.sigTime + (nMnCount*2.6*60) > GetAdjustedTime()) continue;
 
         //make sure it has at least as many confirmations as there are masternodes
-        if(GetUTXOConfirmations(mnpair.first) < nMnCount) continue;
-
-        vecMasternodeLastPaid.push_back(std::make_pair(mnpair.second.GetLastPaidBlock(), &mnpair.second));
-    }
-
-    nCountRet = (int)vecMasternodeLastPaid.size();
-
-    //when the network is in the process of upgrading, don't penalize nodes that recently restarted
-    if(fFilterSigTime && nCountRet < nMnCount/3)
-        return GetNextMasternodeInQueueForPayment(nBlockHeight, false, nCountRet, mnInfoRet);
+        if(GetUTXOConfirmations(mn.outpoint) < nMnCount) continue;
 
-    // Sort them low to high
-    sort(vecMasternodeLastPaid.begin(), vecMasternodeLastPaid.end(), CompareLastPaidBlock());
+        nCountRet++;
 
-    uint256 blockHash;
-    if(!GetBlockHash(blockHash, nBlockHeight - 101)) {
-        LogPrintf("CMasternode::GetNextMasternodeInQueueForPayment -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight - 101);
-        return false;
-    }
-    // Look at 1/10 of the oldest nodes (by last payment), calculate their scores and pay the best one
-    //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
-    //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
-    //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = nMnCount/10;
-    int nCountTenth = 0;
-    arith_uint256 nHighest = 0;
-    const CMasternode *pBestMasternode = nullptr;
-    for (const auto& s : vecMasternodeLastPaid) {
-        arith_uint256 nScore = s.second->CalculateScore(blockHash);
+        if (!fHaveBlockHash || (nCountTenth > 0 && nCountTenth >= nTenthNetwork)) continue;
+        int nIndex = pscores ? pscores->GetIndex(mn.outpoint) : -1;
+        arith_uint256 nScore = nIndex >= 0 ? pscores->vecScores[nIndex].first : mn.CalculateScore(blockHash);
         if(nScore > nHighest){
             nHighest = nScore;
-            pBestMasternode = s.second;
+            pBestMasternode = &mn;
         }
         nCountTenth++;
-        if(nCountTenth >= nTenthNetwork) break;
     }
+
+    //when the network is in the process of upgrading, don't penalize nodes that recently restarted
+    if(fFilterSigTime && nCountRet < nMnCount/3)
+        return GetNextMasternodeInQueueForPayment(nBlockHeight, false, nCountRet, mnInfoRet, fCountAll);
+
     if (pBestMasternode) {
         mnInfoRet = pBestMasternode->GetInfo();
     }
@@ -618,6 +794,34 @@ bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeM
     return !vecMasternodeScoresRet.empty();
 }
 
+const CMasternodeMan::CMasternodeScoreCacheEntry* CMasternodeMan::GetCachedMasternodeScores(const uint256& nBlockHash, int nMinProtocol)
+{
+    AssertLockHeld(cs);
+
+    for (auto it = listScoreCache.begin(); it != listScoreCache.end(); ++it) {
+        if (it->nBlockHash == nBlockHash && it->nMinProtocol == nMinProtocol) {
+            listScoreCache.splice(listScoreCache.begin(), listScoreCache, it);
+            return &listScoreCache.front();
+        }
+    }
+
+    CMasternodeScoreCacheEntry entry;
+    if (!GetMasternodeScores(nBlockHash, entry.vecScores, nMinProtocol))
+        return nullptr;
+    entry.nBlockHash = nBlockHash;
+    entry.nMinProtocol = nMinProtocol;
+    entry.vecIndexByOutpoint.reserve(entry.vecScores.size());
+    for (size_t i = 0; i < entry.vecScores.size(); i++) {
+        entry.vecIndexByOutpoint.emplace_back(entry.vecScores[i].second->outpoint, i);
+    }
+    sort(entry.vecIndexByOutpoint.begin(), entry.vecIndexByOutpoint.end());
+
+    listScoreCache.push_front(std::move(entry));
+    if (listScoreCache.size() > MAX_SCORE_CACHE_ENTRIES)
+        listScoreCache.pop_back();
+    return &listScoreCache.front();
+}
+
 bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet, int nBlockHeight, int nMinProtocol)
 {
     nRankRet = -1;
@@ -634,20 +838,16 @@ bool CMasternodeMan::GetMasternodeRank(const COutPoint& outpoint, int& nRankRet,
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    const CMasternodeScoreCacheEntry* pscores = GetCachedMasternodeScores(nBlockHash, nMinProtocol);
+    if (!pscores)
         return false;
 
-    int nRank = 0;
-    for (const auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if(scorePair.second->outpoint == outpoint) {
-            nRankRet = nRank;
-            return true;
-        }
-    }
+    int nIndex = pscores->GetIndex(outpoint);
+    if (nIndex < 0)
+        return false;
 
-    return false;
+    nRankRet = nIndex + 1;
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight, int nMinProtocol)
@@ -666,12 +866,12 @@ bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMast
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    const CMasternodeScoreCacheEntry* pscores = GetCachedMasternodeScores(nBlockHash, nMinProtocol);
+    if (!pscores)
         return false;
 
     int nRank = 0;
-    for (const auto& scorePair : vecMasternodeScores) {
+    for (const auto& scorePair : pscores->vecScores) {
         nRank++;
         vecMasternodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
     }
@@ -766,71 +966,77 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
 {
     if(fLiteMode) return; // disable all Dash specific functionality
 
-    if (strCommand == NetMsgType::MNANNOUNCE) { //Masternode Broadcast
+    if (strCommand == NetMsgType::MNANNOUNCE || strCommand == NetMsgType::MNPING) {
 
-        CMasternodeBroadcast mnb;
-        vRecv >> mnb;
-
-        pfrom->setAskFor.erase(mnb.GetHash());
+        CPendingMasternodeMessage msg;
+        msg.fPing = strCommand == NetMsgType::MNPING;
+        if (msg.fPing) {
+            vRecv >> msg.mnp;
+            pfrom->setAskFor.erase(msg.mnp.GetHash());
+        } else {
+            vRecv >> msg.mnb;
+            pfrom->setAskFor.erase(msg.mnb.GetHash());
+        }
 
         if(!masternodeSync.IsBlockchainSynced()) return;
 
-        LogPrint(BCLog::MASTERNODE, "MNANNOUNCE -- Masternode announce, masternode=%s\n", mnb.outpoint.ToStringShort());
-
-        int nDos = 0;
-
-        if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
-            // use announced Masternode as a peer
-            connman.AddNewAddress(CAddress(mnb.addr, NODE_NETWORK), pfrom->addr, 2*60*60);
-        } else if(nDos > 0) {
-            LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), nDos);
+        // List sync sends these in bursts, so queue them up while the peer has
+        // more messages waiting and verify the whole batch at once
+        bool fMoreWork;
+        {
+            LOCK(pfrom->cs_vProcessMsg);
+            fMoreWork = !pfrom->vProcessMsg.empty();
         }
-
-        if(fMasternodesAdded) {
-            NotifyMasternodeUpdates(connman);
+        if (QueuePendingMessage(pfrom, msg) >= MAX_PENDING_MN_MESSAGES || !fMoreWork) {
+            ProcessPendingMessages(connman);
         }
-    } else if (strCommand == NetMsgType::MNPING) { //Masternode Ping
 
-        CMasternodePing mnp;
-        vRecv >> mnp;
+    } else if (strCommand == NetMsgType::MNLISTDIFF) {
 
-        uint256 nHash = mnp.GetHash();
+        CMasternodeListDiff diff;
+        vRecv >> diff;
 
-        pfrom->setAskFor.erase(nHash);
+        if (diff.size() > MAX_MNLISTDIFF_ENTRIES) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
 
         if(!masternodeSync.IsBlockchainSynced()) return;
 
-        LogPrint(BCLog::MASTERNODE, "MNPING -- Masternode ping, masternode=%s\n", mnp.masternodeOutpoint.ToStringShort());
-
-        // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
-        LOCK2(cs_main, cs);
-
-        if(mapSeenMasternodePing.count(nHash)) return; //seen
-        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
-
-        LogPrint(BCLog::MASTERNODE, "MNPING -- Masternode ping, masternode=%s new\n", mnp.masternodeOutpoint.ToStringShort());
+        LogPrint(BCLog::MASTERNODE, "MNLISTDIFF -- %d announces, %d pings, peer=%d\n", diff.vecMnb.size(), diff.vecMnp.size(), pfrom->GetId());
 
-        // see if we have this Masternode
-        CMasternode* pmn = Find(mnp.masternodeOutpoint);
+        // a diff already is a batch, check it together with anything still queued
+        for (auto& mnb : diff.vecMnb) {
+            CPendingMasternodeMessage msg;
+            msg.fPing = false;
+            msg.mnb = std::move(mnb);
+            QueuePendingMessage(pfrom, msg);
+        }
+        for (auto& mnp : diff.vecMnp) {
+            CPendingMasternodeMessage msg;
+            msg.fPing = true;
+            msg.mnp = std::move(mnp);
+            QueuePendingMessage(pfrom, msg);
+        }
+        ProcessPendingMessages(connman);
 
-        // too late, new MNANNOUNCE is required
-        if(pmn && pmn->IsNewStartRequired()) return;
+    } else if (strCommand == NetMsgType::MNLISTDIGEST) { //Get the changes to our Masternode list
+        // Same rules as a DSEG for the whole list
+        if (!masternodeSync.IsSynced()) return;
 
-        int nDos = 0;
-        if(mnp.CheckAndUpdate(pmn, false, nDos, connman)) return;
+        CMasternodeListDigest digest;
+        vRecv >> digest;
 
-        if(nDos > 0) {
-            // if anything significant failed, mark that node
-            Misbehaving(pfrom->GetId(), nDos);
-        } else if(pmn != nullptr) {
-            // nothing significant failed, mn is a known one too
+        if (digest.vecShortIds.size() > MAX_MNLISTDIGEST_ENTRIES) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
             return;
         }
 
-        // something significant is broken or mn is unknown,
-        // we might have to ask for a masternode entry once
-        AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+        LogPrint(BCLog::MASTERNODE, "MNLISTDIGEST -- Masternode list digest with %d entries, peer=%d\n", digest.vecShortIds.size(), pfrom->GetId());
+
+        SyncDiff(pfrom, digest, connman);
 
     } else if (strCommand == NetMsgType::DSEG) { //Get Masternode list or specific entry
         // Ignore such requests until we are fully synced.
@@ -881,6 +1087,130 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, const std::string& strCommand,
     }
 }
 
+void CMasternodeMan::ProcessMasternodeBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb, CConnman& connman)
+{
+    LogPrint(BCLog::MASTERNODE, "MNANNOUNCE -- Masternode announce, masternode=%s\n", mnb.outpoint.ToStringShort());
+
+    int nDos = 0;
+
+    if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
+        // use announced Masternode as a peer
+        connman.AddNewAddress(CAddress(mnb.addr, NODE_NETWORK), pfrom->addr, 2*60*60);
+        // lock votes of this masternode may have arrived before its announce
+        instantsend.ProcessVotesWaitingForMasternode(mnb.outpoint, connman);
+    } else if(nDos > 0) {
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), nDos);
+    }
+
+    if(fMasternodesAdded) {
+        NotifyMasternodeUpdates(connman);
+    }
+}
+
+void CMasternodeMan::ProcessMasternodePing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman)
+{
+    uint256 nHash = mnp.GetHash();
+
+    LogPrint(BCLog::MASTERNODE, "MNPING -- Masternode ping, masternode=%s\n", mnp.masternodeOutpoint.ToStringShort());
+
+    // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
+    LOCK2(cs_main, cs);
+
+    if(mapSeenMasternodePing.count(nHash)) return; //seen
+    mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
+
+    LogPrint(BCLog::MASTERNODE, "MNPING -- Masternode ping, masternode=%s new\n", mnp.masternodeOutpoint.ToStringShort());
+
+    // see if we have this Masternode
+    CMasternode* pmn = Find(mnp.masternodeOutpoint);
+
+    // too late, new MNANNOUNCE is required
+    if(pmn && pmn->IsNewStartRequired()) return;
+
+    int nDos = 0;
+    if(mnp.CheckAndUpdate(pmn, false, nDos, connman)) {
+        // the ping is pmn's lastPing now
+        fSnapshotDirty = true;
+        MarkChanged(mnp.masternodeOutpoint, CT_UPDATED);
+        return;
+    }
+
+    if(nDos > 0) {
+        // if anything significant failed, mark that node
+        Misbehaving(pfrom->GetId(), nDos);
+    } else if(pmn != nullptr) {
+        // nothing significant failed, mn is a known one too
+        return;
+    }
+
+    // something significant is broken or mn is unknown,
+    // we might have to ask for a masternode entry once
+    AskForMN(pfrom, mnp.masternodeOutpoint, connman);
+}
+
+size_t CMasternodeMan::QueuePendingMessage(CNode* pfrom, CPendingMasternodeMessage& msg)
+{
+    LOCK(cs_vecPendingMessages);
+    pfrom->AddRef();
+    msg.pfrom = pfrom;
+    vecPendingMessages.push_back(std::move(msg));
+    return vecPendingMessages.size();
+}
+
+void CMasternodeMan::ProcessPendingMessages(CConnman& connman)
+{
+    std::vector<CPendingMasternodeMessage> vecMessages;
+    {
+        LOCK(cs_vecPendingMessages);
+        vecMessages.swap(vecPendingMessages);
+    }
+    if (vecMessages.empty()) return;
+
+    // Verify all signatures first, good ones are cached and not checked again below.
+    // Pings are checked against the key of a masternode announced earlier in the
+    // batch or else the one in our list; unknown ones are left to CheckAndUpdate.
+    if (nScriptCheckThreads && vecMessages.size() > 1) {
+        std::vector<CMasternodeSigCheck> vChecks;
+        vChecks.reserve(vecMessages.size() * 2);
+        {
+            std::map<COutPoint, CPubKey> mapBatchKeys;
+            LOCK(cs);
+            for (const auto& msg : vecMessages) {
+                if (!msg.fPing) {
+                    vChecks.emplace_back(msg.mnb);
+                    if (msg.mnb.lastPing) {
+                        vChecks.emplace_back(msg.mnb.lastPing, msg.mnb.pubKeyMasternode);
+                    }
+                    mapBatchKeys[msg.mnb.outpoint] = msg.mnb.pubKeyMasternode;
+                    continue;
+                }
+                const auto it = mapBatchKeys.find(msg.mnp.masternodeOutpoint);
+                if (it != mapBatchKeys.end()) {
+                    vChecks.emplace_back(msg.mnp, it->second);
+                } else if (const CMasternode* pmn = Find(msg.mnp.masternodeOutpoint)) {
+                    vChecks.emplace_back(msg.mnp, pmn->pubKeyMasternode);
+                }
+            }
+        }
+        LogPrint(BCLog::MASTERNODE, "CMasternodeMan::%s -- checking %d signatures for %d messages\n", __func__, vChecks.size(), vecMessages.size());
+        CCheckQueueControl<CMasternodeSigCheck> control(&mnsigcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    for (auto& msg : vecMessages) {
+        if (!msg.pfrom->fDisconnect) {
+            if (msg.fPing) {
+                ProcessMasternodePing(msg.pfrom, msg.mnp, connman);
+            } else {
+                ProcessMasternodeBroadcast(msg.pfrom, msg.mnb, connman);
+            }
+        }
+        msg.pfrom->Release();
+    }
+}
+
 void CMasternodeMan::SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman& connman)
 {
     // do not provide any data until our node is synced
@@ -899,11 +1229,8 @@ void CMasternodeMan::SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnma
     }
 }
 
-void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
+bool CMasternodeMan::AllowListRequest(CNode* pnode)
 {
-    // do not provide any data until our node is synced
-    if (!masternodeSync.IsSynced()) return;
-
     // local network
     bool isLocal = (pnode->addr.IsRFC1918() || pnode->addr.IsLocal());
 
@@ -915,12 +1242,22 @@ void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
         if (it != mAskedUsForMasternodeList.end() && it->second > GetTime()) {
             Misbehaving(pnode->GetId(), 34);
             LogPrintf("CMasternodeMan::%s -- peer already asked me for the list, peer=%d\n", __func__, pnode->GetId());
-            return;
+            return false;
         }
         int64_t askAgain = GetTime() + DSEG_UPDATE_SECONDS;
         mAskedUsForMasternodeList[addrSquashed] = askAgain;
     }
 
+    return true;
+}
+
+void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
+{
+    // do not provide any data until our node is synced
+    if (!masternodeSync.IsSynced()) return;
+
+    if (!AllowListRequest(pnode)) return;
+
     int nInvCount = 0;
 
     LOCK(cs);
@@ -937,6 +1274,72 @@ void CMasternodeMan::SyncAll(CNode* pnode, CConnman& connman)
     LogPrintf("CMasternodeMan::%s -- Sent %d Masternode invs to peer=%d\n", __func__, nInvCount, pnode->GetId());
 }
 
+void CMasternodeMan::SyncDiff(CNode* pnode, const CMasternodeListDigest& digest, CConnman& connman)
+{
+    if (!AllowListRequest(pnode)) return;
+
+    std::set<uint64_t> setMnbIds, setMnpIds;
+    for (const auto& ids : digest.vecShortIds) {
+        setMnbIds.insert(ids.first);
+        setMnpIds.insert(ids.second);
+    }
+
+    CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    CMasternodeListDiff diff;
+    int nCount = 0;
+
+    LOCK(cs);
+
+    for (const auto& mnpair : mapMasternodes) {
+        if (mnpair.second.addr.IsRFC1918() || mnpair.second.addr.IsLocal()) continue; // do not send local network masternode
+        CMasternodeBroadcast mnb(mnpair.second);
+        uint256 hashMNB = mnb.GetHash();
+        uint256 hashMNP = mnb.lastPing.GetHash();
+        // NOTE: send masternode regardless of its current state, the other node will need it to verify old votes.
+        if (!setMnbIds.count(digest.GetShortId(hashMNB))) {
+            diff.vecMnb.push_back(mnb);
+        } else if (mnb.lastPing && !setMnpIds.count(digest.GetShortId(hashMNP))) {
+            diff.vecMnp.push_back(mnb.lastPing);
+        } else {
+            continue;
+        }
+        mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
+        mapSeenMasternodePing.insert(std::make_pair(hashMNP, mnb.lastPing));
+        nCount++;
+
+        if (diff.size() == MAX_MNLISTDIFF_ENTRIES) {
+            connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTDIFF, diff));
+            diff = CMasternodeListDiff();
+        }
+    }
+    if (diff.size()) {
+        connman.PushMessage(pnode, msgMaker.Make(NetMsgType::MNLISTDIFF, diff));
+    }
+
+    connman.PushMessage(pnode, msgMaker.Make(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nCount));
+    LogPrintf("CMasternodeMan::%s -- Sent %d of %d Masternode entries to peer=%d\n", __func__, nCount, mapMasternodes.size(), pnode->GetId());
+}
+
+CMasternodeListDigest CMasternodeMan::GetListDigest()
+{
+    LOCK(cs);
+
+    CMasternodeListDigest digest;
+    // salted per request, so nobody can make their entries collide with others
+    digest.nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    digest.vecShortIds.reserve(mapMasternodes.size());
+    for (const auto& mnpair : mapMasternodes) {
+        digest.vecShortIds.emplace_back(digest.GetShortId(CMasternodeBroadcast(mnpair.second).GetHash()),
+                                        digest.GetShortId(mnpair.second.lastPing.GetHash()));
+    }
+    return digest;
+}
+
+uint64_t CMasternodeListDigest::GetShortId(const uint256& hash) const
+{
+    return SipHashUint256(nSalt, 0, hash);
+}
+
 void CMasternodeMan::PushDsegInvs(CNode* pnode, const CMasternode& mn)
 {
     AssertLockHeld(cs);
@@ -958,70 +1361,54 @@ void CMasternodeMan::DoFullVerificationStep(CConnman& connman)
     if(activeMasternode.outpoint.IsNull()) return;
     if(!masternodeSync.IsSynced()) return;
 
-    rank_pair_vec_t vecMasternodeRanks;
-    GetMasternodeRanks(vecMasternodeRanks, nCachedBlockHeight - 1, MIN_POSE_PROTO_VERSION);
+    uint256 nBlockHash;
+    if (!GetBlockHash(nBlockHash, nCachedBlockHeight - 1)) {
+        LogPrintf("CMasternodeMan::%s -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", __func__, nCachedBlockHeight - 1);
+        return;
+    }
 
     LOCK(cs);
 
+    // Walk the cached scores rather than copy every masternode into a list of ranks
+    const CMasternodeScoreCacheEntry* pscores = GetCachedMasternodeScores(nBlockHash, MIN_POSE_PROTO_VERSION);
+    if (!pscores) return;
+    const score_pair_vec_t& vecScores = pscores->vecScores;
+
     int nCount = 0;
+    int nRanksTotal = (int)vecScores.size();
 
-    int nMyRank = -1;
-    int nRanksTotal = (int)vecMasternodeRanks.size();
+    // edge case: list is too short and this masternode is not enabled
+    int nIndex = pscores->GetIndex(activeMasternode.outpoint);
+    if(nIndex < 0) return;
+    int nMyRank = nIndex + 1;
 
     // send verify requests only if we are in top MAX_POSE_RANK
-    rank_pair_vec_t::iterator it = vecMasternodeRanks.begin();
-    while(it != vecMasternodeRanks.end()) {
-        if(it->first > MAX_POSE_RANK) {
-            LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Must be in top %d to send verify request\n",
-                        (int)MAX_POSE_RANK);
-            return;
-        }
-        if(it->second.outpoint == activeMasternode.outpoint) {
-            nMyRank = it->first;
-            LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Found self at rank %d/%d, verifying up to %d masternodes\n",
-                        nMyRank, nRanksTotal, (int)MAX_POSE_CONNECTIONS);
-            break;
-        }
-        ++it;
+    if(nMyRank > MAX_POSE_RANK) {
+        LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Must be in top %d to send verify request\n",
+                    (int)MAX_POSE_RANK);
+        return;
     }
-
-    // edge case: list is too short and this masternode is not enabled
-    if(nMyRank == -1) return;
+    LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Found self at rank %d/%d, verifying up to %d masternodes\n",
+                nMyRank, nRanksTotal, (int)MAX_POSE_CONNECTIONS);
 
     // send verify requests to up to MAX_POSE_CONNECTIONS masternodes
     // starting from MAX_POSE_RANK + nMyRank and using MAX_POSE_CONNECTIONS as a step
-    int nOffset = MAX_POSE_RANK + nMyRank - 1;
-    if(nOffset >= (int)vecMasternodeRanks.size()) return;
-
-    std::vector<const CMasternode*> vSortedByAddr;
-    for (const auto& mnpair : mapMasternodes) {
-        vSortedByAddr.push_back(&mnpair.second);
-    }
-
-    sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
-    it = vecMasternodeRanks.begin() + nOffset;
-    while(it != vecMasternodeRanks.end()) {
-        if(it->second.IsPoSeVerified() || it->second.IsPoSeBanned()) {
+    for (int nOffset = MAX_POSE_RANK + nMyRank - 1; nOffset < nRanksTotal; nOffset += MAX_POSE_CONNECTIONS) {
+        const CMasternode& mn = *vecScores[nOffset].second;
+        if(mn.IsPoSeVerified() || mn.IsPoSeBanned()) {
             LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Already %s%s%s masternode %s address %s, skipping...\n",
-                        it->second.IsPoSeVerified() ? "verified" : "",
-                        it->second.IsPoSeVerified() && it->second.IsPoSeBanned() ? " and " : "",
-                        it->second.IsPoSeBanned() ? "banned" : "",
-                        it->second.outpoint.ToStringShort(), it->second.addr.ToString());
-            nOffset += MAX_POSE_CONNECTIONS;
-            if(nOffset >= (int)vecMasternodeRanks.size()) break;
-            it += MAX_POSE_CONNECTIONS;
+                        mn.IsPoSeVerified() ? "verified" : "",
+                        mn.IsPoSeVerified() && mn.IsPoSeBanned() ? " and " : "",
+                        mn.IsPoSeBanned() ? "banned" : "",
+                        mn.outpoint.ToStringShort(), mn.addr.ToString());
             continue;
         }
         LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Verifying masternode %s rank %d/%d address %s\n",
-                    it->second.outpoint.ToStringShort(), it->first, nRanksTotal, it->second.addr.ToString());
-        if(SendVerifyRequest(CAddress(it->second.addr, NODE_NETWORK), vSortedByAddr, connman)) {
+                    mn.outpoint.ToStringShort(), nOffset + 1, nRanksTotal, mn.addr.ToString());
+        if(SendVerifyRequest(CAddress(mn.addr, NODE_NETWORK), connman)) {
             nCount++;
             if(nCount >= MAX_POSE_CONNECTIONS) break;
         }
-        nOffset += MAX_POSE_CONNECTIONS;
-        if(nOffset >= (int)vecMasternodeRanks.size()) break;
-        it += MAX_POSE_CONNECTIONS;
     }
 
     LogPrint(BCLog::MASTERNODE, "CMasternodeMan::DoFullVerificationStep -- Sent verification requests to %d masternodes\n", nCount);
@@ -1037,65 +1424,39 @@ void CMasternodeMan::CheckSameAddr(bool fApplyNewRules)
     if(!masternodeSync.IsSynced() || mapMasternodes.empty()) return;
 
     std::vector<CMasternode*> vBan;
-    std::vector<CMasternode*> vSortedByAddr;
 
     {
         LOCK(cs);
 
-        CMasternode* pprevMasternode = nullptr;
-        CMasternode* pverifiedMasternode = nullptr;
+        // Only the addresses shared by several masternodes are looked at, in the order of their outpoints
+        for (const CService& addr : setDuplicateAddrs) {
+            CMasternode* pprevMasternode = nullptr;
+            CMasternode* pverifiedMasternode = nullptr;
 
-        for (auto& mnpair : mapMasternodes) {
-            vSortedByAddr.push_back(&mnpair.second);
-        }
-
-        sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
-        if(fApplyNewRules)
-        {
-            for (const auto& pmn : vSortedByAddr) {
+            for (const COutPoint& outpoint : mapOutpointsByAddr.at(addr)) {
+                CMasternode* pmn = &mapMasternodes.at(outpoint);
                 // check only (pre)enabled masternodes
                 if(!pmn->IsEnabled() && !pmn->IsPreEnabled()) continue;
                 // initial step
                 if(!pprevMasternode) {
                     pprevMasternode = pmn;
+                    pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : nullptr;
                     continue;
                 }
-                // ban all nodes with the same IP that are (pre)enabled
-                if(pmn->addr == pprevMasternode->addr) 
-                {
+                if(fApplyNewRules) {
+                    // ban all nodes with the same IP that are (pre)enabled
                     vBan.push_back(pmn);
-                }
-                else
-                {
-                    pprevMasternode = pmn;
-                }
-            }
-        }
-        else
-        {
-            for (const auto& pmn : vSortedByAddr) {
-                // check only (pre)enabled masternodes
-                if(!pmn->IsEnabled() && !pmn->IsPreEnabled()) continue;
-                // initial step
-                if(!pprevMasternode) {
-                    pprevMasternode = pmn;
-                    pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : nullptr;
                     continue;
                 }
                 // second+ step
-                if(pmn->addr == pprevMasternode->addr) {
-                    if(pverifiedMasternode) {
-                        // another masternode with the same ip is verified, ban this one
-                        vBan.push_back(pmn);
-                    } else if(pmn->IsPoSeVerified()) {
-                        // this masternode with the same ip is verified, ban previous one
-                        vBan.push_back(pprevMasternode);
-                        // and keep a reference to be able to ban following masternodes with the same ip
-                        pverifiedMasternode = pmn;
-                    }
-                } else {
-                    pverifiedMasternode = pmn->IsPoSeVerified() ? pmn : nullptr;
+                if(pverifiedMasternode) {
+                    // another masternode with the same ip is verified, ban this one
+                    vBan.push_back(pmn);
+                } else if(pmn->IsPoSeVerified()) {
+                    // this masternode with the same ip is verified, ban previous one
+                    vBan.push_back(pprevMasternode);
+                    // and keep a reference to be able to ban following masternodes with the same ip
+                    pverifiedMasternode = pmn;
                 }
                 pprevMasternode = pmn;
             }
@@ -1109,7 +1470,7 @@ void CMasternodeMan::CheckSameAddr(bool fApplyNewRules)
     }
 }
 
-bool CMasternodeMan::SendVerifyRequest(const CAddress& addr, const std::vector<const CMasternode*>& vSortedByAddr, CConnman& connman)
+bool CMasternodeMan::SendVerifyRequest(const CAddress& addr, CConnman& connman)
 {
     if(netfulfilledman.HasFulfilledRequest(addr, strprintf("%s", NetMsgType::MNVERIFY)+"-request")) {
         // we already asked for verification, not a good idea to do this too often, skip it
@@ -1484,6 +1845,71 @@ std::string CMasternodeMan::ToString() const
     return info.str();
 }
 
+template<typename X>
+static size_t ListMemoryUsage(const std::list<X>& l)
+{
+    // list nodes hold the element and two pointers
+    return memusage::MallocUsage(sizeof(X) + 2 * sizeof(void*)) * l.size();
+}
+
+template<typename X>
+static size_t IndexMemoryUsage(const X& index)
+{
+    size_t nUsage = memusage::DynamicUsage(index);
+    for (const auto& entry : index) {
+        nUsage += memusage::DynamicUsage(entry.second);
+    }
+    return nUsage;
+}
+
+std::map<std::string, size_t> CMasternodeMan::GetMemoryUsage()
+{
+    // Containers and the containers nested in them, not the scripts and signatures of the entries
+    std::map<std::string, size_t> mapUsage;
+    {
+        LOCK(cs);
+        mapUsage["mapMasternodes"] = memusage::DynamicUsage(mapMasternodes);
+        mapUsage["mAskedUsForMasternodeList"] = memusage::DynamicUsage(mAskedUsForMasternodeList);
+        mapUsage["mWeAskedForMasternodeList"] = memusage::DynamicUsage(mWeAskedForMasternodeList);
+        mapUsage["mWeAskedForMasternodeListEntry"] = IndexMemoryUsage(mWeAskedForMasternodeListEntry);
+        mapUsage["mWeAskedForVerification"] = memusage::DynamicUsage(mWeAskedForVerification);
+        size_t nRecoveryRequests = memusage::DynamicUsage(mMnbRecoveryRequests);
+        for (const auto& entry : mMnbRecoveryRequests) {
+            nRecoveryRequests += memusage::DynamicUsage(entry.second.second);
+        }
+        mapUsage["mMnbRecoveryRequests"] = nRecoveryRequests;
+        mapUsage["mMnbRecoveryGoodReplies"] = IndexMemoryUsage(mMnbRecoveryGoodReplies);
+        mapUsage["listScheduledMnbRequestConnections"] = ListMemoryUsage(listScheduledMnbRequestConnections);
+        size_t nPendingMNB = memusage::DynamicUsage(mapPendingMNB);
+        for (const auto& entry : mapPendingMNB) {
+            nPendingMNB += memusage::DynamicUsage(entry.second.second);
+        }
+        mapUsage["mapPendingMNB"] = nPendingMNB;
+        size_t nScoreCache = ListMemoryUsage(listScoreCache);
+        for (const auto& entry : listScoreCache) {
+            nScoreCache += memusage::DynamicUsage(entry.vecScores) + memusage::DynamicUsage(entry.vecIndexByOutpoint);
+        }
+        mapUsage["listScoreCache"] = nScoreCache;
+        mapUsage["mapOutpointsByPubKey"] = IndexMemoryUsage(mapOutpointsByPubKey);
+        mapUsage["mapOutpointsByCollateral"] = IndexMemoryUsage(mapOutpointsByCollateral);
+        mapUsage["setOutpointsByLastPaid"] = memusage::DynamicUsage(setOutpointsByLastPaid);
+        mapUsage["mapOutpointsByAddr"] = IndexMemoryUsage(mapOutpointsByAddr);
+        mapUsage["setDuplicateAddrs"] = memusage::DynamicUsage(setDuplicateAddrs);
+        mapUsage["mapSeenMasternodeBroadcast"] = memusage::DynamicUsage(mapSeenMasternodeBroadcast);
+        mapUsage["mapSeenMasternodePing"] = memusage::DynamicUsage(mapSeenMasternodePing);
+        mapUsage["mapSeenMasternodeVerification"] = memusage::DynamicUsage(mapSeenMasternodeVerification);
+    }
+    {
+        LOCK(cs_mapPendingMNV);
+        mapUsage["mapPendingMNV"] = memusage::DynamicUsage(mapPendingMNV);
+    }
+    {
+        LOCK(cs_vecPendingMessages);
+        mapUsage["vecPendingMessages"] = memusage::DynamicUsage(vecPendingMessages);
+    }
+    return mapUsage;
+}
+
 bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman& connman)
 {
     // Need to lock cs_main here to ensure consistent locking order because the SimpleCheck call below locks cs_main
@@ -1539,7 +1965,14 @@ bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBr
         CMasternode* pmn = Find(mnb.outpoint);
         if(pmn) {
             CMasternodeBroadcast mnbOld = mapSeenMasternodeBroadcast[CMasternodeBroadcast(*pmn).GetHash()].second;
-            if(!mnb.Update(pmn, nDos, connman)) {
+            // Update() may change the protocol version scores are filtered by and pubKeyMasternode
+            InvalidateScoreCache();
+            UnindexMasternode(*pmn);
+            bool fUpdated = mnb.Update(pmn, nDos, connman);
+            IndexMasternode(*pmn);
+            fSnapshotDirty = true;
+            MarkChanged(pmn->outpoint, CT_UPDATED);
+            if(!fUpdated) {
                 LogPrint(BCLog::MASTERNODE, "CMasternodeMan::CheckMnbAndUpdateMasternodeList -- Update() failed, masternode=%s\n", mnb.outpoint.ToStringShort());
                 return false;
             }
@@ -1593,7 +2026,12 @@ void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex)
                             nCachedBlockHeight, nLastRunBlockHeight, nMaxBlocksToScanBack);
 
     for (auto& mnpair : mapMasternodes) {
+        int nBlockLastPaidOld = mnpair.second.GetLastPaidBlock();
         mnpair.second.UpdateLastPaid(pindex, nMaxBlocksToScanBack);
+        if (mnpair.second.GetLastPaidBlock() != nBlockLastPaidOld) {
+            setOutpointsByLastPaid.erase(std::make_pair(nBlockLastPaidOld, mnpair.first));
+            setOutpointsByLastPaid.emplace(mnpair.second.GetLastPaidBlock(), mnpair.first);
+        }
     }
 
     nLastRunBlockHeight = nCachedBlockHeight;
@@ -1602,10 +2040,13 @@ void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex)
 void CMasternodeMan::CheckMasternode(const CPubKey& pubKeyMasternode, bool fForce)
 {
     LOCK2(cs_main, cs);
-    for (auto& mnpair : mapMasternodes) {
-        if (mnpair.second.pubKeyMasternode == pubKeyMasternode) {
-            mnpair.second.Check(fForce);
-            return;
+    CMasternode* pmn = FindIndexed(mapOutpointsByPubKey, pubKeyMasternode.GetID());
+    if (pmn && pmn->pubKeyMasternode == pubKeyMasternode) {
+        const int nActiveStatePrev = pmn->nActiveState;
+        pmn->Check(fForce);
+        if (pmn->nActiveState != nActiveStatePrev) {
+            fSnapshotDirty = true;
+            MarkChanged(pmn->outpoint, CT_UPDATED);
         }
     }
 }
@@ -1625,6 +2066,8 @@ void CMasternodeMan::SetMasternodeLastPing(const COutPoint& outpoint, const CMas
         return;
     }
     pmn->lastPing = mnp;
+    fSnapshotDirty = true;
+    MarkChanged(outpoint, CT_UPDATED);
     mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
 
     CMasternodeBroadcast mnb(*pmn);
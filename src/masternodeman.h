@@ -7,12 +7,75 @@
 
 #include <masternode.h>
 #include <sync.h>
+#include <ui_interface.h>
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <set>
+#include <unordered_map>
 
 class CMasternodeMan;
 class CConnman;
 
+/** Cheap hasher for keys of masternodes, every one of which costs a collateral to create */
+struct CMasternodeKeyIDHasher
+{
+    size_t operator()(const CKeyID& keyID) const { return ReadLE64(keyID.begin()); }
+};
+
 extern CMasternodeMan mnodeman;
 
+/**
+ * Summary of our masternode list sent with "mnldigest": salted short ids of
+ * the announce and the last ping of every entry. The peer answers with only
+ * the announces and pings these don't match, so a node restarting with a
+ * recent mncache.dat downloads the changes instead of the whole list.
+ */
+class CMasternodeListDigest
+{
+public:
+    uint64_t nSalt;
+    /// Short ids of the announce and last ping hash of each masternode
+    std::vector<std::pair<uint64_t, uint64_t> > vecShortIds;
+
+    CMasternodeListDigest() : nSalt(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nSalt);
+        READWRITE(vecShortIds);
+    }
+
+    uint64_t GetShortId(const uint256& hash) const;
+};
+
+/** One batch of a "mnldiff" answer */
+class CMasternodeListDiff
+{
+public:
+    /// Masternodes the digest had no announce for, each with its last ping
+    std::vector<CMasternodeBroadcast> vecMnb;
+    /// Newer pings of masternodes the digest had the announce of
+    std::vector<CMasternodePing> vecMnp;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(vecMnb);
+        READWRITE(vecMnp);
+    }
+
+    size_t size() const { return vecMnb.size() + vecMnp.size(); }
+};
+
+/** Run a masternode signature check worker thread */
+void ThreadMasternodeSigCheck();
+
 class CMasternodeMan
 {
 public:
@@ -20,6 +83,7 @@ public:
     typedef std::vector<score_pair_t> score_pair_vec_t;
     typedef std::pair<int, const CMasternode> rank_pair_t;
     typedef std::vector<rank_pair_t> rank_pair_vec_t;
+    typedef std::shared_ptr<const std::map<COutPoint, CMasternode> > masternode_snapshot_t;
 
 private:
     static const std::string SERIALIZATION_VERSION_STRING;
@@ -39,9 +103,15 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const size_t MAX_SCORE_CACHE_ENTRIES     = 16;
+    static const size_t MAX_PENDING_MN_MESSAGES     = 1000;
+    static const size_t MAX_MNLISTDIFF_ENTRIES      = 500;
+    static const size_t MAX_MNLISTDIGEST_ENTRIES    = 100000;
+    static const size_t MAX_COLLATERAL_LOOKUP_BATCH = 250;
+
 
     // critical section to protect the inner data structures
-    mutable CCriticalSection cs;
+    mutable CInstrumentedCriticalSection cs;
 
     // Keep track of current block height
     int nCachedBlockHeight;
@@ -72,17 +142,90 @@ private:
     /// Set when masternodes are removed, cleared when CGovernanceManager is notified
     bool fMasternodesRemoved;
 
+    /// Masternodes sorted by score for one block hash and minimum protocol version
+    struct CMasternodeScoreCacheEntry
+    {
+        uint256 nBlockHash;
+        int nMinProtocol;
+        score_pair_vec_t vecScores;
+        /// Outpoints with their index in vecScores, sorted by outpoint
+        std::vector<std::pair<COutPoint, size_t> > vecIndexByOutpoint;
+
+        /// Index of the masternode in vecScores, -1 if it has no score
+        int GetIndex(const COutPoint& outpoint) const
+        {
+            auto it = std::lower_bound(vecIndexByOutpoint.begin(), vecIndexByOutpoint.end(), std::make_pair(outpoint, (size_t)0));
+            return (it != vecIndexByOutpoint.end() && it->first == outpoint) ? (int)it->second : -1;
+        }
+    };
+    /// Most recently used first, holds pointers into mapMasternodes so it is cleared whenever that changes
+    std::list<CMasternodeScoreCacheEntry> listScoreCache;
+
+    typedef std::unordered_map<CKeyID, std::set<COutPoint>, CMasternodeKeyIDHasher> outpoint_index_t;
+    /// Outpoints of mapMasternodes by pubKeyMasternode and by collateral key, kept in step by Index/UnindexMasternode
+    outpoint_index_t mapOutpointsByPubKey;
+    outpoint_index_t mapOutpointsByCollateral;
+    /// Outpoints of mapMasternodes ordered by last paid block, then outpoint, the order payments are queued in
+    std::set<std::pair<int, COutPoint> > setOutpointsByLastPaid;
+    /// Outpoints of mapMasternodes by address, the addresses shared by more than one of them in setDuplicateAddrs
+    std::map<CService, std::set<COutPoint> > mapOutpointsByAddr;
+    std::set<CService> setDuplicateAddrs;
+
+    /// Immutable copy of mapMasternodes for readers that must not wait for cs, only accessed with std::atomic_load/store
+    masternode_snapshot_t pSnapshot;
+    /// Set when masternodes are added, removed or updated after pSnapshot was published
+    std::atomic<bool> fSnapshotDirty;
+    /// Entries added, updated or removed since NotifyMasternodeChanges last reported them
+    std::map<COutPoint, ChangeType> mapChangedMasternodes;
+
+    /// Announce or ping waiting for the signature of its batch to be checked
+    struct CPendingMasternodeMessage
+    {
+        /// Referenced with AddRef() until the message is applied
+        CNode* pfrom;
+        bool fPing;
+        CMasternodeBroadcast mnb;
+        CMasternodePing mnp;
+    };
+    /// Announces and pings in arrival order, only touched by the message handler thread
+    std::vector<CPendingMasternodeMessage> vecPendingMessages;
+    CCriticalSection cs_vecPendingMessages;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const COutPoint& outpoint);
 
     bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
+    /// Cached result of GetMasternodeScores, nullptr if there are no scores
+    const CMasternodeScoreCacheEntry* GetCachedMasternodeScores(const uint256& nBlockHash, int nMinProtocol);
+    void InvalidateScoreCache() { listScoreCache.clear(); }
+
+    void IndexMasternode(const CMasternode& mn);
+    void UnindexMasternode(const CMasternode& mn);
+    void RebuildIndexes();
+    /// First masternode (by outpoint) with keyID in index, nullptr if none
+    CMasternode* FindIndexed(const outpoint_index_t& index, const CKeyID& keyID);
+    /// Replace pSnapshot with a copy of the current mapMasternodes
+    void PublishSnapshot();
+    /// Record a change to the entry of outpoint for NotifyMasternodeChanges
+    void MarkChanged(const COutPoint& outpoint, ChangeType status);
 
     void SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman& connman);
     void SyncAll(CNode* pnode, CConnman& connman);
+    void SyncDiff(CNode* pnode, const CMasternodeListDigest& digest, CConnman& connman);
+    /// Whether pnode may ask for the whole list now, it should only do so once per DSEG_UPDATE_SECONDS
+    bool AllowListRequest(CNode* pnode);
+    CMasternodeListDigest GetListDigest();
 
     void PushDsegInvs(CNode* pnode, const CMasternode& mn);
 
+    void ProcessMasternodeBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb, CConnman& connman);
+    void ProcessMasternodePing(CNode* pfrom, CMasternodePing& mnp, CConnman& connman);
+    /// Queue an announce or ping for ProcessPendingMessages, returns the number now pending
+    size_t QueuePendingMessage(CNode* pfrom, CPendingMasternodeMessage& msg);
+    /// Check the signatures of all pending announces and pings in parallel, then apply them in order
+    void ProcessPendingMessages(CConnman& connman);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CMasternodeBroadcast> > mapSeenMasternodeBroadcast;
@@ -118,6 +261,11 @@ public:
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
+        if(ser_action.ForRead()) {
+            InvalidateScoreCache();
+            RebuildIndexes();
+            fSnapshotDirty = true;
+        }
     }
 
     CMasternodeMan();
@@ -163,14 +311,23 @@ public:
     bool GetMasternodeInfo(const CScript& payee, masternode_info_t& mnInfoRet);
 
     /// Find an entry in the masternode list that is next to be paid
-    bool GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet);
+    /// nCountRet is exact only with fCountAll, otherwise the walk stops once the winner is known
+    bool GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet, bool fCountAll = false);
     /// Same as above but use current block height
-    bool GetNextMasternodeInQueueForPayment(bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet);
+    bool GetNextMasternodeInQueueForPayment(bool fFilterSigTime, int& nCountRet, masternode_info_t& mnInfoRet, bool fCountAll = false);
 
     /// Find a random entry
     masternode_info_t FindRandomNotInVec(const std::vector<COutPoint> &vecToExclude, int nProtocolVersion = -1);
 
-    std::map<COutPoint, CMasternode> GetFullMasternodeMap() { return mapMasternodes; }
+    /**
+     * The masternode list as of the last change to its entries or the last
+     * CheckAndRemove, without waiting for cs. Shared and never modified, so
+     * it can be read for as long as it is held. With fWait it waits for cs
+     * rather than return a snapshot older than the list.
+     */
+    masternode_snapshot_t GetMasternodeListSnapshot(bool fWait = false);
+    /// Report the entries changed since the last call to uiInterface and the validation interface
+    void NotifyMasternodeChanges();
 
     bool GetMasternodeRanks(rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight = -1, int nMinProtocol = 0);
     bool GetMasternodeRank(const COutPoint &outpoint, int& nRankRet, int nBlockHeight = -1, int nMinProtocol = 0);
@@ -183,7 +340,7 @@ public:
 
     void DoFullVerificationStep(CConnman& connman);
     void CheckSameAddr(bool fApplyNewRules);
-    bool SendVerifyRequest(const CAddress& addr, const std::vector<const CMasternode*>& vSortedByAddr, CConnman& connman);
+    bool SendVerifyRequest(const CAddress& addr, CConnman& connman);
     void ProcessPendingMnvRequests(CConnman& connman);
     void SendVerifyReply(CNode* pnode, CMasternodeVerification& mnv, CConnman& connman);
     void ProcessVerifyReply(CNode* pnode, CMasternodeVerification& mnv);
@@ -194,6 +351,11 @@ public:
 
     std::string ToString() const;
 
+    /// Estimated heap usage of each of the maps above, by name
+    std::map<std::string, size_t> GetMemoryUsage();
+    /// Contention counters of cs
+    const CLockStats& GetLockStats() const { return cs.stats; }
+
     /// Perform complete check and only then update masternode list and maps using provided CMasternodeBroadcast
     bool CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman& connman);
     bool IsMnbRecoveryRequested(const uint256& hash) { return mMnbRecoveryRequests.count(hash); }
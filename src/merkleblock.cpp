@@ -10,8 +10,9 @@
 #include <utilstrencodings.h>
 
 
-CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids)
+CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids, const std::vector<CBloomTxElements>* elements)
 {
+    assert(!elements || elements->size() == block.vtx.size());
     header = block.GetBlockHeader();
 
     std::vector<bool> vMatch;
@@ -25,7 +26,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std:
         const uint256& hash = block.vtx[i]->GetHash();
         if (txids && txids->count(hash)) {
             vMatch.push_back(true);
-        } else if (filter && filter->IsRelevantAndUpdate(*block.vtx[i])) {
+        } else if (filter && (elements ? filter->IsRelevantAndUpdate(*block.vtx[i], (*elements)[i]) : filter->IsRelevantAndUpdate(*block.vtx[i]))) {
             vMatch.push_back(true);
             vMatchedTxn.emplace_back(i, hash);
         } else {
@@ -146,6 +146,12 @@ public:
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter) : CMerkleBlock(block, &filter, nullptr) { }
 
+    /**
+     * Same as above, with the script data elements of every transaction of
+     * the block parsed before, see CBloomTxElements
+     */
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter, const std::vector<CBloomTxElements>& vElements) : CMerkleBlock(block, &filter, nullptr, &vElements) { }
+
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
 
@@ -161,7 +167,7 @@ public:
 
 private:
     // Combined constructor to consolidate code
-    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids);
+    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids, const std::vector<CBloomTxElements>* elements = nullptr);
 };
 
 #endif // BITCOIN_MERKLEBLOCK_H
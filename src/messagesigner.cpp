@@ -6,9 +6,98 @@
 #include <hash.h>
 #include <validation.h> // For strMessageMagic
 #include <messagesigner.h>
+#include <random.h>
+#include <script/sigcache.h>
 #include <tinyformat.h>
+#include <util.h>
 #include <utilstrencodings.h>
 
+#include <cuckoocache.h>
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+namespace {
+/**
+ * Valid hash signature cache. Masternode pings, broadcasts, payment votes,
+ * InstantSend votes and sporks are relayed by several peers, and the copies
+ * are verified before the first one makes it to the seen maps. Recovering
+ * the public key is then only done for the first of them.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || key ID || signature)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    uint32_t nElems;
+    boost::shared_mutex cs_msgsigcache;
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
+
+public:
+    CMessageSignatureCache() : nElems(0)
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        bool fFound = nElems != 0 && setValid.contains(entry, false);
+        (fFound ? nHits : nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        if (nElems != 0)
+            setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        nElems = setValid.setup_bytes(n);
+        return nElems;
+    }
+
+    SignatureCacheStats GetStats()
+    {
+        SignatureCacheStats stats;
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        stats.nCapacity = nElems != 0 ? setValid.capacity() : 0;
+        stats.nOccupied = nElems != 0 ? setValid.count_occupied() : 0;
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+static CMessageSignatureCache messageSignatureCache;
+} // namespace
+
+void InitMessageSignatureCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxmsgsigcachesize", DEFAULT_MAX_MSG_SIG_CACHE_SIZE)), MAX_MAX_MSG_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = messageSignatureCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for message signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+SignatureCacheStats GetMessageSignatureCacheStats()
+{
+    return messageSignatureCache.GetStats();
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string& strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CBitcoinSecret vchSecret;
@@ -56,6 +145,11 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if (messageSignatureCache.Get(entry))
+        return true;
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
@@ -69,5 +163,6 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std
         return false;
     }
 
+    messageSignatureCache.Set(entry);
     return true;
 }
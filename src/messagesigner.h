@@ -7,6 +7,13 @@
 
 #include <key.h>
 
+/** Default for -maxmsgsigcachesize, maximum size of the message signature cache in MiB */
+static const int64_t DEFAULT_MAX_MSG_SIG_CACHE_SIZE = 2;
+/** Maximum for -maxmsgsigcachesize */
+static const int64_t MAX_MAX_MSG_SIG_CACHE_SIZE = 1024;
+
+struct SignatureCacheStats;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -35,4 +42,8 @@ public:
     static bool VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
+/** To be called once in AppInitMain/BasicTestingSetup to initialize the cache of verified message signatures */
+void InitMessageSignatureCache();
+SignatureCacheStats GetMessageSignatureCacheStats();
+
 #endif
@@ -35,6 +35,8 @@
 #include <utility>
 #include <inttypes.h>
 
+#include <boost/thread.hpp>
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // BitcoinMiner
@@ -49,6 +51,149 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockWeight = 0;
 
+namespace {
+
+/** Upper bound of the mempool additions tracked between two package selections */
+const size_t MAX_TRACKED_MEMPOOL_ADDITIONS = 100000;
+
+/**
+ * The transactions of the last package selection that included everything
+ * the mempool offered, so that the next template in incremental mode only
+ * needs to consider the changes since. Protected by mempool.cs.
+ */
+struct CPreviousSelection
+{
+    bool fValid = false;
+    bool fIncludeWitness = false;
+    unsigned int nBlockMaxWeight = 0;
+    CFeeRate blockMinFeeRate;
+    //! Selected transactions in block order
+    std::vector<uint256> vSelected;
+    //! Transactions added to the mempool since the selection
+    std::set<uint256> setAdded;
+};
+
+CPreviousSelection previousSelection;
+bool fTrackingMempoolAdditions = false;
+
+/**
+ * The selection for the block after hashSpeculativeTip, made while that block
+ * was not connected yet, see ThreadSpeculativeAssembly. It becomes the
+ * previous selection once that block is the tip. Protected by mempool.cs.
+ */
+CPreviousSelection speculativeSelection;
+uint256 hashSpeculativeTip;
+
+void TrackEntryAdded(CPreviousSelection& selection, const uint256& hash)
+{
+    if (!selection.fValid)
+        return;
+    if (selection.setAdded.size() >= MAX_TRACKED_MEMPOOL_ADDITIONS) {
+        // Cheaper to select from scratch at this point
+        selection.fValid = false;
+        selection.setAdded.clear();
+        return;
+    }
+    selection.setAdded.insert(hash);
+}
+
+void PreviousSelectionEntryAdded(CTransactionRef tx, uint64_t /*nMempoolSequence*/)
+{
+    TrackEntryAdded(previousSelection, tx->GetHash());
+    TrackEntryAdded(speculativeSelection, tx->GetHash());
+}
+
+/** A block extending the tip to select the transactions of the next block for */
+struct CSpeculativeRequest
+{
+    std::shared_ptr<const CBlock> pblock;
+    uint256 hashBlock;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    bool fIncludeWitness;
+};
+
+/**
+ * Hands the blocks that passed their PoW and CheckBlock on top of the tip to
+ * ThreadSpeculativeAssembly, only the latest one is kept.
+ */
+class CSpeculativeAssembly : public CValidationInterface
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::unique_ptr<CSpeculativeRequest> pending;
+
+protected:
+    void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) override
+    {
+        AssertLockHeld(cs_main);
+        {
+            // Nobody asked for a template yet, nothing to prepare for
+            LOCK(mempool.cs);
+            if (!fTrackingMempoolAdditions)
+                return;
+        }
+        std::unique_ptr<CSpeculativeRequest> request(new CSpeculativeRequest());
+        request->pblock = pblock;
+        request->hashBlock = pindex->GetBlockHash();
+        request->nHeight = pindex->nHeight + 1;
+        // As CreateNewBlock will see it once pindex is the tip
+        request->nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? pindex->GetMedianTimePast() : GetAdjustedTime();
+        request->fIncludeWitness = IsWitnessEnabled(pindex, Params().GetConsensus());
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        pending = std::move(request);
+        cond.notify_one();
+    }
+
+public:
+    void Thread()
+    {
+        while (true) {
+            std::unique_ptr<CSpeculativeRequest> request;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!pending)
+                    cond.wait(lock);
+                request = std::move(pending);
+            }
+
+            const int64_t nTimeStart = GetTimeMicros();
+            LOCK(mempool.cs);
+            BlockAssembler(Params()).SelectAfterBlock(*request->pblock, request->hashBlock, request->nHeight, request->nLockTimeCutoff, request->fIncludeWitness);
+            LogPrint(BCLog::BENCH, "Speculative selection after %s: %u txs%s, %.2fms\n", request->hashBlock.ToString(),
+                speculativeSelection.vSelected.size(), speculativeSelection.fValid ? "" : " (incomplete, not used)", 0.001 * (GetTimeMicros() - nTimeStart));
+        }
+    }
+};
+
+CSpeculativeAssembly speculativeAssembly;
+
+} // namespace
+
+void ResetIncrementalAssembly()
+{
+    LOCK(mempool.cs);
+    previousSelection.fValid = false;
+    previousSelection.vSelected.clear();
+    previousSelection.setAdded.clear();
+    speculativeSelection.fValid = false;
+    speculativeSelection.vSelected.clear();
+    speculativeSelection.setAdded.clear();
+}
+
+CValidationInterface* GetSpeculativeAssemblyInterface()
+{
+    return &speculativeAssembly;
+}
+
+void ThreadSpeculativeAssembly()
+{
+    RenameThread("globaltoken-specasm");
+    speculativeAssembly.Thread();
+}
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev, uint8_t algo)
 {
     int64_t nOldTime = pblock->nTime;
@@ -67,11 +212,13 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    fIncremental = false;
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
 {
     blockMinFeeRate = options.blockMinFeeRate;
+    fIncremental = options.fIncremental;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
 }
@@ -91,6 +238,7 @@ static BlockAssembler::Options DefaultOptions(const CChainParams& params)
     } else {
         options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     }
+    options.fIncremental = gArgs.GetBoolArg("-incrementalassembly", DEFAULT_INCREMENTAL_ASSEMBLY);
     return options;
 }
 
@@ -170,9 +318,35 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
 
+    // The block this template builds on was connected since the selection for it was made
+    if (fIncremental && speculativeSelection.fValid && hashSpeculativeTip == pindexPrev->GetBlockHash()) {
+        previousSelection = std::move(speculativeSelection);
+        speculativeSelection = CPreviousSelection();
+    }
+
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    std::vector<CTxMemPool::txiter> vCandidates;
+    const bool fReuseSelection = addPreviousSelection(vCandidates);
+    const bool fLockedSelected = addInstantSendLockedTxs(nPackagesSelected);
+    const bool fCompleteSelection = addPackageTxs(nPackagesSelected, nDescendantsUpdated, fReuseSelection ? &vCandidates : nullptr) && fLockedSelected;
+
+    if (fIncremental) {
+        if (!fTrackingMempoolAdditions) {
+            mempool.NotifyEntryAdded.connect(&PreviousSelectionEntryAdded);
+            fTrackingMempoolAdditions = true;
+        }
+        previousSelection.fValid = fCompleteSelection;
+        previousSelection.fIncludeWitness = fIncludeWitness;
+        previousSelection.nBlockMaxWeight = nBlockMaxWeight;
+        previousSelection.blockMinFeeRate = blockMinFeeRate;
+        previousSelection.vSelected.clear();
+        previousSelection.setAdded.clear();
+        if (fCompleteSelection) {
+            for (size_t i = 1; i < pblock->vtx.size(); i++)
+                previousSelection.vSelected.push_back(pblock->vtx[i]->GetHash());
+        }
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -207,6 +381,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
+    pblocktemplate->vCoinbaseMerkleBranch = BlockMerkleBranch(*pblock, 0);
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
@@ -235,11 +410,92 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, fReuseSelection ? strprintf(", %u candidates", vCandidates.size()) : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
 
+void BlockAssembler::SelectAfterBlock(const CBlock& block, const uint256& hashBlock, int nHeightIn, int64_t nLockTimeCutoffIn, bool fIncludeWitnessIn)
+{
+    AssertLockHeld(mempool.cs);
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+    pblock = &pblocktemplate->block;
+    pblock->vtx.emplace_back();
+    pblocktemplate->vTxFees.push_back(-1);
+    pblocktemplate->vTxSigOpsCost.push_back(-1);
+
+    nHeight = nHeightIn;
+    nLockTimeCutoff = nLockTimeCutoffIn;
+    fIncludeWitness = fIncludeWitnessIn;
+
+    // Once the block is connected its transactions are gone from the mempool,
+    // and so are those spending the same coins, with their descendants. Both
+    // count as already in the block without taking any room, so that the
+    // descendants of the former are selected as if their parents were
+    // confirmed and the latter are skipped.
+    CTxMemPool::setEntries setGone;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+        if (it != mempool.mapTx.end()) {
+            setGone.insert(it);
+            continue;
+        }
+        for (const CTxIn& txin : tx.vin) {
+            auto itConflict = mempool.mapNextTx.find(txin.prevout);
+            if (itConflict != mempool.mapNextTx.end())
+                mempool.CalculateDescendants(mempool.mapTx.find(itConflict->second->GetHash()), setGone);
+        }
+    }
+    inBlock = setGone;
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    const bool fLockedSelected = addInstantSendLockedTxs(nPackagesSelected);
+    const bool fCompleteSelection = addPackageTxs(nPackagesSelected, nDescendantsUpdated) && fLockedSelected;
+
+    speculativeSelection.fValid = fCompleteSelection;
+    speculativeSelection.fIncludeWitness = fIncludeWitness;
+    speculativeSelection.nBlockMaxWeight = nBlockMaxWeight;
+    speculativeSelection.blockMinFeeRate = blockMinFeeRate;
+    speculativeSelection.vSelected.clear();
+    speculativeSelection.setAdded.clear();
+    if (fCompleteSelection) {
+        for (size_t i = 1; i < pblock->vtx.size(); i++)
+            speculativeSelection.vSelected.push_back(pblock->vtx[i]->GetHash());
+    }
+    hashSpeculativeTip = hashBlock;
+}
+
+std::unique_ptr<CBlockTemplate> CopyBlockTemplateForAlgo(const CBlockTemplate& blocktemplate, const CBlockIndex* pindexPrev, uint8_t algo, const Consensus::Params& consensusParams)
+{
+    if (!consensusParams.Hardfork2.IsActivated((uint32_t)GetAdjustedTime()) && !IsAlgoAllowedBeforeHF2(algo))
+        return nullptr;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(blocktemplate));
+    CBlock* pblock = &pblocktemplate->block;
+
+    arith_uint256 nonce;
+    if (consensusParams.Hardfork1.IsActivated(pblock->nTime) && IsEquihashBasedAlgo(algo)) {
+        // Randomise nonce for new block format, like CreateNewBlock.
+        nonce = UintToArith256(GetRandHash());
+        nonce <<= 32;
+        nonce >>= 16;
+    }
+
+    // SetAlgo only ever sets bits, so drop the algo of the source template first.
+    pblock->nVersion &= ~BLOCK_VERSION_ALGO;
+    pblock->SetAlgo(algo);
+    UpdateTime(pblock, consensusParams, pindexPrev, algo);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, consensusParams, algo);
+    pblock->nNonce         = 0;
+    pblock->nBigNonce      = ArithToUint256(nonce);
+    pblock->nSolution.clear();
+
+    return pblocktemplate;
+}
+
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
 {
     for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
@@ -278,6 +534,97 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::addPreviousSelection(std::vector<CTxMemPool::txiter>& vCandidates)
+{
+    vCandidates.clear();
+    if (!fIncremental || !previousSelection.fValid || previousSelection.fIncludeWitness != fIncludeWitness ||
+            previousSelection.nBlockMaxWeight != nBlockMaxWeight || previousSelection.blockMinFeeRate != blockMinFeeRate)
+        return false;
+
+    const uint64_t nBlockWeightStart = nBlockWeight;
+    const uint64_t nBlockSigOpsCostStart = nBlockSigOpsCost;
+    for (const uint256& hash : previousSelection.vSelected) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            // Confirmed in the new tip, or removed together with its descendants
+            continue;
+        }
+
+        bool fValid = true;
+        for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+            if (!inBlock.count(parent)) {
+                fValid = false;
+                break;
+            }
+        }
+        CTxMemPool::setEntries package;
+        package.insert(it);
+        if (!fValid || !TestPackage(it->GetTxSize(), it->GetSigOpCost()) || !TestPackageTransactions(package)) {
+            // Start from scratch, as if nothing was reused
+            pblock->vtx.resize(1);
+            pblocktemplate->vTxFees.resize(1);
+            pblocktemplate->vTxSigOpsCost.resize(1);
+            inBlock.clear();
+            nBlockWeight = nBlockWeightStart;
+            nBlockSigOpsCost = nBlockSigOpsCostStart;
+            nBlockTx = 0;
+            nFees = 0;
+            return false;
+        }
+        AddToBlock(it);
+    }
+
+    for (const uint256& hash : previousSelection.setAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end() && !inBlock.count(it))
+            vCandidates.push_back(it);
+    }
+    std::sort(vCandidates.begin(), vCandidates.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+        return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+    });
+    return true;
+}
+
+bool BlockAssembler::addInstantSendLockedTxs(int &nPackagesSelected)
+{
+    std::vector<CTxMemPool::txiter> vLocked(mempool.GetInstantSendLocked().begin(), mempool.GetInstantSendLocked().end());
+    std::sort(vLocked.begin(), vLocked.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+        return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+    });
+
+    bool fComplete = true;
+    for (CTxMemPool::txiter it : vLocked) {
+        if (inBlock.count(it))
+            continue;
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(it);
+
+        uint64_t packageSize = 0;
+        int64_t packageSigOpsCost = 0;
+        for (CTxMemPool::txiter entry : ancestors) {
+            packageSize += entry->GetTxSize();
+            packageSigOpsCost += entry->GetSigOpCost();
+        }
+        if (!TestPackage(packageSize, packageSigOpsCost) || !TestPackageTransactions(ancestors)) {
+            fComplete = false;
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, it, sortedEntries);
+        for (CTxMemPool::txiter entry : sortedEntries) {
+            AddToBlock(entry);
+        }
+        ++nPackagesSelected;
+    }
+    return fComplete;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -360,7 +707,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+bool BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* pvCandidates)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -372,8 +719,21 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     // and modifying them for their already included ancestors
     UpdatePackagesForAdded(inBlock, mapModifiedTx);
 
+    // Walk either the whole mempool or only the given candidates, in both
+    // cases by descending ancestor score.
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    size_t nCandidate = 0;
+    auto HasNext = [&]() {
+        return pvCandidates ? nCandidate < pvCandidates->size() : mi != mempool.mapTx.get<ancestor_score>().end();
+    };
+    auto Next = [&]() {
+        return pvCandidates ? (*pvCandidates)[nCandidate] : mempool.mapTx.project<0>(mi);
+    };
+    auto Advance = [&]() {
+        if (pvCandidates) ++nCandidate; else ++mi;
+    };
     CTxMemPool::txiter iter;
+    bool fComplete = true;
 
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
@@ -381,12 +741,11 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    while (HasNext() || !mapModifiedTx.empty())
     {
         // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
+        if (HasNext() && SkipMapTxEntry(Next(), mapModifiedTx, failedTx)) {
+            Advance();
             continue;
         }
 
@@ -395,13 +754,13 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         bool fUsingModified = false;
 
         modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
+        if (!HasNext()) {
             // We're out of entries in mapTx; use the entry from mapModifiedTx
             iter = modit->iter;
             fUsingModified = true;
         } else {
             // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
+            iter = Next();
             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
                     CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter))) {
                 // The best entry in mapModifiedTx has higher score
@@ -412,7 +771,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             } else {
                 // Either no entry in mapModifiedTx, or it's worse than mapTx.
                 // Increment mi for the next loop iteration.
-                ++mi;
+                Advance();
             }
         }
 
@@ -431,10 +790,11 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
-            return;
+            return fComplete;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            fComplete = false;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -463,6 +823,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
 
         // Test if all tx's are Final
         if (!TestPackageTransactions(ancestors)) {
+            fComplete = false;
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
@@ -488,9 +849,10 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
+    return fComplete;
 }
 
-void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+static void SetExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
     static uint256 hashPrevBlock;
@@ -506,5 +868,22 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+}
+
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+{
+    SetExtraNonce(pblock, pindexPrev, nExtraNonce);
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+void IncrementExtraNonce(CBlockTemplate* pblocktemplate, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+{
+    SetExtraNonce(&pblocktemplate->block, pindexPrev, nExtraNonce);
+    UpdateCoinbaseMerkleRoot(*pblocktemplate);
+}
+
+void UpdateCoinbaseMerkleRoot(CBlockTemplate& blocktemplate)
+{
+    CBlock& block = blocktemplate.block;
+    block.hashMerkleRoot = ComputeMerkleRootFromBranch(block.vtx[0]->GetHash(), blocktemplate.vCoinbaseMerkleBranch, 0);
+}
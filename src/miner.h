@@ -17,10 +17,15 @@
 class CBlockIndex;
 class CChainParams;
 class CScript;
+class CValidationInterface;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -incrementalassembly, reuse the previous transaction selection when possible */
+static const bool DEFAULT_INCREMENTAL_ASSEMBLY = true;
+/** Default for -speculativeassembly, select the transactions of the next block before the new tip is connected */
+static const bool DEFAULT_SPECULATIVE_ASSEMBLY = true;
 
 struct CBlockTemplate
 {
@@ -28,6 +33,9 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    //! Merkle branch of the coinbase. It does not depend on the coinbase itself,
+    //! so coinbase changes only need ComputeMerkleRootFromBranch.
+    std::vector<uint256> vCoinbaseMerkleBranch;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -132,6 +140,7 @@ private:
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    bool fIncremental;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -150,6 +159,7 @@ public:
         Options();
         size_t nBlockMaxWeight;
         CFeeRate blockMinFeeRate;
+        bool fIncremental;
     };
 
     explicit BlockAssembler(const CChainParams& params);
@@ -158,6 +168,13 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, uint8_t algo, bool fMineWitnessTx=true);
 
+    /** Select the transactions of the block after block, which extends the
+      * tip, as if it was connected already. The next CreateNewBlock on top
+      * of it reuses the selection if everything the mempool offered fit.
+      * The height, locktime cutoff and witness inclusion are those of the
+      * next block. Caller must hold mempool.cs. */
+    void SelectAfterBlock(const CBlock& block, const uint256& hashBlock, int nHeightIn, int64_t nLockTimeCutoffIn, bool fIncludeWitnessIn);
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
@@ -168,8 +185,19 @@ private:
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+      * statistics from the package selection (for logging statistics).
+      * If pvCandidates is given, only those mempool entries (sorted by
+      * ancestor score) are considered instead of the whole mempool.
+      * Returns false if a package was skipped for not fitting or not being
+      * final, i.e. the selection is not everything the mempool offers. */
+    bool addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* pvCandidates = nullptr);
+    /** Add the transactions of the previous complete selection that are still
+      * in the mempool, and collect the entries added to the mempool since.
+      * Returns false if the previous selection cannot be reused. */
+    bool addPreviousSelection(std::vector<CTxMemPool::txiter>& vCandidates);
+    /** Add the InstantSend locked transactions with their ancestors, ahead of
+      * everything selected by feerate. Returns false if a package did not fit. */
+    bool addInstantSendLockedTxs(int &nPackagesSelected);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -192,8 +220,32 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/** Make the next block template select its transactions from the whole mempool again */
+void ResetIncrementalAssembly();
+
+/**
+ * Select the transactions of the next block in the background as soon as a
+ * block extending the tip has passed its PoW and CheckBlock, before it is
+ * connected. CreateNewBlock picks the selection up once that block is the
+ * tip, so fresh work is ready right after ConnectTip; if the block fails to
+ * connect the selection is never used. Blocks are only handed to the thread
+ * through GetSpeculativeAssemblyInterface, after the first template was made.
+ */
+void ThreadSpeculativeAssembly();
+CValidationInterface* GetSpeculativeAssemblyInterface();
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+/** Like IncrementExtraNonce on the template's block, but only hashes up the cached coinbase merkle branch. */
+void IncrementExtraNonce(CBlockTemplate* pblocktemplate, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+/** Recompute the merkle root of a template's block after its coinbase changed. */
+void UpdateCoinbaseMerkleRoot(CBlockTemplate& blocktemplate);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev, uint8_t algo);
+/**
+ * Copy a block template built on pindexPrev for another algo. The transaction
+ * selection and coinbase do not depend on the algo, so only the header fields
+ * that do are recomputed. Returns nullptr if algo cannot be mined yet.
+ */
+std::unique_ptr<CBlockTemplate> CopyBlockTemplateForAlgo(const CBlockTemplate& blocktemplate, const CBlockIndex* pindexPrev, uint8_t algo, const Consensus::Params& consensusParams);
 
 #endif // BITCOIN_MINER_H
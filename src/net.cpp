@@ -45,9 +45,17 @@
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
+/** How long (in seconds) getaddr requests are answered from the same snapshot of the address manager */
+static const int64_t ADDR_RESPONSE_CACHE_LIFETIME = 10 * 60;
+
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** How long the socket handler waits for network activity, which is also how often it polls pnode->vSend */
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+/** Maximum number of ready sockets returned by one epoll or kqueue wait */
+static const int MAX_SOCKET_EVENTS = 256;
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -458,6 +466,11 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         CloseSocket(hSocket);
         return nullptr;
     }
+    if (socketEventsMode == SocketEventsMode::SELECT && !IsSelectableSocket(hSocket)) {
+        LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
+        CloseSocket(hSocket);
+        return nullptr;
+    }
 
     // Add node
     NodeId id = GetNewNodeId();
@@ -718,6 +731,7 @@ void CNode::copyStats(CNodeStats &stats)
     {
         LOCK(cs_vRecv);
         X(mapRecvBytesPerMsgCmd);
+        X(mapRecvStatsPerMsgCmd);
         X(nRecvBytes);
     }
     X(fWhitelisted);
@@ -890,30 +904,46 @@ const uint256& CNetMessage::GetMessageHash() const
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (true) {
+        // Masternode overlay messages overtake the queue, but never one that is partly sent
+        if (pnode->nSendOffset == 0)
+            pnode->fSendingPriority = !pnode->vSendMsgPriority.empty();
+        std::deque<CQueuedNetMsg>& queue = pnode->fSendingPriority ? pnode->vSendMsgPriority : pnode->vSendMsg;
+        if (queue.empty())
+            break;
+        const CQueuedNetMsg& msg = queue.front();
+        assert(msg.size() > pnode->nSendOffset);
+
+        // The header and the payload are sent one after the other
+        const unsigned char* data;
+        size_t nDataSize;
+        if (pnode->nSendOffset < msg.header.size()) {
+            data = msg.header.data() + pnode->nSendOffset;
+            nDataSize = msg.header.size() - pnode->nSendOffset;
+        } else {
+            data = msg.payload->data() + (pnode->nSendOffset - msg.header.size());
+            nDataSize = msg.size() - pnode->nSendOffset;
+        }
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data), nDataSize, MSG_NOSIGNAL | MSG_DONTWAIT);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            if (pnode->nSendOffset == msg.size()) {
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= msg.size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
+                queue.pop_front();
+            } else if ((size_t)nBytes < nDataSize) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -932,11 +962,10 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty() && pnode->vSendMsgPriority.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1113,7 +1142,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (socketEventsMode == SocketEventsMode::SELECT && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1165,6 +1194,248 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#if defined(USE_EPOLL)
+    if (str == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+#if defined(USE_KQUEUE)
+    if (str == "kqueue") {
+        mode = SocketEventsMode::KQUEUE;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#if defined(USE_EPOLL)
+    strModes += ", epoll";
+#endif
+#if defined(USE_KQUEUE)
+    strModes += ", kqueue";
+#endif
+    return strModes;
+}
+
+void CConnman::GenerateSelectSet(std::map<SOCKET, SocketInterest>& interest)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        interest[hListenSocket.socket] = SocketInterest{-1, true, false};
+    }
+
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes)
+    {
+        // Implement the following logic:
+        // * If there is data to send, select() for sending data. As this only
+        //   happens when optimistic write failed, we choose to first drain the
+        //   write buffer in this case before receiving more. This avoids
+        //   needlessly queueing received data, if the remote peer is not themselves
+        //   receiving data. This means properly utilizing TCP flow control signalling.
+        // * Otherwise, if there is space left in the receive buffer, select() for
+        //   receiving data.
+        // * Hand off all complete messages to the processor, to be handled without
+        //   blocking here.
+
+        bool select_recv = !pnode->fPauseRecv;
+        bool select_send;
+        {
+            LOCK(pnode->cs_vSend);
+            select_send = !pnode->vSendMsg.empty() || !pnode->vSendMsgPriority.empty();
+        }
+
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+
+        interest[pnode->hSocket] = SocketInterest{pnode->GetId(), !select_send && select_recv, select_send};
+    }
+}
+
+void CConnman::SocketEventsSelect(const std::map<SOCKET, SocketInterest>& interest, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    struct timeval timeout = MillisToTimeval(SELECT_TIMEOUT_MILLISECONDS);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (const auto& it : interest) {
+        if (it.second.fRecv)
+            FD_SET(it.first, &fdsetRecv);
+        if (it.second.fSend)
+            FD_SET(it.first, &fdsetSend);
+        if (it.second.owner != -1)
+            FD_SET(it.first, &fdsetError);
+        hSocketMax = std::max(hSocketMax, it.first);
+    }
+
+    int nSelect = select(interest.empty() ? 0 : hSocketMax + 1,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (!interest.empty())
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (const auto& it : interest)
+                recv_set.insert(it.first);
+        }
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    for (const auto& it : interest) {
+        if (FD_ISSET(it.first, &fdsetRecv))
+            recv_set.insert(it.first);
+        if (FD_ISSET(it.first, &fdsetSend))
+            send_set.insert(it.first);
+        if (FD_ISSET(it.first, &fdsetError))
+            error_set.insert(it.first);
+    }
+}
+
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+void CConnman::UpdatePollRegistration(SOCKET hSocket, const SocketInterest* pold, const SocketInterest* pnew)
+{
+#if defined(USE_EPOLL)
+    if (!pnew) {
+        struct epoll_event event = {};
+        epoll_ctl(nPollFd, EPOLL_CTL_DEL, hSocket, &event);
+        return;
+    }
+    struct epoll_event event = {};
+    event.events = (pnew->fRecv ? EPOLLIN : 0) | (pnew->fSend ? EPOLLOUT : 0);
+    event.data.fd = hSocket;
+    if (pold && (epoll_ctl(nPollFd, EPOLL_CTL_MOD, hSocket, &event) == 0 || errno != ENOENT))
+        return;
+    if (epoll_ctl(nPollFd, EPOLL_CTL_ADD, hSocket, &event) == -1)
+        LogPrint(BCLog::NET, "epoll_ctl for socket %d failed: %s\n", hSocket, NetworkErrorString(errno));
+#elif defined(USE_KQUEUE)
+    auto change = [&](int16_t filter, bool fOld, bool fNew) {
+        if (fOld == fNew)
+            return;
+        struct kevent event;
+        EV_SET(&event, hSocket, filter, fNew ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        // Deleting fails for sockets that were closed, which dropped their filters already.
+        if (kevent(nPollFd, &event, 1, nullptr, 0, nullptr) == -1 && fNew)
+            LogPrint(BCLog::NET, "kevent for socket %d failed: %s\n", hSocket, NetworkErrorString(errno));
+    };
+    change(EVFILT_READ, pold && pold->fRecv, pnew && pnew->fRecv);
+    change(EVFILT_WRITE, pold && pold->fSend, pnew && pnew->fSend);
+#endif
+}
+
+void CConnman::UpdatePollRegistrations(const std::map<SOCKET, SocketInterest>& interest)
+{
+    // Closing a socket removes it from nPollFd, the registrations left behind
+    // are only dropped here. Its descriptor may already have been reused for
+    // a new connection though, which is told apart by the owner.
+    for (auto it = mapPollRegistrations.begin(); it != mapPollRegistrations.end(); ) {
+        if (interest.count(it->first) == 0) {
+            UpdatePollRegistration(it->first, &it->second, nullptr);
+            it = mapPollRegistrations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const auto& it : interest) {
+        auto itOld = mapPollRegistrations.find(it.first);
+        if (itOld == mapPollRegistrations.end()) {
+            UpdatePollRegistration(it.first, nullptr, &it.second);
+            mapPollRegistrations.emplace(it.first, it.second);
+        } else if (itOld->second.owner != it.second.owner) {
+            UpdatePollRegistration(it.first, nullptr, &it.second);
+            itOld->second = it.second;
+        } else if (itOld->second.fRecv != it.second.fRecv || itOld->second.fSend != it.second.fSend) {
+            UpdatePollRegistration(it.first, &itOld->second, &it.second);
+            itOld->second = it.second;
+        }
+    }
+}
+
+void CConnman::SocketEventsPoller(const std::map<SOCKET, SocketInterest>& interest, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    // Only sockets whose interest changed cost a system call, and only the
+    // ready ones are returned, instead of passing every socket to select().
+    UpdatePollRegistrations(interest);
+
+#if defined(USE_EPOLL)
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(nPollFd, events, MAX_SOCKET_EVENTS, SELECT_TIMEOUT_MILLISECONDS);
+#elif defined(USE_KQUEUE)
+    struct kevent events[MAX_SOCKET_EVENTS];
+    struct timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = SELECT_TIMEOUT_MILLISECONDS * 1000 * 1000;
+    int nEvents = kevent(nPollFd, nullptr, 0, events, MAX_SOCKET_EVENTS, &timeout);
+#endif
+    if (interruptNet)
+        return;
+
+    if (nEvents == -1)
+    {
+        int nErr = errno;
+        if (nErr != EINTR) {
+            LogPrintf("socket events error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+#if defined(USE_EPOLL)
+        SOCKET hSocket = events[i].data.fd;
+        if (events[i].events & EPOLLIN)
+            recv_set.insert(hSocket);
+        if (events[i].events & EPOLLOUT)
+            send_set.insert(hSocket);
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            error_set.insert(hSocket);
+#elif defined(USE_KQUEUE)
+        SOCKET hSocket = events[i].ident;
+        if (events[i].flags & EV_ERROR)
+            error_set.insert(hSocket);
+        else if (events[i].filter == EVFILT_READ)
+            recv_set.insert(hSocket);
+        else if (events[i].filter == EVFILT_WRITE)
+            send_set.insert(hSocket);
+#endif
+    }
+}
+#endif
+
+void CConnman::SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    std::map<SOCKET, SocketInterest> interest;
+    GenerateSelectSet(interest);
+
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (nPollFd != -1) {
+        SocketEventsPoller(interest, recv_set, send_set, error_set);
+        return;
+    }
+#endif
+    SocketEventsSelect(interest, recv_set, send_set, error_set);
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1238,91 +1509,19 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::set<SOCKET> recv_set;
+        std::set<SOCKET> send_set;
+        std::set<SOCKET> error_set;
+        SocketEvents(recv_set, send_set, error_set);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket) > 0)
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1347,9 +1546,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet)
             {
@@ -1382,7 +1581,7 @@ void CConnman::ThreadSocketHandler()
                             pnode->nProcessQueueSize += nSizeAdded;
                             pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                         }
-                        WakeMessageHandler();
+                        WakeMessageHandler(pnode);
                     }
                 }
                 else if (nBytes == 0)
@@ -1457,11 +1656,31 @@ void CConnman::ThreadSocketHandler()
 
 void CConnman::WakeMessageHandler()
 {
+    for (MessageHandler& handler : messageHandlers) {
+        {
+            std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+            handler.fMsgProcWake = true;
+        }
+        handler.condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(const CNode* pnode)
+{
+    MessageHandler& handler = GetMessageHandler(pnode);
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+        handler.fMsgProcWake = true;
     }
-    condMsgProc.notify_one();
+    handler.condMsgProc.notify_one();
+}
+
+CConnman::MessageHandler& CConnman::GetMessageHandler(const CNode* pnode)
+{
+    // fMasternode is set before the node is added to vNodes and never changes
+    if (pnode->fMasternode)
+        return messageHandlers[MAX_MSGHANDLER_THREADS];
+    return messageHandlers[pnode->GetId() % nMessageHandlerThreads];
 }
 
 
@@ -1675,8 +1894,14 @@ void CConnman::DumpAddresses()
 {
     int64_t nStart = GetTimeMillis();
 
+    uint64_t nModifications = addrman.GetModificationCount();
+    if (nModifications == nAddrmanModificationsDumped) {
+        LogPrint(BCLog::NET, "Addresses unchanged, not flushing peers.dat\n");
+        return;
+    }
     CAddrDB adb;
-    adb.Write(addrman);
+    if (adb.Write(addrman))
+        nAddrmanModificationsDumped = nModifications;
 
     LogPrint(BCLog::NET, "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -2072,17 +2297,19 @@ void CConnman::OpenMasternodeConnection(const CAddress &addrConnect) {
     OpenNetworkConnection(addrConnect, false, nullptr, nullptr, false, false, false, true);
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(MessageHandler& handler)
 {
     while (!flagInterruptMsgProc)
     {
+        FlushRelayInv();
+
         std::vector<CNode*> vNodesCopy = CopyNodeVector();
 
         bool fMoreWork = false;
 
         for (CNode* pnode : vNodesCopy)
         {
-            if (pnode->fDisconnect)
+            if (pnode->fDisconnect || &GetMessageHandler(pnode) != &handler)
                 continue;
 
             // Receive messages
@@ -2102,11 +2329,11 @@ void CConnman::ThreadMessageHandler()
 
         ReleaseNodeVector(vNodesCopy);
 
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
+        std::unique_lock<std::mutex> lock(handler.mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            handler.condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&handler] { return handler.fMsgProcWake; });
         }
-        fMsgProcWake = false;
+        handler.fMsgProcWake = false;
     }
 }
 
@@ -2268,9 +2495,13 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : addrman(Params().Allo
     fNetworkActive = true;
     setBannedIsDirty = false;
     fAddressesInitialized = false;
+    nAddrmanModificationsDumped = std::numeric_limits<uint64_t>::max();
+    nAddrResponseCacheExpire = 0;
+    nRelayInvQueueSince = 0;
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nPollFd = -1;
     flagInterruptMsgProc = false;
     SetTryNewOutboundPeer(false);
 
@@ -2329,6 +2560,18 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         nMaxOutboundCycleStartTime = 0;
     }
 
+#if defined(USE_EPOLL)
+    if (socketEventsMode == SocketEventsMode::EPOLL)
+        nPollFd = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(USE_KQUEUE)
+    if (socketEventsMode == SocketEventsMode::KQUEUE)
+        nPollFd = kqueue();
+#endif
+    if (socketEventsMode != SocketEventsMode::SELECT && nPollFd == -1) {
+        LogPrintf("Failed to set up socket events (%s), falling back to select\n", NetworkErrorString(errno));
+        socketEventsMode = SocketEventsMode::SELECT;
+    }
+
     if (fListen && !InitBinds(connOptions.vBinds, connOptions.vWhiteBinds)) {
         if (clientInterface) {
             clientInterface->ThreadSafeMessageBox(
@@ -2349,9 +2592,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     int64_t nStart = GetTimeMillis();
     {
         CAddrDB adb;
-        if (adb.Read(addrman))
+        if (adb.Read(addrman)) {
+            nAddrmanModificationsDumped = addrman.GetModificationCount();
             LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
-        else {
+        } else {
             addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
             LogPrintf("Invalid or missing peers.dat; recreating\n");
             DumpAddresses();
@@ -2401,9 +2645,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+    for (MessageHandler& handler : messageHandlers) {
+        std::unique_lock<std::mutex> lock(handler.mutexMsgProc);
+        handler.fMsgProcWake = false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2429,13 +2673,20 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        MessageHandler& handler = messageHandlers[i];
+        handler.strThreadName = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        handler.thread = std::thread(&TraceThread<std::function<void()> >, handler.strThreadName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, std::ref(handler))));
+    }
+    MessageHandler& masternodeHandler = messageHandlers[MAX_MSGHANDLER_THREADS];
+    masternodeHandler.strThreadName = "mnmsghand";
+    masternodeHandler.thread = std::thread(&TraceThread<std::function<void()> >, masternodeHandler.strThreadName.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, std::ref(masternodeHandler))));
     
     // Initiate masternode connections
     threadOpenMasternodeConnections = std::thread(&TraceThread<std::function<void()> >, "mncon", std::function<void()>(std::bind(&CConnman::ThreadOpenMasternodeConnections, this)));
 
     // Dump network addresses
-    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000, CScheduler::PRIORITY_LOW, "address dump");
 
     return true;
 }
@@ -2457,11 +2708,13 @@ instance_of_cnetcleanup;
 
 void CConnman::Interrupt()
 {
-    {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    for (MessageHandler& handler : messageHandlers) {
+        {
+            std::lock_guard<std::mutex> lock(handler.mutexMsgProc);
+            flagInterruptMsgProc = true;
+        }
+        handler.condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2487,8 +2740,10 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (MessageHandler& handler : messageHandlers) {
+        if (handler.thread.joinable())
+            handler.thread.join();
+    }
     if (threadOpenMasternodeConnections.joinable())
         threadOpenMasternodeConnections.join();
     if (threadOpenConnections.joinable())
@@ -2500,6 +2755,14 @@ void CConnman::Stop()
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (nPollFd != -1) {
+        close(nPollFd);
+        nPollFd = -1;
+    }
+#endif
+    mapPollRegistrations.clear();
+
     if (fAddressesInitialized)
     {
         DumpData();
@@ -2573,7 +2836,15 @@ void CConnman::AddNewAddresses(const std::vector<CAddress>& vAddr, const CAddres
 
 std::vector<CAddress> CConnman::GetAddresses()
 {
-    return addrman.GetAddr();
+    // Every inbound peer asks once, serve them a recent snapshot instead of
+    // shuffling through addrman under its lock each time.
+    LOCK(cs_addrResponseCache);
+    int64_t nNow = GetTime();
+    if (nNow >= nAddrResponseCacheExpire) {
+        vAddrResponseCache = addrman.GetAddr();
+        nAddrResponseCacheExpire = nNow + ADDR_RESPONSE_CACHE_LIFETIME;
+    }
+    return vAddrResponseCache;
 }
 
 bool CConnman::AddNode(const std::string& strNode)
@@ -2660,10 +2931,30 @@ bool CConnman::DisconnectNode(NodeId id)
 }
 
 void CConnman::RelayInv(CInv &inv, const int minProtoVersion) {
+    LOCK(cs_vRelayInvQueue);
+    if (vRelayInvQueue.empty())
+        nRelayInvQueueSince = GetTimeMillis();
+    vRelayInvQueue.emplace_back(inv, minProtoVersion);
+}
+
+void CConnman::FlushRelayInv()
+{
+    std::vector<std::pair<CInv, int>> vInv;
+    {
+        LOCK(cs_vRelayInvQueue);
+        if (vRelayInvQueue.empty() || GetTimeMillis() < nRelayInvQueueSince + RELAY_INV_BATCH_INTERVAL)
+            return;
+        vInv.swap(vRelayInvQueue);
+    }
+
     LOCK(cs_vNodes);
-    for (const auto& pnode : vNodes)
-        if(pnode->nVersion >= minProtoVersion)
-            pnode->PushInventory(inv);
+    for (const auto& pnode : vNodes) {
+        LOCK(pnode->cs_inventory);
+        for (const auto& entry : vInv) {
+            if (pnode->nVersion >= entry.second)
+                pnode->PushInventory(entry.first);
+        }
+    }
 }
 
 void CConnman::RecordBytesRecv(uint64_t bytes)
@@ -2774,6 +3065,60 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+void CTimingHistogram::Add(int64_t nMicros)
+{
+    if (nMicros < 0) nMicros = 0;
+    int nBucket = 0;
+    while (nBucket < NUM_BUCKETS - 1 && (uint64_t)nMicros >= ((uint64_t)1 << nBucket))
+        nBucket++;
+    vBuckets[nBucket]++;
+    nCount++;
+    nTotalMicros += nMicros;
+    if ((uint64_t)nMicros > nMaxMicros) nMaxMicros = nMicros;
+}
+
+void CConnman::RecordMessageProcessed(CNode* pnode, const std::string& strCommand, int64_t nQueueMicros, int64_t nProcessMicros, bool fFailed)
+{
+    nQueueMicros = std::max<int64_t>(nQueueMicros, 0);
+    nProcessMicros = std::max<int64_t>(nProcessMicros, 0);
+    std::string strKey;
+    {
+        LOCK(pnode->cs_vRecv);
+        // Like the byte counts, keyed by the known commands only, so peers cannot grow the maps
+        strKey = pnode->mapRecvBytesPerMsgCmd.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+        CMsgCmdStats& stats = pnode->mapRecvStatsPerMsgCmd[strKey];
+        stats.nCount++;
+        stats.nFailed += fFailed;
+        stats.nProcessMicros += nProcessMicros;
+        stats.nMaxProcessMicros = std::max<uint64_t>(stats.nMaxProcessMicros, nProcessMicros);
+        stats.nQueueMicros += nQueueMicros;
+        stats.nMaxQueueMicros = std::max<uint64_t>(stats.nMaxQueueMicros, nQueueMicros);
+    }
+    LOCK(cs_msgTotals);
+    CMsgCmdTotals& totals = mapMsgTotals[strKey];
+    totals.nFailed += fFailed;
+    totals.processTime.Add(nProcessMicros);
+    totals.queueTime.Add(nQueueMicros);
+}
+
+void CConnman::RecordMessageDropped(CNode* pnode, const std::string& strCommand)
+{
+    std::string strKey;
+    {
+        LOCK(pnode->cs_vRecv);
+        strKey = pnode->mapRecvBytesPerMsgCmd.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+        pnode->mapRecvStatsPerMsgCmd[strKey].nDropped++;
+    }
+    LOCK(cs_msgTotals);
+    mapMsgTotals[strKey].nDropped++;
+}
+
+std::map<std::string, CMsgCmdTotals> CConnman::GetMessageTotals() const
+{
+    LOCK(cs_msgTotals);
+    return mapMsgTotals;
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2826,6 +3171,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSendingPriority = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2908,24 +3254,44 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg) : command(std::move(msg.command))
+{
+    hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    data = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+}
+
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    PushMessage(pnode, CSharedNetMsg(std::move(msg)));
+}
+
+/** Messages of the masternode overlay network, which are sent ahead of the other queued messages */
+static bool IsPriorityNetMsg(const std::string& command)
+{
+    return command == NetMsgType::TXLOCKREQUEST ||
+           command == NetMsgType::TXLOCKVOTE ||
+           command == NetMsgType::MNVERIFY;
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    CQueuedNetMsg queued;
+    queued.header.reserve(CMessageHeader::HEADER_SIZE);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    memcpy(hdr.pchChecksum, msg.hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, queued.header, 0, hdr};
+    if (nMessageSize)
+        queued.payload = msg.data;
 
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        bool optimisticSend(pnode->vSendMsg.empty() && pnode->vSendMsgPriority.empty());
 
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
@@ -2933,9 +3299,10 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        if (IsPriorityNetMsg(msg.command))
+            pnode->vSendMsgPriority.push_back(std::move(queued));
+        else
+            pnode->vSendMsg.push_back(std::move(queued));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
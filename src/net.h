@@ -22,8 +22,11 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <map>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -45,6 +48,8 @@ static const int TIMEOUT_INTERVAL = 20 * 60;
 static const int FEELER_INTERVAL = 120;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** How long inventory relayed with RelayInv is collected for before it is pushed to the peers together, in milliseconds */
+static const int64_t RELAY_INV_BATCH_INTERVAL = 100;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /**
@@ -89,6 +94,32 @@ static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** -msghandlerthreads default, a debug option: the masternode, payment and InstantSend handlers assume a single thread */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message processing threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+
+/** How the socket handler thread waits for network activity (-socketevents) */
+enum class SocketEventsMode {
+    SELECT, //!< select(), which can only handle sockets below FD_SETSIZE
+    EPOLL,  //!< epoll on Linux
+    KQUEUE, //!< kqueue on BSD and macOS
+};
+
+/** -socketevents default, the event-driven backend where there is one */
+#if defined(USE_EPOLL)
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#elif defined(USE_KQUEUE)
+static const char* const DEFAULT_SOCKETEVENTS = "kqueue";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/** Parse a -socketevents value, failing for modes this build does not support */
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode);
+/** Comma-separated list of the -socketevents modes this build supports */
+std::string SupportedSocketEventsModes();
+
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
@@ -118,6 +149,68 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * A serialized message whose payload can be queued for several peers without
+ * copying it, e.g. a block many peers ask for.
+ */
+struct CSharedNetMsg
+{
+    CSharedNetMsg() = default;
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string command;
+    //! Hash of data, the message header checksum is taken from
+    uint256 hash;
+};
+
+/** A message waiting in a CNode send queue */
+struct CQueuedNetMsg
+{
+    std::vector<unsigned char> header;
+    //! Null for messages without a payload
+    std::shared_ptr<const std::vector<unsigned char>> payload;
+
+    size_t size() const { return header.size() + (payload ? payload->size() : 0); }
+};
+
+/** Processing times of one message type, in power of two microsecond buckets */
+class CTimingHistogram
+{
+public:
+    /// Bucket i counts times below 2^i microseconds, the last one everything slower
+    static const int NUM_BUCKETS = 24;
+
+    uint64_t nCount{0};
+    uint64_t nTotalMicros{0};
+    uint64_t nMaxMicros{0};
+    uint64_t vBuckets[NUM_BUCKETS] = {};
+
+    void Add(int64_t nMicros);
+};
+
+/** How the messages of one type received from a peer were handled */
+struct CMsgCmdStats
+{
+    uint64_t nCount{0};             //!< Messages processed
+    uint64_t nFailed{0};            //!< Processed messages that were rejected or failed to parse
+    uint64_t nDropped{0};           //!< Messages discarded unprocessed, for a bad header or checksum
+    uint64_t nProcessMicros{0};     //!< Total time spent processing
+    uint64_t nMaxProcessMicros{0};
+    uint64_t nQueueMicros{0};       //!< Total time between receiving and processing
+    uint64_t nMaxQueueMicros{0};
+};
+typedef std::map<std::string, CMsgCmdStats> mapMsgCmdStats;
+
+/** The messages of one type received from all peers since startup */
+struct CMsgCmdTotals
+{
+    uint64_t nFailed{0};
+    uint64_t nDropped{0};
+    CTimingHistogram processTime;
+    CTimingHistogram queueTime;
+};
+
 class NetEventsInterface;
 class CConnman
 {
@@ -150,6 +243,8 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
     };
 
     void Init(const Options& connOptions) {
@@ -169,6 +264,8 @@ public:
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         }
         vWhitelistedRange = connOptions.vWhitelistedRange;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
         {
             LOCK(cs_vAddedNodes);
             vAddedNodes = connOptions.m_added_nodes;
@@ -225,6 +322,7 @@ public:
     bool IsMasternodeOrDisconnectRequested(const CService& addr);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
     
     template<typename Condition, typename Callable>
     bool ForEachNodeContinueIf(const Condition& cond, Callable&& func)
@@ -330,6 +428,7 @@ public:
     std::vector<CNode*> CopyNodeVector();
     void ReleaseNodeVector(const std::vector<CNode*>& vecNodes);
     
+    /** Queue inv for the peers of at least minProtoVersion, see FlushRelayInv */
     void RelayInv(CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
 
     // Addrman functions
@@ -413,6 +512,12 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    /** Account a message received from pnode that was processed */
+    void RecordMessageProcessed(CNode* pnode, const std::string& strCommand, int64_t nQueueMicros, int64_t nProcessMicros, bool fFailed);
+    /** Account a message received from pnode that was discarded without processing it */
+    void RecordMessageDropped(CNode* pnode, const std::string& strCommand);
+    std::map<std::string, CMsgCmdTotals> GetMessageTotals() const;
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -421,7 +526,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message processing threads */
     void WakeMessageHandler();
+    /** Wake the message processing thread of a peer */
+    void WakeMessageHandler(const CNode* pnode);
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -430,6 +538,21 @@ private:
         ListenSocket(SOCKET socket_, bool whitelisted_) : socket(socket_), whitelisted(whitelisted_) {}
     };
 
+    /**
+     * A message processing thread. Peers are sharded across them by id, so the
+     * messages of each peer are still processed one at a time and in order.
+     */
+    struct MessageHandler {
+        std::string strThreadName;
+        std::thread thread;
+
+        /** flag for waking the message processor. */
+        bool fMsgProcWake = false;
+
+        std::condition_variable condMsgProc;
+        std::mutex mutexMsgProc;
+    };
+
     bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
     bool Bind(const CService &addr, unsigned int flags);
     bool InitBinds(const std::vector<CService>& binds, const std::vector<CService>& whiteBinds);
@@ -437,8 +560,33 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    MessageHandler& GetMessageHandler(const CNode* pnode);
+    void ThreadMessageHandler(MessageHandler& handler);
+    /**
+     * Push the inventory queued by RelayInv to the peers, once it was
+     * collected for RELAY_INV_BATCH_INTERVAL: every peer is locked once for
+     * all of it, rather than all peers for every item.
+     */
+    void FlushRelayInv();
     void AcceptConnection(const ListenSocket& hListenSocket);
+
+    /** What the socket handler waits for on one socket */
+    struct SocketInterest {
+        NodeId owner; //!< node the socket belongs to, -1 for listening sockets
+        bool fRecv;
+        bool fSend;
+    };
+
+    void GenerateSelectSet(std::map<SOCKET, SocketInterest>& interest);
+    /** Wait for network activity and return the sockets that are ready */
+    void SocketEvents(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+    void SocketEventsSelect(const std::map<SOCKET, SocketInterest>& interest, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    /** Bring the sockets registered with nPollFd in line with what the socket handler waits for */
+    void UpdatePollRegistrations(const std::map<SOCKET, SocketInterest>& interest);
+    void UpdatePollRegistration(SOCKET hSocket, const SocketInterest* pold, const SocketInterest* pnew);
+    void SocketEventsPoller(const std::map<SOCKET, SocketInterest>& interest, std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
     void ThreadOpenMasternodeConnections();
@@ -480,6 +628,10 @@ private:
     CCriticalSection cs_totalBytesRecv;
     CCriticalSection cs_totalBytesSent;
     uint64_t nTotalBytesRecv GUARDED_BY(cs_totalBytesRecv);
+    //! Inventory queued by RelayInv, with the protocol version the peers need
+    std::vector<std::pair<CInv, int>> vRelayInvQueue GUARDED_BY(cs_vRelayInvQueue);
+    int64_t nRelayInvQueueSince GUARDED_BY(cs_vRelayInvQueue);
+    CCriticalSection cs_vRelayInvQueue;
     uint64_t nTotalBytesSent GUARDED_BY(cs_totalBytesSent);
 
     // outbound limit & stats
@@ -488,6 +640,10 @@ private:
     uint64_t nMaxOutboundLimit GUARDED_BY(cs_totalBytesSent);
     uint64_t nMaxOutboundTimeframe GUARDED_BY(cs_totalBytesSent);
 
+    // Message processing totals, per command
+    mutable CCriticalSection cs_msgTotals;
+    std::map<std::string, CMsgCmdTotals> mapMsgTotals GUARDED_BY(cs_msgTotals);
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<CSubNet> vWhitelistedRange;
@@ -496,12 +652,23 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    SocketEventsMode socketEventsMode;
+    //! epoll or kqueue descriptor when socketEventsMode uses one, only used by the socket handler thread
+    int nPollFd;
+    //! What each socket is registered with nPollFd for
+    std::map<SOCKET, SocketInterest> mapPollRegistrations;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
     CAddrMan addrman;
+    //! addrman.GetModificationCount() as of the last load or write of peers.dat
+    uint64_t nAddrmanModificationsDumped;
+    //! Snapshot of addrman.GetAddr() answering getaddr requests, see GetAddresses
+    std::vector<CAddress> vAddrResponseCache GUARDED_BY(cs_addrResponseCache);
+    int64_t nAddrResponseCacheExpire GUARDED_BY(cs_addrResponseCache);
+    CCriticalSection cs_addrResponseCache;
     std::deque<std::string> vOneShots;
     CCriticalSection cs_vOneShots;
     std::vector<std::string> vAddedNodes GUARDED_BY(cs_vAddedNodes);
@@ -530,11 +697,15 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
-
-    std::condition_variable condMsgProc;
-    std::mutex mutexMsgProc;
+    /**
+     * The first nMessageHandlerThreads process the messages of ordinary peers,
+     * the last one those of our masternode connections, so verification and
+     * InstantSend traffic does not wait behind block and transaction
+     * processing. Only those are started, all exist so they can be woken up at
+     * any time.
+     */
+    std::array<MessageHandler, MAX_MSGHANDLER_THREADS + 1> messageHandlers;
+    int nMessageHandlerThreads;
     std::atomic<bool> flagInterruptMsgProc;
 
     CThreadInterrupt interruptNet;
@@ -544,7 +715,6 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadOpenMasternodeConnections;
-    std::thread threadMessageHandler;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -653,6 +823,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdStats mapRecvStatsPerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -720,10 +891,15 @@ public:
     // socket
     std::atomic<ServiceFlags> nServices;
     SOCKET hSocket;
-    size_t nSendSize; // total size of all vSendMsg entries
-    size_t nSendOffset; // offset inside the first vSendMsg already sent
+    size_t nSendSize; // total size of all vSendMsg and vSendMsgPriority entries
+    size_t nSendOffset; // offset inside the message being sent already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    //! Messages waiting to be sent, payloads may be shared with other peers
+    std::deque<CQueuedNetMsg> vSendMsg;
+    //! Masternode overlay messages, sent ahead of vSendMsg once the message being sent is complete
+    std::deque<CQueuedNetMsg> vSendMsgPriority;
+    //! Whether the message being sent is the front of vSendMsgPriority
+    bool fSendingPriority;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -782,12 +958,16 @@ protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    //! Processing of the messages received, per command, protected by cs_vRecv
+    mapMsgCmdStats mapRecvStatsPerMsgCmd;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    //! Protects vAddrToSend and addrKnown, which the message processing of other peers adds to
+    CCriticalSection cs_vAddrToSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -797,9 +977,6 @@ public:
 
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
-    // Set of transaction ids we still have to announce.
-    // They are sorted by the mempool before relay, so the order is not important.
-    std::set<uint256> setInventoryTxToSend;
     // List of block ids we still have announce.
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
@@ -912,11 +1089,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -941,13 +1120,11 @@ public:
     void PushInventory(const CInv& inv)
     {
         LOCK(cs_inventory);
-        if (inv.type == MSG_TX) {
-            if (!filterInventoryKnown.contains(inv.hash)) {
-                setInventoryTxToSend.insert(inv.hash);
-            }
-        } else if (inv.type == MSG_BLOCK) {
+        if (inv.type == MSG_BLOCK) {
             vInventoryBlockToSend.push_back(inv.hash);
-        } else {
+        } else if (inv.type != MSG_TX || !filterInventoryKnown.contains(inv.hash)) {
+            // Relayed transactions are queued for all peers at once by
+            // net_processing, a transaction pushed here goes out as it is.
             vInventoryOtherToSend.push_back(inv);
         }
     }
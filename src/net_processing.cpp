@@ -12,6 +12,7 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <globaltoken/hardfork.h>
+#include <globaltoken/multihasher.h>
 #include <hash.h>
 #include <init.h>
 #include <validation.h>
@@ -35,6 +36,7 @@
 #include <spork.h>
 #include <instantx.h>
 #include <masternode-payments.h>
+#include <masternode-stats.h>
 #include <masternode-sync.h>
 #include <masternodeman.h>
 
@@ -120,6 +122,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        bool fStolen;                                            //!< Whether we took this block over from a peer stalling the download.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -135,6 +138,9 @@ namespace {
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect = 0;
 
+    /** Lowest height below the chainstate snapshot base whose block was not received yet, protected by cs_main */
+    int nHistoryMissingHeight = 0;
+
     /** When our tip was last updated. */
     std::atomic<int64_t> g_last_tip_update(0);
 
@@ -143,6 +149,124 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /**
+     * The transactions to announce, for all peers at once. Every relayed
+     * transaction gets the next sequence number, and every peer has a cursor:
+     * the transactions after it are the ones still to announce to the peer.
+     * All peers announce them in the same mempool order, which is only sorted
+     * again once more transactions were relayed, instead of sorting their own
+     * inventory at each of their trickles.
+     */
+    class CTxRelayQueue
+    {
+    public:
+        /** Transactions in mempool order with their sequence numbers, and the last number relayed when sorted */
+        struct Sorted
+        {
+            std::vector<std::pair<uint256, uint64_t>> vTxs;
+            uint64_t nLastSeq = 0;
+        };
+
+        /** Add a transaction, to be announced again to the peers that announced it already */
+        void Push(const uint256& hash)
+        {
+            LOCK(cs);
+            mapSeq[hash] = ++nLastSeq;
+            fSorted = false;
+        }
+
+        /** A new peer, which is only announced transactions relayed from now on */
+        void AddPeer(NodeId nodeid)
+        {
+            LOCK(cs);
+            mapCursors[nodeid] = nLastSeq;
+        }
+
+        void RemovePeer(NodeId nodeid)
+        {
+            LOCK(cs);
+            mapCursors.erase(nodeid);
+        }
+
+        uint64_t GetCursor(NodeId nodeid)
+        {
+            LOCK(cs);
+            auto it = mapCursors.find(nodeid);
+            return it != mapCursors.end() ? it->second : nLastSeq;
+        }
+
+        /** Announce nothing relayed until now to the peer */
+        void SkipAll(NodeId nodeid)
+        {
+            LOCK(cs);
+            SetCursor(nodeid, nLastSeq);
+        }
+
+        /** Mark everything up to nSeq as announced to the peer */
+        void SetCursor(NodeId nodeid, uint64_t nSeq)
+        {
+            LOCK(cs);
+            auto it = mapCursors.find(nodeid);
+            if (it != mapCursors.end())
+                it->second = std::max(it->second, nSeq);
+        }
+
+        /**
+         * The transactions still to announce to some peer, in mempool order.
+         * Ones all peers are past and ones that left the mempool are dropped
+         * when sorting.
+         */
+        std::shared_ptr<const Sorted> GetSorted(const CTxMemPool& pool)
+        {
+            std::vector<uint256> vHashes;
+            uint64_t nSortedSeq;
+            {
+                LOCK(cs);
+                if (fSorted)
+                    return sorted;
+                uint64_t nMinCursor = nLastSeq;
+                for (const auto& entry : mapCursors) {
+                    nMinCursor = std::min(nMinCursor, entry.second);
+                }
+                for (auto it = mapSeq.begin(); it != mapSeq.end();) {
+                    if (it->second <= nMinCursor) {
+                        it = mapSeq.erase(it);
+                    } else {
+                        vHashes.push_back(it->first);
+                        ++it;
+                    }
+                }
+                nSortedSeq = nLastSeq;
+                fSorted = true;
+            }
+
+            // Sorted without cs, the mempool lock is taken while holding it elsewhere
+            pool.SortByDepthAndScore(vHashes);
+
+            std::shared_ptr<Sorted> newSorted = std::make_shared<Sorted>();
+            newSorted->nLastSeq = nSortedSeq;
+            newSorted->vTxs.reserve(vHashes.size());
+            LOCK(cs);
+            for (const uint256& hash : vHashes) {
+                // pushed again meanwhile, or dropped by another sort
+                auto it = mapSeq.find(hash);
+                if (it != mapSeq.end() && it->second <= nSortedSeq)
+                    newSorted->vTxs.emplace_back(hash, it->second);
+            }
+            sorted = newSorted;
+            return sorted;
+        }
+
+    private:
+        CCriticalSection cs;
+        uint64_t nLastSeq = 0;
+        std::map<uint256, uint64_t> mapSeq;
+        std::map<NodeId, uint64_t> mapCursors;
+        bool fSorted = true;
+        std::shared_ptr<const Sorted> sorted = std::make_shared<Sorted>();
+    };
+    CTxRelayQueue txRelayQueue;
 } // namespace
 
 namespace {
@@ -193,6 +317,8 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time between blocks arriving while we wait for some from this peer (in microseconds), or 0.
+    int64_t nAvgBlockIntervalUsec;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -260,6 +386,7 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nAvgBlockIntervalUsec = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -360,7 +487,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), false});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -376,6 +503,36 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     return true;
 }
 
+// Requires cs_main.
+// Called before MarkBlockAsReceived for a block a peer sent us, to measure how fast it delivers.
+void UpdateBlockDownloadSpeed(NodeId nodeid, const uint256& hash) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    // nDownloadingSince is when the previous block arrived, or when we started
+    // waiting for this peer, so time it spent idle is not counted.
+    int64_t nInterval = std::max<int64_t>(GetTimeMicros() - state->nDownloadingSince, 1);
+    if (state->nAvgBlockIntervalUsec == 0)
+        state->nAvgBlockIntervalUsec = nInterval;
+    else
+        state->nAvgBlockIntervalUsec = (state->nAvgBlockIntervalUsec * 7 + nInterval) / 8;
+}
+
+/**
+ * Number of blocks to keep in flight from a peer: enough for two round trips
+ * at the rate it delivers them, so the download is limited by its bandwidth
+ * rather than by waiting for our next getdata. A peer limited by the window is
+ * measured to deliver faster as the window grows, so it keeps growing until
+ * the link is busy.
+ */
+int GetMaxBlocksInTransit(const CNodeState& state, int64_t nPingUsec) {
+    if (state.nAvgBlockIntervalUsec == 0 || nPingUsec <= 0 || nPingUsec == std::numeric_limits<int64_t>::max())
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nBlocks = 2 * nPingUsec / state.nAvgBlockIntervalUsec + 1;
+    return std::max<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(nBlocks, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -454,6 +611,8 @@ bool TipMayBeStale(const Consensus::Params &consensusParams)
 // Requires cs_main
 bool CanDirectFetch(const Consensus::Params &consensusParams)
 {
+    if (fHeadersOnly)
+        return false;
     return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.nPowTargetSpacing * 20;
 }
 
@@ -469,7 +628,7 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -505,6 +664,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -531,7 +691,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 return;
             }
             if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
-                if (pindex->nChainTx)
+                // The history of a chainstate snapshot is linked once it was received, the active chain is ours before
+                if (pindex->nChainTx || chainActive.Contains(pindex))
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
@@ -540,6 +701,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -550,11 +712,39 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
 }
 
+/**
+ * Add up to count blocks below the base of a chainstate snapshot, which the
+ * active chain starts with without having them, to vBlocks. They are taken
+ * in order from the lowest one still missing, for the validation of the
+ * snapshot's history, and only from peers whose best chain has the base.
+ */
+void FindHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, const Consensus::Params& consensusParams) {
+    if (count == 0 || pindexSnapshotBase == nullptr || fSnapshotValidated)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    if (state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(pindexSnapshotBase->nHeight) != pindexSnapshotBase)
+        return;
+
+    while (nHistoryMissingHeight <= pindexSnapshotBase->nHeight && (chainActive[nHistoryMissingHeight]->nStatus & BLOCK_HAVE_DATA))
+        nHistoryMissingHeight++;
+    const int nWindowEnd = std::min<int>(pindexSnapshotBase->nHeight, nHistoryMissingHeight + BLOCK_DOWNLOAD_WINDOW);
+    for (int nHeight = nHistoryMissingHeight; nHeight <= nWindowEnd && vBlocks.size() < count; nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!state->fHaveWitness && IsWitnessEnabled(pindex->pprev, consensusParams))
+            return;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0)
+            vBlocks.push_back(pindex);
+    }
+}
+
 } // namespace
 
 // This function is used for testing the stale tip eviction logic, see
@@ -581,12 +771,14 @@ void PeerLogicValidation::InitializeNode(CNode *pnode) {
         LOCK(cs_main);
         mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName)));
     }
+    txRelayQueue.AddPeer(nodeid);
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
 }
 
 void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     fUpdateConnectionTime = false;
+    txRelayQueue.RemovePeer(nodeid);
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
     assert(state != nullptr);
@@ -813,7 +1005,7 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
     // combine them in one function and schedule at the quicker (peer-eviction)
     // timer.
     static_assert(EXTRA_PEER_CHECK_INTERVAL < STALE_CHECK_INTERVAL, "peer eviction timer should be less than stale tip check timer");
-    scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
+    scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000, CScheduler::PRIORITY_NORMAL, "stale tip check");
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -855,6 +1047,40 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
 
+/**
+ * Messages announcing the latest block, by command and serialization
+ * version. Every peer the block is announced to the same way gets the same
+ * payload, serialized once, instead of one of its own. Replaced when another
+ * block is announced. Protected by cs_announcement_msgs.
+ */
+static CCriticalSection cs_announcement_msgs;
+static uint256 announcement_msgs_hash;
+static std::map<std::pair<std::string, int>, CSharedNetMsg> announcement_msgs;
+
+/** The message announcing the block hashBlock, built by make unless another peer got it already */
+static CSharedNetMsg GetAnnouncementMsg(const uint256& hashBlock, const std::string& strCommand, int nVersion, const std::function<CSerializedNetMsg()>& make)
+{
+    const std::pair<std::string, int> key(strCommand, nVersion);
+    {
+        LOCK(cs_announcement_msgs);
+        if (announcement_msgs_hash == hashBlock) {
+            auto it = announcement_msgs.find(key);
+            if (it != announcement_msgs.end())
+                return it->second;
+        }
+    }
+
+    // Built without the lock, make may take others
+    CSharedNetMsg msg(make());
+    LOCK(cs_announcement_msgs);
+    if (announcement_msgs_hash != hashBlock) {
+        announcement_msgs.clear();
+        announcement_msgs_hash = hashBlock;
+    }
+    announcement_msgs.emplace(key, msg);
+    return msg;
+}
+
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
@@ -878,7 +1104,6 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
     }
 
     connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -890,7 +1115,9 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, GetAnnouncementMsg(hashBlock, NetMsgType::CMPCTBLOCK, PROTOCOL_VERSION, [&msgMaker, &pcmpctblock] {
+                return msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock);
+            }));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1042,9 +1269,12 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     uint256 hash = tx.GetHash();
-    int nInv = instantsend.HasTxLockRequest(hash) ? MSG_TXLOCK_REQUEST : MSG_TX;
-    CInv inv(nInv, hash);
-    
+    if (!instantsend.HasTxLockRequest(hash)) {
+        txRelayQueue.Push(hash);
+        return;
+    }
+    CInv inv(MSG_TXLOCK_REQUEST, hash);
+
     connman->ForEachNode([&inv](CNode* pnode)
     {
         pnode->PushInventory(inv);
@@ -1092,6 +1322,144 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connma
     connman->ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/** Maximum total payload size of the blocks kept in recent_block_msgs */
+static const size_t MAX_RECENT_BLOCK_MSGS_SIZE = 16 * 1000 * 1000;
+
+/**
+ * Block messages (with witness) recently sent to peers, most recently used
+ * first. A block around the tip is usually requested by many peers in a row,
+ * this way it is read and hashed once and the same payload is queued for all
+ * of them. Protected by cs_recent_block_msgs.
+ */
+static CCriticalSection cs_recent_block_msgs;
+static std::list<std::pair<uint256, CSharedNetMsg>> recent_block_msgs;
+static size_t recent_block_msgs_size = 0;
+
+/** The block message of a witness block, cached or read from disk as it is stored */
+static bool GetWitnessBlockMsg(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& a_recent_block, CSharedNetMsg& msg)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_recent_block_msgs);
+        for (auto it = recent_block_msgs.begin(); it != recent_block_msgs.end(); ++it) {
+            if (it->first == hash) {
+                recent_block_msgs.splice(recent_block_msgs.begin(), recent_block_msgs, it);
+                msg = it->second;
+                return true;
+            }
+        }
+    }
+
+    CSerializedNetMsg serialized;
+    if (a_recent_block && a_recent_block->GetHash() == hash) {
+        serialized = CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, *a_recent_block);
+    } else {
+        // Blocks are stored with their witness, just like this message wants them
+        serialized.command = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(serialized.data, pindex, Params().MessageStart()))
+            return false;
+    }
+    msg = CSharedNetMsg(std::move(serialized));
+
+    LOCK(cs_recent_block_msgs);
+    for (const auto& entry : recent_block_msgs) {
+        if (entry.first == hash)
+            return true;
+    }
+    recent_block_msgs.emplace_front(hash, msg);
+    recent_block_msgs_size += msg.data->size();
+    while (recent_block_msgs_size > MAX_RECENT_BLOCK_MSGS_SIZE && recent_block_msgs.size() > 1) {
+        recent_block_msgs_size -= recent_block_msgs.back().second.data->size();
+        recent_block_msgs.pop_back();
+    }
+    return true;
+}
+
+/** Number of blocks kept in recent_filtered_blocks */
+static const size_t MAX_RECENT_FILTERED_BLOCKS = 8;
+
+/** A block served as a merkleblock, with the script data elements its transactions are matched by */
+struct RecentFilteredBlock
+{
+    std::shared_ptr<const CBlock> block;
+    std::vector<CBloomTxElements> elements;
+};
+
+/**
+ * Blocks recently served as merkleblocks, most recently used first. SPV peers
+ * syncing ask for the same blocks, this way a block is read and its scripts
+ * are parsed once for the filters of all of them. Protected by
+ * cs_recent_filtered_blocks.
+ */
+static CCriticalSection cs_recent_filtered_blocks;
+static std::list<std::pair<uint256, std::shared_ptr<const RecentFilteredBlock>>> recent_filtered_blocks;
+
+static std::shared_ptr<const RecentFilteredBlock> GetRecentFilteredBlock(const uint256& hash)
+{
+    LOCK(cs_recent_filtered_blocks);
+    for (auto it = recent_filtered_blocks.begin(); it != recent_filtered_blocks.end(); ++it) {
+        if (it->first == hash) {
+            recent_filtered_blocks.splice(recent_filtered_blocks.begin(), recent_filtered_blocks, it);
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+static std::shared_ptr<const RecentFilteredBlock> AddRecentFilteredBlock(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    std::shared_ptr<RecentFilteredBlock> filtered_block = std::make_shared<RecentFilteredBlock>();
+    filtered_block->block = pblock;
+    filtered_block->elements.reserve(pblock->vtx.size());
+    for (const CTransactionRef& tx : pblock->vtx)
+        filtered_block->elements.emplace_back(*tx);
+
+    LOCK(cs_recent_filtered_blocks);
+    for (const auto& entry : recent_filtered_blocks) {
+        if (entry.first == hash)
+            return entry.second;
+    }
+    recent_filtered_blocks.emplace_front(hash, filtered_block);
+    if (recent_filtered_blocks.size() > MAX_RECENT_FILTERED_BLOCKS)
+        recent_filtered_blocks.pop_back();
+    return filtered_block;
+}
+
+/** Send headers as "cmpcthdrs" to peers that know it, as "headers" to the others */
+static void PushHeaders(CNode* pnode, const std::vector<CBlock>& vHeaders, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    if (pnode->nVersion >= COMPRESSED_HEADERS_VERSION) {
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTHEADERS, CCompressedHeaders<CBlock>(vHeaders)));
+    } else {
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+    }
+}
+
+/**
+ * Announce the blocks to a peer by their headers, like PushHeaders. The
+ * announcement of a single block, the usual one, is made once for all peers.
+ */
+static void AnnounceHeaders(CNode* pnode, const std::vector<const CBlockIndex*>& vIndexes, const Consensus::Params& consensusParams, CConnman* connman)
+{
+    if (vIndexes.size() == 1) {
+        const bool fCompressed = pnode->nVersion >= COMPRESSED_HEADERS_VERSION;
+        const int nSendVersion = pnode->GetSendVersion();
+        connman->PushMessage(pnode, GetAnnouncementMsg(vIndexes[0]->GetBlockHash(), fCompressed ? NetMsgType::CMPCTHEADERS : NetMsgType::HEADERS, nSendVersion, [&] {
+            const std::vector<CBlock> vHeaders(1, vIndexes[0]->GetBlockHeader(consensusParams));
+            const CNetMsgMaker msgMaker(nSendVersion);
+            return fCompressed ? msgMaker.Make(NetMsgType::CMPCTHEADERS, CCompressedHeaders<CBlock>(vHeaders)) : msgMaker.Make(NetMsgType::HEADERS, vHeaders);
+        }));
+        return;
+    }
+
+    std::vector<CBlock> vHeaders;
+    for (const CBlockIndex* pindex : vIndexes) {
+        vHeaders.push_back(pindex->GetBlockHeader(consensusParams));
+    }
+    PushHeaders(pnode, vHeaders, connman);
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensusParams, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     bool send = false;
@@ -1161,11 +1529,17 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
+        std::shared_ptr<const RecentFilteredBlock> filtered_block;
+        if (inv.type == MSG_FILTERED_BLOCK)
+            filtered_block = GetRecentFilteredBlock((*mi).second->GetBlockHash());
+        if (filtered_block) {
+            pblock = filtered_block->block;
+        } else if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
-        } else {
-            // Send block from disk
+        } else if (inv.type != MSG_WITNESS_BLOCK) {
+            // Send block from disk, witness blocks are sent as stored by GetWitnessBlockMsg
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            CBlockArenaScope arena;
             if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
@@ -1173,7 +1547,12 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
         if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         else if (inv.type == MSG_WITNESS_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        {
+            CSharedNetMsg msg;
+            if (!GetWitnessBlockMsg(mi->second, a_recent_block, msg))
+                assert(!"cannot load block from disk");
+            connman->PushMessage(pfrom, msg);
+        }
         else if (inv.type == MSG_FILTERED_BLOCK)
         {
             bool sendMerkleBlock = false;
@@ -1182,7 +1561,9 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
                 LOCK(pfrom->cs_filter);
                 if (pfrom->pfilter) {
                     sendMerkleBlock = true;
-                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
+                    if (!filtered_block)
+                        filtered_block = AddRecentFilteredBlock((*mi).second->GetBlockHash(), pblock);
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter, filtered_block->elements);
                 }
             }
             if (sendMerkleBlock) {
@@ -1208,12 +1589,21 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             // instead we respond with the full, non-compact block.
             bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
             int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            // A peer asking for a compact block usually got the header from us
+            // or announced it, so it does not need the auxpow or the Equihash
+            // solution again.
+            bool fSendHeaderRef = pfrom->nVersion >= COMPACT_BLOCK_REF_VERSION && PeerHasHeader(State(pfrom->GetId()), mi->second);
             if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock;
                 if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                    pcmpctblock = a_recent_compact_block;
+                } else {
+                    pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock, fPeerWantsWitness);
+                }
+                if (fSendHeaderRef) {
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTREF, CBlockHeaderRefAndShortTxIDs(*pcmpctblock)));
                 } else {
-                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *pcmpctblock));
                 }
             } else {
                 connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
@@ -2228,7 +2618,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        PushHeaders(pfrom, vHeaders, connman);
     }
 
 
@@ -2459,10 +2849,30 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
-    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    else if ((strCommand == NetMsgType::CMPCTBLOCK || strCommand == NetMsgType::CMPCTREF) && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlockHeaderAndShortTxIDs cmpctblock;
-        vRecv >> cmpctblock;
+        if (strCommand == NetMsgType::CMPCTREF) {
+            CBlockHeaderRefAndShortTxIDs cmpctref(cmpctblock);
+            vRecv >> cmpctref;
+
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(cmpctref.blockhash);
+            CBlockHeader header;
+            if (mi != mapBlockIndex.end())
+                header = mi->second->GetBlockHeader(chainparams.GetConsensus());
+            if (header.IsNull() || (header.IsAuxpow() && !header.auxpow) || header.GetHash() != cmpctref.blockhash) {
+                // We do not have the header (anymore), or lost its auxpow, ask for the whole block instead
+                LogPrint(BCLog::NET, "Peer %d sent us cmpctref for block %s whose header we do not have\n", pfrom->GetId(), cmpctref.blockhash.ToString());
+                uint32_t nFetchFlags = GetFetchFlags(pfrom);
+                std::vector<CInv> vInv(1, CInv(MSG_BLOCK | nFetchFlags, cmpctref.blockhash));
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vInv));
+                return true;
+            }
+            cmpctblock.SetHeader(header);
+        } else {
+            vRecv >> cmpctblock;
+        }
 
         bool received_new_header = false;
 
@@ -2755,21 +3165,30 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
+    else if ((strCommand == NetMsgType::HEADERS || strCommand == NetMsgType::CMPCTHEADERS) && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
-        // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
-        unsigned int nCount = ReadCompactSize(vRecv);
+        uint64_t nCount;
+        if (strCommand == NetMsgType::CMPCTHEADERS) {
+            CCompressedHeaders<CBlockHeader> compressedHeaders(headers, MAX_HEADERS_RESULTS);
+            vRecv >> compressedHeaders;
+            nCount = compressedHeaders.nCount;
+        } else {
+            // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
+            nCount = ReadCompactSize(vRecv);
+        }
         if (nCount > MAX_HEADERS_RESULTS) {
             LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20, strprintf("headers message size = %u", nCount));
             return false;
         }
-        headers.resize(nCount);
-        for (unsigned int n = 0; n < nCount; n++) {
-            vRecv >> headers[n];
-            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+        if (strCommand == NetMsgType::HEADERS) {
+            headers.resize(nCount);
+            for (unsigned int n = 0; n < nCount; n++) {
+                vRecv >> headers[n];
+                ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+            }
         }
 
         // Headers received via a HEADERS message should be valid, and reflect
@@ -2783,14 +3202,24 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-        vRecv >> *pblock;
+        {
+            CBlockArenaScope arena;
+            vRecv >> *pblock;
+        }
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
 
+        if (fHeadersOnly) {
+            // We never ask for blocks, but an unsolicited one still announces its header.
+            bool should_punish = !pfrom->fInbound && !pfrom->m_manual_connection;
+            return ProcessHeadersMessage(pfrom, connman, {pblock->GetBlockHeader()}, chainparams, should_punish);
+        }
+
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            UpdateBlockDownloadSpeed(pfrom->GetId(), hash);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -2829,9 +3258,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
+        LOCK(pfrom->cs_vAddrToSend);
+        pfrom->vAddrToSend.clear();
         for (const CAddress &addr : vAddr)
             pfrom->PushAddress(addr, insecure_rand);
     }
@@ -3073,6 +3503,7 @@ static bool SendRejectsAndCheckIfBanned(CNode* pnode, CConnman* connman)
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
+    CHashPurposeScope hashPurpose(HashPurpose::HEADER_SYNC);
     //
     // Message format
     //  (4) message start
@@ -3122,6 +3553,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (!hdr.IsValid(chainparams.MessageStart()))
     {
         LogPrint(BCLog::NET, "PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d\n", SanitizeString(hdr.GetCommand()), pfrom->GetId());
+        connman->RecordMessageDropped(pfrom, hdr.GetCommand());
         return fMoreWork;
     }
     std::string strCommand = hdr.GetCommand();
@@ -3138,14 +3570,17 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
            SanitizeString(strCommand), nMessageSize,
            HexStr(hash.begin(), hash.begin()+CMessageHeader::CHECKSUM_SIZE),
            HexStr(hdr.pchChecksum, hdr.pchChecksum+CMessageHeader::CHECKSUM_SIZE));
+        connman->RecordMessageDropped(pfrom, strCommand);
         return fMoreWork;
     }
 
     // Process message
     bool fRet = false;
+    int64_t nTimeStart = GetTimeMicros();
     try
     {
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        mnmsgstats.Add(strCommand, GetTimeMicros() - nTimeStart);
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3180,6 +3615,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
 
+    connman->RecordMessageProcessed(pfrom, strCommand, nTimeStart - msg.nTime, GetTimeMicros() - nTimeStart, !fRet);
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->GetId());
     }
@@ -3320,23 +3756,6 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
     }
 }
 
-class CompareInvMempoolOrder
-{
-    CTxMemPool *mp;
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-
 bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptMsgProc)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -3397,6 +3816,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3466,7 +3886,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             // blocks, or if the peer doesn't want headers, just
             // add all to the inv queue.
             LOCK(pto->cs_inventory);
-            std::vector<CBlock> vHeaders;
+            std::vector<const CBlockIndex*> vHeaders;
             bool fRevertToInv = ((!state.fPreferHeaders &&
                                  (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
                                 pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
@@ -3505,14 +3925,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     pBestIndex = pindex;
                     if (fFoundStartingHeader) {
                         // add this to the headers message
-                        vHeaders.push_back(pindex->GetBlockHeader(consensusParams));
+                        vHeaders.push_back(pindex);
                     } else if (PeerHasHeader(&state, pindex)) {
                         continue; // keep looking for the first new block
                     } else if (pindex->pprev == nullptr || PeerHasHeader(&state, pindex->pprev)) {
                         // Peer doesn't have this header but they do have the prior one.
                         // Start sending headers.
                         fFoundStartingHeader = true;
-                        vHeaders.push_back(pindex->GetBlockHeader(consensusParams));
+                        vHeaders.push_back(pindex);
                     } else {
                         // Peer doesn't have this header or the prior one -- nothing will
                         // connect, so bail out.
@@ -3526,42 +3946,44 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     // We only send up to 1 block as header-and-ids, as otherwise
                     // probably means we're doing an initial-ish-sync or they're slow
                     LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", __func__,
-                            vHeaders.front().GetHash().ToString(), pto->GetId());
+                            pBestIndex->GetBlockHash().ToString(), pto->GetId());
 
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
 
-                    bool fGotBlockFromCache = false;
+                    std::shared_ptr<const CBlock> a_recent_block;
+                    std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+                    bool fWitnessesPresentInARecentCompactBlock = false;
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
-                            else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                            }
-                            fGotBlockFromCache = true;
+                            a_recent_block = most_recent_block;
+                            a_recent_compact_block = most_recent_compact_block;
+                            fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
                         }
                     }
-                    if (!fGotBlockFromCache) {
+                    connman->PushMessage(pto, GetAnnouncementMsg(pBestIndex->GetBlockHash(), NetMsgType::CMPCTBLOCK, pto->GetSendVersion() | nSendFlags, [&]() -> CSerializedNetMsg {
+                        if (a_recent_compact_block && (state.fWantsCmpctWitness || !fWitnessesPresentInARecentCompactBlock))
+                            return msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block);
                         CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
-                        assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                        connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
+                        if (!a_recent_block) {
+                            bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
+                            assert(ret);
+                        }
+                        CBlockHeaderAndShortTxIDs cmpctblock(a_recent_block ? *a_recent_block : block, state.fWantsCmpctWitness);
+                        return msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock);
+                    }));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
                     if (vHeaders.size() > 1) {
                         LogPrint(BCLog::NET, "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
                                 vHeaders.size(),
-                                vHeaders.front().GetHash().ToString(),
-                                vHeaders.back().GetHash().ToString(), pto->GetId());
+                                vHeaders.front()->GetBlockHash().ToString(),
+                                vHeaders.back()->GetBlockHash().ToString(), pto->GetId());
                     } else {
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
-                                vHeaders.front().GetHash().ToString(), pto->GetId());
+                                vHeaders.front()->GetBlockHash().ToString(), pto->GetId());
                     }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    AnnounceHeaders(pto, vHeaders, consensusParams, connman);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -3624,7 +4046,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             // Time to send but the peer has requested we not relay transactions.
             if (fSendTrickle) {
                 LOCK(pto->cs_filter);
-                if (!pto->fRelayTxes) pto->setInventoryTxToSend.clear();
+                if (!pto->fRelayTxes) txRelayQueue.SkipAll(pto->GetId());
             }
 
             // Respond to BIP35 mempool requests
@@ -3642,7 +4064,6 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 for (const auto& txinfo : vtxinfo) {
                     const uint256& hash = txinfo.tx->GetHash();
                     CInv inv(MSG_TX, hash);
-                    pto->setInventoryTxToSend.erase(hash);
                     if (filterrate) {
                         if (txinfo.feeRate.GetFeePerK() < filterrate)
                             continue;
@@ -3662,33 +4083,30 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                // The candidates are the transactions relayed after the peer's cursor, topologically and
+                // fee-rate sorted for privacy and priority reasons, in the order shared by all peers.
+                const uint64_t nCursor = txRelayQueue.GetCursor(pto->GetId());
+                std::shared_ptr<const CTxRelayQueue::Sorted> sortedTxs = txRelayQueue.GetSorted(mempool);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
+                bool fRelayedAll = true;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                for (const auto& entry : sortedTxs->vTxs) {
+                    if (entry.second <= nCursor) {
+                        continue;
+                    }
+                    if (nRelayedTransactions >= INVENTORY_BROADCAST_MAX) {
+                        // The rest stays after the cursor, for the next trickle
+                        fRelayedAll = false;
+                        break;
+                    }
+                    const uint256& hash = entry.first;
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
                         continue;
@@ -3724,6 +4142,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     }
                     pto->filterInventoryKnown.insert(hash);
                 }
+                if (fRelayedAll) {
+                    txRelayQueue.SetCursor(pto->GetId(), sortedTxs->nLastSeq);
+                }
             }
             
             // Send non-tx/non-block inventory items
@@ -3804,10 +4225,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nMaxBlocksInTransit = GetMaxBlocksInTransit(state, pto->nMinPingUsecTime);
+        if (!pto->fClient && !fHeadersOnly && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < nMaxBlocksInTransit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalled = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), nMaxBlocksInTransit - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
+            if (pto->nServices & NODE_NETWORK)
+                FindHistoricalBlocksToDownload(pto->GetId(), nMaxBlocksInTransit - state.nBlocksInFlight - vToDownload.size(), vToDownload, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -3816,7 +4241,18 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     pindex->nHeight, pto->GetId());
             }
             if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
+                // We are idle while the staller holds up the window, so ask
+                // for the block ourselves. A block is only taken over once, if
+                // that does not help either the staller is disconnected below.
+                std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itStalled = mapBlocksInFlight.find(pindexStalled->GetBlockHash());
+                if (itStalled != mapBlocksInFlight.end() && !itStalled->second.second->fStolen) {
+                    uint32_t nFetchFlags = GetFetchFlags(pto);
+                    vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), pindexStalled);
+                    state.vBlocksInFlight.back().fStolen = true;
+                    LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d, stalled by peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, pto->GetId(), staller);
+                } else if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
                     LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
                 }
@@ -19,6 +19,10 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        // Size the payload first, so it is written without growing the buffer
+        CSizeComputer sizer(SER_NETWORK, nFlags | nVersion);
+        ::SerializeMany(sizer, args...);
+        msg.data.reserve(sizer.size());
         CVectorWriter{ SER_NETWORK, nFlags | nVersion, msg.data, 0, std::forward<Args>(args)... };
         return msg;
     }
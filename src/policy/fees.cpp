@@ -14,6 +14,9 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+/** Stored fee estimation averages are rescaled once their decay factor drops below this */
+static constexpr double MIN_DECAY_FACTOR = 1e-12;
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -98,6 +101,11 @@ private:
 
     double decay;
 
+    // The averages above are kept divided by decayFactor, which is decay to
+    // the power of the number of blocks since they were last rescaled. Decaying
+    // them all for a new block is then a single multiplication of decayFactor.
+    double decayFactor;
+
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
@@ -110,6 +118,9 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Apply decayFactor to the stored averages and reset it to 1 */
+    void Rescale();
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -139,8 +150,8 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
                   unsigned int bucketIndex, bool inBlock);
 
-    /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
+    /** Decay our historical moving averages for a new block, before it is
+        recorded. Takes constant time unless decayFactor needs a rescale. */
     void UpdateMovingAverages();
 
     /**
@@ -178,6 +189,7 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     : buckets(defaultBuckets), bucketMap(defaultBucketMap)
 {
     decay = _decay;
+    decayFactor = 1;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
     confAvg.resize(maxPeriods);
@@ -221,22 +233,33 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
+    const double weight = 1 / decayFactor;
     for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+        confAvg[i - 1][bucketindex] += weight;
     }
-    txCtAvg[bucketindex]++;
-    avg[bucketindex] += val;
+    txCtAvg[bucketindex] += weight;
+    avg[bucketindex] += val * weight;
 }
 
-void TxConfirmStats::UpdateMovingAverages()
+void TxConfirmStats::Rescale()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
         for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
+            confAvg[i][j] = confAvg[i][j] * decayFactor;
         for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
+            failAvg[i][j] = failAvg[i][j] * decayFactor;
+        avg[j] = avg[j] * decayFactor;
+        txCtAvg[j] = txCtAvg[j] * decayFactor;
+    }
+    decayFactor = 1;
+}
+
+void TxConfirmStats::UpdateMovingAverages()
+{
+    decayFactor *= decay;
+    // Keep the stored averages well within the range of a double
+    if (decayFactor < MIN_DECAY_FACTOR) {
+        Rescale();
     }
 }
 
@@ -285,9 +308,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        nConf += confAvg[periodTarget - 1][bucket] * decayFactor;
+        totalNum += txCtAvg[bucket] * decayFactor;
+        failNum += failAvg[periodTarget - 1][bucket] * decayFactor;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -345,13 +368,13 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int minBucket = std::min(bestNearBucket, bestFarBucket);
     unsigned int maxBucket = std::max(bestNearBucket, bestFarBucket);
     for (unsigned int j = minBucket; j <= maxBucket; j++) {
-        txSum += txCtAvg[j];
+        txSum += txCtAvg[j] * decayFactor;
     }
     if (foundAnswer && txSum != 0) {
         txSum = txSum / 2;
         for (unsigned int j = minBucket; j <= maxBucket; j++) {
-            if (txCtAvg[j] < txSum)
-                txSum -= txCtAvg[j];
+            if (txCtAvg[j] * decayFactor < txSum)
+                txSum -= txCtAvg[j] * decayFactor;
             else { // we're in the right bucket
                 median = avg[j] / txCtAvg[j];
                 break;
@@ -395,12 +418,15 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
+    // The file holds the actual averages
+    TxConfirmStats rescaled(*this);
+    rescaled.Rescale();
     fileout << decay;
     fileout << scale;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << rescaled.avg;
+    fileout << rescaled.txCtAvg;
+    fileout << rescaled.confAvg;
+    fileout << rescaled.failAvg;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -415,6 +441,7 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (decay <= 0 || decay >= 1) {
         throw std::runtime_error("Corrupt estimates file. Decay must be between 0 and 1 (non-inclusive)");
     }
+    decayFactor = 1;
     filein >> scale;
     if (scale == 0) {
         throw std::runtime_error("Corrupt estimates file. Scale must be non-zero");
@@ -499,7 +526,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg[i][bucketindex] += 1 / decayFactor;
         }
     }
 }
@@ -518,6 +545,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         mapMemPoolTxs.erase(hash);
+        mapSmartFeeCache.clear();
         return true;
     } else {
         return false;
@@ -629,6 +657,7 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    mapSmartFeeCache.clear();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -817,14 +846,12 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
  */
-CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+CFeeRate CBlockPolicyEstimator::calculateSmartFee(int confTarget, FeeCalculation& feeCalc, bool conservative) const
 {
-    LOCK(cs_feeEstimator);
+    AssertLockHeld(cs_feeEstimator);
 
-    if (feeCalc) {
-        feeCalc->desiredTarget = confTarget;
-        feeCalc->returnedTarget = confTarget;
-    }
+    feeCalc.desiredTarget = confTarget;
+    feeCalc.returnedTarget = confTarget;
 
     double median = -1;
     EstimationResult tempResult;
@@ -841,7 +868,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     if ((unsigned int)confTarget > maxUsableEstimate) {
         confTarget = maxUsableEstimate;
     }
-    if (feeCalc) feeCalc->returnedTarget = confTarget;
+    feeCalc.returnedTarget = confTarget;
 
     if (confTarget <= 1) return CFeeRate(0); // error condition
 
@@ -857,36 +884,28 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * fluctuations lower our estimates by too much.
      */
     double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
-    if (feeCalc) {
-        feeCalc->est = tempResult;
-        feeCalc->reason = FeeReason::HALF_ESTIMATE;
-    }
+    feeCalc.est = tempResult;
+    feeCalc.reason = FeeReason::HALF_ESTIMATE;
     median = halfEst;
     double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::FULL_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::FULL_ESTIMATE;
     }
     double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::DOUBLE_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::DOUBLE_ESTIMATE;
     }
 
     if (conservative || median == -1) {
         double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
-            if (feeCalc) {
-                feeCalc->est = tempResult;
-                feeCalc->reason = FeeReason::CONSERVATIVE;
-            }
+            feeCalc.est = tempResult;
+            feeCalc.reason = FeeReason::CONSERVATIVE;
         }
     }
 
@@ -895,6 +914,29 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     return CFeeRate(llround(median));
 }
 
+CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
+    LOCK(cs_feeEstimator);
+
+    // Transactions entering the mempool at the current height do not count
+    // towards any target yet, so results only change with blocks and removals.
+    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+        FeeCalculation calc;
+        CFeeRate feeRate = calculateSmartFee(confTarget, calc, conservative);
+        if (feeCalc) *feeCalc = calc;
+        return feeRate;
+    }
+    const std::pair<int, bool> key(confTarget, conservative);
+    auto it = mapSmartFeeCache.find(key);
+    if (it == mapSmartFeeCache.end()) {
+        FeeCalculation calc;
+        CFeeRate feeRate = calculateSmartFee(confTarget, calc, conservative);
+        it = mapSmartFeeCache.emplace(key, std::make_pair(feeRate, calc)).first;
+    }
+    if (feeCalc) *feeCalc = it->second.second;
+    return it->second.first;
+}
+
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
@@ -972,6 +1014,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            mapSmartFeeCache.clear();
         }
     }
     catch (const std::exception& e) {
@@ -13,6 +13,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 class CAutoFile;
@@ -257,9 +258,14 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** estimateSmartFee results by (confTarget, conservative), valid until the tracked data changes */
+    mutable std::map<std::pair<int, bool>, std::pair<CFeeRate, FeeCalculation>> mapSmartFeeCache;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
+    /** Compute what estimateSmartFee returns when it is not cached */
+    CFeeRate calculateSmartFee(int confTarget, FeeCalculation& feeCalc, bool conservative) const;
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
     /** Helper for estimateSmartFee */
@@ -13,14 +13,269 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <globaltoken/hardfork.h>
+#include <globaltoken/multihasher.h>
 #include <primitives/block.h>
 #include <primitives/mining_block.h>
 #include <uint256.h>
 #include <util.h>
 #include <streams.h>
 #include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/hashlib/multihash.h>
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
+#include <random.h>
+#include <script/sigcache.h>
 #include <validation.h>
 
+#include <array>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+#include <boost/thread.hpp>
+
+namespace {
+/**
+ * Valid Equihash solution cache, so that a solution is verified only once per
+ * process although the same header is checked on receipt, when the block
+ * arrives and again in LoadBlockIndexGuts.
+ */
+class CEquihashSolutionCache
+{
+private:
+    //! Entries are SHA256(nonce || header hash || algo || personalization string)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    uint32_t nElems;
+    boost::shared_mutex cs_ehcache;
+
+public:
+    CEquihashSolutionCache() : nElems(0)
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, uint8_t nAlgo, const std::string& strPersonalize)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&nAlgo, 1).Write((const unsigned char*)strPersonalize.data(), strPersonalize.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_ehcache);
+        return nElems != 0 && setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_ehcache);
+        if (nElems != 0)
+            setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_ehcache);
+        nElems = setValid.setup_bytes(n);
+        return nElems;
+    }
+};
+
+static CEquihashSolutionCache equihashSolutionCache;
+
+/**
+ * PoW hashes of the last POW_HASH_CACHE_SIZE headers hashed, a header is
+ * PoW hashed by CheckBlockHeader, again in AcceptBlockHeader and
+ * ReadBlockFromDisk, and by the RPCs that show it.
+ */
+class CPoWHashCache
+{
+private:
+    //! Keys are SHA256(nonce || header hash || algo || multihasher version)
+    uint256 nonce;
+    std::unordered_map<uint256, uint256, BlockHasher> mapHashes;
+    //! Keys in the order they were added, the oldest is evicted first
+    std::deque<uint256> dequeKeys;
+    boost::shared_mutex cs_powhashcache;
+
+public:
+    CPoWHashCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeKey(uint256& key, const uint256& hash, uint8_t nAlgo, int nHashVersion)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&nAlgo, 1).Write((const unsigned char*)&nHashVersion, sizeof(nHashVersion)).Finalize(key.begin());
+    }
+
+    bool Get(const uint256& key, uint256& hashPoW)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_powhashcache);
+        auto it = mapHashes.find(key);
+        if (it == mapHashes.end())
+            return false;
+        hashPoW = it->second;
+        return true;
+    }
+
+    void Set(const uint256& key, const uint256& hashPoW)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_powhashcache);
+        if (!mapHashes.emplace(key, hashPoW).second)
+            return;
+        dequeKeys.push_back(key);
+        if (dequeKeys.size() > POW_HASH_CACHE_SIZE) {
+            mapHashes.erase(dequeKeys.front());
+            dequeKeys.pop_front();
+        }
+    }
+};
+
+static CPoWHashCache powHashCache;
+
+/**
+ * The next nBits of every algo for the last NEXT_WORK_CACHE_SIZE tips asked
+ * about. After Hardfork1 the retarget only depends on the previous block,
+ * so the first call for a tip computes all algos at once and the block
+ * templates, the RPCs and ContextualCheckBlockHeader share them. Keyed by
+ * block hash and retarget version, so blocks off the active chain work too.
+ */
+class CNextWorkCache
+{
+private:
+    struct Entry {
+        uint256 hash;
+        int nRetargetVersion;
+        std::array<unsigned int, NUM_ALGOS> vBits;
+    };
+    //! The most recently added last
+    std::deque<Entry> entries;
+    std::mutex cs_nextworkcache;
+
+public:
+    bool Get(const uint256& hash, int nRetargetVersion, uint8_t algo, unsigned int& nBits)
+    {
+        std::lock_guard<std::mutex> lock(cs_nextworkcache);
+        for (const Entry& entry : entries) {
+            if (entry.hash == hash && entry.nRetargetVersion == nRetargetVersion) {
+                nBits = entry.vBits[algo];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Set(const uint256& hash, int nRetargetVersion, const std::array<unsigned int, NUM_ALGOS>& vBits)
+    {
+        std::lock_guard<std::mutex> lock(cs_nextworkcache);
+        for (const Entry& entry : entries) {
+            if (entry.hash == hash && entry.nRetargetVersion == nRetargetVersion)
+                return;
+        }
+        entries.push_back(Entry{hash, nRetargetVersion, vBits});
+        if (entries.size() > NEXT_WORK_CACHE_SIZE)
+            entries.pop_front();
+    }
+};
+
+static CNextWorkCache nextWorkCache;
+} // namespace
+
+template <typename Header>
+static uint256 GetCachedPoWHashOf(const Header& block, uint8_t nAlgo, int nHashVersion)
+{
+    // The key costs as much as these
+    if (nAlgo == ALGO_SHA256D || IsEquihashBasedAlgo(nAlgo))
+        return block.GetPoWHash(nAlgo, SER_GETHASH, nHashVersion);
+
+    uint256 key;
+    powHashCache.ComputeKey(key, block.GetHash(), nAlgo, nHashVersion);
+    uint256 hashPoW;
+    if (!powHashCache.Get(key, hashPoW)) {
+        hashPoW = block.GetPoWHash(nAlgo, SER_GETHASH, nHashVersion);
+        powHashCache.Set(key, hashPoW);
+    }
+    return hashPoW;
+}
+
+uint256 GetCachedPoWHash(const CPureBlockHeader& block, uint8_t nAlgo, int nHashVersion)
+{
+    return GetCachedPoWHashOf(block, nAlgo, nHashVersion);
+}
+
+uint256 GetCachedPoWHash(const CDefaultBlockHeader& block, uint8_t nAlgo, int nHashVersion)
+{
+    return GetCachedPoWHashOf(block, nAlgo, nHashVersion);
+}
+
+bool HasPoWHashBatchKernel(uint8_t nAlgo)
+{
+    return nAlgo == ALGO_X11;
+}
+
+template <typename Header>
+static void PrecomputePoWHashesOf(const std::vector<const Header*>& vpheaders, uint8_t nAlgo, int nHashVersion)
+{
+    if (!HasPoWHashBatchKernel(nAlgo))
+        return;
+
+    std::vector<uint256> vKeys;
+    std::vector<const Header*> vMissing;
+    for (const Header* pheader : vpheaders) {
+        uint256 key, hashPoW;
+        powHashCache.ComputeKey(key, pheader->GetHash(), nAlgo, nHashVersion);
+        if (powHashCache.Get(key, hashPoW))
+            continue;
+        vKeys.push_back(key);
+        vMissing.push_back(pheader);
+    }
+
+    static_assert(POW_HASH_BATCH_SIZE == 4, "HashX11_4way hashes four headers");
+    for (size_t i = 0; i + POW_HASH_BATCH_SIZE <= vMissing.size(); i += POW_HASH_BATCH_SIZE) {
+        unsigned char headers[POW_HASH_BATCH_SIZE * 80];
+        bool fAllFit = true;
+        for (size_t j = 0; j < POW_HASH_BATCH_SIZE && fAllFit; j++) {
+            CDataStream ss(SER_GETHASH, nHashVersion);
+            ss << *vMissing[i + j];
+            // A header serialized with the Equihash fields is left to GetCachedPoWHash
+            fAllFit = ss.size() == 80;
+            if (fAllFit)
+                memcpy(headers + j * 80, ss.data(), 80);
+        }
+        if (!fAllFit)
+            continue;
+
+        uint256 hashes[POW_HASH_BATCH_SIZE];
+        {
+            CPoWHashTimer timer(nAlgo, POW_HASH_BATCH_SIZE);
+            HashX11_4way(headers, 80, hashes);
+        }
+        for (size_t j = 0; j < POW_HASH_BATCH_SIZE; j++)
+            powHashCache.Set(vKeys[i + j], hashes[j]);
+    }
+}
+
+void PrecomputePoWHashes(const std::vector<const CPureBlockHeader*>& vpheaders, uint8_t nAlgo, int nHashVersion)
+{
+    PrecomputePoWHashesOf(vpheaders, nAlgo, nHashVersion);
+}
+
+void PrecomputePoWHashes(const std::vector<const CDefaultBlockHeader*>& vpheaders, uint8_t nAlgo, int nHashVersion)
+{
+    PrecomputePoWHashesOf(vpheaders, nAlgo, nHashVersion);
+}
+
+void InitEquihashSolutionCache()
+{
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxequihashcachesize", DEFAULT_MAX_EQUIHASH_CACHE_SIZE)), MAX_MAX_EQUIHASH_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = equihashSolutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for Equihash solution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
 bool IsAuxPowAllowed(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params, const uint8_t algo)
 {
     if(!pblock->IsAuxpow())
@@ -53,7 +308,7 @@ bool IsAuxPowAllowed(const CBlockIndex* pindexLast, const CBlockHeader *pblock,
                 {
                     break;
                 }
-                pIndexLastAlgo = GetLastBlockIndexForAlgo(pIndexLastAlgo->pprev, algo, params);
+                pIndexLastAlgo = GetPrevBlockIndexForAlgo(pIndexLastAlgo, params);
                 
                 if(pIndexLastAlgo == nullptr)
                     return false;
@@ -89,12 +344,30 @@ bool IsAuxPowAllowed(const CBlockIndex* pindexLast, const CBlockHeader *pblock,
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params, const uint8_t algo)
 {
+    // V1 also looks at the time of the new block, V2 and V3 only at the
+    // chain up to pindexLast, whose results are cached
+    int nRetargetVersion;
     if(params.Hardfork2.IsActivated(pblock->nTime))
-       return GetNextWorkRequiredV3(pindexLast, pblock, params, algo);
+       nRetargetVersion = 3;
     else if(params.Hardfork1.IsActivated(pblock->nTime))
-       return GetNextWorkRequiredV2(pindexLast, pblock, params, algo);
+       nRetargetVersion = 2;
     else
        return GetNextWorkRequiredV1(pindexLast, pblock, params, algo);
+
+    auto fnNextWork = nRetargetVersion == 3 ? GetNextWorkRequiredV3 : GetNextWorkRequiredV2;
+    if (pindexLast == nullptr || pindexLast->phashBlock == nullptr || algo >= NUM_ALGOS)
+        return fnNextWork(pindexLast, pblock, params, algo);
+
+    const uint256 hash = pindexLast->GetBlockHash();
+    unsigned int nBits;
+    if (nextWorkCache.Get(hash, nRetargetVersion, algo, nBits))
+        return nBits;
+
+    std::array<unsigned int, NUM_ALGOS> vBits;
+    for (uint8_t i = 0; i < NUM_ALGOS; i++)
+        vBits[i] = fnNextWork(pindexLast, pblock, params, i);
+    nextWorkCache.Set(hash, nRetargetVersion, vBits);
+    return vBits[algo];
 }
 
 unsigned int GetNextWorkRequiredV1(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params, const uint8_t algo)
@@ -133,6 +406,36 @@ unsigned int GetNextWorkRequiredV1(const CBlockIndex* pindexLast, const CBlockHe
     return CalculateNextWorkRequired(pindexLast, pindexFirst->GetBlockTime(), params);
 }
 
+/**
+ * Make bnNew harder by nLocalTargetAdjustment percent nAdjustments times, or
+ * easier for a negative count. Every step truncates and a long run of easier
+ * steps wraps around 2^256, so this keeps the steps of the original loop and
+ * only makes each one cheap: dividing by a 32 bit value with
+ * DivideByUint32 instead of a long division by a base_uint.
+ */
+static void ApplyLocalTargetAdjustments(arith_uint256& bnNew, int nAdjustments, const Consensus::Params& params)
+{
+	const int64_t nFactor = 100 + params.nLocalTargetAdjustment;
+	assert(nFactor > 0 && nFactor <= std::numeric_limits<uint32_t>::max());
+
+	if (nAdjustments > 0)
+	{
+		for (int i = 0; i < nAdjustments && bnNew != 0; i++)
+		{
+			bnNew *= 100;
+			bnNew.DivideByUint32(nFactor);
+		}
+	}
+	else if (nAdjustments < 0)//make it easier
+	{
+		for (int i = 0; i < -nAdjustments; i++)
+		{
+			bnNew *= (uint32_t)nFactor;
+			bnNew.DivideByUint32(100);
+		}
+	}
+}
+
 unsigned int GetNextWorkRequiredV2(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params, const uint8_t algo)
 {
 	unsigned int npowWorkLimit = params.aPOWAlgos[algo].GetArithPowLimit().GetCompact();
@@ -158,11 +461,7 @@ unsigned int GetNextWorkRequiredV2(const CBlockIndex* pindexLast, const CBlockHe
 
 	// find first block in averaging interval
 	// Go back by what we want to be nAveragingInterval blocks per algo
-	const CBlockIndex* pindexFirst = pindexLast;
-	for (int i = 0; pindexFirst && i < NUM_ALGOS_OLD*params.nAveragingInterval; i++)
-	{
-		pindexFirst = pindexFirst->pprev;
-	}
+	const CBlockIndex* pindexFirst = pindexLast->GetAncestor(pindexLast->nHeight - NUM_ALGOS_OLD*params.nAveragingInterval);
 
 	const CBlockIndex* pindexPrevAlgo = GetLastBlockIndexForAlgo(pindexLast, algo, params);
 	if (pindexPrevAlgo == nullptr || pindexFirst == nullptr)
@@ -189,22 +488,7 @@ unsigned int GetNextWorkRequiredV2(const CBlockIndex* pindexLast, const CBlockHe
 
 	//Per-algo retarget
 	int nAdjustments = pindexPrevAlgo->nHeight + NUM_ALGOS_OLD - 1 - pindexLast->nHeight;
-	if (nAdjustments > 0)
-	{
-		for (int i = 0; i < nAdjustments; i++)
-		{
-			bnNew *= 100;
-			bnNew /= (100 + params.nLocalTargetAdjustment);
-		}
-	}
-	else if (nAdjustments < 0)//make it easier
-	{
-		for (int i = 0; i < -nAdjustments; i++)
-		{
-			bnNew *= (100 + params.nLocalTargetAdjustment);
-			bnNew /= 100;
-		}
-	}
+	ApplyLocalTargetAdjustments(bnNew, nAdjustments, params);
 
 	if (bnNew > params.aPOWAlgos[algo].GetArithPowLimit())
 	{
@@ -239,11 +523,7 @@ unsigned int GetNextWorkRequiredV3(const CBlockIndex* pindexLast, const CBlockHe
 
 	// find first block in averaging interval
 	// Go back by what we want to be nAveragingInterval blocks per algo
-	const CBlockIndex* pindexFirst = pindexLast;
-	for (int i = 0; pindexFirst && i < NUM_ALGOS*params.nAveragingInterval; i++) // unchanged, nAveragingInterval is still the same
-	{
-		pindexFirst = pindexFirst->pprev;
-	}
+	const CBlockIndex* pindexFirst = pindexLast->GetAncestor(pindexLast->nHeight - NUM_ALGOS*params.nAveragingInterval); // unchanged, nAveragingInterval is still the same
 
 	const CBlockIndex* pindexPrevAlgo = GetLastBlockIndexForAlgo(pindexLast, algo, params);
 	if (pindexPrevAlgo == nullptr || pindexFirst == nullptr)
@@ -270,22 +550,7 @@ unsigned int GetNextWorkRequiredV3(const CBlockIndex* pindexLast, const CBlockHe
 
 	//Per-algo retarget
 	int nAdjustments = pindexPrevAlgo->nHeight + NUM_ALGOS - 1 - pindexLast->nHeight;
-	if (nAdjustments > 0)
-	{
-		for (int i = 0; i < nAdjustments; i++)
-		{
-			bnNew *= 100;
-			bnNew /= (100 + params.nLocalTargetAdjustment); // unchanged
-		}
-	}
-	else if (nAdjustments < 0)//make it easier
-	{
-		for (int i = 0; i < -nAdjustments; i++)
-		{
-			bnNew *= (100 + params.nLocalTargetAdjustment); // unchanged
-			bnNew /= 100;
-		}
-	}
+	ApplyLocalTargetAdjustments(bnNew, nAdjustments, params); // unchanged
 
 	if (bnNew > params.aPOWAlgos[algo].GetArithPowLimit())
 	{
@@ -322,11 +587,17 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
 
 bool CheckEquihashSolution(const CEquihashBlockHeader *pblock, const CChainParams& params, uint8_t nAlgo, const std::string stateString)
 {
+    // The header hash commits to the solution, n and k follow from the algo.
+    uint256 entry;
+    equihashSolutionCache.ComputeEntry(entry, pblock->GetHash(), nAlgo, stateString);
+    if (equihashSolutionCache.Get(entry))
+        return true;
+
     unsigned int n = params.GetEquihashAlgoN(nAlgo);
     unsigned int k = params.GetEquihashAlgoK(nAlgo);
 
-    // Hash state
-    crypto_generichash_blake2b_state state;
+    // Hash state, the in-tree one lets the indices be hashed four at a time
+    eh_IndexHashState state;
     EhInitialiseState(n, k, state, stateString);
 
     // I = the block header minus nonce and solution.
@@ -337,13 +608,14 @@ bool CheckEquihashSolution(const CEquihashBlockHeader *pblock, const CChainParam
     ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
 
     bool isValid;
     EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
     if (!isValid)
         return false;
 
+    equihashSolutionCache.Set(entry);
     return true;
 }
 
@@ -429,14 +701,16 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
                 
                 // Check the header
                 // Also check the Block Header after Equihash solution check.
-                if (!CheckProofOfWork(block.GetPoWHash(SER_GETHASH, powHashFlags), block.nBits, params, nAlgo))
-                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, block.GetPoWHash(SER_GETHASH, powHashFlags).ToString());
+                const uint256 hashPoW = GetCachedPoWHash(block, nAlgo, powHashFlags);
+                if (!CheckProofOfWork(hashPoW, block.nBits, params, nAlgo))
+                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, hashPoW.ToString());
             }
             else
             {
                 // Check the header
-                if (!CheckProofOfWork(block.GetPoWHash(SER_GETHASH, powHashFlags), block.nBits, params, nAlgo))
-                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, block.GetPoWHash(SER_GETHASH, powHashFlags).ToString());
+                const uint256 hashPoW = GetCachedPoWHash(block, nAlgo, powHashFlags);
+                if (!CheckProofOfWork(hashPoW, block.nBits, params, nAlgo))
+                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, hashPoW.ToString());
             }
         }
         else
@@ -444,8 +718,9 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
             if(nAlgo == ALGO_SHA256D)
             {
                 // Check the header
-                if (!CheckProofOfWork(block.GetPoWHash(SER_GETHASH, powHashFlags), block.nBits, params, ALGO_SHA256D))
-                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, block.GetPoWHash(SER_GETHASH, powHashFlags).ToString());
+                const uint256 hashPoW = GetCachedPoWHash(block, ALGO_SHA256D, powHashFlags);
+                if (!CheckProofOfWork(hashPoW, block.nBits, params, ALGO_SHA256D))
+                    return error("%s : non-AUX proof of work failed - hash=%s, algo=%d (%s), nVersion=%d, PoWHash=%s", __func__, block.GetHash().ToString(), nAlgo, GetAlgoName(nAlgo), block.nVersion, hashPoW.ToString());
             }
             else
             {
@@ -525,8 +800,8 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
         if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params, nAlgo))
             return error("%s : AUX POW is not valid", __func__);
 
-        // Check the header
-        if (!CheckProofOfWork(block.auxpow->getParentBlockPoWHash(nAlgo), block.nBits, params, nAlgo))
+        // Check the header, the same hash getParentBlockPoWHash computes for these algos
+        if (!CheckProofOfWork(GetCachedPoWHash(block.auxpow->getDefaultParentBlock(), nAlgo, LoadMultiHasherVersionFlags(true)), block.nBits, params, nAlgo))
             return error("%s : AUX proof of work failed (Algo : %s)", __func__, GetAlgoName(nAlgo));
     }
 
@@ -550,6 +825,24 @@ const CBlockIndex* GetLastBlockIndexForAlgo(const CBlockIndex* pindex, const uin
 	return nullptr;
 }
 
+const CBlockIndex* GetPrevBlockIndexForAlgo(const CBlockIndex* pindex, const Consensus::Params& params)
+{
+    assert(pindex != nullptr);
+    const uint8_t algo = pindex->GetAlgo();
+
+    // Skip pointer not built yet (e.g. a detached index), walk the chain instead.
+    if (pindex->nPrevAlgoTimeMin == 0)
+        return GetLastBlockIndexForAlgo(pindex->pprev, algo, params);
+
+    if (!pindex->pprevAlgo)
+        return nullptr;
+    if (!params.Hardfork1.IsActivated(pindex->nPrevAlgoTimeMin) && algo != ALGO_SHA256D)
+        return nullptr;
+    if (!params.Hardfork2.IsActivated(pindex->nPrevAlgoTimeMin) && !IsAlgoAllowedBeforeHF2(algo))
+        return nullptr;
+    return pindex->pprevAlgo;
+}
+
 const CBlockIndex* GetNextBlockIndexForAlgo(const CBlockIndex* pindex, const uint8_t algo)
 {
     AssertLockHeld(cs_main);
@@ -573,7 +866,7 @@ int CalculateDiffRetargetingBlock(const CBlockIndex* pindex, int retargettype, c
     const CBlockIndex* pindexLastAlgo;
     if(pindexAlgo != nullptr)
         if(pindexAlgo->pprev)
-            pindexLastAlgo = GetLastBlockIndexForAlgo(pindexAlgo->pprev, algo, params);
+            pindexLastAlgo = GetPrevBlockIndexForAlgo(pindexAlgo, params);
         else
             pindexLastAlgo = nullptr;
     else
@@ -592,7 +885,7 @@ int CalculateDiffRetargetingBlock(const CBlockIndex* pindex, int retargettype, c
 				return pindexAlgo->nHeight;	
 		
 			pindexAlgo = pindexLastAlgo;
-			pindexLastAlgo = GetLastBlockIndexForAlgo(pindexAlgo->pprev, algo, params);
+			pindexLastAlgo = GetPrevBlockIndexForAlgo(pindexAlgo, params);
 		}
 		return -3;
 	}
@@ -656,7 +949,7 @@ int CalculateDiffRetargetingBlock(const CBlockIndex* pindex, int retargettype, c
                     }
 				}
 				pindexAlgo = pindexLastAlgo;
-                pindexLastAlgo = GetLastBlockIndexForAlgo(pindexAlgo->pprev, algo, params);
+                pindexLastAlgo = GetPrevBlockIndexForAlgo(pindexAlgo, params);
 	    }
 	    return -3;
     }
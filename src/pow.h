@@ -10,6 +10,8 @@
 #include <consensus/params.h>
 
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 enum {
     RETARGETING_LAST = 0,
@@ -19,7 +21,9 @@ enum {
 class CBlockHeader;
 class CBlockIndex;
 class CChainParams;
+class CDefaultBlockHeader;
 class CEquihashBlockHeader;
+class CPureBlockHeader;
 class uint256;
 
 bool IsAuxPowAllowed(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&, const uint8_t algo);
@@ -29,13 +33,52 @@ unsigned int GetNextWorkRequiredV2(const CBlockIndex* pindexLast, const CBlockHe
 unsigned int GetNextWorkRequiredV3(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&, const uint8_t algo);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
 
-/** Check whether the Equihash solution in a block header is valid */
+/** Default for -maxequihashcachesize, maximum size of the Equihash solution cache in MiB */
+static const int64_t DEFAULT_MAX_EQUIHASH_CACHE_SIZE = 4;
+/** Maximum for -maxequihashcachesize */
+static const int64_t MAX_MAX_EQUIHASH_CACHE_SIZE = 1024;
+
+/** To be called once in AppInitMain/BasicTestingSetup to initialize the Equihash solution cache */
+void InitEquihashSolutionCache();
+
+/** Number of tips GetNextWorkRequired keeps the next nBits of every algo for */
+static const size_t NEXT_WORK_CACHE_SIZE = 8;
+
+/** Number of PoW hashes GetCachedPoWHash keeps */
+static const size_t POW_HASH_CACHE_SIZE = 20000;
+
+/**
+ * The PoW hash of a header with the given algo, as GetPoWHash(nAlgo, SER_GETHASH,
+ * nHashVersion) computes it. The hashes are remembered by header hash, algo and
+ * multihasher version, so a header checked again or shown by RPC is hashed once.
+ */
+uint256 GetCachedPoWHash(const CPureBlockHeader& block, uint8_t nAlgo, int nHashVersion);
+uint256 GetCachedPoWHash(const CDefaultBlockHeader& block, uint8_t nAlgo, int nHashVersion);
+
+/** Number of headers PrecomputePoWHashes hashes at once, the lanes of HashX11_4way */
+static const size_t POW_HASH_BATCH_SIZE = 4;
+
+/** Whether PrecomputePoWHashes has a kernel hashing several headers of the algo at once */
+bool HasPoWHashBatchKernel(uint8_t nAlgo);
+
+/**
+ * Compute the PoW hashes of headers with the given algo, POW_HASH_BATCH_SIZE at a
+ * time, and put them into the cache GetCachedPoWHash reads. Headers left over,
+ * already cached or of an algo without batch kernel are skipped, GetCachedPoWHash
+ * hashes those one by one.
+ */
+void PrecomputePoWHashes(const std::vector<const CPureBlockHeader*>& vpheaders, uint8_t nAlgo, int nHashVersion);
+void PrecomputePoWHashes(const std::vector<const CDefaultBlockHeader*>& vpheaders, uint8_t nAlgo, int nHashVersion);
+
+/** Check whether the Equihash solution in a block header is valid, valid solutions are cached */
 bool CheckEquihashSolution(const CEquihashBlockHeader *pblock, const CChainParams&, uint8_t nAlgo, const std::string stateString);
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams&);
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&, const uint8_t algo);
 const CBlockIndex* GetLastBlockIndexForAlgo(const CBlockIndex* pindex, const uint8_t algo, const Consensus::Params&);
+/** Return the closest predecessor of pindex mined with the same algo, same result as GetLastBlockIndexForAlgo(pindex->pprev, pindex->GetAlgo(), params) but O(1) */
+const CBlockIndex* GetPrevBlockIndexForAlgo(const CBlockIndex* pindex, const Consensus::Params&);
 const CBlockIndex* GetNextBlockIndexForAlgo(const CBlockIndex* pindex, const uint8_t algo);
 
 /**
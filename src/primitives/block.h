@@ -122,6 +122,38 @@ public:
     std::string ToString(bool fHardfork3) const;
 };
 
+/** Size of the chunks CBlockArenaScope allocates the transactions of a block from */
+static const size_t BLOCK_ARENA_CHUNK_SIZE = 16 << 10;
+
+/**
+ * While in scope, the transactions of the blocks deserialized on this thread
+ * are allocated from an arena, a chunk at a time rather than one by one.
+ * Meant for blocks that are only looked at and dropped, like those read back
+ * from disk or received from a peer: the chunks go away with the block. A
+ * transaction kept for longer keeps its whole chunk, so long lived copies
+ * should be made with MakeTransactionRef.
+ */
+class CBlockArenaScope
+{
+private:
+    ArenaResource arena;
+    ArenaResource* pPrevArena;
+
+public:
+    CBlockArenaScope() : arena(BLOCK_ARENA_CHUNK_SIZE), pPrevArena(GetDeserializeArena())
+    {
+        SetDeserializeArena(&arena);
+    }
+
+    ~CBlockArenaScope()
+    {
+        SetDeserializeArena(pPrevArena);
+    }
+
+    CBlockArenaScope(const CBlockArenaScope&) = delete;
+    CBlockArenaScope& operator=(const CBlockArenaScope&) = delete;
+};
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
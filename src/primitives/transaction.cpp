@@ -3,12 +3,40 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <primitives/transaction.h>
 
 #include <hash.h>
 #include <tinyformat.h>
 #include <utilstrencodings.h>
 
+#ifdef HAVE_THREAD_LOCAL
+static thread_local ArenaResource* pDeserializeArena = nullptr;
+
+ArenaResource* GetDeserializeArena()
+{
+    return pDeserializeArena;
+}
+
+void SetDeserializeArena(ArenaResource* arena)
+{
+    pDeserializeArena = arena;
+}
+#else
+// Transactions are allocated one by one without thread_local
+ArenaResource* GetDeserializeArena()
+{
+    return nullptr;
+}
+
+void SetDeserializeArena(ArenaResource* arena)
+{
+}
+#endif
+
 std::string COutPoint::ToString() const
 {
     return strprintf("COutPoint(%s, %u)", hash.ToString().substr(0,10), n);
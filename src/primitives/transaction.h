@@ -10,6 +10,7 @@
 #include <amount.h>
 #include <script/script.h>
 #include <serialize.h>
+#include <support/allocators/arena.h>
 #include <uint256.h>
 
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
@@ -650,6 +651,21 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** The arena transactions deserialized on this thread are allocated from, null if none, see CBlockArenaScope */
+ArenaResource* GetDeserializeArena();
+void SetDeserializeArena(ArenaResource* arena);
+
+template<typename Stream>
+void Unserialize(Stream& is, CTransactionRef& p)
+{
+    ArenaResource* arena = GetDeserializeArena();
+    if (arena) {
+        p = std::allocate_shared<const CTransaction>(ArenaAllocator<CTransaction>(arena), deserialize, is);
+    } else {
+        p = std::make_shared<const CTransaction>(deserialize, is);
+    }
+}
+
 typedef std::shared_ptr<const CPOSTransaction> CPOSTransactionRef;
 static inline CPOSTransactionRef MakePOSTransactionRef() { return std::make_shared<const CPOSTransaction>(); }
 template <typename Tx> static inline CPOSTransactionRef MakePOSTransactionRef(Tx&& txIn) { return std::make_shared<const CPOSTransaction>(std::forward<Tx>(txIn)); }
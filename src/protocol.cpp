@@ -53,6 +53,10 @@ const char *MNPING="mnp";
 const char *DSEG="dseg";
 const char *SYNCSTATUSCOUNT="ssc";
 const char *MNVERIFY="mnv";
+const char *MNLISTDIGEST="mnldigest";
+const char *MNLISTDIFF="mnldiff";
+const char *CMPCTREF="cmpctref";
+const char *CMPCTHEADERS="cmpcthdrs";
 } // namespace NetMsgType
 
 /** All known message types. Keep this in the same order as the list of
@@ -100,6 +104,10 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::DSEG,
     NetMsgType::SYNCSTATUSCOUNT,
     NetMsgType::MNVERIFY,
+    NetMsgType::MNLISTDIGEST,
+    NetMsgType::MNLISTDIFF,
+    NetMsgType::CMPCTREF,
+    NetMsgType::CMPCTHEADERS,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
 
@@ -252,6 +252,31 @@ extern const char *MNPING;
 extern const char *DSEG;
 extern const char *SYNCSTATUSCOUNT;
 extern const char *MNVERIFY;
+/**
+ * Contains a CMasternodeListDigest, sent instead of "dseg" to ask for the
+ * masternode list. Peer should respond with "mnldiff" messages.
+ * @since protocol version 80003
+ */
+extern const char *MNLISTDIGEST;
+/**
+ * Contains a CMasternodeListDiff, a batch of the announces and pings that
+ * the digest we sent did not cover.
+ * @since protocol version 80003
+ */
+extern const char *MNLISTDIFF;
+/**
+ * Contains a CBlockHeaderRefAndShortTxIDs, a "cmpctblock" with only the hash
+ * of a header the peer has already. Sent instead of "cmpctblock" in reply to
+ * a getdata for a compact block.
+ * @since protocol version 80004
+ */
+extern const char *CMPCTREF;
+/**
+ * Contains a CCompressedHeaders, a "headers" message without the parts of a
+ * header that follow from the headers before it. Sent instead of "headers".
+ * @since protocol version 80005
+ */
+extern const char *CMPCTHEADERS;
 };
 
 /* Get a vector of all valid message types (see above) */
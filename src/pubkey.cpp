@@ -167,13 +167,30 @@ static int ecdsa_signature_parse_der_lax(const secp256k1_context* ctx, secp256k1
 }
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
+    CParsedPubKey parsed;
+    if (!Parse(parsed)) {
+        return false;
+    }
+    return Verify(parsed, hash, vchSig);
+}
+
+static_assert(sizeof(CParsedPubKey) == sizeof(secp256k1_pubkey), "CParsedPubKey must hold a secp256k1_pubkey");
+
+bool CPubKey::Parse(CParsedPubKey& parsed) const {
     if (!IsValid())
         return false;
     secp256k1_pubkey pubkey;
-    secp256k1_ecdsa_signature sig;
     if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
         return false;
     }
+    memcpy(parsed.data, &pubkey, sizeof(pubkey));
+    return true;
+}
+
+bool CPubKey::Verify(const CParsedPubKey& parsed, const uint256 &hash, const std::vector<unsigned char>& vchSig) {
+    secp256k1_pubkey pubkey;
+    secp256k1_ecdsa_signature sig;
+    memcpy(&pubkey, parsed.data, sizeof(pubkey));
     if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, vchSig.data(), vchSig.size())) {
         return false;
     }
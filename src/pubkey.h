@@ -26,6 +26,15 @@ public:
 
 typedef uint256 ChainCode;
 
+/**
+ * A public key as libsecp256k1 parsed it (a secp256k1_pubkey), so it can
+ * verify several signatures without being decompressed again each time.
+ */
+struct CParsedPubKey
+{
+    unsigned char data[64];
+};
+
 /** An encapsulated public key. */
 class CPubKey
 {
@@ -182,6 +191,12 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    //! Parse for Verify(const CParsedPubKey&, ...), false if this public key is not fully valid.
+    bool Parse(CParsedPubKey& parsed) const;
+
+    //! Verify a DER signature with a public key parsed by Parse, same as Verify otherwise.
+    static bool Verify(const CParsedPubKey& parsed, const uint256& hash, const std::vector<unsigned char>& vchSig);
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
@@ -31,11 +31,65 @@
 #include <QFlags>
 #include <QIcon>
 #include <QSettings>
+#include <QTimer>
 #include <QTreeWidget>
 
 QList<CAmount> CoinControlDialog::payAmounts;
 bool CoinControlDialog::fSubtractFeeFromAmount = false;
 
+/**
+ * Lists the wallet's coins for the dialog and adds up their totals by address
+ * on a thread of its own, so AvailableCoins does not block the GUI on wallets
+ * with many outputs.
+ */
+class CoinControlWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CoinControlWorker(WalletModel *_model) : model(_model) {}
+
+public Q_SLOTS:
+    void listCoins(int nGeneration)
+    {
+        std::map<QString, std::vector<COutput> > mapCoins;
+        model->listCoins(mapCoins);
+
+        std::shared_ptr<std::vector<CoinControlGroup> > coins = std::make_shared<std::vector<CoinControlGroup> >();
+        coins->reserve(mapCoins.size());
+        for (const std::pair<QString, std::vector<COutput>>& entry : mapCoins) {
+            coins->emplace_back();
+            CoinControlGroup& group = coins->back();
+            group.address = entry.first;
+            group.label = model->getAddressTableModel()->labelForAddress(entry.first);
+            group.nSum = 0;
+            group.vOutputs.reserve(entry.second.size());
+            for (const COutput& out : entry.second) {
+                const CTxOut& txout = out.tx->tx->vout[out.i];
+                CoinControlOutput output;
+                output.outpoint = COutPoint(out.tx->GetHash(), out.i);
+                output.nValue = txout.nValue;
+                CTxDestination outputAddress;
+                if (ExtractDestination(txout.scriptPubKey, outputAddress))
+                    output.address = QString::fromStdString(EncodeDestination(outputAddress));
+                output.nTime = out.tx->GetTxTime();
+                output.nDepth = out.nDepth;
+                group.nSum += output.nValue;
+                group.vOutputs.push_back(output);
+            }
+        }
+        Q_EMIT coinsListed(nGeneration, coins);
+    }
+
+Q_SIGNALS:
+    void coinsListed(int nGeneration, const CoinControlGroups& coins);
+
+private:
+    WalletModel *model;
+};
+
+#include <qt/coincontroldialog.moc>
+
 bool CCoinControlWidgetItem::operator<(const QTreeWidgetItem &other) const {
     int column = treeWidget()->sortColumn();
     if (column == CoinControlDialog::COLUMN_AMOUNT || column == CoinControlDialog::COLUMN_DATE || column == CoinControlDialog::COLUMN_CONFIRMATIONS)
@@ -47,10 +101,17 @@ CoinControlDialog::CoinControlDialog(const PlatformStyle *_platformStyle, QWidge
     QDialog(parent),
     ui(new Ui::CoinControlDialog),
     model(0),
-    platformStyle(_platformStyle)
+    platformStyle(_platformStyle),
+    nViewGeneration(0),
+    nNextGroup(0),
+    nNextOutput(0)
 {
     ui->setupUi(this);
 
+    loadTimer = new QTimer(this);
+    loadTimer->setSingleShot(true);
+    connect(loadTimer, SIGNAL(timeout()), this, SLOT(addPendingOutputs()));
+
     // context menu actions
     QAction *copyAddressAction = new QAction(tr("Copy address"), this);
     QAction *copyLabelAction = new QAction(tr("Copy label"), this);
@@ -110,6 +171,9 @@ CoinControlDialog::CoinControlDialog(const PlatformStyle *_platformStyle, QWidge
     // click on checkbox
     connect(ui->treeWidget, SIGNAL(itemChanged(QTreeWidgetItem*, int)), this, SLOT(viewItemChanged(QTreeWidgetItem*, int)));
 
+    // the outputs of an address are only added once it is expanded
+    connect(ui->treeWidget, SIGNAL(itemExpanded(QTreeWidgetItem*)), this, SLOT(viewItemExpanded(QTreeWidgetItem*)));
+
     // click on header
 #if QT_VERSION < 0x050000
     ui->treeWidget->header()->setClickable(true);
@@ -155,6 +219,8 @@ CoinControlDialog::~CoinControlDialog()
     settings.setValue("nCoinControlSortColumn", sortColumn);
     settings.setValue("nCoinControlSortOrder", (int)sortOrder);
 
+    coinThread.quit();
+    coinThread.wait();
     delete ui;
 }
 
@@ -164,6 +230,14 @@ void CoinControlDialog::setModel(WalletModel *_model)
 
     if(_model && _model->getOptionsModel() && _model->getAddressTableModel())
     {
+        qRegisterMetaType<CoinControlGroups>("CoinControlGroups");
+        CoinControlWorker *worker = new CoinControlWorker(_model);
+        worker->moveToThread(&coinThread);
+        connect(this, SIGNAL(coinsRequested(int)), worker, SLOT(listCoins(int)));
+        connect(worker, SIGNAL(coinsListed(int,CoinControlGroups)), this, SLOT(setCoins(int,CoinControlGroups)));
+        connect(&coinThread, SIGNAL(finished()), worker, SLOT(deleteLater()), Qt::DirectConnection);
+        coinThread.start();
+
         updateView();
         updateLabelLocked();
         CoinControlDialog::updateLabels(_model, this);
@@ -180,6 +254,10 @@ void CoinControlDialog::buttonBoxClicked(QAbstractButton* button)
 // (un)select all
 void CoinControlDialog::buttonSelectAllClicked()
 {
+    // still loading
+    if (!ui->treeWidget->isEnabled())
+        return;
+
     Qt::CheckState state = Qt::Checked;
     for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
     {
@@ -272,6 +350,7 @@ void CoinControlDialog::lockCoin()
 
     COutPoint outpt(uint256S(contextMenuItem->text(COLUMN_TXHASH).toStdString()), contextMenuItem->text(COLUMN_VOUT_INDEX).toUInt());
     model->lockCoin(outpt);
+    setLockedCoins.insert(outpt);
     contextMenuItem->setDisabled(true);
     contextMenuItem->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
     updateLabelLocked();
@@ -282,6 +361,7 @@ void CoinControlDialog::unlockCoin()
 {
     COutPoint outpt(uint256S(contextMenuItem->text(COLUMN_TXHASH).toStdString()), contextMenuItem->text(COLUMN_VOUT_INDEX).toUInt());
     model->unlockCoin(outpt);
+    setLockedCoins.erase(outpt);
     contextMenuItem->setDisabled(false);
     contextMenuItem->setIcon(COLUMN_CHECKBOX, QIcon());
     updateLabelLocked();
@@ -362,15 +442,15 @@ void CoinControlDialog::headerSectionClicked(int logicalIndex)
 // toggle tree mode
 void CoinControlDialog::radioTreeMode(bool checked)
 {
-    if (checked && model)
-        updateView();
+    if (checked && groups)
+        showCoins();
 }
 
 // toggle list mode
 void CoinControlDialog::radioListMode(bool checked)
 {
-    if (checked && model)
-        updateView();
+    if (checked && groups)
+        showCoins();
 }
 
 // checkbox clicked by user
@@ -394,6 +474,32 @@ void CoinControlDialog::viewItemChanged(QTreeWidgetItem* item, int column)
 
     // TODO: Remove this temporary qt5 fix after Qt5.3 and Qt5.4 are no longer used.
     //       Fixed in Qt5.5 and above: https://bugreports.qt.io/browse/QTBUG-43473
+    // address whose outputs were not added yet -> (un)select them without adding them
+    else if (column == COLUMN_CHECKBOX && item->childCount() == 0 && item->data(COLUMN_CHECKBOX, Qt::UserRole).isValid())
+    {
+        const CoinControlGroup& group = (*groups)[item->data(COLUMN_CHECKBOX, Qt::UserRole).toUInt()];
+        Qt::CheckState state = item->checkState(COLUMN_CHECKBOX);
+        for (const CoinControlOutput& out : group.vOutputs) {
+            if (state == Qt::Checked && setLockedCoins.count(out.outpoint)) {
+                // add them after all, so the address shows as partially checked
+                bool fBlocked = ui->treeWidget->blockSignals(true);
+                populateGroup(item);
+                ui->treeWidget->blockSignals(fBlocked);
+                item->setCheckState(COLUMN_CHECKBOX, state);
+                return;
+            }
+        }
+        for (const CoinControlOutput& out : group.vOutputs) {
+            if (state == Qt::Checked)
+                coinControl()->Select(out.outpoint);
+            else
+                coinControl()->UnSelect(out.outpoint);
+        }
+
+        if (ui->treeWidget->isEnabled())
+            CoinControlDialog::updateLabels(model, this);
+    }
+
 #if QT_VERSION >= 0x050000
     else if (column == COLUMN_CHECKBOX && item->childCount() > 0)
     {
@@ -518,7 +624,7 @@ void CoinControlDialog::updateLabels(WalletModel *model, QDialog* dialog)
         nPayFee = GetMinimumFee(nBytes, *coinControl(), ::mempool, ::feeEstimator, nullptr /* FeeCalculation */);
         
         // InstantSend Fee
-        if (coinControl()->fUseInstantSend) nPayFee = std::max(nPayFee, CTxLockRequest(txDummy).GetMinFee());
+        if (coinControl()->fUseInstantSend) nPayFee = std::max(nPayFee, CTxLockRequest::GetMinFee(txDummy.vin.size()));
 
         if (nPayAmount > 0)
         {
@@ -620,132 +726,189 @@ void CoinControlDialog::updateView()
     if (!model || !model->getOptionsModel() || !model->getAddressTableModel())
         return;
 
+    loadTimer->stop();
+    groups.reset();
+    ui->treeWidget->clear();
+    ui->treeWidget->setEnabled(false);
+    Q_EMIT coinsRequested(++nViewGeneration);
+}
+
+void CoinControlDialog::setCoins(int nGeneration, const CoinControlGroups& coins)
+{
+    if (nGeneration != nViewGeneration)
+        return;
+
+    groups = coins;
+    showCoins();
+}
+
+void CoinControlDialog::showCoins()
+{
     bool treeMode = ui->radioTreeMode->isChecked();
 
+    loadTimer->stop();
     ui->treeWidget->clear();
     ui->treeWidget->setEnabled(false); // performance, otherwise updateLabels would be called for every checked checkbox
     ui->treeWidget->setAlternatingRowColors(!treeMode);
-    QFlags<Qt::ItemFlag> flgCheckbox = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
-    QFlags<Qt::ItemFlag> flgTristate = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;
+
+    std::vector<COutPoint> vLockedCoins;
+    model->listLockedCoins(vLockedCoins);
+    setLockedCoins = std::set<COutPoint>(vLockedCoins.begin(), vLockedCoins.end());
+
+    if (!treeMode)
+    {
+        nNextGroup = 0;
+        nNextOutput = 0;
+        addPendingOutputs();
+        return;
+    }
 
     int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
+    QFlags<Qt::ItemFlag> flgTristate = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsTristate;
 
-    std::map<QString, std::vector<COutput> > mapCoins;
-    model->listCoins(mapCoins);
+    // The items are initialized from the selection, not the other way around
+    bool fBlocked = ui->treeWidget->blockSignals(true);
+    for (size_t i = 0; i < groups->size(); i++) {
+        const CoinControlGroup& group = (*groups)[i];
 
-    for (const std::pair<QString, std::vector<COutput>>& coins : mapCoins) {
-        CCoinControlWidgetItem *itemWalletAddress = new CCoinControlWidgetItem();
+        // wallet address
+        CCoinControlWidgetItem *itemWalletAddress = new CCoinControlWidgetItem(ui->treeWidget);
+        itemWalletAddress->setFlags(flgTristate);
         itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
-        QString sWalletAddress = coins.first;
-        QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
-        if (sWalletLabel.isEmpty())
-            sWalletLabel = tr("(no label)");
+        itemWalletAddress->setData(COLUMN_CHECKBOX, Qt::UserRole, QVariant((uint)i));
+        itemWalletAddress->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
 
-        if (treeMode)
-        {
-            // wallet address
-            ui->treeWidget->addTopLevelItem(itemWalletAddress);
-
-            itemWalletAddress->setFlags(flgTristate);
-            itemWalletAddress->setCheckState(COLUMN_CHECKBOX, Qt::Unchecked);
+        // label
+        itemWalletAddress->setText(COLUMN_LABEL, group.label.isEmpty() ? tr("(no label)") : group.label);
 
-            // label
-            itemWalletAddress->setText(COLUMN_LABEL, sWalletLabel);
+        // address
+        itemWalletAddress->setText(COLUMN_ADDRESS, group.address);
 
-            // address
-            itemWalletAddress->setText(COLUMN_ADDRESS, sWalletAddress);
+        // amount
+        itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(group.vOutputs.size()) + ")");
+        itemWalletAddress->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, group.nSum));
+        itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)group.nSum));
+
+        // expand all partially selected
+        for (const CoinControlOutput& out : group.vOutputs) {
+            if (coinControl()->IsSelected(out.outpoint)) {
+                populateGroup(itemWalletAddress);
+                if (itemWalletAddress->checkState(COLUMN_CHECKBOX) == Qt::PartiallyChecked)
+                    itemWalletAddress->setExpanded(true);
+                break;
+            }
         }
+    }
+    ui->treeWidget->blockSignals(fBlocked);
 
-        CAmount nSum = 0;
-        int nChildren = 0;
-        for (const COutput& out : coins.second) {
-            nSum += out.tx->tx->vout[out.i].nValue;
-            nChildren++;
-
-            CCoinControlWidgetItem *itemOutput;
-            if (treeMode)    itemOutput = new CCoinControlWidgetItem(itemWalletAddress);
-            else             itemOutput = new CCoinControlWidgetItem(ui->treeWidget);
-            itemOutput->setFlags(flgCheckbox);
-            itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
-
-            // address
-            CTxDestination outputAddress;
-            QString sAddress = "";
-            if(ExtractDestination(out.tx->tx->vout[out.i].scriptPubKey, outputAddress))
-            {
-                sAddress = QString::fromStdString(EncodeDestination(outputAddress));
+    // sort view
+    sortView(sortColumn, sortOrder);
+    ui->treeWidget->setEnabled(true);
+}
 
-                // if listMode or change => show bitcoin address. In tree mode, address is not shown again for direct wallet address outputs
-                if (!treeMode || (!(sAddress == sWalletAddress)))
-                    itemOutput->setText(COLUMN_ADDRESS, sAddress);
-            }
+void CoinControlDialog::addPendingOutputs()
+{
+    int nAdded = 0;
+    bool fBlocked = ui->treeWidget->blockSignals(true);
+    while (nNextGroup < groups->size() && nAdded < COINCONTROL_LOAD_BATCH_SIZE) {
+        const CoinControlGroup& group = (*groups)[nNextGroup];
+        if (nNextOutput < group.vOutputs.size()) {
+            addOutputItem(group, group.vOutputs[nNextOutput++], 0);
+            nAdded++;
+        } else {
+            nNextGroup++;
+            nNextOutput = 0;
+        }
+    }
+    ui->treeWidget->blockSignals(fBlocked);
 
-            // label
-            if (!(sAddress == sWalletAddress)) // change
-            {
-                // tooltip from where the change comes from
-                itemOutput->setToolTip(COLUMN_LABEL, tr("change from %1 (%2)").arg(sWalletLabel).arg(sWalletAddress));
-                itemOutput->setText(COLUMN_LABEL, tr("(change)"));
-            }
-            else if (!treeMode)
-            {
-                QString sLabel = model->getAddressTableModel()->labelForAddress(sAddress);
-                if (sLabel.isEmpty())
-                    sLabel = tr("(no label)");
-                itemOutput->setText(COLUMN_LABEL, sLabel);
-            }
+    // let the GUI process events between batches
+    if (nNextGroup < groups->size()) {
+        loadTimer->start(0);
+        return;
+    }
 
-            // amount
-            itemOutput->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, out.tx->tx->vout[out.i].nValue));
-            itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)out.tx->tx->vout[out.i].nValue)); // padding so that sorting works correctly
+    // sort view
+    sortView(sortColumn, sortOrder);
+    ui->treeWidget->setEnabled(true);
+}
 
-            // date
-            itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.tx->GetTxTime()));
-            itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong)out.tx->GetTxTime()));
+void CoinControlDialog::viewItemExpanded(QTreeWidgetItem* item)
+{
+    if (item->childCount() == 0 && item->data(COLUMN_CHECKBOX, Qt::UserRole).isValid())
+    {
+        bool fBlocked = ui->treeWidget->blockSignals(true);
+        populateGroup(item);
+        ui->treeWidget->blockSignals(fBlocked);
+    }
+}
 
-            // confirmations
-            itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
-            itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong)out.nDepth));
+void CoinControlDialog::populateGroup(QTreeWidgetItem *itemWalletAddress)
+{
+    const CoinControlGroup& group = (*groups)[itemWalletAddress->data(COLUMN_CHECKBOX, Qt::UserRole).toUInt()];
+    for (const CoinControlOutput& out : group.vOutputs)
+        addOutputItem(group, out, itemWalletAddress);
+    itemWalletAddress->sortChildren(sortColumn, sortOrder);
+}
 
-            // transaction hash
-            uint256 txhash = out.tx->GetHash();
-            itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(txhash.GetHex()));
+void CoinControlDialog::addOutputItem(const CoinControlGroup& group, const CoinControlOutput& out, QTreeWidgetItem *itemWalletAddress)
+{
+    int nDisplayUnit = model->getOptionsModel()->getDisplayUnit();
+    QFlags<Qt::ItemFlag> flgCheckbox = Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable;
+    bool treeMode = itemWalletAddress != 0;
 
-            // vout index
-            itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.i));
+    CCoinControlWidgetItem *itemOutput;
+    if (treeMode)    itemOutput = new CCoinControlWidgetItem(itemWalletAddress);
+    else             itemOutput = new CCoinControlWidgetItem(ui->treeWidget);
+    itemOutput->setFlags(flgCheckbox);
+    itemOutput->setCheckState(COLUMN_CHECKBOX,Qt::Unchecked);
 
-             // disable locked coins
-            if (model->isLockedCoin(txhash, out.i))
-            {
-                COutPoint outpt(txhash, out.i);
-                coinControl()->UnSelect(outpt); // just to be sure
-                itemOutput->setDisabled(true);
-                itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
-            }
+    QString sWalletLabel = group.label.isEmpty() ? tr("(no label)") : group.label;
 
-            // set checkbox
-            if (coinControl()->IsSelected(COutPoint(txhash, out.i)))
-                itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
-        }
+    // address
+    // if listMode or change => show bitcoin address. In tree mode, address is not shown again for direct wallet address outputs
+    if (!treeMode || (!(out.address == group.address)))
+        itemOutput->setText(COLUMN_ADDRESS, out.address);
 
-        // amount
-        if (treeMode)
-        {
-            itemWalletAddress->setText(COLUMN_CHECKBOX, "(" + QString::number(nChildren) + ")");
-            itemWalletAddress->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, nSum));
-            itemWalletAddress->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)nSum));
-        }
+    // label
+    if (!(out.address == group.address)) // change
+    {
+        // tooltip from where the change comes from
+        itemOutput->setToolTip(COLUMN_LABEL, tr("change from %1 (%2)").arg(sWalletLabel).arg(group.address));
+        itemOutput->setText(COLUMN_LABEL, tr("(change)"));
+    }
+    else if (!treeMode)
+    {
+        itemOutput->setText(COLUMN_LABEL, sWalletLabel);
     }
 
-    // expand all partially selected
-    if (treeMode)
+    // amount
+    itemOutput->setText(COLUMN_AMOUNT, BitcoinUnits::format(nDisplayUnit, out.nValue));
+    itemOutput->setData(COLUMN_AMOUNT, Qt::UserRole, QVariant((qlonglong)out.nValue)); // padding so that sorting works correctly
+
+    // date
+    itemOutput->setText(COLUMN_DATE, GUIUtil::dateTimeStr(out.nTime));
+    itemOutput->setData(COLUMN_DATE, Qt::UserRole, QVariant((qlonglong)out.nTime));
+
+    // confirmations
+    itemOutput->setText(COLUMN_CONFIRMATIONS, QString::number(out.nDepth));
+    itemOutput->setData(COLUMN_CONFIRMATIONS, Qt::UserRole, QVariant((qlonglong)out.nDepth));
+
+    // transaction hash
+    itemOutput->setText(COLUMN_TXHASH, QString::fromStdString(out.outpoint.hash.GetHex()));
+
+    // vout index
+    itemOutput->setText(COLUMN_VOUT_INDEX, QString::number(out.outpoint.n));
+
+     // disable locked coins
+    if (setLockedCoins.count(out.outpoint))
     {
-        for (int i = 0; i < ui->treeWidget->topLevelItemCount(); i++)
-            if (ui->treeWidget->topLevelItem(i)->checkState(COLUMN_CHECKBOX) == Qt::PartiallyChecked)
-                ui->treeWidget->topLevelItem(i)->setExpanded(true);
+        coinControl()->UnSelect(out.outpoint); // just to be sure
+        itemOutput->setDisabled(true);
+        itemOutput->setIcon(COLUMN_CHECKBOX, platformStyle->SingleColorIcon(":/icons/lock_closed"));
     }
 
-    // sort view
-    sortView(sortColumn, sortOrder);
-    ui->treeWidget->setEnabled(true);
+    // set checkbox
+    if (coinControl()->IsSelected(out.outpoint))
+        itemOutput->setCheckState(COLUMN_CHECKBOX, Qt::Checked);
 }
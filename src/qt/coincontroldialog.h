@@ -6,6 +6,11 @@
 #define BITCOIN_QT_COINCONTROLDIALOG_H
 
 #include <amount.h>
+#include <primitives/transaction.h>
+
+#include <memory>
+#include <set>
+#include <vector>
 
 #include <QAbstractButton>
 #include <QAction>
@@ -14,6 +19,7 @@
 #include <QMenu>
 #include <QPoint>
 #include <QString>
+#include <QThread>
 #include <QTreeWidgetItem>
 
 class PlatformStyle;
@@ -21,12 +27,40 @@ class WalletModel;
 
 class CCoinControl;
 
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
 namespace Ui {
     class CoinControlDialog;
 }
 
 #define ASYMP_UTF8 "\xE2\x89\x88"
 
+/** Outputs added to the list view per pass of the event loop */
+static const int COINCONTROL_LOAD_BATCH_SIZE = 1000;
+
+/** A spendable output as the dialog shows it */
+struct CoinControlOutput
+{
+    COutPoint outpoint;
+    CAmount nValue;
+    QString address;
+    int64_t nTime;
+    int nDepth;
+};
+
+/** The outputs of a wallet address, with their total */
+struct CoinControlGroup
+{
+    QString address;
+    QString label;
+    CAmount nSum;
+    std::vector<CoinControlOutput> vOutputs;
+};
+
+typedef std::shared_ptr<const std::vector<CoinControlGroup> > CoinControlGroups;
+
 class CCoinControlWidgetItem : public QTreeWidgetItem
 {
 public:
@@ -69,8 +103,27 @@ private:
 
     const PlatformStyle *platformStyle;
 
+    /** Runs the CoinControlWorker, which lists the coins off the GUI thread */
+    QThread coinThread;
+    /** Bumped by every updateView, so the worker's answers to earlier ones are ignored */
+    int nViewGeneration;
+    /** The coins last listed by the worker, null until it answered */
+    CoinControlGroups groups;
+    std::set<COutPoint> setLockedCoins;
+    /** Next output showCoins has yet to add in list mode */
+    size_t nNextGroup;
+    size_t nNextOutput;
+    QTimer *loadTimer;
+
     void sortView(int, Qt::SortOrder);
+    /** Have the worker list the coins again, they are shown once it answered */
     void updateView();
+    /** Rebuild the view from the listed coins. Tree mode shows the address totals
+        and creates the items of an address' outputs once it is expanded, list
+        mode adds the outputs in batches. */
+    void showCoins();
+    void populateGroup(QTreeWidgetItem *itemWalletAddress);
+    void addOutputItem(const CoinControlGroup& group, const CoinControlOutput& out, QTreeWidgetItem *itemWalletAddress);
 
     enum
     {
@@ -107,6 +160,15 @@ private Q_SLOTS:
     void buttonBoxClicked(QAbstractButton*);
     void buttonSelectAllClicked();
     void updateLabelLocked();
+    void viewItemExpanded(QTreeWidgetItem*);
+    void setCoins(int nGeneration, const CoinControlGroups& coins);
+    void addPendingOutputs();
+
+Q_SIGNALS:
+    // Ask the coin control worker to list the coins
+    void coinsRequested(int nGeneration);
 };
 
+Q_DECLARE_METATYPE(CoinControlGroups)
+
 #endif // BITCOIN_QT_COINCONTROLDIALOG_H
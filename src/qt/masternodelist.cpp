@@ -7,6 +7,7 @@
 
 #include <qt/clientmodel.h>
 #include <qt/guiutil.h>
+#include <qt/masternodetablemodel.h>
 #include <qt/qrdialog.h>
 #include <qt/walletmodel.h>
 
@@ -21,6 +22,7 @@
 
 #include <QTimer>
 #include <QMessageBox>
+#include <QSortFilterProxyModel>
 
 int GetOffsetFromUtc()
 {
@@ -57,11 +59,26 @@ MasternodeList::MasternodeList(const PlatformStyle *platformStyle, QWidget *pare
     ui->tableWidgetMyMasternodes->setColumnWidth(4, columnActiveWidth);
     ui->tableWidgetMyMasternodes->setColumnWidth(5, columnLastSeenWidth);
 
-    ui->tableWidgetMasternodes->setColumnWidth(0, columnAddressWidth);
-    ui->tableWidgetMasternodes->setColumnWidth(1, columnProtocolWidth);
-    ui->tableWidgetMasternodes->setColumnWidth(2, columnStatusWidth);
-    ui->tableWidgetMasternodes->setColumnWidth(3, columnActiveWidth);
-    ui->tableWidgetMasternodes->setColumnWidth(4, columnLastSeenWidth);
+    // The model follows the changes CMasternodeMan reports, sorting and filtering happen in the proxy
+    masternodeModel = new MasternodeTableModel(this);
+    masternodeProxyModel = new QSortFilterProxyModel(this);
+    masternodeProxyModel->setSourceModel(masternodeModel);
+    masternodeProxyModel->setSortRole(MasternodeTableModel::SortRole);
+    masternodeProxyModel->setFilterKeyColumn(-1);
+    masternodeProxyModel->setDynamicSortFilter(true);
+    ui->tableViewMasternodes->setModel(masternodeProxyModel);
+    ui->tableViewMasternodes->sortByColumn(MasternodeTableModel::Address, Qt::AscendingOrder);
+
+    ui->tableViewMasternodes->setColumnWidth(MasternodeTableModel::Address, columnAddressWidth);
+    ui->tableViewMasternodes->setColumnWidth(MasternodeTableModel::Protocol, columnProtocolWidth);
+    ui->tableViewMasternodes->setColumnWidth(MasternodeTableModel::Status, columnStatusWidth);
+    ui->tableViewMasternodes->setColumnWidth(MasternodeTableModel::Active, columnActiveWidth);
+    ui->tableViewMasternodes->setColumnWidth(MasternodeTableModel::LastSeen, columnLastSeenWidth);
+
+    connect(masternodeProxyModel, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(updateNodeCount()));
+    connect(masternodeProxyModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(updateNodeCount()));
+    connect(masternodeProxyModel, SIGNAL(layoutChanged()), this, SLOT(updateNodeCount()));
+    connect(masternodeProxyModel, SIGNAL(modelReset()), this, SLOT(updateNodeCount()));
 
     ui->tableWidgetMyMasternodes->setContextMenuPolicy(Qt::CustomContextMenu);
 
@@ -72,14 +89,12 @@ MasternodeList::MasternodeList(const PlatformStyle *platformStyle, QWidget *pare
     connect(ui->tableWidgetMyMasternodes, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(on_QRButton_clicked()));
     connect(startAliasAction, SIGNAL(triggered()), this, SLOT(on_startButton_clicked()));
 
+    // Only counts down to the next refresh of my masternodes, the full list needs no timer
     timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(updateNodeList()));
     connect(timer, SIGNAL(timeout()), this, SLOT(updateMyNodeList()));
     timer->start(1000);
 
-    fFilterUpdated = false;
-    nTimeFilterUpdated = GetTime();
-    updateNodeList();
+    updateNodeCount();
 }
 
 MasternodeList::~MasternodeList()
@@ -90,10 +105,6 @@ MasternodeList::~MasternodeList()
 void MasternodeList::setClientModel(ClientModel *model)
 {
     this->clientModel = model;
-    if(model) {
-        // try to update list when masternode count changes
-        connect(clientModel, SIGNAL(strMasternodesChanged(QString)), this, SLOT(updateNodeList()));
-    }
 }
 
 void MasternodeList::setWalletModel(WalletModel *model)
@@ -268,77 +279,15 @@ void MasternodeList::updateMyNodeList(bool fForce)
     ui->secondsLabel->setText("0");
 }
 
-void MasternodeList::updateNodeList()
+void MasternodeList::updateNodeCount()
 {
-    TRY_LOCK(cs_mnlist, fLockAcquired);
-    if(!fLockAcquired) {
-        return;
-    }
-
-    static int64_t nTimeListUpdated = GetTime();
-
-    // to prevent high cpu usage update only once in MASTERNODELIST_UPDATE_SECONDS seconds
-    // or MASTERNODELIST_FILTER_COOLDOWN_SECONDS seconds after filter was last changed
-    int64_t nSecondsToWait = fFilterUpdated
-                            ? nTimeFilterUpdated - GetTime() + MASTERNODELIST_FILTER_COOLDOWN_SECONDS
-                            : nTimeListUpdated - GetTime() + MASTERNODELIST_UPDATE_SECONDS;
-
-    if(fFilterUpdated) ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", nSecondsToWait)));
-    if(nSecondsToWait > 0) return;
-
-    nTimeListUpdated = GetTime();
-    fFilterUpdated = false;
-
-    QString strToFilter;
-    ui->countLabel->setText("Updating...");
-    ui->tableWidgetMasternodes->setSortingEnabled(false);
-    ui->tableWidgetMasternodes->clearContents();
-    ui->tableWidgetMasternodes->setRowCount(0);
-    std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
-    int offsetFromUtc = GetOffsetFromUtc();
-
-    for (const auto& mnpair : mapMasternodes)
-    {
-        CMasternode mn = mnpair.second;
-        // populate list
-        // Address, Protocol, Status, Active Seconds, Last Seen, Pub Key
-        QTableWidgetItem *addressItem = new QTableWidgetItem(QString::fromStdString(mn.addr.ToString()));
-        QTableWidgetItem *protocolItem = new QTableWidgetItem(QString::number(mn.nProtocolVersion));
-        QTableWidgetItem *statusItem = new QTableWidgetItem(QString::fromStdString(mn.GetStatus()));
-        QTableWidgetItem *activeSecondsItem = new QTableWidgetItem(QString::fromStdString(DurationToDHMS(mn.lastPing.sigTime - mn.sigTime)));
-        QTableWidgetItem *lastSeenItem = new QTableWidgetItem(QString::fromStdString(DateTimeStrFormat("%Y-%m-%d %H:%M", mn.lastPing.sigTime + offsetFromUtc)));
-        QTableWidgetItem *pubkeyItem = new QTableWidgetItem(QString::fromStdString(EncodeDestination(mn.pubKeyCollateralAddress.GetID())));
-
-        if (strCurrentFilter != "")
-        {
-            strToFilter =   addressItem->text() + " " +
-                            protocolItem->text() + " " +
-                            statusItem->text() + " " +
-                            activeSecondsItem->text() + " " +
-                            lastSeenItem->text() + " " +
-                            pubkeyItem->text();
-            if (!strToFilter.contains(strCurrentFilter)) continue;
-        }
-
-        ui->tableWidgetMasternodes->insertRow(0);
-        ui->tableWidgetMasternodes->setItem(0, 0, addressItem);
-        ui->tableWidgetMasternodes->setItem(0, 1, protocolItem);
-        ui->tableWidgetMasternodes->setItem(0, 2, statusItem);
-        ui->tableWidgetMasternodes->setItem(0, 3, activeSecondsItem);
-        ui->tableWidgetMasternodes->setItem(0, 4, lastSeenItem);
-        ui->tableWidgetMasternodes->setItem(0, 5, pubkeyItem);
-    }
-
-    ui->countLabel->setText(QString::number(ui->tableWidgetMasternodes->rowCount()));
-    ui->tableWidgetMasternodes->setSortingEnabled(true);
+    ui->countLabel->setText(QString::number(masternodeProxyModel->rowCount()));
 }
 
 void MasternodeList::on_filterLineEdit_textChanged(const QString &strFilterIn)
 {
-    strCurrentFilter = strFilterIn;
-    nTimeFilterUpdated = GetTime();
-    fFilterUpdated = true;
-    ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", MASTERNODELIST_FILTER_COOLDOWN_SECONDS)));
+    masternodeProxyModel->setFilterFixedString(strFilterIn);
+    updateNodeCount();
 }
 
 void MasternodeList::on_startButton_clicked()
@@ -15,18 +15,18 @@
 #include <QWidget>
 
 #define MY_MASTERNODELIST_UPDATE_SECONDS                 60
-#define MASTERNODELIST_UPDATE_SECONDS                    15
-#define MASTERNODELIST_FILTER_COOLDOWN_SECONDS            3
 
 namespace Ui {
     class MasternodeList;
 }
 
 class ClientModel;
+class MasternodeTableModel;
 class WalletModel;
 
 QT_BEGIN_NAMESPACE
 class QModelIndex;
+class QSortFilterProxyModel;
 QT_END_NAMESPACE
 
 /** Masternode Manager page widget */
@@ -46,13 +46,11 @@ public:
 
 private:
     QMenu *contextMenu;
-    int64_t nTimeFilterUpdated;
-    bool fFilterUpdated;
 
 public Q_SLOTS:
     void updateMyMasternodeInfo(QString strAlias, QString strAddr, const COutPoint& outpoint);
     void updateMyNodeList(bool fForce = false);
-    void updateNodeList();
+    void updateNodeCount();
 
 Q_SIGNALS:
     void doubleClicked(const QModelIndex&);
@@ -62,15 +60,12 @@ private:
     Ui::MasternodeList *ui;
     ClientModel *clientModel;
     WalletModel *walletModel;
-
-    // Protects tableWidgetMasternodes
-    CCriticalSection cs_mnlist;
+    MasternodeTableModel *masternodeModel;
+    QSortFilterProxyModel *masternodeProxyModel;
 
     // Protects tableWidgetMyMasternodes
     CCriticalSection cs_mymnlist;
 
-    QString strCurrentFilter;
-
 private Q_SLOTS:
     void showContextMenu(const QPoint &);
     void on_filterLineEdit_textChanged(const QString &strFilterIn);
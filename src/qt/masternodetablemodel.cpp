@@ -0,0 +1,186 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <qt/masternodetablemodel.h>
+
+#include <base58.h>
+#include <masternodeman.h>
+#include <ui_interface.h>
+#include <utiltime.h>
+
+#include <algorithm>
+
+#include <QDateTime>
+
+#include <boost/bind.hpp>
+
+MasternodeTableEntry::MasternodeTableEntry(const CMasternode& mn) :
+    outpoint(mn.outpoint),
+    address(QString::fromStdString(mn.addr.ToString())),
+    protocol(mn.nProtocolVersion),
+    status(QString::fromStdString(mn.GetStatus())),
+    activeSeconds(mn.lastPing.sigTime - mn.sigTime),
+    lastSeen(mn.lastPing.sigTime),
+    payee(QString::fromStdString(EncodeDestination(mn.pubKeyCollateralAddress.GetID())))
+{
+}
+
+static bool EntryBeforeOutpoint(const MasternodeTableEntry& entry, const COutPoint& outpoint)
+{
+    return entry.outpoint < outpoint;
+}
+
+MasternodeTableModel::MasternodeTableModel(QObject *parent) :
+    QAbstractTableModel(parent)
+{
+    columns << tr("Address") << tr("Protocol") << tr("Status") << tr("Active") << tr("Last Seen") << tr("Payee");
+
+    // Subscribe before loading the list, so no change falls in between. A
+    // change reported for an entry the list has already is applied again.
+    subscribeToCoreSignals();
+    CMasternodeMan::masternode_snapshot_t pMasternodes = mnodeman.GetMasternodeListSnapshot(true);
+    entries.reserve(pMasternodes->size());
+    for (const auto& mnpair : *pMasternodes) {
+        entries.emplace_back(mnpair.second);
+    }
+}
+
+MasternodeTableModel::~MasternodeTableModel()
+{
+    unsubscribeFromCoreSignals();
+}
+
+int MasternodeTableModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return entries.size();
+}
+
+int MasternodeTableModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return columns.length();
+}
+
+QVariant MasternodeTableModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid() || index.row() >= (int)entries.size())
+        return QVariant();
+
+    const MasternodeTableEntry& rec = entries[index.row()];
+
+    if (role == Qt::DisplayRole) {
+        switch(index.column())
+        {
+        case Address:
+            return rec.address;
+        case Protocol:
+            return QString::number(rec.protocol);
+        case Status:
+            return rec.status;
+        case Active:
+            return QString::fromStdString(DurationToDHMS(rec.activeSeconds));
+        case LastSeen:
+            return QDateTime::fromTime_t((uint)rec.lastSeen).toString("yyyy-MM-dd hh:mm");
+        case Payee:
+            return rec.payee;
+        }
+    } else if (role == SortRole) {
+        switch(index.column())
+        {
+        case Address:
+            return rec.address;
+        case Protocol:
+            return rec.protocol;
+        case Status:
+            return rec.status;
+        case Active:
+            return (qint64)rec.activeSeconds;
+        case LastSeen:
+            return (qint64)rec.lastSeen;
+        case Payee:
+            return rec.payee;
+        }
+    }
+
+    return QVariant();
+}
+
+QVariant MasternodeTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation == Qt::Horizontal)
+    {
+        if(role == Qt::DisplayRole && section < columns.size())
+        {
+            return columns[section];
+        }
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags MasternodeTableModel::flags(const QModelIndex &index) const
+{
+    if(!index.isValid())
+        return 0;
+
+    Qt::ItemFlags retval = Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+    return retval;
+}
+
+void MasternodeTableModel::queueChange(const COutPoint& outpoint, const CMasternode* pmn)
+{
+    bool fWasEmpty;
+    {
+        LOCK(cs_pending);
+        fWasEmpty = mapPending.empty();
+        mapPending[outpoint].reset(pmn ? new MasternodeTableEntry(*pmn) : nullptr);
+    }
+    // One call applies everything queued until it runs
+    if (fWasEmpty)
+        QMetaObject::invokeMethod(this, "processChanges", Qt::QueuedConnection);
+}
+
+void MasternodeTableModel::processChanges()
+{
+    std::map<COutPoint, std::unique_ptr<MasternodeTableEntry> > mapChanges;
+    {
+        LOCK(cs_pending);
+        mapChanges.swap(mapPending);
+    }
+
+    for (auto& change : mapChanges) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), change.first, EntryBeforeOutpoint);
+        const int nRow = it - entries.begin();
+        const bool fFound = it != entries.end() && it->outpoint == change.first;
+        if (!change.second) {
+            if (fFound) {
+                beginRemoveRows(QModelIndex(), nRow, nRow);
+                entries.erase(it);
+                endRemoveRows();
+            }
+        } else if (fFound) {
+            *it = *change.second;
+            Q_EMIT dataChanged(index(nRow, 0), index(nRow, columns.length() - 1));
+        } else {
+            beginInsertRows(QModelIndex(), nRow, nRow);
+            entries.insert(it, *change.second);
+            endInsertRows();
+        }
+    }
+}
+
+static void NotifyMasternodeChanged(MasternodeTableModel *model, const COutPoint& outpoint, const CMasternode* pmn, ChangeType status)
+{
+    model->queueChange(outpoint, status == CT_DELETED ? nullptr : pmn);
+}
+
+void MasternodeTableModel::subscribeToCoreSignals()
+{
+    uiInterface.NotifyMasternodeChanged.connect(boost::bind(NotifyMasternodeChanged, this, _1, _2, _3));
+}
+
+void MasternodeTableModel::unsubscribeFromCoreSignals()
+{
+    uiInterface.NotifyMasternodeChanged.disconnect(boost::bind(NotifyMasternodeChanged, this, _1, _2, _3));
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_QT_MASTERNODETABLEMODEL_H
+#define BITCOIN_QT_MASTERNODETABLEMODEL_H
+
+#include <primitives/transaction.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <QAbstractTableModel>
+#include <QStringList>
+
+class CMasternode;
+
+/** A masternode as the list shows it */
+struct MasternodeTableEntry
+{
+    COutPoint outpoint;
+    QString address;
+    int protocol;
+    QString status;
+    int64_t activeSeconds;
+    int64_t lastSeen;
+    QString payee;
+
+    explicit MasternodeTableEntry(const CMasternode& mn);
+};
+
+/**
+   Qt model of the masternode list. Loaded once, then kept up to date with the
+   entries CMasternodeMan reports as added, updated or removed, rather than
+   rebuilt. Rows are ordered by outpoint, sort and filter with a proxy model.
+ */
+class MasternodeTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit MasternodeTableModel(QObject *parent = 0);
+    ~MasternodeTableModel();
+
+    enum ColumnIndex {
+        Address = 0,
+        Protocol = 1,
+        Status = 2,
+        Active = 3,
+        LastSeen = 4,
+        Payee = 5
+    };
+
+    /** Role with the raw value of a column, to sort by */
+    static const int SortRole = Qt::UserRole;
+
+    /** @name Methods overridden from QAbstractTableModel
+        @{*/
+    int rowCount(const QModelIndex &parent) const;
+    int columnCount(const QModelIndex &parent) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    /*@}*/
+
+    /** Queue a change reported by CMasternodeMan, pmn is null for a removed masternode */
+    void queueChange(const COutPoint& outpoint, const CMasternode* pmn);
+
+public Q_SLOTS:
+    /** Apply the changes queued since the last call */
+    void processChanges();
+
+private:
+    QStringList columns;
+    /** Ordered by outpoint */
+    std::vector<MasternodeTableEntry> entries;
+
+    CCriticalSection cs_pending;
+    /** Latest entry of every changed masternode, null once it was removed */
+    std::map<COutPoint, std::unique_ptr<MasternodeTableEntry> > mapPending;
+
+    void subscribeToCoreSignals();
+    void unsubscribeFromCoreSignals();
+};
+
+#endif // BITCOIN_QT_MASTERNODETABLEMODEL_H
@@ -16,15 +16,22 @@
 #include <core_io.h>
 #include <validation.h>
 #include <sync.h>
+#include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
 #include <wallet/wallet.h>
 
+#include <unordered_map>
+
 #include <QColor>
 #include <QDateTime>
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
+
+// Transactions decomposed into records at a time, the first batch before the table is shown
+static const size_t TX_LOAD_BATCH_SIZE = 1000;
 
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
@@ -36,30 +43,14 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter /* amount */
     };
 
-// Comparison operator for sort/binary search of model tx list
-struct TxLessThan
-{
-    bool operator()(const TransactionRecord &a, const TransactionRecord &b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TransactionRecord &a, const uint256 &b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256 &a, const TransactionRecord &b) const
-    {
-        return a < b.hash;
-    }
-};
-
 // Private implementation
 class TransactionTablePriv
 {
 public:
     TransactionTablePriv(CWallet *_wallet, TransactionTableModel *_parent) :
         wallet(_wallet),
-        parent(_parent)
+        parent(_parent),
+        nNextPending(0)
     {
     }
 
@@ -67,25 +58,90 @@ public:
     TransactionTableModel *parent;
 
     /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+     * The records of a transaction are next to each other, transactions are
+     * in the order they were loaded in: the wallet's newest first, then the
+     * ones added since.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Row of the first record of every transaction in cachedWallet, -1 for
+     * one waiting in vPending to be decomposed.
+     */
+    std::unordered_map<uint256, int, SaltedTxidHasher> mapRows;
+
+    /* Transactions of the wallet not decomposed yet, newest first, from nNextPending on.
+     */
+    std::vector<uint256> vPending;
+    size_t nNextPending;
+
+    /* Query the transactions of the entire wallet anew from core. Only their
+       hashes, the records are made by loadPending.
      */
     void refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        mapRows.clear();
+        vPending.clear();
+        nNextPending = 0;
+        {
+            LOCK2(cs_main, wallet->cs_wallet);
+            vPending.reserve(wallet->mapWallet.size());
+            mapRows.reserve(wallet->mapWallet.size());
+            for (auto it = wallet->wtxOrdered.rbegin(); it != wallet->wtxOrdered.rend(); ++it)
+            {
+                const CWalletTx* pwtx = it->second.first;
+                if (pwtx && mapRows.emplace(pwtx->GetHash(), -1).second)
+                    vPending.push_back(pwtx->GetHash());
+            }
+        }
+    }
+
+    /* Decompose up to nMax of the transactions waiting in vPending into
+       records, holding the locks only for those. Returns whether any remain.
+     */
+    bool loadPending(size_t nMax)
+    {
+        QList<TransactionRecord> toInsert;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for (const auto& entry : wallet->mapWallet)
+            for (; nNextPending < vPending.size() && nMax > 0; ++nNextPending, --nMax)
             {
-                if (TransactionRecord::showTransaction(entry.second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, entry.second));
+                const uint256& hash = vPending[nNextPending];
+                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                if (mi != wallet->mapWallet.end() && TransactionRecord::showTransaction(mi->second))
+                    toInsert.append(TransactionRecord::decomposeTransaction(wallet, mi->second));
+                else
+                    mapRows.erase(hash);
             }
         }
+        if (nNextPending == vPending.size())
+            std::vector<uint256>().swap(vPending);
+        if (!toInsert.isEmpty())
+        {
+            // Not new to the wallet, so no notification for them either
+            bool fProcessingQueuedPrev = parent->fProcessingQueuedTransactions;
+            parent->fProcessingQueuedTransactions = true;
+            append(toInsert);
+            parent->fProcessingQueuedTransactions = fProcessingQueuedPrev;
+        }
+        return !vPending.empty();
+    }
+
+    /* Add the records of transactions to the end of the model.
+     */
+    void append(const QList<TransactionRecord>& toInsert)
+    {
+        int insert_idx = cachedWallet.size();
+        parent->beginInsertRows(QModelIndex(), insert_idx, insert_idx+toInsert.size()-1);
+        for (const TransactionRecord &rec : toInsert)
+        {
+            if (insert_idx == 0 || cachedWallet[insert_idx-1].hash != rec.hash)
+                mapRows[rec.hash] = insert_idx;
+            cachedWallet.append(rec);
+            insert_idx += 1;
+        }
+        parent->endInsertRows();
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -98,13 +154,20 @@ public:
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
         // Find bounds of this transaction in model
-        QList<TransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        QList<TransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
+        std::unordered_map<uint256, int, SaltedTxidHasher>::iterator itRows = mapRows.find(hash);
+        if(itRows != mapRows.end() && itRows->second < 0)
+        {
+            // Decomposed as it is when its turn comes
+            return;
+        }
+        int lowerIndex = cachedWallet.size();
+        int upperIndex = lowerIndex;
+        if(itRows != mapRows.end())
+        {
+            lowerIndex = itRows->second;
+            for (upperIndex = lowerIndex; upperIndex < cachedWallet.size() && cachedWallet[upperIndex].hash == hash; upperIndex++) {}
+        }
+        bool inModel = (lowerIndex != upperIndex);
 
         if(status == CT_UPDATED)
         {
@@ -128,28 +191,21 @@ public:
             }
             if(showTransaction)
             {
-                LOCK2(cs_main, wallet->cs_wallet);
-                // Find transaction in wallet
-                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
-                if(mi == wallet->mapWallet.end())
-                {
-                    qWarning() << "TransactionTablePriv::updateWallet: Warning: Got CT_NEW, but transaction is not in wallet";
-                    break;
-                }
-                // Added -- insert at the right position
-                QList<TransactionRecord> toInsert =
-                        TransactionRecord::decomposeTransaction(wallet, mi->second);
-                if(!toInsert.isEmpty()) /* only if something to insert */
+                QList<TransactionRecord> toInsert;
                 {
-                    parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
-                    int insert_idx = lowerIndex;
-                    for (const TransactionRecord &rec : toInsert)
+                    LOCK2(cs_main, wallet->cs_wallet);
+                    // Find transaction in wallet
+                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                    if(mi == wallet->mapWallet.end())
                     {
-                        cachedWallet.insert(insert_idx, rec);
-                        insert_idx += 1;
+                        qWarning() << "TransactionTablePriv::updateWallet: Warning: Got CT_NEW, but transaction is not in wallet";
+                        break;
                     }
-                    parent->endInsertRows();
+                    toInsert = TransactionRecord::decomposeTransaction(wallet, mi->second);
                 }
+                // Added -- insert at the end
+                if(!toInsert.isEmpty()) /* only if something to insert */
+                    append(toInsert);
             }
             break;
         case CT_DELETED:
@@ -160,7 +216,14 @@ public:
             }
             // Removed -- remove entire transaction from table
             parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-            cachedWallet.erase(lower, upper);
+            cachedWallet.erase(cachedWallet.begin() + lowerIndex, cachedWallet.begin() + upperIndex);
+            mapRows.erase(itRows);
+            // The transactions after it moved up
+            for (int i = lowerIndex; i < cachedWallet.size(); i++)
+            {
+                if (i == lowerIndex || cachedWallet[i-1].hash != cachedWallet[i].hash)
+                    mapRows[cachedWallet[i].hash] = i;
+            }
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
@@ -230,7 +293,7 @@ public:
         std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
         if(mi != wallet->mapWallet.end())
         {
-            std::string strHex = EncodeHexTx(*mi->second.tx);
+            std::string strHex = EncodeHexTx(*wallet->GetFullTransaction(mi->second));
             return QString::fromStdString(strHex);
         }
         return QString();
@@ -251,6 +314,9 @@ TransactionTableModel::TransactionTableModel(const PlatformStyle *_platformStyle
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 
     subscribeToCoreSignals();
+
+    // The newest transactions come first, the rest is loaded while the GUI is up
+    loadPendingTransactions();
 }
 
 TransactionTableModel::~TransactionTableModel()
@@ -266,6 +332,12 @@ void TransactionTableModel::updateAmountColumnTitle()
     Q_EMIT headerDataChanged(Qt::Horizontal,Amount,Amount);
 }
 
+void TransactionTableModel::loadPendingTransactions()
+{
+    if (priv->loadPending(TX_LOAD_BATCH_SIZE))
+        QTimer::singleShot(0, this, SLOT(loadPendingTransactions()));
+}
+
 void TransactionTableModel::updateTransaction(const QString &hash, int status, bool showTransaction)
 {
     uint256 updated;
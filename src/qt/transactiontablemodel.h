@@ -105,6 +105,8 @@ private:
     QVariant txAddressDecoration(const TransactionRecord *wtx) const;
 
 public Q_SLOTS:
+    /* Decompose the next batch of the wallet's transactions, until all are in the model */
+    void loadPendingTransactions();
     /* New transaction, or transaction changed status */
     void updateTransaction(const QString &hash, int status, bool showTransaction);
     void updateConfirmations();
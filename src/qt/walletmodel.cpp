@@ -40,6 +40,49 @@
 #include <QSet>
 #include <QTimer>
 
+/* Computes the balances of a wallet on a thread of its own, blocking on
+ * cs_main and cs_wallet there rather than on the GUI thread.
+ */
+class WalletBalanceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WalletBalanceWorker(WalletModel *_model) :
+        model(_model), wallet(_model->wallet), nLastHeight(-1), nLastTxLocks(-1) {}
+
+public Q_SLOTS:
+    /* Compute the balances if the tip, InstantSend locks or wallet changed since the last time */
+    void poll()
+    {
+        model->fBalancePollQueued = false;
+
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+        }
+        const int nTxLocks = nCompleteTXLocks;
+        if (!model->fForceCheckBalanceChanged.exchange(false) && nHeight == nLastHeight && nTxLocks == nLastTxLocks)
+            return;
+        nLastHeight = nHeight;
+        nLastTxLocks = nTxLocks;
+
+        Q_EMIT balancesComputed(nHeight, wallet->GetBalances());
+    }
+
+Q_SIGNALS:
+    void balancesComputed(int nHeight, const CWalletBalances& balances);
+
+private:
+    WalletModel *model;
+    CWallet *wallet;
+    int nLastHeight;
+    int nLastTxLocks;
+};
+
+#include <qt/walletmodel.moc>
+
 
 WalletModel::WalletModel(const PlatformStyle *platformStyle, CWallet *_wallet, OptionsModel *_optionsModel, QObject *parent) :
     QObject(parent), wallet(_wallet), optionsModel(_optionsModel), addressTableModel(0),
@@ -48,16 +91,24 @@ WalletModel::WalletModel(const PlatformStyle *platformStyle, CWallet *_wallet, O
     cachedBalance(0), cachedUnconfirmedBalance(0), cachedImmatureBalance(0),
     cachedWatchOnlyBalance{0}, cachedWatchUnconfBalance{0}, cachedWatchImmatureBalance{0},
     cachedEncryptionStatus(Unencrypted),
-    cachedNumBlocks(0),
-    cachedTxLocks(0)
+    cachedNumBlocks(0)
 {
     fHaveWatchOnly = wallet->HaveWatchOnly();
     fForceCheckBalanceChanged = false;
+    fBalancePollQueued = false;
 
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(platformStyle, wallet, this);
     recentRequestsTableModel = new RecentRequestsTableModel(wallet, this);
 
+    qRegisterMetaType<CWalletBalances>("CWalletBalances");
+    WalletBalanceWorker *worker = new WalletBalanceWorker(this);
+    worker->moveToThread(&balanceThread);
+    connect(this, SIGNAL(balancePollRequested()), worker, SLOT(poll()));
+    connect(worker, SIGNAL(balancesComputed(int,CWalletBalances)), this, SLOT(setBalances(int,CWalletBalances)));
+    connect(&balanceThread, SIGNAL(finished()), worker, SLOT(deleteLater()), Qt::DirectConnection);
+    balanceThread.start();
+
     // This timer will be fired repeatedly to update the balance
     pollTimer = new QTimer(this);
     connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
@@ -69,6 +120,8 @@ WalletModel::WalletModel(const PlatformStyle *platformStyle, CWallet *_wallet, O
 WalletModel::~WalletModel()
 {
     unsubscribeFromCoreSignals();
+    balanceThread.quit();
+    balanceThread.wait();
 }
 
 CAmount WalletModel::getBalance(const CCoinControl *coinControl) const
@@ -121,52 +174,41 @@ void WalletModel::updateStatus()
 
 void WalletModel::pollBalanceChanged()
 {
-    // Get required locks upfront. This avoids the GUI from getting stuck on
-    // periodical polls if the core is holding the locks for a longer time -
-    // for example, during a wallet rescan.
-    TRY_LOCK(cs_main, lockMain);
-    if(!lockMain)
-        return;
-    TRY_LOCK(wallet->cs_wallet, lockWallet);
-    if(!lockWallet)
-        return;
-
-    if(fForceCheckBalanceChanged || chainActive.Height() != cachedNumBlocks || cachedTxLocks != nCompleteTXLocks)
-    {
-        fForceCheckBalanceChanged = false;
-
-        // Balance and number of transactions might have changed
-        cachedNumBlocks = chainActive.Height();
+    // Polls are cheap for the worker unless something changed, but one queued is enough
+    if (!fBalancePollQueued.exchange(true))
+        Q_EMIT balancePollRequested();
+}
 
-        checkBalanceChanged();
+void WalletModel::setBalances(int nHeight, const CWalletBalances& balances)
+{
+    if(nHeight != cachedNumBlocks)
+    {
+        // Number of confirmations might have changed
+        cachedNumBlocks = nHeight;
         if(transactionTableModel)
             transactionTableModel->updateConfirmations();
     }
-}
 
-void WalletModel::checkBalanceChanged()
-{
-    CAmount newBalance = getBalance();
-    CAmount newUnconfirmedBalance = getUnconfirmedBalance();
-    CAmount newImmatureBalance = getImmatureBalance();
+    CAmount newBalance = balances.nTrusted;
+    CAmount newUnconfirmedBalance = balances.nUntrustedPending;
+    CAmount newImmatureBalance = balances.nImmature;
     CAmount newWatchOnlyBalance = 0;
     CAmount newWatchUnconfBalance = 0;
     CAmount newWatchImmatureBalance = 0;
     if (haveWatchOnly())
     {
-        newWatchOnlyBalance = getWatchBalance();
-        newWatchUnconfBalance = getWatchUnconfirmedBalance();
-        newWatchImmatureBalance = getWatchImmatureBalance();
+        newWatchOnlyBalance = balances.nWatchOnlyTrusted;
+        newWatchUnconfBalance = balances.nWatchOnlyUntrustedPending;
+        newWatchImmatureBalance = balances.nWatchOnlyImmature;
     }
 
     if(cachedBalance != newBalance || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance
-        || cachedTxLocks != nCompleteTXLocks || cachedWatchOnlyBalance != newWatchOnlyBalance || cachedWatchUnconfBalance != newWatchUnconfBalance 
+        || cachedWatchOnlyBalance != newWatchOnlyBalance || cachedWatchUnconfBalance != newWatchUnconfBalance
         || cachedWatchImmatureBalance != newWatchImmatureBalance)
     {
         cachedBalance = newBalance;
         cachedUnconfirmedBalance = newUnconfirmedBalance;
         cachedImmatureBalance = newImmatureBalance;
-        cachedTxLocks = nCompleteTXLocks;
         cachedWatchOnlyBalance = newWatchOnlyBalance;
         cachedWatchUnconfBalance = newWatchUnconfBalance;
         cachedWatchImmatureBalance = newWatchImmatureBalance;
@@ -399,7 +441,9 @@ WalletModel::SendCoinsReturn WalletModel::sendCoins(WalletModelTransaction &tran
         }
         Q_EMIT coinsSent(wallet, rcp, transaction_array);
     }
-    checkBalanceChanged(); // update balance immediately, otherwise there could be a short noticeable delay until pollBalanceChanged hits
+    // update balance right away, otherwise there could be a short noticeable delay until pollBalanceChanged hits
+    fForceCheckBalanceChanged = true;
+    pollBalanceChanged();
 
     return SendCoinsReturn(OK);
 }
@@ -14,10 +14,12 @@
 
 #include <support/allocators/secure.h>
 
+#include <atomic>
 #include <map>
 #include <vector>
 
 #include <QObject>
+#include <QThread>
 
 enum OutputType : int;
 
@@ -232,7 +234,10 @@ public:
 private:
     CWallet *wallet;
     bool fHaveWatchOnly;
-    bool fForceCheckBalanceChanged;
+    /** Read and cleared by the balance worker */
+    std::atomic<bool> fForceCheckBalanceChanged;
+    /** Set while a poll is queued for the balance worker, so polls do not pile up behind a slow one */
+    std::atomic<bool> fBalancePollQueued;
 
     // Wallet has an options model for wallet-specific options
     // (transaction fee, for example)
@@ -251,15 +256,20 @@ private:
     CAmount cachedWatchImmatureBalance;
     EncryptionStatus cachedEncryptionStatus;
     int cachedNumBlocks;
-    int cachedTxLocks;
 
     QTimer *pollTimer;
+    /** Runs the WalletBalanceWorker, which takes the locks the balances need off the GUI thread */
+    QThread balanceThread;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
-    void checkBalanceChanged();
+
+    friend class WalletBalanceWorker;
 
 Q_SIGNALS:
+    // Ask the balance worker to check for changes
+    void balancePollRequested();
+
     // Signal that balance in wallet changed
     void balanceChanged(const CAmount& balance, const CAmount& unconfirmedBalance, const CAmount& immatureBalance,
                         const CAmount& watchOnlyBalance, const CAmount& watchUnconfBalance, const CAmount& watchImmatureBalance);
@@ -293,8 +303,12 @@ public Q_SLOTS:
     void updateAddressBook(const QString &address, const QString &label, bool isMine, const QString &purpose, int status);
     /* Watch-only added */
     void updateWatchOnlyFlag(bool fHaveWatchonly);
-    /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
+    /* Current, immature or unconfirmed balance might have changed - have the balance worker check */
     void pollBalanceChanged();
+    /* Balances computed by the balance worker at a tip height - emit 'balanceChanged' if they changed */
+    void setBalances(int nHeight, const CWalletBalances& balances);
 };
 
+Q_DECLARE_METATYPE(CWalletBalances)
+
 #endif // BITCOIN_QT_WALLETMODEL_H
@@ -3,18 +3,22 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockview.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <coinsreadview.h>
 #include <core_io.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <validation.h>
+#include <httprpc.h>
 #include <httpserver.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
 #include <txmempool.h>
+#include <util.h>
 #include <utilstrencodings.h>
 #include <version.h>
 
@@ -23,6 +27,9 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_HEADERS = 2000; //allow a max of 2000 headers to be queried at once
+static const long MAX_REST_BLOCKS = 1000; //allow a max of 1000 blocks to be queried at once
+static const size_t MAX_REST_BLOCKS_SIZE = 32 << 20; //end a range of blocks with the one that passes 32 MiB
 
 enum RetFormat {
     RF_UNDEF,
@@ -121,6 +128,47 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/** Reply with headers in the requested format */
+static bool WriteHeadersReply(HTTPRequest* req, RetFormat rf, const std::vector<const CBlockIndex *>& headers)
+{
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CBlockIndex *pindex : headers) {
+        ssHeader << pindex->GetBlockHeader(Params().GetConsensus());
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        std::string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RF_HEX: {
+        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RF_JSON: {
+        UniValue jsonHeaders(UniValue::VARR);
+        {
+            LOCK(cs_main);
+            for (const CBlockIndex *pindex : headers) {
+                jsonHeaders.push_back(blockheaderToJSON(pindex));
+            }
+        }
+        std::string strJSON = jsonHeaders.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -135,7 +183,7 @@ static bool rest_headers(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
     long count = strtol(path[0].c_str(), nullptr, 10);
-    if (count < 1 || count > 2000)
+    if (count < 1 || count > MAX_REST_HEADERS)
         return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
 
     std::string hashStr = path[1];
@@ -157,40 +205,162 @@ static bool rest_headers(HTTPRequest* req,
         }
     }
 
-    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-    for (const CBlockIndex *pindex : headers) {
-        ssHeader << pindex->GetBlockHeader(Params().GetConsensus());
+    return WriteHeadersReply(req, rf, headers);
+}
+
+/** Parse the <start>/<count> of a range of heights of the active chain, false after replying with an error */
+static bool ParseHeightRange(HTTPRequest* req, const std::string& strRange, long nMaxCount, int& nStart, int& nCount)
+{
+    std::vector<std::string> path;
+    boost::split(path, strRange, boost::is_any_of("/"));
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "No height range specified. Use <start>/<count>.<ext>.");
+    if (nCount < 1 || nCount > nMaxCount)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + path[1]);
+    LOCK(cs_main);
+    if (nStart < 0 || nStart > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Start height out of range: " + path[0]);
+    nCount = std::min(nCount, chainActive.Height() - nStart + 1);
+    return true;
+}
+
+static bool rest_headers_by_height(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    int nStart, nCount;
+    if (!ParseHeightRange(req, param, MAX_REST_HEADERS, nStart, nCount))
+        return false;
+
+    std::vector<const CBlockIndex *> headers;
+    headers.reserve(nCount);
+    {
+        LOCK(cs_main);
+        // The chain may have become shorter since the range was checked
+        for (int nHeight = nStart; nHeight < nStart + nCount && nHeight <= chainActive.Height(); nHeight++)
+            headers.push_back(chainActive[nHeight]);
+    }
+
+    return WriteHeadersReply(req, rf, headers);
+}
+
+/**
+ * Blocks of the active chain by height, read from the block files as they
+ * are stored and sent on as parts of a chunked reply, so they are not
+ * deserialized and a range is not held in memory at once. Only the raw
+ * formats are offered, the binary one is the blocks one after the other
+ * and the hex one a line per block.
+ */
+static bool rest_blocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    int nStart, nCount;
+    if (!ParseHeightRange(req, param, MAX_REST_BLOCKS, nStart, nCount))
+        return false;
+
+    std::vector<const CBlockIndex *> blocks;
+    blocks.reserve(nCount);
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight < nStart + nCount && nHeight <= chainActive.Height(); nHeight++) {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            blocks.push_back(pindex);
+        }
+    }
+
+    req->WriteHeader("Content-Type", rf == RF_BINARY ? "application/octet-stream" : "text/plain");
+    req->StartChunkedReply(HTTP_OK);
+    std::vector<unsigned char> block;
+    size_t nSize = 0;
+    for (const CBlockIndex* pindex : blocks) {
+        // The reply already started, a block that cannot be read ends it early.
+        if (!ReadRawBlockFromDisk(block, pindex, Params().MessageStart())) {
+            LogPrintf("%s: failed to read block %s, the range ends before it\n", __func__, pindex->GetBlockHash().ToString());
+            break;
+        }
+        if (rf == RF_BINARY)
+            req->WriteReplyChunk(std::string(block.begin(), block.end()));
+        else
+            req->WriteReplyChunk(HexStr(block) + "\n");
+        nSize += block.size();
+        if (nSize > MAX_REST_BLOCKS_SIZE)
+            break;
+    }
+    req->EndChunkedReply();
+    return true;
+}
+
+static bool rest_blocksbyalgo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2 && path.size() != 4)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No algo and count specified. Use /rest/blocksbyalgo/<algo>/<count>[/<startheight>/<endheight>].<ext>.");
+
+    bool fAlgoFound = false;
+    const uint8_t algo = GetAlgoByName(path[0], currentAlgo, fAlgoFound);
+    if (!fAlgoFound)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid algo: " + path[0]);
+
+    long count = strtol(path[1].c_str(), nullptr, 10);
+    if (count < 1 || count > 2000)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    std::vector<const CBlockIndex*> blocks;
+    {
+        LOCK(cs_main);
+        int nStartHeight = 0;
+        int nEndHeight = chainActive.Height();
+        if (path.size() == 4 && (!ParseInt32(path[2], &nStartHeight) || !ParseInt32(path[3], &nEndHeight)))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid heights: " + path[2] + "/" + path[3]);
+        if (nStartHeight < 0 || nEndHeight > chainActive.Height() || nStartHeight > nEndHeight)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Block height out of range");
+        if (algoHashrateIndex.Tip() != chainActive.Tip())
+            return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Hashrate index is not in sync with the active chain");
+        blocks = algoHashrateIndex.GetBlocks(algo, nStartHeight, nEndHeight, count);
+    }
+
+    CDataStream ssHashes(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CBlockIndex* pindex : blocks) {
+        ssHashes << pindex->GetBlockHash();
     }
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryHeader = ssHeader.str();
+        std::string binaryHashes = ssHashes.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryHeader);
+        req->WriteReply(HTTP_OK, binaryHashes);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        std::string strHex = HexStr(ssHashes.begin(), ssHashes.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
     case RF_JSON: {
-        UniValue jsonHeaders(UniValue::VARR);
-        {
-            LOCK(cs_main);
-            for (const CBlockIndex *pindex : headers) {
-                jsonHeaders.push_back(blockheaderToJSON(pindex));
-            }
-        }
-        std::string strJSON = jsonHeaders.write() + "\n";
+        std::string strJSON = blocksByAlgoToJSON(blocks).write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
     }
     default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
     }
     }
 }
@@ -218,11 +388,26 @@ static bool rest_block(HTTPRequest* req,
         pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+    }
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    // The stored block is the serialization asked for unless flags strip the witness
+    if ((rf == RF_BINARY || rf == RF_HEX) && RPCSerializationFlags() == 0) {
+        CRawBlockView view;
+        if (!view.Read(pblockindex, Params().MessageStart()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, std::string(view.begin(), view.end()));
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(view.begin(), view.end()) + "\n");
+        }
+        return true;
     }
 
+    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
 
@@ -242,12 +427,12 @@ static bool rest_block(HTTPRequest* req,
     }
 
     case RF_JSON: {
-        UniValue objBlock;
+        std::string strJSON;
         {
             LOCK(cs_main);
-            objBlock = blockToJSON(block, pblockindex, showTxDetails);
+            blockToJSON(block, pblockindex, showTxDetails, strJSON);
         }
-        std::string strJSON = objBlock.write() + "\n";
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -295,6 +480,14 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+// The RPC call stats for a Prometheus scraper, only served with -restrpcstats
+static bool rest_rpcstats(HTTPRequest* req, const std::string& strURIPart)
+{
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, RPCStatsToPrometheus());
+    return true;
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -388,6 +581,32 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     }
 }
 
+/** Look up the outpoints in viewChain, with the mempool on top of it if fCheckMemPool. Requires mempool.cs. */
+static void CheckUTXOs(CCoinsView& viewChain, bool fCheckMemPool, const std::vector<COutPoint>& vOutPoints,
+                       std::vector<unsigned char>& bitmap, std::vector<CCoin>& outs, std::string& bitmapStringRepresentation)
+{
+    AssertLockHeld(mempool.cs);
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    CCoinsViewMemPool viewMempool(&viewChain, mempool);
+
+    if (fCheckMemPool)
+        view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
+
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        bool hit = false;
+        Coin coin;
+        if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
+            hit = true;
+            outs.emplace_back(std::move(coin));
+        }
+
+        bitmapStringRepresentation.append(hit ? "1" : "0"); // form a binary string representation (human-readable for json output)
+        bitmap[i / 8] |= ((uint8_t)hit) << (i % 8);
+    }
+}
+
 static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -484,32 +703,20 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     std::vector<unsigned char> bitmap;
     std::vector<CCoin> outs;
     std::string bitmapStringRepresentation;
-    std::vector<bool> hits;
+    int nChainHeight;
+    uint256 hashChainTip;
     bitmap.resize((vOutPoints.size() + 7) / 8);
-    {
+    std::shared_ptr<CCoinsReadView> pcoinsview = GetCoinsReadView();
+    if (pcoinsview) {
+        LOCK(mempool.cs);
+        CheckUTXOs(*pcoinsview, fCheckMemPool, vOutPoints, bitmap, outs, bitmapStringRepresentation);
+        nChainHeight = pcoinsview->GetHeight();
+        hashChainTip = pcoinsview->GetBestBlock();
+    } else {
         LOCK2(cs_main, mempool.cs);
-
-        CCoinsView viewDummy;
-        CCoinsViewCache view(&viewDummy);
-
-        CCoinsViewCache& viewChain = *pcoinsTip;
-        CCoinsViewMemPool viewMempool(&viewChain, mempool);
-
-        if (fCheckMemPool)
-            view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
-
-        for (size_t i = 0; i < vOutPoints.size(); i++) {
-            bool hit = false;
-            Coin coin;
-            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
-                hit = true;
-                outs.emplace_back(std::move(coin));
-            }
-
-            hits.push_back(hit);
-            bitmapStringRepresentation.append(hit ? "1" : "0"); // form a binary string representation (human-readable for json output)
-            bitmap[i / 8] |= ((uint8_t)hit) << (i % 8);
-        }
+        CheckUTXOs(*pcoinsTip, fCheckMemPool, vOutPoints, bitmap, outs, bitmapStringRepresentation);
+        nChainHeight = chainActive.Height();
+        hashChainTip = chainActive.Tip()->GetBlockHash();
     }
 
     switch (rf) {
@@ -517,7 +724,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         // serialize data
         // use exact same output as mentioned in Bip64
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         std::string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -527,7 +734,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
     case RF_HEX: {
         CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        ssGetUTXOResponse << nChainHeight << hashChainTip << bitmap << outs;
         std::string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -540,8 +747,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.pushKV("chainHeight", chainActive.Height());
-        objGetUTXOResponse.pushKV("chaintipHash", chainActive.Tip()->GetBlockHash().GetHex());
+        objGetUTXOResponse.pushKV("chainHeight", nChainHeight);
+        objGetUTXOResponse.pushKV("chaintipHash", hashChainTip.GetHex());
         objGetUTXOResponse.pushKV("bitmap", bitmapStringRepresentation);
 
         UniValue utxos(UniValue::VARR);
@@ -580,7 +787,10 @@ static const struct {
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
+      {"/rest/headers/height/", rest_headers_by_height},
       {"/rest/headers/", rest_headers},
+      {"/rest/blocks/", rest_blocks},
+      {"/rest/blocksbyalgo/", rest_blocksbyalgo},
       {"/rest/getutxos", rest_getutxos},
 };
 
@@ -588,6 +798,8 @@ bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    if (gArgs.GetBoolArg("-restrpcstats", DEFAULT_REST_RPCSTATS))
+        RegisterHTTPHandler("/rest/rpcstats", true, rest_rpcstats);
     return true;
 }
 
@@ -599,4 +811,5 @@ void StopREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         UnregisterHTTPHandler(uri_prefixes[i].prefix, false);
+    UnregisterHTTPHandler("/rest/rpcstats", true);
 }
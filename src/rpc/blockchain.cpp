@@ -5,23 +5,31 @@
 
 #include <rpc/blockchain.h>
 
+#include <addressindex.h>
 #include <amount.h>
+#include <blockview.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinsreadview.h>
+#include <coinstats.h>
 #include <consensus/validation.h>
 #include <instantx.h>
+#include <jsonwriter.h>
 #include <globaltoken/hardfork.h>
 #include <validation.h>
 #include <core_io.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
+#include <snapshot.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -186,7 +194,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     CBlockHeader header = blockindex->GetBlockHeader(Params().GetConsensus());
     bool isauxpow = header.auxpow && (header.auxpow != nullptr);
 	const CBlockIndex *pnext = chainActive.Next(blockindex);
-	const CBlockIndex* plastAlgo = GetLastBlockIndexForAlgo(blockindex->pprev, algo, Params().GetConsensus());
+	const CBlockIndex* plastAlgo = GetPrevBlockIndexForAlgo(blockindex, Params().GetConsensus());
 	const CBlockIndex* pnextAlgo = GetNextBlockIndexForAlgo(pnext, algo);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
 	result.pushKV("algo", GetAlgoName(algo));
@@ -206,11 +214,14 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.pushKV("time", (int64_t)blockindex->nTime);
     result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
     if(IsEquihashBasedAlgo(algo))
-        result.pushKV("nonce", blockindex->nBigNonce.GetHex());
+    {
+        std::shared_ptr<const CEquihashFields> equihashfields = blockindex->GetEquihashFields();
+        result.pushKV("nonce", equihashfields->nBigNonce.GetHex());
+        if(!isauxpow)
+            result.pushKV("solution", HexStr(equihashfields->nSolution));
+    }
     else
         result.pushKV("nonce", (uint64_t)blockindex->nNonce);
-    if(!isauxpow && IsEquihashBasedAlgo(algo))
-        result.pushKV("solution", HexStr(blockindex->nSolution));
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex, algo));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
@@ -226,14 +237,13 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+/** The fields blockToJSON describes before and after the transactions */
+static void BlockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result, UniValue& after)
 {
-    AssertLockHeld(cs_main);
-    UniValue result(UniValue::VOBJ);
 	uint8_t algo = block.GetAlgo();
     bool isauxpow = block.auxpow && (block.auxpow != nullptr);
 	const CBlockIndex *pnext = chainActive.Next(blockindex);
-	const CBlockIndex* plastAlgo = GetLastBlockIndexForAlgo(blockindex->pprev, algo, Params().GetConsensus());
+	const CBlockIndex* plastAlgo = GetPrevBlockIndexForAlgo(blockindex, Params().GetConsensus());
 	const CBlockIndex* pnextAlgo = GetNextBlockIndexForAlgo(pnext, algo);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
@@ -248,10 +258,42 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.pushKV("algo", GetAlgoName(algo));
 	result.pushKV("algoid", algo);
     if(!isauxpow)
-        result.pushKV("algopowhash", block.GetPoWHash(SER_GETHASH, LoadMultiHasherVersionFlags(Params().GetConsensus().Hardfork3.IsActivated(block.nTime))).GetHex());
+        result.pushKV("algopowhash", GetCachedPoWHash(block, block.GetAlgo(), LoadMultiHasherVersionFlags(Params().GetConsensus().Hardfork3.IsActivated(block.nTime))).GetHex());
     result.pushKV("version", block.nVersion);
     result.pushKV("versionHex", strprintf("%08x", block.nVersion));
     result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
+
+    after.pushKV("time", block.GetBlockTime());
+    after.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
+    if(IsEquihashBasedAlgo(algo))
+        after.pushKV("nonce", block.nBigNonce.GetHex());
+    else
+        after.pushKV("nonce", (uint64_t)block.nNonce);
+    if(!isauxpow && IsEquihashBasedAlgo(algo))
+        after.pushKV("solution", HexStr(block.nSolution));
+    after.pushKV("bits", strprintf("%08x", block.nBits));
+    after.pushKV("difficulty", GetDifficulty(blockindex, algo));
+    after.pushKV("chainwork", blockindex->nChainWork.GetHex());
+    
+    if (block.auxpow)
+        after.pushKV("auxpow", AuxpowToJSON(*block.auxpow, algo));
+
+    if (blockindex->pprev)
+        after.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+	if (plastAlgo != nullptr)
+		after.pushKV("previousalgohash", plastAlgo->GetBlockHash().GetHex());
+    if (pnext)
+        after.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
+	if (pnextAlgo != nullptr)
+		after.pushKV("nextalgohash", pnextAlgo->GetBlockHash().GetHex());
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    AssertLockHeld(cs_main);
+    UniValue result(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    BlockFieldsToJSON(block, blockindex, result, after);
     UniValue txs(UniValue::VARR);
     for(const auto& tx : block.vtx)
     {
@@ -265,32 +307,42 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
             txs.push_back(tx->GetHash().GetHex());
     }
     result.pushKV("tx", txs);
-    result.pushKV("time", block.GetBlockTime());
-    result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
-    if(IsEquihashBasedAlgo(algo))
-        result.pushKV("nonce", block.nBigNonce.GetHex());
-    else
-        result.pushKV("nonce", (uint64_t)block.nNonce);
-    if(!isauxpow && IsEquihashBasedAlgo(algo))
-        result.pushKV("solution", HexStr(blockindex->nSolution));
-    result.pushKV("bits", strprintf("%08x", block.nBits));
-    result.pushKV("difficulty", GetDifficulty(blockindex, algo));
-    result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    
-    if (block.auxpow)
-        result.pushKV("auxpow", AuxpowToJSON(*block.auxpow, algo));
-
-    if (blockindex->pprev)
-        result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-	if (plastAlgo != nullptr)
-		result.pushKV("previousalgohash", plastAlgo->GetBlockHash().GetHex());
-    if (pnext)
-        result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
-	if (pnextAlgo != nullptr)
-		result.pushKV("nextalgohash", pnextAlgo->GetBlockHash().GetHex());
+    result.pushKVs(after);
     return result;
 }
 
+//! Bytes of JSON text blockToJSON collects before it passes them on to a stream
+static const size_t BLOCK_JSON_STREAM_BYTES = 1 << 20;
+
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, std::string& strJSON, JSONRPCResultStream* stream)
+{
+    AssertLockHeld(cs_main);
+    UniValue before(UniValue::VOBJ);
+    UniValue after(UniValue::VOBJ);
+    BlockFieldsToJSON(block, blockindex, before, after);
+
+    CJSONWriter writer(strJSON);
+    writer.BeginObject();
+    for (size_t i = 0; i < before.size(); i++)
+        writer.KV(before.getKeys()[i], before.getValues()[i]);
+    writer.Key("tx");
+    writer.BeginArray();
+    for (const auto& tx : block.vtx) {
+        if (txDetails)
+            TxToJSON(*tx, uint256(), writer, true, RPCSerializationFlags());
+        else
+            writer.Value(tx->GetHash().GetHex());
+        if (stream && strJSON.size() >= BLOCK_JSON_STREAM_BYTES) {
+            stream->Write(strJSON);
+            strJSON.clear();
+        }
+    }
+    writer.EndArray();
+    for (size_t i = 0; i < after.size(); i++)
+        writer.KV(after.getKeys()[i], after.getValues()[i]);
+    writer.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -545,7 +597,7 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.pushKV("instantlock", instantsend.IsLockedInstantSendTransaction(tx.GetHash()));
 }
 
-UniValue mempoolToJSON(bool fVerbose)
+UniValue mempoolToJSON(bool fVerbose, bool fIncludeMempoolSequence)
 {
     if (fVerbose)
     {
@@ -563,36 +615,99 @@ UniValue mempoolToJSON(bool fVerbose)
     else
     {
         std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
+        uint64_t nMempoolSequence;
+        {
+            LOCK(mempool.cs);
+            mempool.queryHashes(vtxid);
+            nMempoolSequence = mempool.GetSequence();
+        }
 
         UniValue a(UniValue::VARR);
         for (const uint256& hash : vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        if (!fIncludeMempoolSequence)
+            return a;
+
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txids", a);
+        o.pushKV("mempool_sequence", nMempoolSequence);
+        return o;
+    }
+}
+
+//! Number of verbose getrawmempool entries described per mempool.cs lock
+static const size_t MEMPOOL_STREAM_BATCH_SIZE = 1000;
+
+/** Write the verbose mempool in parts, holding mempool.cs for one part at a
+ *  time instead of building the whole object. The transactions are those in
+ *  the mempool when the walk starts, less the ones removed before their part
+ *  is written. Each entry is described as of its part. */
+static void StreamMempoolToJSON(JSONRPCResultStream& stream)
+{
+    std::vector<uint256> vtxid;
+    {
+        LOCK(mempool.cs);
+        vtxid.reserve(mempool.mapTx.size());
+        for (const CTxMemPoolEntry& e : mempool.mapTx)
+            vtxid.push_back(e.GetTx().GetHash());
     }
+
+    std::string strPart = "{";
+    bool fFirst = true;
+    for (size_t nStart = 0; nStart < vtxid.size(); nStart += MEMPOOL_STREAM_BATCH_SIZE) {
+        {
+            LOCK(mempool.cs);
+            const size_t nEnd = std::min(vtxid.size(), nStart + MEMPOOL_STREAM_BATCH_SIZE);
+            for (size_t i = nStart; i < nEnd; i++) {
+                auto it = mempool.mapTx.find(vtxid[i]);
+                if (it == mempool.mapTx.end())
+                    continue;
+                UniValue info(UniValue::VOBJ);
+                entryToJSON(info, *it);
+                if (!fFirst)
+                    strPart += ",";
+                fFirst = false;
+                strPart += "\"" + vtxid[i].ToString() + "\":" + info.write();
+            }
+        }
+        stream.Write(strPart);
+        strPart.clear();
+    }
+    stream.Write(strPart + "}");
 }
 
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n"
             "\nArguments:\n"
             "1. verbose (boolean, optional, default=false) True for a json object, false for array of transaction ids\n"
+            "2. mempool_sequence (boolean, optional, default=false) If verbose=false, returns a json object with transaction list and mempool sequence number attached.\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                            (json object)\n"
+            "  \"txids\" : [               (json array of string)\n"
+            "    \"transactionid\"        (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"mempool_sequence\" : n    (numeric) The mempool sequence value, the -zmqpubsequence number of the next mempool change\n"
+            "}\n"
             "\nResult: (for verbose = true):\n"
             "{                           (json object)\n"
             "  \"transactionid\" : {       (json object)\n"
             + EntryDescriptionString()
             + "  }, ...\n"
             "}\n"
+            "\nThe verbose result is sent in parts over HTTP, letting the mempool change in between.\n"
+            "Transactions removed meanwhile are left out.\n"
             "\nExamples:\n"
             + HelpExampleCli("getrawmempool", "true")
             + HelpExampleRpc("getrawmempool", "true")
@@ -602,7 +717,18 @@ UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    bool fIncludeMempoolSequence = false;
+    if (!request.params[1].isNull())
+        fIncludeMempoolSequence = request.params[1].get_bool();
+
+    if (fVerbose && fIncludeMempoolSequence)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+
+    if (fVerbose && request.resultStream) {
+        StreamMempoolToJSON(*request.resultStream);
+        return NullUniValue;
+    }
+    return mempoolToJSON(fVerbose, fIncludeMempoolSequence);
 }
 
 UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -791,6 +917,108 @@ UniValue getblockhash(const JSONRPCRequest& request)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 2)
+        throw std::runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns the hashes of the blocks of the active chain with a timestamp in a range,\n"
+            "from the timestamp index (requires -timestampindex).\n"
+            "\nArguments:\n"
+            "1. high         (numeric, required) The timestamp the range ends before\n"
+            "2. low          (numeric, required) The first timestamp of the range\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash, in the order of the timestamps\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockhashes", "1231614698 1231024505")
+            + HelpExampleRpc("getblockhashes", "1231614698, 1231024505")
+        );
+
+    if (!paddressindex || !paddressindex->HasTimestampIndex())
+        throw JSONRPCError(RPC_MISC_ERROR, "This call needs -timestampindex");
+    if (!paddressindex->IsSynced())
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is still being built");
+
+    const int64_t nHigh = request.params[0].get_int64();
+    const int64_t nLow = request.params[1].get_int64();
+    if (nLow < 0 || nHigh < nLow || nHigh > std::numeric_limits<unsigned int>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid timestamp range");
+
+    std::vector<uint256> hashes;
+    if (!paddressindex->ReadTimestampIndex(nHigh, nLow, hashes))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the timestamp index");
+
+    UniValue result(UniValue::VARR);
+    for (const uint256& hash : hashes)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
+UniValue blocksByAlgoToJSON(const std::vector<const CBlockIndex*>& blocks)
+{
+    UniValue result(UniValue::VARR);
+    for (const CBlockIndex* pindex : blocks) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("height", pindex->nHeight);
+        entry.pushKV("hash", pindex->GetBlockHash().GetHex());
+        entry.pushKV("time", pindex->GetBlockTime());
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue getblocksbyalgo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+        throw std::runtime_error(strprintf(
+            "getblocksbyalgo \"algo\" ( count startheight endheight )\n"
+            "\nReturns the last blocks of the active chain mined with an algo, in a range of heights.\n"
+            "\nArguments:\n"
+            "1. \"algo\"        (string, required) The algorithm of the blocks. (%s)\n"
+            "2. count         (numeric, optional, default=%d) The most blocks to return, the last ones of the range.\n"
+            "3. startheight   (numeric, optional, default=0) The first height of the range.\n"
+            "4. endheight     (numeric, optional, default=the tip) The last height of the range.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": xxxxxx,      (numeric) the height of the block\n"
+            "    \"hash\": \"hash\",       (string) the block hash\n"
+            "    \"time\": xxxxxx         (numeric) the block time in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblocksbyalgo", "\"sha256d\" 10")
+            + HelpExampleCli("getblocksbyalgo", "\"sha256d\" 100 1000 2000")
+            + HelpExampleRpc("getblocksbyalgo", "\"sha256d\", 100, 1000, 2000")
+        , GetAlgoRangeString(), DEFAULT_GETBLOCKSBYALGO_COUNT));
+
+    LOCK(cs_main);
+
+    bool fAlgoFound = false;
+    uint8_t algo = GetAlgoByName(request.params[0].get_str(), currentAlgo, fAlgoFound);
+    if (!fAlgoFound)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid mining algorithm '%s' selected. Available algorithms: %s", request.params[0].get_str(), GetAlgoRangeString()));
+
+    int nCount = DEFAULT_GETBLOCKSBYALGO_COUNT;
+    if (!request.params[1].isNull()) {
+        nCount = request.params[1].get_int();
+        if (nCount < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be positive");
+    }
+    int nStartHeight = request.params[2].isNull() ? 0 : request.params[2].get_int();
+    int nEndHeight = request.params[3].isNull() ? chainActive.Height() : request.params[3].get_int();
+    if (nStartHeight < 0 || nEndHeight > chainActive.Height() || nStartHeight > nEndHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+
+    if (algoHashrateIndex.Tip() != chainActive.Tip())
+        throw JSONRPCError(RPC_IN_WARMUP, "Hashrate index is not in sync with the active chain");
+
+    return blocksByAlgoToJSON(algoHashrateIndex.GetBlocks(algo, nStartHeight, nEndHeight, nCount));
+}
+
 UniValue getblockheader(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -926,6 +1154,14 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    // The stored block is the serialization asked for unless flags strip the witness
+    if (verbosity <= 0 && RPCSerializationFlags() == 0) {
+        CRawBlockView view;
+        if (!view.Read(pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        return HexStr(view.begin(), view.end());
+    }
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -942,6 +1178,14 @@ UniValue getblock(const JSONRPCRequest& request)
         return strHex;
     }
 
+    // Written straight to the reply where possible, large blocks with
+    // verbosity 2 would take many small UniValue objects otherwise
+    if (request.resultStream) {
+        std::string strJSON;
+        blockToJSON(block, pblockindex, verbosity >= 2, strJSON, request.resultStream);
+        request.resultStream->Write(strJSON);
+        return NullUniValue;
+    }
     return blockToJSON(block, pblockindex, verbosity >= 2);
 }
 
@@ -1065,31 +1309,80 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(height);
 }
 
+//! Look up an active chain block by height (number or decimal string) or hash
+static const CBlockIndex* ParseHashOrHeight(const UniValue& param)
+{
+    AssertLockHeld(cs_main);
+    int nHeight = -1;
+    if (param.isNum()) {
+        nHeight = param.get_int();
+    } else if (param.get_str().size() != 64) {
+        if (!ParseInt32(param.get_str(), &nHeight))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height or hash: " + param.get_str());
+    } else {
+        uint256 hash = ParseHashV(param, "hash_or_height");
+        BlockMap::iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        if (!chainActive.Contains(it->second))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block is not in the main chain");
+        return it->second;
+    }
+    if (nHeight < 0 || nHeight > chainActive.Height())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    return chainActive[nHeight];
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_or_height\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless -coinstatsindex is enabled.\n"
+            "\nArguments:\n"
+            "1. \"hash_or_height\"   (string or numeric, optional) The block the statistics are for, default the chain tip.\n"
+            "                       Requires -coinstatsindex.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, not with -coinstatsindex\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, not with -coinstatsindex\n"
+            "  \"muhash\": \"hash\",     (string) The MuHash3072 of the unspent outputs, only with -coinstatsindex\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk, not for past blocks\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    if (fCoinStatsIndex) {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = request.params[0].isNull() ? chainActive.Tip() : ParseHashOrHeight(request.params[0]);
+        CCoinStatsEntry entry;
+        if (!coinstatsindex.LookUpStats(pindex, entry))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics");
+        ret.pushKV("height", (int64_t)pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)entry.nTransactionOutputs);
+        ret.pushKV("bogosize", (int64_t)entry.nBogoSize);
+        ret.pushKV("muhash", entry.hashMuHash.GetHex());
+        if (pindex == chainActive.Tip())
+            ret.pushKV("disk_size", (uint64_t)pcoinsdbview->EstimateSize());
+        ret.pushKV("total_amount", ValueFromAmount(entry.nTotalAmount));
+        return ret;
+    }
+
+    if (!request.params[0].isNull())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Statistics for past blocks need -coinstatsindex");
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
@@ -1107,6 +1400,17 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+/** Look up an unspent output in viewChain, or in the mempool on top of it if fMempool */
+static bool GetUnspentCoin(CCoinsView& viewChain, const COutPoint& out, bool fMempool, Coin& coin)
+{
+    if (fMempool) {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool view(&viewChain, mempool);
+        return view.GetCoin(out, coin) && !mempool.isSpent(out);
+    }
+    return viewChain.GetCoin(out, coin);
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1145,8 +1449,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             + HelpExampleRpc("gettxout", "\"txid\", 1")
         );
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     std::string strHash = request.params[0].get_str();
@@ -1158,25 +1460,29 @@ UniValue gettxout(const JSONRPCRequest& request)
         fMempool = request.params[2].get_bool();
 
     Coin coin;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip.get(), mempool);
-        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) {
+    uint256 hashBestBlock;
+    int nBestHeight;
+    std::shared_ptr<CCoinsReadView> pcoinsview = GetCoinsReadView();
+    if (pcoinsview) {
+        if (!GetUnspentCoin(*pcoinsview, out, fMempool, coin))
             return NullUniValue;
-        }
+        hashBestBlock = pcoinsview->GetBestBlock();
+        nBestHeight = pcoinsview->GetHeight();
     } else {
-        if (!pcoinsTip->GetCoin(out, coin)) {
+        LOCK(cs_main);
+        if (!GetUnspentCoin(*pcoinsTip, out, fMempool, coin))
             return NullUniValue;
-        }
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        CBlockIndex *pindex = it->second;
+        hashBestBlock = pindex->GetBlockHash();
+        nBestHeight = pindex->nHeight;
     }
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
-    ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+    ret.pushKV("bestblock", hashBestBlock.GetHex());
     if (coin.nHeight == MEMPOOL_HEIGHT) {
         ret.pushKV("confirmations", 0);
     } else {
-        ret.pushKV("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1));
+        ret.pushKV("confirmations", (int64_t)(nBestHeight - coin.nHeight + 1));
     }
     ret.pushKV("value", ValueFromAmount(coin.out.nValue));
     UniValue o(UniValue::VOBJ);
@@ -1305,9 +1611,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"chainwork\": \"xxxx\"           (string) total amount of work in active chain, in hexadecimal\n"
             "  \"size_on_disk\": xxxxxx,       (numeric) the estimated size of the block and undo files on disk\n"
             "  \"pruned\": xx,                 (boolean) if the blocks are subject to pruning\n"
+            "  \"headersonly\": xx,            (boolean) if only block headers are synced (-headersonly)\n"
             "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"txindex\": {                  (object) the transaction index (only present if -txindex is enabled)\n"
+            "     \"synced\": xx,              (boolean) whether it reached the tip, lookups of transactions it has not indexed yet scan the block of an unspent output\n"
+            "     \"bestblockheight\": xxxxxx  (numeric) the height of the last block indexed\n"
+            "  },\n"
             "  \"softforks\": [                (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",           (string) name of softfork\n"
@@ -1364,6 +1675,7 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.pushKV("chainwork",             chainActive.Tip()->nChainWork.GetHex());
     obj.pushKV("size_on_disk",          CalculateCurrentUsage());
     obj.pushKV("pruned",                fPruneMode);
+    obj.pushKV("headersonly",           fHeadersOnly);
     if (fPruneMode) {
         CBlockIndex* block = chainActive.Tip();
         assert(block);
@@ -1381,6 +1693,13 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
+    if (ptxindex) {
+        UniValue txindex(UniValue::VOBJ);
+        txindex.pushKV("synced",            ptxindex->IsSynced());
+        txindex.pushKV("bestblockheight",   ptxindex->GetBestHeight());
+        obj.pushKV("txindex",            txindex);
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
     UniValue softforks(UniValue::VARR);
@@ -1783,6 +2102,92 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue SnapshotMetadataToJSON(const fs::path& path, const CSnapshotMetadata& metadata)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("path", path.string());
+    ret.pushKV("base_hash", metadata.hashBaseBlock.GetHex());
+    ret.pushKV("base_height", (int64_t)metadata.nBaseHeight);
+    ret.pushKV("txouts", (int64_t)metadata.nCoins);
+    ret.pushKV("total_amount", ValueFromAmount(metadata.nTotalAmount));
+    ret.pushKV("muhash", metadata.hashMuHash.GetHex());
+    return ret;
+}
+
+static const std::string SNAPSHOT_RESULT_HELP =
+    "{\n"
+    "  \"path\": \"path\",         (string) The absolute path of the snapshot\n"
+    "  \"base_hash\": \"hash\",    (string) The hash of the block the coins are as of\n"
+    "  \"base_height\": n,        (numeric) The height of that block\n"
+    "  \"txouts\": n,             (numeric) The number of unspent outputs\n"
+    "  \"total_amount\": x.xxx,   (numeric) The total amount\n"
+    "  \"muhash\": \"hash\"        (string) The MuHash3072 of the unspent outputs, as gettxoutsetinfo reports with -coinstatsindex\n"
+    "}\n";
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set as of the chain tip to a snapshot file,\n"
+            "which another node can bootstrap from with loadtxoutset.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory unless absolute.\n"
+            "              It must not exist yet.\n"
+            "\nResult:\n"
+            + SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CSnapshotMetadata metadata;
+    std::string strError;
+    if (!DumpTxOutSet(path, metadata, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotMetadataToJSON(path, metadata);
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 3)
+        throw std::runtime_error(
+            "loadtxoutset \"path\" \"blockhash\" \"muhash\"\n"
+            "\nLoads a snapshot written by dumptxoutset and continues the active chain from its block,\n"
+            "then downloads and validates the blocks up to there in the background.\n"
+            "The headers up to that block must be synced (e.g. with -headersonly) and no other block connected yet.\n"
+            "Not with -prune or any index, so only in -litemode outside regtest.\n"
+            "The file itself only proves that its coins match its own header. Until the background validation\n"
+            "reaches the snapshot's block, the node relies on the blockhash and muhash given here, so take them\n"
+            "from a source you trust, e.g. the dumptxoutset result or gettxoutsetinfo with -coinstatsindex of\n"
+            "your own node. If the blocks turn out not to lead to the snapshot, the node shuts down.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"        (string, required) The snapshot, relative to the data directory unless absolute.\n"
+            "2. \"blockhash\"   (string, required) The hash of the block the snapshot must be of.\n"
+            "3. \"muhash\"      (string, required) The MuHash3072 the unspent outputs of the snapshot must have.\n"
+            "\nResult:\n"
+            + SNAPSHOT_RESULT_HELP +
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\" \"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"4d2c1c8ba4e7bd1e4e23b5a5e1b6c6f2c8bc4d7f3f2e7b7c1d3a1a2b3c4d5e6f\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", \"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"4d2c1c8ba4e7bd1e4e23b5a5e1b6c6f2c8bc4d7f3f2e7b7c1d3a1a2b3c4d5e6f\"")
+        );
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    const uint256 hashExpectedBase = ParseHashV(request.params[1], "blockhash");
+    const uint256 hashExpectedMuHash = ParseHashV(request.params[2], "muhash");
+    CSnapshotMetadata metadata;
+    std::string strError;
+    if (!LoadTxOutSet(path, hashExpectedBase, hashExpectedMuHash, metadata, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotMetadataToJSON(path, metadata);
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1792,6 +2197,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         {"high","low"} },
+    { "blockchain",         "getblocksbyalgo",        &getblocksbyalgo,        {"algo","count","startheight","endheight"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
@@ -1799,9 +2206,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose", "mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_or_height"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path","blockhash","muhash"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
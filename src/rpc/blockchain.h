@@ -5,10 +5,16 @@
 #ifndef BITCOIN_RPC_BLOCKCHAIN_H
 #define BITCOIN_RPC_BLOCKCHAIN_H
 #include <stdint.h>
+#include <string>
+#include <vector>
 class CBlock;
 class CBlockIndex;
+class JSONRPCResultStream;
 class UniValue;
 
+/** Blocks getblocksbyalgo returns when no count is given */
+static const int DEFAULT_GETBLOCKSBYALGO_COUNT = 10;
+
 /**
  * Get the difficulty of the net wrt to the given block index, or the chain tip if
  * not provided.
@@ -23,14 +29,21 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+/** Block description appended to strJSON as JSON text, the same UniValue::write() makes of the above
+ *  without building it first. With a stream, the text is passed on to it in parts as it grows,
+ *  the caller writes what is left in strJSON. */
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, std::string& strJSON, JSONRPCResultStream* stream = nullptr);
 
 /** Mempool information to JSON */
 UniValue mempoolInfoToJSON();
 
 /** Mempool to JSON */
-UniValue mempoolToJSON(bool fVerbose = false);
+UniValue mempoolToJSON(bool fVerbose = false, bool fIncludeMempoolSequence = false);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
+/** Height, hash and time of blocks, as getblocksbyalgo lists them */
+UniValue blocksByAlgoToJSON(const std::vector<const CBlockIndex*>& blocks);
+
 #endif
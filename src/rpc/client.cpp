@@ -31,10 +31,15 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setmocktime", 0, "timestamp" },
     { "generate", 0, "nblocks" },
     { "generate", 1, "maxtries" },
+    { "generate", 3, "threads" },
     { "generatetoaddress", 0, "nblocks" },
     { "generatetoaddress", 2, "maxtries" },
+    { "generatetoaddress", 4, "threads" },
     { "getnetworkhashps", 0, "nblocks" },
     { "getnetworkhashps", 1, "height" },
+    { "getalgohashratehistory", 1, "startheight" },
+    { "getalgohashratehistory", 2, "endheight" },
+    { "getalgohashratehistory", 3, "interval" },
     { "sendtoaddress", 1, "amount" },
     { "sendtoaddress", 4, "subtractfeefromamount" },
     { "sendtoaddress", 5, "use_is" },
@@ -61,6 +66,16 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getbalance", 2, "addlockconf" },
     { "getbalance", 3, "include_watchonly" },
     { "getblockhash", 0, "height" },
+    { "getblockhashes", 0, "high" },
+    { "getblockhashes", 1, "low" },
+    { "getblocksbyalgo", 1, "count" },
+    { "getblocksbyalgo", 2, "startheight" },
+    { "getblocksbyalgo", 3, "endheight" },
+    { "startjob", 1, "params" },
+    { "getaddressbalance", 0, "addresses" },
+    { "getaddresstxids", 0, "addresses" },
+    { "getaddressutxos", 0, "addresses" },
+    { "getspentinfo", 0, "json" },
     { "waitforblockheight", 0, "height" },
     { "waitforblockheight", 1, "timeout" },
     { "waitforblock", 1, "timeout" },
@@ -122,9 +137,13 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "signrawtransactionwithwallet", 1, "prevtxs" },
     { "sendrawtransaction", 1, "allowhighfees" },
     { "sendrawtransaction", 2, "instantsend" },
+    { "sendrawtransactions", 0, "hexstrings" },
+    { "sendrawtransactions", 1, "allowhighfees" },
     { "broadcastsignedproposal", 1, "allowhighfees" },
     { "broadcastallsignedproposals", 0, "allowhighfees" },
     { "submitauxblock", 2, "auxpowversion"},
+    { "submitauxblocks", 0, "blocks"},
+    { "submitauxblocks", 1, "auxpowversion"},
     { "combinerawtransaction", 0, "txs" },
     { "fundrawtransaction", 1, "options" },
     { "fundrawtransaction", 2, "iswitness" },
@@ -146,6 +165,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
+    { "getrawmempool", 1, "mempool_sequence" },
     { "estimatesmartfee", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
     { "estimaterawfee", 1, "threshold" },
@@ -158,6 +178,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getmempooldescendants", 1, "verbose" },
     { "spork", 1, "value" },
     { "bumpfee", 1, "options" },
+    { "getlockcontention", 0, "count" },
+    { "getlockcontention", 1, "reset" },
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
     { "disconnectnode", 1, "nodeid" },
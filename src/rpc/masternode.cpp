@@ -10,7 +10,9 @@
 #include <init.h>
 #include <netbase.h>
 #include <validation.h>
+#include <instantx.h>
 #include <masternode-payments.h>
+#include <masternode-stats.h>
 #include <masternode-sync.h>
 #include <masternodeconfig.h>
 #include <masternodeman.h>
@@ -110,7 +112,7 @@ UniValue masternode(const JSONRPCRequest& request)
 
         int nCount;
         masternode_info_t mnInfo;
-        mnodeman.GetNextMasternodeInQueueForPayment(true, nCount, mnInfo);
+        mnodeman.GetNextMasternodeInQueueForPayment(true, nCount, mnInfo, true);
 
         int total = mnodeman.size();
         int enabled = mnodeman.CountEnabled();
@@ -122,6 +124,13 @@ UniValue masternode(const JSONRPCRequest& request)
             obj.pushKV("enabled", enabled);
             obj.pushKV("qualify", nCount);
 
+            UniValue payments(UniValue::VOBJ);
+            payments.pushKV("votes", mnpayments.GetVoteCount());
+            payments.pushKV("blocks", mnpayments.GetBlockCount());
+            payments.pushKV("usage", (int64_t) mnpayments.DynamicMemoryUsage());
+            payments.pushKV("maxusage", (int64_t) MAX_MNPAYMENTS_MEMORY_USAGE);
+            obj.pushKV("payments", payments);
+
             return obj;
         }
 
@@ -504,9 +513,9 @@ UniValue masternodelist(const JSONRPCRequest& request)
             obj.pushKV(strOutpoint, rankpair.first);
         }
     } else {
-        std::map<COutPoint, CMasternode> mapMasternodes = mnodeman.GetFullMasternodeMap();
-        for (const auto& mnpair : mapMasternodes) {
-            CMasternode mn = mnpair.second;
+        CMasternodeMan::masternode_snapshot_t pMasternodes = mnodeman.GetMasternodeListSnapshot();
+        for (const auto& mnpair : *pMasternodes) {
+            const CMasternode& mn = mnpair.second;
             std::string strOutpoint = mnpair.first.ToStringShort();
             if (strMode == "activeseconds") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
@@ -858,12 +867,99 @@ UniValue masternodebroadcast(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue LockStatsToJSON(const CLockStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("locks", (uint64_t)stats.nLocks);
+    obj.pushKV("contentions", (uint64_t)stats.nContentions);
+    obj.pushKV("waitmicros", (uint64_t)stats.nWaitMicros);
+    return obj;
+}
+
+UniValue getmasternodestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getmasternodestats\n"
+            "\nReturns lock contention, message processing times and memory usage of the masternode subsystem.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"locks\": {                   (object) Counters of each lock since startup\n"
+            "    \"name\": {\n"
+            "      \"locks\": n,               (numeric) Times the lock was taken\n"
+            "      \"contentions\": n,         (numeric) Times it had to wait for another thread\n"
+            "      \"waitmicros\": n           (numeric) Total time spent waiting in microseconds\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"messages\": {                (object) Processing time of each message type received\n"
+            "    \"command\": {\n"
+            "      \"count\": n,               (numeric) Messages processed\n"
+            "      \"totalmicros\": n,         (numeric) Total processing time in microseconds\n"
+            "      \"maxmicros\": n,           (numeric) Slowest message in microseconds\n"
+            "      \"histogram\": [            (array) Non-empty buckets\n"
+            "        {\n"
+            "          \"belowmicros\": n,     (numeric) Upper bound of the bucket, absent for the last one\n"
+            "          \"count\": n            (numeric) Messages in the bucket\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"memory\": {                  (object) Estimated bytes used by each masternode list map\n"
+            "    \"name\": n, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmasternodestats", "")
+            + HelpExampleRpc("getmasternodestats", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+
+    UniValue locks(UniValue::VOBJ);
+    locks.pushKV("mnodeman", LockStatsToJSON(mnodeman.GetLockStats()));
+    locks.pushKV("instantsend", LockStatsToJSON(instantsend.cs_instantsend.stats));
+    locks.pushKV("payees", LockStatsToJSON(cs_vecPayees.stats));
+    locks.pushKV("paymentblocks", LockStatsToJSON(cs_mapMasternodeBlocks.stats));
+    locks.pushKV("paymentvotes", LockStatsToJSON(cs_mapMasternodePaymentVotes.stats));
+    result.pushKV("locks", locks);
+
+    UniValue messages(UniValue::VOBJ);
+    for (const auto& entry : mnmsgstats.GetHistograms()) {
+        const CTimingHistogram& histogram = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", histogram.nCount);
+        obj.pushKV("totalmicros", histogram.nTotalMicros);
+        obj.pushKV("maxmicros", histogram.nMaxMicros);
+        UniValue buckets(UniValue::VARR);
+        for (int i = 0; i < CTimingHistogram::NUM_BUCKETS; i++) {
+            if (histogram.vBuckets[i] == 0) continue;
+            UniValue bucket(UniValue::VOBJ);
+            if (i < CTimingHistogram::NUM_BUCKETS - 1)
+                bucket.pushKV("belowmicros", (uint64_t)1 << i);
+            bucket.pushKV("count", histogram.vBuckets[i]);
+            buckets.push_back(bucket);
+        }
+        obj.pushKV("histogram", buckets);
+        messages.pushKV(entry.first, obj);
+    }
+    result.pushKV("messages", messages);
+
+    UniValue memory(UniValue::VOBJ);
+    for (const auto& entry : mnodeman.GetMemoryUsage()) {
+        memory.pushKV(entry.first, (uint64_t)entry.second);
+    }
+    result.pushKV("memory", memory);
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category                     name                      actor (function)         argNames
   //  ---------------------        ------------------------  -----------------------  ----------
     { "globaltoken",               "masternode",             &masternode,             {} },
     { "globaltoken",               "masternodelist",         &masternodelist,         {} },
     { "globaltoken",               "masternodebroadcast",    &masternodebroadcast,    {} },
+    { "globaltoken",               "getmasternodestats",     &getmasternodestats,     {} },
 };
 
 void RegisterMasternodeRPCCommands(CRPCTable &t)
@@ -15,10 +15,16 @@
 #include <chainparams.h>
 #include <consensus/consensus.h>
 #include <consensus/params.h>
+#include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/hashlib/sph_echo.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/algos/yescrypt/yescrypt.h>
+#include <crypto/algos/yespower/yespower.h>
 #include <globaltoken/hardfork.h>
+#include <globaltoken/multihasher.h>
 #include <init.h>
 #include <validation.h>
 #include <miner.h>
@@ -30,6 +36,7 @@
 #include <rpc/mining.h>
 #include <rpc/server.h>
 #include <spork.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -39,7 +46,12 @@
 #include <masternode-payments.h>
 #include <masternode-sync.h>
 
+#include <atomic>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <stdint.h>
 
 unsigned int ParseConfirmTarget(const UniValue& value)
@@ -74,7 +86,9 @@ UniValue GetNetworkHashPS(uint8_t nAlgo, int lookup, int height) {
     if (lookup > pb->nHeight)
         lookup = pb->nHeight;
 
-    return CalculateAlgoHashrate(*pb, nAlgo, lookup, Params().GetConsensus());
+    if (algoHashrateIndex.Tip() != chainActive.Tip())
+        return CalculateAlgoHashrate(*pb, nAlgo, lookup, Params().GetConsensus());
+    return algoHashrateIndex.GetRecent(pb, nAlgo, lookup, Params().GetConsensus()).GetHashrate();
 }
 
 UniValue GetUniValueForTreasury(const CAmount blockReward, const uint32_t nTime, int nHeight, const bool skipActivationCheck)
@@ -201,16 +215,188 @@ UniValue getnetworkhashps(const JSONRPCRequest& request)
     return GetNetworkHashPS(algo, !request.params[0].isNull() ? request.params[0].get_int() : 24, !request.params[1].isNull() ? request.params[1].get_int() : -1);
 }
 
-UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, uint8_t nAlgo)
+int ParseGenerateThreads(const UniValue& value)
 {
-	static const int nInnerLoopGlobalTokenMask = 0x1FFFF;
-    static const int nInnerLoopGlobalTokenCount = 0x10000;
+    if (value.isNull())
+        return 1;
+    int nThreads = value.get_int();
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    return std::max(1, std::min(nThreads, MAX_GENERATE_THREADS));
+}
+
+/** Run func(0) .. func(nThreads - 1) in parallel, func(0) on the calling thread. */
+static void RunGenerateThreads(int nThreads, const std::function<void(int)>& func)
+{
+    const HashPurpose hashPurpose = GetHashPurpose();
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++) {
+        vThreads.emplace_back([&func, hashPurpose, i]() {
+            CHashPurposeScope scope(hashPurpose);
+            func(i);
+        });
+    }
+    func(0);
+    for (std::thread& thread : vThreads)
+        thread.join();
+}
+
+/**
+ * Search the nonces below nNonceEnd of a block on nThreads threads. The
+ * threads claim batches of nonces from a shared counter, so every nonce is
+ * tried by one thread only. nMaxTries is reduced by the hashes computed.
+ */
+static bool SolveDefaultBlock(CBlock* pblock, uint8_t nAlgo, int nThreads, uint64_t& nMaxTries, uint32_t nNonceEnd)
+{
+    static const uint32_t NONCE_BATCH_SIZE = 256;
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const CDefaultBlockHeader header = pblock->GetDefaultBlockHeader();
+    const int nHashVersion = LoadMultiHasherVersionFlags(consensusParams.Hardfork3.IsActivated(header.nTime));
+    const uint32_t nLimit = (uint32_t)std::min<uint64_t>(nNonceEnd, nMaxTries);
+
+    std::atomic<uint32_t> nNextNonce(0);
+    std::atomic<uint64_t> nTries(0);
+    std::atomic<bool> fFound(false);
+    std::mutex csFound;
+    uint32_t nFoundNonce = 0;
+
+    // Only the nonce changes, so each thread hashes the serialized header through a CNonceHasher
+    CDataStream ssHeader(SER_GETHASH, nHashVersion);
+    ssHeader << header;
+    const std::vector<unsigned char> vHeader(ssHeader.begin(), ssHeader.end());
+
+    RunGenerateThreads(nThreads, [&](int nThread) {
+        CNonceHasher hasher(nAlgo, vHeader, nHashVersion);
+        uint64_t nThreadTries = 0;
+        while (!fFound) {
+            const uint32_t nStart = nNextNonce.fetch_add(NONCE_BATCH_SIZE);
+            if (nStart >= nLimit)
+                break;
+            const uint32_t nEnd = std::min(nLimit, nStart + NONCE_BATCH_SIZE);
+            for (uint32_t nNonce = nStart; nNonce < nEnd && !fFound; ++nNonce) {
+                ++nThreadTries;
+                if (CheckProofOfWork(hasher.GetHash(nNonce), header.nBits, consensusParams, nAlgo)) {
+                    std::lock_guard<std::mutex> lock(csFound);
+                    if (!fFound) {
+                        nFoundNonce = nNonce;
+                        fFound = true;
+                    }
+                    break;
+                }
+            }
+        }
+        nTries += nThreadTries;
+    });
+
+    nMaxTries -= std::min<uint64_t>(nTries, nMaxTries);
+    if (fFound)
+        pblock->nNonce = nFoundNonce;
+    return fFound;
+}
+
+/**
+ * Solve an Equihash based block on nThreads threads. Each thread puts its
+ * index in the top 16 bits of nBigNonce, which CreateNewBlock leaves clear
+ * for this, and counts up the bits under nMask up to nCount. Every solver
+ * run counts as one try.
+ */
+static bool SolveEquihashBlock(CBlock* pblock, uint8_t nAlgo, int nThreads, uint64_t& nMaxTries, int nMask, int nCount)
+{
+    const CChainParams& params = Params();
+    const unsigned int n = params.GetEquihashAlgoN(nAlgo);
+    const unsigned int k = params.GetEquihashAlgoK(nAlgo);
+    const uint64_t nMaxTriesStart = nMaxTries;
+
+    std::atomic<uint64_t> nTries(0);
+    std::atomic<bool> fFound(false);
+    std::mutex csFound;
+    uint256 nFoundNonce;
+    std::vector<unsigned char> vFoundSolution;
+
+    // The bucket solver uses all threads on one nonce, the basic solver one thread per nonce
+    const bool fBucketSolver = gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER) == "bucket";
+    const int nSearchThreads = fBucketSolver ? 1 : nThreads;
+
+    RunGenerateThreads(nSearchThreads, [&](int nThread) {
+        CEquihashBlockHeader equihashblock = pblock->GetEquihashBlockHeader();
+        equihashblock.nNonce = ArithToUint256(UintToArith256(equihashblock.nNonce) + (arith_uint256(nThread) << 240));
+
+        // Solve Equihash.
+        crypto_generichash_blake2b_state eh_state;
+        EhInitialiseState(n, k, eh_state, GetEquihashBasedDefaultPersonalize(nAlgo));
+
+        // I = the block header minus nonce and solution.
+        CEquihashInput I{equihashblock};
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << I;
+
+        // H(I||...
+        crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
+
+        std::function<bool(std::vector<unsigned char>)> validBlock =
+                [&equihashblock, nAlgo](std::vector<unsigned char> soln) {
+            equihashblock.nSolution = soln;
+            return CheckProofOfWork(equihashblock.GetHash(), equihashblock.nBits, Params().GetConsensus(), nAlgo);
+        };
+        std::function<bool(EhSolverCancelCheck)> cancelled = [&fFound](EhSolverCancelCheck pos) {
+            return fFound.load();
+        };
+
+        while (!fFound && ((int)equihashblock.nNonce.GetUint64(0) & nMask) < nCount) {
+            if (nTries.fetch_add(1) >= nMaxTriesStart)
+                break;
+
+            // Yes, there is a chance every nonce could fail to satisfy the -regtest
+            // target -- 1 in 2^(2^256). That ain't gonna happen
+            equihashblock.nNonce = ArithToUint256(UintToArith256(equihashblock.nNonce) + 1);
+
+            // H(I||V||...
+            crypto_generichash_blake2b_state curr_state;
+            curr_state = eh_state;
+            crypto_generichash_blake2b_update(&curr_state,
+                                              equihashblock.nNonce.begin(),
+                                              equihashblock.nNonce.size());
+
+            // (x_1, x_2, ...) = A(I, V, n, k)
+            bool found;
+            try {
+                if (fBucketSolver) {
+                    found = EhBucketSolve(n, k, curr_state, validBlock, cancelled, nThreads);
+                } else {
+                    found = EhBasicSolve(n, k, curr_state, validBlock, cancelled);
+                }
+            } catch (const EhSolverCancelledException&) {
+                break;
+            }
+            if (found) {
+                std::lock_guard<std::mutex> lock(csFound);
+                if (!fFound) {
+                    nFoundNonce = equihashblock.nNonce;
+                    vFoundSolution = equihashblock.nSolution;
+                    fFound = true;
+                }
+                break;
+            }
+        }
+    });
+
+    nMaxTries -= std::min<uint64_t>(nTries, nMaxTries);
+    if (fFound) {
+        pblock->nBigNonce = nFoundNonce;
+        pblock->nSolution = vFoundSolution;
+    }
+    return fFound;
+}
+
+UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, uint8_t nAlgo, int nThreads)
+{
+    static const uint32_t nInnerLoopGlobalTokenCount = 0x10000;
     static const int nInnerLoopEquihashMask = 0xFFFF;
-	static const int nInnerLoopEquihashCount = 0xFFFF;
+    static const int nInnerLoopEquihashCount = 0xFFFF;
     int nHeightEnd = 0;
     int nHeight = 0;
-	int nInnerLoopCount;
-	int nInnerLoopMask;
+    CHashPurposeScope hashPurpose(HashPurpose::MINING);
 
     {   // Don't keep cs_main locked
         LOCK(cs_main);
@@ -220,8 +406,6 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
 	const CChainParams& params = Params();
-	unsigned int n;
-    unsigned int k;
     while (nHeight < nHeightEnd)
     {
         std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, nAlgo));
@@ -269,96 +453,21 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
         */
         {
             LOCK(cs_main);
-            IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
-        }
-		if(params.GetConsensus().Hardfork1.IsActivated(pblock->nTime))
-		{
-			if(IsEquihashBasedAlgo(nAlgo))
-			{
-                CEquihashBlockHeader equihashblock = pblock->GetEquihashBlockHeader();
-				nInnerLoopMask = nInnerLoopEquihashMask;
-				nInnerLoopCount = nInnerLoopEquihashCount;
-                n = params.GetEquihashAlgoN(nAlgo);
-                k = params.GetEquihashAlgoK(nAlgo);
-				// Solve Equihash.
-				crypto_generichash_blake2b_state eh_state;
-                EhInitialiseState(n, k, eh_state, GetEquihashBasedDefaultPersonalize(nAlgo));
-
-				// I = the block header minus nonce and solution.
-				CEquihashInput I{equihashblock};
-				CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-				ss << I;
-
-				// H(I||...
-				crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
-
-				while (nMaxTries > 0 &&
-					   ((int)equihashblock.nNonce.GetUint64(0) & nInnerLoopEquihashMask) < nInnerLoopCount) {
-					// Yes, there is a chance every nonce could fail to satisfy the -regtest
-					// target -- 1 in 2^(2^256). That ain't gonna happen
-					equihashblock.nNonce = ArithToUint256(UintToArith256(equihashblock.nNonce) + 1);
-
-					// H(I||V||...
-					crypto_generichash_blake2b_state curr_state;
-					curr_state = eh_state;
-					crypto_generichash_blake2b_update(&curr_state,
-													  equihashblock.nNonce.begin(),
-													  equihashblock.nNonce.size());
-
-					// (x_1, x_2, ...) = A(I, V, n, k)
-					std::function<bool(std::vector<unsigned char>)> validBlock =
-							[&equihashblock, nAlgo](std::vector<unsigned char> soln) {
-						equihashblock.nSolution = soln;
-						return CheckProofOfWork(equihashblock.GetHash(), equihashblock.nBits, Params().GetConsensus(), nAlgo);
-					};
-					bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
-                    --nMaxTries;
-					if (found) {
-						break;
-					}
-				}
-                
-                // If Block is found convert CEquihashBlockHeader calculated stuff to pblock
-                
-                pblock->nBigNonce = equihashblock.nNonce;
-                pblock->nSolution = equihashblock.nSolution;
-			}
-			else
-			{
-                CDefaultBlockHeader defaultblockheader = pblock->GetDefaultBlockHeader();
-				nInnerLoopMask = nInnerLoopGlobalTokenMask;
-				nInnerLoopCount = nInnerLoopGlobalTokenCount;
-				while (nMaxTries > 0 && defaultblockheader.nNonce < nInnerLoopCount && !CheckProofOfWork(defaultblockheader.GetPoWHash(nAlgo, SER_GETHASH, LoadMultiHasherVersionFlags(Params().GetConsensus().Hardfork3.IsActivated(defaultblockheader.nTime))), defaultblockheader.nBits, Params().GetConsensus(), nAlgo)) {
-					++defaultblockheader.nNonce;
-					--nMaxTries;
-				}
-                
-                // If Block is found convert CDefaultBlockHeader calculated stuff to pblock
-                
-                pblock->nNonce = defaultblockheader.nNonce;
-			}
-		}
-		else
-		{
-            CDefaultBlockHeader defaultblockheader = pblock->GetDefaultBlockHeader();
-			nInnerLoopMask = nInnerLoopGlobalTokenMask;
-			nInnerLoopCount = nInnerLoopGlobalTokenCount;
-			while (nMaxTries > 0 && defaultblockheader.nNonce < nInnerLoopCount && !CheckProofOfWork(defaultblockheader.GetPoWHash(ALGO_SHA256D, SER_GETHASH, LoadMultiHasherVersionFlags(Params().GetConsensus().Hardfork3.IsActivated(defaultblockheader.nTime))), defaultblockheader.nBits, Params().GetConsensus(), ALGO_SHA256D)) {
-				++defaultblockheader.nNonce;
-				--nMaxTries;
-			}
-            
-            // If Block is found convert CDefaultBlockHeader calculated stuff to pblock
-                
-            pblock->nNonce = defaultblockheader.nNonce;
-		}
-        if (nMaxTries == 0) {
-            break;
+            IncrementExtraNonce(pblocktemplate.get(), chainActive.Tip(), nExtraNonce);
         }
-        if (IsEquihashBasedAlgo(pblock->GetAlgo()) && ((int)pblock->nBigNonce.GetUint64(0) & nInnerLoopMask) == nInnerLoopCount) {
-            continue;
+        bool fSolved;
+        if (params.GetConsensus().Hardfork1.IsActivated(pblock->nTime) && IsEquihashBasedAlgo(nAlgo)) {
+            fSolved = SolveEquihashBlock(pblock, nAlgo, nThreads, nMaxTries, nInnerLoopEquihashMask, nInnerLoopEquihashCount);
+        } else {
+            // Blocks before the first hardfork are always SHA256D
+            const uint8_t nPoWAlgo = params.GetConsensus().Hardfork1.IsActivated(pblock->nTime) ? nAlgo : ALGO_SHA256D;
+            fSolved = SolveDefaultBlock(pblock, nPoWAlgo, nThreads, nMaxTries, nInnerLoopGlobalTokenCount);
         }
-        if (!IsEquihashBasedAlgo(pblock->GetAlgo()) && (pblock->nNonce & nInnerLoopMask) == nInnerLoopCount) {
+        if (!fSolved) {
+            if (nMaxTries == 0) {
+                break;
+            }
+            // Nonce space exhausted, try again with a new extranonce
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -378,20 +487,23 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
 
 UniValue generatetoaddress(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 2 || request.params.size() > 4)
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 5)
         throw std::runtime_error(strprintf(
-            "generatetoaddress nblocks address (maxtries)\n"
+            "generatetoaddress nblocks address ( maxtries algo threads )\n"
             "\nMine blocks immediately to a specified address (before the RPC call returns)\n"
             "\nArguments:\n"
             "1. nblocks      (numeric, required) How many blocks are generated immediately.\n"
             "2. address      (string, required) The address to send the newly generated globaltoken to.\n"
             "3. maxtries     (numeric, optional) How many iterations to try (default = 1000000 or 50000 for scrypt, neoscrypt and yescrypt).\n"
             "4. algo         (string, optional) Which mining algorithm to use. (%s)\n"
+            "5. threads      (numeric, optional, default=1) How many threads search the nonce space, 0 or less uses one per core.\n"
             "\nResult:\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
             "\nExamples:\n"
             "\nGenerate 11 blocks to myaddress\n"
             + HelpExampleCli("generatetoaddress", "11 \"myaddress\"")
+            + "\nGenerate 11 scrypt blocks to myaddress on 4 threads\n"
+            + HelpExampleCli("generatetoaddress", "11 \"myaddress\" 50000 \"scrypt\" 4")
         , GetAlgoRangeString()));
 
     int nGenerate = request.params[0].get_int();
@@ -427,7 +539,7 @@ UniValue generatetoaddress(const JSONRPCRequest& request)
     std::shared_ptr<CReserveScript> coinbaseScript = std::make_shared<CReserveScript>();
     coinbaseScript->reserveScript = GetScriptForDestination(destination);
 
-    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false, algo);
+    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false, algo, ParseGenerateThreads(request.params[4]));
 }
 
 UniValue getmininginfo(const JSONRPCRequest& request)
@@ -502,6 +614,13 @@ UniValue getalgoinfo(const JSONRPCRequest& request)
 			"  \"lastblockalgoid\": \"xx\"     (numeric) the ID of the algorithm from the last block that has been mined\n"
 			"  \"localalgo\": \"xxxx\"         (string) the name of the current algorithm that is activated to mine blocks\n"
 			"  \"localalgoid\": \"xx\"         (numeric) the ID of the current algorithm that is activated to mine blocks\n"
+            "  \"implementations\": {          (object) the implementation selected at startup for each runtime dispatched hash function\n"
+            "     \"echo\": \"xxxx\"            (string) \"aesni\" or \"standard\", used by every algo that chains ECHO (x11, x13, x16r, ...)\n"
+            "     \"yescrypt\": \"xxxx\"        (string) \"sse2\", \"avx\" or \"xop\" (\"generic\" on other CPUs), used by the yescrypt algos\n"
+            "     \"yespower\": \"xxxx\"        (string) \"sse2\" or \"sse4.1\", \"avx\" or \"xop\" (\"generic\" on other CPUs), used by yespower\n"
+            "     \"neoscrypt\": \"xxxx\"       (string) \"asm\" or \"generic\", used by neoscrypt\n"
+            "     \"equihash\": \"xxxx\"        (string) \"avx2(4way)\" or \"standard\", hashes the indices when checking Equihash solutions\n"
+            "  }\n"
             "  \"algo_details\": {             (object) details of the algo such like difficulty, last block and so on ..\n"
             "     \"xxxx\" : {                 (string) name of the algorithm\n"
 			"        \"algoid\": xx,           (numeric) the ID of this algo\n"
@@ -510,6 +629,13 @@ UniValue getalgoinfo(const JSONRPCRequest& request)
             "        \"nethashrate\": xx       (numeric) total nethashrate of this algo\n"
 			"        \"lastdiffret\": xxxxxx,  (numeric) the last diff retargeting height from this algo\n"
 			"        \"nextdiffret\": xxxxxx,  (numeric) the next diff retargeting height from this algo\n"
+            "        \"hashing\": {           (object) the PoW hashes of this algo computed by this node since startup, by what they were for\n"
+            "           \"xxxx\": {            (string) \"headersync\" (headers and blocks from peers), \"blockread\" (blocks read back from disk),\n"
+            "                                 \"startupload\" (block index load and verification, reindex), \"mining\", \"rpc\" or \"other\"\n"
+            "              \"hashes\": xx,      (numeric) the number of hashes\n"
+            "              \"time\": xx.xxx     (numeric) the cumulative time spent on them in seconds\n"
+            "           }, ...\n"
+            "        }\n"
             "     }\n"
             "  }\n"
             "}\n"
@@ -533,6 +659,14 @@ UniValue getalgoinfo(const JSONRPCRequest& request)
     obj.pushKV("lastblockalgoid",       tip->GetAlgo());
     obj.pushKV("localalgo",             GetAlgoName(currentAlgo));
     obj.pushKV("localalgoid",           currentAlgo);
+
+    UniValue implementations(UniValue::VOBJ);
+    implementations.pushKV("echo", sph_echo_implementation());
+    implementations.pushKV("yescrypt", yescrypt_implementation());
+    implementations.pushKV("yespower", yespower_implementation());
+    implementations.pushKV("neoscrypt", neoscrypt_implementation());
+    implementations.pushKV("equihash", EhIndexHashImplementation());
+    obj.pushKV("implementations",       implementations);
     
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
@@ -548,6 +682,18 @@ UniValue getalgoinfo(const JSONRPCRequest& request)
         algo_description.pushKV("nethashrate", GetNetworkHashPS(consensusParams.aPOWAlgos[i].GetAlgoID(), 24, -1));
         algo_description.pushKV("lastdiffret", CalculateDiffRetargetingBlock(tip, RETARGETING_LAST, consensusParams.aPOWAlgos[i].GetAlgoID(), Params().GetConsensus()));
         algo_description.pushKV("nextdiffret", CalculateDiffRetargetingBlock(tip, RETARGETING_NEXT, consensusParams.aPOWAlgos[i].GetAlgoID(), Params().GetConsensus()));
+
+        UniValue hashing(UniValue::VOBJ);
+        if (consensusParams.aPOWAlgos[i].GetAlgoID() < NUM_ALGOS_IMPL) {
+            for (int j = 0; j < (int)HashPurpose::COUNT; j++) {
+                const CHashingStats stats = GetHashingStats(consensusParams.aPOWAlgos[i].GetAlgoID(), (HashPurpose)j);
+                UniValue entry(UniValue::VOBJ);
+                entry.pushKV("hashes", stats.nHashes);
+                entry.pushKV("time", stats.nNanos * 1e-9);
+                hashing.pushKV(GetHashPurposeName((HashPurpose)j), entry);
+            }
+        }
+        algo_description.pushKV("hashing", hashing);
         algos.pushKV(GetAlgoName(consensusParams.aPOWAlgos[i].GetAlgoID()), algo_description);
     }
 	
@@ -555,6 +701,72 @@ UniValue getalgoinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getalgohashratehistory(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 3 || request.params.size() > 4)
+        throw std::runtime_error(strprintf(
+            "getalgohashratehistory \"algo\" startheight endheight ( interval )\n"
+            "\nReturns the hashrate and difficulty of an algo over a range of block heights of the active chain.\n"
+            "\nArguments:\n"
+            "1. \"algo\"        (string, required) The algorithm to show the history of. (%s)\n"
+            "2. startheight   (numeric, required) The first height of the range.\n"
+            "3. endheight     (numeric, required) The last height of the range.\n"
+            "4. interval      (numeric, optional, default=the whole range) Split the range into entries of this many heights.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"startheight\": xxxxxx,    (numeric) the first height of this entry\n"
+            "    \"endheight\": xxxxxx,      (numeric) the last height of this entry\n"
+            "    \"blocks\": xx,             (numeric) the number of blocks mined with this algo in the entry\n"
+            "    \"timespan\": xxxx,         (numeric) the seconds between the oldest and newest of these blocks\n"
+            "    \"hashrate\": xxxxxx,       (numeric) the estimated hashes per second, 0 if there were less than two blocks\n"
+            "    \"difficulty\": xxxxxx      (numeric) the difficulty of the last of these blocks, if any\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getalgohashratehistory", "\"sha256d\" 1000 2000 100")
+            + HelpExampleRpc("getalgohashratehistory", "\"sha256d\", 1000, 2000, 100")
+        , GetAlgoRangeString()));
+
+    LOCK(cs_main);
+
+    bool fAlgoFound = false;
+    uint8_t algo = GetAlgoByName(request.params[0].get_str(), currentAlgo, fAlgoFound);
+    if (!fAlgoFound)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid mining algorithm '%s' selected. Available algorithms: %s", request.params[0].get_str(), GetAlgoRangeString()));
+
+    int nStartHeight = request.params[1].get_int();
+    int nEndHeight = request.params[2].get_int();
+    if (nStartHeight < 0 || nEndHeight > chainActive.Height() || nStartHeight > nEndHeight)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+
+    int nInterval = nEndHeight - nStartHeight + 1;
+    if (!request.params[3].isNull()) {
+        nInterval = request.params[3].get_int();
+        if (nInterval < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid interval, must be positive");
+    }
+
+    if (algoHashrateIndex.Tip() != chainActive.Tip())
+        throw JSONRPCError(RPC_IN_WARMUP, "Hashrate index is not in sync with the active chain");
+
+    UniValue result(UniValue::VARR);
+    for (int nHeight = nStartHeight; nHeight <= nEndHeight; nHeight += nInterval) {
+        const int nLast = std::min(nEndHeight, nHeight + nInterval - 1);
+        const CAlgoHashrateStats stats = algoHashrateIndex.GetHeightRange(algo, nHeight, nLast);
+
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("startheight", nHeight);
+        entry.pushKV("endheight", nLast);
+        entry.pushKV("blocks", stats.nBlocks);
+        entry.pushKV("timespan", stats.nTimeSpan);
+        entry.pushKV("hashrate", stats.GetHashrate());
+        if (stats.pindexLast)
+            entry.pushKV("difficulty", GetDifficulty(stats.pindexLast, algo));
+        result.push_back(entry);
+    }
+    return result;
+}
 
 // NOTE: Unlike wallet RPC (which use BTC values), mining RPCs follow GBT (BIP 22) in using satoshi amounts
 UniValue prioritisetransaction(const JSONRPCRequest& request)
@@ -587,11 +799,24 @@ UniValue prioritisetransaction(const JSONRPCRequest& request)
     }
 
     mempool.PrioritiseTransaction(hash, nAmount);
+    // Fee deltas are not tracked by the incremental package selection
+    ResetIncrementalAssembly();
     return true;
 }
 
 
 // NOTE: Assumes a conclusive result; if result is inconclusive, it must be handled by caller
+/** A block template cached by getblocktemplate, together with what it was built for */
+struct GBTTemplateCacheEntry
+{
+    CBlockIndex* pindexPrev = nullptr;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nStart = 0;
+    bool fSupportsSegwit = true;
+    CScript scriptPubKey;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+};
+
 static UniValue BIP22ValidationResult(const CValidationState& state)
 {
     if (state.IsValid())
@@ -900,32 +1125,53 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    // Cache whether the last invocation was with segwit support, to avoid returning
-    // a segwit-block to a non-segwit caller.
-    static bool fLastTemplateSupportsSegwit = true;
-    static uint8_t lastAlgo;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
-        fLastTemplateSupportsSegwit != fSupportsSegwit || algo != lastAlgo)
+    // One template is cached per algo. Templates of different algos on the same
+    // tip only differ in the header, so a fresh template of another algo is
+    // copied instead of selecting the transactions again.
+    static std::map<uint8_t, GBTTemplateCacheEntry> mapTemplateCache;
+    CScript scriptDummy = CScript() << OP_TRUE;
+    CScript createscript = (coinbasetxn) ? coinbasetxnscript : scriptDummy;
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    const int64_t nNow = GetTime();
+    auto IsFreshTemplate = [&](const GBTTemplateCacheEntry& entry) {
+        return entry.pblocktemplate && entry.pindexPrev == chainActive.Tip() &&
+            (entry.nTransactionsUpdated == nTransactionsUpdated || nNow - entry.nStart <= 5) &&
+            entry.fSupportsSegwit == fSupportsSegwit && entry.scriptPubKey == createscript;
+    };
+
+    GBTTemplateCacheEntry& cached = mapTemplateCache[algo];
+    if (!IsFreshTemplate(cached))
     {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        // Clear the entry so future calls make a new block, despite any failures from here on
+        cached = GBTTemplateCacheEntry();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-        fLastTemplateSupportsSegwit = fSupportsSegwit;
-        lastAlgo = algo;
-
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        CScript createscript = (coinbasetxn) ? coinbasetxnscript : scriptDummy;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(createscript, algo, fSupportsSegwit);
-        if (!pblocktemplate)
+
+        for (auto it = mapTemplateCache.begin(); it != mapTemplateCache.end(); ) {
+            if (it->first != algo && it->second.pindexPrev != pindexPrevNew) {
+                // Built on an old tip, will never be served again
+                it = mapTemplateCache.erase(it);
+                continue;
+            }
+            if (it->first != algo && IsFreshTemplate(it->second)) {
+                cached.pblocktemplate = CopyBlockTemplateForAlgo(*it->second.pblocktemplate, pindexPrevNew, algo, Params().GetConsensus());
+                if (cached.pblocktemplate) {
+                    cached.nTransactionsUpdated = it->second.nTransactionsUpdated;
+                    cached.nStart = it->second.nStart;
+                }
+                break;
+            }
+            ++it;
+        }
+
+        if (!cached.pblocktemplate) {
+            // Store the pindexBest used before CreateNewBlock, to avoid races
+            cached.nTransactionsUpdated = nTransactionsUpdated;
+            cached.nStart = nNow;
+
+            // Create new block
+            cached.pblocktemplate = BlockAssembler(Params()).CreateNewBlock(createscript, algo, fSupportsSegwit);
+        }
+        if (!cached.pblocktemplate)
         {
             if(Params().GetConsensus().Hardfork2.IsActivated(pindexPrevNew->nTime))
             {
@@ -947,8 +1193,13 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         }
 
         // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
+        cached.fSupportsSegwit = fSupportsSegwit;
+        cached.scriptPubKey = createscript;
+        cached.pindexPrev = pindexPrevNew;
     }
+    nTransactionsUpdatedLast = cached.nTransactionsUpdated;
+    CBlockIndex* const pindexPrev = cached.pindexPrev;
+    CBlockTemplate* const pblocktemplate = cached.pblocktemplate.get();
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
@@ -1228,7 +1479,7 @@ UniValue submitblock(const JSONRPCRequest& request)
     }
 
     submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
+    RegisterValidationInterface(&sc, "submitblock");
     bool fAccepted = ProcessNewBlock(Params(), blockptr, true, nullptr);
     UnregisterValidationInterface(&sc);
     if (fBlockPresent) {
@@ -1417,14 +1668,33 @@ UniValue estimaterawfee(const JSONRPCRequest& request)
 
 namespace {
 
+/** Maximum number of created auxpow blocks that are kept for submitauxblock */
+const size_t MAX_AUXBLOCK_TEMPLATES = 256;
+/** Seconds after which a changed mempool causes a new auxpow block */
+const int64_t AUXBLOCK_REFRESH_INTERVAL = 60;
+
+typedef std::list<std::unique_ptr<CBlockTemplate>> AuxBlockTemplateList;
+
+/** The last auxpow block created for an algo and payout script */
+struct AuxBlockCacheEntry
+{
+    const CBlockIndex* pindexPrev = nullptr;
+    unsigned int nTransactionsUpdated = 0;
+    int64_t nStart = 0;
+    uint256 hash;
+};
+
 /**
  * The variables below are used to keep track of created and not yet
  * submitted auxpow blocks.  Lock them to be sure even for multiple
  * RPC threads running in parallel.
+ * lstNewBlockTemplate is ordered by last use, the least recently used
+ * blocks are forgotten once there are more than MAX_AUXBLOCK_TEMPLATES.
  */
 CCriticalSection cs_auxblockCache;
-std::map<uint256, CBlock*> mapNewBlock;
-std::vector<std::unique_ptr<CBlockTemplate>> vNewBlockTemplate;
+AuxBlockTemplateList lstNewBlockTemplate;
+std::map<uint256, AuxBlockTemplateList::iterator> mapNewBlock;
+std::map<std::pair<uint8_t, CScript>, AuxBlockCacheEntry> mapAuxBlockCache;
 
 void AuxMiningCheck()
 {
@@ -1458,31 +1728,80 @@ UniValue AuxMiningCreateBlock(const CScript& scriptPubKey, const uint8_t nAlgo)
 
     LOCK(cs_auxblockCache);
 
-    static unsigned nTransactionsUpdatedLast;
-    static const CBlockIndex* pindexPrev = nullptr;
-    static uint64_t nStart;
-    static CBlock* pblock = nullptr;
+    static const CBlockIndex* pindexLastTip = nullptr;
     static unsigned nExtraNonce = 0;
-    static uint8_t lastAlgo;
+    const CBlockIndex* pindexPrev;
+    CBlock* pblock;
 
     // Update block
     {
     LOCK(cs_main);
-    if (pindexPrev != chainActive.Tip()
-        || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
-            && GetTime() - nStart > 60) || nAlgo != lastAlgo)
+    pindexPrev = chainActive.Tip();
+    if (pindexLastTip != pindexPrev)
     {
-        if (pindexPrev != chainActive.Tip())
+        // Clear old blocks since they're obsolete now.
+        mapNewBlock.clear();
+        lstNewBlockTemplate.clear();
+        mapAuxBlockCache.clear();
+        pindexLastTip = pindexPrev;
+    }
+
+    const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    const int64_t nNow = GetTime();
+    auto IsFreshEntry = [&](const AuxBlockCacheEntry& entry) {
+        return entry.pindexPrev == pindexPrev && mapNewBlock.count(entry.hash) &&
+            (entry.nTransactionsUpdated == nTransactionsUpdated || nNow - entry.nStart <= AUXBLOCK_REFRESH_INTERVAL);
+    };
+
+    AuxBlockCacheEntry& cached = mapAuxBlockCache[std::make_pair(nAlgo, scriptPubKey)];
+    if (!IsFreshEntry(cached))
+    {
+        // Blocks for other algos or payout scripts share the transaction
+        // selection, prefer one of the same algo as only the coinbase differs.
+        const AuxBlockCacheEntry* pbase = nullptr;
+        for (const auto& item : mapAuxBlockCache) {
+            if (&item.second == &cached || !IsFreshEntry(item.second))
+                continue;
+            if (!pbase || item.first.first == nAlgo)
+                pbase = &item.second;
+            if (item.first.first == nAlgo)
+                break;
+        }
+
+        std::unique_ptr<CBlockTemplate> newBlock;
+        AuxBlockCacheEntry newEntry;
+        newEntry.pindexPrev = pindexPrev;
+        if (pbase)
         {
-            // Clear old blocks since they're obsolete now.
-            mapNewBlock.clear();
-            vNewBlockTemplate.clear();
-            pblock = nullptr;
+            const CBlockTemplate& base = **mapNewBlock[pbase->hash];
+            if (base.block.GetAlgo() == nAlgo)
+                newBlock.reset(new CBlockTemplate(base));
+            else
+                newBlock = CopyBlockTemplateForAlgo(base, pindexPrev, nAlgo, Params().GetConsensus());
+            if (newBlock)
+            {
+                CBlock& block = newBlock->block;
+                // The base block may already carry a submitted auxpow.
+                block.auxpow.reset();
+                if (block.vtx[0]->vout[0].scriptPubKey != scriptPubKey)
+                {
+                    CMutableTransaction coinbaseTx(*block.vtx[0]);
+                    coinbaseTx.vout[0].scriptPubKey = scriptPubKey;
+                    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+                    newBlock->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+                }
+                newEntry.nTransactionsUpdated = pbase->nTransactionsUpdated;
+                newEntry.nStart = pbase->nStart;
+            }
         }
 
-        // Create new block with nonce = 0 and extraNonce = 1
-        std::unique_ptr<CBlockTemplate> newBlock
-            = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, nAlgo);
+        if (!newBlock)
+        {
+            // Create new block with nonce = 0 and extraNonce = 1
+            newBlock = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, nAlgo);
+            newEntry.nTransactionsUpdated = nTransactionsUpdated;
+            newEntry.nStart = nNow;
+        }
         if (!newBlock)
         {
             if(Params().GetConsensus().Hardfork2.IsActivated(chainActive.Tip()->nTime))
@@ -1509,33 +1828,34 @@ UniValue AuxMiningCreateBlock(const CScript& scriptPubKey, const uint8_t nAlgo)
             throw std::runtime_error(GetCoinbaseFeeString(DIVIDEDPAYMENTS_AUXPOW_WARNING));
         }
 
-        // Update state only when CreateNewBlock succeeded
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        pindexPrev = chainActive.Tip();
-        nStart = GetTime();
-        lastAlgo = nAlgo;
-	    
         // If new block is an Equihash block, set the nNonce to null, because it is randomized by default.
         if(IsEquihashBasedAlgo(nAlgo))
             newBlock->block.nBigNonce.SetNull();
 
         // Finalise it by setting the version and building the merkle root
-        IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
+        IncrementExtraNonce(newBlock.get(), pindexPrev, nExtraNonce);
         newBlock->block.SetAuxpowVersion(true);
 
-        // Save
-        pblock = &newBlock->block;
-        mapNewBlock[pblock->GetHash()] = pblock;
-        vNewBlockTemplate.push_back(std::move(newBlock));
+        // Save, update state only when the block was created successfully
+        newEntry.hash = newBlock->block.GetHash();
+        lstNewBlockTemplate.push_front(std::move(newBlock));
+        mapNewBlock[newEntry.hash] = lstNewBlockTemplate.begin();
+        cached = newEntry;
+
+        while (lstNewBlockTemplate.size() > MAX_AUXBLOCK_TEMPLATES)
+        {
+            mapNewBlock.erase(lstNewBlockTemplate.back()->block.GetHash());
+            lstNewBlockTemplate.pop_back();
+        }
     }
+    else
+    {
+        // Mark as recently used
+        lstNewBlockTemplate.splice(lstNewBlockTemplate.begin(), lstNewBlockTemplate, mapNewBlock[cached.hash]);
     }
 
-    // At this point, pblock is always initialised:  If we make it here
-    // without creating a new block above, it means that, in particular,
-    // pindexPrev == chainActive.Tip().  But for that to happen, we must
-    // already have created a pblock in a previous call, as pindexPrev is
-    // initialised only when pblock is.
-    assert(pblock);
+    pblock = &lstNewBlockTemplate.front()->block;
+    }
 
     arith_uint256 target;
     bool fNegative, fOverflow;
@@ -1561,23 +1881,26 @@ UniValue AuxMiningCreateBlock(const CScript& scriptPubKey, const uint8_t nAlgo)
     return result;
 }
 
-bool AuxMiningSubmitBlock(const std::string& hashHex,
-                          const std::string& auxpowHex,
-                          const int nAuxPoWVersion)
+/**
+ * Return a copy of the block created by createauxblock with the given hash,
+ * with the submitted auxpow attached. Requires cs_auxblockCache.
+ */
+static std::shared_ptr<CBlock> GetSolvedAuxBlock(const std::string& hashHex,
+                                                 const std::string& auxpowHex,
+                                                 const int nAuxPoWVersion)
 {
-    AuxMiningCheck();
-
-    LOCK(cs_auxblockCache);
+    AssertLockHeld(cs_auxblockCache);
 
     uint256 hash;
     hash.SetHex(hashHex);
     std::string auxpowstring;
     uint32_t nVersion = CURRENT_AUXPOW_VERSION;
 
-    const std::map<uint256, CBlock*>::iterator mit = mapNewBlock.find(hash);
+    const auto mit = mapNewBlock.find(hash);
     if (mit == mapNewBlock.end())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "block hash unknown");
-    CBlock& block = *mit->second;
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>((*mit->second)->block);
+    CBlock& block = *pblock;
     
     uint8_t nBlockAlgo = block.GetAlgo();
     
@@ -1605,17 +1928,90 @@ bool AuxMiningSubmitBlock(const std::string& hashHex,
     block.SetAuxpow(new CAuxPow(auxpow));
     
     assert(block.GetHash() == hash);
+    return pblock;
+}
 
-    submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
-    std::shared_ptr<const CBlock> shared_block 
-      = std::make_shared<const CBlock>(block);
+bool AuxMiningSubmitBlock(const std::string& hashHex,
+                          const std::string& auxpowHex,
+                          const int nAuxPoWVersion)
+{
+    AuxMiningCheck();
+
+    LOCK(cs_auxblockCache);
+
+    std::shared_ptr<const CBlock> shared_block = GetSolvedAuxBlock(hashHex, auxpowHex, nAuxPoWVersion);
+
+    submitblock_StateCatcher sc(shared_block->GetHash());
+    RegisterValidationInterface(&sc, "submitblock");
     bool fAccepted = ProcessNewBlock(Params(), shared_block, true, nullptr);
     UnregisterValidationInterface(&sc);
 
     return fAccepted;
 }
 
+UniValue AuxMiningSubmitBlocks(const std::vector<std::pair<std::string, std::string>>& vSubmissions,
+                               const int nAuxPoWVersion)
+{
+    AuxMiningCheck();
+
+    UniValue result(UniValue::VARR);
+    std::vector<UniValue> vResults(vSubmissions.size(), UniValue(UniValue::VOBJ));
+    std::vector<std::shared_ptr<CBlock>> vBlocks(vSubmissions.size());
+    {
+        LOCK(cs_auxblockCache);
+        for (size_t i = 0; i < vSubmissions.size(); i++) {
+            vResults[i].pushKV("hash", vSubmissions[i].first);
+            try {
+                vBlocks[i] = GetSolvedAuxBlock(vSubmissions[i].first, vSubmissions[i].second, nAuxPoWVersion);
+            } catch (const UniValue& objError) {
+                vResults[i].pushKV("accepted", false);
+                vResults[i].pushKV("reason", find_value(objError, "message").get_str());
+            } catch (const std::exception& e) {
+                vResults[i].pushKV("accepted", false);
+                vResults[i].pushKV("reason", strprintf("auxpow decode failed: %s", e.what()));
+            }
+        }
+    }
+
+    // Check the merkle branches and parent block hashes of all candidates in
+    // parallel, without holding any lock, so that cs_main is only taken for
+    // the blocks that can actually be accepted.
+    std::vector<size_t> vIndex;
+    std::vector<const CBlockHeader*> vpheaders;
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        if (vBlocks[i]) {
+            vIndex.push_back(i);
+            vpheaders.push_back(vBlocks[i].get());
+        }
+    }
+    std::vector<char> fPoWValid;
+    CheckProofOfWorkBatch(vpheaders, Params().GetConsensus(), fPoWValid);
+
+    for (size_t j = 0; j < vIndex.size(); j++) {
+        const size_t i = vIndex[j];
+        if (!fPoWValid[j]) {
+            vResults[i].pushKV("accepted", false);
+            vResults[i].pushKV("reason", "high-hash");
+            continue;
+        }
+
+        std::shared_ptr<const CBlock> shared_block = vBlocks[i];
+        submitblock_StateCatcher sc(shared_block->GetHash());
+        RegisterValidationInterface(&sc, "submitblock");
+        bool fAccepted = ProcessNewBlock(Params(), shared_block, true, nullptr);
+        UnregisterValidationInterface(&sc);
+
+        vResults[i].pushKV("accepted", fAccepted);
+        const UniValue reason = sc.found ? BIP22ValidationResult(sc.state) : NullUniValue;
+        if (!fAccepted && reason.isStr())
+            vResults[i].pushKV("reason", reason);
+    }
+
+    for (UniValue& entry : vResults)
+        result.push_back(entry);
+    return result;
+}
+
 UniValue createauxblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || (request.params.size() < 1 && request.params.size() > 2))
@@ -1701,12 +2097,65 @@ UniValue submitauxblock(const JSONRPCRequest& request)
 }
 
 
+UniValue submitauxblocks(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "submitauxblocks [{\"hash\":\"hash\",\"auxpow\":\"auxpow\"},...] ( auxpowversion )\n"
+            "\nsubmit several solved auxpows for blocks previously created by 'createauxblock' at once.\n"
+            "The proof of work of all submissions is verified in parallel before any block is processed.\n"
+            "\nArguments:\n"
+            "1. blocks         (array, required) the solved blocks\n"
+            "     [\n"
+            "       {\n"
+            "         \"hash\"   : \"hash\",    (string, required) hash of the block to submit\n"
+            "         \"auxpow\" : \"auxpow\",  (string, required) serialised auxpow found\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "2. auxpowversion  (numeric, optional, default=1) The AuxPoW Version to encode (1 = legacy, 2 = supports pos + equihash format)\n"
+            "\nResult:\n"
+            "[                 (array) one entry per submitted block, in the same order\n"
+            "  {\n"
+            "    \"hash\"     : \"hash\", (string) hash of the block\n"
+            "    \"accepted\" : true|false, (boolean) whether the submitted block was correct\n"
+            "    \"reason\"   : \"xxx\",  (string, optional) why the block was rejected\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("submitauxblocks", "\"[{\\\"hash\\\":\\\"hash\\\",\\\"auxpow\\\":\\\"serialised auxpow\\\"}]\"")
+            + HelpExampleRpc("submitauxblocks", "[{\"hash\":\"hash\",\"auxpow\":\"serialised auxpow\"}]")
+            );
+
+    const UniValue& blocks = request.params[0].get_array();
+    const int nAuxPoWVersion = request.params[1].isNull() ? 1 : request.params[1].get_int();
+
+    //throw an error if the auxpow encoding version is unknown.
+    if (!(nAuxPoWVersion == 1 || nAuxPoWVersion == 2))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unknown auxpow version.");
+
+    std::vector<std::pair<std::string, std::string>> vSubmissions;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const UniValue& entry = blocks[i].get_obj();
+        RPCTypeCheckObj(entry,
+            {
+                {"hash", UniValueType(UniValue::VSTR)},
+                {"auxpow", UniValueType(UniValue::VSTR)},
+            });
+        vSubmissions.emplace_back(find_value(entry, "hash").get_str(), find_value(entry, "auxpow").get_str());
+    }
+
+    return AuxMiningSubmitBlocks(vSubmissions, nAuxPoWVersion);
+}
+
 /* ************************************************************************** */
 
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "mining",             "getalgoinfo",            &getalgoinfo,            {} },
+    { "mining",             "getalgohashratehistory", &getalgohashratehistory, {"algo","startheight","endheight","interval"} },
     { "mining",             "getblocktreasury",       &getblocktreasury,       {"height"} },
     { "mining",             "getnetworkhashps",       &getnetworkhashps,       {"nblocks","height"} },
     { "mining",             "getmininginfo",          &getmininginfo,          {} },
@@ -1715,9 +2164,10 @@ static const CRPCCommand commands[] =
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
     { "mining",             "createauxblock",         &createauxblock,         {"address", "algo"} },
     { "mining",             "submitauxblock",         &submitauxblock,         {"hash", "auxpow", "auxpowversion"} },
+    { "mining",             "submitauxblocks",        &submitauxblocks,        {"blocks", "auxpowversion"} },
 
 
-    { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries","algo"} },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries","algo","threads"} },
 
     { "hidden",             "estimatefee",            &estimatefee,            {} },
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
@@ -8,11 +8,21 @@
 #include <script/script.h>
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <univalue.h>
 
-/** Generate blocks (mine) */
-UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, uint8_t nAlgo);
+/** Maximum number of threads the generate RPCs search nonces with */
+static const int MAX_GENERATE_THREADS = 64;
+/** Default Equihash solver of the generate RPCs, "bucket" or "basic" */
+static const char* const DEFAULT_EQUIHASH_SOLVER = "bucket";
+
+/** Generate blocks (mine), searching the nonce space on nThreads threads */
+UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, uint8_t nAlgo, int nThreads);
+
+/** Parse the threads argument of the generate RPCs, nonpositive means one thread per core */
+int ParseGenerateThreads(const UniValue& value);
 
 /** Check bounds on a command line confirm target */
 unsigned int ParseConfirmTarget(const UniValue& value);
@@ -22,5 +32,8 @@ UniValue AuxMiningCreateBlock(const CScript& scriptPubKey, const uint8_t nAlgo);
 bool AuxMiningSubmitBlock(const std::string& hashHex,
                           const std::string& auxpowHex,
                           const int nAuxPoWVersion);
+/** Submit several solved auxpow blocks, verifying their proof of work in parallel first */
+UniValue AuxMiningSubmitBlocks(const std::vector<std::pair<std::string, std::string>>& vSubmissions,
+                               const int nAuxPoWVersion);
 
 #endif
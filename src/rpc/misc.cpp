@@ -4,6 +4,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <addressindex.h>
 #include <base58.h>
 #include <chain.h>
 #include <chainparams.h>
@@ -18,9 +19,12 @@
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
+#include <scheduler.h>
+#include <script/sigcache.h>
 #include <timedata.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <validationinterface.h>
 #ifdef ENABLE_WALLET
 #include <wallet/rpcwallet.h>
 #include <wallet/wallet.h>
@@ -28,9 +32,14 @@
 #endif
 #include <warnings.h>
 
+#include <instantx.h>
+#include <masternode-payments.h>
 #include <masternode-sync.h>
+#include <masternodeman.h>
+#include <messagesigner.h>
 #include <spork.h>
 
+#include <algorithm>
 #include <stdint.h>
 #ifdef HAVE_MALLOC_INFO
 #include <malloc.h>
@@ -391,6 +400,19 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCSignatureCacheInfo(const SignatureCacheStats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("capacity", uint64_t(stats.nCapacity));
+    obj.pushKV("occupied", uint64_t(stats.nOccupied));
+    obj.pushKV("bytes", uint64_t(stats.nCapacity * sizeof(uint256)));
+    obj.pushKV("hits", stats.nHits);
+    obj.pushKV("misses", stats.nMisses);
+    const uint64_t nLookups = stats.nHits + stats.nMisses;
+    obj.pushKV("hitrate", nLookups ? (double)stats.nHits / nLookups : 0.0);
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -422,6 +444,7 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "Arguments:\n"
             "1. \"mode\" determines what kind of information is returned. This argument is optional, the default mode is \"stats\".\n"
             "  - \"stats\" returns general statistics about memory usage in the daemon.\n"
+            "  - \"detailed\" returns the statistics and the estimated memory usage of every subsystem.\n"
             "  - \"mallocinfo\" returns an XML string describing low-level heap state (only available if compiled with glibc 2.10+).\n"
             "\nResult (mode \"stats\"):\n"
             "{\n"
@@ -432,6 +455,34 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"signaturecache\": {       (json object) Information about the cache of valid signatures\n"
+            "    \"capacity\": xxxxx,      (numeric) Number of entries that fit, see -maxsigcachesize\n"
+            "    \"occupied\": xxxxx,      (numeric) Number of entries held\n"
+            "    \"bytes\": xxxxx,         (numeric) Number of bytes allocated for the entries\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups that found their entry since startup\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that did not\n"
+            "    \"hitrate\": x.xxx        (numeric) hits / (hits + misses)\n"
+            "  },\n"
+            "  \"scriptcache\": {          (json object) Information about the cache of valid script executions, same fields\n"
+            "    ...\n"
+            "  },\n"
+            "  \"messagesignaturecache\": { (json object) Information about the cache of valid masternode, InstantSend and spork message signatures, same fields, see -maxmsgsigcachesize\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nResult (mode \"detailed\"), the fields of mode \"stats\" and:\n"
+            "{\n"
+            "  \"usage\": {                (json object) Estimated number of bytes used by\n"
+            "    \"blockindex\": xxxxx,    (numeric) the block index, with the Equihash solutions kept in memory\n"
+            "    \"coinstip\": xxxxx,      (numeric) the coins cache, see -dbcache\n"
+            "    \"mempool\": xxxxx,       (numeric) the memory pool, see -maxmempool\n"
+            "    \"masternodes\": xxxxx,   (numeric) the masternode list, see getmasternodestats for every map\n"
+            "    \"masternodepayments\": xxxxx, (numeric) the masternode payment votes\n"
+            "    \"instantsend\": xxxxx,   (numeric) the InstantSend lock requests, votes and candidates\n"
+            "    \"treasury\": xxxxx,      (numeric) the treasury proposals and scripts, if built with the treasury\n"
+            "    \"signaturecaches\": xxxxx, (numeric) the signature, script and message signature caches\n"
+            "    \"wallet\": xxxxx         (numeric) the transactions and keys of the loaded wallets\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -442,9 +493,53 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
 
     std::string mode = request.params[0].isNull() ? "stats" : request.params[0].get_str();
-    if (mode == "stats") {
+    if (mode == "stats" || mode == "detailed") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        const SignatureCacheStats sigCacheStats = GetSignatureCacheStats();
+        const SignatureCacheStats msgSigCacheStats = GetMessageSignatureCacheStats();
+        obj.pushKV("signaturecache", RPCSignatureCacheInfo(sigCacheStats));
+        obj.pushKV("messagesignaturecache", RPCSignatureCacheInfo(msgSigCacheStats));
+        size_t nBlockIndexUsage = 0, nCoinsTipUsage = 0;
+        SignatureCacheStats scriptCacheStats;
+        {
+            LOCK(cs_main);
+            scriptCacheStats = GetScriptExecutionCacheStats();
+            if (mode == "detailed") {
+                nBlockIndexUsage = BlockIndexDynamicMemoryUsage();
+                nCoinsTipUsage = pcoinsTip->DynamicMemoryUsage();
+            }
+        }
+        obj.pushKV("scriptcache", RPCSignatureCacheInfo(scriptCacheStats));
+        if (mode == "stats")
+            return obj;
+
+        UniValue usage(UniValue::VOBJ);
+        usage.pushKV("blockindex", (uint64_t)nBlockIndexUsage);
+        usage.pushKV("coinstip", (uint64_t)nCoinsTipUsage);
+        usage.pushKV("mempool", (uint64_t)mempool.DynamicMemoryUsage());
+        size_t nMasternodesUsage = 0;
+        for (const auto& entry : mnodeman.GetMemoryUsage()) {
+            nMasternodesUsage += entry.second;
+        }
+        usage.pushKV("masternodes", (uint64_t)nMasternodesUsage);
+        usage.pushKV("masternodepayments", (uint64_t)mnpayments.DynamicMemoryUsage());
+        usage.pushKV("instantsend", (uint64_t)instantsend.DynamicMemoryUsage());
+#ifdef ENABLE_TREASURY
+        {
+            LOCK(cs_treasury);
+            usage.pushKV("treasury", (uint64_t)activeTreasury.DynamicMemoryUsage());
+        }
+#endif
+        usage.pushKV("signaturecaches", uint64_t((sigCacheStats.nCapacity + scriptCacheStats.nCapacity + msgSigCacheStats.nCapacity) * sizeof(uint256)));
+        size_t nWalletUsage = 0;
+#ifdef ENABLE_WALLET
+        for (CWalletRef pwallet : vpwallets) {
+            nWalletUsage += pwallet->DynamicMemoryUsage();
+        }
+#endif
+        usage.pushKV("wallet", (uint64_t)nWalletUsage);
+        obj.pushKV("usage", usage);
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -474,6 +569,148 @@ uint32_t getCategoryMask(UniValue cats) {
     return mask;
 }
 
+UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "Returns the queues of validation callbacks, one for every listener such as\n"
+            "the wallet, an index or the ZMQ notifications. A listener that does not keep up\n"
+            "makes block connection wait once it has more than " + std::to_string(MAX_VALIDATION_QUEUE_DEPTH) + " callbacks queued.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",       (string) The listener\n"
+            "    \"queued\": n,          (numeric) Callbacks queued now\n"
+            "    \"maxqueued\": n        (numeric) Most callbacks queued at once since the listener was registered\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+        );
+
+    UniValue result(UniValue::VARR);
+    for (const CMainSignals::QueueInfo& info : GetMainSignals().GetQueueInfo()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", info.strName);
+        obj.pushKV("queued", (uint64_t)info.nQueued);
+        obj.pushKV("maxqueued", (uint64_t)info.nMaxQueued);
+        result.push_back(obj);
+    }
+    return result;
+}
+
+UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getschedulerinfo\n"
+            "Returns the background tasks the scheduler ran so far, such as the validation callbacks\n"
+            "and the periodic flushes to disk, with how long they waited past their time (lag) and took.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queued\": n,              (numeric) Tasks waiting to run\n"
+            "  \"tasks\": [\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",         (string) The task\n"
+            "      \"priority\": \"xxxx\",     (string) high, normal or low\n"
+            "      \"runs\": n,              (numeric) Times it ran\n"
+            "      \"avglagmicros\": n,      (numeric) Average time it waited past its time in microseconds\n"
+            "      \"maxlagmicros\": n,      (numeric) Longest of those in microseconds\n"
+            "      \"avgrunmicros\": n,      (numeric) Average time it took in microseconds\n"
+            "      \"maxrunmicros\": n       (numeric) Longest of those in microseconds\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+        );
+
+    static const char* const PRIORITY_NAMES[CScheduler::NUM_PRIORITIES] = {"high", "normal", "low"};
+    boost::chrono::system_clock::time_point first, last;
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("queued", (uint64_t)GetScheduler().getQueueInfo(first, last));
+    UniValue tasks(UniValue::VARR);
+    for (const CScheduler::TaskStats& stats : GetScheduler().getTaskStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", stats.strName);
+        obj.pushKV("priority", PRIORITY_NAMES[stats.priority]);
+        obj.pushKV("runs", stats.nRuns);
+        obj.pushKV("avglagmicros", stats.nRuns ? stats.nTotalLagMicros / (int64_t)stats.nRuns : 0);
+        obj.pushKV("maxlagmicros", stats.nMaxLagMicros);
+        obj.pushKV("avgrunmicros", stats.nRuns ? stats.nTotalRunMicros / (int64_t)stats.nRuns : 0);
+        obj.pushKV("maxrunmicros", stats.nMaxRunMicros);
+        tasks.push_back(obj);
+    }
+    result.pushKV("tasks", tasks);
+    return result;
+}
+
+UniValue getlockcontention(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            "getlockcontention ( count reset )\n"
+            "Returns the LOCK() call sites of cs_main, cs_wallet and the masternode and InstantSend locks\n"
+            "that waited longest in total, with how long they waited and held the lock.\n"
+            "Only recorded with -lockprofile, hold times are measured for one in " + std::to_string(LOCK_PROFILE_SAMPLE_RATE) + " acquisitions.\n"
+            "\nArguments:\n"
+            "1. count    (numeric, optional, default=20) The number of call sites to return\n"
+            "2. reset    (boolean, optional, default=false) Clear the recorded times afterwards\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"xxxx\",          (string) The lock, as written at the call site\n"
+            "    \"site\": \"file:line\",     (string) The call site\n"
+            "    \"contentions\": n,        (numeric) Times it had to wait for another thread\n"
+            "    \"waitmicros\": n,         (numeric) Total time spent waiting in microseconds\n"
+            "    \"maxwaitmicros\": n,      (numeric) Longest wait in microseconds\n"
+            "    \"holdsamples\": n,        (numeric) Acquisitions whose hold time was measured\n"
+            "    \"avgholdmicros\": n,      (numeric) Average hold time of those in microseconds\n"
+            "    \"maxholdmicros\": n       (numeric) Longest of those in microseconds\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockcontention", "")
+            + HelpExampleCli("getlockcontention", "10 true")
+            + HelpExampleRpc("getlockcontention", "10, true")
+        );
+
+    int nCount = request.params[0].isNull() ? 20 : request.params[0].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    bool fReset = request.params[1].isNull() ? false : request.params[1].get_bool();
+
+    std::vector<CLockSiteStats> vSites = GetLockSiteStats();
+    if (fReset)
+        ResetLockSiteStats();
+    std::sort(vSites.begin(), vSites.end(), [](const CLockSiteStats& a, const CLockSiteStats& b) {
+        return a.nWaitMicros != b.nWaitMicros ? a.nWaitMicros > b.nWaitMicros : a.nContentions > b.nContentions;
+    });
+    if (vSites.size() > (size_t)nCount)
+        vSites.resize(nCount);
+
+    UniValue result(UniValue::VARR);
+    for (const CLockSiteStats& site : vSites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", site.strName);
+        obj.pushKV("site", strprintf("%s:%d", site.strFile, site.nLine));
+        obj.pushKV("contentions", site.nContentions);
+        obj.pushKV("waitmicros", site.nWaitMicros);
+        obj.pushKV("maxwaitmicros", site.nMaxWaitMicros);
+        obj.pushKV("holdsamples", site.nHoldSamples);
+        obj.pushKV("avgholdmicros", site.nHoldSamples ? site.nHoldMicros / site.nHoldSamples : 0);
+        obj.pushKV("maxholdmicros", site.nMaxHoldMicros);
+        result.push_back(obj);
+    }
+    return result;
+}
+
 UniValue logging(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2) {
@@ -549,6 +786,19 @@ UniValue mnsync(const JSONRPCRequest& request)
         throw std::runtime_error(
             "mnsync [status|next|reset]\n"
             "Returns the sync status, updates to the next step or resets it entirely.\n"
+            "\nThe status lists, under \"Assets\", every asset synced since the last reset:\n"
+            "  {\n"
+            "    \"AssetID\": n,             (numeric) the asset\n"
+            "    \"AssetName\": \"name\",      (string) its name\n"
+            "    \"StartTime\": n,           (numeric) when it started, in seconds since epoch\n"
+            "    \"Duration\": n,            (numeric) seconds it took, or took so far\n"
+            "    \"Finished\": true|false,   (boolean) whether the sync moved past it\n"
+            "    \"TimedOut\": true|false,   (boolean) whether it stopped waiting for peers\n"
+            "    \"PeersAsked\": n,          (numeric) peers it was requested from\n"
+            "    \"PeersReported\": n,       (numeric) of them, peers that reported how many items they sent\n"
+            "    \"ItemsReported\": n,       (numeric) items these peers reported\n"
+            "    \"ItemsReceived\": n        (numeric) items received, headers and blocks for the blockchain assets\n"
+            "  }\n"
         );
 
     std::string strMode = request.params[0].get_str();
@@ -564,6 +814,24 @@ UniValue mnsync(const JSONRPCRequest& request)
         objStatus.pushKV("IsWinnersListSynced", masternodeSync.IsWinnersListSynced());
         objStatus.pushKV("IsSynced", masternodeSync.IsSynced());
         objStatus.pushKV("IsFailed", masternodeSync.IsFailed());
+
+        UniValue assets(UniValue::VARR);
+        for (const auto& asset : masternodeSync.GetAssetStats()) {
+            const CMasternodeSyncAssetStats& stats = asset.second;
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("AssetID", asset.first);
+            obj.pushKV("AssetName", CMasternodeSync::GetAssetName(asset.first));
+            obj.pushKV("StartTime", stats.nTimeStarted);
+            obj.pushKV("Duration", (stats.nTimeFinished ? stats.nTimeFinished : GetTime()) - stats.nTimeStarted);
+            obj.pushKV("Finished", stats.nTimeFinished != 0);
+            obj.pushKV("TimedOut", stats.fTimedOut);
+            obj.pushKV("PeersAsked", (int)stats.setPeersAsked.size());
+            obj.pushKV("PeersReported", (int)stats.setPeersReported.size());
+            obj.pushKV("ItemsReported", stats.nItemsReported);
+            obj.pushKV("ItemsReceived", stats.nItemsReceived);
+            assets.push_back(obj);
+        }
+        objStatus.pushKV("Assets", assets);
         return objStatus;
     }
 
@@ -661,6 +929,241 @@ UniValue spork(const JSONRPCRequest& request)
 
 }
 
+/** The index to answer an address or spent index RPC from, throws if it is not there (yet) */
+static const CAddressIndex& GetAddressIndex(bool (CAddressIndex::*fHasIndex)() const, const std::string& strOption)
+{
+    if (!paddressindex || !(paddressindex.get()->*fHasIndex)())
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("This call needs %s", strOption));
+    if (!paddressindex->IsSynced())
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is still being built");
+    return *paddressindex;
+}
+
+/** The addresses of an {"addresses": [...]} argument, or of a single address string */
+static std::vector<CIndexAddress> ParseIndexAddresses(const UniValue& param)
+{
+    std::vector<UniValue> vValues;
+    if (param.isStr()) {
+        vValues.push_back(param);
+    } else if (param.isObject()) {
+        vValues = find_value(param.get_obj(), "addresses").get_array().getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with addresses");
+    }
+
+    std::vector<CIndexAddress> addresses;
+    for (const UniValue& value : vValues) {
+        const CIndexAddress address = CIndexAddress::FromDestination(DecodeDestination(value.get_str()));
+        if (address.IsNull())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Invalid or not indexed address: %s", value.get_str()));
+        addresses.push_back(address);
+    }
+    return addresses;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of addresses, from the address index (requires -addressindex).\n"
+            "P2PKH (also matching P2PK outputs), P2SH and P2WPKH addresses are indexed.\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"           (array, required) The globaltoken addresses\n"
+            "    [\n"
+            "      \"address\"         (string) A globaltoken address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,         (numeric) The current balance in satoshis\n"
+            "  \"received\": n,        (numeric) The total number of satoshis received, change included\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}'")
+            + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}")
+        );
+
+    const CAddressIndex& index = GetAddressIndex(&CAddressIndex::HasAddressIndex, "-addressindex");
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const CIndexAddress& address : ParseIndexAddresses(request.params[0])) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!index.ReadAddressIndex(address, entries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        for (const auto& entry : entries) {
+            nBalance += entry.second;
+            if (!entry.first.fSpending)
+                nReceived += entry.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance", nBalance);
+    result.pushKV("received", nReceived);
+    return result;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids of the transactions of the active chain paying to or spending from addresses,\n"
+            "from the address index (requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"           (array, required) The globaltoken addresses\n"
+            "    [\n"
+            "      \"address\"         (string) A globaltoken address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" (numeric, optional) The height of the first block to include\n"
+            "  \"end\" (numeric, optional) The height of the last block to include\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"       (string) The transaction id, in the order of the chain\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}'")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}")
+        );
+
+    const CAddressIndex& index = GetAddressIndex(&CAddressIndex::HasAddressIndex, "-addressindex");
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (request.params[0].isObject()) {
+        const UniValue& startValue = find_value(request.params[0].get_obj(), "start");
+        const UniValue& endValue = find_value(request.params[0].get_obj(), "end");
+        if (!startValue.isNull())
+            nStart = startValue.get_int();
+        if (!endValue.isNull())
+            nEnd = endValue.get_int();
+        if (nStart < 0 || nEnd < 0 || (nEnd > 0 && nEnd < nStart))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start or end height");
+    }
+
+    // By height, then by txid, with every transaction once
+    std::vector<std::pair<int, uint256>> vTxids;
+    for (const CIndexAddress& address : ParseIndexAddresses(request.params[0])) {
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        if (!index.ReadAddressIndex(address, entries, nStart, nEnd))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        for (const auto& entry : entries)
+            vTxids.emplace_back(entry.first.nHeight, entry.first.txid);
+    }
+    std::sort(vTxids.begin(), vTxids.end());
+    vTxids.erase(std::unique(vTxids.begin(), vTxids.end()), vTxids.end());
+
+    UniValue result(UniValue::VARR);
+    for (const auto& txid : vTxids)
+        result.push_back(txid.second.GetHex());
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of the active chain paying to addresses, from the address index\n"
+            "(requires -addressindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"           (array, required) The globaltoken addresses\n"
+            "    [\n"
+            "      \"address\"         (string) A globaltoken address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\", (string) The address\n"
+            "    \"txid\": \"hash\",       (string) The id of the transaction of the output\n"
+            "    \"outputIndex\": n,     (numeric) The index of the output\n"
+            "    \"script\": \"hex\",      (string) The hex encoded output script\n"
+            "    \"satoshis\": n,        (numeric) The value of the output in satoshis\n"
+            "    \"height\": n           (numeric) The height of the block the output is in\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}'")
+            + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"GdCvo5ZYRVHamNmSrxanyZdiR86krcH22j\"]}")
+        );
+
+    const CAddressIndex& index = GetAddressIndex(&CAddressIndex::HasAddressIndex, "-addressindex");
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent;
+    for (const CIndexAddress& address : ParseIndexAddresses(request.params[0])) {
+        if (!index.ReadAddressUnspent(address, unspent))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+    }
+    std::stable_sort(unspent.begin(), unspent.end(), [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+        return a.second.nHeight < b.second.nHeight;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (const auto& entry : unspent) {
+        UniValue output(UniValue::VOBJ);
+        output.pushKV("address", EncodeDestination(entry.first.address.GetDestination()));
+        output.pushKV("txid", entry.first.outpoint.hash.GetHex());
+        output.pushKV("outputIndex", (int)entry.first.outpoint.n);
+        output.pushKV("script", HexStr(entry.second.scriptPubKey.begin(), entry.second.scriptPubKey.end()));
+        output.pushKV("satoshis", entry.second.nValue);
+        output.pushKV("height", entry.second.nHeight);
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the input of the active chain that spends an output, from the spent index (requires -spentindex).\n"
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\" (string, required) The id of the transaction of the output\n"
+            "  \"index\" (numeric, required) The index of the output\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",         (string) The id of the spending transaction\n"
+            "  \"index\": n,             (numeric) The index of the spending input\n"
+            "  \"height\": n             (numeric) The height of the block of the spending transaction\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
+        );
+
+    const CAddressIndex& index = GetAddressIndex(&CAddressIndex::HasSpentIndex, "-spentindex");
+
+    const uint256 txid = ParseHashO(request.params[0], "txid");
+    const int nOutput = find_value(request.params[0].get_obj(), "index").get_int();
+    if (nOutput < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    CSpentIndexValue value;
+    if (!index.ReadSpentIndex(COutPoint(txid, nOutput), value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", value.txid.GetHex());
+    result.pushKV("index", (int)value.nInput);
+    result.pushKV("height", value.nHeight);
+    return result;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -690,6 +1193,9 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getvalidationqueueinfo", &getvalidationqueueinfo, {} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       {} },
+    { "control",            "getlockcontention",      &getlockcontention,      {"count", "reset"} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
@@ -698,6 +1204,12 @@ static const CRPCCommand commands[] =
     { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
     { "util",               "signmessagewithprivkey", &signmessagewithprivkey, {"privkey","message"} },
     { "util",               "listattackersaddresses", &listattackersaddresses, {} },
+
+    /* Address and spent index */
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      {"addresses"} },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        {"addresses"} },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        {"addresses"} },
+    { "addressindex",       "getspentinfo",           &getspentinfo,           {"json"} },
     
     /* Globaltoken features */
     { "globaltoken",        "mnsync",                 &mnsync,                 {} },
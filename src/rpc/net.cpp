@@ -109,6 +109,18 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"msgstats_per_msg\": {      (json object) How the messages received were handled, by message type\n"
+            "       \"addr\": {\n"
+            "         \"count\": n,             (numeric) Messages processed\n"
+            "         \"failed\": n,            (numeric) Processed messages that were rejected or failed to parse\n"
+            "         \"dropped\": n,           (numeric) Messages discarded for a bad header or checksum\n"
+            "         \"processmicros\": n,     (numeric) Total processing time in microseconds\n"
+            "         \"maxprocessmicros\": n,  (numeric) Slowest message in microseconds\n"
+            "         \"queuemicros\": n,       (numeric) Total time messages waited to be processed in microseconds\n"
+            "         \"maxqueuemicros\": n     (numeric) Longest wait in microseconds\n"
+            "       },\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -184,6 +196,20 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue statsPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdStats::value_type &i : stats.mapRecvStatsPerMsgCmd) {
+            UniValue cmdStats(UniValue::VOBJ);
+            cmdStats.pushKV("count", i.second.nCount);
+            cmdStats.pushKV("failed", i.second.nFailed);
+            cmdStats.pushKV("dropped", i.second.nDropped);
+            cmdStats.pushKV("processmicros", i.second.nProcessMicros);
+            cmdStats.pushKV("maxprocessmicros", i.second.nMaxProcessMicros);
+            cmdStats.pushKV("queuemicros", i.second.nQueueMicros);
+            cmdStats.pushKV("maxqueuemicros", i.second.nMaxQueueMicros);
+            statsPerMsgCmd.pushKV(i.first, cmdStats);
+        }
+        obj.pushKV("msgstats_per_msg", statsPerMsgCmd);
+
         ret.push_back(obj);
     }
 
@@ -392,6 +418,54 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getmessagestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getmessagestats\n"
+            "\nReturns how the messages received from all peers since startup were handled, by message type.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {\n"
+            "    \"count\": n,               (numeric) Messages processed\n"
+            "    \"failed\": n,              (numeric) Processed messages that were rejected or failed to parse\n"
+            "    \"dropped\": n,             (numeric) Messages discarded for a bad header or checksum\n"
+            "    \"processtime\": {          (json object) Time spent processing\n"
+            "      \"totalmicros\": n,       (numeric) Total time in microseconds\n"
+            "      \"maxmicros\": n,         (numeric) Slowest message in microseconds\n"
+            "      \"histogram\": [          (array) Non-empty buckets\n"
+            "        {\n"
+            "          \"belowmicros\": n,   (numeric) Upper bound of the bucket, absent for the last one\n"
+            "          \"count\": n          (numeric) Messages in the bucket\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    },\n"
+            "    \"queuetime\": {            (json object) Time between receiving and processing, like processtime\n"
+            "      ...\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmessagestats", "")
+            + HelpExampleRpc("getmessagestats", "")
+       );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& entry : g_connman->GetMessageTotals()) {
+        const CMsgCmdTotals& totals = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", totals.processTime.nCount);
+        obj.pushKV("failed", totals.nFailed);
+        obj.pushKV("dropped", totals.nDropped);
+        obj.pushKV("processtime", TimingHistogramToJSON(totals.processTime));
+        obj.pushKV("queuetime", TimingHistogramToJSON(totals.queueTime));
+        ret.pushKV(entry.first, obj);
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -634,6 +708,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getmessagestats",        &getmessagestats,        {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -27,6 +27,7 @@
 #include <script/script_error.h>
 #include <script/sign.h>
 #include <script/standard.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <utilstrencodings.h>
@@ -208,9 +209,13 @@ UniValue getrawtransaction(const JSONRPCRequest& request)
             }
             errmsg = "No such transaction found in the provided block";
         } else {
-            errmsg = fTxIndex
-              ? "No such mempool or blockchain transaction"
-              : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            if (!fTxIndex) {
+                errmsg = "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
+            } else if (ptxindex && !ptxindex->IsSynced()) {
+                errmsg = strprintf("No such mempool or blockchain transaction, the transaction index is still being built (at height %d)", ptxindex->GetBestHeight());
+            } else {
+                errmsg = "No such mempool or blockchain transaction";
+            }
         }
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, errmsg + ". Use gettransaction for wallet transactions.");
     }
@@ -817,15 +822,19 @@ UniValue SignTransaction(CMutableTransaction& mtx, const UniValue& prevTxsUnival
     UniValue vErrors(UniValue::VARR);
 
     // Use CTransaction for the constant parts of the
-    // transaction to avoid rehashing.
+    // transaction to avoid rehashing. Signatures do not cover the input
+    // scripts of each other, so all inputs are signed against it, in
+    // parallel, and then verified in parallel once all are in place.
     const CTransaction txConst(mtx);
-    // Sign what we can:
-    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
-        CTxIn& txin = mtx.vin[i];
-        const Coin& coin = view.AccessCoin(txin.prevout);
+    std::vector<const Coin*> vCoins;
+    for (const CTxIn& txin : mtx.vin) {
+        vCoins.push_back(&view.AccessCoin(txin.prevout));
+    }
+    std::vector<SignatureData> vSigData(mtx.vin.size());
+    ForEachInputInParallel(mtx.vin.size(), [&](unsigned int i) {
+        const Coin& coin = *vCoins[i];
         if (coin.IsSpent()) {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
-            continue;
+            return;
         }
         const CScript& prevPubKey = coin.out.scriptPubKey;
         const CAmount& amount = coin.out.nValue;
@@ -833,20 +842,37 @@ UniValue SignTransaction(CMutableTransaction& mtx, const UniValue& prevTxsUnival
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mtx.vout.size())) {
-            ProduceSignature(MutableTransactionSignatureCreator(keystore, &mtx, i, amount, nHashType), prevPubKey, sigdata);
+            ProduceSignature(TransactionSignatureCreator(keystore, &txConst, i, amount, nHashType), prevPubKey, sigdata);
         }
-        sigdata = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, amount), sigdata, DataFromTransaction(mtx, i));
+        vSigData[i] = CombineSignatures(prevPubKey, TransactionSignatureChecker(&txConst, i, amount), sigdata, DataFromTransaction(mtx, i));
+    });
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        if (!vCoins[i]->IsSpent()) {
+            UpdateTransaction(mtx, i, vSigData[i]);
+        }
+    }
 
-        UpdateTransaction(mtx, i, sigdata);
+    std::vector<ScriptError> vScriptErrors(mtx.vin.size(), SCRIPT_ERR_OK);
+    ForEachInputInParallel(mtx.vin.size(), [&](unsigned int i) {
+        const CTxIn& txin = mtx.vin[i];
+        const Coin& coin = *vCoins[i];
+        if (coin.IsSpent()) {
+            return;
+        }
+        if (!VerifyScript(txin.scriptSig, coin.out.scriptPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, coin.out.nValue), &vScriptErrors[i]) && vScriptErrors[i] == SCRIPT_ERR_OK) {
+            vScriptErrors[i] = SCRIPT_ERR_UNKNOWN_ERROR;
+        }
+    });
 
-        ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, amount), &serror)) {
-            if (serror == SCRIPT_ERR_INVALID_STACK_OPERATION) {
-                // Unable to sign input and verification failed (possible attempt to partially sign).
-                TxInErrorToJSON(txin, vErrors, "Unable to sign input, invalid stack size (possibly missing key)");
-            } else {
-                TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
-            }
+    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
+        CTxIn& txin = mtx.vin[i];
+        if (vCoins[i]->IsSpent()) {
+            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
+        } else if (vScriptErrors[i] == SCRIPT_ERR_INVALID_STACK_OPERATION) {
+            // Unable to sign input and verification failed (possible attempt to partially sign).
+            TxInErrorToJSON(txin, vErrors, "Unable to sign input, invalid stack size (possibly missing key)");
+        } else if (vScriptErrors[i] != SCRIPT_ERR_OK) {
+            TxInErrorToJSON(txin, vErrors, ScriptErrorString(vScriptErrors[i]));
         }
     }
     bool fComplete = vErrors.empty();
@@ -1099,7 +1125,7 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     bool fHaveMempool = mempool.exists(hashTx);
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
-        if (fInstantSend && !instantsend.ProcessTxLockRequest(*tx, *g_connman)) {
+        if (fInstantSend && !instantsend.ProcessTxLockRequest(CTxLockRequest(tx), *g_connman)) {
             throw JSONRPCError(RPC_TRANSACTION_ERROR, "Not a valid InstantSend transaction, see debug.log for more info");
         }
         CValidationState state;
@@ -1144,6 +1170,145 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The transactions are validated under a single lock, parents before the transactions\n"
+            "of the batch spending them, so a chain of transactions can be sent in any order.\n"
+            "A transaction failing does not stop the others from being accepted.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) One entry per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\": \"hex\",     (string) The transaction hash in hex\n"
+            "    \"accepted\": true|false, (boolean) Whether the transaction is in the mempool now\n"
+            "    \"error\": \"str\"     (string) Why the transaction was not accepted (only present if not accepted)\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    ObserveSafeMode();
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexTxs = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexTxs.size());
+    for (unsigned int i = 0; i < hexTxs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexTxs[i].isStr() || !DecodeHexTx(mtx, hexTxs[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Order the batch so each transaction comes after the ones of the batch it
+    // spends. Later copies of a transaction are left out, they get its result.
+    std::map<uint256, size_t> mapBatchIndex;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        mapBatchIndex.emplace(vtx[i]->GetHash(), i);
+    }
+    std::vector<std::vector<size_t>> vChildren(vtx.size());
+    std::vector<size_t> vParentsLeft(vtx.size(), 0);
+    std::vector<size_t> vOrder;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (mapBatchIndex[vtx[i]->GetHash()] != i)
+            continue;
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vtx[i]->vin) {
+            auto it = mapBatchIndex.find(txin.prevout.hash);
+            if (it != mapBatchIndex.end() && setParents.insert(it->second).second) {
+                vChildren[it->second].push_back(i);
+                vParentsLeft[i]++;
+            }
+        }
+        if (vParentsLeft[i] == 0)
+            vOrder.push_back(i);
+    }
+    for (size_t n = 0; n < vOrder.size(); n++) {
+        for (size_t child : vChildren[vOrder[n]]) {
+            if (--vParentsLeft[child] == 0)
+                vOrder.push_back(child);
+        }
+    }
+
+    std::vector<bool> vAccepted(vtx.size(), false);
+    std::vector<std::string> vError(vtx.size());
+    std::vector<CTransactionRef> vRelay;
+    std::promise<void> promise;
+
+    { // cs_main scope
+    LOCK(cs_main);
+    CCoinsViewCache &view = *pcoinsTip;
+    for (size_t i : vOrder) {
+        const CTransactionRef& tx = vtx[i];
+        const uint256& hashTx = tx->GetHash();
+        bool fHaveChain = false;
+        for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
+            const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+            fHaveChain = !existingCoin.IsSpent();
+        }
+        if (fHaveChain) {
+            vError[i] = "transaction already in block chain";
+            continue;
+        }
+        if (mempool.exists(hashTx)) {
+            vAccepted[i] = true;
+            vRelay.push_back(tx);
+            continue;
+        }
+        CValidationState state;
+        bool fMissingInputs;
+        if (!AcceptToMemoryPool(mempool, state, tx, &fMissingInputs,
+                                nullptr /* plTxnReplaced */, false /* bypass_limits */, nMaxRawTxFee)) {
+            vError[i] = !state.IsInvalid() && fMissingInputs ? "Missing inputs" : FormatStateMessage(state);
+            continue;
+        }
+        vAccepted[i] = true;
+        vRelay.push_back(tx);
+    }
+    // As in sendrawtransaction, let the wallet see the new transactions before returning
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+    } // cs_main
+
+    promise.get_future().wait();
+
+    if (!vRelay.empty()) {
+        if (!g_connman)
+            throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+        for (const CTransactionRef& tx : vRelay) {
+            RelayTransactionFromExtern(*tx, g_connman.get());
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        // Copies of a transaction share the result of the first one
+        size_t nFirst = mapBatchIndex[vtx[i]->GetHash()];
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vtx[i]->GetHash().GetHex());
+        entry.pushKV("accepted", vAccepted[nFirst]);
+        if (!vAccepted[nFirst])
+            entry.pushKV("error", vError[nFirst]);
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
@@ -1152,6 +1317,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees", "instantsend"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransaction",           &signrawtransaction,        {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
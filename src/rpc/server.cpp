@@ -7,7 +7,9 @@
 
 #include <base58.h>
 #include <fs.h>
+#include <globaltoken/multihasher.h>
 #include <init.h>
+#include <net.h>
 #include <random.h>
 #include <sync.h>
 #include <ui_interface.h>
@@ -20,7 +22,11 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
+#include <set>
 #include <unordered_map>
 
 static bool fRPCRunning = false;
@@ -256,6 +262,127 @@ UniValue uptime(const JSONRPCRequest& jsonRequest)
     return GetTime() - GetStartupTime();
 }
 
+/** The calls of one method since startup */
+struct CRPCMethodStats
+{
+    CTimingHistogram latency;
+    uint64_t nErrors{0};
+    uint64_t nLockWaitMicros{0};
+};
+
+static CCriticalSection cs_rpcStats;
+static std::map<std::string, CRPCMethodStats> mapRPCStats;
+
+static void RecordRPCCall(const std::string& strMethod, int64_t nTimeStart, uint64_t nLockWaitStart, bool fFailed)
+{
+    const int64_t nMicros = GetTimeMicros() - nTimeStart;
+    const uint64_t nLockWaitMicros = GetThreadLockWaitMicros() - nLockWaitStart;
+    LOCK(cs_rpcStats);
+    CRPCMethodStats& stats = mapRPCStats[strMethod];
+    stats.latency.Add(nMicros);
+    stats.nLockWaitMicros += nLockWaitMicros;
+    if (fFailed)
+        stats.nErrors++;
+}
+
+UniValue TimingHistogramToJSON(const CTimingHistogram& histogram)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("totalmicros", histogram.nTotalMicros);
+    obj.pushKV("maxmicros", histogram.nMaxMicros);
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < CTimingHistogram::NUM_BUCKETS; i++) {
+        if (histogram.vBuckets[i] == 0) continue;
+        UniValue bucket(UniValue::VOBJ);
+        if (i < CTimingHistogram::NUM_BUCKETS - 1)
+            bucket.pushKV("belowmicros", (uint64_t)1 << i);
+        bucket.pushKV("count", histogram.vBuckets[i]);
+        buckets.push_back(bucket);
+    }
+    obj.pushKV("histogram", buckets);
+    return obj;
+}
+
+std::string RPCStatsToPrometheus()
+{
+    std::map<std::string, CRPCMethodStats> mapStats;
+    {
+        LOCK(cs_rpcStats);
+        mapStats = mapRPCStats;
+    }
+
+    std::string strCalls = "# HELP globaltoken_rpc_calls_total RPC calls handled, by method.\n"
+                           "# TYPE globaltoken_rpc_calls_total counter\n";
+    std::string strErrors = "# HELP globaltoken_rpc_errors_total RPC calls that returned an error, by method.\n"
+                            "# TYPE globaltoken_rpc_errors_total counter\n";
+    std::string strLockWait = "# HELP globaltoken_rpc_lock_wait_seconds_total Time RPC calls waited for cs_main and the other instrumented locks, by method.\n"
+                              "# TYPE globaltoken_rpc_lock_wait_seconds_total counter\n";
+    std::string strDuration = "# HELP globaltoken_rpc_duration_seconds Time RPC calls took, by method.\n"
+                              "# TYPE globaltoken_rpc_duration_seconds histogram\n";
+    for (const auto& entry : mapStats) {
+        const std::string strLabel = "method=\"" + entry.first + "\"";
+        const CRPCMethodStats& stats = entry.second;
+        strCalls += strprintf("globaltoken_rpc_calls_total{%s} %u\n", strLabel, stats.latency.nCount);
+        strErrors += strprintf("globaltoken_rpc_errors_total{%s} %u\n", strLabel, stats.nErrors);
+        strLockWait += strprintf("globaltoken_rpc_lock_wait_seconds_total{%s} %.6f\n", strLabel, stats.nLockWaitMicros / 1e6);
+        uint64_t nCumulative = 0;
+        for (int i = 0; i < CTimingHistogram::NUM_BUCKETS - 1; i++) {
+            nCumulative += stats.latency.vBuckets[i];
+            strDuration += strprintf("globaltoken_rpc_duration_seconds_bucket{%s,le=\"%.6f\"} %u\n", strLabel, ((uint64_t)1 << i) / 1e6, nCumulative);
+        }
+        strDuration += strprintf("globaltoken_rpc_duration_seconds_bucket{%s,le=\"+Inf\"} %u\n", strLabel, stats.latency.nCount);
+        strDuration += strprintf("globaltoken_rpc_duration_seconds_sum{%s} %.6f\n", strLabel, stats.latency.nTotalMicros / 1e6);
+        strDuration += strprintf("globaltoken_rpc_duration_seconds_count{%s} %u\n", strLabel, stats.latency.nCount);
+    }
+    return strCalls + strErrors + strLockWait + strDuration;
+}
+
+UniValue getrpcstats(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() != 0)
+        throw std::runtime_error(
+            "getrpcstats\n"
+            "\nReturns how often each RPC method was called since startup, and how long the calls took.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"method\": {\n"
+            "    \"count\": n,               (numeric) Calls handled\n"
+            "    \"errors\": n,              (numeric) Calls that returned an error\n"
+            "    \"lockwaitmicros\": n,      (numeric) Time waited for cs_main and the other instrumented locks, in microseconds\n"
+            "    \"totalmicros\": n,         (numeric) Total time of the calls in microseconds\n"
+            "    \"maxmicros\": n,           (numeric) Slowest call in microseconds\n"
+            "    \"histogram\": [            (array) Non-empty buckets\n"
+            "      {\n"
+            "        \"belowmicros\": n,     (numeric) Upper bound of the bucket, absent for the last one\n"
+            "        \"count\": n            (numeric) Calls in the bucket\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    std::map<std::string, CRPCMethodStats> mapStats;
+    {
+        LOCK(cs_rpcStats);
+        mapStats = mapRPCStats;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    for (const auto& entry : mapStats) {
+        const CRPCMethodStats& stats = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", stats.latency.nCount);
+        obj.pushKV("errors", stats.nErrors);
+        obj.pushKV("lockwaitmicros", stats.nLockWaitMicros);
+        obj.pushKVs(TimingHistogramToJSON(stats.latency));
+        result.pushKV(entry.first, obj);
+    }
+    return result;
+}
+
 /**
  * Call Table
  */
@@ -266,6 +393,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "help",                   &help,                   {"command"}  },
     { "control",            "stop",                   &stop,                   {}  },
     { "control",            "uptime",                 &uptime,                 {}  },
+    { "control",            "getrpcstats",            &getrpcstats,            {}  },
 };
 
 CRPCTable::CRPCTable()
@@ -362,7 +490,7 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
     id = find_value(request, "id");
 
     // Parse method
-    UniValue valMethod = find_value(request, "method");
+    const UniValue& valMethod = find_value(request, "method");
     if (valMethod.isNull())
         throw JSONRPCError(RPC_INVALID_REQUEST, "Missing method");
     if (!valMethod.isStr())
@@ -371,7 +499,7 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
     LogPrint(BCLog::RPC, "ThreadRPCServer method=%s\n", SanitizeString(strMethod));
 
     // Parse params
-    UniValue valParams = find_value(request, "params");
+    const UniValue& valParams = find_value(request, "params");
     if (valParams.isArray() || valParams.isObject())
         params = valParams;
     else if (valParams.isNull())
@@ -410,12 +538,83 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
+//! Methods that only read, a batch of nothing else may run its calls at the same time
+static const std::set<std::string> setParallelMethods = {
+    "getbestblockhash", "getblock", "getblockchaininfo", "getblockcount", "getblockhash", "getblockhashes",
+    "getblockheader", "getblocksbyalgo", "getchaintips", "getdifficulty", "getmempoolancestors",
+    "getmempooldescendants", "getmempoolentry", "getmempoolinfo", "gettxout", "gettxoutproof",
+    "getrawtransaction", "decoderawtransaction", "decodescript", "validateaddress", "verifymessage",
+    "getaddressbalance", "getaddresstxids", "getaddressutxos", "getspentinfo",
+};
+
+static bool IsParallelBatch(const UniValue& vReq)
+{
+    for (size_t i = 0; i < vReq.size(); i++) {
+        const UniValue& method = find_value(vReq[i], "method");
+        if (!method.isStr() || !setParallelMethods.count(method.get_str()))
+            return false;
+    }
+    return true;
+}
+
+/** The calls of a batch, taken one at a time by the threads running them */
+struct RPCBatchState
+{
+    const JSONRPCRequest jreq;
+    const UniValue& vReq;
+    const size_t nSize;
+    std::vector<UniValue> vResults;
+    std::atomic<size_t> nNext{0};
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nDone{0};
+
+    RPCBatchState(const JSONRPCRequest& jreqIn, const UniValue& vReqIn) : jreq(jreqIn), vReq(vReqIn), nSize(vReqIn.size()), vResults(vReqIn.size()) {}
+};
+
+// vReq is the caller's, read only for the calls taken, which are all done
+// before the caller returns. A helper that runs later finds none left.
+static void RunBatchCalls(RPCBatchState& state)
+{
+    while (true) {
+        const size_t i = state.nNext++;
+        if (i >= state.nSize)
+            return;
+        UniValue result = JSONRPCExecOne(state.jreq, state.vReq[i]);
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.vResults[i] = std::move(result);
+            state.nDone++;
+        }
+        state.cond.notify_one();
+    }
+}
+
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq, const RPCQueueWorkFn& queueWork, int nMaxHelpers)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    if (!queueWork || nMaxHelpers <= 0 || vReq.size() < 2 || !IsParallelBatch(vReq)) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+        return ret.write() + "\n";
+    }
+
+    // Helpers take calls while this thread does, it never waits for one that
+    // was not taken, so it does not matter when or whether they run.
+    auto state = std::make_shared<RPCBatchState>(jreq, vReq);
+    const size_t nHelpers = std::min<size_t>(nMaxHelpers, vReq.size() - 1);
+    for (size_t i = 0; i < nHelpers; i++) {
+        if (!queueWork([state] { RunBatchCalls(*state); }))
+            break;
+    }
+    RunBatchCalls(*state);
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cond.wait(lock, [&state] { return state->nDone == state->nSize; });
+    }
 
+    for (UniValue& result : state->vResults)
+        ret.push_back(std::move(result));
     return ret.write() + "\n";
 }
 
@@ -485,19 +684,31 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    CHashPurposeScope hashPurpose(HashPurpose::RPC);
+    const int64_t nTimeStart = GetTimeMicros();
+    const uint64_t nLockWaitStart = GetThreadLockWaitMicros();
     try
     {
         // Execute, convert arguments to array if necessary
+        UniValue result;
         if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
+            result = pcmd->actor(transformNamedArguments(request, pcmd->argNames));
         } else {
-            return pcmd->actor(request);
+            result = pcmd->actor(request);
         }
+        RecordRPCCall(request.strMethod, nTimeStart, nLockWaitStart, false);
+        return result;
     }
     catch (const std::exception& e)
     {
+        RecordRPCCall(request.strMethod, nTimeStart, nLockWaitStart, true);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
+    catch (...)
+    {
+        RecordRPCCall(request.strMethod, nTimeStart, nLockWaitStart, true);
+        throw;
+    }
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
@@ -10,6 +10,7 @@
 #include <rpc/protocol.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -20,6 +21,7 @@
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 
 class CRPCCommand;
+class CTimingHistogram;
 
 namespace RPCServer
 {
@@ -36,6 +38,15 @@ struct UniValueType {
     UniValue::VType type;
 };
 
+/** Lets a method send a large result to the client in parts, as it is generated */
+class JSONRPCResultStream
+{
+public:
+    virtual ~JSONRPCResultStream() {}
+    /** Append JSON text to the result. Once a part is written, errors cannot be reported anymore. */
+    virtual void Write(const std::string& strPart) = 0;
+};
+
 class JSONRPCRequest
 {
 public:
@@ -45,8 +56,10 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /** Set by servers that can stream the result. A method that wrote to it returns NullUniValue. */
+    JSONRPCResultStream* resultStream;
 
-    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
+    JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false), resultStream(nullptr) {}
     void parse(const UniValue& valRequest);
 };
 
@@ -191,7 +204,19 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+/** Queues a function to run on another thread, false if it could not */
+typedef std::function<bool(const std::function<void()>&)> RPCQueueWorkFn;
+/**
+ * Execute a batch of requests. When every call of it only reads, up to
+ * nMaxHelpers helpers queued with queueWork run its calls alongside this
+ * thread. The replies are in the order of the requests either way.
+ */
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq, const RPCQueueWorkFn& queueWork = nullptr, int nMaxHelpers = 0);
+
+/** Totals and non-empty buckets of a timing histogram, as the stats RPCs report them */
+UniValue TimingHistogramToJSON(const CTimingHistogram& histogram);
+/** The stats getrpcstats reports, in the Prometheus text format */
+std::string RPCStatsToPrometheus();
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
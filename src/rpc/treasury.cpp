@@ -35,12 +35,16 @@
 #include <algorithm>
 #include <stdint.h>
 #include <sstream>
+#include <unordered_set>
 
 #include <univalue.h>
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <future>
 #include <condition_variable>
+#include <thread>
 
 bool IsTreasuryChangeAddrValid(const CScript& scriptTreasuryChange, CTxDestination &txDestination)
 {
@@ -61,26 +65,24 @@ bool IsTreasuryChangeAddrValid(const CScript& scriptTreasuryChange, CTxDestinati
     return (type == TX_SCRIPTHASH);
 }
 
-UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStore *keystore, const UniValue& hashType)
+/** Fetch the coins spent by mtx from the chain and the mempool into view. */
+static void FetchProposalTxCoins(const CMutableTransaction& mtx, CCoinsViewCache& view)
 {
-    CMutableTransaction &mtx = tpsl.mtx;
-    
-    // Fetch previous transactions (inputs):
     CCoinsView viewDummy;
-    CCoinsViewCache view(&viewDummy);
-    {
-        LOCK2(cs_main, mempool.cs);
-        CCoinsViewCache &viewChain = *pcoinsTip;
-        CCoinsViewMemPool viewMempool(&viewChain, mempool);
-        view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
-
-        for (const CTxIn& txin : mtx.vin) {
-            view.AccessCoin(txin.prevout); // Load entries from viewChain into view; can fail.
-        }
+    LOCK2(cs_main, mempool.cs);
+    CCoinsViewCache &viewChain = *pcoinsTip;
+    CCoinsViewMemPool viewMempool(&viewChain, mempool);
+    view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
+    for (const CTxIn& txin : mtx.vin) {
+        view.AccessCoin(txin.prevout); // Load entries from viewChain into view; can fail.
     }
 
+    view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
+}
+
+static int ParseTreasurySigHashType(const UniValue& hashType)
+{
     int nHashType = SIGHASH_ALL;
     if (!hashType.isNull()) {
         static std::map<std::string, int> mapSigHashValues = {
@@ -98,6 +100,16 @@ UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStor
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sighash param");
         }
     }
+    return nHashType;
+}
+
+/**
+ * Sign what we can of the proposal transaction with the coins already loaded into view.
+ * Takes no locks, so it can run on several proposals at once.
+ */
+static UniValue SignTreasuryTransaction(CTreasuryProposal& tpsl, const CBasicKeyStore *keystore, const CCoinsViewCache& view, int nHashType)
+{
+    CMutableTransaction &mtx = tpsl.mtx;
 
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
@@ -120,6 +132,10 @@ UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStor
         const CAmount& amount = coin.out.nValue;
         const CScript& currentSignature = txin.scriptSig;
 
+        // Inputs that already carry all signatures don't need our key.
+        if ((!txin.scriptSig.empty() || !txin.scriptWitness.IsNull()) && VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, amount)))
+            continue;
+
         SignatureData sigdata;
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mtx.vout.size())) {
@@ -158,6 +174,53 @@ UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStor
     return result;
 }
 
+UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStore *keystore, const UniValue& hashType)
+{
+    int nHashType = ParseTreasurySigHashType(hashType);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    FetchProposalTxCoins(tpsl.mtx, view);
+
+    return SignTreasuryTransaction(tpsl, keystore, view, nHashType);
+}
+
+UniValue SignTreasuryTransactionsPartially(const std::vector<CTreasuryProposal*>& vProposals, CBasicKeyStore *keystore, const UniValue& hashType)
+{
+    int nHashType = ParseTreasurySigHashType(hashType);
+
+    // The coins are fetched up front on this thread, so the signing threads never touch cs_main.
+    CCoinsView viewDummy;
+    std::vector<std::unique_ptr<CCoinsViewCache>> vViews;
+    vViews.reserve(vProposals.size());
+    for (const CTreasuryProposal* pProposal : vProposals) {
+        vViews.emplace_back(new CCoinsViewCache(&viewDummy));
+        FetchProposalTxCoins(pProposal->mtx, *vViews.back());
+    }
+
+    std::vector<UniValue> vResults(vProposals.size());
+    std::atomic<size_t> nNextProposal(0);
+    auto signer = [&]() {
+        size_t i;
+        while ((i = nNextProposal++) < vProposals.size()) {
+            vResults[i] = SignTreasuryTransaction(*vProposals[i], keystore, *vViews[i], nHashType);
+        }
+    };
+
+    size_t nThreads = std::min(vProposals.size(), (size_t)std::max(1, GetNumCores()));
+    std::vector<std::thread> vThreads;
+    for (size_t t = 1; t < nThreads; t++)
+        vThreads.emplace_back(signer);
+    signer();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    UniValue result(UniValue::VARR);
+    for (UniValue& proposalResult : vResults)
+        result.push_back(proposalResult);
+    return result;
+}
+
 UniValue treasurymempoolInfoToJSON()
 {
     UniValue ret(UniValue::VOBJ);
@@ -166,6 +229,7 @@ UniValue treasurymempoolInfoToJSON()
     ret.pushKV("bytes", (int64_t) ::GetSerializeSize(activeTreasury, SER_NETWORK, PROTOCOL_VERSION));
     ret.pushKV("version", (int64_t) activeTreasury.GetVersion());
     ret.pushKV("lastsaved", (int64_t) activeTreasury.GetLastSaved());
+    ret.pushKV("journalbytes", (int64_t) activeTreasury.GetJournalSize());
     ret.pushKV("filepath", activeTreasury.GetTreasuryFilePath().string());
     return ret;
 }
@@ -795,7 +859,7 @@ UniValue cleartreasuryscripts(const JSONRPCRequest& request)
     if (!activeTreasury.IsCached())
         throw JSONRPCError(RPC_MISC_ERROR, "No treasury mempool loaded.");
     
-    activeTreasury.vRedeemScripts.clear();
+    activeTreasury.ClearScripts();
     return NullUniValue;
 }
 
@@ -817,7 +881,7 @@ UniValue cleartreasuryproposals(const JSONRPCRequest& request)
     if (!activeTreasury.IsCached())
         throw JSONRPCError(RPC_MISC_ERROR, "No treasury mempool loaded.");
     
-    activeTreasury.vTreasuryProposals.clear();
+    activeTreasury.ClearProposals();
     return NullUniValue;
 }
 
@@ -1079,7 +1143,7 @@ UniValue addtreasuryscript(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Treasury redeemscript already exists in treasury mempool!");
     
     // Now all checks are done, and we can add this script.
-    activeTreasury.vRedeemScripts.push_back(script);
+    activeTreasury.AddScript(script);
     activeTreasury.SearchScriptByScript(script, nIndex);
     
     strStream << "The treasury script has been added successfully with ID: " << nIndex;
@@ -1257,6 +1321,7 @@ UniValue gettreasurymempoolinfo(const JSONRPCRequest& request)
             "  \"bytes\": xxxxx,              (numeric) Size in bytes of this treasury memory pool\n"
             "  \"version\": xxxxx,            (numeric) The version of this treasury mempool\n"
             "  \"lastsaved\": xxxxx,          (numeric) Unix timestamp, when the mempool was last saved\n"
+            "  \"journalbytes\": xxxxx,       (numeric) Size in bytes of the changes saved since the file was last rewritten\n"
             "  \"filepath\": xxxxx            (numeric) The current path to the file of the loaded treasury memory pool\n"
             "}\n"
             "\nExamples:\n"
@@ -1391,7 +1456,8 @@ UniValue createtreasuryproposal(const JSONRPCRequest& request)
     proposal.hashID = hashRandom;
     
     // Now add the proposal to cachedTreasury
-    activeTreasury.vTreasuryProposals.push_back(proposal);
+    if(!activeTreasury.AddProposal(proposal))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "A proposal with this ID already exists in treasury mempool!");
 
     return proposal.hashID.GetHex();
 }
@@ -1538,6 +1604,51 @@ UniValue createproposaltx(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+/**
+ * Drop spent inputs and inputs whose outpoint is already used by another proposal (recorded
+ * in setUsedOutpoints, first come first served), then move every input above MAX_TX_INPUTS
+ * with a cleared scriptSig to vOverflow.
+ */
+static void FilterProposalTxInputs(CMutableTransaction& mtx, const CCoinsViewCache& view, std::unordered_set<COutPoint, SaltedOutpointHasher>& setUsedOutpoints, std::vector<CTxIn>& vOverflow)
+{
+    std::vector<CTxIn> vin;
+    vin.reserve(mtx.vin.size());
+    for (CTxIn& txin : mtx.vin)
+    {
+        if (view.AccessCoin(txin.prevout).IsSpent())
+            continue;
+        
+        if (!setUsedOutpoints.insert(txin.prevout).second)
+            continue;
+        
+        if (vin.size() < CTreasuryProposal::MAX_TX_INPUTS)
+        {
+            vin.push_back(std::move(txin));
+        }
+        else
+        {
+            txin.scriptSig.clear();
+            vOverflow.push_back(std::move(txin));
+        }
+    }
+    mtx.vin.swap(vin);
+}
+
+/** Fill mtx up to MAX_TX_INPUTS with vTxIn starting at nNextTxIn and spend the added amount to scriptChange. */
+static void FundProposalTxWithInputs(CMutableTransaction& mtx, const CCoinsViewCache& view, const std::vector<CTxIn>& vTxIn, size_t& nNextTxIn, const CScript& scriptChange)
+{
+    CAmount currentAmount = 0;
+    
+    while (mtx.vin.size() < CTreasuryProposal::MAX_TX_INPUTS && nNextTxIn < vTxIn.size())
+    {
+        currentAmount += view.AccessCoin(vTxIn[nNextTxIn].prevout).out.nValue;
+        mtx.vin.push_back(vTxIn[nNextTxIn++]);
+    }
+    
+    if (currentAmount > 0)
+        mtx.vout.push_back(CTxOut(currentAmount, scriptChange));
+}
+
 UniValue moveunusableproposaltxinputs(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 2)
@@ -1627,77 +1738,16 @@ UniValue moveunusableproposaltxinputs(const JSONRPCRequest& request)
         view.SetBackend(viewDummy); // switch back to avoid locking mempool for too long
     }
     
-    // Remove unspendable transaction inputs and overflow inputs
-    for (size_t input = activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.size(); input > 0; input--) 
-    {
-        size_t inputIndex = input - 1;
-        if (view.AccessCoin(activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin[inputIndex].prevout).IsSpent())
-        {
-            activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.erase(activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.begin() + inputIndex);
-        }
-    }
-    
-    for (size_t input = activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.size(); input > CTreasuryProposal::MAX_TX_INPUTS; input--) 
-    {
-        size_t inputIndex = input - 1;
-        activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin[inputIndex].scriptSig.clear();
-        vTxIn.push_back(activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin[inputIndex]);
-        activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.erase(activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.begin() + inputIndex);
-    }
+    // Remove unspendable and double transaction inputs, the from proposal keeps its inputs.
+    std::unordered_set<COutPoint, SaltedOutpointHasher> setUsedOutpoints;
+    FilterProposalTxInputs(activeTreasury.vTreasuryProposals[nFromProposal].mtx, view, setUsedOutpoints, vTxIn);
+    FilterProposalTxInputs(activeTreasury.vTreasuryProposals[nToProposal].mtx, view, setUsedOutpoints, vTxIn);
     
-    // Remove double unspent entries.
-    std::vector<CTxIn>::iterator itend = vTxIn.end();
-	for (std::vector<CTxIn>::iterator it = vTxIn.begin(); it != itend; it++) 
-    {
-		itend = std::remove(it + 1, itend, *it);
-	}
-    
-    vTxIn.erase(itend, vTxIn.end());
-    
-    // Remove double inputs
-    for (size_t input = 0; input < activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin.size(); input++) 
-    {
-        for (size_t icheck = activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.size(); icheck > 0; icheck--) 
-        {
-            size_t nTmpIndex = icheck - 1;
-            if (activeTreasury.vTreasuryProposals[nFromProposal].mtx.vin[input] == activeTreasury.vTreasuryProposals[nToProposal].mtx.vin[nTmpIndex])
-            {
-                activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.erase(activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.begin() + nTmpIndex);
-            }
-        }
-    }
-    
-    // Remove unspendable transaction inputs and overflow inputs from pToMtx
-    for (size_t input = activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.size(); input > 0; input--) 
-    {
-        size_t nTmpIndex = input - 1;
-        if (view.AccessCoin(activeTreasury.vTreasuryProposals[nToProposal].mtx.vin[nTmpIndex].prevout).IsSpent())
-        {
-            activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.erase(activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.begin() + nTmpIndex);
-        }
-    }
-    
-    CAmount currentAmount = 0;
-    
-    for (size_t input = activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.size(); input < CTreasuryProposal::MAX_TX_INPUTS; input++) 
-    {
-        if(!vTxIn.empty())
-        {
-            activeTreasury.vTreasuryProposals[nToProposal].mtx.vin.push_back(vTxIn[0]);
-            currentAmount += view.AccessCoin(vTxIn[0].prevout).out.nValue;
-            vTxIn.erase(vTxIn.begin());
-        }
-        else
-        {
-            break;
-        }
-    }
+    size_t nNextTxIn = 0;
+    FundProposalTxWithInputs(activeTreasury.vTreasuryProposals[nToProposal].mtx, view, vTxIn, nNextTxIn, activeTreasury.scriptChangeAddress);
     
     uint32_t nSystemTime = GetTime();
     
-    if(currentAmount > 0)
-        activeTreasury.vTreasuryProposals[nToProposal].mtx.vout.push_back(CTxOut(currentAmount, activeTreasury.scriptChangeAddress));
-    
     // Now we return the edited vTreasuryProposals
     
     activeTreasury.vTreasuryProposals[nFromProposal].UpdateTimeData(nSystemTime);
@@ -1782,80 +1832,22 @@ UniValue handleproposaltxinputs(const JSONRPCRequest& request)
     
     uint32_t nSystemTime = GetTime();
     
-    // Remove unspendable transaction inputs and overflow inputs
-    for (unsigned int i = 0; i < activeTreasury.vTreasuryProposals.size(); i++) 
-    {
-        activeTreasury.vTreasuryProposals[i].UpdateTimeData(nSystemTime);
-        for (size_t input = activeTreasury.vTreasuryProposals[i].mtx.vin.size(); input > 0; input--) 
-        {
-            size_t nTmpIndex = input - 1;
-            if (view.AccessCoin(activeTreasury.vTreasuryProposals[i].mtx.vin[nTmpIndex].prevout).IsSpent())
-            {
-                activeTreasury.vTreasuryProposals[i].mtx.vin.erase(activeTreasury.vTreasuryProposals[i].mtx.vin.begin() + nTmpIndex);
-            }
-        }
-        
-        for (size_t input = activeTreasury.vTreasuryProposals[i].mtx.vin.size(); input > CTreasuryProposal::MAX_TX_INPUTS; input--) 
-        {
-            size_t nTmpIndex = input - 1;
-            activeTreasury.vTreasuryProposals[i].mtx.vin[nTmpIndex].scriptSig.clear();
-            vTxIn.push_back(activeTreasury.vTreasuryProposals[i].mtx.vin[nTmpIndex]);
-            activeTreasury.vTreasuryProposals[i].mtx.vin.erase(activeTreasury.vTreasuryProposals[i].mtx.vin.begin() + nTmpIndex);
-        }
-    }
-    
-    // Remove double unspent entries.
-    std::vector<CTxIn>::iterator itend = vTxIn.end();
-	for (std::vector<CTxIn>::iterator it = vTxIn.begin(); it != itend; it++) 
+    // Remove unspendable transaction inputs, double inputs and overflow inputs.
+    // Double inputs stay with the first proposal that uses them.
+    std::unordered_set<COutPoint, SaltedOutpointHasher> setUsedOutpoints;
+    for (CTreasuryProposal& proposal : activeTreasury.vTreasuryProposals)
     {
-		itend = std::remove(it + 1, itend, *it);
-	}
-    
-    vTxIn.erase(itend, vTxIn.end());
-    
-    // Remove double inputs
-    for (unsigned int i = 0; i < activeTreasury.vTreasuryProposals.size(); i++) 
-    {
-        for (unsigned int p = 0; p < activeTreasury.vTreasuryProposals.size(); p++) 
-        {
-            if(activeTreasury.vTreasuryProposals[i] == activeTreasury.vTreasuryProposals[p])
-                continue;
-            
-            for (int input = 0; input < activeTreasury.vTreasuryProposals[i].mtx.vin.size(); input++) 
-            {
-                for (size_t icheck = activeTreasury.vTreasuryProposals[p].mtx.vin.size(); icheck > 0; icheck--) 
-                {
-                    size_t nTmpIndex = icheck - 1;
-                    if (activeTreasury.vTreasuryProposals[i].mtx.vin[input] == activeTreasury.vTreasuryProposals[p].mtx.vin[nTmpIndex])
-                    {
-                        activeTreasury.vTreasuryProposals[p].mtx.vin.erase(activeTreasury.vTreasuryProposals[p].mtx.vin.begin() + nTmpIndex);
-                    }
-                }
-            }
-        }
+        proposal.UpdateTimeData(nSystemTime);
+        FilterProposalTxInputs(proposal.mtx, view, setUsedOutpoints, vTxIn);
     }
     
-    // Add unused inputs to existing proposal transactions and spent them as change money.
-    for (unsigned int i = 0; i < activeTreasury.vTreasuryProposals.size(); i++) 
+    // Add overflowed inputs to existing proposal transactions and spent them as change money.
+    size_t nNextTxIn = 0;
+    for (CTreasuryProposal& proposal : activeTreasury.vTreasuryProposals)
     {
-        CAmount currentAmount = 0;
-        
-        for (size_t input = activeTreasury.vTreasuryProposals[i].mtx.vin.size(); input < CTreasuryProposal::MAX_TX_INPUTS; input++) 
-        {
-            if(vTxIn.size() != 0)
-            {
-                activeTreasury.vTreasuryProposals[i].mtx.vin.push_back(vTxIn[0]);
-                currentAmount += view.AccessCoin(vTxIn[0].prevout).out.nValue;
-                vTxIn.erase(vTxIn.begin());
-            }
-            else
-            {
-                break;
-            }
-        }
-        
-        if(currentAmount > 0)
-            activeTreasury.vTreasuryProposals[i].mtx.vout.push_back(CTxOut(currentAmount, activeTreasury.scriptChangeAddress));
+        if (nNextTxIn == vTxIn.size())
+            break;
+        FundProposalTxWithInputs(proposal.mtx, view, vTxIn, nNextTxIn, activeTreasury.scriptChangeAddress);
     }
     
     // Now we return the edited vTreasuryProposals
@@ -2417,7 +2409,6 @@ UniValue signtreasuryproposalswithkey(const JSONRPCRequest& request)
         );
 
     RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VSTR}, true);
-    UniValue result(UniValue::VARR);
     
     LOCK(cs_treasury);
     
@@ -2472,15 +2463,14 @@ UniValue signtreasuryproposalswithkey(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_WALLET_ERROR, "None of the signers addresses are yours, the transaction cannot be signed.");
     }
     
-    for(size_t i = 0; i < activeTreasury.vTreasuryProposals.size(); i++)
+    // Sign the agreed transactions
+    std::vector<CTreasuryProposal*> vAgreedProposals;
+    for(CTreasuryProposal& proposal : activeTreasury.vTreasuryProposals)
     {
-        if(activeTreasury.vTreasuryProposals[i].IsAgreed())
-        {
-            // Sign the agreed transactions
-            result.push_back(SignTreasuryTransactionPartially(activeTreasury.vTreasuryProposals[i], &keystore, request.params[1]));
-        }
+        if(proposal.IsAgreed())
+            vAgreedProposals.push_back(&proposal);
     }
-    return result;
+    return SignTreasuryTransactionsPartially(vAgreedProposals, &keystore, request.params[1]);
 }
 
 UniValue clearproposaltxrecipients(const JSONRPCRequest& request)
@@ -2595,7 +2585,8 @@ UniValue savetreasurymempool(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() != 0) {
         throw std::runtime_error(
             "savetreasurymempool\n"
-            "\nSaves the treasury mempool to disk.\n"
+            "\nSaves the treasury mempool to disk. Only the changed proposals are appended to the journal\n"
+            "next to the file, until the journal grows larger than the file and the whole file is rewritten.\n"
             "\nExamples:\n"
             + HelpExampleCli("savetreasurymempool", "")
             + HelpExampleRpc("savetreasurymempool", "")
@@ -7,6 +7,8 @@
 #include <stdint.h>
 #include <script/standard.h>
 
+#include <vector>
+
 class UniValue;
 class CTreasuryProposal;
 class CScript;
@@ -14,6 +16,9 @@ class CScript;
 /** Sign the treasury transaction partially */
 UniValue SignTreasuryTransactionPartially(CTreasuryProposal& tpsl, CBasicKeyStore *keystore, const UniValue& hashType);
 
+/** Sign several treasury transactions partially, in parallel. Returns one result per proposal, in order. */
+UniValue SignTreasuryTransactionsPartially(const std::vector<CTreasuryProposal*>& vProposals, CBasicKeyStore *keystore, const UniValue& hashType);
+
 /** Treasury Mempool information to JSON */
 UniValue treasurymempoolInfoToJSON();
 
@@ -11,7 +11,7 @@
 #include <boost/bind.hpp>
 #include <utility>
 
-CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
+CScheduler::CScheduler() : nThreadsServicingQueue(0), nLowPriorityRunning(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
 
@@ -30,6 +30,33 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
+bool CScheduler::empty() const
+{
+    for (const auto& queue : taskQueue) {
+        if (!queue.empty()) return false;
+    }
+    return true;
+}
+
+// Finds the highest priority task that is due and this thread may run. If
+// there is none, timeNext is when the next one is due, or max() if no task
+// will be without another thread's doing.
+bool CScheduler::getDueTask(boost::chrono::system_clock::time_point now, int& nPriority, boost::chrono::system_clock::time_point& timeNext) const
+{
+    timeNext = boost::chrono::system_clock::time_point::max();
+    for (int p = 0; p < NUM_PRIORITIES; p++) {
+        if (taskQueue[p].empty()) continue;
+        // Keep a thread free for the others
+        if (p == PRIORITY_LOW && nThreadsServicingQueue > 1 && nLowPriorityRunning >= nThreadsServicingQueue - 1) continue;
+        if (taskQueue[p].begin()->first <= now) {
+            nPriority = p;
+            return true;
+        }
+        timeNext = std::min(timeNext, taskQueue[p].begin()->first);
+    }
+    return false;
+}
+
 void CScheduler::serviceQueue()
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
@@ -39,50 +66,66 @@ void CScheduler::serviceQueue()
     // when the thread is waiting or when the user's function
     // is called.
     while (!shouldStop()) {
+        bool fRunningLow = false;
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && empty()) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
-                // Wait until there is something to do.
-                newTaskScheduled.wait(lock);
-            }
-
-            // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
 
+            // Wait until a task this thread may run is due. New tasks, and
+            // low priority tasks finishing, wake the waiting threads up.
+            int nPriority = PRIORITY_NORMAL;
+            boost::chrono::system_clock::time_point timeNext;
+            while (!shouldStop() && !getDueTask(boost::chrono::system_clock::now(), nPriority, timeNext)) {
+                if (timeNext == boost::chrono::system_clock::time_point::max()) {
+                    newTaskScheduled.wait(lock);
+                } else {
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
-                // Keep waiting until timeout
-            }
+                    newTaskScheduled.timed_wait(lock, toPosixTime(timeNext));
 #else
-            // Some boost versions have a conflicting overload of wait_until that returns void.
-            // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
-                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
-                    break; // Exit loop after timeout, it means we reached the time of the event
-            }
+                    // Some boost versions have a conflicting overload of wait_until that returns void.
+                    // Explicitly use a template here to avoid hitting that overload.
+                    newTaskScheduled.wait_until<>(lock, timeNext);
 #endif
-            // If there are multiple threads, the queue can empty while we're waiting (another
-            // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+                }
+            }
+            if (shouldStop())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            auto it = taskQueue[nPriority].begin();
+            const boost::chrono::system_clock::time_point timeScheduled = it->first;
+            Task task = std::move(it->second);
+            taskQueue[nPriority].erase(it);
+            fRunningLow = nPriority == PRIORITY_LOW;
+            if (fRunningLow) ++nLowPriorityRunning;
 
+            const boost::chrono::system_clock::time_point timeStart = boost::chrono::system_clock::now();
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
-                f();
+                task.f();
             }
+            const boost::chrono::system_clock::time_point timeEnd = boost::chrono::system_clock::now();
+            if (fRunningLow) {
+                --nLowPriorityRunning;
+                newTaskScheduled.notify_one();
+            }
+
+            TaskStats& stats = mapTaskStats.emplace(task.strName, TaskStats{task.strName, (Priority)nPriority, 0, 0, 0, 0, 0}).first->second;
+            const int64_t nLagMicros = std::max<int64_t>(0, boost::chrono::duration_cast<boost::chrono::microseconds>(timeStart - timeScheduled).count());
+            const int64_t nRunMicros = boost::chrono::duration_cast<boost::chrono::microseconds>(timeEnd - timeStart).count();
+            stats.priority = (Priority)nPriority;
+            stats.nRuns++;
+            stats.nTotalLagMicros += nLagMicros;
+            stats.nMaxLagMicros = std::max(stats.nMaxLagMicros, nLagMicros);
+            stats.nTotalRunMicros += nRunMicros;
+            stats.nMaxRunMicros = std::max(stats.nMaxRunMicros, nRunMicros);
         } catch (...) {
+            if (fRunningLow) --nLowPriorityRunning;
             --nThreadsServicingQueue;
             throw;
         }
@@ -103,39 +146,41 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority, const std::string& strName)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue[priority].insert(std::make_pair(t, Task{std::move(f), strName}));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority, const std::string& strName)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), priority, strName);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, CScheduler::Priority priority, const std::string& strName)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaMilliSeconds, priority, strName), deltaMilliSeconds, priority, strName);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, Priority priority, const std::string& strName)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaMilliSeconds, priority, strName), deltaMilliSeconds, priority, strName);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const auto& queue : taskQueue) {
+        if (queue.empty()) continue;
+        if (result == 0 || queue.begin()->first < first) first = queue.begin()->first;
+        if (result == 0 || queue.rbegin()->first > last) last = queue.rbegin()->first;
+        result += queue.size();
     }
     return result;
 }
@@ -145,6 +190,16 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+std::vector<CScheduler::TaskStats> CScheduler::getTaskStats() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    std::vector<TaskStats> vStats;
+    for (const auto& entry : mapTaskStats) {
+        vStats.push_back(entry.second);
+    }
+    return vStats;
+}
+
 
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
@@ -155,7 +210,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(), m_priority, m_name);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
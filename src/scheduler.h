@@ -13,6 +13,8 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 #include <map>
+#include <string>
+#include <vector>
 
 #include <sync.h>
 
@@ -42,18 +44,42 @@ public:
 
     typedef std::function<void(void)> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    // Of the tasks that are due, the ones of higher priority run first.
+    // Low priority tasks, like flushing caches to disk, never take the last
+    // of several threads servicing the queue, so they cannot hold up the
+    // others.
+    enum Priority {
+        PRIORITY_HIGH,
+        PRIORITY_NORMAL,
+        PRIORITY_LOW,
+        NUM_PRIORITIES
+    };
+
+    // How long the runs of the tasks of one name waited past their time
+    // (lag) and took
+    struct TaskStats {
+        std::string strName;
+        Priority priority;
+        uint64_t nRuns;
+        int64_t nTotalLagMicros;
+        int64_t nMaxLagMicros;
+        int64_t nTotalRunMicros;
+        int64_t nMaxRunMicros;
+    };
+
+    // Call func at/after time t. Statistics are kept by strName.
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(),
+                  Priority priority=PRIORITY_NORMAL, const std::string& strName="other");
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, Priority priority=PRIORITY_NORMAL, const std::string& strName="other");
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, Priority priority=PRIORITY_NORMAL, const std::string& strName="other");
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -74,14 +100,27 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    // Returns the statistics of the tasks run so far, by name
+    std::vector<TaskStats> getTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        std::string strName;
+    };
+
+    // One queue per priority
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue[NUM_PRIORITIES];
+    std::map<std::string, TaskStats> mapTaskStats;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
+    int nLowPriorityRunning;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool empty() const;
+    bool shouldStop() const { return stopRequested || (stopWhenEmpty && empty()); }
+    bool getDueTask(boost::chrono::system_clock::time_point now, int& nPriority, boost::chrono::system_clock::time_point& timeNext) const;
 };
 
 /**
@@ -93,6 +132,8 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    const std::string m_name;
+    const CScheduler::Priority m_priority;
 
     CCriticalSection m_cs_callbacks_pending;
     std::list<std::function<void (void)>> m_callbacks_pending;
@@ -102,7 +143,8 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, const std::string& strName = "callbacks", CScheduler::Priority priority = CScheduler::PRIORITY_HIGH)
+        : m_pscheduler(pschedulerIn), m_name(strName), m_priority(priority) {}
     void AddToProcessQueue(std::function<void (void)> func);
 
     // Processes all remaining queue members on the calling thread, blocking until queue is empty
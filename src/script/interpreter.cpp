@@ -10,6 +10,7 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
 typedef std::vector<unsigned char> valtype;
@@ -1165,6 +1166,9 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 
 } // namespace
 
+/** Size of an input in the legacy sighash serialization with its script blanked out */
+static const size_t LEGACY_BLANK_INPUT_SIZE = 32 + 4 + 1 + 4;
+
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
     // Cache is calculated only for transactions with witness
@@ -1174,6 +1178,30 @@ PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
         hashOutputs = GetOutputsHash(txTo);
         ready = true;
     }
+
+    // Serializing the whole transaction for every legacy input is quadratic,
+    // the parts besides the signed input are the same for all of them.
+    unsigned int nLegacyInputs = 0;
+    for (const CTxIn& txin : txTo.vin) {
+        if (txin.scriptWitness.IsNull())
+            nLegacyInputs++;
+    }
+    if (nLegacyInputs >= LEGACY_SIGHASH_CACHE_MIN_INPUTS) {
+        CVectorWriter blank(SER_GETHASH, 0, vchLegacyBlank, 0);
+        for (const CTxIn& txin : txTo.vin)
+            blank << txin.prevout << CScript() << txin.nSequence;
+        assert(vchLegacyBlank.size() == txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE);
+        blank << txTo.vout << txTo.nLockTime;
+
+        vLegacyPrefix.reserve(txTo.vin.size());
+        CHashWriter prefix(SER_GETHASH, 0);
+        prefix << txTo.nVersion;
+        ::WriteCompactSize(prefix, txTo.vin.size());
+        for (size_t i = 0; i < txTo.vin.size(); i++) {
+            vLegacyPrefix.push_back(prefix);
+            prefix.write((const char*)&vchLegacyBlank[i * LEGACY_BLANK_INPUT_SIZE], LEGACY_BLANK_INPUT_SIZE);
+        }
+    }
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1239,6 +1267,17 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL serializes the other inputs blanked out and all outputs, for every input alike
+    if (cache && !cache->vLegacyPrefix.empty() && !(nHashType & SIGHASH_ANYONECANPAY) &&
+            (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CHashWriter ss(cache->vLegacyPrefix[nIn]);
+        txTmp.SerializeInput(ss, nIn);
+        const size_t nSuffix = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ss.write((const char*)cache->vchLegacyBlank.data() + nSuffix, cache->vchLegacyBlank.size() - nSuffix);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1406,6 +1445,185 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     return true;
 }
 
+/**
+ * Read script as the pushes the generic interpreter would put on the stack.
+ * False if it holds anything else, or anything EvalScript rejects for the
+ * given flags; the caller leaves such scripts to the generic path.
+ */
+static bool GetStandardPushes(const CScript& script, unsigned int flags, std::vector<valtype>& vPush)
+{
+    if (script.size() > MAX_SCRIPT_SIZE)
+        return false;
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    valtype vch;
+    while (pc < script.end()) {
+        if (!script.GetOp(pc, opcode, vch) || opcode > OP_PUSHDATA4 || vch.size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(vch, opcode))
+            return false;
+        vPush.push_back(std::move(vch));
+    }
+    return true;
+}
+
+/** What OP_CHECKSIG does with vchSig and vchPubKey, false with serror set where it fails the script */
+static bool CheckStandardSig(const valtype& vchSig, const valtype& vchPubKey, const CScript& scriptCodeIn, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, bool& fSuccess, ScriptError* serror)
+{
+    CScript scriptCode(scriptCodeIn);
+    if (sigversion == SIGVERSION_BASE) {
+        scriptCode.FindAndDelete(CScript(vchSig));
+    }
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, serror)) {
+        return false;
+    }
+    fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
+        return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+    return true;
+}
+
+/** The key hash check of OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG, then its OP_CHECKSIG */
+static bool CheckPubKeyHashSig(const valtype& vchSig, const valtype& vchPubKey, const unsigned char* pKeyHash, const CScript& scriptCode, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    unsigned char hash[20];
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash);
+    if (memcmp(hash, pKeyHash, sizeof(hash)))
+        return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+    bool fSuccess;
+    if (!CheckStandardSig(vchSig, vchPubKey, scriptCode, flags, checker, sigversion, fSuccess, serror))
+        return false;
+    if (!fSuccess)
+        return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+    return true;
+}
+
+/**
+ * Verify the spends of the common standard scripts without running them
+ * through EvalScript: P2PKH, P2WPKH and P2SH wrapped bare multisig. The
+ * checks are the ones the generic interpreter ends up doing for these
+ * scripts, in the same order and with the same errors, but on the pushed
+ * items directly instead of building and copying a stack for every opcode.
+ *
+ * @param[out] fResult  The result of the verification, set if it returns true.
+ * @return false if the scripts are not one of these templates, or are in a
+ *         shape only the generic path handles; VerifyScript runs that then.
+ */
+static bool VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness& witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror, bool& fResult)
+{
+    std::vector<valtype> vPush;
+    // OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+    if (scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+            scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG) {
+        vPush.reserve(2);
+        if (!GetStandardPushes(scriptSig, flags, vPush) || vPush.size() != 2)
+            return false;
+        fResult = CheckPubKeyHashSig(vPush[0], vPush[1], &scriptPubKey[3], scriptPubKey, flags, checker, SIGVERSION_BASE, serror);
+        if (fResult && (flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull())
+            fResult = set_error(serror, SCRIPT_ERR_WITNESS_UNEXPECTED);
+        if (fResult)
+            set_success(serror);
+        return true;
+    }
+
+    // OP_0 <20 bytes>, the witness holds the signature and key
+    if ((flags & SCRIPT_VERIFY_WITNESS) && scriptPubKey.size() == 22 && scriptPubKey[0] == OP_0 && scriptPubKey[1] == 20) {
+        // An all zero program fails the script before the witness is looked at
+        if (!scriptSig.empty() || witness.stack.size() != 2 || !CastToBool(valtype(scriptPubKey.begin() + 2, scriptPubKey.end())))
+            return false;
+        if (witness.stack[0].size() > MAX_SCRIPT_ELEMENT_SIZE || witness.stack[1].size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        CScript scriptCode;
+        scriptCode << OP_DUP << OP_HASH160 << valtype(scriptPubKey.begin() + 2, scriptPubKey.end()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        fResult = CheckPubKeyHashSig(witness.stack[0], witness.stack[1], &scriptPubKey[2], scriptCode, flags, checker, SIGVERSION_WITNESS_V0, serror);
+        if (fResult)
+            set_success(serror);
+        return true;
+    }
+
+    // OP_HASH160 <20 bytes> OP_EQUAL, redeemed by OP_m <pubkey>... OP_n OP_CHECKMULTISIG
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        if (!GetStandardPushes(scriptSig, flags, vPush) || vPush.size() < 3)
+            return false;
+        const valtype& vchRedeem = vPush.back();
+        if (vchRedeem.size() < 3 || vchRedeem.back() != OP_CHECKMULTISIG)
+            return false;
+        if (vchRedeem[0] < OP_1 || vchRedeem[0] > OP_16)
+            return false;
+        const int nSigsCount = CScript::DecodeOP_N((opcodetype)vchRedeem[0]);
+        if ((int)vPush.size() != nSigsCount + 2)
+            return false;
+        // Offsets of the keys, only direct pushes of the possible key sizes
+        std::vector<size_t> vKeyPos;
+        size_t nPos = 1;
+        while (nPos < vchRedeem.size() - 2 && (vchRedeem[nPos] == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE || vchRedeem[nPos] == CPubKey::PUBLIC_KEY_SIZE)) {
+            vKeyPos.push_back(nPos + 1);
+            nPos += 1 + vchRedeem[nPos];
+        }
+        const int nKeysCount = vKeyPos.size();
+        if (nPos != vchRedeem.size() - 2 || vchRedeem[nPos] < OP_1 || vchRedeem[nPos] > OP_16 ||
+                CScript::DecodeOP_N((opcodetype)vchRedeem[nPos]) != nKeysCount || nSigsCount > nKeysCount)
+            return false;
+        // Such a redeem script is never a witness program, its second byte is a key size.
+
+        unsigned char hash[20];
+        CHash160().Write(vchRedeem.data(), vchRedeem.size()).Finalize(hash);
+        if (memcmp(hash, &scriptPubKey[2], sizeof(hash))) {
+            fResult = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+            return true;
+        }
+
+        // OP_CHECKMULTISIG pairs the signatures and keys starting at the last ones
+        CScript scriptCode(vchRedeem.begin(), vchRedeem.end());
+        for (int k = nSigsCount; k >= 1; k--) {
+            scriptCode.FindAndDelete(CScript(vPush[k]));
+        }
+        bool fSuccess = true;
+        int isig = nSigsCount, ikey = nKeysCount - 1;
+        int nSigsLeft = nSigsCount, nKeysLeft = nKeysCount;
+        while (fSuccess && nSigsLeft > 0) {
+            const valtype& vchSig = vPush[isig];
+            const valtype vchPubKey(vchRedeem.begin() + vKeyPos[ikey], vchRedeem.begin() + vKeyPos[ikey] + vchRedeem[vKeyPos[ikey] - 1]);
+            if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror)) {
+                fResult = false;
+                return true;
+            }
+            if (checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE)) {
+                isig--;
+                nSigsLeft--;
+            }
+            ikey--;
+            nKeysLeft--;
+            if (nSigsLeft > nKeysLeft)
+                fSuccess = false;
+        }
+        if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL)) {
+            for (int k = nSigsCount; k >= 1; k--) {
+                if (vPush[k].size()) {
+                    fResult = set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+                    return true;
+                }
+            }
+        }
+        if ((flags & SCRIPT_VERIFY_NULLDUMMY) && vPush[0].size()) {
+            fResult = set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+            return true;
+        }
+        if (!fSuccess) {
+            fResult = set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+            return true;
+        }
+        if ((flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull()) {
+            fResult = set_error(serror, SCRIPT_ERR_WITNESS_UNEXPECTED);
+            return true;
+        }
+        fResult = set_success(serror);
+        return true;
+    }
+
+    return false;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
@@ -1420,6 +1638,10 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    bool fResult;
+    if (VerifyStandardScript(scriptSig, scriptPubKey, *witness, flags, checker, serror, fResult))
+        return fResult;
+
     std::vector<std::vector<unsigned char> > stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -115,11 +116,24 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
+/** Fewest inputs without witness for which PrecomputedTransactionData caches the legacy SIGHASH_ALL serialization */
+static const unsigned int LEGACY_SIGHASH_CACHE_MIN_INPUTS = 4;
+
 struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * The legacy SIGHASH_ALL serialization with every script blanked out, split
+     * around the signed input: vLegacyPrefix[i] has hashed what comes before
+     * input i, vchLegacyBlank holds the blank inputs (prevout, empty script and
+     * nSequence, all the same size) followed by the outputs and nLockTime.
+     * Empty when not cached.
+     */
+    std::vector<CHashWriter> vLegacyPrefix;
+    std::vector<unsigned char> vchLegacyBlank;
+
     explicit PrecomputedTransactionData(const CTransaction& tx);
 };
 
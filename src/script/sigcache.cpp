@@ -12,6 +12,10 @@
 #include <util.h>
 
 #include <cuckoocache.h>
+
+#include <atomic>
+#include <mutex>
+
 #include <boost/thread.hpp>
 
 namespace {
@@ -28,6 +32,8 @@ private:
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
     boost::shared_mutex cs_sigcache;
+    std::atomic<uint64_t> nHits{0};
+    std::atomic<uint64_t> nMisses{0};
 
 public:
     CSignatureCache()
@@ -45,7 +51,9 @@ public:
     Get(const uint256& entry, const bool erase)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        bool fFound = setValid.contains(entry, erase);
+        (fFound ? nHits : nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
     }
 
     void Set(uint256& entry)
@@ -57,6 +65,17 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    SignatureCacheStats GetStats()
+    {
+        SignatureCacheStats stats;
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        stats.nCapacity = setValid.capacity();
+        stats.nOccupied = setValid.count_occupied();
+        stats.nHits = nHits.load(std::memory_order_relaxed);
+        stats.nMisses = nMisses.load(std::memory_order_relaxed);
+        return stats;
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -66,6 +85,59 @@ public:
  * signatureCache could be made local to VerifySignature.
 */
 static CSignatureCache signatureCache;
+
+/**
+ * Public keys parsed for verification, by their serialization. Inputs often
+ * reuse the same treasury and masternode keys, and a failed CHECKMULTISIG
+ * attempt tries a key again with the next signature; parsing a compressed
+ * key means decompressing it, which this saves on every verification after
+ * the first. Direct mapped, a colliding key just replaces the entry.
+ */
+class CPubKeyParseCache
+{
+private:
+    struct Entry {
+        CPubKey pubkey;
+        CParsedPubKey parsed;
+    };
+
+    static const size_t ENTRIES = 1 << 15;
+    static const size_t LOCKS = 64;
+
+    //! Salt of the entry index, so keys that share a slot cannot be picked
+    uint64_t k0, k1;
+    std::vector<Entry> vEntries;
+    std::mutex locks[LOCKS];
+
+public:
+    CPubKeyParseCache() : vEntries(ENTRIES)
+    {
+        GetRandBytes((unsigned char*)&k0, sizeof(k0));
+        GetRandBytes((unsigned char*)&k1, sizeof(k1));
+    }
+
+    /** Parse pubkey, or take it as parsed before. False if it is not fully valid. */
+    bool Parse(const CPubKey& pubkey, CParsedPubKey& parsed)
+    {
+        const size_t nIndex = CSipHasher(k0, k1).Write(pubkey.begin(), pubkey.size()).Finalize() % ENTRIES;
+        Entry& entry = vEntries[nIndex];
+        {
+            std::lock_guard<std::mutex> lock(locks[nIndex % LOCKS]);
+            if (entry.pubkey == pubkey) {
+                parsed = entry.parsed;
+                return true;
+            }
+        }
+        if (!pubkey.Parse(parsed))
+            return false;
+        std::lock_guard<std::mutex> lock(locks[nIndex % LOCKS]);
+        entry.pubkey = pubkey;
+        entry.parsed = parsed;
+        return true;
+    }
+};
+
+static CPubKeyParseCache pubkeyParseCache;
 } // namespace
 
 // To be called once in AppInitMain/BasicTestingSetup to initialize the
@@ -80,13 +152,19 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
-    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
+    CParsedPubKey parsed;
+    if (!pubkeyParseCache.Parse(pubkey, parsed) || !CPubKey::Verify(parsed, sighash, vchSig))
         return false;
     if (store)
         signatureCache.Set(entry);
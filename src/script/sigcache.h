@@ -51,6 +51,16 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
+/** Usage of the signature or the script execution cache */
+struct SignatureCacheStats
+{
+    size_t nCapacity = 0;  //!< Number of entries that fit
+    size_t nOccupied = 0;  //!< Number of entries held
+    uint64_t nHits = 0;    //!< Lookups that found their entry
+    uint64_t nMisses = 0;  //!< Lookups that did not
+};
+
 void InitSignatureCache();
+SignatureCacheStats GetSignatureCacheStats();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
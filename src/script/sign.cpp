@@ -11,6 +11,11 @@
 #include <primitives/transaction.h>
 #include <script/standard.h>
 #include <uint256.h>
+#include <util.h>
+
+#include <algorithm>
+#include <future>
+#include <vector>
 
 
 typedef std::vector<unsigned char> valtype;
@@ -388,6 +393,9 @@ SignatureData CombineSignatures(const CScript& scriptPubKey, const BaseSignature
 }
 
 namespace {
+/** Size of the signatures DummySignatureCreator makes, with the hash type */
+const unsigned int DUMMY_SIGNATURE_SIZE = 72;
+
 /** Dummy signature checker which accepts all signatures. */
 class DummySignatureChecker : public BaseSignatureChecker
 {
@@ -410,7 +418,7 @@ const BaseSignatureChecker& DummySignatureCreator::Checker() const
 bool DummySignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const
 {
     // Create a dummy signature that is a valid DER-encoding
-    vchSig.assign(72, '\000');
+    vchSig.assign(DUMMY_SIGNATURE_SIZE, '\000');
     vchSig[0] = 0x30;
     vchSig[1] = 69;
     vchSig[2] = 0x02;
@@ -441,3 +449,117 @@ bool IsSolvable(const CKeyStore& store, const CScript& script)
     }
     return false;
 }
+
+/** Serialized size of a script pushing items of the given sizes, as PushAll builds it */
+static unsigned int PushAllSize(std::initializer_list<unsigned int> items)
+{
+    unsigned int nBytes = 0;
+    for (unsigned int n : items) {
+        nBytes += n + (n < OP_PUSHDATA1 ? 1 : n <= 0xff ? 2 : n <= 0xffff ? 3 : 5);
+    }
+    return GetSizeOfCompactSize(nBytes) + nBytes;
+}
+
+/** Serialized size of a witness stack with items of the given sizes */
+static unsigned int WitnessStackSize(std::initializer_list<unsigned int> items)
+{
+    unsigned int nBytes = GetSizeOfCompactSize(items.size());
+    for (unsigned int n : items) {
+        nBytes += GetSizeOfCompactSize(n) + n;
+    }
+    return nBytes;
+}
+
+/** The compressed pubkey a P2WPKH program commits to, which signing it needs */
+static bool GetWitnessKeyHashPubKey(const CKeyStore& keystore, const valtype& program, CPubKey& pubkey)
+{
+    return keystore.GetPubKey(CKeyID(uint160(program)), pubkey) && pubkey.IsCompressed();
+}
+
+bool EstimateSignedInputSize(const CKeyStore& keystore, const CScript& scriptPubKey, SignedInputSize& size)
+{
+    std::vector<valtype> vSolutions;
+    txnouttype whichType;
+    CPubKey pubkey;
+    if (Solver(scriptPubKey, whichType, vSolutions)) {
+        switch (whichType) {
+        case TX_PUBKEY:
+            size.nScriptSigBytes = PushAllSize({DUMMY_SIGNATURE_SIZE});
+            size.nWitnessBytes = 0;
+            return true;
+        case TX_PUBKEYHASH:
+            if (keystore.GetPubKey(CKeyID(uint160(vSolutions[0])), pubkey)) {
+                size.nScriptSigBytes = PushAllSize({DUMMY_SIGNATURE_SIZE, pubkey.size()});
+                size.nWitnessBytes = 0;
+                return true;
+            }
+            break;
+        case TX_WITNESS_V0_KEYHASH:
+            if (GetWitnessKeyHashPubKey(keystore, vSolutions[0], pubkey)) {
+                size.nScriptSigBytes = PushAllSize({});
+                size.nWitnessBytes = WitnessStackSize({DUMMY_SIGNATURE_SIZE, pubkey.size()});
+                return true;
+            }
+            break;
+        case TX_SCRIPTHASH: {
+            CScript redeemScript;
+            std::vector<valtype> vRedeemSolutions;
+            if (keystore.GetCScript(CScriptID(uint160(vSolutions[0])), redeemScript) &&
+                Solver(redeemScript, whichType, vRedeemSolutions) && whichType == TX_WITNESS_V0_KEYHASH &&
+                GetWitnessKeyHashPubKey(keystore, vRedeemSolutions[0], pubkey)) {
+                size.nScriptSigBytes = PushAllSize({(unsigned int)redeemScript.size()});
+                size.nWitnessBytes = WitnessStackSize({DUMMY_SIGNATURE_SIZE, pubkey.size()});
+                return true;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    SignatureData sigdata;
+    if (!ProduceSignature(DummySignatureCreator(&keystore), scriptPubKey, sigdata)) {
+        return false;
+    }
+    size.nScriptSigBytes = GetSizeOfCompactSize(sigdata.scriptSig.size()) + sigdata.scriptSig.size();
+    size.nWitnessBytes = 0;
+    if (!sigdata.scriptWitness.IsNull()) {
+        size.nWitnessBytes = GetSizeOfCompactSize(sigdata.scriptWitness.stack.size());
+        for (const valtype& item : sigdata.scriptWitness.stack) {
+            size.nWitnessBytes += GetSizeOfCompactSize(item.size()) + item.size();
+        }
+    }
+    return true;
+}
+
+void ForEachInputInParallel(unsigned int nInputs, const std::function<void(unsigned int)>& func)
+{
+    const unsigned int nThreads = nInputs < MIN_PARALLEL_SIGNING_INPUTS ? 1 :
+        std::min<unsigned int>(std::max(std::min(GetNumCores(), MAX_SIGNING_THREADS), 1), nInputs);
+
+    // Thread k takes the inputs k, k + nThreads, ..., this thread is the first of them.
+    auto run = [&](unsigned int k) {
+        for (unsigned int i = k; i < nInputs; i += nThreads)
+            func(i);
+    };
+    std::vector<std::future<void>> vWorkers;
+    for (unsigned int k = 1; k < nThreads; k++)
+        vWorkers.push_back(std::async(std::launch::async, run, k));
+    std::exception_ptr error;
+    try {
+        run(0);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (std::future<void>& worker : vWorkers) {
+        try {
+            worker.get();
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -8,6 +8,8 @@
 
 #include <script/interpreter.h>
 
+#include <functional>
+
 class CKeyID;
 class CKeyStore;
 class CScript;
@@ -87,4 +89,35 @@ void UpdateTransaction(CMutableTransaction& tx, unsigned int nIn, const Signatur
  * Solvability is unrelated to whether we consider this output to be ours. */
 bool IsSolvable(const CKeyStore& store, const CScript& script);
 
+/** Serialized sizes of what signing an input adds to the transaction */
+struct SignedInputSize
+{
+    //! The scriptSig, length included
+    unsigned int nScriptSigBytes = 0;
+    //! The witness stack, item count included, or 0 for an input without witness
+    unsigned int nWitnessBytes = 0;
+};
+
+/**
+ * Size of an input spending scriptPubKey once signed, the same as with
+ * DummySignatureCreator. Pay to pubkey (hash) and pay to witness keyhash,
+ * nested in P2SH or not, are sized from their pubkeys without signing, other
+ * scripts are dummy signed. Fails if the keystore cannot solve the script.
+ */
+bool EstimateSignedInputSize(const CKeyStore& keystore, const CScript& scriptPubKey, SignedInputSize& size);
+
+//! Inputs from which ForEachInputInParallel spreads the work over several threads
+static const unsigned int MIN_PARALLEL_SIGNING_INPUTS = 16;
+//! Most threads ForEachInputInParallel uses
+static const int MAX_SIGNING_THREADS = 16;
+
+/**
+ * Call func for every input index below nInputs, on several threads for
+ * transactions with many inputs, to sign or verify them. func may only write
+ * to what belongs to its own input, and what it reads has to stay constant,
+ * so sign against a CTransaction of the unsigned transaction and apply the
+ * results afterwards. An exception func throws is passed on once all are done.
+ */
+void ForEachInputInParallel(unsigned int nInputs, const std::function<void(unsigned int)>& func);
+
 #endif // BITCOIN_SCRIPT_SIGN_H
@@ -18,6 +18,8 @@
 #include <stdint.h>
 #include <string>
 #include <string.h>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -77,6 +79,11 @@ template<typename Stream> inline void ser_writedata32(Stream &s, uint32_t obj)
     obj = htole32(obj);
     s.write((char*)&obj, 4);
 }
+template<typename Stream> inline void ser_writedata32be(Stream &s, uint32_t obj)
+{
+    obj = htobe32(obj);
+    s.write((char*)&obj, 4);
+}
 template<typename Stream> inline void ser_writedata64(Stream &s, uint64_t obj)
 {
     obj = htole64(obj);
@@ -100,6 +107,12 @@ template<typename Stream> inline uint32_t ser_readdata32(Stream &s)
     s.read((char*)&obj, 4);
     return le32toh(obj);
 }
+template<typename Stream> inline uint32_t ser_readdata32be(Stream &s)
+{
+    uint32_t obj;
+    s.read((char*)&obj, 4);
+    return be32toh(obj);
+}
 template<typename Stream> inline uint64_t ser_readdata64(Stream &s)
 {
     uint64_t obj;
@@ -475,6 +488,27 @@ CVarInt<I> WrapVarInt(I& n) { return CVarInt<I>(n); }
 template<typename Stream, typename C> void Serialize(Stream& os, const std::basic_string<C>& str);
 template<typename Stream, typename C> void Unserialize(Stream& is, std::basic_string<C>& str);
 
+/**
+ * Element types whose serialization is their memory representation, so
+ * containers of them are written and read with a single write or read
+ * instead of one per element. Integers only on little-endian hosts.
+ */
+class uint160;
+class uint256;
+template<typename T> struct is_raw_serializable : std::false_type {};
+#ifndef WORDS_BIGENDIAN
+template<> struct is_raw_serializable<char> : std::true_type {};
+template<> struct is_raw_serializable<int8_t> : std::true_type {};
+template<> struct is_raw_serializable<int16_t> : std::true_type {};
+template<> struct is_raw_serializable<uint16_t> : std::true_type {};
+template<> struct is_raw_serializable<int32_t> : std::true_type {};
+template<> struct is_raw_serializable<uint32_t> : std::true_type {};
+template<> struct is_raw_serializable<int64_t> : std::true_type {};
+template<> struct is_raw_serializable<uint64_t> : std::true_type {};
+#endif
+template<> struct is_raw_serializable<uint160> : std::true_type {};
+template<> struct is_raw_serializable<uint256> : std::true_type {};
+
 /**
  * prevector
  * prevectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
@@ -509,6 +543,12 @@ template<typename Stream, typename K, typename T> void Unserialize(Stream& is, s
 template<typename Stream, typename K, typename T, typename Pred, typename A> void Serialize(Stream& os, const std::map<K, T, Pred, A>& m);
 template<typename Stream, typename K, typename T, typename Pred, typename A> void Unserialize(Stream& is, std::map<K, T, Pred, A>& m);
 
+/**
+ * unordered_map
+ */
+template<typename Stream, typename K, typename T, typename Hash, typename Pred, typename A> void Serialize(Stream& os, const std::unordered_map<K, T, Hash, Pred, A>& m);
+template<typename Stream, typename K, typename T, typename Hash, typename Pred, typename A> void Unserialize(Stream& is, std::unordered_map<K, T, Hash, Pred, A>& m);
+
 /**
  * set
  */
@@ -585,6 +625,11 @@ template<typename Stream, unsigned int N, typename T, typename V>
 void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&)
 {
     WriteCompactSize(os, v.size());
+    if (is_raw_serializable<T>::value) {
+        if (!v.empty())
+            os.write((char*)v.data(), v.size() * sizeof(T));
+        return;
+    }
     for (typename prevector<N, T>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
         ::Serialize(os, (*vi));
 }
@@ -615,6 +660,20 @@ void Unserialize_impl(Stream& is, prevector<N, T>& v, const unsigned char&)
 template<typename Stream, unsigned int N, typename T, typename V>
 void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&)
 {
+    if (is_raw_serializable<T>::value) {
+        // Read like the bytes of an opaque blob, see above
+        v.clear();
+        unsigned int nSize = ReadCompactSize(is);
+        unsigned int i = 0;
+        while (i < nSize)
+        {
+            unsigned int blk = std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
+            v.resize(i + blk);
+            is.read((char*)&v[i], blk * sizeof(T));
+            i += blk;
+        }
+        return;
+    }
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
     unsigned int i = 0;
@@ -653,6 +712,11 @@ template<typename Stream, typename T, typename A, typename V>
 void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&)
 {
     WriteCompactSize(os, v.size());
+    if (is_raw_serializable<T>::value) {
+        if (!v.empty())
+            os.write((char*)v.data(), v.size() * sizeof(T));
+        return;
+    }
     for (typename std::vector<T, A>::const_iterator vi = v.begin(); vi != v.end(); ++vi)
         ::Serialize(os, (*vi));
 }
@@ -683,6 +747,20 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, const unsigned char&)
 template<typename Stream, typename T, typename A, typename V>
 void Unserialize_impl(Stream& is, std::vector<T, A>& v, const V&)
 {
+    if (is_raw_serializable<T>::value) {
+        // Read like the bytes of an opaque blob, see above
+        v.clear();
+        unsigned int nSize = ReadCompactSize(is);
+        unsigned int i = 0;
+        while (i < nSize)
+        {
+            unsigned int blk = std::min(nSize - i, (unsigned int)(1 + 4999999 / sizeof(T)));
+            v.resize(i + blk);
+            is.read((char*)&v[i], blk * sizeof(T));
+            i += blk;
+        }
+        return;
+    }
     v.clear();
     unsigned int nSize = ReadCompactSize(is);
     unsigned int i = 0;
@@ -752,6 +830,32 @@ void Unserialize(Stream& is, std::map<K, T, Pred, A>& m)
 
 
 
+/**
+ * unordered_map
+ */
+template<typename Stream, typename K, typename T, typename Hash, typename Pred, typename A>
+void Serialize(Stream& os, const std::unordered_map<K, T, Hash, Pred, A>& m)
+{
+    WriteCompactSize(os, m.size());
+    for (const auto& entry : m)
+        Serialize(os, entry);
+}
+
+template<typename Stream, typename K, typename T, typename Hash, typename Pred, typename A>
+void Unserialize(Stream& is, std::unordered_map<K, T, Hash, Pred, A>& m)
+{
+    m.clear();
+    unsigned int nSize = ReadCompactSize(is);
+    for (unsigned int i = 0; i < nSize; i++)
+    {
+        std::pair<K, T> item;
+        Unserialize(is, item);
+        m.insert(std::move(item));
+    }
+}
+
+
+
 /**
  * set
  */
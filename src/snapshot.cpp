@@ -0,0 +1,526 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <snapshot.h>
+
+#include <addressindex.h>
+#include <blockfilterindex.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <coinstats.h>
+#include <consensus/validation.h>
+#include <crypto/muhash.h>
+#include <init.h>
+#include <protocol.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <validation.h>
+#include <validationinterface.h>
+#include <warnings.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Coins read or written between progress messages
+const uint64_t SNAPSHOT_LOG_INTERVAL = 1000000;
+//! Coins loaded between checks of the coins cache size
+const uint64_t SNAPSHOT_FLUSH_CHECK_INTERVAL = 10000;
+//! Blocks of the history validated between progress messages
+const int HISTORY_LOG_INTERVAL = 10000;
+
+CCriticalSection cs_validationthread;
+std::unique_ptr<boost::thread> pthreadValidation;
+
+/** The last block of every algo mined up to pindexBase, by algo */
+std::vector<CSnapshotAlgoState> GetAlgoStates(const CBlockIndex* pindexBase)
+{
+    std::vector<CSnapshotAlgoState> vState;
+    std::vector<bool> vSeen(NUM_ALGOS, false);
+    for (const CBlockIndex* pindex = pindexBase; pindex && vState.size() < (size_t)NUM_ALGOS; pindex = pindex->pprev) {
+        const uint8_t nAlgo = pindex->GetAlgo();
+        if (nAlgo >= NUM_ALGOS || vSeen[nAlgo])
+            continue;
+        vSeen[nAlgo] = true;
+        CSnapshotAlgoState state;
+        state.nAlgo = nAlgo;
+        state.nHeight = pindex->nHeight;
+        state.hashBlock = pindex->GetBlockHash();
+        state.nBits = pindex->nBits;
+        vState.push_back(state);
+    }
+    std::sort(vState.begin(), vState.end(), [](const CSnapshotAlgoState& a, const CSnapshotAlgoState& b) { return a.nAlgo < b.nAlgo; });
+    return vState;
+}
+
+void WriteHeader(CAutoFile& file, const CSnapshotMetadata& metadata)
+{
+    file.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    file << metadata;
+}
+
+bool ReadHeader(CAutoFile& file, CSnapshotMetadata& metadata, std::string& strError)
+{
+    CMessageHeader::MessageStartChars messageStart;
+    try {
+        file.read((char*)messageStart, CMessageHeader::MESSAGE_START_SIZE);
+        file >> metadata;
+    } catch (const std::exception& e) {
+        strError = strprintf("Cannot read the snapshot header: %s", e.what());
+        return false;
+    }
+    if (memcmp(messageStart, Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE)) {
+        strError = "The snapshot is for another network";
+        return false;
+    }
+    if (metadata.nVersion != SNAPSHOT_VERSION) {
+        strError = strprintf("Unknown snapshot version %u", metadata.nVersion);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the coins following the header and pass each of them to fn, which
+ * returns false to stop. Fails unless they add up to the totals and MuHash
+ * of the header.
+ */
+template <typename Callable>
+bool ReadCoins(CAutoFile& file, const CSnapshotMetadata& metadata, Callable fn, std::string& strError)
+{
+    MuHash3072 muhash;
+    CCoinStatsEntry stats;
+    try {
+        while (stats.nTransactionOutputs < metadata.nCoins) {
+            boost::this_thread::interruption_point();
+            uint256 txid;
+            file >> txid;
+            const uint64_t nOutputs = ReadCompactSize(file);
+            if (nOutputs == 0 || nOutputs > metadata.nCoins - stats.nTransactionOutputs) {
+                strError = strprintf("The snapshot has a bad number of outputs for %s", txid.ToString());
+                return false;
+            }
+            for (uint64_t i = 0; i < nOutputs; i++) {
+                uint32_t n;
+                Coin coin;
+                file >> VARINT(n);
+                file >> coin;
+                const COutPoint outpoint(txid, n);
+                ApplyCoin(muhash, stats, outpoint, coin, true);
+                if (!fn(outpoint, std::move(coin)))
+                    return false;
+                if (stats.nTransactionOutputs % SNAPSHOT_LOG_INTERVAL == 0)
+                    LogPrintf("%s: %u of %u coins\n", __func__, stats.nTransactionOutputs, metadata.nCoins);
+            }
+        }
+    } catch (const std::ios_base::failure& e) {
+        strError = strprintf("Cannot read the coins of the snapshot: %s", e.what());
+        return false;
+    }
+    if (stats.nTotalAmount != metadata.nTotalAmount || stats.nBogoSize != metadata.nBogoSize || FinalizeMuHash(muhash) != metadata.hashMuHash) {
+        strError = "The coins of the snapshot do not match the totals and hash of its header";
+        return false;
+    }
+    return true;
+}
+
+/** The block index entry of the base of a snapshot this node can load, nullptr with strError otherwise */
+CBlockIndex* GetLoadableBase(const CSnapshotMetadata& metadata, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    if (pindexSnapshotBase) {
+        strError = "The chainstate was loaded from a snapshot already";
+        return nullptr;
+    }
+    if (chainActive.Height() != 0) {
+        strError = "Blocks were connected already, a snapshot is only loaded by a node at the genesis block (e.g. one syncing headers with -headersonly)";
+        return nullptr;
+    }
+    if (fPruneMode || fTxIndex || fCoinStatsIndex || pblockfilterindex || paddressindex) {
+        strError = "A snapshot cannot be loaded with -prune or any of the indexes, they need the history";
+        return nullptr;
+    }
+
+    BlockMap::iterator it = mapBlockIndex.find(metadata.hashBaseBlock);
+    if (it == mapBlockIndex.end()) {
+        strError = strprintf("The header of the snapshot base %s is not known yet", metadata.hashBaseBlock.ToString());
+        return nullptr;
+    }
+    CBlockIndex* pindexBase = it->second;
+    if (!pindexBase->IsValid(BLOCK_VALID_TREE) || (pindexBase->nStatus & BLOCK_FAILED_MASK) || pindexBestHeader->GetAncestor(pindexBase->nHeight) != pindexBase) {
+        strError = strprintf("The snapshot base %s is not on the best header chain", metadata.hashBaseBlock.ToString());
+        return nullptr;
+    }
+    if (metadata.nChainTx == 0 || metadata.nBaseHeight != pindexBase->nHeight || UintToArith256(metadata.nChainWork) != pindexBase->nChainWork ||
+        metadata.vAlgoState != GetAlgoStates(pindexBase)) {
+        strError = "The snapshot does not match the headers up to its base";
+        return nullptr;
+    }
+    return pindexBase;
+}
+
+/** Give up on a snapshot whose history turned out not to lead to it, like AbortNode */
+void AbortSnapshot(const std::string& strMessage)
+{
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(strMessage + "\n" + _("Restart with -reindex-chainstate to validate the chain without the snapshot."), "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
+void ThreadValidateHistory()
+{
+    RenameThread("globaltoken-snapshot");
+    const CChainParams& chainparams = Params();
+
+    CSnapshotBase snapshot;
+    CBlockIndex* pindexBase;
+    {
+        LOCK(cs_main);
+        if (!pindexSnapshotBase || fSnapshotValidated || !pblocktree->ReadSnapshotBase(snapshot))
+            return;
+        pindexBase = pindexSnapshotBase;
+    }
+
+    // The coins of the history have a database of their own, to continue from after a restart
+    std::unique_ptr<CCoinsViewDB> pdb(new CCoinsViewDB(nDefaultDbCache << 20, false, false, "chainstate_history"));
+    CBlockIndex* pindex = nullptr;
+    {
+        const uint256 hashBest = pdb->GetBestBlock();
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end() && pdb->GetHeadBlocks().empty() && pindexBase->GetAncestor(it->second->nHeight) == it->second)
+            pindex = it->second;
+    }
+    if (!pindex && !pdb->GetBestBlock().IsNull()) {
+        // Interrupted while writing, start over
+        pdb.reset();
+        pdb.reset(new CCoinsViewDB(nDefaultDbCache << 20, false, true, "chainstate_history"));
+    }
+    std::unique_ptr<CCoinsViewCache> pview(new CCoinsViewCache(pdb.get()));
+    LogPrintf("%s: validating the history of the chainstate snapshot at height %d from height %d\n", __func__, pindexBase->nHeight, pindex ? pindex->nHeight + 1 : 0);
+
+    try {
+        while (pindex != pindexBase) {
+            boost::this_thread::interruption_point();
+
+            CBlockIndex* pindexNext = pindexBase->GetAncestor(pindex ? pindex->nHeight + 1 : 0);
+            bool fHaveData;
+            {
+                LOCK(cs_main);
+                fHaveData = pindexNext->nStatus & BLOCK_HAVE_DATA;
+            }
+            if (!fHaveData) {
+                // Downloaded from the lowest height missing on, see FindHistoricalBlocksToDownload
+                boost::this_thread::sleep_for(boost::chrono::seconds(1));
+                continue;
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexNext, chainparams.GetConsensus())) {
+                AbortSnapshot(strprintf("Failed to read block %s of the chainstate snapshot history", pindexNext->GetBlockHash().ToString()));
+                return;
+            }
+            {
+                LOCK(cs_main);
+                CValidationState state;
+                if (!ConnectHistoricalBlock(block, state, pindexNext, *pview, chainparams)) {
+                    AbortSnapshot(strprintf("Block %s at height %d below the chainstate snapshot base is invalid: %s",
+                        pindexNext->GetBlockHash().ToString(), pindexNext->nHeight, FormatStateMessage(state)));
+                    return;
+                }
+            }
+            pindex = pindexNext;
+
+            if (pview->DynamicMemoryUsage() > SNAPSHOT_HISTORY_CACHE && !pview->Flush()) {
+                AbortSnapshot("Failed to write the coins of the chainstate snapshot history");
+                return;
+            }
+            if (pindex->nHeight % HISTORY_LOG_INTERVAL == 0)
+                LogPrintf("%s: history validated up to height %d of %d\n", __func__, pindex->nHeight, pindexBase->nHeight);
+        }
+        if (!pview->Flush()) {
+            AbortSnapshot("Failed to write the coins of the chainstate snapshot history");
+            return;
+        }
+    } catch (const boost::thread_interrupted&) {
+        pview->Flush();
+        throw;
+    }
+    pview.reset();
+
+    MuHash3072 muhash;
+    CCoinStatsEntry stats;
+    {
+        std::unique_ptr<CCoinsViewCursor> pcursor(pdb->Cursor());
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                AbortSnapshot("Failed to read the coins of the chainstate snapshot history");
+                return;
+            }
+            ApplyCoin(muhash, stats, key, coin, true);
+            pcursor->Next();
+        }
+    }
+    stats.hashMuHash = FinalizeMuHash(muhash);
+    if (stats.nTransactionOutputs != snapshot.stats.nTransactionOutputs || stats.nTotalAmount != snapshot.stats.nTotalAmount ||
+        stats.nBogoSize != snapshot.stats.nBogoSize || stats.hashMuHash != snapshot.stats.hashMuHash) {
+        AbortSnapshot(strprintf("The blocks up to height %d do not lead to the coins of the chainstate snapshot loaded there", pindexBase->nHeight));
+        return;
+    }
+
+    pdb.reset();
+    {
+        LOCK(cs_main);
+        snapshot.fValidated = true;
+        if (!pblocktree->WriteSnapshotBase(snapshot)) {
+            AbortSnapshot("Failed to write to the block index database");
+            return;
+        }
+        fSnapshotValidated = true;
+    }
+    fs::remove_all(GetDataDir() / "chainstate_history");
+    LogPrintf("%s: the history of the chainstate snapshot at height %d is valid\n", __func__, pindexBase->nHeight);
+}
+
+} // namespace
+
+bool DumpTxOutSet(const fs::path& path, CSnapshotMetadata& metadata, std::string& strError)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        // The cursor reads the database as of now, blocks connected meanwhile do not change it
+        pcursor.reset(pcoinsdbview->Cursor());
+        BlockMap::iterator it = mapBlockIndex.find(pcursor->GetBestBlock());
+        assert(it != mapBlockIndex.end());
+        const CBlockIndex* pindexBase = it->second;
+        metadata = CSnapshotMetadata();
+        metadata.hashBaseBlock = pindexBase->GetBlockHash();
+        metadata.nBaseHeight = pindexBase->nHeight;
+        metadata.nChainWork = ArithToUint256(pindexBase->nChainWork);
+        metadata.nChainTx = pindexBase->nChainTx;
+        metadata.vAlgoState = GetAlgoStates(pindexBase);
+    }
+
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+    CAutoFile file(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = strprintf("Cannot open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    LogPrintf("%s: writing the coins at height %d to %s\n", __func__, metadata.nBaseHeight, path.string());
+    MuHash3072 muhash;
+    CCoinStatsEntry stats;
+    try {
+        WriteHeader(file, metadata);
+        uint256 txid;
+        std::vector<std::pair<uint32_t, Coin>> vOutputs;
+        auto writeOutputs = [&]() {
+            file << txid;
+            WriteCompactSize(file, vOutputs.size());
+            for (auto& output : vOutputs) {
+                file << VARINT(output.first);
+                file << output.second;
+            }
+            vOutputs.clear();
+        };
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                strError = "Unable to read the UTXO set";
+                file.fclose();
+                fs::remove(pathTmp);
+                return false;
+            }
+            if (!vOutputs.empty() && key.hash != txid)
+                writeOutputs();
+            txid = key.hash;
+            ApplyCoin(muhash, stats, key, coin, true);
+            vOutputs.emplace_back(key.n, std::move(coin));
+            if (stats.nTransactionOutputs % SNAPSHOT_LOG_INTERVAL == 0)
+                LogPrintf("%s: %u coins\n", __func__, stats.nTransactionOutputs);
+            pcursor->Next();
+        }
+        if (!vOutputs.empty())
+            writeOutputs();
+
+        metadata.nCoins = stats.nTransactionOutputs;
+        metadata.nTotalAmount = stats.nTotalAmount;
+        metadata.nBogoSize = stats.nBogoSize;
+        metadata.hashMuHash = FinalizeMuHash(muhash);
+        if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+            strError = "Cannot write the snapshot header";
+            file.fclose();
+            fs::remove(pathTmp);
+            return false;
+        }
+        WriteHeader(file, metadata);
+        FileCommit(file.Get());
+    } catch (const std::ios_base::failure& e) {
+        strError = strprintf("Cannot write the snapshot: %s", e.what());
+        file.fclose();
+        fs::remove(pathTmp);
+        return false;
+    }
+    file.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("Cannot rename %s to %s", pathTmp.string(), path.string());
+        return false;
+    }
+    return true;
+}
+
+bool LoadTxOutSet(const fs::path& path, const uint256& hashExpectedBase, const uint256& hashExpectedMuHash, CSnapshotMetadata& metadata, std::string& strError)
+{
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            strError = strprintf("Cannot open %s", path.string());
+            return false;
+        }
+        if (!ReadHeader(file, metadata, strError))
+            return false;
+        // The header only vouches for the file itself, what it has to match comes from the caller
+        if (metadata.hashBaseBlock != hashExpectedBase) {
+            strError = strprintf("The snapshot is of block %s, not of the expected block %s", metadata.hashBaseBlock.ToString(), hashExpectedBase.ToString());
+            return false;
+        }
+        if (metadata.hashMuHash != hashExpectedMuHash) {
+            strError = strprintf("The MuHash of the snapshot is %s, not the expected %s", metadata.hashMuHash.ToString(), hashExpectedMuHash.ToString());
+            return false;
+        }
+        {
+            LOCK(cs_main);
+            if (!GetLoadableBase(metadata, strError))
+                return false;
+        }
+        LogPrintf("%s: checking the %u coins of the snapshot at height %d\n", __func__, metadata.nCoins, metadata.nBaseHeight);
+        if (!ReadCoins(file, metadata, [](const COutPoint&, Coin&&) { return true; }, strError))
+            return false;
+    }
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    CSnapshotMetadata metadataChecked = metadata;
+    if (file.IsNull() || !ReadHeader(file, metadata, strError) || metadata.hashBaseBlock != metadataChecked.hashBaseBlock || metadata.hashMuHash != metadataChecked.hashMuHash) {
+        strError = strprintf("%s changed while it was loaded", path.string());
+        return false;
+    }
+
+    CBlockIndex* pindexBase;
+    {
+        LOCK(cs_main);
+        pindexBase = GetLoadableBase(metadata, strError);
+        if (!pindexBase)
+            return false;
+
+        // Until the record says it is loaded, the node refuses to start on a partly loaded chainstate
+        CSnapshotBase snapshot;
+        snapshot.hashBlock = pindexBase->GetBlockHash();
+        snapshot.nChainTx = metadata.nChainTx;
+        snapshot.stats.nTransactionOutputs = metadata.nCoins;
+        snapshot.stats.nBogoSize = metadata.nBogoSize;
+        snapshot.stats.nTotalAmount = metadata.nTotalAmount;
+        snapshot.stats.hashMuHash = metadata.hashMuHash;
+        if (!pblocktree->WriteSnapshotBase(snapshot)) {
+            strError = "Failed to write to the block index database";
+            return false;
+        }
+
+        LogPrintf("%s: loading the %u coins of the snapshot at height %d\n", __func__, metadata.nCoins, metadata.nBaseHeight);
+        uint64_t nLoaded = 0;
+        bool fOk;
+        try {
+            fOk = ReadCoins(file, metadata, [&nLoaded](const COutPoint& outpoint, Coin&& coin) {
+                pcoinsTip->AddCoin(outpoint, std::move(coin), false);
+                if (++nLoaded % SNAPSHOT_FLUSH_CHECK_INTERVAL == 0 && pcoinsTip->DynamicMemoryUsage() > (size_t)nCoinCacheUsage)
+                    return pcoinsTip->Flush();
+                return true;
+            }, strError);
+        } catch (const std::logic_error& e) {
+            // AddCoin found an output twice
+            strError = e.what();
+            fOk = false;
+        }
+        if (!fOk) {
+            strError += ". The chainstate is incomplete now, restart with -reindex-chainstate";
+            return false;
+        }
+        pcoinsTip->SetBestBlock(pindexBase->GetBlockHash());
+        if (!pcoinsTip->Flush()) {
+            strError = "Failed to write the coins database. The chainstate is incomplete now, restart with -reindex-chainstate";
+            return false;
+        }
+
+        ActivateSnapshot(pindexBase, metadata.nChainTx);
+        snapshot.fLoaded = true;
+        if (!pblocktree->WriteSnapshotBase(snapshot)) {
+            strError = "Failed to write to the block index database";
+            return false;
+        }
+        FlushStateToDisk();
+        if (fHeadersOnly) {
+            fHeadersOnly = false;
+            LogPrintf("%s: downloading blocks from the snapshot base on, restart without -headersonly to serve them and relay transactions\n", __func__);
+        }
+    }
+    LogPrintf("%s: the active chain continues from the snapshot at height %d\n", __func__, pindexBase->nHeight);
+
+    const bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(pindexBase, pindexBase->GetAncestor(0), fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, pindexBase);
+
+    // Blocks received after the base already continue the chain
+    CValidationState state;
+    ActivateBestChain(state, Params());
+
+    StartSnapshotValidation();
+    return true;
+}
+
+void StartSnapshotValidation()
+{
+    LOCK(cs_validationthread);
+    if (pthreadValidation)
+        return;
+    {
+        LOCK(cs_main);
+        if (!pindexSnapshotBase || fSnapshotValidated)
+            return;
+    }
+    pthreadValidation.reset(new boost::thread(boost::bind(&TraceThread<void (*)()>, "snapshot", &ThreadValidateHistory)));
+}
+
+void InterruptSnapshotValidation()
+{
+    LOCK(cs_validationthread);
+    if (pthreadValidation)
+        pthreadValidation->interrupt();
+}
+
+void StopSnapshotValidation()
+{
+    LOCK(cs_validationthread);
+    if (pthreadValidation) {
+        pthreadValidation->interrupt();
+        pthreadValidation->join();
+        pthreadValidation.reset();
+    }
+}
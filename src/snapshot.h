@@ -0,0 +1,116 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include <amount.h>
+#include <fs.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <string>
+#include <vector>
+
+/** Version of the chainstate snapshots dumptxoutset writes */
+static const uint32_t SNAPSHOT_VERSION = 1;
+/** Bytes of coins the validation of a snapshot's history caches before writing them to chainstate_history */
+static const size_t SNAPSHOT_HISTORY_CACHE = 256 << 20;
+
+/** The last block of an algo up to the base of a snapshot, the difficulty of its next block starts from */
+struct CSnapshotAlgoState
+{
+    uint8_t nAlgo;
+    int32_t nHeight;
+    uint256 hashBlock;
+    uint32_t nBits;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nAlgo);
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nBits);
+    }
+
+    CSnapshotAlgoState() : nAlgo(0), nHeight(0), nBits(0) {}
+
+    bool operator==(const CSnapshotAlgoState& other) const
+    {
+        return nAlgo == other.nAlgo && nHeight == other.nHeight && hashBlock == other.hashBlock && nBits == other.nBits;
+    }
+};
+
+/**
+ * Header of a chainstate snapshot file, after the network's message start.
+ * The coins follow it grouped by transaction: the txid, the number of its
+ * unspent outputs and every output's index and Coin. The fields have a fixed
+ * size, so DumpTxOutSet writes the header again once it counted the coins.
+ */
+class CSnapshotMetadata
+{
+public:
+    uint32_t nVersion;
+    uint256 hashBaseBlock;
+    int32_t nBaseHeight;
+    uint256 nChainWork;
+    uint64_t nChainTx;
+    //! The totals and MuHash gettxoutsetinfo reports at the base
+    uint64_t nCoins;
+    CAmount nTotalAmount;
+    uint64_t nBogoSize;
+    uint256 hashMuHash;
+    //! By algo, for the algos mined up to the base
+    std::vector<CSnapshotAlgoState> vAlgoState;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nVersion);
+        READWRITE(hashBaseBlock);
+        READWRITE(nBaseHeight);
+        READWRITE(nChainWork);
+        READWRITE(nChainTx);
+        READWRITE(nCoins);
+        READWRITE(nTotalAmount);
+        READWRITE(nBogoSize);
+        READWRITE(hashMuHash);
+        READWRITE(vAlgoState);
+    }
+
+    CSnapshotMetadata() : nVersion(SNAPSHOT_VERSION), nBaseHeight(0), nChainTx(0), nCoins(0), nTotalAmount(0), nBogoSize(0) {}
+};
+
+/** Write the chainstate as of the active tip to path, false with strError if it cannot be written */
+bool DumpTxOutSet(const fs::path& path, CSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Load a snapshot written by DumpTxOutSet into the coins database and make
+ * its base the tip of the active chain, so blocks are validated from there
+ * on. The node must have the headers up to the base on its best header chain
+ * and no block connected after the genesis block, e.g. after syncing with
+ * -headersonly. The snapshot has to be of the block hashExpectedBase and its
+ * header has to carry the MuHash hashExpectedMuHash, both of which the caller
+ * got from a source it trusts. The file is read twice, first to check that
+ * its coins add up to the totals and MuHash of the header, then to load them.
+ * The blocks up to the base are then downloaded and validated in the
+ * background, see StartSnapshotValidation.
+ */
+bool LoadTxOutSet(const fs::path& path, const uint256& hashExpectedBase, const uint256& hashExpectedMuHash, CSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Validate the history of a loaded snapshot on a thread of its own: connect
+ * the blocks from the genesis block up to the base on a chainstate of their
+ * own (chainstate_history), as they are downloaded, and compare the coins
+ * they arrive at with the totals and MuHash of the snapshot. The node shuts
+ * down if they differ. Does nothing unless a snapshot awaits validation.
+ */
+void StartSnapshotValidation();
+void InterruptSnapshotValidation();
+void StopSnapshotValidation();
+
+#endif // BITCOIN_SNAPSHOT_H
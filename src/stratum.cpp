@@ -0,0 +1,668 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <arith_uint256.h>
+#include <base58.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <globaltoken/multihasher.h>
+#include <globaltoken/powalgorithm.h>
+#include <miner.h>
+#include <netbase.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <univalue.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+
+namespace {
+
+/** Maximum length of a single stratum request line */
+const size_t MAX_STRATUM_LINE_LENGTH = 16 * 1024;
+/** Maximum number of simultaneously connected miners */
+const size_t MAX_STRATUM_CLIENTS = 1024;
+/** Seconds between new jobs when only the mempool changed */
+const int64_t STRATUM_JOB_REFRESH_INTERVAL = 30;
+/** Size of the extranonce2 field miners roll in the coinbase */
+const unsigned int STRATUM_EXTRANONCE2_SIZE = 4;
+/** Size of the extranonce1 field the server assigns to every connection */
+const unsigned int STRATUM_EXTRANONCE1_SIZE = 4;
+
+/** Stratum error codes as used by common pool software */
+enum StratumErrorCode {
+    STRATUM_ERR_OTHER = 20,
+    STRATUM_ERR_JOB_NOT_FOUND = 21,
+    STRATUM_ERR_DUPLICATE_SHARE = 22,
+    STRATUM_ERR_LOW_DIFFICULTY = 23,
+    STRATUM_ERR_UNAUTHORIZED = 24,
+    STRATUM_ERR_NOT_SUBSCRIBED = 25,
+};
+
+/** Work for one algo. The coinbase is split around the extranonce as coinb1 and coinb2. */
+struct StratumJob
+{
+    std::string strId;
+    uint64_t nGeneration;
+    uint8_t nAlgo;
+    CBlock block;
+    CMutableTransaction txCoinbase;
+    size_t nExtraNonceOffset; //!< offset of the extranonce placeholder in the coinbase scriptSig
+    std::vector<unsigned char> vCoinb1;
+    std::vector<unsigned char> vCoinb2;
+    std::vector<uint256> vMerkleBranch;
+    std::set<uint256> setSubmitted; //!< header hashes of accepted shares, to refuse duplicates
+};
+
+struct StratumClient
+{
+    std::string strExtraNonce1;
+    bool fSubscribed = false;
+    bool fAuthorized = false;
+    uint8_t nAlgo = ALGO_SHA256D;
+    std::string strWorker;
+};
+
+struct event_base* eventBase = nullptr;
+struct event* eventRefresh = nullptr;
+std::vector<struct evconnlistener*> vListeners;
+std::thread threadStratum;
+
+// Everything below is only accessed from the stratum thread.
+std::map<struct bufferevent*, StratumClient> mapClients;
+std::map<std::string, StratumJob> mapJobs;
+std::map<uint8_t, std::string> mapCurrentJob;
+CScript scriptPayout;
+arith_uint256 shareTarget;
+double dDifficulty = DEFAULT_STRATUM_DIFFICULTY;
+const CBlockIndex* pindexJobs = nullptr;
+unsigned int nJobsTransactionsUpdated = 0;
+int64_t nJobsTime = 0;
+uint64_t nJobGeneration = 0;
+uint64_t nJobCounter = 0;
+uint32_t nExtraNonce1Counter = 0;
+
+/** Stratum sends prevhash as the header bytes with every 32-bit word byte swapped. */
+std::string EncodePrevHash(const uint256& hash)
+{
+    std::vector<unsigned char> v(hash.begin(), hash.end());
+    for (size_t i = 0; i < v.size(); i += 4) {
+        std::swap(v[i], v[i + 3]);
+        std::swap(v[i + 1], v[i + 2]);
+    }
+    return HexStr(v);
+}
+
+bool ParseHexUInt32(const std::string& str, uint32_t& n)
+{
+    if (str.size() != 8 || !IsHex(str))
+        return false;
+    n = static_cast<uint32_t>(strtoul(str.c_str(), nullptr, 16));
+    return true;
+}
+
+/** diff1 / difficulty, scaled by 2^16 to keep fractional difficulties usable. */
+arith_uint256 GetShareTarget(double dDiff)
+{
+    arith_uint256 diff1;
+    diff1.SetCompact(0x1d00ffff);
+    uint64_t nScaled = std::max<uint64_t>(1, static_cast<uint64_t>(dDiff * 65536.0));
+    return (diff1 << 16) / nScaled;
+}
+
+void Send(struct bufferevent* bev, const UniValue& msg)
+{
+    std::string str = msg.write() + "\n";
+    bufferevent_write(bev, str.data(), str.size());
+}
+
+void SendResult(struct bufferevent* bev, const UniValue& id, const UniValue& result)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", result);
+    reply.pushKV("error", NullUniValue);
+    Send(bev, reply);
+}
+
+void SendError(struct bufferevent* bev, const UniValue& id, int code, const std::string& strMessage)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(strMessage);
+    error.push_back(NullUniValue);
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", NullUniValue);
+    reply.pushKV("error", error);
+    Send(bev, reply);
+}
+
+void SendNotification(struct bufferevent* bev, const std::string& strMethod, const UniValue& params)
+{
+    UniValue msg(UniValue::VOBJ);
+    msg.pushKV("id", NullUniValue);
+    msg.pushKV("method", strMethod);
+    msg.pushKV("params", params);
+    Send(bev, msg);
+}
+
+void SendJob(struct bufferevent* bev, const StratumJob& job, bool fClean)
+{
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : job.vMerkleBranch)
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+
+    UniValue params(UniValue::VARR);
+    params.push_back(job.strId);
+    params.push_back(EncodePrevHash(job.block.hashPrevBlock));
+    params.push_back(HexStr(job.vCoinb1));
+    params.push_back(HexStr(job.vCoinb2));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", (uint32_t)job.block.nVersion));
+    params.push_back(strprintf("%08x", job.block.nBits));
+    params.push_back(strprintf("%08x", job.block.nTime));
+    params.push_back(fClean);
+    SendNotification(bev, "mining.notify", params);
+}
+
+/** Turn a block template into a stratum job, replacing the coinbase scriptSig by height + extranonce placeholder. */
+void MakeJob(const CBlockTemplate& blocktemplate, int nHeight, uint8_t nAlgo, StratumJob& job)
+{
+    job.strId = strprintf("%x", ++nJobCounter);
+    job.nGeneration = nJobGeneration;
+    job.nAlgo = nAlgo;
+    job.block = blocktemplate.block;
+    job.txCoinbase = CMutableTransaction(*job.block.vtx[0]);
+
+    CScript scriptSig = CScript() << nHeight;
+    // Skip the push opcode in front of the placeholder.
+    job.nExtraNonceOffset = scriptSig.size() + 1;
+    std::vector<unsigned char> vPlaceholder(STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE, 0);
+    scriptSig << vPlaceholder;
+    job.txCoinbase.vin[0].scriptSig = scriptSig + COINBASE_FLAGS;
+    assert(job.txCoinbase.vin[0].scriptSig.size() <= 100);
+    job.block.vtx[0] = MakeTransactionRef(job.txCoinbase);
+
+    // Non-witness serialization: nVersion, vin count, prevout, scriptSig length, scriptSig...
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << *job.block.vtx[0];
+    std::vector<unsigned char> vTx(ss.begin(), ss.end());
+    size_t nOffset = 4 + 1 + 36 + GetSizeOfCompactSize(job.txCoinbase.vin[0].scriptSig.size()) + job.nExtraNonceOffset;
+    job.vCoinb1.assign(vTx.begin(), vTx.begin() + nOffset);
+    job.vCoinb2.assign(vTx.begin() + nOffset + vPlaceholder.size(), vTx.end());
+    job.vMerkleBranch = blocktemplate.vCoinbaseMerkleBranch;
+}
+
+/** Algos that have at least one authorized miner. */
+std::set<uint8_t> GetActiveAlgos()
+{
+    std::set<uint8_t> setAlgos;
+    for (const auto& client : mapClients) {
+        if (client.second.fAuthorized)
+            setAlgos.insert(client.second.nAlgo);
+    }
+    return setAlgos;
+}
+
+/** Build one new job per requested algo from a single BlockAssembler run. */
+bool UpdateJobs(const std::set<uint8_t>& setAlgos, bool fClean)
+{
+    if (setAlgos.empty())
+        return true;
+
+    const CChainParams& chainparams = Params();
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+    }
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    try {
+        pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPayout, *setAlgos.begin());
+    } catch (const std::exception& e) {
+        LogPrint(BCLog::STRATUM, "stratum: unable to create a new block: %s\n", e.what());
+        return false;
+    }
+    if (!pblocktemplate)
+        return false;
+
+    if (fClean)
+        mapJobs.clear();
+    ++nJobGeneration;
+    for (uint8_t nAlgo : setAlgos) {
+        std::unique_ptr<CBlockTemplate> palgotemplate;
+        if (pblocktemplate->block.GetAlgo() != nAlgo) {
+            palgotemplate = CopyBlockTemplateForAlgo(*pblocktemplate, pindexPrev, nAlgo, chainparams.GetConsensus());
+            if (!palgotemplate)
+                continue;
+        }
+        StratumJob job;
+        MakeJob(palgotemplate ? *palgotemplate : *pblocktemplate, pindexPrev->nHeight + 1, nAlgo, job);
+        mapCurrentJob[nAlgo] = job.strId;
+        mapJobs[job.strId] = std::move(job);
+    }
+
+    // Keep the previous generation around so in-flight shares are not lost.
+    for (auto it = mapJobs.begin(); it != mapJobs.end(); ) {
+        if (it->second.nGeneration + 1 < nJobGeneration)
+            it = mapJobs.erase(it);
+        else
+            ++it;
+    }
+
+    pindexJobs = pindexPrev;
+    nJobsTransactionsUpdated = nTransactionsUpdated;
+    nJobsTime = GetTime();
+
+    for (const auto& client : mapClients) {
+        if (!client.second.fAuthorized || !setAlgos.count(client.second.nAlgo))
+            continue;
+        auto it = mapCurrentJob.find(client.second.nAlgo);
+        if (it != mapCurrentJob.end() && mapJobs.count(it->second))
+            SendJob(client.first, mapJobs.at(it->second), fClean);
+    }
+    LogPrint(BCLog::STRATUM, "stratum: new jobs for height %d, %u algos\n", pindexPrev->nHeight + 1, setAlgos.size());
+    return true;
+}
+
+void RefreshJobsIfNeeded(bool fForce)
+{
+    if (IsInitialBlockDownload())
+        return;
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+    if (pindexTip != pindexJobs) {
+        UpdateJobs(GetActiveAlgos(), true);
+    } else if (fForce || (mempool.GetTransactionsUpdated() != nJobsTransactionsUpdated && GetTime() - nJobsTime >= STRATUM_JOB_REFRESH_INTERVAL)) {
+        UpdateJobs(GetActiveAlgos(), false);
+    }
+}
+
+void HandleSubscribe(struct bufferevent* bev, StratumClient& client, const UniValue& id)
+{
+    client.fSubscribed = true;
+
+    UniValue subscription(UniValue::VARR);
+    UniValue notify(UniValue::VARR);
+    notify.push_back("mining.notify");
+    notify.push_back(client.strExtraNonce1);
+    subscription.push_back(notify);
+    UniValue difficulty(UniValue::VARR);
+    difficulty.push_back("mining.set_difficulty");
+    difficulty.push_back(client.strExtraNonce1);
+    subscription.push_back(difficulty);
+
+    UniValue result(UniValue::VARR);
+    result.push_back(subscription);
+    result.push_back(client.strExtraNonce1);
+    result.push_back((int)STRATUM_EXTRANONCE2_SIZE);
+    SendResult(bev, id, result);
+}
+
+/** The password may select the algo to mine, e.g. "x,algo=scrypt". */
+void HandleAuthorize(struct bufferevent* bev, StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    if (!client.fSubscribed) {
+        SendError(bev, id, STRATUM_ERR_NOT_SUBSCRIBED, "Not subscribed");
+        return;
+    }
+    if (params.size() < 1 || !params[0].isStr()) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Invalid parameters");
+        return;
+    }
+
+    uint8_t nAlgo = currentAlgo;
+    if (params.size() > 1 && params[1].isStr()) {
+        std::vector<std::string> vOptions;
+        boost::split(vOptions, params[1].get_str(), boost::is_any_of(","));
+        for (const std::string& strOption : vOptions) {
+            if (strOption.compare(0, 5, "algo=") != 0)
+                continue;
+            bool fAlgoFound = false;
+            nAlgo = GetAlgoByName(strOption.substr(5), currentAlgo, fAlgoFound);
+            if (!fAlgoFound) {
+                SendError(bev, id, STRATUM_ERR_OTHER, "Unknown algo " + strOption.substr(5));
+                return;
+            }
+        }
+    }
+    if (IsEquihashBasedAlgo(nAlgo)) {
+        SendError(bev, id, STRATUM_ERR_OTHER, GetAlgoName(nAlgo) + " is not supported by this stratum server");
+        return;
+    }
+    if (!Params().GetConsensus().Hardfork2.IsActivated((uint32_t)GetAdjustedTime()) && !IsAlgoAllowedBeforeHF2(nAlgo)) {
+        SendError(bev, id, STRATUM_ERR_OTHER, GetAlgoName(nAlgo) + " is not active yet");
+        return;
+    }
+
+    client.fAuthorized = true;
+    client.nAlgo = nAlgo;
+    client.strWorker = params[0].get_str();
+    SendResult(bev, id, true);
+    LogPrint(BCLog::STRATUM, "stratum: worker %s authorized for %s\n", SanitizeString(client.strWorker), GetAlgoName(nAlgo));
+
+    UniValue diff(UniValue::VARR);
+    diff.push_back(dDifficulty);
+    SendNotification(bev, "mining.set_difficulty", diff);
+
+    auto it = mapCurrentJob.find(nAlgo);
+    if (it != mapCurrentJob.end() && mapJobs.count(it->second)) {
+        SendJob(bev, mapJobs.at(it->second), true);
+    } else if (!IsInitialBlockDownload()) {
+        UpdateJobs(std::set<uint8_t>{nAlgo}, false);
+    }
+}
+
+void HandleSubmit(struct bufferevent* bev, StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    CHashPurposeScope hashPurpose(HashPurpose::MINING);
+    if (!client.fAuthorized) {
+        SendError(bev, id, STRATUM_ERR_UNAUTHORIZED, "Unauthorized worker");
+        return;
+    }
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr() || !params[3].isStr() || !params[4].isStr()) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Invalid parameters");
+        return;
+    }
+
+    auto it = mapJobs.find(params[1].get_str());
+    if (it == mapJobs.end()) {
+        SendError(bev, id, STRATUM_ERR_JOB_NOT_FOUND, "Job not found");
+        return;
+    }
+    StratumJob& job = it->second;
+
+    const std::string& strExtraNonce2 = params[2].get_str();
+    uint32_t nTime, nNonce;
+    if (strExtraNonce2.size() != 2 * STRATUM_EXTRANONCE2_SIZE || !IsHex(strExtraNonce2) ||
+        !ParseHexUInt32(params[3].get_str(), nTime) || !ParseHexUInt32(params[4].get_str(), nNonce)) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Malformed share");
+        return;
+    }
+    if (nTime < job.block.nTime || nTime > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "ntime out of range");
+        return;
+    }
+
+    // Rebuild the coinbase with this miner's extranonce and hash up the header.
+    std::vector<unsigned char> vExtraNonce = ParseHex(client.strExtraNonce1 + strExtraNonce2);
+    CMutableTransaction txCoinbase(job.txCoinbase);
+    CScript& scriptSig = txCoinbase.vin[0].scriptSig;
+    std::copy(vExtraNonce.begin(), vExtraNonce.end(), scriptSig.begin() + job.nExtraNonceOffset);
+
+    CBlockHeader header = job.block.GetBlockHeader();
+    header.hashMerkleRoot = ComputeMerkleRootFromBranch(txCoinbase.GetHash(), job.vMerkleBranch, 0);
+    header.nTime = nTime;
+    header.nNonce = nNonce;
+
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    uint256 hashPoW = header.GetPoWHash(job.nAlgo, SER_GETHASH, LoadMultiHasherVersionFlags(consensusParams.Hardfork3.IsActivated(header.nTime)));
+    if (UintToArith256(hashPoW) > shareTarget) {
+        SendError(bev, id, STRATUM_ERR_LOW_DIFFICULTY, "Low difficulty share");
+        return;
+    }
+    if (!job.setSubmitted.insert(header.GetHash()).second) {
+        SendError(bev, id, STRATUM_ERR_DUPLICATE_SHARE, "Duplicate share");
+        return;
+    }
+    SendResult(bev, id, true);
+
+    if (!CheckProofOfWork(hashPoW, header.nBits, consensusParams, job.nAlgo))
+        return;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(job.block);
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    pblock->hashMerkleRoot = header.hashMerkleRoot;
+    pblock->nTime = header.nTime;
+    pblock->nNonce = header.nNonce;
+    bool fNewBlock = false;
+    bool fAccepted = ProcessNewBlock(Params(), pblock, true, &fNewBlock);
+    LogPrintf("stratum: block %s found by %s (%s)\n", pblock->GetHash().ToString(), SanitizeString(client.strWorker), fAccepted ? "accepted" : "rejected");
+    if (fAccepted)
+        RefreshJobsIfNeeded(false);
+}
+
+void HandleLine(struct bufferevent* bev, StratumClient& client, const std::string& strLine)
+{
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        SendError(bev, NullUniValue, STRATUM_ERR_OTHER, "Parse error");
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr()) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Missing method");
+        return;
+    }
+    const UniValue paramsArray = params.isArray() ? params : UniValue(UniValue::VARR);
+
+    const std::string& strMethod = method.get_str();
+    if (strMethod == "mining.subscribe") {
+        HandleSubscribe(bev, client, id);
+    } else if (strMethod == "mining.authorize") {
+        HandleAuthorize(bev, client, id, paramsArray);
+    } else if (strMethod == "mining.submit") {
+        HandleSubmit(bev, client, id, paramsArray);
+    } else if (strMethod == "mining.extranonce.subscribe") {
+        // Extranonce1 never changes for a connection, nothing to subscribe to.
+        SendResult(bev, id, false);
+    } else {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Method not found");
+    }
+}
+
+void DisconnectClient(struct bufferevent* bev)
+{
+    mapClients.erase(bev);
+    bufferevent_free(bev);
+}
+
+void ReadCallback(struct bufferevent* bev, void* ctx)
+{
+    auto it = mapClients.find(bev);
+    if (it == mapClients.end())
+        return;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t nLength;
+    while (char* line = evbuffer_readln(input, &nLength, EVBUFFER_EOL_CRLF)) {
+        std::string strLine(line, nLength);
+        free(line);
+        if (!strLine.empty())
+            HandleLine(bev, it->second, strLine);
+    }
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "stratum: request line too long, disconnecting\n");
+        DisconnectClient(bev);
+    }
+}
+
+void EventCallback(struct bufferevent* bev, short events, void* ctx)
+{
+    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+        DisconnectClient(bev);
+}
+
+void AcceptCallback(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    if (mapClients.size() >= MAX_STRATUM_CLIENTS) {
+        LogPrint(BCLog::STRATUM, "stratum: too many connections, refusing\n");
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent* bev = bufferevent_socket_new(eventBase, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    StratumClient& client = mapClients[bev];
+    uint32_t nExtraNonce1 = ++nExtraNonce1Counter;
+    client.strExtraNonce1 = HexStr((unsigned char*)&nExtraNonce1, (unsigned char*)&nExtraNonce1 + STRATUM_EXTRANONCE1_SIZE);
+    bufferevent_setcb(bev, ReadCallback, nullptr, EventCallback, nullptr);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+void RefreshCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    RefreshJobsIfNeeded(false);
+}
+
+void ThreadStratum()
+{
+    RenameThread("globaltoken-stratum");
+    LogPrint(BCLog::STRATUM, "stratum: entering event loop\n");
+    event_base_dispatch(eventBase);
+    LogPrint(BCLog::STRATUM, "stratum: exited event loop\n");
+}
+
+bool BindStratumServer(int nDefaultPort)
+{
+    std::vector<std::pair<std::string, uint16_t>> vEndpoints;
+    if (!gArgs.IsArgSet("-stratumbind")) {
+        vEndpoints.push_back(std::make_pair("::1", nDefaultPort));
+        vEndpoints.push_back(std::make_pair("127.0.0.1", nDefaultPort));
+    } else {
+        for (const std::string& strBind : gArgs.GetArgs("-stratumbind")) {
+            int port = nDefaultPort;
+            std::string host;
+            SplitHostPort(strBind, port, host);
+            vEndpoints.push_back(std::make_pair(host, port));
+        }
+    }
+
+    for (const auto& endpoint : vEndpoints) {
+        CService addr;
+        if (!Lookup(endpoint.first.c_str(), addr, endpoint.second, false)) {
+            LogPrintf("stratum: invalid bind address %s\n", endpoint.first);
+            continue;
+        }
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+            continue;
+        struct evconnlistener* listener = evconnlistener_new_bind(eventBase, AcceptCallback, nullptr,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+        if (listener) {
+            LogPrintf("Binding stratum server on address %s\n", addr.ToString());
+            vListeners.push_back(listener);
+        } else {
+            LogPrintf("Binding stratum server on address %s failed.\n", addr.ToString());
+        }
+    }
+    return !vListeners.empty();
+}
+
+} // namespace
+
+bool StartStratumServer()
+{
+    assert(!eventBase);
+
+    CTxDestination dest = DecodeDestination(gArgs.GetArg("-stratumaddress", ""));
+    if (!IsValidDestination(dest)) {
+        LogPrintf("stratum: -stratumaddress must be set to a valid address to pay mined blocks to\n");
+        return false;
+    }
+    scriptPayout = GetScriptForDestination(dest);
+
+    if (!gArgs.GetBoolArg("-acceptdividedcoinbase", false)) {
+        LogPrintf("stratum: mining through the stratum server requires -acceptdividedcoinbase\n");
+        return false;
+    }
+
+    std::string strDifficulty = gArgs.GetArg("-stratumdifficulty", "");
+    if (!strDifficulty.empty() && (!ParseDouble(strDifficulty, &dDifficulty) || dDifficulty <= 0)) {
+        LogPrintf("stratum: invalid -stratumdifficulty %s\n", strDifficulty);
+        return false;
+    }
+    shareTarget = GetShareTarget(dDifficulty);
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    eventBase = event_base_new();
+    if (!eventBase) {
+        LogPrintf("stratum: Unable to create event_base\n");
+        return false;
+    }
+
+    if (!BindStratumServer(gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT))) {
+        LogPrintf("stratum: Unable to bind any endpoint for the stratum server\n");
+        event_base_free(eventBase);
+        eventBase = nullptr;
+        return false;
+    }
+
+    eventRefresh = event_new(eventBase, -1, EV_PERSIST, RefreshCallback, nullptr);
+    struct timeval tv = {1, 0};
+    event_add(eventRefresh, &tv);
+
+    threadStratum = std::thread(ThreadStratum);
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (eventBase) {
+        LogPrint(BCLog::STRATUM, "stratum: Interrupting stratum server\n");
+        event_base_loopbreak(eventBase);
+    }
+}
+
+void StopStratumServer()
+{
+    if (!eventBase)
+        return;
+    if (threadStratum.joinable())
+        threadStratum.join();
+    for (struct evconnlistener* listener : vListeners)
+        evconnlistener_free(listener);
+    vListeners.clear();
+    for (const auto& client : mapClients)
+        bufferevent_free(client.first);
+    mapClients.clear();
+    mapJobs.clear();
+    mapCurrentJob.clear();
+    if (eventRefresh) {
+        event_free(eventRefresh);
+        eventRefresh = nullptr;
+    }
+    event_base_free(eventBase);
+    eventBase = nullptr;
+    pindexJobs = nullptr;
+    LogPrint(BCLog::STRATUM, "stratum: Stopped stratum server\n");
+}
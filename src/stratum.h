@@ -0,0 +1,23 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Minimal stratum v1 mining server, serving work built by BlockAssembler
+ * straight to miners without going through the RPC layer.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+static const bool DEFAULT_STRATUM_ENABLE = false;
+static const int DEFAULT_STRATUM_PORT = 9329;
+static const double DEFAULT_STRATUM_DIFFICULTY = 1.0;
+
+/** Start the stratum server. Returns false if it could not bind or is misconfigured. */
+bool StartStratumServer();
+/** Interrupt the stratum server thread */
+void InterruptStratumServer();
+/** Stop the stratum server and disconnect all miners */
+void StopStratumServer();
+
+#endif // BITCOIN_STRATUM_H
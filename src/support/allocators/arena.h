@@ -0,0 +1,169 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <new>
+
+/**
+ * Monotonic memory resource for objects that are created together and mostly
+ * die together, like the transactions of a block being deserialized.
+ *
+ * Allocations are carved from chunks one after the other and freed memory is
+ * not reused. Every chunk counts the allocations that live in it and goes
+ * back to operator delete as a whole once the last of them is freed, so an
+ * object that outlives the others only keeps its own chunk around. Requests
+ * that do not fit in a chunk go to operator new.
+ *
+ * Allocating is not thread safe. Freeing is, and does not need the resource,
+ * which may be destroyed before the memory it handed out.
+ */
+class ArenaResource
+{
+private:
+    struct Chunk
+    {
+        //! Allocations living in the chunk, plus one while the resource allocates from it
+        std::atomic<std::size_t> m_refs;
+    };
+
+    //! Every allocation is preceded by the chunk it lives in, null for one of its own
+    static const std::size_t HEADER_BYTES = alignof(std::max_align_t) > sizeof(Chunk*) ? alignof(std::max_align_t) : sizeof(Chunk*);
+
+    const std::size_t m_chunk_size_bytes;
+    Chunk* m_chunk = nullptr;
+    char* m_available_begin = nullptr;
+    char* m_available_end = nullptr;
+    std::size_t m_num_chunks = 0;
+
+    static std::size_t RoundUp(std::size_t bytes)
+    {
+        return (bytes + HEADER_BYTES - 1) / HEADER_BYTES * HEADER_BYTES;
+    }
+
+    static void Release(Chunk* chunk) noexcept
+    {
+        if (chunk->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            chunk->~Chunk();
+            ::operator delete(chunk);
+        }
+    }
+
+    void AllocateChunk()
+    {
+        if (m_chunk) {
+            Release(m_chunk);
+        }
+        void* p = ::operator new(m_chunk_size_bytes);
+        m_chunk = new (p) Chunk;
+        m_chunk->m_refs.store(1, std::memory_order_relaxed);
+        m_available_begin = static_cast<char*>(p) + HEADER_BYTES;
+        m_available_end = static_cast<char*>(p) + m_chunk_size_bytes;
+        ++m_num_chunks;
+    }
+
+public:
+    explicit ArenaResource(std::size_t chunk_size_bytes) : m_chunk_size_bytes(RoundUp(chunk_size_bytes))
+    {
+        assert(m_chunk_size_bytes >= 4 * HEADER_BYTES);
+    }
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    ~ArenaResource()
+    {
+        if (m_chunk) {
+            Release(m_chunk);
+        }
+    }
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        assert(alignment <= HEADER_BYTES);
+        const std::size_t round_bytes = HEADER_BYTES + RoundUp(bytes);
+        Chunk* chunk = nullptr;
+        char* p;
+        if (round_bytes > m_chunk_size_bytes - HEADER_BYTES) {
+            p = static_cast<char*>(::operator new(round_bytes));
+        } else {
+            if ((std::size_t)(m_available_end - m_available_begin) < round_bytes) {
+                AllocateChunk();
+            }
+            chunk = m_chunk;
+            chunk->m_refs.fetch_add(1, std::memory_order_relaxed);
+            p = m_available_begin;
+            m_available_begin += round_bytes;
+        }
+        *reinterpret_cast<Chunk**>(p) = chunk;
+        return p + HEADER_BYTES;
+    }
+
+    static void Deallocate(void* p) noexcept
+    {
+        char* header = static_cast<char*>(p) - HEADER_BYTES;
+        Chunk* chunk = *reinterpret_cast<Chunk**>(header);
+        if (chunk) {
+            Release(chunk);
+        } else {
+            ::operator delete(header);
+        }
+    }
+
+    //! Chunks the resource allocated so far, whether or not they were freed since
+    std::size_t NumAllocatedChunks() const { return m_num_chunks; }
+};
+
+/** Allocator handing out memory from an ArenaResource, which only has to outlive the allocations */
+template <class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator(ArenaResource* resource) noexcept : m_resource(resource) {}
+    ArenaAllocator(const ArenaAllocator& other) noexcept = default;
+    ArenaAllocator& operator=(const ArenaAllocator& other) noexcept = default;
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_resource(other.resource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        ArenaResource::Deallocate(p);
+    }
+
+    ArenaResource* resource() const noexcept { return m_resource; }
+
+private:
+    ArenaResource* m_resource;
+};
+
+template <class T1, class T2>
+bool operator==(const ArenaAllocator<T1>& a, const ArenaAllocator<T2>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2>
+bool operator!=(const ArenaAllocator<T1>& a, const ArenaAllocator<T2>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
@@ -0,0 +1,185 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <list>
+#include <new>
+
+/**
+ * Memory resource for node based containers like std::unordered_map, which
+ * allocate one small node at a time.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES (rounded up to a multiple of
+ * ALIGN_BYTES) are carved from large chunks, and freed blocks are kept in a
+ * free list per size for reuse. This saves the per allocation overhead of
+ * malloc and keeps the nodes close together. Larger or more strictly aligned
+ * requests, like the bucket array of a hash map, go to operator new.
+ *
+ * Chunks are only released when the resource is destroyed. Not thread safe.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(void*), "ALIGN_BYTES must hold a free list link");
+    static_assert(ALIGN_BYTES <= alignof(std::max_align_t), "chunks are only aligned to max_align_t");
+    static_assert(MAX_BLOCK_SIZE_BYTES >= ALIGN_BYTES, "MAX_BLOCK_SIZE_BYTES below ALIGN_BYTES");
+
+private:
+    /** A freed block, linking to the next free block of the same size */
+    struct ListNode
+    {
+        ListNode* m_next;
+    };
+
+    static const std::size_t NUM_SIZE_CLASSES = (MAX_BLOCK_SIZE_BYTES + ALIGN_BYTES - 1) / ALIGN_BYTES + 1;
+
+    const std::size_t m_chunk_size_bytes;
+    std::list<void*> m_allocated_chunks;
+    //! Free blocks by size, in multiples of ALIGN_BYTES
+    std::array<ListNode*, NUM_SIZE_CLASSES> m_free_lists;
+    //! Not yet handed out part of the newest chunk
+    char* m_available_begin = nullptr;
+    char* m_available_end = nullptr;
+
+    static std::size_t NumAlignments(std::size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    static bool IsPoolUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PushFree(void* p, std::size_t num_alignments)
+    {
+        ListNode* node = new (p) ListNode;
+        node->m_next = m_free_lists[num_alignments];
+        m_free_lists[num_alignments] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // The rest of the current chunk is too small for the request, keep it for smaller ones.
+        if (m_available_begin != m_available_end) {
+            PushFree(m_available_begin, (m_available_end - m_available_begin) / ALIGN_BYTES);
+        }
+        void* chunk = ::operator new(m_chunk_size_bytes);
+        m_allocated_chunks.push_back(chunk);
+        m_available_begin = static_cast<char*>(chunk);
+        m_available_end = m_available_begin + m_chunk_size_bytes;
+    }
+
+public:
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(chunk_size_bytes / ALIGN_BYTES * ALIGN_BYTES)
+    {
+        assert(m_chunk_size_bytes >= NumAlignments(MAX_BLOCK_SIZE_BYTES) * ALIGN_BYTES);
+        m_free_lists.fill(nullptr);
+    }
+
+    PoolResource() : PoolResource(262144) {}
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (void* chunk : m_allocated_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPoolUsable(bytes, alignment)) {
+            return ::operator new(bytes);
+        }
+
+        const std::size_t num_alignments = NumAlignments(bytes);
+        if (m_free_lists[num_alignments]) {
+            ListNode* node = m_free_lists[num_alignments];
+            m_free_lists[num_alignments] = node->m_next;
+            return node;
+        }
+
+        const std::size_t round_bytes = num_alignments * ALIGN_BYTES;
+        if ((std::size_t)(m_available_end - m_available_begin) < round_bytes) {
+            AllocateChunk();
+        }
+        void* p = m_available_begin;
+        m_available_begin += round_bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsPoolUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(p, NumAlignments(bytes));
+    }
+
+    std::size_t NumAllocatedChunks() const { return m_allocated_chunks.size(); }
+    std::size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+};
+
+/** Allocator handing out memory from a PoolResource, which has to outlive it and the container using it */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(void*)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+    PoolAllocator(const PoolAllocator& other) noexcept = default;
+    PoolAllocator& operator=(const PoolAllocator& other) noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.resource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* resource() const noexcept { return m_resource; }
+
+private:
+    ResourceType* m_resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
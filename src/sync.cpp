@@ -10,6 +10,10 @@
 
 #include <stdio.h>
 
+#include <algorithm>
+#include <map>
+#include <tuple>
+
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
 static_assert(false, "thread_local is not supported");
@@ -21,6 +25,109 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#ifdef HAVE_THREAD_LOCAL
+static thread_local uint64_t nThreadLockWaitMicros = 0;
+
+void AddThreadLockWait(uint64_t nMicros)
+{
+    nThreadLockWaitMicros += nMicros;
+}
+
+uint64_t GetThreadLockWaitMicros()
+{
+    return nThreadLockWaitMicros;
+}
+#else
+// Not counted per thread without thread_local
+void AddThreadLockWait(uint64_t nMicros) {}
+uint64_t GetThreadLockWaitMicros() { return 0; }
+#endif
+
+std::atomic<bool> g_lock_profiling{DEFAULT_LOCK_PROFILE};
+
+namespace {
+// Keyed by the file and line literals of the call site, a header's call
+// sites may show up once per translation unit and are merged when reported
+std::mutex g_lock_sites_mutex;
+std::map<std::pair<const char*, int>, CLockSiteStats> g_lock_sites;
+
+CLockSiteStats& GetLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    CLockSiteStats& site = g_lock_sites[std::make_pair(pszFile, nLine)];
+    if (site.strFile.empty()) {
+        site.strName = pszName;
+        site.strFile = pszFile;
+        site.nLine = nLine;
+    }
+    return site;
+}
+} // namespace
+
+void RecordLockWait(const char* pszName, const char* pszFile, int nLine, uint64_t nMicros)
+{
+    std::lock_guard<std::mutex> lock(g_lock_sites_mutex);
+    CLockSiteStats& site = GetLockSite(pszName, pszFile, nLine);
+    site.nContentions++;
+    site.nWaitMicros += nMicros;
+    site.nMaxWaitMicros = std::max(site.nMaxWaitMicros, nMicros);
+}
+
+void RecordLockHold(const char* pszName, const char* pszFile, int nLine, uint64_t nMicros)
+{
+    std::lock_guard<std::mutex> lock(g_lock_sites_mutex);
+    CLockSiteStats& site = GetLockSite(pszName, pszFile, nLine);
+    site.nHoldSamples++;
+    site.nHoldMicros += nMicros;
+    site.nMaxHoldMicros = std::max(site.nMaxHoldMicros, nMicros);
+}
+
+#ifdef HAVE_THREAD_LOCAL
+bool SampleLockHold()
+{
+    static thread_local unsigned int nThreadLocks = 0;
+    return ++nThreadLocks % LOCK_PROFILE_SAMPLE_RATE == 0;
+}
+#else
+bool SampleLockHold()
+{
+    static std::atomic<unsigned int> nLocks{0};
+    return nLocks.fetch_add(1, std::memory_order_relaxed) % LOCK_PROFILE_SAMPLE_RATE == 0;
+}
+#endif
+
+std::vector<CLockSiteStats> GetLockSiteStats()
+{
+    std::map<std::tuple<std::string, int, std::string>, CLockSiteStats> mapMerged;
+    {
+        std::lock_guard<std::mutex> lock(g_lock_sites_mutex);
+        for (const auto& entry : g_lock_sites) {
+            const CLockSiteStats& site = entry.second;
+            CLockSiteStats& merged = mapMerged[std::make_tuple(site.strFile, site.nLine, site.strName)];
+            if (merged.strFile.empty()) {
+                merged = site;
+                continue;
+            }
+            merged.nContentions += site.nContentions;
+            merged.nWaitMicros += site.nWaitMicros;
+            merged.nMaxWaitMicros = std::max(merged.nMaxWaitMicros, site.nMaxWaitMicros);
+            merged.nHoldSamples += site.nHoldSamples;
+            merged.nHoldMicros += site.nHoldMicros;
+            merged.nMaxHoldMicros = std::max(merged.nMaxHoldMicros, site.nMaxHoldMicros);
+        }
+    }
+    std::vector<CLockSiteStats> vSites;
+    vSites.reserve(mapMerged.size());
+    for (const auto& entry : mapMerged)
+        vSites.push_back(entry.second);
+    return vSites;
+}
+
+void ResetLockSiteStats()
+{
+    std::lock_guard<std::mutex> lock(g_lock_sites_mutex);
+    g_lock_sites.clear();
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -404,6 +404,31 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr)
 }
 
 
+BOOST_AUTO_TEST_CASE(addrman_modification_count)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+
+    // Reading the tables leaves the count alone, changing them does not.
+    uint64_t nCount = addrman.GetModificationCount();
+    addrman.Select();
+    addrman.GetAddr();
+    BOOST_CHECK_EQUAL(addrman.GetModificationCount(), nCount);
+
+    BOOST_CHECK(addrman.Add(CAddress(addr1, NODE_NONE), source));
+    BOOST_CHECK(addrman.GetModificationCount() != nCount);
+    nCount = addrman.GetModificationCount();
+
+    addrman.Good(addr1);
+    BOOST_CHECK(addrman.GetModificationCount() != nCount);
+    nCount = addrman.GetModificationCount();
+
+    addrman.Clear();
+    BOOST_CHECK(addrman.GetModificationCount() != nCount);
+}
+
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
 {
     CAddrManTest addrman;
@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/block.h>
+#include <streams.h>
+#include <support/allocators/arena.h>
+#include <test/test_bitcoin.h>
+#include <version.h>
+
+#include <string.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(arena_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(arena_allocates_in_chunks)
+{
+    void* a;
+    void* b;
+    void* c;
+    {
+        ArenaResource resource(1024);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+        a = resource.Allocate(100, 8);
+        b = resource.Allocate(100, 8);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+        BOOST_CHECK((char*)a < (char*)b && (char*)b - (char*)a < 1024);
+        BOOST_CHECK_EQUAL((size_t)b % alignof(std::max_align_t), 0U);
+
+        // Too large requests get an allocation of their own.
+        c = resource.Allocate(4096, 8);
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+        memset(c, 0xff, 4096);
+
+        for (int i = 0; i < 20; i++) {
+            ArenaResource::Deallocate(resource.Allocate(100, 8));
+        }
+        BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+    }
+
+    // The allocations stay usable after the resource is gone.
+    memset(a, 0xff, 100);
+    memset(b, 0xff, 100);
+    ArenaResource::Deallocate(b);
+    ArenaResource::Deallocate(c);
+    memset(a, 0, 100);
+    ArenaResource::Deallocate(a);
+}
+
+BOOST_AUTO_TEST_CASE(arena_block_deserialization)
+{
+    CBlock block;
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(2);
+        mtx.vin[0].prevout = COutPoint(InsecureRand256(), i);
+        mtx.vin[1].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = i;
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+
+    CBlock blockArena;
+    {
+        CBlockArenaScope arena;
+#ifdef HAVE_THREAD_LOCAL
+        BOOST_CHECK(GetDeserializeArena() != nullptr);
+#endif
+        stream >> blockArena;
+    }
+    BOOST_CHECK(GetDeserializeArena() == nullptr);
+
+    BOOST_REQUIRE_EQUAL(blockArena.vtx.size(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(blockArena.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+    }
+
+    // A transaction outlives the rest of its block.
+    CTransactionRef tx = blockArena.vtx[100];
+    blockArena.SetNull();
+    BOOST_CHECK(tx->GetHash() == block.vtx[100]->GetHash());
+    BOOST_CHECK_EQUAL(tx->vout[0].nValue, 100);
+
+#ifdef HAVE_THREAD_LOCAL
+    // Scopes nest.
+    {
+        CBlockArenaScope outer;
+        ArenaResource* pOuter = GetDeserializeArena();
+        {
+            CBlockArenaScope inner;
+            BOOST_CHECK(GetDeserializeArena() != pOuter);
+        }
+        BOOST_CHECK(GetDeserializeArena() == pOuter);
+    }
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -317,6 +317,41 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(HeaderRefRoundTripTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    CBlockHeaderAndShortTxIDs shortIDs(block, true);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CBlockHeaderRefAndShortTxIDs(shortIDs);
+
+    // Only the block hash is sent instead of the header
+    CDataStream streamFull(SER_NETWORK, PROTOCOL_VERSION);
+    streamFull << shortIDs;
+    BOOST_CHECK_EQUAL(streamFull.size() - stream.size(), ::GetSerializeSize(block.GetBlockHeader(), SER_NETWORK, PROTOCOL_VERSION) - 32);
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    CBlockHeaderRefAndShortTxIDs ref(shortIDs2);
+    stream >> ref;
+    BOOST_CHECK_EQUAL(ref.blockhash.ToString(), block.GetHash().ToString());
+    shortIDs2.SetHeader(block.GetBlockHeader());
+
+    // The short ids match once the header is known
+    BOOST_CHECK_EQUAL(shortIDs2.GetShortID(block.vtx[1]->GetWitnessHash()), shortIDs.GetShortID(block.vtx[1]->GetWitnessHash()));
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx[1], block.vtx[2]}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -340,4 +375,51 @@ BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BOOST_CHECK_EQUAL(req1.indexes[3], req2.indexes[3]);
 }
 
+BOOST_AUTO_TEST_CASE(CompressedHeadersRoundTripTest)
+{
+    const uint8_t algos[] = {ALGO_SHA256D, ALGO_SCRYPT, ALGO_SHA256D, ALGO_EQUIHASH, ALGO_EQUIHASH, ALGO_SCRYPT};
+    std::vector<CBlock> headers;
+    for (size_t i = 0; i < 12; i++) {
+        CBlock header;
+        header.nVersion = 0x20000000;
+        header.SetAlgo(algos[i % 6]);
+        header.hashPrevBlock = headers.empty() ? InsecureRand256() : headers.back().GetHash();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1500000000 + i * 60 - (i == 7 ? 100 : 0);
+        header.nBits = 0x1d00ffff - (i >= 8 && algos[i % 6] == ALGO_SCRYPT);
+        header.nNonce = InsecureRand32();
+        if (IsEquihashBasedAlgo(header.GetAlgo())) {
+            header.hashReserved = InsecureRand256();
+            header.nBigNonce = InsecureRand256();
+            header.nSolution.resize(100, i);
+        }
+        headers.push_back(header);
+    }
+    // a header not connecting to the one before
+    headers[10].hashPrevBlock = InsecureRand256();
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CCompressedHeaders<CBlock>(headers);
+    BOOST_CHECK(stream.size() < GetSerializeSize(headers, SER_NETWORK, PROTOCOL_VERSION));
+
+    std::vector<CBlockHeader> headers2;
+    CCompressedHeaders<CBlockHeader> compressed(headers2, headers.size());
+    stream >> compressed;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK_EQUAL(compressed.nCount, headers.size());
+    BOOST_REQUIRE_EQUAL(headers2.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK_EQUAL(headers2[i].GetHash().ToString(), headers[i].GetHash().ToString());
+        BOOST_CHECK_EQUAL(headers2[i].nTime, headers[i].nTime);
+        BOOST_CHECK_EQUAL(headers2[i].nBits, headers[i].nBits);
+    }
+
+    // too many headers are not read
+    stream << CCompressedHeaders<CBlock>(headers);
+    CCompressedHeaders<CBlockHeader> compressed2(headers2, headers.size() - 1);
+    stream >> compressed2;
+    BOOST_CHECK_EQUAL(compressed2.nCount, headers.size());
+    BOOST_CHECK(headers2.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+
+#include <coins.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <streams.h>
+#include <undo.h>
+#include <utilstrencodings.h>
+#include <version.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_bip158_vector)
+{
+    // The basic filter of the testnet3 genesis block, from the BIP 158 test vectors.
+    const uint256 hashBlock = uint256S("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    const std::vector<unsigned char> script = ParseHex("4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac");
+    CGCSFilter::ElementSet elements;
+    elements.insert(script);
+
+    CGCSFilter filter(hashBlock.GetUint64(0), hashBlock.GetUint64(1), CGCSFilter::BASIC_P, CGCSFilter::BASIC_M, elements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+    BOOST_CHECK(filter.Match(script));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    CGCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; ++i) {
+        CGCSFilter::Element element1(32, 0);
+        element1[0] = i;
+        included.insert(element1);
+        CGCSFilter::Element element2(32, 1);
+        element2[0] = i;
+        excluded.insert(element2);
+    }
+
+    CGCSFilter filter(0, 0, 10, 1 << 10, included);
+    for (const CGCSFilter::Element& element : included) {
+        BOOST_CHECK(filter.Match(element));
+        CGCSFilter::ElementSet query = excluded;
+        query.insert(element);
+        BOOST_CHECK(filter.MatchAny(query));
+    }
+
+    // Decoding an encoded filter gives the same set.
+    CGCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    for (const CGCSFilter::Element& element : included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // Nothing is in an empty filter, not even with a false positive.
+    CGCSFilter empty;
+    BOOST_CHECK_EQUAL(HexStr(empty.GetEncoded()), "00");
+    BOOST_CHECK(!empty.MatchAny(included));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CScript included_scripts[4], excluded_scripts[3];
+    included_scripts[0] << std::vector<unsigned char>(33, 1) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    included_scripts[2] << OP_0 << std::vector<unsigned char>(20, 3);
+    included_scripts[3] << OP_0 << std::vector<unsigned char>(32, 4);
+    // Not in the block at all, an OP_RETURN output and an empty script
+    excluded_scripts[0] << OP_HASH160 << std::vector<unsigned char>(20, 5) << OP_EQUAL;
+    excluded_scripts[1] << OP_RETURN << std::vector<unsigned char>(8, 6);
+
+    CMutableTransaction tx;
+    tx.vout.emplace_back(100, included_scripts[0]);
+    tx.vout.emplace_back(200, included_scripts[1]);
+    tx.vout.emplace_back(0, excluded_scripts[1]);
+    tx.vout.emplace_back(0, excluded_scripts[2]);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    // The scripts of the outputs the block spends are matched too.
+    CBlockUndo blockundo;
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[2]), 1000, false);
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(700, included_scripts[3]), 10000, false);
+
+    CBlockFilter blockfilter(block, blockundo);
+    BOOST_CHECK(blockfilter.GetBlockHash() == block.GetHash());
+    const CGCSFilter& filter = blockfilter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 4U);
+    for (const CScript& script : included_scripts)
+        BOOST_CHECK(filter.Match(CGCSFilter::Element(script.begin(), script.end())));
+    for (const CScript& script : excluded_scripts)
+        BOOST_CHECK(!filter.Match(CGCSFilter::Element(script.begin(), script.end())));
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << blockfilter;
+    CBlockFilter blockfilter2;
+    ss >> blockfilter2;
+    BOOST_CHECK(blockfilter2.GetBlockHash() == blockfilter.GetBlockHash());
+    BOOST_CHECK(blockfilter2.GetFilter().GetEncoded() == filter.GetEncoded());
+    for (const CScript& script : included_scripts)
+        BOOST_CHECK(blockfilter2.GetFilter().Match(CGCSFilter::Element(script.begin(), script.end())));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,42 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilemap.h>
+#include <blockview.h>
+#include <chainparams.h>
+#include <streams.h>
+#include <validation.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(raw_block_view)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    // From a mapped block file and read through the C library, the view is the serialized block.
+    for (int nMaps : {DEFAULT_BLOCK_FILE_MAPS, 0}) {
+        SetBlockFileMaps(nMaps);
+        CRawBlockView view;
+        BOOST_REQUIRE(view.Read(pindex, Params().MessageStart()));
+        BOOST_CHECK(std::vector<unsigned char>(view.begin(), view.end()) == std::vector<unsigned char>(ssBlock.begin(), ssBlock.end()));
+        BOOST_CHECK(view.GetHeader().GetHash() == block.GetHash());
+        BOOST_REQUIRE_EQUAL(view.GetTxCount(), block.vtx.size());
+        for (size_t i = block.vtx.size(); i-- > 0;)
+            BOOST_CHECK(view.GetTransaction(i)->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+    }
+    SetBlockFileMaps(DEFAULT_BLOCK_FILE_MAPS);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -586,7 +586,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
     InsertCoinsMapEntry(map, value, flags);
     view.BatchWrite(map, {});
 }
@@ -656,6 +657,85 @@ BOOST_AUTO_TEST_CASE(ccoins_access)
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
 }
 
+void CheckAddFetchedCoin(CAmount base_value, CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(base_value, cache_value, cache_flags);
+    Coin coin;
+    if (test.base.GetCoin(OUTPOINT, coin))
+        test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* Check AddFetchedCoin behavior, adding a coin read from the base view
+     * ahead of time to the cache. The result has to be the same as the one
+     * of AccessCoin in ccoins_access.
+     *
+     *                   Base    Cache   Result  Cache        Result
+     *                   Value   Value   Value   Flags        Flags
+     */
+    CheckAddFetchedCoin(ABSENT, ABSENT, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckAddFetchedCoin(ABSENT, PRUNED, PRUNED, 0          , 0          );
+    CheckAddFetchedCoin(ABSENT, PRUNED, PRUNED, DIRTY|FRESH, DIRTY|FRESH);
+    CheckAddFetchedCoin(ABSENT, VALUE2, VALUE2, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(PRUNED, ABSENT, ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckAddFetchedCoin(PRUNED, PRUNED, PRUNED, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(VALUE1, ABSENT, VALUE1, NO_ENTRY   , 0          );
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, 0          , 0          );
+    CheckAddFetchedCoin(VALUE1, PRUNED, PRUNED, DIRTY      , DIRTY      );
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, 0          , 0          );
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, FRESH      , FRESH      );
+    CheckAddFetchedCoin(VALUE1, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH);
+}
+
+void CheckExtractOldDirtyCoins(CAmount cache_value, char cache_flags, int max_height, CAmount expected_cache_value, char expected_cache_flags, CAmount expected_value, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    CCoinsMapMemoryResource resource;
+    CCoinsMap extracted(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    size_t count = test.cache.ExtractOldDirtyCoins(extracted, max_height, std::numeric_limits<size_t>::max());
+    test.cache.SelfTest();
+    BOOST_CHECK_EQUAL(count, extracted.size());
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_cache_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_cache_flags);
+    GetCoinsMapEntry(extracted, result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_extract_old_dirty)
+{
+    /* Check ExtractOldDirtyCoins behavior, taking modified entries out of the
+     * cache to be written to the base separately. Coins in these tests are
+     * created at height 1.
+     *
+     *                         Cache   Cache        Max     Result  Result       Taken   Taken
+     *                         Value   Flags        Height  Value   Flags        Value   Flags
+     */
+    CheckExtractOldDirtyCoins(ABSENT, NO_ENTRY   , 1,      ABSENT, NO_ENTRY   , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(PRUNED, 0          , 1,      PRUNED, 0          , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(PRUNED, FRESH      , 1,      PRUNED, FRESH      , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(PRUNED, DIRTY      , 0,      ABSENT, NO_ENTRY   , PRUNED, DIRTY   );
+    CheckExtractOldDirtyCoins(PRUNED, DIRTY|FRESH, 0,      ABSENT, NO_ENTRY   , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(VALUE1, 0          , 1,      VALUE1, 0          , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(VALUE1, FRESH      , 1,      VALUE1, FRESH      , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(VALUE1, DIRTY      , 1,      VALUE1, 0          , VALUE1, DIRTY   );
+    CheckExtractOldDirtyCoins(VALUE1, DIRTY|FRESH, 1,      VALUE1, 0          , VALUE1, DIRTY   );
+    CheckExtractOldDirtyCoins(VALUE1, DIRTY      , 0,      VALUE1, DIRTY      , ABSENT, NO_ENTRY);
+    CheckExtractOldDirtyCoins(VALUE1, DIRTY|FRESH, 0,      VALUE1, DIRTY|FRESH, ABSENT, NO_ENTRY);
+}
+
 void CheckSpendCoins(CAmount base_value, CAmount cache_value, CAmount expected_value, char cache_flags, char expected_flags)
 {
     SingleEntryCacheTest test(base_value, cache_value, cache_flags);
@@ -855,4 +935,37 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(blockundo_compact_serialization)
+{
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(50 * COIN, CScript() << OP_TRUE), 100, true);
+    blockundo.vtxundo[1].vprevout.emplace_back(CTxOut(COIN, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG), 1000, false);
+    blockundo.vtxundo[1].vprevout.emplace_back(CTxOut(COIN / 2, CScript() << OP_TRUE), 0, false);
+
+    for (int nVersion : {CLIENT_VERSION, CLIENT_VERSION | SERIALIZE_UNDO_COMPACT}) {
+        CDataStream ss(SER_DISK, nVersion);
+        ss << blockundo;
+        BOOST_CHECK_EQUAL(ss.size(), ::GetSerializeSize(blockundo, SER_DISK, nVersion));
+        CBlockUndo blockundoRead;
+        ss >> blockundoRead;
+        BOOST_CHECK(ss.empty());
+        BOOST_REQUIRE_EQUAL(blockundoRead.vtxundo.size(), 2U);
+        for (size_t i = 0; i < 2; i++) {
+            BOOST_REQUIRE_EQUAL(blockundoRead.vtxundo[i].vprevout.size(), blockundo.vtxundo[i].vprevout.size());
+            for (size_t j = 0; j < blockundo.vtxundo[i].vprevout.size(); j++) {
+                const Coin& coin = blockundo.vtxundo[i].vprevout[j];
+                const Coin& coinRead = blockundoRead.vtxundo[i].vprevout[j];
+                BOOST_CHECK(coinRead.out == coin.out);
+                BOOST_CHECK_EQUAL(coinRead.nHeight, coin.nHeight);
+                BOOST_CHECK_EQUAL(coinRead.fCoinBase, coin.fCoinBase);
+            }
+        }
+    }
+
+    // One byte less for every spent output with a height
+    BOOST_CHECK_EQUAL(::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION | SERIALIZE_UNDO_COMPACT) + 2,
+                      ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsreadview.h>
+#include <script/script.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+
+#include <utility>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+Coin MakeCoin(CAmount nValue, int nHeight)
+{
+    return Coin(CTxOut(nValue, CScript() << OP_TRUE), nHeight, false);
+}
+
+void WriteCoins(CCoinsViewDB& db, const std::vector<std::pair<COutPoint, Coin> >& vCoins, const uint256& hashBlock)
+{
+    CCoinsViewCache cache(&db);
+    for (const auto& entry : vCoins) {
+        if (entry.second.IsSpent()) {
+            cache.SpendCoin(entry.first);
+        } else {
+            Coin coin = entry.second;
+            cache.AddCoin(entry.first, std::move(coin), true);
+        }
+    }
+    cache.SetBestBlock(hashBlock);
+    BOOST_REQUIRE(cache.Flush());
+}
+
+CAmount GetValue(const CCoinsView& view, const COutPoint& outpoint)
+{
+    Coin coin;
+    if (!view.GetCoin(outpoint, coin))
+        return -1;
+    BOOST_CHECK(view.HaveCoin(outpoint));
+    return coin.out.nValue;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsreadview_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(coinsreadview_layers)
+{
+    CCoinsViewDB db(1 << 20, true);
+    const COutPoint a(InsecureRand256(), 0), b(InsecureRand256(), 1), c(InsecureRand256(), 2);
+    WriteCoins(db, {{a, MakeCoin(1, 1)}, {b, MakeCoin(2, 1)}}, InsecureRand256());
+
+    // Modifications not written to the database yet go on top of the snapshot.
+    const uint256 hash1 = InsecureRand256();
+    CCoinsReadView view1(db, {{b, MakeCoin(3, 2)}}, hash1, 2);
+    BOOST_CHECK(view1.GetBestBlock() == hash1);
+    BOOST_CHECK_EQUAL(view1.GetHeight(), 2);
+    BOOST_CHECK_EQUAL(GetValue(view1, a), 1);
+    BOOST_CHECK_EQUAL(GetValue(view1, b), 3);
+    BOOST_CHECK_EQUAL(view1.GetLayerCount(), 1U);
+
+    // The next block spends a and creates c.
+    CCoinsReadView view2(view1, {{a, Coin()}, {c, MakeCoin(4, 3)}}, InsecureRand256(), 3);
+    BOOST_CHECK_EQUAL(GetValue(view2, a), -1);
+    BOOST_CHECK_EQUAL(GetValue(view2, b), 3);
+    BOOST_CHECK_EQUAL(GetValue(view2, c), 4);
+    BOOST_CHECK_EQUAL(GetValue(view1, a), 1);
+    BOOST_CHECK_EQUAL(GetValue(view1, c), -1);
+
+    // Writes to the database after a view was made do not show in it.
+    WriteCoins(db, {{a, Coin()}, {b, MakeCoin(3, 2)}, {c, MakeCoin(4, 3)}}, InsecureRand256());
+    BOOST_CHECK_EQUAL(GetValue(view1, a), 1);
+    BOOST_CHECK_EQUAL(GetValue(view1, c), -1);
+    CCoinsReadView view3(db, {}, InsecureRand256(), 3);
+    BOOST_CHECK_EQUAL(view3.GetLayerCount(), 0U);
+    BOOST_CHECK_EQUAL(GetValue(view3, a), -1);
+    BOOST_CHECK_EQUAL(GetValue(view3, b), 3);
+    BOOST_CHECK_EQUAL(GetValue(view3, c), 4);
+}
+
+BOOST_AUTO_TEST_CASE(coinsreadview_merge)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::unique_ptr<CCoinsReadView> pview(new CCoinsReadView(db, {}, InsecureRand256(), 0));
+    std::vector<std::unique_ptr<CCoinsReadView> > vViews;
+    std::vector<COutPoint> vOutpoints;
+    for (int i = 1; i <= 1000; i++) {
+        vOutpoints.emplace_back(InsecureRand256(), 0);
+        std::vector<std::pair<COutPoint, Coin> > vCoins;
+        vCoins.emplace_back(vOutpoints.back(), MakeCoin(i, i));
+        // Every block also spends the coin of the block before.
+        if (i > 1)
+            vCoins.emplace_back(vOutpoints[i - 2], Coin());
+        std::unique_ptr<CCoinsReadView> pnext(new CCoinsReadView(*pview, std::move(vCoins), InsecureRand256(), i));
+        vViews.push_back(std::move(pview));
+        pview = std::move(pnext);
+    }
+
+    BOOST_CHECK(pview->GetLayerCount() <= 16);
+    for (int i = 1; i < 1000; i++) {
+        BOOST_CHECK_EQUAL(GetValue(*pview, vOutpoints[i - 1]), -1);
+    }
+    BOOST_CHECK_EQUAL(GetValue(*pview, vOutpoints.back()), 1000);
+
+    // Merging the layers of a view leaves the ones of older views alone.
+    const CCoinsReadView& view500 = *vViews[500];
+    BOOST_CHECK_EQUAL(view500.GetHeight(), 500);
+    BOOST_CHECK_EQUAL(GetValue(view500, vOutpoints[498]), -1);
+    BOOST_CHECK_EQUAL(GetValue(view500, vOutpoints[499]), 500);
+    BOOST_CHECK_EQUAL(GetValue(view500, vOutpoints[500]), -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -524,6 +525,76 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+static std::string MuHashHex(MuHash3072& muhash)
+{
+    unsigned char out[MuHash3072::OUTPUT_SIZE];
+    muhash.Finalize(out);
+    return HexStr(out, out + sizeof(out));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    const unsigned char a[] = {'a'}, b[] = {'b'}, c[] = {'c'};
+
+    MuHash3072 empty;
+    BOOST_CHECK_EQUAL(MuHashHex(empty), "c85525462fdcf30a2c18d6f4b92923000974355c2477f59594d2c205a1d25add");
+
+    MuHash3072 ab;
+    ab.Insert(a, 1).Insert(b, 1);
+    BOOST_CHECK_EQUAL(MuHashHex(ab), "e384c914eed07d0a166a00a956214adbe9dfd2d327e1d3e6dfb69fa5f9cb8327");
+
+    // Order does not matter, and removing an element undoes adding it.
+    MuHash3072 bca;
+    bca.Insert(b, 1).Insert(c, 1).Remove(c, 1).Insert(a, 1);
+    BOOST_CHECK_EQUAL(MuHashHex(bca), MuHashHex(ab));
+    MuHash3072 removed;
+    removed.Remove(c, 1).Insert(c, 1);
+    BOOST_CHECK_EQUAL(MuHashHex(removed), MuHashHex(empty));
+
+    // The state left by Finalize continues the same set.
+    MuHash3072 restored;
+    restored.SetState(ab.GetState());
+    restored.Insert(c, 1).Remove(a, 1);
+    MuHash3072 bc;
+    bc.Insert(c, 1).Insert(b, 1);
+    BOOST_CHECK_EQUAL(MuHashHex(restored), MuHashHex(bc));
+
+    // Inverses of random numbers, including ones close to the modulus.
+    for (int i = 0; i < 4; ++i) {
+        unsigned char bytes[Num3072::BYTE_SIZE];
+        for (unsigned char& byte : bytes) {
+            byte = i < 2 ? InsecureRandBits(8) : 0xff;
+        }
+        bytes[0] -= i;
+        Num3072 x(bytes);
+        Num3072 y = x.GetInverse();
+        y.Multiply(x);
+        Num3072 one;
+        BOOST_CHECK(memcmp(y.limbs, one.limbs, sizeof(one.limbs)) == 0);
+
+        Num3072 squared = x;
+        squared.Square();
+        x.Multiply(Num3072(bytes));
+        BOOST_CHECK(memcmp(squared.limbs, x.limbs, sizeof(x.limbs)) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -58,6 +58,25 @@ BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
     }
 };
 
+/* Test that the occupancy follows inserts and erases.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_count_occupied)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    BOOST_CHECK_EQUAL(cc.setup(1024), cc.capacity());
+    BOOST_CHECK_EQUAL(cc.count_occupied(), 0U);
+    std::vector<uint256> hashes(100);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    BOOST_CHECK_EQUAL(cc.count_occupied(), 100U);
+    for (int i = 0; i < 40; ++i)
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    BOOST_CHECK_EQUAL(cc.count_occupied(), 60U);
+}
+
 /** This helper returns the hit rate when megabytes*load worth of entries are
  * inserted into a megabytes sized cache
  */
@@ -81,6 +81,22 @@ void TestEquihashSolvers(unsigned int n, unsigned int k, const std::string &I, c
     BOOST_TEST_MESSAGE(strm.str());
     BOOST_CHECK(retOpt == solns);
     BOOST_CHECK(retOpt == ret);
+
+    // And so should the bucket solver, whatever the number of threads
+    for (unsigned int nThreads : {1, 3}) {
+        std::set<std::vector<uint32_t>> retBucket;
+        std::function<bool(std::vector<unsigned char>)> validBlockBucket =
+                [&retBucket, cBitLen](std::vector<unsigned char> soln) {
+            retBucket.insert(GetIndicesFromMinimal(soln, cBitLen));
+            return false;
+        };
+        EhBucketSolveUncancellable(n, k, state, validBlockBucket, nThreads);
+        BOOST_TEST_MESSAGE("[Bucket, " << nThreads << " threads] Number of solutions: " << retBucket.size());
+        strm.str("");
+        PrintSolutions(strm, retBucket);
+        BOOST_TEST_MESSAGE(strm.str());
+        BOOST_CHECK(retBucket == solns);
+    }
 }
 
 void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I, const arith_uint256 &nonce, std::vector<uint32_t> soln, bool expected) {
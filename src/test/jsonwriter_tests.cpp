@@ -0,0 +1,96 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <core_io.h>
+#include <jsonwriter.h>
+#include <key.h>
+#include <primitives/transaction.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <univalue.h>
+#include <utilstrencodings.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(jsonwriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_univalue)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("str", std::string("a\"b\\c\n\t\x01\x7f"));
+    obj.pushKV("neg", (int64_t)-42);
+    obj.pushKV("big", (uint64_t)18446744073709551615ULL);
+    obj.pushKV("bool", true);
+    obj.pushKV("empty", UniValue(UniValue::VARR));
+    obj.pushKV("amount", ValueFromAmount(-123456789));
+    UniValue arr(UniValue::VARR);
+    arr.push_back(1);
+    arr.push_back(UniValue(UniValue::VOBJ));
+    obj.pushKV("arr", arr);
+
+    std::string str;
+    CJSONWriter writer(str);
+    writer.BeginObject();
+    writer.KV("str", "a\"b\\c\n\t\x01\x7f");
+    writer.KV("neg", (int64_t)-42);
+    writer.KV("big", (uint64_t)18446744073709551615ULL);
+    writer.KV("bool", true);
+    writer.Key("empty");
+    writer.BeginArray();
+    writer.EndArray();
+    writer.Key("amount");
+    writer.RawValue(ValueFromAmount(-123456789).getValStr());
+    writer.Key("arr");
+    writer.BeginArray();
+    writer.Value(1);
+    writer.BeginObject();
+    writer.EndObject();
+    writer.EndArray();
+    writer.EndObject();
+
+    BOOST_CHECK_EQUAL(str, obj.write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_tx)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 100 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    mtx.nLockTime = 99;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    mtx.vin[0].scriptSig = CScript() << ParseHex("3044022000000000000000000000000000000000000000000000000000000000000000010220000000000000000000000000000000000000000000000000000000000000000101");
+    mtx.vin[1].prevout = COutPoint(coinbase.GetHash(), 1);
+    mtx.vin[1].scriptWitness.stack.push_back(ParseHex("00ff"));
+    mtx.vout.emplace_back(COIN, GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID())));
+    mtx.vout.emplace_back(0, CScript() << OP_RETURN << ParseHex("deadbeef"));
+    mtx.vout.emplace_back(1, GetScriptForMultisig(1, {key.GetPubKey(), key.GetPubKey()}));
+
+    const uint256 hashBlock = uint256S("0badc0de");
+    for (const CTransaction& tx : {CTransaction(coinbase), CTransaction(mtx)}) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, hashBlock, entry, true);
+
+        std::string str;
+        CJSONWriter writer(str);
+        TxToJSON(tx, hashBlock, writer, true);
+        BOOST_CHECK_EQUAL(str, entry.write());
+
+        UniValue entryNoHex(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entryNoHex, false);
+        str.clear();
+        CJSONWriter writerNoHex(str);
+        TxToJSON(tx, uint256(), writerNoHex, false);
+        BOOST_CHECK_EQUAL(str, entryNoHex.write());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
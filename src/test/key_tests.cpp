@@ -112,6 +112,16 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(!pubkey2C.Verify(hashMsg, sign1C));
         BOOST_CHECK( pubkey2C.Verify(hashMsg, sign2C));
 
+        // verification with a parsed public key
+        CParsedPubKey parsed1, parsed1C;
+        BOOST_CHECK(pubkey1.Parse(parsed1));
+        BOOST_CHECK(pubkey1C.Parse(parsed1C));
+        BOOST_CHECK( CPubKey::Verify(parsed1, hashMsg, sign1));
+        BOOST_CHECK(!CPubKey::Verify(parsed1, hashMsg, sign2));
+        BOOST_CHECK( CPubKey::Verify(parsed1C, hashMsg, sign1C));
+        BOOST_CHECK(!CPubKey::Verify(parsed1C, hashMsg, sign2C));
+        BOOST_CHECK(!CPubKey().Parse(parsed1));
+
         // compact signatures (with key recovery)
 
         std::vector<unsigned char> csign1, csign2, csign1C, csign2C;
@@ -571,4 +571,168 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolInstantSendLockedTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK(pool.cs);
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(1000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(50000LL).FromTx(tx3));
+
+    // Unknown transactions are not recorded
+    CMutableTransaction tx4 = tx3;
+    tx4.vout[0].nValue = 5 * COIN;
+    pool.SetInstantSendLocked(tx4.GetHash());
+    BOOST_CHECK(pool.GetInstantSendLocked().empty());
+
+    // tx1 and tx2 have the lowest feerate, but tx2 is locked and takes tx1 along
+    pool.SetInstantSendLocked(tx2.GetHash());
+    BOOST_CHECK(pool.IsInstantSendLocked(pool.mapTx.find(tx2.GetHash())));
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.exists(tx2.GetHash()));
+    BOOST_CHECK(!pool.exists(tx3.GetHash()));
+
+    // Nothing is left that could be evicted
+    pool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(tx1));
+    vtx.push_back(MakeTransactionRef(tx2));
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK(pool.GetInstantSendLocked().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolTxidIndexTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.get(tx1.GetHash()));
+
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).Time(42).FromTx(tx1));
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(pool.get(tx1.GetHash())->GetHash() == tx1.GetHash());
+    TxMempoolInfo info = pool.info(tx1.GetHash());
+    BOOST_CHECK_EQUAL(info.nTime, 42);
+    BOOST_CHECK_EQUAL(info.nFeeDelta, 0);
+
+    pool.PrioritiseTransaction(tx1.GetHash(), 500);
+    BOOST_CHECK_EQUAL(pool.info(tx1.GetHash()).nFeeDelta, 500);
+
+    pool.removeRecursive(tx1);
+    BOOST_CHECK(!pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.info(tx1.GetHash()).tx);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDiamondChainTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK(pool.cs);
+
+    // tx1 has two children that are both spent by tx4, followed by a chain
+    // of 20 transactions each spending the previous one.
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_11;
+    tx1.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        tx1.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx1.vout[i].nValue = 10 * COIN;
+    }
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction txMid = CMutableTransaction();
+        txMid.vin.resize(1);
+        txMid.vin[0].prevout = COutPoint(tx1.GetHash(), i);
+        txMid.vin[0].scriptSig = CScript() << OP_11;
+        txMid.vout.resize(1);
+        txMid.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txMid.vout[0].nValue = 10 * COIN;
+        pool.addUnchecked(txMid.GetHash(), entry.Fee(1000LL).FromTx(txMid));
+        tx4.vin[i].prevout = COutPoint(txMid.GetHash(), 0);
+        tx4.vin[i].scriptSig = CScript() << OP_11;
+    }
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 20 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(1000LL).FromTx(tx4));
+
+    uint256 hashPrev = tx4.GetHash();
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction tx = CMutableTransaction();
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 20 * COIN;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(1000LL).FromTx(tx));
+        hashPrev = tx.GetHash();
+    }
+
+    // The diamond counts tx1 once.
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx4.GetHash())->GetCountWithAncestors(), 4);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx1.GetHash())->GetCountWithDescendants(), 24);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(hashPrev)->GetCountWithAncestors(), 24);
+
+    CTxMemPool::setEntries setAncestors;
+    std::string dummy;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*pool.mapTx.find(hashPrev), setAncestors, 100, 1000000, 1000, 1000000, dummy));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 23);
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(*pool.mapTx.find(hashPrev), setAncestors, 23, 1000000, 1000, 1000000, dummy));
+
+    // Confirming tx1 updates the whole chain below it.
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(tx1));
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 23);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx4.GetHash())->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(hashPrev)->GetCountWithAncestors(), 23);
+
+    // Evicting tx4 takes its descendants along and updates its ancestors.
+    pool.removeRecursive(tx4);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    for (CTxMemPool::txiter it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), 1);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <messagesigner.h>
+
+#include <key.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <uint256.h>
+#include <test/test_bitcoin.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(verify_hash_cache)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    const uint256 hash1 = GetRandHash();
+    const uint256 hash2 = GetRandHash();
+
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CHashSigner::SignHash(hash1, key1, vchSig));
+
+    std::string strError;
+    const uint64_t nHits = GetMessageSignatureCacheStats().nHits;
+    BOOST_CHECK(CHashSigner::VerifyHash(hash1, key1.GetPubKey(), vchSig, strError));
+    BOOST_CHECK_EQUAL(GetMessageSignatureCacheStats().nHits, nHits);
+    // the copy relayed by another peer is found in the cache
+    BOOST_CHECK(CHashSigner::VerifyHash(hash1, key1.GetPubKey(), vchSig, strError));
+    BOOST_CHECK_EQUAL(GetMessageSignatureCacheStats().nHits, nHits + 1);
+
+    // a cached signature does not pass for another key or hash
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash1, key2.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash2, key1.GetPubKey(), vchSig, strError));
+    // and a failed verification is not cached
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash1, key2.GetPubKey(), vchSig, strError));
+    BOOST_CHECK_EQUAL(GetMessageSignatureCacheStats().nHits, nHits + 1);
+}
+
+BOOST_AUTO_TEST_CASE(verify_message)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CMessageSigner::SignMessage("message", vchSig, key));
+
+    std::string strError;
+    for (int i = 0; i < 2; i++) {
+        BOOST_CHECK(CMessageSigner::VerifyMessage(key.GetPubKey(), vchSig, "message", strError));
+        BOOST_CHECK(!CMessageSigner::VerifyMessage(key.GetPubKey(), vchSig, "other message", strError));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -47,6 +47,23 @@ static BlockAssembler AssemblerForTest(const CChainParams& params) {
     return BlockAssembler(params, options);
 }
 
+static BlockAssembler IncrementalAssemblerForTest(const CChainParams& params) {
+    BlockAssembler::Options options;
+
+    options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.blockMinFeeRate = blockMinFeeRate;
+    options.fIncremental = true;
+    return BlockAssembler(params, options);
+}
+
+static std::set<uint256> GetTemplateTxids(const CBlockTemplate& blocktemplate)
+{
+    std::set<uint256> txids;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); ++i)
+        txids.insert(blocktemplate.block.vtx[i]->GetHash());
+    return txids;
+}
+
 static
 struct {
     unsigned char extranonce;
@@ -199,6 +216,40 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey,0);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // Test that the incremental mode, which only considers the mempool
+    // entries added since the previous template, selects the same transactions.
+    ResetIncrementalAssembly();
+    std::unique_ptr<CBlockTemplate> pincremental = IncrementalAssemblerForTest(chainparams).CreateNewBlock(scriptPubKey,0);
+    BOOST_CHECK(GetTemplateTxids(*pincremental) == GetTemplateTxids(*pblocktemplate));
+
+    tx.vin[0].prevout.hash = hashLowFeeTx2;
+    tx.vin[0].prevout.n = 0;
+    tx.vout[0].nValue = 5000000000LL - 100000000 - feeToUse - 20000; // 20k satoshi fee
+    uint256 hashChildTx = tx.GetHash();
+    mempool.addUnchecked(hashChildTx, entry.Fee(20000).FromTx(tx));
+    pincremental = IncrementalAssemblerForTest(chainparams).CreateNewBlock(scriptPubKey,0);
+    pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey,0);
+    BOOST_CHECK(GetTemplateTxids(*pincremental).count(hashChildTx));
+    BOOST_CHECK(GetTemplateTxids(*pincremental) == GetTemplateTxids(*pblocktemplate));
+
+    // Removed entries are dropped from the reused selection.
+    mempool.removeRecursive(tx);
+    pincremental = IncrementalAssemblerForTest(chainparams).CreateNewBlock(scriptPubKey,0);
+    BOOST_CHECK(!GetTemplateTxids(*pincremental).count(hashChildTx));
+    BOOST_CHECK_EQUAL(pincremental->block.vtx.size(), 9);
+
+    // The cached coinbase merkle branch gives the same root as hashing the whole block.
+    unsigned int nExtraNonce = 0;
+    for (int i = 0; i < 2; i++) {
+        IncrementExtraNonce(pincremental.get(), chainActive.Tip(), nExtraNonce);
+        BOOST_CHECK(pincremental->block.hashMerkleRoot == BlockMerkleRoot(pincremental->block));
+    }
+    CMutableTransaction txCoinbase(*pincremental->block.vtx[0]);
+    txCoinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    pincremental->block.vtx[0] = MakeTransactionRef(std::move(txCoinbase));
+    UpdateCoinbaseMerkleRoot(*pincremental);
+    BOOST_CHECK(pincremental->block.hashMerkleRoot == BlockMerkleRoot(pincremental->block));
 }
 
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
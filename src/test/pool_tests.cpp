@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <support/allocators/pool.h>
+#include <test/test_bitcoin.h>
+
+#include <stdint.h>
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_reuses_freed_blocks)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL((char*)b - (char*)a, 24);
+
+    // A freed block is handed out again for the same size only.
+    resource.Deallocate(a, 24, 8);
+    void* c = resource.Allocate(32, 8);
+    BOOST_CHECK(c != a);
+    void* d = resource.Allocate(20, 8);
+    BOOST_CHECK(d == a);
+
+    // Too large or too strictly aligned requests do not come from the pool.
+    void* e = resource.Allocate(128, 8);
+    void* f = resource.Allocate(8, 16);
+    resource.Deallocate(e, 128, 8);
+    resource.Deallocate(f, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    resource.Deallocate(b, 24, 8);
+    resource.Deallocate(c, 32, 8);
+    resource.Deallocate(d, 20, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_new_chunks)
+{
+    PoolResource<64, 8> resource(256);
+    for (int i = 0; i < 10; i++) {
+        resource.Allocate(64, 8);
+    }
+    // Four blocks of 64 bytes fit a chunk.
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 256U);
+
+    // The 128 bytes left in the last chunk are not lost to smaller blocks.
+    for (int i = 0; i < 4; i++) {
+        resource.Allocate(32, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_unordered_map)
+{
+    typedef std::pair<const uint64_t, uint64_t> Value;
+    typedef PoolAllocator<Value, sizeof(Value) + sizeof(void*) * 4> Allocator;
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, Allocator> Map;
+
+    Allocator::ResourceType resource;
+    Map map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), &resource);
+    for (uint64_t i = 0; i < 10000; i++) {
+        map[i] = i * 2;
+    }
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        map.erase(i);
+    }
+    BOOST_CHECK_EQUAL(map.size(), 5000U);
+    for (uint64_t i = 1; i < 10000; i += 2) {
+        BOOST_CHECK_EQUAL(map.at(i), i * 2);
+    }
+
+    // Erased nodes are reused, refilling the map needs no more chunks.
+    size_t chunks = resource.NumAllocatedChunks();
+    BOOST_CHECK(chunks > 0);
+    for (uint64_t i = 0; i < 10000; i += 2) {
+        map[i] = i;
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+    BOOST_CHECK(memusage::DynamicUsage(map) >= chunks * resource.ChunkSizeBytes());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,9 +4,18 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <crypto/algos/argon2/hashargon.h>
+#include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/common.h>
+#include <globaltoken/multihasher.h>
+#include <globaltoken/powalgorithm.h>
 #include <pow.h>
+#include <primitives/mining_block.h>
+#include <streams.h>
 #include <random.h>
 #include <util.h>
+#include <validation.h>
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
@@ -83,4 +92,459 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+/* The same-algo skip pointer must give the same answer as walking pprev, also around hardforks */
+BOOST_AUTO_TEST_CASE(GetPrevBlockIndexForAlgo_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const uint32_t nHardfork1Time = params.Hardfork1.GetActivationTime();
+    const uint32_t nHardfork2Time = params.Hardfork2.GetActivationTime();
+    std::vector<CBlockIndex> blocks(3000);
+    for (int i = 0; i < 3000; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        // Mostly a few popular algos, with rarely mined ones in between.
+        header.SetAlgo(InsecureRandRange(4) ? InsecureRandRange(3) : InsecureRandRange(NUM_ALGOS));
+        blocks[i].nVersion = header.nVersion;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        if (i < 1000)
+            blocks[i].nTime = nHardfork1Time - 1000 + i;
+        else if (i < 2000)
+            blocks[i].nTime = nHardfork2Time - 2000 + i;
+        else
+            blocks[i].nTime = nHardfork2Time + i;
+        // Timestamps are not strictly monotonic.
+        blocks[i].nTime -= InsecureRandRange(10);
+        blocks[i].BuildPrevAlgo();
+    }
+
+    for (int i = 0; i < 3000; i++) {
+        const CBlockIndex* pexpected = GetLastBlockIndexForAlgo(blocks[i].pprev, blocks[i].GetAlgo(), params);
+        BOOST_CHECK(GetPrevBlockIndexForAlgo(&blocks[i], params) == pexpected);
+    }
+
+    // Entries without a built skip pointer fall back to walking the chain.
+    CBlockIndex detached;
+    detached.nVersion = blocks[2999].nVersion;
+    detached.pprev = &blocks[2999];
+    detached.nHeight = 3000;
+    BOOST_CHECK(GetPrevBlockIndexForAlgo(&detached, params) == GetLastBlockIndexForAlgo(&blocks[2999], detached.GetAlgo(), params));
+}
+
+/* GetNextWorkRequiredV3 as it was written, walking pprev and dividing by base_uints */
+static unsigned int GetNextWorkRequiredV3Loop(const CBlockIndex* pindexLast, const Consensus::Params& params, const uint8_t algo)
+{
+    unsigned int npowWorkLimit = params.aPOWAlgos[algo].GetArithPowLimit().GetCompact();
+    const CBlockIndex* pindexFirst = pindexLast;
+    for (int i = 0; pindexFirst && i < NUM_ALGOS*params.nAveragingInterval; i++)
+        pindexFirst = pindexFirst->pprev;
+    const CBlockIndex* pindexPrevAlgo = GetLastBlockIndexForAlgo(pindexLast, algo, params);
+    if (pindexPrevAlgo == nullptr || pindexFirst == nullptr)
+        return npowWorkLimit;
+
+    int64_t nActualTimespan = pindexLast->GetMedianTimePast() - pindexFirst->GetMedianTimePast();
+    nActualTimespan = params.nAveragingTargetTimespanV2 + (nActualTimespan - params.nAveragingTargetTimespanV2)/4;
+    if (nActualTimespan < params.nMinActualTimespanV2)
+        nActualTimespan = params.nMinActualTimespanV2;
+    if (nActualTimespan > params.nMaxActualTimespanV2)
+        nActualTimespan = params.nMaxActualTimespanV2;
+
+    arith_uint256 bnNew;
+    bnNew.SetCompact(pindexPrevAlgo->nBits);
+    bnNew *= nActualTimespan;
+    bnNew /= params.nAveragingTargetTimespanV2;
+
+    int nAdjustments = pindexPrevAlgo->nHeight + NUM_ALGOS - 1 - pindexLast->nHeight;
+    for (int i = 0; i < nAdjustments; i++) {
+        bnNew *= 100;
+        bnNew /= (100 + params.nLocalTargetAdjustment);
+    }
+    for (int i = 0; i < -nAdjustments; i++) {
+        bnNew *= (100 + params.nLocalTargetAdjustment);
+        bnNew /= 100;
+    }
+
+    if (bnNew > params.aPOWAlgos[algo].GetArithPowLimit())
+        bnNew = params.aPOWAlgos[algo].GetArithPowLimit();
+    return bnNew.GetCompact();
+}
+
+/* The ancestor lookup and single pass divisions must not change any result, also for algos not mined for thousands of blocks */
+BOOST_AUTO_TEST_CASE(GetNextWorkRequiredV3_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const uint32_t nHardfork2Time = params.Hardfork2.GetActivationTime();
+    std::vector<CBlockIndex> blocks(3000);
+    std::vector<uint256> hashes(3000);
+    for (int i = 0; i < 3000; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        // A few popular algos, the others only mined near the start
+        const uint8_t algo = i < 100 || !InsecureRandRange(50) ? InsecureRandRange(NUM_ALGOS) : InsecureRandRange(3);
+        header.SetAlgo(algo);
+        blocks[i].nVersion = header.nVersion;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = nHardfork2Time + i * 60 + InsecureRandRange(600);
+        blocks[i].nBits = arith_uint256(params.aPOWAlgos[algo].GetArithPowLimit() >> InsecureRandRange(40)).GetCompact();
+        hashes[i] = InsecureRand256();
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].BuildSkip();
+    }
+
+    for (int n = 0; n < 10; n++) {
+        const CBlockIndex* pindexLast = &blocks[n ? InsecureRandRange(3000) : 2999];
+        CBlockHeader header;
+        header.nTime = pindexLast->nTime + 60;
+        for (uint8_t algo = 0; algo < NUM_ALGOS; algo++) {
+            const unsigned int nExpected = GetNextWorkRequiredV3Loop(pindexLast, params, algo);
+            BOOST_CHECK_EQUAL(GetNextWorkRequiredV3(pindexLast, &header, params, algo), nExpected);
+            // Computed for all algos with the first one, then from the per-tip cache
+            BOOST_CHECK_EQUAL(GetNextWorkRequired(pindexLast, &header, params, algo), nExpected);
+        }
+    }
+
+    // Extreme targets, which the easier steps make wrap around
+    arith_uint256 bn = ~arith_uint256();
+    for (int i = 0; i < 1000; i++) {
+        arith_uint256 bnExpected = bn * 104;
+        bnExpected /= 100;
+        bn *= 104;
+        bn.DivideByUint32(100);
+        BOOST_CHECK(bn == bnExpected);
+    }
+}
+
+/* The per-algo hashrate index must agree with walking the chain, also after a reorg */
+BOOST_AUTO_TEST_CASE(CAlgoHashrateIndex_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    const uint32_t nHardfork1Time = params.Hardfork1.GetActivationTime();
+    const uint32_t nHardfork2Time = params.Hardfork2.GetActivationTime();
+    std::vector<CBlockIndex> blocks(3000);
+    for (int i = 0; i < 3000; i++) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.SetAlgo(InsecureRandRange(4) ? InsecureRandRange(3) : InsecureRandRange(NUM_ALGOS));
+        blocks[i].nVersion = header.nVersion;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nBits = 0x1e000000 + InsecureRandRange(0x100000);
+        if (i < 1000)
+            blocks[i].nTime = nHardfork1Time - 1000 + 10 * i;
+        else if (i < 2000)
+            blocks[i].nTime = nHardfork2Time - 20000 + 10 * i;
+        else
+            blocks[i].nTime = nHardfork2Time + 10 * i;
+        blocks[i].nTime -= InsecureRandRange(30);
+        blocks[i].BuildPrevAlgo();
+    }
+
+    CChain chain;
+    CAlgoHashrateIndex index;
+    for (int nTip : {2999, 1500, 2999}) {
+        chain.SetTip(&blocks[nTip]);
+        index.SetTip(chain, params);
+        BOOST_CHECK(index.Tip() == &blocks[nTip]);
+
+        for (int n = 0; n < 200; n++) {
+            const CBlockIndex& block = blocks[InsecureRandRange(nTip + 1)];
+            const uint8_t algo = InsecureRandRange(4) ? InsecureRandRange(3) : InsecureRandRange(NUM_ALGOS);
+            const int lookup = InsecureRandRange(100);
+            BOOST_CHECK_EQUAL(index.GetRecent(&block, algo, lookup, params).GetHashrate(), CalculateAlgoHashrate(block, algo, lookup, params));
+        }
+
+        for (int n = 0; n < 50; n++) {
+            const uint8_t algo = InsecureRandRange(3);
+            const int nStart = InsecureRandRange(nTip + 1);
+            const int nEnd = nStart + InsecureRandRange(nTip + 1 - nStart);
+            const CBlockIndex* pfirst = nullptr;
+            const CBlockIndex* plast = nullptr;
+            int nBlocks = 0;
+            std::vector<const CBlockIndex*> vAlgoBlocks;
+            for (int i = nStart; i <= nEnd; i++) {
+                if (blocks[i].GetAlgo() == algo) {
+                    if (!pfirst)
+                        pfirst = &blocks[i];
+                    plast = &blocks[i];
+                    nBlocks++;
+                    vAlgoBlocks.push_back(&blocks[i]);
+                }
+            }
+            const CAlgoHashrateStats stats = index.GetHeightRange(algo, nStart, nEnd);
+            BOOST_CHECK_EQUAL(stats.nBlocks, nBlocks);
+            BOOST_CHECK(stats.pindexFirst == pfirst);
+            BOOST_CHECK(stats.pindexLast == plast);
+
+            const size_t nCount = InsecureRandRange(2 * nBlocks + 2);
+            if (vAlgoBlocks.size() > nCount)
+                vAlgoBlocks.erase(vAlgoBlocks.begin(), vAlgoBlocks.end() - nCount);
+            BOOST_CHECK(index.GetBlocks(algo, nStart, nEnd, nCount) == vAlgoBlocks);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CheckEquihashSolution_cache_test)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const std::string strPersonalize = GetEquihashBasedDefaultPersonalize(ALGO_EQUIHASH);
+    const unsigned int n = chainParams->GetEquihashAlgoN(ALGO_EQUIHASH);
+    const unsigned int k = chainParams->GetEquihashAlgoK(ALGO_EQUIHASH);
+
+    CEquihashBlockHeader header;
+    header.nVersion = 4;
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1577365200;
+    header.nBits = 0x200f0f0f;
+
+    // Find a valid solution with the small regtest parameters.
+    bool found = false;
+    while (!found) {
+        header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+        crypto_generichash_blake2b_state state;
+        EhInitialiseState(n, k, state, strPersonalize);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << CEquihashInput{header} << header.nNonce;
+        crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+        std::function<bool(std::vector<unsigned char>)> validBlock =
+                [&header](std::vector<unsigned char> soln) {
+            header.nSolution = soln;
+            return true;
+        };
+        found = EhBasicSolveUncancellable(n, k, state, validBlock);
+    }
+
+    // A cached solution stays valid, but only for the same personalization string.
+    BOOST_CHECK(CheckEquihashSolution(&header, *chainParams, ALGO_EQUIHASH, strPersonalize));
+    BOOST_CHECK(CheckEquihashSolution(&header, *chainParams, ALGO_EQUIHASH, strPersonalize));
+    BOOST_CHECK(!CheckEquihashSolution(&header, *chainParams, ALGO_EQUIHASH, "GLT_Test"));
+
+    // Changing the solution changes the header hash, so it is verified again.
+    header.nSolution[0] ^= 1;
+    BOOST_CHECK(!CheckEquihashSolution(&header, *chainParams, ALGO_EQUIHASH, strPersonalize));
+    BOOST_CHECK(!CheckEquihashSolution(&header, *chainParams, ALGO_EQUIHASH, strPersonalize));
+}
+
+BOOST_AUTO_TEST_CASE(equihash_index_hashes)
+{
+    const unsigned int params[][2] = {{96, 3}, {200, 9}, {144, 5}, {96, 5}, {48, 5}, {192, 7}};
+    const eh_index g[7] = {0, 1, 2, 0x1234, 0x7fffff, 5, 0x100000};
+    std::vector<unsigned char> header(140);
+    for (size_t i = 0; i < header.size(); ++i) header[i] = i * 7 + 1;
+
+    // The in-tree state, after the cached personalization, hashes the indices like libsodium.
+    for (const auto& nk : params) {
+        const size_t hLen = (512 / nk[0]) * nk[0] / 8;
+        for (int pass = 0; pass < 2; ++pass) {
+            eh_IndexHashState state;
+            EhInitialiseState(nk[0], nk[1], state, "ZcashPoW");
+            blake2b_update(&state, header.data(), header.size());
+            std::vector<unsigned char> hashes(7 * hLen);
+            GenerateHashes(state, g, 7, hashes.data(), hLen);
+
+            for (int i = 0; i < 7; ++i) {
+                crypto_generichash_blake2b_state sodium_state;
+                EhInitialiseState(nk[0], nk[1], sodium_state, "ZcashPoW");
+                crypto_generichash_blake2b_update(&sodium_state, header.data(), header.size());
+                unsigned char lei[4];
+                WriteLE32(lei, g[i]);
+                crypto_generichash_blake2b_update(&sodium_state, lei, sizeof(lei));
+                std::vector<unsigned char> expected(hLen);
+                crypto_generichash_blake2b_final(&sodium_state, expected.data(), hLen);
+                BOOST_CHECK(std::equal(expected.begin(), expected.end(), hashes.begin() + i * hLen));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(algo_descriptors)
+{
+    for (uint8_t nAlgo = 0; nAlgo < NUM_ALGOS_IMPL; nAlgo++) {
+        // The version bits and the name of every algo lead back to it.
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.SetAlgo(nAlgo);
+        BOOST_CHECK_EQUAL(header.GetAlgo(), nAlgo);
+
+        bool fAlgoFound = false;
+        BOOST_CHECK_EQUAL(GetAlgoByName(GetAlgoName(nAlgo), ALGO_SHA256D, fAlgoFound), nAlgo);
+        BOOST_CHECK(fAlgoFound);
+        BOOST_CHECK_EQUAL(IsEquihashBasedAlgo(nAlgo), GetAlgoDescriptor(nAlgo).pszEquihashPersonalize != nullptr);
+    }
+    BOOST_CHECK_EQUAL(GetAlgoName(NUM_ALGOS_IMPL), "unknown");
+    BOOST_CHECK(!IsAlgoAllowedBeforeHF2(ALGO_LYRA2REV3));
+    BOOST_CHECK(IsAlgoAllowedBeforeHF2(ALGO_X16R));
+}
+
+BOOST_AUTO_TEST_CASE(lyra2_scratch_reuse)
+{
+    // The Lyra2 algos share the memory matrix of the thread, with 4x4 and 8x8
+    // matrices. Hashing them in turn must give what each gives on its own.
+    unsigned char header[80];
+    for (int i = 0; i < 80; i++)
+        header[i] = i * 7 + 3;
+    const std::vector<std::pair<uint8_t, std::string>> vExpected = {
+        {ALGO_LYRA2REV2, "6c29f1f0f9cb45d148f2b1ac56f58a1952d0b02f69bdd37606eba5b9a621f266"},
+        {ALGO_LYRA2Z, "003a482fd7328b86abe7695f892866259fdf6ef9b8d091c419db3cd062589921"},
+        {ALGO_LYRA2REV3, "5eac5576ce23770d2843f677b3b6c8c4322554381f06b8549f9c42771f4941f7"},
+        {ALGO_ALLIUM, "983a4de310a416d626b64ae73702198dfbdaa08e7618056279b1e2f0ae6183fc"},
+    };
+    for (int nRound = 0; nRound < 2; nRound++) {
+        for (const auto& expected : vExpected) {
+            CMultihasher hasher(SER_GETHASH, PROTOCOL_VERSION, expected.first);
+            hasher.write((const char*)header, sizeof(header));
+            BOOST_CHECK_EQUAL(hasher.GetHash().ToString(), expected.second);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(nonce_hasher)
+{
+    // With a midstate or without, the hash is the one of the whole header.
+    std::vector<unsigned char> vHeader(80);
+    for (int i = 0; i < 80; i++)
+        vHeader[i] = i * 7 + 3;
+    for (uint8_t nAlgo : {ALGO_SKEIN, ALGO_SKUNKHASH, ALGO_PHI1612, ALGO_TRIBUS, ALGO_QUBIT, ALGO_X11, ALGO_SCRYPT}) {
+        CNonceHasher nonceHasher(nAlgo, vHeader, PROTOCOL_VERSION);
+        for (uint32_t nNonce : {0u, 1u, 0xdeadbeefu}) {
+            std::vector<unsigned char> vNonceHeader = vHeader;
+            WriteLE32(vNonceHeader.data() + 76, nNonce);
+            CMultihasher hasher(SER_GETHASH, PROTOCOL_VERSION, nAlgo);
+            hasher.write((const char*)vNonceHeader.data(), vNonceHeader.size());
+            BOOST_CHECK(nonceHasher.GetHash(nNonce) == hasher.GetHash());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hashing_stats)
+{
+    // Every PoW hash is counted under the purpose of the innermost scope.
+    std::vector<unsigned char> vHeader(80, 0x5a);
+    CMultihasher hasher(SER_GETHASH, PROTOCOL_VERSION, ALGO_SCRYPT);
+    hasher.write((const char*)vHeader.data(), vHeader.size());
+
+#ifdef HAVE_THREAD_LOCAL
+    const CHashingStats rpcBefore = GetHashingStats(ALGO_SCRYPT, HashPurpose::RPC);
+    const CHashingStats miningBefore = GetHashingStats(ALGO_SCRYPT, HashPurpose::MINING);
+#endif
+    {
+        CHashPurposeScope outer(HashPurpose::RPC);
+        hasher.GetHash();
+        {
+            CHashPurposeScope inner(HashPurpose::MINING);
+            // Enough hashes that at least one of them is timed
+            CNonceHasher nonceHasher(ALGO_SCRYPT, vHeader, PROTOCOL_VERSION);
+            for (uint32_t nNonce = 0; nNonce < HASH_TIMING_SAMPLE_INTERVAL; nNonce++)
+                nonceHasher.GetHash(nNonce);
+        }
+        hasher.GetHash();
+    }
+#ifdef HAVE_THREAD_LOCAL
+    BOOST_CHECK_EQUAL(GetHashingStats(ALGO_SCRYPT, HashPurpose::RPC).nHashes - rpcBefore.nHashes, 2U);
+    BOOST_CHECK_EQUAL(GetHashingStats(ALGO_SCRYPT, HashPurpose::MINING).nHashes - miningBefore.nHashes, HASH_TIMING_SAMPLE_INTERVAL);
+    BOOST_CHECK(GetHashingStats(ALGO_SCRYPT, HashPurpose::MINING).nNanos > miningBefore.nNanos);
+#endif
+    BOOST_CHECK(GetHashPurpose() == HashPurpose::OTHER);
+}
+
+BOOST_AUTO_TEST_CASE(argon2_parallel_lanes)
+{
+    // Filling the lanes on the lane pool gives the hashes of filling them one after the other
+    std::vector<unsigned char> vHeader(80);
+    for (int i = 0; i < 80; i++)
+        vHeader[i] = i * 7 + 3;
+    for (uint8_t nAlgo : {ALGO_ARGON2D, ALGO_ARGON2I}) {
+        CMultihasher hasher(SER_GETHASH, PROTOCOL_VERSION, nAlgo);
+        hasher.write((const char*)vHeader.data(), vHeader.size());
+        const uint256 hash = hasher.GetHash();
+
+        SetArgon2LaneThreads(2);
+        {
+            CArgon2ParallelScope scope(true);
+            for (int i = 0; i < 3; i++)
+                BOOST_CHECK(hasher.GetHash() == hash);
+        }
+        SetArgon2LaneThreads(1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(neoscrypt_engines)
+{
+    // Every engine built in gives the hashes of the portable one, whichever neoscrypt() uses
+    unsigned char input[80], expected[32], output[32];
+    for (int i = 0; i < 80; i++)
+        input[i] = i;
+    neoscrypt(input, output, 0x0);
+    BOOST_CHECK_EQUAL(HexStr(output, output + 32), "7258961afb33fd12d00cacb8d63f4f4f52bb6917043865dd24a08f578853122d");
+
+    const char* name;
+    for (unsigned int i = 0; neoscrypt_engine_t hash = neoscrypt_get_engine(i, &name); i++) {
+        for (uint32_t nNonce = 0; nNonce < 8; nNonce++) {
+            WriteLE32(input + 76, nNonce);
+            neoscrypt_generic(input, expected, 0x0);
+            hash(input, output, 0x0);
+            BOOST_CHECK_MESSAGE(memcmp(output, expected, 32) == 0, name);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cached_pow_hash)
+{
+    CBlockHeader header;
+    header.SetAlgo(ALGO_SCRYPT);
+    header.nTime = 1500000000;
+    header.nBits = 0x207fffff;
+    const int nHashVersion = LoadMultiHasherVersionFlags(true);
+
+    // Hashed once and then found, the same as computing it.
+    BOOST_CHECK(GetCachedPoWHash(header, ALGO_SCRYPT, nHashVersion) == header.GetPoWHash(ALGO_SCRYPT, SER_GETHASH, nHashVersion));
+    BOOST_CHECK(GetCachedPoWHash(header, ALGO_SCRYPT, nHashVersion) == header.GetPoWHash(ALGO_SCRYPT, SER_GETHASH, nHashVersion));
+
+    // Another algo or a changed header is not mistaken for the cached one.
+    BOOST_CHECK(GetCachedPoWHash(header, ALGO_X11, nHashVersion) == header.GetPoWHash(ALGO_X11, SER_GETHASH, nHashVersion));
+    header.nNonce++;
+    BOOST_CHECK(GetCachedPoWHash(header, ALGO_SCRYPT, nHashVersion) == header.GetPoWHash(ALGO_SCRYPT, SER_GETHASH, nHashVersion));
+}
+
+BOOST_AUTO_TEST_CASE(pow_hash_batch)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    const int nHashVersion = LoadMultiHasherVersionFlags(true);
+
+    // Headers of mixed algos, more X11 ones than a multiple of the batch size.
+    std::vector<CBlockHeader> headers;
+    for (uint8_t nAlgo : {ALGO_X11, ALGO_SCRYPT, ALGO_X11, ALGO_X11, ALGO_SHA256D, ALGO_X11, ALGO_X11, ALGO_X11}) {
+        CBlockHeader header;
+        header.SetAlgo(nAlgo);
+        header.nTime = 1600000000;
+        header.nBits = 0x207fffff;
+        header.nNonce = headers.size() * 0x1234567;
+        headers.push_back(header);
+    }
+
+    std::vector<const CPureBlockHeader*> vpx11;
+    for (const CBlockHeader& header : headers) {
+        if (header.GetAlgo() == ALGO_X11)
+            vpx11.push_back(&header);
+    }
+    PrecomputePoWHashes(vpx11, ALGO_X11, nHashVersion);
+    for (const CPureBlockHeader* pheader : vpx11)
+        BOOST_CHECK(GetCachedPoWHash(*pheader, ALGO_X11, nHashVersion) == pheader->GetPoWHash(ALGO_X11, SER_GETHASH, nHashVersion));
+
+    // The batch finds the headers valid that CheckProofOfWork finds valid.
+    std::vector<const CBlockHeader*> vpheaders;
+    for (CBlockHeader& header : headers) {
+        header.nNonce ^= 0xffff;
+        vpheaders.push_back(&header);
+    }
+    std::vector<char> fPoWValid;
+    CheckProofOfWorkBatch(vpheaders, params, fPoWValid);
+    BOOST_CHECK_EQUAL(fPoWValid.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+        BOOST_CHECK_EQUAL((bool)fPoWValid[i], CheckProofOfWork(headers[i], params));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
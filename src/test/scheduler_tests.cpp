@@ -112,4 +112,57 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(priorities)
+{
+    CScheduler scheduler;
+    std::vector<std::string> vOrder;
+    const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule([&] { vOrder.push_back("low"); }, now - boost::chrono::seconds(2), CScheduler::PRIORITY_LOW, "low");
+    scheduler.schedule([&] { vOrder.push_back("normal"); }, now - boost::chrono::seconds(1), CScheduler::PRIORITY_NORMAL, "normal");
+    scheduler.schedule([&] { vOrder.push_back("high"); }, now, CScheduler::PRIORITY_HIGH, "high");
+    scheduler.schedule([&] { vOrder.push_back("later"); }, now + boost::chrono::milliseconds(50), CScheduler::PRIORITY_HIGH, "high");
+
+    // Of the due tasks, the ones of higher priority run first, whenever they were due.
+    boost::thread thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    thread.join();
+    BOOST_CHECK((vOrder == std::vector<std::string>{"high", "normal", "low", "later"}));
+
+    std::vector<CScheduler::TaskStats> vStats = scheduler.getTaskStats();
+    BOOST_REQUIRE_EQUAL(vStats.size(), 3U);
+    BOOST_CHECK_EQUAL(vStats[0].strName, "high");
+    BOOST_CHECK_EQUAL(vStats[0].priority, CScheduler::PRIORITY_HIGH);
+    BOOST_CHECK_EQUAL(vStats[0].nRuns, 2U);
+    BOOST_CHECK_EQUAL(vStats[1].strName, "low");
+    BOOST_CHECK_EQUAL(vStats[1].nRuns, 1U);
+    // The low priority task was due two seconds before it ran
+    BOOST_CHECK(vStats[1].nMaxLagMicros >= 2000000);
+    BOOST_CHECK_EQUAL(vStats[2].strName, "normal");
+}
+
+BOOST_AUTO_TEST_CASE(low_priority_leaves_a_thread)
+{
+    // Two low priority tasks that wait for a high priority one never take
+    // both threads, or they would only return after the timeout.
+    CScheduler scheduler;
+    std::atomic<bool> fHighRan(false);
+    std::atomic<int> nLowTimedOut(0);
+    auto lowTask = [&] {
+        for (int i = 0; i < 1000 && !fHighRan; i++) MicroSleep(10000);
+        if (!fHighRan) nLowTimedOut++;
+    };
+    const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule(lowTask, now, CScheduler::PRIORITY_LOW);
+    scheduler.schedule(lowTask, now, CScheduler::PRIORITY_LOW);
+    scheduler.schedule([&] { fHighRan = true; }, now + boost::chrono::milliseconds(100), CScheduler::PRIORITY_HIGH);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+    BOOST_CHECK(fHighRan);
+    BOOST_CHECK_EQUAL(nLowTimedOut, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -242,6 +242,47 @@ BOOST_AUTO_TEST_CASE(compactsize)
     }
 }
 
+template <typename T>
+static void CheckRawVector(const std::vector<T>& v)
+{
+    // The elements one by one, as the vector was serialized before
+    CDataStream ssElements(SER_DISK, 0);
+    WriteCompactSize(ssElements, v.size());
+    for (const T& elem : v)
+        ssElements << elem;
+
+    CDataStream ss(SER_DISK, 0);
+    ss << v;
+    BOOST_CHECK(ss.str() == ssElements.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(v, SER_DISK, 0), ss.size());
+
+    std::vector<T> vRead;
+    ss >> vRead;
+    BOOST_CHECK(vRead == v);
+    BOOST_CHECK(ss.empty());
+}
+
+BOOST_AUTO_TEST_CASE(raw_vectors)
+{
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 100; i++)
+        vHashes.push_back(InsecureRand256());
+    CheckRawVector(vHashes);
+    CheckRawVector(std::vector<uint256>());
+
+    std::vector<uint16_t> v16;
+    std::vector<int32_t> v32;
+    std::vector<uint64_t> v64;
+    for (int i = 0; i < 1000; i++) {
+        v16.push_back(InsecureRand32());
+        v32.push_back(InsecureRand32());
+        v64.push_back(InsecureRandBits(64));
+    }
+    CheckRawVector(v16);
+    CheckRawVector(v32);
+    CheckRawVector(v64);
+}
+
 static bool isCanonicalException(const std::ios_base::failure& ex)
 {
     std::ios_base::failure expectedException("non-canonical ReadCompactSize()");
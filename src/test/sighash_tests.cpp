@@ -208,4 +208,37 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+// Goal: check that the legacy sighash cache of PrecomputedTransactionData gives the same hashes
+BOOST_AUTO_TEST_CASE(sighash_legacy_cache)
+{
+    SeedInsecureRand(false);
+
+    for (int i = 0; i < 500; i++) {
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, false);
+        // More inputs than RandomTransaction makes, some of them with a witness
+        while (txTo.vin.size() < LEGACY_SIGHASH_CACHE_MIN_INPUTS + InsecureRandBits(3)) {
+            CTxIn txin(COutPoint(InsecureRand256(), InsecureRandBits(2)));
+            RandomScript(txin.scriptSig);
+            txin.nSequence = InsecureRandBool() ? InsecureRand32() : CTxIn::SEQUENCE_FINAL;
+            if (InsecureRandBits(3) == 0)
+                txin.scriptWitness.stack.push_back({1});
+            txTo.vin.push_back(txin);
+        }
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK_EQUAL(txdata.vLegacyPrefix.empty(), std::count_if(tx.vin.begin(), tx.vin.end(), [](const CTxIn& txin) {
+            return txin.scriptWitness.IsNull();
+        }) < (int)LEGACY_SIGHASH_CACHE_MIN_INPUTS);
+
+        for (int nHashType : {(int)SIGHASH_ALL, (int)InsecureRand32()}) {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) ==
+                            SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE));
+            }
+        }
+    }
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -71,6 +71,27 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    const unsigned char bytes[] = {1, 2, 0, 3, 0, 0, 0, 4, 5};
+    CSpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, bytes, sizeof(bytes));
+    unsigned char a;
+    uint16_t b;
+    uint32_t c;
+    reader >> a >> b >> c;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 2);
+    BOOST_CHECK_EQUAL(c, 3);
+    BOOST_CHECK_EQUAL(reader.size(), 2U);
+
+    // Reading past the end throws and leaves the rest to read.
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+    reader.ignore(1);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 5);
+    BOOST_CHECK(reader.empty());
+}
+
 BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
 {
     std::vector<char> in;
@@ -5,12 +5,21 @@
 #include <test/test_bitcoin.h>
 
 #include <chainparams.h>
+#include <coinsreadview.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <crypto/algos/equihash/equihash.h>
+#include <crypto/algos/hashlib/sph_echo.h>
+#include <crypto/algos/neoscrypt/neoscrypt.h>
+#include <crypto/algos/yescrypt/yescrypt.h>
+#include <crypto/algos/yespower/yespower.h>
+#include <crypto/hash4way.h>
 #include <crypto/sha256.h>
 #include <validation.h>
+#include <messagesigner.h>
 #include <miner.h>
 #include <net_processing.h>
+#include <pow.h>
 #include <ui_interface.h>
 #include <streams.h>
 #include <rpc/server.h>
@@ -18,6 +27,7 @@
 #include <script/sigcache.h>
 
 #include <memory>
+#include <mutex>
 
 void CConnmanTest::AddNode(CNode& node)
 {
@@ -43,12 +53,20 @@ extern void noui_connect();
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
         SHA256AutoDetect();
+        sph_echo_autodetect();
+        Hash4WayAutoDetect();
+        EhIndexHashAutoDetect();
+        // These time the builds against each other, once is enough for all the tests
+        static std::once_flag builds_timed;
+        std::call_once(builds_timed, [] { yescrypt_autodetect(); yespower_autodetect(); neoscrypt_autodetect(); });
         RandomInit();
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
         InitSignatureCache();
         InitScriptExecutionCache();
+        InitEquihashSolutionCache();
+        InitMessageSignatureCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
@@ -107,6 +125,7 @@ TestingSetup::~TestingSetup()
         g_connman.reset();
         peerLogic.reset();
         UnloadBlockIndex();
+        ResetCoinsReadView();
         pcoinsTip.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
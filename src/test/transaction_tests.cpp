@@ -493,6 +493,118 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_parallel_signing)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKeyPubKey(key, key.GetPubKey());
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction mtx;
+    uint256 prevId;
+    prevId.SetHex("0000000000000000000000000000000000000000000000000000000000000100");
+    for (uint32_t i = 0; i < 64; i++) {
+        mtx.vin.emplace_back(COutPoint(prevId, i));
+    }
+    mtx.vout.emplace_back(1000, CScript() << OP_1);
+
+    // The signatures made on several threads against the unsigned transaction are the ones made one by one.
+    CMutableTransaction serial = mtx;
+    for (uint32_t i = 0; i < serial.vin.size(); i++) {
+        BOOST_CHECK(SignSignature(keystore, scriptPubKey, serial, i, 1000, SIGHASH_ALL));
+    }
+
+    const CTransaction txConst(mtx);
+    std::vector<SignatureData> vSigData(mtx.vin.size());
+    std::vector<char> vSigned(mtx.vin.size(), false);
+    ForEachInputInParallel(mtx.vin.size(), [&](unsigned int i) {
+        vSigned[i] = ProduceSignature(TransactionSignatureCreator(&keystore, &txConst, i, 1000, SIGHASH_ALL), scriptPubKey, vSigData[i]);
+    });
+    for (uint32_t i = 0; i < mtx.vin.size(); i++) {
+        BOOST_CHECK(vSigned[i]);
+        UpdateTransaction(mtx, i, vSigData[i]);
+    }
+    BOOST_CHECK(CTransaction(mtx).GetHash() == CTransaction(serial).GetHash());
+
+    // Every input is visited once, and an exception of any of them is passed on.
+    std::vector<int> vVisited(100, 0);
+    ForEachInputInParallel(vVisited.size(), [&](unsigned int i) { vVisited[i]++; });
+    BOOST_CHECK(std::all_of(vVisited.begin(), vVisited.end(), [](int n) { return n == 1; }));
+    BOOST_CHECK_THROW(ForEachInputInParallel(100, [](unsigned int i) { if (i == 57) throw std::runtime_error("input 57"); }), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_signed_input_size)
+{
+    CBasicKeyStore keystore;
+    CKey key, keyUncompressed;
+    key.MakeNewKey(true);
+    keyUncompressed.MakeNewKey(false);
+    keystore.AddKey(key);
+    keystore.AddKey(keyUncompressed);
+
+    std::vector<CPubKey> pubkeys;
+    for (int i = 0; i < 3; i++) {
+        CKey keyMultisig;
+        keyMultisig.MakeNewKey(true);
+        keystore.AddKey(keyMultisig);
+        pubkeys.push_back(keyMultisig.GetPubKey());
+    }
+    const CScript scriptMultisig = GetScriptForMultisig(2, pubkeys);
+    const CScript scriptWitnessKeyHash = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+    uint256 hashMultisig;
+    CSHA256().Write(scriptMultisig.data(), scriptMultisig.size()).Finalize(hashMultisig.begin());
+    const CScript scriptWitnessScriptHash = GetScriptForDestination(WitnessV0ScriptHash(hashMultisig));
+    keystore.AddCScript(scriptMultisig);
+    keystore.AddCScript(scriptWitnessKeyHash);
+    keystore.AddCScript(scriptWitnessScriptHash);
+
+    const std::vector<CScript> vScripts = {
+        GetScriptForRawPubKey(key.GetPubKey()),
+        GetScriptForDestination(key.GetPubKey().GetID()),
+        GetScriptForDestination(keyUncompressed.GetPubKey().GetID()),
+        scriptWitnessKeyHash,
+        GetScriptForDestination(CScriptID(scriptWitnessKeyHash)),
+        GetScriptForDestination(CScriptID(scriptMultisig)),
+        scriptWitnessScriptHash,
+        GetScriptForDestination(CScriptID(scriptWitnessScriptHash)),
+    };
+
+    // The sizes make up the weight of the transaction dummy signed, whatever the mix of inputs.
+    for (int i = 0; i < 50; i++) {
+        CMutableTransaction mtx;
+        mtx.vout.emplace_back(1000, CScript() << OP_1);
+        CMutableTransaction mtxSigned = mtx;
+        int64_t nBaseBytes = 0;
+        int64_t nWitnessBytes = 0;
+        bool fWitness = false;
+        const int nInputs = 1 + InsecureRandRange(i < 40 ? 8 : 300);
+        for (int j = 0; j < nInputs; j++) {
+            const CScript& scriptPubKey = vScripts[InsecureRandRange(vScripts.size())];
+            mtx.vin.emplace_back(COutPoint(InsecureRand256(), j));
+            mtxSigned.vin.emplace_back(mtx.vin.back());
+            SignatureData sigdata;
+            BOOST_CHECK(ProduceSignature(DummySignatureCreator(&keystore), scriptPubKey, sigdata));
+            UpdateTransaction(mtxSigned, j, sigdata);
+
+            SignedInputSize size;
+            BOOST_CHECK(EstimateSignedInputSize(keystore, scriptPubKey, size));
+            nBaseBytes += size.nScriptSigBytes - 1;
+            nWitnessBytes += size.nWitnessBytes ? size.nWitnessBytes : 1;
+            fWitness |= size.nWitnessBytes != 0;
+        }
+        nBaseBytes += ::GetSerializeSize(mtx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        BOOST_CHECK_EQUAL(nBaseBytes * WITNESS_SCALE_FACTOR + (fWitness ? 2 + nWitnessBytes : 0), GetTransactionWeight(mtxSigned));
+    }
+
+    // Scripts the keystore cannot solve cannot be sized.
+    CKey keyUnknown;
+    keyUnknown.MakeNewKey(true);
+    SignedInputSize size;
+    BOOST_CHECK(!EstimateSignedInputSize(keystore, GetScriptForDestination(keyUnknown.GetPubKey().GetID()), size));
+    BOOST_CHECK(!EstimateSignedInputSize(keystore, GetScriptForDestination(WitnessV0KeyHash(keyUncompressed.GetPubKey().GetID())), size));
+}
+
 BOOST_AUTO_TEST_CASE(test_witness)
 {
     CBasicKeyStore keystore, keystore2;
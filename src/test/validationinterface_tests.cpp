@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <scheduler.h>
+#include <uint256.h>
+#include <utiltime.h>
+#include <validationinterface.h>
+
+#include <test/test_bitcoin.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, BasicTestingSetup)
+
+/** Counts Inventory callbacks, each of them waits for release first if set */
+class TestListener : public CValidationInterface
+{
+public:
+    std::atomic<int> nCalls{0};
+    std::shared_future<void> release;
+
+protected:
+    void Inventory(const uint256& hash) override
+    {
+        if (release.valid()) release.wait();
+        ++nCalls;
+    }
+};
+
+static const CMainSignals::QueueInfo* FindQueue(const std::vector<CMainSignals::QueueInfo>& vInfo, const std::string& strName)
+{
+    for (const CMainSignals::QueueInfo& info : vInfo) {
+        if (info.strName == strName) return &info;
+    }
+    return nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(slow_listener)
+{
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    std::promise<void> release;
+    TestListener slow, fast;
+    slow.release = release.get_future().share();
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    const int nEvents = MAX_VALIDATION_QUEUE_DEPTH + 10;
+    for (int i = 0; i < nEvents; i++)
+        GetMainSignals().Inventory(uint256());
+
+    // The fast listener gets all its callbacks while the slow one is stuck on its first
+    for (int i = 0; i < 10000 && fast.nCalls < nEvents; i++)
+        MilliSleep(1);
+    BOOST_CHECK_EQUAL(fast.nCalls, nEvents);
+    BOOST_CHECK_EQUAL(slow.nCalls, 0);
+
+    std::vector<CMainSignals::QueueInfo> vInfo = GetMainSignals().GetQueueInfo();
+    BOOST_REQUIRE_EQUAL(vInfo.size(), 2U);
+    const CMainSignals::QueueInfo* pslow = FindQueue(vInfo, "slow");
+    const CMainSignals::QueueInfo* pfast = FindQueue(vInfo, "fast");
+    BOOST_REQUIRE(pslow && pfast);
+    BOOST_CHECK(pslow->nQueued > MAX_VALIDATION_QUEUE_DEPTH);
+    BOOST_CHECK(pslow->nMaxQueued >= pslow->nQueued);
+    BOOST_CHECK_EQUAL(pfast->nQueued, 0U);
+
+    // Block connection would wait for the slow listener to catch up
+    std::future<void> limited = std::async(std::launch::async, LimitValidationInterfaceQueue);
+    BOOST_CHECK(limited.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout);
+    release.set_value();
+    limited.wait();
+    BOOST_CHECK_EQUAL(slow.nCalls, nEvents);
+
+    // Callbacks still queued for an unregistered listener are skipped
+    std::promise<void> release2;
+    slow.release = release2.get_future().share();
+    for (int i = 0; i < 5; i++)
+        GetMainSignals().Inventory(uint256());
+    UnregisterValidationInterface(&slow);
+    release2.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(slow.nCalls <= nEvents + 1);
+    BOOST_CHECK_EQUAL(fast.nCalls, nEvents + 5);
+
+    UnregisterAllValidationInterfaces();
+    scheduler.stop(true);
+    threads.join_all();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
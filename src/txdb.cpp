@@ -7,6 +7,7 @@
 
 #include <chainparams.h>
 #include <globaltoken/hardfork.h>
+#include <globaltoken/multihasher.h>
 #include <hash.h>
 #include <random.h>
 #include <pow.h>
@@ -17,6 +18,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <memory>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -24,6 +29,9 @@ static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_COINSTATS = 'u';
+static const char DB_COINSTATS_STATE = 'm';
+static const char DB_SNAPSHOT_BASE = 's';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
@@ -57,15 +65,57 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const std::string& strName) : db(GetDataDir() / strName, nCacheSize, fMemory, fWipe, true, DBProfile::CHAINSTATE) 
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB()
 {
+    WaitForBackgroundWrite();
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        LOCK(cs_background);
+        if (pbackgroundBatch) {
+            CCoinsMap::const_iterator it = pbackgroundBatch->mapCoins.find(outpoint);
+            if (it != pbackgroundBatch->mapCoins.end()) {
+                if (it->second.coin.IsSpent())
+                    return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin, const CDBSnapshot &snapshot) const {
+    return db.Read(CoinEntry(&outpoint), coin, snapshot);
+}
+
+std::unique_ptr<CDBSnapshot> CCoinsViewDB::GetSnapshot(std::vector<std::pair<COutPoint, Coin> >& vCoins) const {
+    // The background writer only releases its batch once all of it is on disk.
+    LOCK(cs_background);
+    std::unique_ptr<CDBSnapshot> psnapshot(new CDBSnapshot(db));
+    if (pbackgroundBatch) {
+        for (const auto& entry : pbackgroundBatch->mapCoins) {
+            if (entry.second.flags & CCoinsCacheEntry::DIRTY)
+                vCoins.emplace_back(entry.first, entry.second.coin);
+        }
+    }
+    return psnapshot;
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(cs_background);
+        if (pbackgroundBatch) {
+            CCoinsMap::const_iterator it = pbackgroundBatch->mapCoins.find(outpoint);
+            if (it != pbackgroundBatch->mapCoins.end())
+                return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
@@ -85,6 +135,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    WaitForBackgroundWrite();
+    if (fBackgroundWriteFailed)
+        return false;
+
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -97,7 +151,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
-            assert(old_heads[0] == hashBlock);
+            assert(old_heads[0] == hashBlock || old_heads[0] == hashPartialTip);
             old_tip = old_heads[1];
         }
     }
@@ -142,9 +196,88 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    if (ret)
+        hashPartialTip.SetNull();
     return ret;
 }
 
+void CCoinsViewDB::BatchWriteInBackground(std::unique_ptr<CCoinsWriteBatch> pbatch, const uint256 &hashBlock) {
+    assert(!hashBlock.IsNull());
+    WaitForBackgroundWrite();
+    assert(!IsWritingInBackground());
+
+    // Replaying has to start from the last consistent state, which earlier
+    // background writes since then left in the head blocks.
+    uint256 old_tip = GetBestBlock();
+    if (old_tip.IsNull()) {
+        std::vector<uint256> old_heads = GetHeadBlocks();
+        if (old_heads.size() == 2) {
+            assert(old_heads[0] == hashBlock || old_heads[0] == hashPartialTip);
+            old_tip = old_heads[1];
+        }
+    }
+
+    {
+        LOCK(cs_background);
+        pbackgroundBatch = std::move(pbatch);
+    }
+    hashPartialTip = hashBlock;
+    backgroundWriter = std::thread(&CCoinsViewDB::WriteBackgroundBatch, this, hashBlock, old_tip);
+}
+
+void CCoinsViewDB::WriteBackgroundBatch(const uint256 &hashBlock, const uint256 &old_tip) {
+    RenameThread("globaltoken-coinsflush");
+    bool ret = false;
+    size_t changed = 0;
+    try {
+        CDBBatch batch(db);
+        size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+
+        // Never cleared again by this write: only a full BatchWrite makes the
+        // database consistent with a single block.
+        batch.Erase(DB_BEST_BLOCK);
+        batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+
+        // Nothing else changes the batch until it is released below.
+        for (const auto& entry : pbackgroundBatch->mapCoins) {
+            if (!(entry.second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            CoinEntry key(&entry.first);
+            if (entry.second.coin.IsSpent())
+                batch.Erase(key);
+            else
+                batch.Write(key, entry.second.coin);
+            changed++;
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+            }
+        }
+        ret = db.WriteBatch(batch);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs to coin database in the background\n", (unsigned int)changed);
+    LOCK(cs_background);
+    if (ret) {
+        pbackgroundBatch.reset();
+    } else {
+        // Keep serving the coins, the next BatchWrite fails and the node shuts down.
+        fBackgroundWriteFailed = true;
+    }
+}
+
+void CCoinsViewDB::WaitForBackgroundWrite() {
+    if (backgroundWriter.joinable())
+        backgroundWriter.join();
+}
+
+bool CCoinsViewDB::IsWritingInBackground() const {
+    LOCK(cs_background);
+    return pbackgroundBatch != nullptr;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -157,6 +290,10 @@ bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
 }
 
+bool CBlockTreeDB::ReadBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex) {
+    return Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex);
+}
+
 bool CBlockTreeDB::WriteReindexing(bool fReindexing) {
     if (fReindexing)
         return Write(DB_REINDEX_FLAG, '1');
@@ -239,17 +376,62 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+bool CBlockTreeDB::ReadLegacyTxIndex(const uint256 &txidFrom, size_t nMax, std::vector<std::pair<uint256, CDiskTxPos> > &vect) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    std::pair<char, uint256> key;
+    vect.clear();
+    for (pcursor->Seek(std::make_pair(DB_TXINDEX, txidFrom)); pcursor->Valid() && vect.size() < nMax; pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_TXINDEX)
+            break;
+        CDiskTxPos pos;
+        if (!pcursor->GetValue(pos))
+            return error("%s: failed to read transaction index entry", __func__);
+        vect.push_back(std::make_pair(key.second, pos));
+    }
+    return true;
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CBlockTreeDB::EraseLegacyTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    for (const auto& entry : vect)
+        batch.Erase(std::make_pair(DB_TXINDEX, entry.first));
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteCoinStats(const uint256 &hash, const CCoinStatsEntry &entry, const std::vector<unsigned char> &state) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_COINSTATS, hash), entry);
+    batch.Write(std::make_pair(DB_COINSTATS_STATE, hash), state);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadCoinStats(const uint256 &hash, CCoinStatsEntry &entry) {
+    return Read(std::make_pair(DB_COINSTATS, hash), entry);
+}
+
+bool CBlockTreeDB::ReadCoinStatsState(const uint256 &hash, std::vector<unsigned char> &state) {
+    return Read(std::make_pair(DB_COINSTATS_STATE, hash), state);
+}
+
+bool CBlockTreeDB::EraseCoinStatsStates(const std::vector<uint256> &hashes) {
+    CDBBatch batch(*this);
+    for (const uint256& hash : hashes)
+        batch.Erase(std::make_pair(DB_COINSTATS_STATE, hash));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteSnapshotBase(const CSnapshotBase &snapshot) {
+    return Write(DB_SNAPSHOT_BASE, snapshot, true);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(CSnapshotBase &snapshot) {
+    return Read(DB_SNAPSHOT_BASE, snapshot);
+}
+
+bool CBlockTreeDB::EraseSnapshotBase() {
+    return Erase(DB_SNAPSHOT_BASE, true);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -262,72 +444,151 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+/** A block index entry read by a LoadBlockIndexGuts worker, waiting to be linked into the block index */
+struct LoadedBlockIndex
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    uint256 hash;
+    CDiskBlockIndex diskindex;
+    //! Whether the PoW got verified by this load, so the entry has to be written back with BLOCK_POW_VERIFIED
+    bool fNewlyVerified;
+};
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
-    
-    vAuxpowValidation.reserve(445724); // the estimated amount of auxpow blocks between hardfork 1 and hardfork 2
+/**
+ * Read and PoW check the block index entries whose hash starts with a byte in
+ * [nBeginByte, nEndByte). This only touches the DB and its own results, so
+ * several ranges can be loaded at once.
+ */
+bool LoadBlockIndexRange(CDBWrapper& db, const Consensus::Params& consensusParams, CheckPoWOnLoad checkPoWOnLoad,
+                         unsigned int nBeginByte, unsigned int nEndByte, std::vector<LoadedBlockIndex>& vLoaded)
+{
+    CHashPurposeScope hashPurpose(HashPurpose::STARTUP_LOAD);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    uint256 hashBegin;
+    *hashBegin.begin() = nBeginByte;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashBegin));
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return false;
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashReserved   = diskindex.hashReserved;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nBigNonce      = diskindex.nBigNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                
-                CPureBlockVersion versionverify = pindexNew->nVersion;
-
-                // We may not have enough data, to validate auxpow, if the block header was saved, but not the full block.
-                // Skip validation here and let it continue syncing this Block.
-                // The block will be verified anyways, so skip the validation this time for this block.
-                if(versionverify.IsAuxpow())
-                {
-                    if(pindexNew->GetBlockPos().nFile != -1)
-                    {
-                        LogPrint(BCLog::POW, "%s: Adding auxpow block to verify que. Blockhash=%s - Height=%d\n", __func__, pindexNew->GetBlockHash().GetHex(), pindexNew->nHeight);
-                        vAuxpowValidation.push_back(pindexNew->GetBlockHash());
-                    }
-                    pcursor->Next();
-                    continue;
-                }
-				
-                bool equihashvalidator;
-                bool checkresult = CheckProofOfWork(pindexNew->GetBlockHeader(consensusParams), consensusParams, equihashvalidator);
-                
-                if (IsEquihashBasedAlgo(pindexNew->GetAlgo()) && !equihashvalidator) {
-                    return error("%s: %s solution invalid at: %s", __func__, GetAlgoName(pindexNew->GetAlgo()), pindexNew->ToString());
-                }
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEndByte)
+            break;
 
-                if (!checkresult)
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+        vLoaded.emplace_back();
+        LoadedBlockIndex& loaded = vLoaded.back();
+        CDiskBlockIndex& diskindex = loaded.diskindex;
+        if (!pcursor->GetValue(diskindex))
+            return error("%s: failed to read value", __func__);
+        loaded.hash = diskindex.GetBlockHash();
+        loaded.fNewlyVerified = false;
+        pcursor->Next();
+
+        // We may not have enough data, to validate auxpow, if the block header was saved, but not the full block.
+        // Skip validation here and let it continue syncing this Block.
+        // The block will be verified anyways, so skip the validation this time for this block.
+        CPureBlockVersion versionverify = diskindex.nVersion;
+        if (!versionverify.IsAuxpow() &&
+            !(checkPoWOnLoad == CheckPoWOnLoad::NONE ||
+              (checkPoWOnLoad == CheckPoWOnLoad::UNVERIFIED && (diskindex.nStatus & BLOCK_POW_VERIFIED)))) {
+            bool equihashvalidator;
+            bool checkresult = CheckProofOfWork(diskindex.GetStoredBlockHeader(), consensusParams, equihashvalidator);
+
+            if (IsEquihashBasedAlgo(diskindex.GetAlgo()) && !equihashvalidator) {
+                return error("%s: %s solution invalid at: %s", __func__, GetAlgoName(diskindex.GetAlgo()), diskindex.ToString());
+            }
+
+            if (!checkresult)
+                return error("%s: CheckProofOfWork failed: %s", __func__, diskindex.ToString());
 
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+            if (!(diskindex.nStatus & BLOCK_POW_VERIFIED)) {
+                diskindex.nStatus |= BLOCK_POW_VERIFIED;
+                loaded.fNewlyVerified = true;
             }
-        } else {
-            break;
         }
+
+        // The solution is only needed again to write the entry back, don't hold it for every block.
+        if (!loaded.fNewlyVerified)
+            std::vector<unsigned char>().swap(diskindex.nSolution);
+    }
+
+    return true;
+}
+
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, CheckPoWOnLoad checkPoWOnLoad)
+{
+    // Deserializing the entries and checking their PoW is most of the work, split
+    // it over the key space by the first byte of the block hash.
+    const unsigned int nRanges = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<LoadedBlockIndex> > vRanges(nRanges);
+    std::unique_ptr<bool[]> fRangeLoaded(new bool[nRanges]);
+    {
+        std::vector<std::thread> vThreads;
+        vThreads.reserve(nRanges);
+        for (unsigned int i = 0; i < nRanges; i++) {
+            vThreads.emplace_back([&, i]() {
+                fRangeLoaded[i] = LoadBlockIndexRange(*this, consensusParams, checkPoWOnLoad, i * 256 / nRanges, (i + 1) * 256 / nRanges, vRanges[i]);
+            });
+        }
+        for (std::thread& thread : vThreads) {
+            thread.join();
+        }
+    }
+    boost::this_thread::interruption_point();
+    for (unsigned int i = 0; i < nRanges; i++) {
+        if (!fRangeLoaded[i])
+            return false;
+    }
+
+    vAuxpowValidation.reserve(445724); // the estimated amount of auxpow blocks between hardfork 1 and hardfork 2
+
+    // Load mapBlockIndex, linking every entry to its parent
+    CDBBatch batch(*this);
+    size_t nVerified = 0;
+    for (std::vector<LoadedBlockIndex>& vLoaded : vRanges) {
+        for (const LoadedBlockIndex& loaded : vLoaded) {
+            const CDiskBlockIndex& diskindex = loaded.diskindex;
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(loaded.hash);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            CPureBlockVersion versionverify = pindexNew->nVersion;
+            if (versionverify.IsAuxpow() && pindexNew->GetBlockPos().nFile != -1)
+            {
+                LogPrint(BCLog::POW, "%s: Adding auxpow block to verify que. Blockhash=%s - Height=%d\n", __func__, pindexNew->GetBlockHash().GetHex(), pindexNew->nHeight);
+                vAuxpowValidation.push_back(pindexNew->GetBlockHash());
+            }
+
+            // Headers verified during this load get their BLOCK_POW_VERIFIED flag written back.
+            if (loaded.fNewlyVerified) {
+                batch.Write(std::make_pair(DB_BLOCK_INDEX, loaded.hash), diskindex);
+                nVerified++;
+            }
+        }
+        std::vector<LoadedBlockIndex>().swap(vLoaded);
+        boost::this_thread::interruption_point();
+    }
+
+    if (nVerified > 0) {
+        LogPrint(BCLog::POW, "%s: Marking %u block headers as pow verified\n", __func__, nVerified);
+        if (!WriteBatch(batch))
+            return error("%s: failed to write pow verified flags", __func__);
     }
 
     return true;
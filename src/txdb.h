@@ -10,8 +10,12 @@
 #include <dbwrapper.h>
 #include <chain.h>
 
+#include <sync.h>
+
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -29,14 +33,22 @@ static const int64_t nDefaultDbBatchSize = 16 << 20;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to the transaction index database, if -txindex (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the block filter index database, if -blockfilterindex (MiB)
+static const int64_t nMaxBlockFilterIndexCache = 16;
+//! Max memory allocated to the address index database, if -addressindex, -spentindex or -timestampindex (MiB)
+static const int64_t nMaxAddressIndexCache = 64;
+//! Max number of threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
+//! -dbpartialflush default
+static const bool DEFAULT_DB_PARTIAL_FLUSH = true;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -63,13 +75,91 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Totals of the UTXO set as of a block, kept by -coinstatsindex */
+struct CCoinStatsEntry
+{
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    //! MuHash3072 of the serialized unspent outputs
+    uint256 hashMuHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(nTotalAmount);
+        READWRITE(hashMuHash);
+    }
+
+    CCoinStatsEntry() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nTransactionOutputs = 0;
+        nBogoSize = 0;
+        nTotalAmount = 0;
+        hashMuHash.SetNull();
+    }
+};
+
+/** The chainstate snapshot the coins database was loaded from with loadtxoutset */
+struct CSnapshotBase
+{
+    uint256 hashBlock;
+    //! nChainTx of the base block, which cannot be counted without its history
+    uint64_t nChainTx;
+    //! The totals and MuHash the history must arrive at
+    CCoinStatsEntry stats;
+    //! False while the coins are being loaded, true once the chainstate is at the base
+    bool fLoaded;
+    //! Whether the history up to the base was validated and arrived at stats
+    bool fValidated;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(nChainTx);
+        READWRITE(stats);
+        READWRITE(fLoaded);
+        READWRITE(fValidated);
+    }
+
+    CSnapshotBase() : nChainTx(0), fLoaded(false), fValidated(false) {}
+};
+
+/** Coins handed to CCoinsViewDB::BatchWriteInBackground, together with the memory their map is allocated from */
+struct CCoinsWriteBatch
+{
+    CCoinsMapMemoryResource resource;
+    CCoinsMap mapCoins{0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource};
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+private:
+    mutable CCriticalSection cs_background;
+    //! Coins being written by backgroundWriter, served to readers until they are on disk
+    std::unique_ptr<CCoinsWriteBatch> pbackgroundBatch;
+    bool fBackgroundWriteFailed = false;
+    std::thread backgroundWriter;
+    //! Tip the last background write was made at, null once a full BatchWrite made the database consistent again
+    uint256 hashPartialTip;
+
+    void WriteBackgroundBatch(const uint256& hashBlock, const uint256& old_tip);
+    void WaitForBackgroundWrite();
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /** The coins database in the directory strName of the data directory */
+    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const std::string& strName = "chainstate");
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -78,6 +168,27 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Start writing the dirty entries of pbatch to the database on a separate
+     * thread, as part of the transition to hashBlock. Until the next BatchWrite
+     * the database stays marked as in the middle of that transition, so a crash
+     * in between is recovered by ReplayBlocks. Must not be called while a
+     * background write is still running.
+     */
+    void BatchWriteInBackground(std::unique_ptr<CCoinsWriteBatch> pbatch, const uint256& hashBlock);
+    //! Whether a background write is still running (or failed, which the next BatchWrite reports)
+    bool IsWritingInBackground() const;
+    //! Whether background writes left the database in between two best blocks
+    bool IsPartiallyWritten() const { return !hashPartialTip.IsNull(); }
+
+    /**
+     * Take a snapshot of the coins on disk. The coins a background write has
+     * not finished writing yet are added to vCoins, to be applied on top of it.
+     */
+    std::unique_ptr<CDBSnapshot> GetSnapshot(std::vector<std::pair<COutPoint, Coin> >& vCoins) const;
+    //! GetCoin as of a snapshot taken by GetSnapshot
+    bool GetCoin(const COutPoint &outpoint, Coin &coin, const CDBSnapshot &snapshot) const;
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -105,6 +216,13 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Modes for -checkpowonload */
+enum class CheckPoWOnLoad {
+    NONE,       //!< trust the stored headers
+    UNVERIFIED, //!< only check headers not yet marked BLOCK_POW_VERIFIED
+    FULL,       //!< check every non-auxpow header
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -117,13 +235,23 @@ public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
     bool ReadLastBlockFile(int &nFile);
+    bool ReadBlockIndex(const uint256 &hash, CDiskBlockIndex &diskindex);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    //! Read up to nMax entries of the transaction index kept here before it moved to indexes/txindex, from txidFrom on
+    bool ReadLegacyTxIndex(const uint256 &txidFrom, size_t nMax, std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    bool EraseLegacyTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
+    //! Write the coin stats index entry of a block, and the MuHash state needed to continue from it
+    bool WriteCoinStats(const uint256 &hash, const CCoinStatsEntry &entry, const std::vector<unsigned char> &state);
+    bool ReadCoinStats(const uint256 &hash, CCoinStatsEntry &entry);
+    bool ReadCoinStatsState(const uint256 &hash, std::vector<unsigned char> &state);
+    bool EraseCoinStatsStates(const std::vector<uint256> &hashes);
+    bool WriteSnapshotBase(const CSnapshotBase &snapshot);
+    bool ReadSnapshotBase(CSnapshotBase &snapshot);
+    bool EraseSnapshotBase();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, CheckPoWOnLoad checkPoWOnLoad);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,167 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+static const char DB_TXINDEX = 't';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Blocks ThreadSync indexes between writes of the block it got to
+static const int SYNC_LOCATOR_INTERVAL = 1000;
+//! Entries of the block tree database moved at a time
+static const size_t MIGRATE_BATCH_ENTRIES = 100000;
+
+std::unique_ptr<CTxIndex> ptxindex;
+
+static const CBlockIndex* GetActiveTip()
+{
+    LOCK(cs_main);
+    return chainActive.Tip();
+}
+
+CTxIndex::CTxIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+    : db(GetDataDir() / "indexes" / "txindex", nCacheSize, fMemory, fWipe, false, DBProfile::INDEX),
+      pindexLegacyTip(GetActiveTip())
+{
+}
+
+bool CTxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    CDBBatch batch(db);
+    for (const CTransactionRef& tx : block.vtx) {
+        batch.Write(std::make_pair(DB_TXINDEX, tx->GetHash()), pos);
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    if (!db.WriteBatch(batch))
+        return false;
+    nBestHeight = pindex->nHeight;
+    return true;
+}
+
+bool CTxIndex::WriteBestBlock(const CBlockLocator& locator)
+{
+    return db.Write(DB_BEST_BLOCK, locator);
+}
+
+void CTxIndex::SetBestChain(const CBlockLocator& locator)
+{
+    if (fSynced)
+        WriteBestBlock(locator);
+}
+
+bool CTxIndex::MigrateLegacyIndex()
+{
+    // The entries reach the tip the node was started with, indexing continues from there.
+    CBlockLocator locator;
+    if (!db.Read(DB_BEST_BLOCK, locator) && pindexLegacyTip) {
+        LOCK(cs_main);
+        if (!WriteBestBlock(chainActive.GetLocator(pindexLegacyTip)))
+            return false;
+    }
+
+    LogPrintf("%s: moving the transaction index out of the block tree database\n", __func__);
+    uint256 txidFrom;
+    std::vector<std::pair<uint256, CDiskTxPos>> vect;
+    size_t nMoved = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        if (!pblocktree->ReadLegacyTxIndex(txidFrom, MIGRATE_BATCH_ENTRIES, vect))
+            return false;
+        if (vect.empty())
+            break;
+
+        // Written here before they are erased there, an interruption in between moves them again.
+        CDBBatch batch(db);
+        for (const auto& entry : vect)
+            batch.Write(std::make_pair(DB_TXINDEX, entry.first), entry.second);
+        if (!db.WriteBatch(batch) || !pblocktree->EraseLegacyTxIndex(vect))
+            return false;
+        txidFrom = vect.back().first;
+        nMoved += vect.size();
+        LogPrintf("%s: moved %u transaction index entries\n", __func__, nMoved);
+    }
+    return pblocktree->WriteFlag("txindex", false);
+}
+
+void CTxIndex::ThreadSync()
+{
+    RenameThread("globaltoken-txindex");
+
+    bool fLegacy = false;
+    if (pblocktree->ReadFlag("txindex", fLegacy) && fLegacy && !MigrateLegacyIndex()) {
+        LogPrintf("%s: failed to move the transaction index out of the block tree database\n", __func__);
+        return;
+    }
+
+    const CBlockIndex* pindex = nullptr;
+    {
+        CBlockLocator locator;
+        db.Read(DB_BEST_BLOCK, locator);
+        LOCK(cs_main);
+        pindex = FindForkInGlobalIndex(chainActive, locator);
+        if (locator.IsNull())
+            pindex = nullptr;
+    }
+    nBestHeight = pindex ? pindex->nHeight : -1;
+
+    int nIndexed = 0;
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            const CBlockIndex* pindexNext;
+            bool fHaveData;
+            {
+                LOCK(cs_main);
+                // Continue from where the active chain left what was indexed, after a reorg too.
+                if (pindex && !chainActive.Contains(pindex))
+                    pindex = chainActive.FindFork(pindex);
+                pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+                if (!pindexNext) {
+                    // Under cs_main, so ConnectBlock writes every block connected after this one.
+                    fSynced = true;
+                    if (pindex)
+                        WriteBestBlock(chainActive.GetLocator(pindex));
+                    LogPrintf("%s: transaction index is synced at height %d\n", __func__, pindex ? pindex->nHeight : -1);
+                    return;
+                }
+                fHaveData = pindexNext->nStatus & BLOCK_HAVE_DATA;
+            }
+
+            CBlock block;
+            if (!fHaveData || !ReadBlockFromDisk(block, pindexNext, Params().GetConsensus()) || !WriteBlock(block, pindexNext)) {
+                LogPrintf("%s: failed to index block %s, the transaction index stops before it\n", __func__, pindexNext->GetBlockHash().ToString());
+                return;
+            }
+            pindex = pindexNext;
+
+            if (++nIndexed % SYNC_LOCATOR_INTERVAL == 0) {
+                LOCK(cs_main);
+                WriteBestBlock(chainActive.GetLocator(pindex));
+                LogPrintf("%s: transaction index at height %d\n", __func__, pindex->nHeight);
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (pindex) {
+            LOCK(cs_main);
+            WriteBestBlock(chainActive.GetLocator(pindex));
+        }
+        throw;
+    }
+}
+
+bool CTxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    return db.Read(std::make_pair(DB_TXINDEX, txid), pos);
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include <dbwrapper.h>
+#include <txdb.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <atomic>
+#include <memory>
+
+class CBlock;
+class CBlockIndex;
+
+/**
+ * Where the transactions of the blocks of the active chain are on disk
+ * (-txindex), in a database of its own under indexes/txindex. ThreadSync
+ * indexes the blocks the node already has in the background, so the index
+ * can be turned on without a reindex. Once it reached the tip, ConnectBlock
+ * writes the transactions of every block it connects, so lookups see them
+ * as soon as the block is connected. Like before, entries are not removed
+ * when their block is disconnected, callers check the block they are in.
+ */
+class CTxIndex final : public CValidationInterface
+{
+private:
+    CDBWrapper db;
+    //! The tip when the index was opened, the entries an older version kept in the block tree database reach it
+    const CBlockIndex* const pindexLegacyTip;
+    //! Whether ThreadSync reached the tip, ConnectBlock writes the blocks from then on
+    std::atomic<bool> fSynced{false};
+    //! Height of the last block indexed, -1 before the genesis block
+    std::atomic<int> nBestHeight{-1};
+
+    bool WriteBestBlock(const CBlockLocator& locator);
+    //! Move the entries of the block tree database into this one
+    bool MigrateLegacyIndex();
+
+protected:
+    void SetBestChain(const CBlockLocator& locator) override;
+
+public:
+    CTxIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /** Index the blocks from the last one synced up to the tip, run on a thread of its own */
+    void ThreadSync();
+
+    bool IsSynced() const { return fSynced; }
+    int GetBestHeight() const { return nBestHeight; }
+
+    /** Add the transactions of a block */
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+    /** Where a transaction is, false if it is not in any block indexed */
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+};
+
+/** The transaction index, if -txindex is enabled */
+extern std::unique_ptr<CTxIndex> ptxindex;
+
+#endif // BITCOIN_TXINDEX_H
@@ -9,7 +9,6 @@
 #include <consensus/consensus.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
-#include <instantx.h>
 #include <validation.h>
 #include <policy/policy.h>
 #include <policy/fees.h>
@@ -34,6 +33,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nModFeesWithDescendants = nFee;
 
     feeDelta = 0;
+    nEpoch = 0;
 
     nCountWithAncestors = 1;
     nSizeWithAncestors = GetTxSize();
@@ -63,13 +63,17 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const uint64_t epoch = NewEpoch();
+    vecEntries stageEntries, vAllDescendants;
+    for (const txiter childEntry : GetMemPoolChildren(updateIt)) {
+        Visited(childEntry, epoch);
+        stageEntries.push_back(childEntry);
+    }
 
     while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
+        const txiter cit = stageEntries.back();
+        stageEntries.pop_back();
+        vAllDescendants.push_back(cit);
         const setEntries &setChildren = GetMemPoolChildren(cit);
         for (const txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
@@ -77,29 +81,33 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (const txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!Visited(cacheEntry, epoch))
+                        vAllDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!Visited(childEntry, epoch)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    vecEntries vCached;
+    for (txiter cit : vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            vCached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
+    if (!vCached.empty())
+        cachedDescendants[updateIt] = std::move(vCached);
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
 }
 
@@ -155,7 +163,14 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 {
     LOCK(cs);
 
-    setEntries parentHashes;
+    // Entries already in setAncestors are not walked again, like the ones
+    // staged in parentHashes.
+    const uint64_t epoch = NewEpoch();
+    for (const txiter ancestorIt : setAncestors) {
+        Visited(ancestorIt, epoch);
+    }
+
+    vecEntries parentHashes;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -164,8 +179,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             txiter piter = mapTx.find(tx.vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+            if (piter != mapTx.end() && !Visited(piter, epoch)) {
+                parentHashes.push_back(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -176,16 +191,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const txiter piter : GetMemPoolParents(it)) {
+            if (!Visited(piter, epoch))
+                parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -202,8 +220,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!Visited(phash, epoch)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -256,7 +274,6 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
 {
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
@@ -265,42 +282,65 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
+            const uint64_t epoch = NewEpoch();
+            const setEntries &setChildren = GetMemPoolChildren(removeIt);
+            vecEntries stage(setChildren.begin(), setChildren.end());
+            for (txiter childIt : stage) {
+                Visited(childIt, epoch);
+            }
+            while (!stage.empty()) {
+                txiter dit = stage.back();
+                stage.pop_back();
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                for (txiter childIt : GetMemPoolChildren(dit)) {
+                    if (!Visited(childIt, epoch))
+                        stage.push_back(childIt);
+                }
             }
         }
     }
     for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
-        // However, if we happen to be in the middle of processing a reorg, then
-        // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of 
-        // ancestors whose packages include this transaction, because when we
-        // add a new transaction to the mempool in addUnchecked(), we assume it
-        // has no children, and in the case of a reorg where that assumption is
-        // false, the in-mempool children aren't linked to the in-block tx's
-        // until UpdateTransactionsFromBlock() is called.
+        // Walk the ancestors reachable via mapLinks rather than by searching
+        // the inputs. If the mempool is in a consistent state both are the
+        // same. However, if we happen to be in the middle of processing a
+        // reorg, then the mempool can be in an inconsistent state.  In this
+        // case, the set of ancestors reachable via mapLinks will be the same
+        // as the set of ancestors whose packages include this transaction,
+        // because when we add a new transaction to the mempool in
+        // addUnchecked(), we assume it has no children, and in the case of a
+        // reorg where that assumption is false, the in-mempool children aren't
+        // linked to the in-block tx's until UpdateTransactionsFromBlock() is
+        // called.
         // So if we're being called during a reorg, ie before
         // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
         // differ from the set of mempool parents we'd calculate by searching,
         // and it's important that we use the mapLinks[] notion of ancestor
         // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        const int64_t modifySize = -((int64_t)removeIt->GetTxSize());
+        const CAmount modifyFee = -removeIt->GetModifiedFee();
+        const uint64_t epoch = NewEpoch();
+        const setEntries &setParents = GetMemPoolParents(removeIt);
+        vecEntries stage(setParents.begin(), setParents.end());
+        for (txiter parentIt : stage) {
+            Visited(parentIt, epoch);
+        }
+        while (!stage.empty()) {
+            txiter ait = stage.back();
+            stage.pop_back();
+            mapTx.modify(ait, update_descendant_state(modifySize, modifyFee, -1));
+            for (txiter parentIt : GetMemPoolParents(ait)) {
+                if (!Visited(parentIt, epoch))
+                    stage.push_back(parentIt);
+            }
+        }
+        // Sever the child links that point to removeIt in the entries for
+        // the parents of removeIt.
+        for (txiter parentIt : setParents) {
+            UpdateChild(parentIt, removeIt, false);
+        }
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update setMemPoolParents
@@ -331,7 +371,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator), nEpoch(0), nSequence(1)
 {
     _clear(); //lock free clear
 
@@ -341,6 +381,12 @@ CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
     nCheckFrequency = 0;
 }
 
+uint64_t CTxMemPool::NewEpoch() const
+{
+    AssertLockHeld(cs);
+    return ++nEpoch;
+}
+
 bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
@@ -359,13 +405,17 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
-    NotifyEntryAdded(entry.GetSharedTx());
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
+    NotifyEntryAdded(entry.GetSharedTx(), nSequence++);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
     mapLinks.insert(make_pair(newit, TxLinks()));
 
@@ -414,13 +464,14 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+    txidIndex.Insert(GetInfo(newit));
 
     return true;
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
-    NotifyEntryRemoved(it->GetSharedTx(), reason);
+    NotifyEntryRemoved(it->GetSharedTx(), reason, reason == MemPoolRemovalReason::BLOCK ? nSequence - 1 : nSequence++);
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
@@ -438,6 +489,8 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
+    setInstantSendLocked.erase(it);
+    txidIndex.Erase(hash);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -451,22 +504,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
+    const uint64_t epoch = NewEpoch();
+    vecEntries stage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        Visited(entryit, epoch);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!Visited(childiter, epoch) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -593,6 +648,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    setInstantSendLocked.clear();
+    txidIndex.Clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -798,8 +855,22 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
     }
 }
 
-static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
+void CTxMemPool::SortByDepthAndScore(std::vector<uint256>& vHashes) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(vHashes.size());
+    for (const uint256& hash : vHashes) {
+        indexed_transaction_set::const_iterator it = mapTx.find(hash);
+        if (it != mapTx.end())
+            iters.push_back(it);
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    vHashes.clear();
+    for (auto it : iters) {
+        vHashes.push_back(it->GetTx().GetHash());
+    }
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
@@ -818,20 +889,12 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
 
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
-    LOCK(cs);
-    indexed_transaction_set::const_iterator i = mapTx.find(hash);
-    if (i == mapTx.end())
-        return nullptr;
-    return i->GetSharedTx();
+    return txidIndex.Get(hash).tx;
 }
 
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
-    LOCK(cs);
-    indexed_transaction_set::const_iterator i = mapTx.find(hash);
-    if (i == mapTx.end())
-        return TxMempoolInfo();
-    return GetInfo(i);
+    return txidIndex.Get(hash);
 }
 
 void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeDelta)
@@ -843,6 +906,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
+            txidIndex.Insert(GetInfo(it));
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -880,6 +944,14 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
     mapDeltas.erase(hash);
 }
 
+void CTxMemPool::SetInstantSendLocked(const uint256& hash)
+{
+    LOCK(cs);
+    txiter it = mapTx.find(hash);
+    if (it != mapTx.end())
+        setInstantSendLocked.insert(it);
+}
+
 bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 {
     for (unsigned int i = 0; i < tx.vin.size(); i++)
@@ -909,7 +981,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + txidIndex.DynamicMemoryUsage() + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -926,7 +998,7 @@ int CTxMemPool::Expire(int64_t time) {
     setEntries toremove;
     while (it != mapTx.get<entry_time>().end() && it->GetTime() < time) {
         // locked txes do not expire until mined and have sufficient confirmations
-        if (instantsend.IsLockedInstantSendTransaction(it->GetTx().GetHash())) {
+        if (setInstantSendLocked.count(mapTx.project<0>(it))) {
             it++;
             continue;
         }
@@ -1024,8 +1096,21 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
+    // Packages that would take an InstantSend locked transaction with them
+    setEntries setSkipped;
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        while (it != mapTx.get<descendant_score>().end() && setSkipped.count(mapTx.project<0>(it)))
+            ++it;
+        if (it == mapTx.get<descendant_score>().end())
+            break;
+
+        setEntries stage;
+        CalculateDescendants(mapTx.project<0>(it), stage);
+        if (std::any_of(stage.begin(), stage.end(), [this](txiter entry) { return setInstantSendLocked.count(entry); })) {
+            setSkipped.insert(mapTx.project<0>(it));
+            continue;
+        }
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
@@ -1036,8 +1121,6 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1070,3 +1153,52 @@ bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLi
 }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+void CTxMemPoolTxidIndex::Insert(const TxMempoolInfo& info)
+{
+    Shard& shard = GetShard(info.tx->GetHash());
+    LOCK(shard.cs);
+    shard.map[info.tx->GetHash()] = info;
+}
+
+void CTxMemPoolTxidIndex::Erase(const uint256& hash)
+{
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    shard.map.erase(hash);
+}
+
+void CTxMemPoolTxidIndex::Clear()
+{
+    for (Shard& shard : shards) {
+        LOCK(shard.cs);
+        shard.map.clear();
+    }
+}
+
+bool CTxMemPoolTxidIndex::Exists(const uint256& hash) const
+{
+    const Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    return shard.map.count(hash);
+}
+
+TxMempoolInfo CTxMemPoolTxidIndex::Get(const uint256& hash) const
+{
+    const Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    auto it = shard.map.find(hash);
+    if (it == shard.map.end())
+        return TxMempoolInfo();
+    return it->second;
+}
+
+size_t CTxMemPoolTxidIndex::DynamicMemoryUsage() const
+{
+    size_t usage = 0;
+    for (const Shard& shard : shards) {
+        LOCK(shard.cs);
+        usage += memusage::DynamicUsage(shard.map);
+    }
+    return usage;
+}
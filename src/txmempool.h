@@ -9,6 +9,7 @@
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -128,6 +129,7 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t nEpoch; //!< Last CTxMemPool graph traversal that visited this entry
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -365,6 +367,41 @@ public:
     }
 };
 
+/**
+ * Txid index of the mempool for lookups that only need the TxMempoolInfo of
+ * a transaction. It is split into shards with a lock of their own. CTxMemPool
+ * updates it while holding its cs, and reads go without cs, so they see the
+ * mempool as of some point in time between two updates.
+ */
+class CTxMemPoolTxidIndex
+{
+private:
+    static const size_t NUM_SHARDS = 16;
+
+    struct Shard {
+        mutable CCriticalSection cs;
+        std::unordered_map<uint256, TxMempoolInfo, SaltedTxidHasher> map;
+    };
+    Shard shards[NUM_SHARDS];
+    //! Picks the shard, salted separately from the maps of the shards
+    SaltedTxidHasher hasher;
+
+    Shard& GetShard(const uint256& hash) { return shards[hasher(hash) % NUM_SHARDS]; }
+    const Shard& GetShard(const uint256& hash) const { return shards[hasher(hash) % NUM_SHARDS]; }
+
+public:
+    /** Add or replace the info of a transaction */
+    void Insert(const TxMempoolInfo& info);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    bool Exists(const uint256& hash) const;
+    /** The info of a transaction, with a null tx if it is not in the mempool */
+    TxMempoolInfo Get(const uint256& hash) const;
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -443,6 +480,8 @@ private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
     CBlockPolicyEstimator* minerPolicyEstimator;
+    mutable uint64_t nEpoch; //!< Number of the latest graph traversal, see NewEpoch()
+    uint64_t nSequence; //!< Mempool sequence number the next added transaction or non-block removal gets
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
@@ -495,11 +534,12 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    typedef std::vector<txiter> vecEntries;
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, vecEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
@@ -509,9 +549,28 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    //! Entries whose transaction is locked by InstantSend, mined first and never evicted
+    setEntries setInstantSendLocked;
+
+    //! Serves exists(), get() and info() without cs
+    CTxMemPoolTxidIndex txidIndex;
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Start a walk of the mempool graph. Entries are marked as visited with
+     *  the returned number instead of being collected in a set, so a walk
+     *  must not be started while another one is still going on. Requires cs. */
+    uint64_t NewEpoch() const;
+    /** Mark an entry as visited by the walk of nEpochIn, returning whether it already was. */
+    static bool Visited(txiter it, uint64_t nEpochIn)
+    {
+        if (it->nEpoch == nEpochIn)
+            return true;
+        it->nEpoch = nEpochIn;
+        return false;
+    }
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
 public:
@@ -550,6 +609,8 @@ public:
     void _clear(); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
     void queryHashes(std::vector<uint256>& vtxid);
+    /** Sort the hashes in the order of CompareDepthAndScore, dropping the ones not in the mempool */
+    void SortByDepthAndScore(std::vector<uint256>& vHashes) const;
     bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -564,6 +625,12 @@ public:
     void ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
 
+    /** Record that the transaction is locked by InstantSend, if it is in the mempool */
+    void SetInstantSendLocked(const uint256& hash);
+    bool IsInstantSendLocked(txiter it) const { AssertLockHeld(cs); return setInstantSendLocked.count(it); }
+    /** The InstantSend locked entries. Requires cs. */
+    const setEntries& GetInstantSendLocked() const { AssertLockHeld(cs); return setInstantSendLocked; }
+
 public:
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
@@ -634,20 +701,33 @@ public:
         return totalTxSize;
     }
 
+    /** Does not need cs, see CTxMemPoolTxidIndex */
     bool exists(uint256 hash) const
     {
-        LOCK(cs);
-        return (mapTx.count(hash) != 0);
+        return txidIndex.Exists(hash);
     }
 
+    /** Do not need cs, see CTxMemPoolTxidIndex */
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
     size_t DynamicMemoryUsage() const;
 
-    boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
-    boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    /** The mempool sequence number the next change will get, all changes up to it are reflected in the mempool */
+    uint64_t GetSequence() const
+    {
+        LOCK(cs);
+        return nSequence;
+    }
+
+    /**
+     * Called with cs held. Every addition and every removal other than for a
+     * block gets the next mempool sequence number, a removal for a block
+     * gets the number of the last change before it.
+     */
+    boost::signals2::signal<void (CTransactionRef, uint64_t nMempoolSequence)> NotifyEntryAdded;
+    boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason, uint64_t nMempoolSequence)> NotifyEntryRemoved;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -14,6 +14,8 @@
 
 class CWallet;
 class CBlockIndex;
+class CMasternode;
+class COutPoint;
 
 /** General change type (added, updated, removed). */
 enum ChangeType
@@ -89,6 +91,9 @@ public:
     /** Number of masternodes changed. */
     boost::signals2::signal<void (int newNumMasternodes)> NotifyStrMasternodeCountChanged;
 
+    /** A masternode was added, updated or removed (then pmn is null), see CMasternodeMan::NotifyMasternodeChanges. */
+    boost::signals2::signal<void (const COutPoint& outpoint, const CMasternode* pmn, ChangeType status)> NotifyMasternodeChanged;
+
     /**
      * Status bar alerts changed.
      */
@@ -11,6 +11,13 @@
 #include <primitives/transaction.h>
 #include <serialize.h>
 
+/**
+ * Stream version flag for the compact undo encoding (-compactundo), which
+ * leaves out the dummy version of the spent outputs. Block index entries
+ * whose undo data is written this way have BLOCK_UNDO_COMPACT set.
+ */
+static const int SERIALIZE_UNDO_COMPACT = 0x20000000;
+
 /** Undo information for a CTxIn
  *
  *  Contains the prevout's CTxOut being spent, and its metadata as well
@@ -26,7 +33,7 @@ public:
     template<typename Stream>
     void Serialize(Stream &s) const {
         ::Serialize(s, VARINT(txout->nHeight * 2 + (txout->fCoinBase ? 1 : 0)));
-        if (txout->nHeight > 0) {
+        if (txout->nHeight > 0 && !(s.GetVersion() & SERIALIZE_UNDO_COMPACT)) {
             // Required to maintain compatibility with older undo format.
             ::Serialize(s, (unsigned char)0);
         }
@@ -47,7 +54,7 @@ public:
         ::Unserialize(s, VARINT(nCode));
         txout->nHeight = nCode / 2;
         txout->fCoinBase = nCode & 1;
-        if (txout->nHeight > 0) {
+        if (txout->nHeight > 0 && !(s.GetVersion() & SERIALIZE_UNDO_COMPACT)) {
             // Old versions stored the version number for the last spend of
             // a transaction's outputs. Non-final spends were indicated with
             // height = 0.
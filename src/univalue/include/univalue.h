@@ -48,7 +48,8 @@ public:
         std::string s(val_);
         setStr(s);
     }
-    ~UniValue() {}
+    // No destructor is declared, so values are moved instead of copied
+    // when containers of them grow
 
     void clear();
 
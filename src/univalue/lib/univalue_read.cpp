@@ -15,6 +15,13 @@ static bool json_isdigit(int ch)
     return ((ch >= '0') && (ch <= '9'));
 }
 
+// 7-bit ASCII that stands for itself inside a string
+static bool json_isplainchar(char ch)
+{
+    return ((unsigned char)ch >= 0x20) && ((unsigned char)ch < 0x80) &&
+           (ch != '"') && (ch != '\\');
+}
+
 // convert hexadecimal string to unsigned integer
 static const char *hatoui(const char *first, const char *last,
                           unsigned int& out)
@@ -166,7 +173,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
             }
         }
 
-        tokenVal = numStr;
+        tokenVal.swap(numStr);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -221,6 +228,15 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
             }
 
             else {
+                // Plain ASCII runs, like the hex of blocks and transactions,
+                // are copied at once
+                const char *run = raw;
+                while (run < end && json_isplainchar(*run))
+                    run++;
+                if (run > raw + 1 && writer.append_ascii(raw, run)) {
+                    raw = run;
+                    continue;
+                }
                 writer.push_back(*raw);
                 raw++;
             }
@@ -228,7 +244,7 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
         if (!writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
+        tokenVal.swap(valStr);
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -317,9 +333,8 @@ bool UniValue::read(const char *raw, size_t size)
                     setArray();
                 stack.push_back(this);
             } else {
-                UniValue tmpVal(utyp);
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.emplace_back(utyp);
 
                 UniValue *newTop = &(top->values.back());
                 stack.push_back(newTop);
@@ -396,21 +411,22 @@ bool UniValue::read(const char *raw, size_t size)
             }
 
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
             }
 
         case JTOK_NUMBER: {
-            UniValue tmpVal(VNUM, tokenVal);
+            UniValue tmpVal(VNUM);
+            tmpVal.val.swap(tokenVal);
             if (!stack.size()) {
-                *this = tmpVal;
+                *this = std::move(tmpVal);
                 break;
             }
 
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
@@ -419,17 +435,19 @@ bool UniValue::read(const char *raw, size_t size)
         case JTOK_STRING: {
             if (expect(OBJ_NAME)) {
                 UniValue *top = stack.back();
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(std::move(tokenVal));
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
+                // The string is moved into the value, not copied
+                UniValue tmpVal(VSTR);
+                tmpVal.val.swap(tokenVal);
                 if (!stack.size()) {
-                    *this = tmpVal;
+                    *this = std::move(tmpVal);
                     break;
                 }
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.push_back(std::move(tmpVal));
             }
 
             setExpect(NOT_VALUE);
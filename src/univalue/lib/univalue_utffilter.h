@@ -45,6 +45,15 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of 7-bit ASCII chars, the same as passing them to
+    // push_back one at a time. Returns false mid-sequence, when they are not.
+    bool append_ascii(const char *begin, const char *end)
+    {
+        if (state)
+            return false;
+        str.append(begin, end);
+        return true;
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint_)
     {
@@ -391,6 +391,13 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("[]{}"));
     BOOST_CHECK(!v.read("{}[]"));
     BOOST_CHECK(!v.read("{} 42"));
+
+    /* Runs of plain ASCII between escapes and multi-byte characters. */
+    BOOST_CHECK(v.read("[\"abcdef\\n012\\u00e9xyz\xc3\xa9" "end\", \"\", \"a\"]"));
+    BOOST_CHECK_EQUAL(v[0].get_str(), "abcdef\n012\xc3\xa9xyz\xc3\xa9" "end");
+    BOOST_CHECK_EQUAL(v[1].get_str(), "");
+    BOOST_CHECK_EQUAL(v[2].get_str(), "a");
+    BOOST_CHECK(!v.read("[\"abc\xc3xyz\"]"));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
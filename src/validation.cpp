@@ -8,18 +8,24 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockfilemap.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <coinsreadview.h>
+#include <coinstats.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/algos/argon2/hashargon.h>
 #include <cuckoocache.h>
 #include <globaltoken/hardfork.h>
+#include <globaltoken/multihasher.h>
 #include <hash.h>
 #include <init.h>
+#include <memusage.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -34,6 +40,7 @@
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
+#include <txindex.h>
 #include <txmempool.h>
 #include <ui_interface.h>
 #include <undo.h>
@@ -53,8 +60,12 @@
 #include <masternode-payments.h>
 
 #include <inttypes.h>
+#include <atomic>
+#include <deque>
 #include <future>
 #include <sstream>
+#include <thread>
+#include <tuple>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -101,6 +112,42 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+class CDisconnectReadAhead;
+
+/**
+ * Slab allocator for the entries of mapBlockIndex. Entries are never freed
+ * one by one, only all together when the block index is unloaded, so they can
+ * be handed out from large contiguous slabs instead of one heap block each.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t SLAB_SIZE = 4096;
+
+    std::vector<std::unique_ptr<CBlockIndex[]> > vSlabs;
+    size_t nSlabUsed = SLAB_SIZE;
+
+public:
+    CBlockIndex* Allocate()
+    {
+        if (nSlabUsed == SLAB_SIZE) {
+            vSlabs.emplace_back(new CBlockIndex[SLAB_SIZE]);
+            nSlabUsed = 0;
+        }
+        return &vSlabs.back()[nSlabUsed++];
+    }
+
+    void Clear()
+    {
+        vSlabs.clear();
+        nSlabUsed = SLAB_SIZE;
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::DynamicUsage(vSlabs) + memusage::MallocUsage(SLAB_SIZE * sizeof(CBlockIndex)) * vSlabs.size();
+    }
+};
 
 /**
  * CChainState stores and provides an API to update our local knowledge of the
@@ -157,6 +204,9 @@ private:
       */
     std::set<CBlockIndex*> g_failed_blocks;
 
+    /** Storage of the entries of mapBlockIndex */
+    CBlockIndexArena blockIndexArena;
+
 public:
     CChain chainActive;
     BlockMap mapBlockIndex;
@@ -165,18 +215,20 @@ public:
 
     bool LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree);
 
+    size_t BlockIndexDynamicMemoryUsage() const;
+
     bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock);
 
-    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex);
-    bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock);
+    bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true);
+    bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fCheckPOW = true);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, const CBlockUndo* pblockUndo = nullptr);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                     CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false);
 
     // Block disconnection on our pcoinsTip:
-    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool);
+    bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, CDisconnectReadAhead* readahead = nullptr);
 
     // Manual block validity manipulation:
     bool PreciousBlock(CValidationState& state, const CChainParams& params, CBlockIndex *pindex);
@@ -194,6 +246,8 @@ public:
     bool DisconnectBlocks(int blocks);
     void ReprocessBlocks(int nBlocks);
 
+    bool ActivateSnapshot(CBlockIndex* pindexBase, uint64_t nChainTx);
+
 private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace);
     bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool);
@@ -213,26 +267,35 @@ private:
 
 
 
-CCriticalSection cs_main;
+CInstrumentedCriticalSection cs_main;
 #ifdef ENABLE_TREASURY
 CCriticalSection cs_treasury;
 #endif
 
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
 CChain& chainActive = g_chainstate.chainActive;
+CAlgoHashrateIndex algoHashrateIndex;
 CBlockIndex *pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nHeaderVerifyThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
+bool fCoinStatsIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fHeadersOnly = false;
+CBlockIndex* pindexSnapshotBase = nullptr;
+bool fSnapshotValidated = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+CheckPoWOnLoad checkPoWOnLoad = CheckPoWOnLoad::UNVERIFIED;
+bool fParanoidBlockReads = DEFAULT_PARANOID_BLOCK_READS;
+bool fCompactUndo = DEFAULT_COMPACT_UNDO;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -315,6 +378,8 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -464,6 +529,7 @@ int GetUTXOConfirmations(const COutPoint& outpoint)
 
 // Returns the script flags which should be checked for a given block
 static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& chainparams);
+static unsigned int GetNextBlockScriptFlags(const CBlockIndex* pindexPrev, const Consensus::Params& chainparams);
 
 static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     int expired = pool.Expire(GetTime() - age);
@@ -586,6 +652,28 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/**
+ * CheckInputs for a transaction entering the mempool. The scripts of a
+ * transaction with many inputs are run on the script-checking threads, which
+ * ConnectBlock cannot be using as both run under cs_main. If one fails, the
+ * inputs are checked again in order so state gets the same rejection reason
+ * as without threads; the inputs that passed are in the signature cache then.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads && tx.vin.size() >= MIN_INPUTS_FOR_PARALLEL_MEMPOOL_SCRIPT_CHECKS) {
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks))
+            return false;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
@@ -628,7 +716,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     }
     
     // If this is a Transaction Lock Request check to see if it's valid
-    if(instantsend.HasTxLockRequest(hash) && !CTxLockRequest(tx).IsValid())
+    if(instantsend.HasTxLockRequest(hash) && !CTxLockRequest(ptx).IsValid())
         return state.DoS(10, error("AcceptToMemoryPool : CTxLockRequest %s is invalid", hash.ToString()),
                             REJECT_INVALID, "bad-txlockrequest");
                             
@@ -960,7 +1048,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -973,12 +1061,11 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return false; // state filled in by CheckInputs
         }
 
-        // Check again against the current block tip's script verification
-        // flags to cache our script execution flags. This is, of course,
-        // useless if the next block has different script flags from the
-        // previous one, but because the cache tracks script flags for us it
-        // will auto-invalidate and we'll just have a few blocks of extra
-        // misses on soft-fork activation.
+        // Check again against the script verification flags of the next
+        // block to cache our script execution flags, so that connecting a
+        // block of mempool transactions needs no script checks. Should a
+        // reorg change the flags, the cache tracks script flags for us and
+        // we'll just have a few blocks of extra misses.
         //
         // This is also useful in case of bugs in the standard flags that cause
         // transactions to pass as valid when they're actually invalid. For
@@ -988,7 +1075,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks (using TestBlockValidity), however allowing such
         // transactions into the mempool can be exploited as a DoS attack.
-        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        unsigned int currentBlockScriptVerifyFlags = GetNextBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
         if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
         {
             // If we're using promiscuousmempoolflags, we may hit this normally
@@ -1029,6 +1116,9 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
+        // The lock may have completed before the transaction got here, e.g. after a reorg
+        if (instantsend.IsLockedInstantSendTransaction(hash))
+            pool.SetInstantSendLocked(hash);
 
         // trim mempool and check if tx was trimmed
         if (!bypass_limits) {
@@ -1085,9 +1175,9 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
+        if (ptxindex) {
             CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
+            if (ptxindex->FindTx(hash, postx)) {
                 CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 if (file.IsNull())
                     return error("%s: OpenBlockFile failed", __func__);
@@ -1105,8 +1195,9 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
                 return true;
             }
 
-            // transaction not found in index, nothing more can be done
-            return false;
+            // transaction not found in index, nothing more can be done once it is complete
+            if (ptxindex->IsSynced())
+                return false;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -1141,47 +1232,210 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
+namespace {
+
+bool AbortNode(const std::string& strMessage, const std::string& userMessage);
+
+/** Write serialized block or undo data at pos, and sync the file if fCommit */
+bool WriteToBlockFile(const CDiskBlockPos& pos, bool fUndo, const std::vector<unsigned char>& vData, bool fCommit)
+{
+    FILE* file = fUndo ? OpenUndoFile(pos) : OpenBlockFile(pos);
+    if (!file)
+        return error("%s: Open%sFile failed", __func__, fUndo ? "Undo" : "Block");
+    bool fWritten = fwrite(vData.data(), 1, vData.size(), file) == vData.size();
+    if (fWritten && fCommit)
+        FileCommit(file);
+    fWritten &= fclose(file) == 0;
+    if (!fWritten)
+        return error("%s: Write failed at %s", __func__, pos.ToString());
+    return true;
+}
+
+/**
+ * Writes the blocks and undo data to their files on a thread of its own, so
+ * accepting and connecting a block does not wait for the disk. Reading from
+ * a file waits for the writes queued for it first, and FlushBlockFile waits
+ * for all of them before it syncs the files, so the block index is never
+ * written with an nStatus claiming data that is not on disk yet. The thread
+ * syncs a file every BLOCK_WRITER_SYNC_BYTES it wrote, leaving less for
+ * FlushBlockFile to sync. A failed write is remembered, so FlushBlockFile
+ * fails from then on and the block index is not written for data that never
+ * reached the disk.
+ */
+class CBlockFileWriter
+{
+private:
+    struct QueuedWrite
+    {
+        CDiskBlockPos pos;
+        bool fUndo;
+        std::vector<unsigned char> vData;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Whether the thread is running, the data is written right away without it
+    bool fRunning = false;
+    std::deque<QueuedWrite> queueWrites;
+    size_t nQueuedBytes = 0;
+    //! Number of writes queued or being written by (fUndo, nFile)
+    std::map<std::pair<bool, int>, int> mapPendingFiles;
+    //! Data written since the file was last synced by the thread, by (fUndo, nFile)
+    std::map<std::pair<bool, int>, size_t> mapUnsyncedBytes;
+    //! Whether a queued write failed
+    bool fWriteFailed = false;
+
+    /** Write the next queued data, with the mutex held on entry and exit */
+    void WriteNext(boost::unique_lock<boost::mutex>& lock)
+    {
+        const QueuedWrite& write = queueWrites.front();
+        const std::pair<bool, int> key(write.fUndo, write.pos.nFile);
+        size_t& nUnsynced = mapUnsyncedBytes[key];
+        nUnsynced += write.vData.size();
+        const bool fCommit = nUnsynced >= BLOCK_WRITER_SYNC_BYTES;
+        if (fCommit)
+            nUnsynced = 0;
+
+        // Only the thread takes writes off the queue, the front stays in place meanwhile
+        lock.unlock();
+        const bool fWritten = WriteToBlockFile(write.pos, write.fUndo, write.vData, fCommit);
+        if (!fWritten)
+            AbortNode(write.fUndo ? "Failed to write undo data" : "Failed to write block", "");
+        lock.lock();
+
+        if (!fWritten)
+            fWriteFailed = true;
+        nQueuedBytes -= write.vData.size();
+        if (--mapPendingFiles[key] == 0)
+            mapPendingFiles.erase(key);
+        queueWrites.pop_front();
+        cond.notify_all();
+    }
+
+public:
+    void Thread()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = true;
+        try {
+            while (true) {
+                while (queueWrites.empty())
+                    cond.wait(lock);
+                WriteNext(lock);
+            }
+        } catch (const boost::thread_interrupted&) {
+            // Nothing queued may be lost on shutdown
+            while (!queueWrites.empty())
+                WriteNext(lock);
+            fRunning = false;
+            mapUnsyncedBytes.clear();
+            cond.notify_all();
+            throw;
+        }
+    }
+
+    /** Write vData at pos, or queue it for the thread, waiting while too much is queued */
+    bool Write(const CDiskBlockPos& pos, bool fUndo, std::vector<unsigned char>&& vData)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && nQueuedBytes > 0 && nQueuedBytes + vData.size() > BLOCK_WRITER_MAX_QUEUED_BYTES)
+                cond.wait(lock);
+            if (fRunning) {
+                nQueuedBytes += vData.size();
+                ++mapPendingFiles[std::make_pair(fUndo, pos.nFile)];
+                queueWrites.push_back(QueuedWrite{pos, fUndo, std::move(vData)});
+                cond.notify_all();
+                return true;
+            }
+        }
+        return WriteToBlockFile(pos, fUndo, vData, false);
+    }
+
+    void WaitForFile(int nFile, bool fUndo)
+    {
+        const std::pair<bool, int> key(fUndo, nFile);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (mapPendingFiles.count(key))
+            cond.wait(lock);
+    }
+
+    /** Wait until everything queued is written, returns false if any queued write failed */
+    bool WaitForAll()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!queueWrites.empty())
+            cond.wait(lock);
+        return !fWriteFailed;
+    }
+};
+
+CBlockFileWriter blockFileWriter;
+
+} // namespace
+
+void ThreadBlockFileWriter()
+{
+    RenameThread("globaltoken-blockwriter");
+    blockFileWriter.Thread();
+}
+
+void WaitForBlockFileWrites(int nFile, bool fUndo)
+{
+    blockFileWriter.WaitForFile(nFile, fUndo);
+}
+
 static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
+    std::vector<unsigned char> vData;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, vData, 0);
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    unsigned int nSize = GetSerializeSize(writer, block);
+    vData.reserve(CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize) + nSize);
+    writer << FLATDATA(messageStart) << nSize;
 
     // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    const CDiskBlockPos posWrite = pos;
+    pos.nPos += vData.size();
+    writer << block;
 
-    return true;
+    return blockFileWriter.Write(posWrite, false, std::move(vData));
 }
 
 template<typename T>
-static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPoW = true)
 {    
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    // Read block, straight from the mapped file if it is mapped
+    const unsigned char* pblock;
+    unsigned int nBlockSize;
+    std::shared_ptr<const CMappedBlockFile> mapped = MapBlock(pos, pblock, nBlockSize);
+    if (mapped) {
+        try {
+            CSpanReader(SER_DISK, CLIENT_VERSION, pblock, nBlockSize) >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
     
     // Check the header
-    if (!CheckProofOfWork(block, consensusParams))
+    CHashPurposeScope hashPurpose(HashPurpose::BLOCK_READ);
+    if (fCheckPoW && !CheckProofOfWork(block, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
     
     block.fAuxPowChecked = true;
@@ -1192,12 +1446,17 @@ template<typename T>
 static bool ReadBlockOrHeader(T& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     CDiskBlockPos blockPos;
+    bool fValidated;
     {
         LOCK(cs_main);
         blockPos = pindex->GetBlockPos();
+        fValidated = (pindex->nStatus & BLOCK_HAVE_DATA) && pindex->IsValid(BLOCK_VALID_TRANSACTIONS);
     }
 
-    if (!ReadBlockOrHeader(block, blockPos, consensusParams))
+    // The proof of work (and auxpow) of a block was checked before its transactions
+    // were accepted and it was written to disk. Matching the hash of the validated
+    // index entry below is enough to know we read back that very block.
+    if (!ReadBlockOrHeader(block, blockPos, consensusParams, !fValidated || fParanoidBlockReads))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1210,11 +1469,354 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return ReadBlockOrHeader(block, pos, consensusParams);
 }
 
+CBlockReadRequest GetBlockReadRequest(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    CBlockReadRequest request;
+    request.pos = pindex->GetBlockPos();
+    request.hash = pindex->GetBlockHash();
+    // Same as ReadBlockFromDisk, validated blocks do not need their PoW checked again.
+    request.fCheckPoW = !((pindex->nStatus & BLOCK_HAVE_DATA) && pindex->IsValid(BLOCK_VALID_TRANSACTIONS)) || fParanoidBlockReads;
+    return request;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CBlockReadRequest& request, const Consensus::Params& consensusParams)
+{
+    if (!ReadBlockOrHeader(block, request.pos, consensusParams, request.fCheckPoW))
+        return false;
+    if (block.GetHash() != request.hash)
+        return error("ReadBlockFromDisk(CBlock&, CBlockReadRequest&): GetHash() doesn't match index for %s at %s",
+                request.hash.ToString(), request.pos.ToString());
+    return true;
+}
+
+namespace {
+
+/**
+ * Reads the blocks ActivateBestChainStep is about to connect on a thread of
+ * its own, so reading the next blocks from disk overlaps with connecting the
+ * current one. It also looks up their inputs in the coins database, which
+ * gets the entries into the LevelDB and OS caches before ConnectBlock asks
+ * pcoinsTip for them.
+ */
+class CBlockReadAhead
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Whether the thread is running, nothing is read ahead without it
+    bool fRunning = false;
+    //! The blocks to read, in the order they get connected
+    std::deque<CBlockReadRequest> queueRequests;
+    //! The block being read by the thread
+    uint256 hashReading;
+    //! The blocks of the last schedule, anything else is not kept
+    std::set<uint256> setWanted;
+    std::map<uint256, std::shared_ptr<const CBlock> > mapRead;
+
+    void WarmInputs(const CBlock& block)
+    {
+        for (const CTransactionRef& tx : block.vtx) {
+            if (tx->IsCoinBase())
+                continue;
+            for (const CTxIn& txin : tx->vin) {
+                Coin coin;
+                pcoinsdbview->GetCoin(txin.prevout, coin);
+            }
+            boost::this_thread::interruption_point();
+        }
+    }
+
+public:
+    void Thread(const Consensus::Params& consensusParams)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fRunning = true;
+        }
+        try {
+            while (true) {
+                CBlockReadRequest request;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (queueRequests.empty())
+                        cond.wait(lock);
+                    request = queueRequests.front();
+                    queueRequests.pop_front();
+                    hashReading = request.hash;
+                }
+
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                // On failure ConnectTip reads the block again itself, and reports the error.
+                bool fRead;
+                {
+                    CBlockArenaScope arena;
+                    fRead = ReadBlockOrHeader(*pblock, request.pos, consensusParams, request.fCheckPoW) && pblock->GetHash() == request.hash;
+                }
+                if (fRead)
+                    WarmInputs(*pblock);
+
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    if (fRead && setWanted.count(request.hash))
+                        mapRead[request.hash] = pblock;
+                    hashReading.SetNull();
+                }
+                cond.notify_all();
+            }
+        } catch (const boost::thread_interrupted&) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fRunning = false;
+                queueRequests.clear();
+                setWanted.clear();
+                mapRead.clear();
+                hashReading.SetNull();
+            }
+            cond.notify_all();
+            throw;
+        }
+    }
+
+    /** Read the given blocks ahead, in this order, and forget about blocks read for earlier schedules. */
+    void Schedule(const std::vector<const CBlockIndex*>& vpindex)
+    {
+        AssertLockHeld(cs_main);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (!fRunning)
+                return;
+
+            queueRequests.clear();
+            setWanted.clear();
+            for (const CBlockIndex* pindex : vpindex) {
+                if (setWanted.size() >= BLOCK_READAHEAD_BLOCKS || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                    break;
+                const uint256& hash = pindex->GetBlockHash();
+                setWanted.insert(hash);
+                if (mapRead.count(hash) || hash == hashReading)
+                    continue;
+                queueRequests.push_back(GetBlockReadRequest(pindex));
+            }
+            for (auto it = mapRead.begin(); it != mapRead.end(); ) {
+                if (setWanted.count(it->first))
+                    ++it;
+                else
+                    it = mapRead.erase(it);
+            }
+        }
+        cond.notify_all();
+    }
+
+    /** Take the block if it was read ahead, waiting if it is being read right now. */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex)
+    {
+        const uint256& hash = pindex->GetBlockHash();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (hash == hashReading)
+            cond.wait(lock);
+
+        setWanted.erase(hash);
+        for (auto it = queueRequests.begin(); it != queueRequests.end(); ++it) {
+            if (it->hash == hash) {
+                queueRequests.erase(it);
+                break;
+            }
+        }
+
+        std::shared_ptr<const CBlock> pblock;
+        auto it = mapRead.find(hash);
+        if (it != mapRead.end()) {
+            pblock = std::move(it->second);
+            mapRead.erase(it);
+        }
+        return pblock;
+    }
+};
+
+CBlockReadAhead blockReadAhead;
+
+}
+
+/**
+ * Reads the blocks and undo data of a reorg ahead of DisconnectTip, on a few
+ * threads of its own, so the disk reads for the whole range run in parallel
+ * instead of one block after the other under cs_main. At most
+ * DISCONNECT_READAHEAD_BLOCKS are kept in memory ahead of the block being
+ * disconnected. Whatever could not be read is left to DisconnectTip, which
+ * reads it again itself and reports the error.
+ */
+class CDisconnectReadAhead
+{
+private:
+    struct Entry {
+        CBlockReadRequest request;
+        CDiskBlockPos posUndo;
+        uint256 hashPrev;
+        bool fCompact;
+        bool fDone;
+        std::shared_ptr<CBlock> pblock;
+        std::shared_ptr<CBlockUndo> pblockundo;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! The blocks to disconnect, starting at the tip
+    std::vector<Entry> vEntries;
+    //! Next entry a thread reads, and the entries DisconnectTip took so far
+    size_t nNext = 0;
+    size_t nTaken = 0;
+    bool fStop = false;
+    boost::thread_group threads;
+
+    void Thread(const Consensus::Params& consensusParams)
+    {
+        while (true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nNext < vEntries.size() && nNext >= nTaken + DISCONNECT_READAHEAD_BLOCKS)
+                    cond.wait(lock);
+                if (fStop || nNext >= vEntries.size())
+                    return;
+                i = nNext++;
+            }
+
+            const Entry& entry = vEntries[i];
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (!ReadBlockOrHeader(*pblock, entry.request.pos, consensusParams, entry.request.fCheckPoW) || pblock->GetHash() != entry.request.hash)
+                pblock.reset();
+            std::shared_ptr<CBlockUndo> pblockundo;
+            if (pblock && !entry.posUndo.IsNull()) {
+                pblockundo = std::make_shared<CBlockUndo>();
+                if (!UndoReadFromDisk(*pblockundo, entry.posUndo, entry.hashPrev, entry.fCompact))
+                    pblockundo.reset();
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                vEntries[i].pblock = std::move(pblock);
+                vEntries[i].pblockundo = std::move(pblockundo);
+                vEntries[i].fDone = true;
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    /** Start reading the given blocks, in the order they get disconnected. */
+    CDisconnectReadAhead(const std::vector<const CBlockIndex*>& vpindex, const Consensus::Params& consensusParams)
+    {
+        AssertLockHeld(cs_main);
+        vEntries.reserve(vpindex.size());
+        for (const CBlockIndex* pindex : vpindex) {
+            Entry entry;
+            entry.request = GetBlockReadRequest(pindex);
+            if (pindex->nStatus & BLOCK_HAVE_UNDO)
+                entry.posUndo = pindex->GetUndoPos();
+            if (pindex->pprev)
+                entry.hashPrev = pindex->pprev->GetBlockHash();
+            entry.fCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+            entry.fDone = false;
+            vEntries.push_back(std::move(entry));
+        }
+        const size_t nThreads = std::min(vEntries.size(), (size_t)DISCONNECT_READAHEAD_THREADS);
+        for (size_t i = 0; i < nThreads; i++)
+            threads.create_thread(std::bind(&CDisconnectReadAhead::Thread, this, std::cref(consensusParams)));
+    }
+
+    ~CDisconnectReadAhead()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        threads.join_all();
+    }
+
+    /** Take what was read for pindex, waiting if it is being read right now. Either may come back empty. */
+    void Take(const CBlockIndex* pindex, std::shared_ptr<CBlock>& pblock, std::shared_ptr<CBlockUndo>& pblockundo)
+    {
+        const uint256& hash = pindex->GetBlockHash();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (size_t i = nTaken; i < vEntries.size(); i++) {
+            if (vEntries[i].request.hash != hash)
+                continue;
+            nTaken = i + 1;
+            if (i < nNext) {
+                while (!vEntries[i].fDone)
+                    cond.wait(lock);
+                pblock = std::move(vEntries[i].pblock);
+                pblockundo = std::move(vEntries[i].pblockundo);
+            } else {
+                // Not started yet, the caller reads it faster itself
+                nNext = i + 1;
+            }
+            break;
+        }
+        cond.notify_all();
+    }
+};
+
+void ThreadBlockReadAhead()
+{
+    RenameThread("globaltoken-readahead");
+    blockReadAhead.Thread(Params().GetConsensus());
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     return ReadBlockOrHeader(block, pindex, consensusParams);
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+    // Start at the message start and size WriteBlockToDisk puts in front of the block
+    if (pos.nPos < CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+
+    const unsigned char* pblock;
+    unsigned int nBlockSize;
+    std::shared_ptr<const CMappedBlockFile> mapped = MapBlock(pos, pblock, nBlockSize);
+    if (mapped) {
+        if (memcmp(pblock - CMessageHeader::MESSAGE_START_SIZE - sizeof(unsigned int), messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        block.assign(pblock, pblock + nBlockSize);
+        return true;
+    }
+
+    pos.nPos -= CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars start;
+        unsigned int nSize;
+        filein >> FLATDATA(start) >> nSize;
+        if (memcmp(start, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+            return error("%s: block size %u too large at %s", __func__, nSize, pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    return true;
+}
+
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    return ReadBlockOrHeader(block, pos, consensusParams);
+}
+
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     return ReadBlockOrHeader(block, pindex, consensusParams);
@@ -1426,6 +2028,8 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
+static uint64_t nScriptExecutionCacheHits = 0;
+static uint64_t nScriptExecutionCacheMisses = 0;
 
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
@@ -1436,6 +2040,17 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+SignatureCacheStats GetScriptExecutionCacheStats()
+{
+    AssertLockHeld(cs_main);
+    SignatureCacheStats stats;
+    stats.nCapacity = scriptExecutionCache.capacity();
+    stats.nOccupied = scriptExecutionCache.count_occupied();
+    stats.nHits = nScriptExecutionCacheHits;
+    stats.nMisses = nScriptExecutionCacheMisses;
+    return stats;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1479,8 +2094,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                nScriptExecutionCacheHits++;
                 return true;
             }
+            nScriptExecutionCacheMisses++;
 
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
@@ -1535,42 +2152,42 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, bool fCompact)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
+    const int nVersion = fCompact ? CLIENT_VERSION | SERIALIZE_UNDO_COMPACT : CLIENT_VERSION;
+
+    std::vector<unsigned char> vData;
+    CVectorWriter writer(SER_DISK, nVersion, vData, 0);
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
+    unsigned int nSize = GetSerializeSize(writer, blockundo);
+    vData.reserve(CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize) + nSize + sizeof(uint256));
+    writer << FLATDATA(messageStart) << nSize;
 
     // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    const CDiskBlockPos posWrite = pos;
+    pos.nPos += vData.size();
+    writer << blockundo;
 
     // calculate & write checksum
-    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    CHashWriter hasher(SER_GETHASH, fCompact ? PROTOCOL_VERSION | SERIALIZE_UNDO_COMPACT : PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
+    writer << hasher.GetHash();
 
-    return true;
+    return blockFileWriter.Write(posWrite, true, std::move(vData));
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashPrevBlock, bool fCompact)
 {
-    CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
     // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, fCompact ? CLIENT_VERSION | SERIALIZE_UNDO_COMPACT : CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
@@ -1578,7 +2195,7 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     uint256 hashChecksum;
     CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
-        verifier << pindex->pprev->GetBlockHash();
+        verifier << hashPrevBlock;
         verifier >> blockundo;
         filein >> hashChecksum;
     }
@@ -1593,6 +2210,13 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+namespace {
+
+static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+{
+    return UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash(), pindex->nStatus & BLOCK_UNDO_COMPACT);
+}
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1649,15 +2273,19 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, const CBlockUndo* pblockUndo)
 {
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    CBlockUndo blockUndoRead;
+    if (!pblockUndo) {
+        if (!UndoReadFromDisk(blockUndoRead, pindex)) {
+            error("DisconnectBlock(): failure reading undo data");
+            return DISCONNECT_FAILED;
+        }
+        pblockUndo = &blockUndoRead;
     }
+    const CBlockUndo& blockUndo = *pblockUndo;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("DisconnectBlock(): block and undo data inconsistent");
@@ -1685,18 +2313,18 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 
         // restore inputs
         if (i > 0) { // not coinbases
-            CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size()) {
                 error("DisconnectBlock(): transaction and undo data inconsistent");
                 return DISCONNECT_FAILED;
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
+                // Copied, the undo data may be used again for the coin stats index
+                int res = ApplyTxInUndo(Coin(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
             }
-            // At this point, all of txundo.vprevout should have been moved out.
         }
     }
 
@@ -1706,10 +2334,13 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+/** Sync the current block and undo files, returns false if writing data to them failed */
+bool static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    const bool fWritten = blockFileWriter.WaitForAll();
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = OpenBlockFile(posOld);
@@ -1727,6 +2358,7 @@ void static FlushBlockFile(bool fFinalize = false)
         FileCommit(fileOld);
         fclose(fileOld);
     }
+    return fWritten;
 }
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
@@ -1736,14 +2368,17 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        const bool fCompact = fCompactUndo;
+        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, fCompact ? CLIENT_VERSION | SERIALIZE_UNDO_COMPACT : CLIENT_VERSION) + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart(), fCompact))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (fCompact)
+            pindex->nStatus |= BLOCK_UNDO_COMPACT;
         setDirtyBlockIndex.insert(pindex);
     }
 
@@ -1752,26 +2387,16 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
 
 static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
 {
-    if (!fTxIndex) return true;
-
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
-    }
+    // Until the index is synced its own thread gets to the block.
+    if (!ptxindex || !ptxindex->IsSynced()) return true;
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
+    if (!ptxindex->WriteBlock(block, pindex)) {
         return AbortNode(state, "Failed to write transaction index");
     }
 
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("globaltoken-scriptch");
     scriptcheckqueue.Thread();
@@ -1862,33 +2487,34 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
-static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) {
+/** Script flags of a block at nHeight on top of pindexPrev */
+static unsigned int GetScriptFlags(int nHeight, const CBlockIndex* pindexPrev, const Consensus::Params& consensusparams) {
     AssertLockHeld(cs_main);
 
     unsigned int flags = SCRIPT_VERIFY_NONE;
 
     // Start enforcing P2SH (BIP16)
-    if (pindex->nHeight >= consensusparams.BIP16Height) {
+    if (nHeight >= consensusparams.BIP16Height) {
         flags |= SCRIPT_VERIFY_P2SH;
     }
 
     // Start enforcing the DERSIG (BIP66) rule
-    if (pindex->nHeight >= consensusparams.BIP66Height) {
+    if (nHeight >= consensusparams.BIP66Height) {
         flags |= SCRIPT_VERIFY_DERSIG;
     }
 
     // Start enforcing CHECKLOCKTIMEVERIFY (BIP65) rule
-    if (pindex->nHeight >= consensusparams.BIP65Height) {
+    if (nHeight >= consensusparams.BIP65Height) {
         flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
     }
 
     // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
-    if (VersionBitsState(pindex->pprev, consensusparams, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+    if (VersionBitsState(pindexPrev, consensusparams, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
         flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
     }
 
     // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, consensusparams)) {
+    if (IsWitnessEnabled(pindexPrev, consensusparams)) {
         flags |= SCRIPT_VERIFY_WITNESS;
         flags |= SCRIPT_VERIFY_NULLDUMMY;
     }
@@ -1896,6 +2522,14 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
     return flags;
 }
 
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) {
+    return GetScriptFlags(pindex->nHeight, pindex->pprev, consensusparams);
+}
+
+static unsigned int GetNextBlockScriptFlags(const CBlockIndex* pindexPrev, const Consensus::Params& consensusparams) {
+    return GetScriptFlags(pindexPrev->nHeight + 1, pindexPrev, consensusparams);
+}
+
 
 
 static int64_t nTimeCheck = 0;
@@ -2162,6 +2796,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!WriteTxIndexDataForBlock(block, state, pindex))
         return false;
 
+    // Only blocks extending the active chain change the UTXO set the index follows,
+    // not the ones VerifyDB reconnects on a copy of it.
+    if (fCoinStatsIndex && pindex->pprev == chainActive.Tip() && !coinstatsindex.ConnectBlock(block, blockundo, pindex))
+        return AbortNode(state, "Failed to write coin stats index");
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2187,6 +2826,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    static int64_t nLastPartialFlush = 0;
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     bool fDoFullFlush = false;
@@ -2233,13 +2873,25 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
+        // The cache is getting full: write its older modifications in the background, so the full flush has less left to do.
+        bool fPartialFlush = !fDoFullFlush && (mode == FLUSH_STATE_IF_NEEDED || mode == FLUSH_STATE_PERIODIC) &&
+            cacheSize > (COINS_PARTIAL_FLUSH_THRESHOLD * nTotalSpace) / 100 &&
+            nNow > nLastPartialFlush + (int64_t)DATABASE_PARTIAL_FLUSH_INTERVAL * 1000000 &&
+            !pcoinsTip->GetBestBlock().IsNull() && !pcoinsdbview->IsWritingInBackground() &&
+            gArgs.GetBoolArg("-dbpartialflush", DEFAULT_DB_PARTIAL_FLUSH);
+        if (fPartialFlush) {
+            nLastPartialFlush = nNow;
+            if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
+                return state.Error("out of disk space");
+        }
         // Write blocks and block index to disk.
-        if (fDoFullFlush || fPeriodicWrite) {
+        if (fDoFullFlush || fPeriodicWrite || fPartialFlush) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
-            FlushBlockFile();
+            if (!FlushBlockFile())
+                return AbortNode(state, "Failed to write block or undo data");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2248,15 +2900,16 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex*> vBlocks;
-                vBlocks.reserve(setDirtyBlockIndex.size());
-                for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
-                    setDirtyBlockIndex.erase(it++);
-                }
+                std::vector<CBlockIndex*> vDirtyBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+                std::vector<const CBlockIndex*> vBlocks(vDirtyBlocks.begin(), vDirtyBlocks.end());
+                setDirtyBlockIndex.clear();
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                // The block tree DB has the Equihash header fields now, stop keeping them in memory.
+                for (CBlockIndex* pindex : vDirtyBlocks) {
+                    pindex->ReleaseEquihashFields();
+                }
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -2275,8 +2928,20 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             // Flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return AbortNode(state, "Failed to write to coin database");
+            RebaseCoinsReadView();
+            if (fCoinStatsIndex)
+                coinstatsindex.ChainStateFlushed(pcoinsTip->GetBestBlock());
             nLastFlush = nNow;
         }
+        // The coins written in the background may refer to the block index entries written above.
+        if (fPartialFlush) {
+            std::unique_ptr<CCoinsWriteBatch> pbatch(new CCoinsWriteBatch());
+            size_t nExtracted = pcoinsTip->ExtractOldDirtyCoins(pbatch->mapCoins, chainActive.Height() - COINS_PARTIAL_FLUSH_MIN_DEPTH, nTotalSpace / 8);
+            if (nExtracted > 0) {
+                LogPrint(BCLog::COINDB, "Writing %u modified coins in the background\n", (unsigned int)nExtracted);
+                pcoinsdbview->BatchWriteInBackground(std::move(pbatch), pcoinsTip->GetBestBlock());
+            }
+        }
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2380,24 +3045,48 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
   * disconnectpool (note that the caller is responsible for mempool consistency
   * in any case).
   */
-bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool)
+bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, CDisconnectReadAhead* readahead)
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return AbortNode(state, "Failed to read block");
+    // Replaying after a crash can only undo the blocks between the last full
+    // flush and the new tip, so coins written in the background for the branch
+    // being left have to be made consistent on disk first.
+    if (pcoinsdbview && pcoinsdbview->IsPartiallyWritten() && !FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        return false;
+    // Read block from disk, unless it was read ahead.
+    std::shared_ptr<CBlock> pblock;
+    std::shared_ptr<CBlockUndo> pblockundo;
+    if (readahead)
+        readahead->Take(pindexDelete, pblock, pblockundo);
+    if (!pblock) {
+        pblock = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblock, pindexDelete, chainparams.GetConsensus()))
+            return AbortNode(state, "Failed to read block");
+    }
+    CBlock& block = *pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip.get());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, pblockundo.get()) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        std::vector<std::pair<COutPoint, Coin> > vChangedCoins;
+        if (fCoinsReadView && !IsInitialBlockDownload())
+            view.GetDirtyCoins(vChangedCoins);
         bool flushed = view.Flush();
         assert(flushed);
+        UpdateCoinsReadView(pindexDelete->GetBlockHash(), pindexDelete->pprev, std::move(vChangedCoins));
+    }
+    if (fCoinStatsIndex) {
+        if (!pblockundo) {
+            pblockundo = std::make_shared<CBlockUndo>();
+            if (!UndoReadFromDisk(*pblockundo, pindexDelete))
+                return AbortNode(state, "Failed to read undo data");
+        }
+        if (!coinstatsindex.DisconnectBlock(block, *pblockundo, pindexDelete))
+            return AbortNode(state, "Failed to write coin stats index");
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
@@ -2418,6 +3107,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     }
 
     chainActive.SetTip(pindexDelete->pprev);
+    algoHashrateIndex.SetTip(chainActive, chainparams.GetConsensus());
 
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
@@ -2426,7 +3116,72 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
     return true;
 }
 
+/** Fewest inputs each prefetch thread gets to read, below that a thread does not pay off */
+static const size_t MIN_PREFETCH_INPUTS_PER_THREAD = 64;
+/** Max number of threads used to prefetch the inputs of a block */
+static const int MAX_PREFETCH_INPUT_THREADS = 16;
+
+/**
+ * Load the inputs of a block that pcoinsTip does not have yet from the coins
+ * database, before ConnectBlock looks them up one after the other. The reads
+ * are sorted by key and split over several threads.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+
+    // Outputs created in the block itself are not in the database.
+    std::vector<uint256> vBlockTxids;
+    vBlockTxids.reserve(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx)
+        vBlockTxids.push_back(tx->GetHash());
+    std::sort(vBlockTxids.begin(), vBlockTxids.end());
+
+    std::vector<COutPoint> vMissing;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (!std::binary_search(vBlockTxids.begin(), vBlockTxids.end(), txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                vMissing.push_back(txin.prevout);
+        }
+    }
+    if (vMissing.empty())
+        return;
+    // COutPoint ordering matches the order of the database keys.
+    std::sort(vMissing.begin(), vMissing.end());
+    vMissing.erase(std::unique(vMissing.begin(), vMissing.end()), vMissing.end());
+
+    std::vector<Coin> vCoins(vMissing.size());
+    std::vector<char> vFound(vMissing.size(), false);
+    auto fetch = [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++)
+            vFound[i] = pcoinsdbview->GetCoin(vMissing[i], vCoins[i]);
+    };
+
+    size_t nThreads = (vMissing.size() + MIN_PREFETCH_INPUTS_PER_THREAD - 1) / MIN_PREFETCH_INPUTS_PER_THREAD;
+    nThreads = std::min(nThreads, (size_t)std::max(1, std::min(GetNumCores(), MAX_PREFETCH_INPUT_THREADS)));
+    try {
+        std::vector<std::future<void> > vFetches;
+        for (size_t t = 1; t < nThreads; t++)
+            vFetches.push_back(std::async(std::launch::async, fetch, t * vMissing.size() / nThreads, (t + 1) * vMissing.size() / nThreads));
+        fetch(0, vMissing.size() / nThreads);
+        for (std::future<void>& f : vFetches)
+            f.get();
+    } catch (const std::exception& e) {
+        // Leave it to ConnectBlock to read the coins (and handle the error) through pcoinsTip.
+        LogPrintf("%s: failed to prefetch inputs of block %s: %s\n", __func__, block.GetHash().ToString(), e.what());
+        return;
+    }
+
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (vFound[i])
+            pcoinsTip->AddFetchedCoin(vMissing[i], std::move(vCoins[i]));
+    }
+}
+
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetchInputs = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2461,11 +3216,11 @@ private:
 
 public:
     explicit ConnectTrace(CTxMemPool &_pool) : blocksConnected(1), pool(_pool) {
-        pool.NotifyEntryRemoved.connect(boost::bind(&ConnectTrace::NotifyEntryRemoved, this, _1, _2));
+        pool.NotifyEntryRemoved.connect(boost::bind(&ConnectTrace::NotifyEntryRemoved, this, _1, _2, _3));
     }
 
     ~ConnectTrace() {
-        pool.NotifyEntryRemoved.disconnect(boost::bind(&ConnectTrace::NotifyEntryRemoved, this, _1, _2));
+        pool.NotifyEntryRemoved.disconnect(boost::bind(&ConnectTrace::NotifyEntryRemoved, this, _1, _2, _3));
     }
 
     void BlockConnected(CBlockIndex* pindex, std::shared_ptr<const CBlock> pblock) {
@@ -2489,7 +3244,7 @@ public:
         return blocksConnected;
     }
 
-    void NotifyEntryRemoved(CTransactionRef txRemoved, MemPoolRemovalReason reason) {
+    void NotifyEntryRemoved(CTransactionRef txRemoved, MemPoolRemovalReason reason, uint64_t /*nMempoolSequence*/) {
         assert(!blocksConnected.back().pindex);
         if (reason == MemPoolRemovalReason::CONFLICT) {
             blocksConnected.back().conflictedTxs->emplace_back(std::move(txRemoved));
@@ -2510,18 +3265,25 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
+        pthisBlock = blockReadAhead.Take(pindexNew);
+    }
+    if (!pblock && !pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        CBlockArenaScope arena;
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pthisBlock = pblockNew;
-    } else {
+    } else if (pblock) {
         pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
+    int64_t nTime1b = GetTimeMicros(); nTimeReadFromDisk += nTime1b - nTime1;
+    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime1b - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockInputs(blockConnecting);
     // Apply the block atomically to the chain state.
-    int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    int64_t nTime2 = GetTimeMicros(); nTimePrefetchInputs += nTime2 - nTime1b;
     int64_t nTime3;
-    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTime2 - nTime1b) * MILLI, nTimePrefetchInputs * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2533,8 +3295,12 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        std::vector<std::pair<COutPoint, Coin> > vChangedCoins;
+        if (fCoinsReadView && !IsInitialBlockDownload())
+            view.GetDirtyCoins(vChangedCoins);
         bool flushed = view.Flush();
         assert(flushed);
+        UpdateCoinsReadView(pindexNew->pprev->GetBlockHash(), pindexNew, std::move(vChangedCoins));
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
@@ -2548,6 +3314,7 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     chainActive.SetTip(pindexNew);
+    algoHashrateIndex.SetTip(chainActive, chainparams.GetConsensus());
     UpdateTip(pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
@@ -2694,8 +3461,16 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
     DisconnectedBlockTransactions disconnectpool;
+    // When there is more than one block to disconnect, read their blocks and undo data in parallel.
+    std::unique_ptr<CDisconnectReadAhead> readahead;
+    if (chainActive.Tip() && chainActive.Tip() != pindexFork && chainActive.Tip()->pprev != pindexFork) {
+        std::vector<const CBlockIndex*> vpindexDisconnect;
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork; pindex = pindex->pprev)
+            vpindexDisconnect.push_back(pindex);
+        readahead.reset(new CDisconnectReadAhead(vpindexDisconnect, chainparams.GetConsensus()));
+    }
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+        if (!DisconnectTip(state, chainparams, &disconnectpool, readahead.get())) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(disconnectpool, false);
@@ -2703,6 +3478,7 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         fBlocksDisconnected = true;
     }
+    readahead.reset();
 
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
@@ -2721,6 +3497,17 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
         }
         nHeight = nTargetHeight;
 
+        // When there is more than one block to connect, have them read from disk ahead of time.
+        if (vpindexToConnect.size() > 1) {
+            std::vector<const CBlockIndex*> vpindexReadAhead;
+            for (const CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+                if (pindexConnect == pindexMostWork && pblock)
+                    break;
+                vpindexReadAhead.push_back(pindexConnect);
+            }
+            blockReadAhead.Schedule(vpindexReadAhead);
+        }
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
@@ -2806,12 +3593,10 @@ bool CChainState::ActivateBestChain(CValidationState &state, const CChainParams&
     do {
         boost::this_thread::interruption_point();
 
-        if (GetMainSignals().CallbacksPending() > 10) {
-            // Block until the validation queue drains. This should largely
-            // never happen in normal operation, however may happen during
-            // reindex, causing memory blowup if we run too far ahead.
-            SyncWithValidationInterfaceQueue();
-        }
+        // Block until the listeners that fell behind catch up. This should
+        // largely never happen in normal operation, however may happen
+        // during reindex, causing memory blowup if we run too far ahead.
+        LimitValidationInterfaceQueue();
 
         const CBlockIndex *pindexFork;
         bool fInitialDownload;
@@ -3021,7 +3806,9 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
+    CacheBlockAuxpow(hash, block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3035,6 +3822,7 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
     }
+    pindexNew->BuildPrevAlgo();
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
@@ -3050,7 +3838,8 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
 bool CChainState::ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     pindexNew->nTx = block.vtx.size();
-    pindexNew->nChainTx = 0;
+    if (pindexNew != pindexSnapshotBase)
+        pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
@@ -3119,7 +3908,8 @@ static bool FindBlockPos(CDiskBlockPos &pos, unsigned int nAddSize, unsigned int
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+            return AbortNode("Failed to write block or undo data");
         nLastBlockFile = nFile;
     }
 
@@ -3514,7 +4304,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3533,7 +4323,7 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3562,8 +4352,12 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
             }
         }
     }
-    if (pindex == nullptr)
+    if (pindex == nullptr) {
         pindex = AddToBlockIndex(block);
+        // The proof of work was verified above or by PreVerifyHeadersPoW, no need to redo that on the next startup.
+        if (!block.IsAuxpow())
+            pindex->nStatus |= BLOCK_POW_VERIFIED;
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3576,15 +4370,163 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+namespace {
+
+/**
+ * Closure representing the proof of work check of a header, or of up to
+ * POW_HASH_BATCH_SIZE headers with the same algo and multihasher version whose
+ * PoW hashes are computed together. The outcome is recorded instead of failing
+ * the queue, so that rejected headers can be checked again by
+ * AcceptBlockHeader, which reports the exact reason and DoS score.
+ */
+class CHeaderPoWCheck
+{
+private:
+    std::vector<std::pair<const CBlockHeader*, char*>> vHeaders;
+    const Consensus::Params *pconsensusParams;
+    //! Of the thread that queued the check, the hashes are counted under it
+    HashPurpose hashPurpose;
+
+public:
+    CHeaderPoWCheck(): pconsensusParams(nullptr), hashPurpose(GetHashPurpose()) {}
+    explicit CHeaderPoWCheck(const Consensus::Params& consensusParamsIn) : pconsensusParams(&consensusParamsIn), hashPurpose(GetHashPurpose()) { }
+    CHeaderPoWCheck(const CBlockHeader& header, const Consensus::Params& consensusParamsIn, char& fValid) :
+        vHeaders(1, std::make_pair(&header, &fValid)), pconsensusParams(&consensusParamsIn), hashPurpose(GetHashPurpose()) { }
+
+    void Add(const CBlockHeader& header, char& fValid) { vHeaders.emplace_back(&header, &fValid); }
+    size_t size() const { return vHeaders.size(); }
+
+    bool operator()()
+    {
+        CHashPurposeScope scope(hashPurpose);
+        if (vHeaders.size() > 1) {
+            // The group shares algo, auxpow-ness and multihasher version, see CheckProofOfWorkBatch
+            const CBlockHeader& first = *vHeaders[0].first;
+            const uint8_t nAlgo = first.GetAlgo();
+            if (first.auxpow) {
+                std::vector<const CDefaultBlockHeader*> vpparents;
+                for (const auto& entry : vHeaders)
+                    vpparents.push_back(&entry.first->auxpow->getDefaultParentBlock());
+                PrecomputePoWHashes(vpparents, nAlgo, LoadMultiHasherVersionFlags(true));
+            } else {
+                std::vector<const CPureBlockHeader*> vpheaders;
+                for (const auto& entry : vHeaders)
+                    vpheaders.push_back(entry.first);
+                PrecomputePoWHashes(vpheaders, nAlgo, LoadMultiHasherVersionFlags(pconsensusParams->Hardfork3.IsActivated(first.nTime)));
+            }
+        }
+        for (const auto& entry : vHeaders) {
+            bool equihashvalidator;
+            *entry.second = CheckProofOfWork(*entry.first, *pconsensusParams, equihashvalidator) && equihashvalidator;
+        }
+        return true;
+    }
+
+    void swap(CHeaderPoWCheck &check) {
+        vHeaders.swap(check.vHeaders);
+        std::swap(pconsensusParams, check.pconsensusParams);
+        std::swap(hashPurpose, check.hashPurpose);
+    }
+};
+
+CCheckQueue<CHeaderPoWCheck> headerverifyqueue(16);
+
+/**
+ * Check the proof of work of all headers not yet in mapBlockIndex through
+ * CheckProofOfWorkBatch, without holding cs_main. fPoWValid[i] is set if the
+ * PoW of headers[i] was found valid and need not be checked again.
+ */
+void PreVerifyHeadersPoW(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, std::vector<char>& fPoWValid)
+{
+    fPoWValid.assign(headers.size(), false);
+    if (headers.size() < 2)
+        return;
+
+    std::vector<uint256> vHashes;
+    vHashes.reserve(headers.size());
+    for (const CBlockHeader& header : headers)
+        vHashes.push_back(header.GetHash());
+
+    std::vector<size_t> vIndex;
+    std::vector<const CBlockHeader*> vpheaders;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!mapBlockIndex.count(vHashes[i])) {
+                vIndex.push_back(i);
+                vpheaders.push_back(&headers[i]);
+            }
+        }
+    }
+    if (vpheaders.size() < 2)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<char> fValid;
+    CheckProofOfWorkBatch(vpheaders, consensusParams, fValid);
+    for (size_t j = 0; j < vIndex.size(); j++)
+        fPoWValid[vIndex[j]] = fValid[j];
+    LogPrint(BCLog::BENCH, "    - Verify %u header PoW: %.2fms\n", vpheaders.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+} // namespace
+
+void ThreadHeaderVerify() {
+    RenameThread("globaltoken-headerch");
+    headerverifyqueue.Thread();
+}
+
+void CheckProofOfWorkBatch(const std::vector<const CBlockHeader*>& vpheaders, const Consensus::Params& consensusParams, std::vector<char>& fPoWValid)
+{
+    fPoWValid.assign(vpheaders.size(), false);
+
+    // Headers of an algo with batch kernel are grouped by what their PoW hash
+    // depends on, the others are checked one per closure.
+    std::vector<CHeaderPoWCheck> vChecks;
+    std::map<std::tuple<uint8_t, bool, int>, CHeaderPoWCheck> mapGroups;
+    vChecks.reserve(vpheaders.size());
+    for (size_t i = 0; i < vpheaders.size(); i++) {
+        const CBlockHeader& header = *vpheaders[i];
+        const uint8_t nAlgo = header.GetAlgo();
+        if (!HasPoWHashBatchKernel(nAlgo)) {
+            vChecks.emplace_back(header, consensusParams, fPoWValid[i]);
+            continue;
+        }
+        const bool fAuxpow = (bool)header.auxpow;
+        const int nHashVersion = LoadMultiHasherVersionFlags(fAuxpow || consensusParams.Hardfork3.IsActivated(header.nTime));
+        CHeaderPoWCheck& group = mapGroups.emplace(std::make_tuple(nAlgo, fAuxpow, nHashVersion), CHeaderPoWCheck(consensusParams)).first->second;
+        group.Add(header, fPoWValid[i]);
+        if (group.size() == POW_HASH_BATCH_SIZE) {
+            vChecks.emplace_back(consensusParams);
+            vChecks.back().swap(group);
+        }
+    }
+    for (auto& entry : mapGroups) {
+        if (entry.second.size() > 0) {
+            vChecks.emplace_back(consensusParams);
+            vChecks.back().swap(entry.second);
+        }
+    }
+
+    CCheckQueueControl<CHeaderPoWCheck> control(&headerverifyqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
+    // A header announcing a new block is checked on its own, its argon2 lanes can use the idle cores
+    CArgon2ParallelScope argon2Scope(headers.size() == 1 && !IsInitialBlockDownload());
+    std::vector<char> fPoWValid;
+    PreVerifyHeadersPoW(headers, chainparams.GetConsensus(), fPoWValid);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex, !fPoWValid[i])) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3617,7 +4559,7 @@ static CDiskBlockPos SaveBlockToDisk(const CBlock& block, int nHeight, const CCh
 }
 
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
-bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
+bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fCheckPOW)
 {
     const CBlock& block = *pblock;
 
@@ -3627,7 +4569,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, fCheckPOW))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3663,7 +4605,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     }
     if (fNewBlock) *fNewBlock = true;
 
-    if (!CheckBlock(block, state, chainparams.GetConsensus()) ||
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), fCheckPOW) ||
         !ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3708,7 +4650,11 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         CValidationState state;
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
-        bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
+        bool ret;
+        {
+            CArgon2ParallelScope argon2Scope(!IsInitialBlockDownload());
+            ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
+        }
 
         LOCK(cs_main);
 
@@ -3754,6 +4700,42 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     return true;
 }
 
+bool CChainState::ActivateSnapshot(CBlockIndex* pindexBase, uint64_t nChainTx)
+{
+    AssertLockHeld(cs_main);
+    assert(chainActive.Height() == 0 && pcoinsTip->GetBestBlock() == pindexBase->GetBlockHash());
+
+    pindexBase->nChainTx = nChainTx;
+    pindexSnapshotBase = pindexBase;
+    fSnapshotValidated = false;
+    chainActive.SetTip(pindexBase);
+    // Nothing spends what the mempool has against the genesis block anymore
+    mempool.clear();
+    setBlockIndexCandidates.insert(pindexBase);
+    PruneBlockIndexCandidates();
+    UpdateTip(pindexBase, Params());
+    return true;
+}
+
+bool ActivateSnapshot(CBlockIndex* pindexBase, uint64_t nChainTx)
+{
+    return g_chainstate.ActivateSnapshot(pindexBase, nChainTx);
+}
+
+bool ConnectHistoricalBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    // Just checking skips the undo data, which cannot be written below the snapshot base
+    if (!g_chainstate.ConnectBlock(block, state, pindex, view, chainparams, true))
+        return false;
+    view.SetBestBlock(pindex->GetBlockHash());
+    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+    }
+    return true;
+}
+
 /**
  * BLOCK PRUNING CODE
  */
@@ -3809,6 +4791,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        UnmapBlockFile(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3942,11 +4925,15 @@ static FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fRe
 }
 
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly) {
+    if (fReadOnly)
+        WaitForBlockFileWrites(pos.nFile);
     return OpenDiskFile(pos, "blk", fReadOnly);
 }
 
 /** Open an undo file (rev?????.dat) */
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
+    if (fReadOnly)
+        WaitForBlockFileWrites(pos.nFile, true);
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
@@ -3966,7 +4953,7 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -3975,11 +4962,22 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
 
 bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }, checkPoWOnLoad))
         return false;
 
     boost::this_thread::interruption_point();
 
+    CSnapshotBase snapshot;
+    if (blocktree.ReadSnapshotBase(snapshot)) {
+        if (!snapshot.fLoaded)
+            return error("%s: loading the chainstate snapshot at %s was interrupted", __func__, snapshot.hashBlock.ToString());
+        BlockMap::iterator it = mapBlockIndex.find(snapshot.hashBlock);
+        if (it == mapBlockIndex.end())
+            return error("%s: the base %s of the chainstate snapshot is not in the block index", __func__, snapshot.hashBlock.ToString());
+        pindexSnapshotBase = it->second;
+        fSnapshotValidated = snapshot.fValidated;
+    }
+
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -4008,16 +5006,20 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
                 pindex->nChainTx = pindex->nTx;
             }
         }
+        // The base of a snapshot counts the transactions of the history that may not be here yet
+        if (pindex == pindexSnapshotBase && pindex->nChainTx == 0)
+            pindex->nChainTx = snapshot.nChainTx;
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK)) {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == nullptr))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == nullptr)) || pindex == pindexSnapshotBase)
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
+        pindex->BuildPrevAlgo();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -4027,9 +5029,6 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!g_chainstate.LoadBlockIndex(chainparams.GetConsensus(), *pblocktree))
-        return false;
-
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -4047,6 +5046,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         }
     }
 
+    // Every block stored in the block files has an index entry, so size the map for them up front.
+    size_t nStoredBlocks = 0;
+    for (const CBlockFileInfo& info : vinfoBlockFile) {
+        nStoredBlocks += info.nBlocks;
+    }
+    mapBlockIndex.reserve(nStoredBlocks);
+
+    if (!g_chainstate.LoadBlockIndex(chainparams.GetConsensus(), *pblocktree))
+        return false;
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -4075,9 +5084,9 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
+    // Check whether we have a coin stats index
+    pblocktree->ReadFlag("coinstatsindex", fCoinStatsIndex);
+    LogPrintf("%s: coin stats index %s\n", __func__, fCoinStatsIndex ? "enabled" : "disabled");
 
     return true;
 }
@@ -4101,6 +5110,7 @@ bool LoadChainTip(const CChainParams& chainparams)
     if (it == mapBlockIndex.end())
         return false;
     chainActive.SetTip(it->second);
+    algoHashrateIndex.SetTip(chainActive, chainparams.GetConsensus());
 
     g_chainstate.PruneBlockIndexCandidates();
 
@@ -4111,53 +5121,113 @@ bool LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+namespace {
+
+/**
+ * Closure representing the re-validation of one stored auxpow header.
+ * The disk position is copied in beforehand, so the check runs without cs_main.
+ */
+class CAuxpowCheck
+{
+private:
+    uint256 hashBlock;
+    CDiskBlockPos pos;
+    int nHeight;
+    const Consensus::Params *pconsensusParams;
+
+public:
+    CAuxpowCheck(): nHeight(0), pconsensusParams(nullptr) {}
+    CAuxpowCheck(const CBlockIndex& index, const Consensus::Params& consensusParamsIn) :
+        hashBlock(index.GetBlockHash()), pos(index.GetBlockPos()), nHeight(index.nHeight), pconsensusParams(&consensusParamsIn) { }
+
+    bool operator()()
+    {
+        // ReadBlockHeaderFromDisk checks the pow (and the auxpow) of the header it reads.
+        CBlockHeader header;
+        if (!ReadBlockHeaderFromDisk(header, pos, *pconsensusParams) || header.GetHash() != hashBlock)
+            return error("Auxpow is invalid! Blockhash = %s, Blockheight = %d Reason: Aux-Proof of Work validation failed ...", hashBlock.GetHex(), nHeight);
+        return true;
+    }
+
+    void swap(CAuxpowCheck &check) {
+        std::swap(hashBlock, check.hashBlock);
+        std::swap(pos, check.pos);
+        std::swap(nHeight, check.nHeight);
+        std::swap(pconsensusParams, check.pconsensusParams);
+    }
+};
+
+/** Number of auxpow headers handed to the check queue between progress updates */
+static const size_t AUXPOW_VALIDATION_CHUNK_SIZE = 1000;
+
+} // namespace
+
 bool VerifyAuxpowBlockIndex(std::string &strErrMsg, const Consensus::Params& consensusParams)
 {
     LOCK(cs_main);
-    
-    double auxPowValidationProgress = 0.0;
 
-    CBlockIndex* pAuxPowValidationCheckIndex = nullptr;
-    CBlockHeader currentBlockHeader;
-    size_t vectorsize = vAuxpowValidation.size();
-    
-    // Sort the vector by hash, so we can speed up mapBlockIndex loading time
-    sort(vAuxpowValidation.begin(), vAuxpowValidation.end());
-    
-    for(size_t i = 0; i < vectorsize; i++)
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(vAuxpowValidation.size());
+
+    for (const uint256& hash : vAuxpowValidation)
     {
-        if (mapBlockIndex.count(vAuxpowValidation[i]) != 0)
+        BlockMap::const_iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
         {
-            pAuxPowValidationCheckIndex = mapBlockIndex[vAuxpowValidation[i]];
-            
-            if(pAuxPowValidationCheckIndex == nullptr)
-            {
-                strErrMsg = _("Error while loading Blockindex Cache!");
-                LogPrintf("Couldn't load blockindex cache ... Shutting down ...\n");
-                return false;
-            }
-            
-            auxPowValidationProgress = static_cast<double>(i) / static_cast<double>(vectorsize);
-            auxPowValidationProgress *= 100.0;
-            
-            // We don't need to check the auxpow here, because GetBlockHeader reads this auxpow block from disk, and checks the pow.
-            currentBlockHeader = pAuxPowValidationCheckIndex->GetBlockHeader(consensusParams);
-            
-            if(!currentBlockHeader.fAuxPowChecked)
-            {
-                strErrMsg = _("Found invalid auxpow! Shutting down.\nFor more details, check your debug.log file!");
-                LogPrintf("Auxpow is invalid! Blockhash = %s, Blockheight = %d Reason: Aux-Proof of Work validation failed ...\n", pAuxPowValidationCheckIndex->GetBlockHash().GetHex(), pAuxPowValidationCheckIndex->nHeight);
-                return false;
-            }
-            uiInterface.ShowProgressAsDouble(_("Verifying auxpow blocks..."), auxPowValidationProgress);
+            strErrMsg = _("Failed to check auxpow blocks! Shutting down.\nFor more details, check your debug.log file!");
+            LogPrintf("Auxpow is invalid! Blockhash = %s Reason: Could not load blockhash from mapBlockIndex ...\n", hash.GetHex());
+            return false;
         }
-        else
+        if (it->second == nullptr)
         {
-            strErrMsg = _("Failed to check auxpow blocks! Shutting down.\nFor more details, check your debug.log file!");
-            LogPrintf("Auxpow is invalid! Blockhash = %s, Blockheight = %d Reason: Could not load blockhash from mapBlockIndex ...\n");
+            strErrMsg = _("Error while loading Blockindex Cache!");
+            LogPrintf("Couldn't load blockindex cache ... Shutting down ...\n");
             return false;
         }
+        vIndex.push_back(it->second);
     }
+
+    // Read the headers in file order, so the disk access stays sequential
+    std::sort(vIndex.begin(), vIndex.end(), [](const CBlockIndex* pa, const CBlockIndex* pb) {
+        return std::make_pair(pa->nFile, pa->nDataPos) < std::make_pair(pb->nFile, pb->nDataPos);
+    });
+
+    // The script check workers are bound to their own queue, so spin up
+    // dedicated workers for the duration of the validation.
+    CCheckQueue<CAuxpowCheck> auxpowcheckqueue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+        threadGroup.create_thread([&auxpowcheckqueue]() {
+            RenameThread("globaltoken-auxpowch");
+            auxpowcheckqueue.Thread();
+        });
+    }
+
+    bool fOk = true;
+    for (size_t i = 0; fOk && i < vIndex.size(); i += AUXPOW_VALIDATION_CHUNK_SIZE)
+    {
+        std::vector<CAuxpowCheck> vChecks;
+        vChecks.reserve(AUXPOW_VALIDATION_CHUNK_SIZE);
+        for (size_t j = i; j < std::min(vIndex.size(), i + AUXPOW_VALIDATION_CHUNK_SIZE); j++)
+            vChecks.emplace_back(*vIndex[j], consensusParams);
+
+        // The master thread joins the workers in Wait(), so this also works without extra threads.
+        CCheckQueueControl<CAuxpowCheck> control(&auxpowcheckqueue);
+        control.Add(vChecks);
+        fOk = control.Wait();
+
+        uiInterface.ShowProgressAsDouble(_("Verifying auxpow blocks..."), 100.0 * static_cast<double>(i) / static_cast<double>(vIndex.size()));
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    if (!fOk)
+    {
+        strErrMsg = _("Found invalid auxpow! Shutting down.\nFor more details, check your debug.log file!");
+        return false;
+    }
+
     ClearAuxpowValidationCache();
     return true;
 }
@@ -4178,6 +5248,112 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
+namespace {
+
+/** Number of blocks VerifyDB checks the proof of work of at once */
+const int VERIFYDB_POW_BATCH_SIZE = 1000;
+
+/**
+ * Check the proof of work of up to VERIFYDB_POW_BATCH_SIZE blocks from pindex
+ * backwards, not below nMinHeight and, if pruning, not past the first block
+ * without data. Auxpow headers are left out, the auxpow kept in memory need
+ * not be the one stored with the block. Returns the first block not checked.
+ */
+const CBlockIndex* CheckBlockIndexPoWBatch(const CBlockIndex* pindex, int nMinHeight, const Consensus::Params& consensusParams, std::map<const CBlockIndex*, bool>& mapPoWValid)
+{
+    std::vector<const CBlockIndex*> vpindex;
+    std::vector<CBlockHeader> vHeaders;
+    for (int i = 0; i < VERIFYDB_POW_BATCH_SIZE && pindex && pindex->pprev; i++, pindex = pindex->pprev) {
+        if (pindex->nHeight < nMinHeight || (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)))
+            break;
+        if (CPureBlockVersion(pindex->nVersion).IsAuxpow())
+            continue;
+        vpindex.push_back(pindex);
+        vHeaders.push_back(pindex->GetBlockHeader(consensusParams));
+    }
+
+    std::vector<const CBlockHeader*> vpheaders;
+    for (const CBlockHeader& header : vHeaders)
+        vpheaders.push_back(&header);
+    std::vector<char> fPoWValid;
+    CheckProofOfWorkBatch(vpheaders, consensusParams, fPoWValid);
+    for (size_t i = 0; i < vpindex.size(); i++)
+        mapPoWValid[vpindex[i]] = fPoWValid[i];
+    return pindex;
+}
+
+/** Number of blocks VerifyDB reads ahead per thread, they stay in memory until they are checked */
+const int VERIFYDB_BLOCKS_PER_THREAD = 4;
+/** Maximum number of threads VerifyDB reads blocks on */
+const int MAX_VERIFYDB_THREADS = 16;
+
+/** A block VerifyDB checks, with the results of the checks that do not need cs_main */
+struct VerifyDBBlock
+{
+    const CBlockIndex* pindex;
+    CBlockReadRequest request;
+    CDiskBlockPos posUndo;
+    bool fUndoCompact;
+    CBlock block;
+    bool fRead = false;
+    //! The part of CheckBlock that hashes every transaction
+    bool fMerkleRootValid = false;
+    bool fUndoRead = false;
+};
+
+/**
+ * Read the blocks from pindex backwards, nCount at most, not below nMinHeight
+ * and stopping where VerifyDB stops, on up to nThreads threads: check levels
+ * 0 and 2 and the merkle root of level 1. The threads do not lock cs_main,
+ * which the caller holds, everything they need of the index is looked up
+ * before they start.
+ */
+void ReadVerifyDBBatch(const CBlockIndex* pindex, int nMinHeight, int nCount, int nThreads, int nCheckLevel, const Consensus::Params& consensusParams, std::vector<VerifyDBBlock>& vBatch)
+{
+    AssertLockHeld(cs_main);
+    vBatch.clear();
+    vBatch.reserve(nCount);
+    for (; (int)vBatch.size() < nCount && pindex && pindex->pprev; pindex = pindex->pprev) {
+        if (pindex->nHeight < nMinHeight || (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) || pindex == pindexSnapshotBase)
+            break;
+        vBatch.emplace_back();
+        VerifyDBBlock& entry = vBatch.back();
+        entry.pindex = pindex;
+        entry.request = GetBlockReadRequest(pindex);
+        entry.posUndo = pindex->GetUndoPos();
+        entry.fUndoCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+    }
+
+    std::atomic<size_t> nNext{0};
+    auto read = [&]() {
+        for (size_t i = nNext++; i < vBatch.size(); i = nNext++) {
+            VerifyDBBlock& entry = vBatch[i];
+            {
+                CBlockArenaScope arena;
+                entry.fRead = ReadBlockFromDisk(entry.block, entry.request, consensusParams);
+            }
+            if (!entry.fRead)
+                continue;
+            if (nCheckLevel >= 1) {
+                bool mutated;
+                entry.fMerkleRootValid = BlockMerkleRoot(entry.block, &mutated) == entry.block.hashMerkleRoot && !mutated;
+            }
+            if (nCheckLevel >= 2) {
+                CBlockUndo undo;
+                entry.fUndoRead = entry.posUndo.IsNull() || UndoReadFromDisk(undo, entry.posUndo, entry.pindex->pprev->GetBlockHash(), entry.fUndoCompact);
+            }
+        }
+    };
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < std::min(nThreads, (int)vBatch.size()); i++)
+        vThreads.emplace_back(read);
+    read();
+    for (std::thread& thread : vThreads)
+        thread.join();
+}
+
+} // namespace
+
 bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -4195,6 +5371,13 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
     int reportDone = 0;
+    // Level 1 checks the PoW of the headers, VERIFYDB_POW_BATCH_SIZE blocks ahead at a time
+    std::map<const CBlockIndex*, bool> mapPoWValid;
+    const CBlockIndex* pindexPoWChecked = chainActive.Tip();
+    // Levels 0 to 2 are checked on several threads, one batch of blocks at a time
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_VERIFYDB_THREADS));
+    std::vector<VerifyDBBlock> vBatch;
+    size_t nBatchPos = 0;
     LogPrintf("[0%%]...");
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
@@ -4213,23 +5396,33 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
-        CBlock block;
+        if (pindex == pindexSnapshotBase) {
+            // The blocks up to the base of a chainstate snapshot were not connected here.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (chainstate snapshot base)\n", pindex->nHeight);
+            break;
+        }
+        if (nCheckLevel >= 1 && pindex == pindexPoWChecked) {
+            mapPoWValid.clear();
+            pindexPoWChecked = CheckBlockIndexPoWBatch(pindex, chainActive.Height() - nCheckDepth, chainparams.GetConsensus(), mapPoWValid);
+        }
+        if (nBatchPos == vBatch.size()) {
+            ReadVerifyDBBatch(pindex, chainActive.Height() - nCheckDepth, nThreads * VERIFYDB_BLOCKS_PER_THREAD, nThreads, nCheckLevel, chainparams.GetConsensus(), vBatch);
+            nBatchPos = 0;
+        }
+        VerifyDBBlock& entry = vBatch[nBatchPos++];
+        assert(entry.pindex == pindex);
+        CBlock block = std::move(entry.block);
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+        if (!entry.fRead)
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
+        // check level 1: verify block validity, the block read has the hash and so the header found valid by CheckBlockIndexPoWBatch.
+        // CheckBlock runs here as it may lock cs_main, a merkle root found invalid is checked again for its error.
+        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus(), !mapPoWValid[pindex], !entry.fMerkleRootValid))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
                          pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
-            }
-        }
+        if (nCheckLevel >= 2 && !entry.fUndoRead)
+            return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
@@ -4368,7 +5561,8 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
 
     // Note that during -reindex-chainstate we are called with an empty chainActive!
 
-    int nHeight = 1;
+    // The blocks up to a snapshot base were never connected here and have no undo data to rewind with
+    int nHeight = pindexSnapshotBase ? pindexSnapshotBase->nHeight + 1 : 1;
     while (nHeight <= chainActive.Height()) {
         if (IsWitnessEnabled(chainActive[nHeight - 1], params.GetConsensus()) && !(chainActive[nHeight]->nStatus & BLOCK_OPT_WITNESS)) {
             break;
@@ -4470,6 +5664,8 @@ void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     g_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 // May NOT be used after any connections are up as much
@@ -4479,6 +5675,7 @@ void UnloadBlockIndex()
 {
     LOCK(cs_main);
     chainActive.SetTip(nullptr);
+    algoHashrateIndex.Clear();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
     mempool.clear();
@@ -4492,15 +5689,29 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
-    mapBlockIndex.clear();
     fHavePruned = false;
 
     g_chainstate.UnloadBlockIndex();
 }
 
+size_t CChainState::BlockIndexDynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(mapBlockIndex) + blockIndexArena.DynamicMemoryUsage();
+    for (const auto& entry : mapBlockIndex) {
+        const std::shared_ptr<const CEquihashFields> pFields = entry.second->pEquihashFields.Load();
+        if (pFields) {
+            nUsage += memusage::DynamicUsage(pFields) + memusage::DynamicUsage(pFields->nSolution);
+        }
+    }
+    return nUsage;
+}
+
+size_t BlockIndexDynamicMemoryUsage()
+{
+    AssertLockHeld(cs_main);
+    return g_chainstate.BlockIndexDynamicMemoryUsage();
+}
+
 bool LoadBlockIndex(const CChainParams& chainparams)
 {
     // Load block index from databases
@@ -4519,9 +5730,8 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
+        fCoinStatsIndex = gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
+        pblocktree->WriteFlag("coinstatsindex", fCoinStatsIndex);
     }
     return true;
 }
@@ -4558,10 +5768,130 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** A block read by LoadExternalBlockFile, with the position it was read from */
+struct CImportedBlock
+{
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+};
+
+/**
+ * Disk positions of blocks with unknown parent (only used for reindex), by
+ * parent hash, and whether their proof of work was found valid already.
+ */
+std::multimap<uint256, std::pair<CDiskBlockPos, bool>> mapBlocksUnknownParent;
+
+/**
+ * Accept the blocks LoadExternalBlockFile read, in the order they were read.
+ * The proof of work of all the blocks to accept is checked first, at once on
+ * the header verification threads, which split them up by algo; accepting
+ * them does not check it again. Returns false if the import has to stop.
+ */
+bool AcceptImportedBlocks(const CChainParams& chainparams, std::vector<CImportedBlock>& vBlocks, bool fKnownPos, int& nLoaded)
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+
+    std::vector<uint256> vHashes;
+    std::vector<size_t> vIndex;
+    std::vector<const CBlockHeader*> vpheaders;
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vHashes.push_back(vBlocks[i].pblock->GetHash());
+            BlockMap::const_iterator mi = mapBlockIndex.find(vHashes[i]);
+            if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0) {
+                vIndex.push_back(i);
+                vpheaders.push_back(vBlocks[i].pblock.get());
+            }
+        }
+    }
+    std::vector<char> fPoWValid(vBlocks.size(), false);
+    {
+        std::vector<char> fValid;
+        CheckProofOfWorkBatch(vpheaders, consensusParams, fValid);
+        for (size_t j = 0; j < vIndex.size(); j++)
+            fPoWValid[vIndex[j]] = fValid[j];
+    }
+
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        boost::this_thread::interruption_point();
+
+        std::shared_ptr<CBlock> pblock = std::move(vBlocks[i].pblock);
+        CDiskBlockPos* dbp = fKnownPos ? &vBlocks[i].pos : nullptr;
+        const uint256& hash = vHashes[i];
+        try {
+            // detect out of order blocks, and store them for later
+            if (hash != consensusParams.hashGenesisBlock && mapBlockIndex.find(pblock->hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                        pblock->hashPrevBlock.ToString());
+                if (dbp)
+                    mapBlocksUnknownParent.insert(std::make_pair(pblock->hashPrevBlock, std::make_pair(*dbp, (bool)fPoWValid[i])));
+                continue;
+            }
+
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                LOCK(cs_main);
+                CValidationState state;
+                if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr, !fPoWValid[i]))
+                    nLoaded++;
+                if (state.IsError())
+                    return false;
+            } else if (hash != consensusParams.hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
+
+            // Activate the genesis block so normal node progress can continue
+            if (hash == consensusParams.hashGenesisBlock) {
+                CValidationState state;
+                if (!ActivateBestChain(state, chainparams)) {
+                    return false;
+                }
+            }
+
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                auto range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    auto it = range.first;
+                    const bool fChildPoWValid = it->second.second;
+                    std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                    if (ReadBlockOrHeader(*pblockrecursive, it->second.first, consensusParams, !fChildPoWValid))
+                    {
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                head.ToString());
+                        LOCK(cs_main);
+                        CValidationState dummy;
+                        if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second.first, nullptr, !fChildPoWValid))
+                        {
+                            nLoaded++;
+                            queue.push_back(pblockrecursive->GetHash());
+                        }
+                    }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
+                }
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -4570,6 +5900,10 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*nMaxBlockSerializedSize, nMaxBlockSerializedSize+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
+        // The blocks read so far, accepted once there are enough of them to check their PoW in parallel
+        std::vector<CImportedBlock> vBatch;
+        size_t nBatchBytes = 0;
+        bool fStop = false;
         while (!blkdat.eof()) {
             boost::this_thread::interruption_point();
 
@@ -4601,73 +5935,25 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                blkdat >> *pblock;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                vBatch.push_back(CImportedBlock{pblock, dbp ? *dbp : CDiskBlockPos()});
+                nBatchBytes += nSize;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+
+            if (vBatch.size() >= IMPORT_BATCH_BLOCKS || nBatchBytes >= IMPORT_BATCH_MAX_BYTES) {
+                fStop = !AcceptImportedBlocks(chainparams, vBatch, dbp != nullptr, nLoaded);
+                vBatch.clear();
+                nBatchBytes = 0;
+                if (fStop)
+                    break;
+            }
         }
+        if (!fStop)
+            AcceptImportedBlocks(chainparams, vBatch, dbp != nullptr, nLoaded);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -4692,6 +5978,11 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         return;
     }
 
+    // The active chain of a chainstate loaded from a snapshot starts with blocks that
+    // were never received, which the checks below take for corruption.
+    if (pindexSnapshotBase)
+        return;
+
     // Build forward-pointing map of the entire block tree.
     std::multimap<CBlockIndex*,CBlockIndex*> forward;
     for (auto& entry : mapBlockIndex) {
@@ -4890,6 +6181,122 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 #ifdef ENABLE_TREASURY
+/** Saves only rewrite the whole treasury file once the journal grows beyond the file itself or this size. */
+static const uint64_t MIN_TREASURY_JOURNAL_COMPACT_SIZE = 1 << 20;
+
+/**
+ * Apply the committed batches of the journal next to the treasury file, if the
+ * journal belongs to the file that was just loaded. A batch that was cut short
+ * by a crash is ignored and overwritten by the next save.
+ */
+static void ReplayTreasuryJournal(CTreasuryMempool &activeMempool)
+{
+    FILE* filestr = fsbridge::fopen(activeMempool.GetJournalFilePath(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return;
+
+    uint64_t nCommittedSize = 0;
+    size_t nBatches = 0;
+    std::vector<CTreasuryJournalEntry> vBatch;
+    try {
+        std::string strJournalMarker;
+        uint256 hashSnapshot;
+        file >> strJournalMarker;
+        file >> hashSnapshot;
+        if (strJournalMarker != CONST_TREASURY_JOURNAL_MARKER || hashSnapshot != activeMempool.GetSnapshotHash()) {
+            LogPrintf("Ignoring treasury journal %s, it does not belong to the loaded treasury file.\n", activeMempool.GetJournalFilePath().string().c_str());
+            return;
+        }
+        nCommittedSize = ftell(file.Get());
+
+        while (true) {
+            CTreasuryJournalEntry entry;
+            uint256 hashEntry;
+            file >> entry;
+            file >> hashEntry;
+            if (hashEntry != SerializeHash(entry) || !entry.IsKnownType())
+                break;
+
+            if (entry.nType != CTreasuryJournalEntry::COMMIT) {
+                vBatch.push_back(std::move(entry));
+                continue;
+            }
+
+            for (const CTreasuryJournalEntry& batchEntry : vBatch) {
+                activeMempool.ApplyJournalEntry(batchEntry);
+            }
+            activeMempool.ApplyJournalEntry(entry);
+            vBatch.clear();
+            nCommittedSize = ftell(file.Get());
+            nBatches++;
+        }
+    } catch (const std::exception&) {
+        // end of the journal
+    }
+
+    if (!vBatch.empty())
+        LogPrintf("Dropping %u uncommitted treasury journal entries.\n", vBatch.size());
+
+    activeMempool.DeleteExpiredProposals(GetTime());
+    activeMempool.SetPersisted(activeMempool.GetSnapshotHash(), activeMempool.GetSnapshotSize(), nCommittedSize);
+    LogPrintf("Replayed %u saves from treasury journal %s\n", nBatches, activeMempool.GetJournalFilePath().string().c_str());
+}
+
+/**
+ * Append everything that changed since the last save to the journal next to the
+ * treasury file, as one committed batch. Returns false if the file on disk is not
+ * from this mempool, the journal has grown too large or could not be written; the
+ * caller then rewrites the whole file.
+ */
+static bool AppendTreasuryJournal(CTreasuryMempool &activeMempool)
+{
+    if (!activeMempool.HasSnapshot())
+        return false;
+
+    std::vector<CTreasuryJournalEntry> vEntries;
+    activeMempool.GetUnpersistedChanges(vEntries);
+    CTreasuryJournalEntry commit;
+    commit.nType = CTreasuryJournalEntry::COMMIT;
+    commit.nLastSaved = activeMempool.GetLastSaved();
+    vEntries.push_back(commit);
+
+    CDataStream ssJournal(SER_DISK, CLIENT_VERSION);
+    if (activeMempool.GetJournalSize() == 0) {
+        ssJournal << CONST_TREASURY_JOURNAL_MARKER;
+        ssJournal << activeMempool.GetSnapshotHash();
+    }
+    for (const CTreasuryJournalEntry& entry : vEntries) {
+        ssJournal << entry;
+        ssJournal << SerializeHash(entry);
+    }
+
+    const uint64_t nNewJournalSize = activeMempool.GetJournalSize() + ssJournal.size();
+    if (nNewJournalSize > std::max(activeMempool.GetSnapshotSize(), MIN_TREASURY_JOURNAL_COMPACT_SIZE))
+        return false;
+
+    const fs::path pathJournal = activeMempool.GetJournalFilePath();
+    try {
+        // cut off a batch a crash may have left half written
+        if (activeMempool.GetJournalSize() > 0)
+            fs::resize_file(pathJournal, activeMempool.GetJournalSize());
+        FILE* filestr = fsbridge::fopen(pathJournal, activeMempool.GetJournalSize() > 0 ? "ab" : "wb");
+        if (!filestr)
+            return false;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file.write(ssJournal.data(), ssJournal.size());
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to append to treasury journal: %s. Rewriting the treasury file instead.\n", e.what());
+        return false;
+    }
+
+    activeMempool.SetPersisted(activeMempool.GetSnapshotHash(), activeMempool.GetSnapshotSize(), nNewJournalSize);
+    LogPrintf("Dumped %u treasury mempool changes to journal\n", vEntries.size() - 1);
+    return true;
+}
+
 bool LoadTreasuryMempool(CTreasuryMempool &activeMempool, std::string &error)
 {
     AssertLockHeld(cs_treasury);
@@ -4908,6 +6315,8 @@ bool LoadTreasuryMempool(CTreasuryMempool &activeMempool, std::string &error)
         return false;
     }
 
+    ReplayTreasuryJournal(activeMempool);
+
     LogPrintf("Imported treasury mempool proposals from disk: %i items loaded from file %s | Last edited: %lu\n", activeMempool.vTreasuryProposals.size(), activeMempool.GetTreasuryFilePath().string().c_str(), (unsigned long)activeMempool.GetLastSaved());
     return true;
 }
@@ -4946,6 +6355,7 @@ bool TreasuryMempoolSanityChecks(CTreasuryMempool &activeMempool, std::string &e
             }
             tempmempool.DeleteExpiredProposals(GetTime());
             tempmempool.RemoveDummyInputs();
+            tempmempool.SetPersisted(hash, fs::file_size(activeMempool.GetTreasuryFilePath()), 0);
             activeMempool = tempmempool;
         } catch (const std::exception& e) {
             error = "Failed to deserialize treasury mempool data on disk. See debug.log for details.";
@@ -4962,37 +6372,85 @@ bool DumpTreasuryMempool(CTreasuryMempool &activeMempool, std::string &error)
     const uint32_t nSystemtime = GetTime();
     activeMempool.SetLastSaved(nSystemtime);
     activeMempool.DeleteExpiredProposals(nSystemtime);
+    
+    // Usually only a few proposals changed, append those to the journal of the file on disk.
+    if (AppendTreasuryJournal(activeMempool))
+        return true;
+    
     activeMempool.InsertDummyInputs();
     
     fs::path pathTmp(activeMempool.GetTreasuryFilePath().string() + std::string(".new"));
+    uint256 hash = activeMempool.GetHash();
 
     try {
         FILE* filestr = fsbridge::fopen(pathTmp, "wb");
         if (!filestr) {
+            activeMempool.RemoveDummyInputs();
             error = "Could not open file for write: " + activeMempool.GetTreasuryFilePath().string();
             return false;
         }
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
         std::string strTreasuryMarker = CONST_TREASURY_FILE_MARKER;
-        uint256 hash = activeMempool.GetHash();
         file << strTreasuryMarker;
         file << hash;
         file << activeMempool;
         FileCommit(file.Get());
         file.fclose();
         RenameOver(pathTmp, activeMempool.GetTreasuryFilePath());
+        // The new file already has everything of the journal.
+        fs::remove(activeMempool.GetJournalFilePath());
         LogPrintf("Dumped treasury mempool\n");
     } catch (const std::exception& e) {
+        activeMempool.RemoveDummyInputs();
         error = "Error while writing treasury mempool. See debug.log for details.";
         LogPrintf("Failed to dump treasury mempool: %s. Continuing anyway.\n", e.what());
         return false;
     }
+    activeMempool.RemoveDummyInputs();
+    activeMempool.SetPersisted(hash, fs::file_size(activeMempool.GetTreasuryFilePath()), 0);
     return true;
 }
 #endif
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of transactions read from mempool.dat that are accepted under one cs_main lock */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+static CCriticalSection cs_dumpmempool;
+//! mempool.GetTransactionsUpdated() when mempool.dat was last written or read
+static unsigned int nMempoolUpdatesDumped GUARDED_BY(cs_dumpmempool) = 0;
+static bool fMempoolDumped GUARDED_BY(cs_dumpmempool) = false;
+
+/**
+ * Run the scripts of a batch of transactions read from mempool.dat on the
+ * script-checking threads, leaving their signatures in the signature cache
+ * for AcceptToMemoryPool to find when it accepts them one by one. The batch
+ * may spend its own outputs, so those are added to a view that is dropped
+ * afterwards. Results are not used, AcceptToMemoryPool still decides.
+ */
+static void PrecheckMempoolScripts(const std::vector<CTransactionRef>& vtx)
+{
+    AssertLockHeld(cs_main);
+    LOCK(mempool.cs);
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+    CCoinsViewCache view(&viewMemPool);
+    std::vector<PrecomputedTransactionData> vtxdata;
+    vtxdata.reserve(vtx.size()); // the checks point into it
+    std::vector<CScriptCheck> vChecks;
+    for (const CTransactionRef& tx : vtx) {
+        if (view.HaveInputs(*tx)) {
+            CValidationState state;
+            vtxdata.emplace_back(*tx);
+            CheckInputs(*tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, vtxdata.back(), &vChecks);
+        }
+        AddCoins(view, *tx, MEMPOOL_HEIGHT, true);
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = Params();
@@ -5018,22 +6476,38 @@ bool LoadMempool(void)
         }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime;
+        while (num) {
+            vtx.clear();
+            vTime.clear();
+            for (; num && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE; num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
+                } else {
+                    ++expired;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+
+            LOCK(cs_main);
+            if (nScriptCheckThreads) {
+                PrecheckMempoolScripts(vtx);
+            }
+            for (size_t i = 0; i < vtx.size(); i++) {
+                CValidationState state;
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, vtx[i], nullptr /* pfMissingInputs */, vTime[i],
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
                 if (state.IsValid()) {
                     ++count;
@@ -5042,14 +6516,12 @@ bool LoadMempool(void)
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
+                    if (mempool.exists(vtx[i]->GetHash())) {
                         ++already_there;
                     } else {
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
@@ -5065,19 +6537,31 @@ bool LoadMempool(void)
         return false;
     }
 
+    {
+        LOCK(cs_dumpmempool);
+        nMempoolUpdatesDumped = mempool.GetTransactionsUpdated();
+        fMempoolDumped = true;
+    }
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
     return true;
 }
 
-bool DumpMempool(void)
+bool DumpMempool(bool fSkipUnchanged)
 {
+    // savemempool and the periodic dump may run at the same time
+    LOCK(cs_dumpmempool);
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    unsigned int nUpdated;
 
     {
         LOCK(mempool.cs);
+        nUpdated = mempool.GetTransactionsUpdated();
+        if (fSkipUnchanged && fMempoolDumped && nUpdated == nMempoolUpdatesDumped) {
+            return true;
+        }
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
@@ -5109,6 +6593,8 @@ bool DumpMempool(void)
         FileCommit(file.Get());
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+        nMempoolUpdatesDumped = nUpdated;
+        fMempoolDumped = true;
         int64_t last = GetTimeMicros();
         LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
     } catch (const std::exception& e) {
@@ -5143,9 +6629,6 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
+        g_chainstate.UnloadBlockIndex();
     }
 } instance_of_cmaincleanup;
@@ -36,7 +36,9 @@
 #include <atomic>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
+enum class CheckPoWOnLoad;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -50,6 +52,7 @@ struct ChainTxData;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
+struct SignatureCacheStats;
 
 /** Default for -whitelistrelay. */
 static const bool DEFAULT_WHITELISTRELAY = true;
@@ -86,13 +89,45 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Transactions with at least this many inputs have their scripts checked on the script-checking threads when entering the mempool */
+static const unsigned int MIN_INPUTS_FOR_PARALLEL_MEMPOOL_SCRIPT_CHECKS = 8;
+/** Maximum number of header proof of work checking threads allowed */
+static const int MAX_HEADERVERIFY_THREADS = 16;
+/** -headerverifythreads default (number of header proof of work checking threads, 0 = auto) */
+static const int DEFAULT_HEADERVERIFY_THREADS = 0;
+/** -parallelargon2 default */
+static const bool DEFAULT_PARALLEL_ARGON2 = false;
+/** -powhugepages default */
+static const bool DEFAULT_POW_HUGEPAGES = false;
+/** -checkpowonload default */
+static const char* const DEFAULT_CHECKPOWONLOAD = "1";
+/** -paranoidblockreads default */
+static const bool DEFAULT_PARANOID_BLOCK_READS = false;
+/** Number of blocks that can be requested at any given time from a single peer, as long as we know nothing about its speed. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Number of blocks that can be in flight from a single peer whose throughput and round trip time show it can keep them busy. */
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Number of blocks to read from disk ahead of connecting them */
+static const unsigned int BLOCK_READAHEAD_BLOCKS = 16;
+/** Size of the block and undo data queued for the block file writer, beyond which validation waits for the disk */
+static const size_t BLOCK_WRITER_MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+/** Size of the data the block file writer writes to a file before it syncs it, so flushing the state has less left to sync */
+static const size_t BLOCK_WRITER_SYNC_BYTES = 16 * 1024 * 1024;
+/** Number of blocks LoadExternalBlockFile reads before checking their proof of work together */
+static const unsigned int IMPORT_BATCH_BLOCKS = 256;
+/** Size of the blocks LoadExternalBlockFile keeps in memory for a batch at most */
+static const size_t IMPORT_BATCH_MAX_BYTES = 64 * 1024 * 1024;
+/** Number of blocks whose block and undo data are read ahead of disconnecting them */
+static const unsigned int DISCONNECT_READAHEAD_BLOCKS = 32;
+/** Number of threads reading the blocks a reorg disconnects */
+static const int DISCONNECT_READAHEAD_THREADS = 4;
+/** -compactundo default */
+static const bool DEFAULT_COMPACT_UNDO = false;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
@@ -107,6 +142,12 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Time to wait (in seconds) between writing parts of the chainstate to disk in the background. */
+static const unsigned int DATABASE_PARTIAL_FLUSH_INTERVAL = 10;
+/** Share (in percent) of the coins cache limit above which parts of it are written in the background. */
+static const int COINS_PARTIAL_FLUSH_THRESHOLD = 70;
+/** Coins created less than this many blocks below the tip are likely to be spent soon, don't write them early. */
+static const int COINS_PARTIAL_FLUSH_MIN_DEPTH = 100;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -136,9 +177,12 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = true;
+static const bool DEFAULT_HEADERSONLY = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempooldumpinterval, in seconds */
+static const int64_t DEFAULT_MEMPOOL_DUMP_INTERVAL = 15 * 60;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -161,7 +205,7 @@ struct BlockHasher
 };
 
 extern CScript COINBASE_FLAGS;
-extern CCriticalSection cs_main;
+extern CInstrumentedCriticalSection cs_main;
 #ifdef ENABLE_TREASURY
 extern CCriticalSection cs_treasury;
 #endif
@@ -177,11 +221,19 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern int nHeaderVerifyThreads;
 extern bool fTxIndex;
+extern bool fCoinStatsIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Which stored block headers get their proof of work re-checked while loading the block index */
+extern CheckPoWOnLoad checkPoWOnLoad;
+/** Re-check the proof of work of blocks read from disk even if their block index entry says they were validated */
+extern bool fParanoidBlockReads;
+/** Write the undo data of newly connected blocks in the compact encoding (SERIALIZE_UNDO_COMPACT) */
+extern bool fCompactUndo;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -213,6 +265,12 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** True if we're running in -headersonly mode and never download blocks. */
+extern bool fHeadersOnly;
+/** Base of the chainstate snapshot the coins were loaded from (see snapshot.h), nullptr if none. The blocks up to it have no undo data. Protected by cs_main. */
+extern CBlockIndex* pindexSnapshotBase;
+/** Whether the history up to pindexSnapshotBase was validated. Protected by cs_main. */
+extern bool fSnapshotValidated;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -288,8 +346,24 @@ bool VerifyAuxpowBlockIndex(std::string &strErrMsg, const Consensus::Params& con
 void ClearAuxpowValidationCache();
 /** Unload database information */
 void UnloadBlockIndex();
+/** Estimated bytes used by mapBlockIndex, its entries and their Equihash solutions, cs_main must be held */
+size_t BlockIndexDynamicMemoryUsage();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof of work checking thread */
+void ThreadHeaderVerify();
+/** Run the thread reading blocks ahead for ActivateBestChain. Requires the coins database to be loaded. */
+void ThreadBlockReadAhead();
+/** Run the thread writing blocks and undo data to their files. Without it they are written right away. */
+void ThreadBlockFileWriter();
+/** Wait for the writes queued for block file nFile (or its undo file) to be done, before reading from it */
+void WaitForBlockFileWrites(int nFile, bool fUndo = false);
+/**
+ * Check the proof of work, including the auxpow, of the given headers on the
+ * header verification threads. fPoWValid[i] is set if vpheaders[i] is valid.
+ * Does not require cs_main.
+ */
+void CheckProofOfWorkBatch(const std::vector<const CBlockHeader*>& vpheaders, const Consensus::Params& consensusParams, std::vector<char>& fPoWValid);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -414,12 +488,30 @@ public:
 
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
+/** Usage of the script-execution cache. Requires cs_main. */
+SignatureCacheStats GetScriptExecutionCacheStats();
 
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
+/** What reading a block needs from its index entry, so the read itself does not have to take cs_main */
+struct CBlockReadRequest
+{
+    CDiskBlockPos pos;
+    uint256 hash;
+    bool fCheckPoW;
+};
+/** Look up where pindex is stored and whether its proof of work was checked before, requires cs_main */
+CBlockReadRequest GetBlockReadRequest(const CBlockIndex* pindex);
+bool ReadBlockFromDisk(CBlock& block, const CBlockReadRequest& request, const Consensus::Params& consensusParams);
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the undo data stored at pos for a block on top of hashPrevBlock, fCompact if its entry has BLOCK_UNDO_COMPACT. Does not need cs_main */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashPrevBlock, bool fCompact = false);
+/** Read the serialized block of pindex as it is stored, without deserializing or checking it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -433,6 +525,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
+/** Make pindexBase, whose coins were loaded into pcoinsTip on top of the genesis block, the tip of the active chain (requires cs_main) */
+bool ActivateSnapshot(CBlockIndex* pindexBase, uint64_t nChainTx);
+
+/** Apply a block below pindexSnapshotBase to view with all ConnectBlock checks but without writing anything for it, to validate the history of a snapshot (requires cs_main) */
+bool ConnectHistoricalBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams);
+
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
 
@@ -471,6 +569,9 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain& chainActive;
 
+/** Per-algo work along chainActive, used for hashrate estimates (protected by cs_main). */
+extern CAlgoHashrateIndex algoHashrateIndex;
+
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
@@ -511,8 +612,8 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
-bool DumpMempool();
+/** Dump the mempool to disk. With fSkipUnchanged, nothing is written if the mempool did not change since the last dump or load. */
+bool DumpMempool(bool fSkipUnchanged = false);
 
 /** Load the mempool from disk. */
 bool LoadMempool();
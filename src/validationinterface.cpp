@@ -13,33 +13,73 @@
 #include <util.h>
 #include <validation.h>
 
-#include <list>
+#include <algorithm>
 #include <atomic>
 #include <future>
+#include <list>
+
+#include <boost/bind.hpp>
 
-#include <boost/signals2/signal.hpp>
+/** A registered CValidationInterface and the queue its callbacks run on */
+struct ValidationListener {
+    CValidationInterface* const callbacks;
+    const std::string strName;
+    SingleThreadedSchedulerClient* const queue;
+    //! Cleared once unregistered, the callbacks still queued are then skipped
+    std::atomic<bool> fActive;
+    //! Most callbacks ever queued at once, guarded by MainSignalsInstance::m_cs_listeners
+    size_t nMaxQueued;
+
+    ValidationListener(CValidationInterface* callbacksIn, const std::string& strNameIn, SingleThreadedSchedulerClient* queueIn)
+        : callbacks(callbacksIn), strName(strNameIn), queue(queueIn), fActive(true), nMaxQueued(0) {}
+};
 
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *)> AcceptedBlockHeader;
-    boost::signals2::signal<void (const CBlockIndex *, bool fInitialDownload)> NotifyHeaderTip;
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const CTransactionRef &)> NotifyTransactionLock;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
-    boost::signals2::signal<void (const uint256 &)> Inventory;
-    boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
-    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
+    CScheduler* const m_pscheduler;
 
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    // our own queues here :( Every listener gets a queue of its own, so a
+    // slow listener only delays its own callbacks while the scheduler
+    // threads keep serving the others.
+    // This one only runs the functions of CallFunctionInValidationInterfaceQueue.
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    CCriticalSection m_cs_listeners;
+    //! In the order they were registered in
+    std::vector<std::shared_ptr<ValidationListener>> m_listeners;
+    //! Every queue handed out so far. The scheduler may still process a
+    //! queue after its listener was unregistered, so queues are only
+    //! destroyed with the instance and are handed to later listeners instead.
+    std::vector<std::unique_ptr<SingleThreadedSchedulerClient>> m_queues;
+    std::vector<SingleThreadedSchedulerClient*> m_free_queues;
+
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_pscheduler(pscheduler), m_schedulerClient(pscheduler, "validation callbacks") {}
+
+    std::vector<std::shared_ptr<ValidationListener>> GetListeners() {
+        LOCK(m_cs_listeners);
+        return m_listeners;
+    }
+
+    /** Queue func for every registered listener, on the listener's own queue */
+    void Enqueue(std::function<void (CValidationInterface&)> func) {
+        auto pfunc = std::make_shared<const std::function<void (CValidationInterface&)>>(std::move(func));
+        LOCK(m_cs_listeners);
+        for (const std::shared_ptr<ValidationListener>& listener : m_listeners) {
+            std::shared_ptr<ValidationListener> plistener = listener;
+            listener->queue->AddToProcessQueue([plistener, pfunc] {
+                if (plistener->fActive) (*pfunc)(*plistener->callbacks);
+            });
+            listener->nMaxQueued = std::max(listener->nMaxQueued, listener->queue->CallbacksPending());
+        }
+    }
+
+    /** Call func for every registered listener on the calling thread */
+    void Call(const std::function<void (CValidationInterface&)>& func) {
+        for (const std::shared_ptr<ValidationListener>& listener : GetListeners()) {
+            if (listener->fActive) func(*listener->callbacks);
+        }
+    }
 };
 
 static CMainSignals g_signals;
@@ -55,21 +95,48 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
+        std::vector<SingleThreadedSchedulerClient*> vQueues;
+        {
+            LOCK(m_internals->m_cs_listeners);
+            for (const std::unique_ptr<SingleThreadedSchedulerClient>& queue : m_internals->m_queues) {
+                vQueues.push_back(queue.get());
+            }
+        }
+        for (SingleThreadedSchedulerClient* queue : vQueues) {
+            queue->EmptyQueue();
+        }
         m_internals->m_schedulerClient.EmptyQueue();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    LOCK(m_internals->m_cs_listeners);
+    size_t nPending = m_internals->m_schedulerClient.CallbacksPending();
+    for (const std::unique_ptr<SingleThreadedSchedulerClient>& queue : m_internals->m_queues) {
+        nPending += queue->CallbacksPending();
+    }
+    return nPending;
+}
+
+std::vector<CMainSignals::QueueInfo> CMainSignals::GetQueueInfo() {
+    std::vector<QueueInfo> vInfo;
+    if (!m_internals) return vInfo;
+    LOCK(m_internals->m_cs_listeners);
+    for (const std::shared_ptr<ValidationListener>& listener : m_internals->m_listeners) {
+        vInfo.push_back(QueueInfo{listener->strName, listener->queue->CallbacksPending(), listener->nMaxQueued});
+    }
+    return vInfo;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
-    pool.NotifyEntryRemoved.connect(boost::bind(&CMainSignals::MempoolEntryRemoved, this, _1, _2));
+    pool.NotifyEntryAdded.connect(boost::bind(&CMainSignals::MempoolEntryAdded, this, _1, _2));
+    pool.NotifyEntryRemoved.connect(boost::bind(&CMainSignals::MempoolEntryRemoved, this, _1, _2, _3));
 }
 
 void CMainSignals::UnregisterWithMempoolSignals(CTxMemPool& pool) {
-    pool.NotifyEntryRemoved.disconnect(boost::bind(&CMainSignals::MempoolEntryRemoved, this, _1, _2));
+    pool.NotifyEntryRemoved.disconnect(boost::bind(&CMainSignals::MempoolEntryRemoved, this, _1, _2, _3));
+    pool.NotifyEntryAdded.disconnect(boost::bind(&CMainSignals::MempoolEntryAdded, this, _1, _2));
 }
 
 CMainSignals& GetMainSignals()
@@ -77,59 +144,60 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->AcceptedBlockHeader.connect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
-    g_signals.m_internals->NotifyHeaderTip.connect(boost::bind(&CValidationInterface::NotifyHeaderTip, pwalletIn, _1, _2));
-    g_signals.m_internals->UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->TransactionAddedToMempool.connect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.connect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->Inventory.connect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.m_internals->Broadcast.connect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName) {
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_listeners);
+    SingleThreadedSchedulerClient* queue;
+    if (!internals.m_free_queues.empty()) {
+        queue = internals.m_free_queues.back();
+        internals.m_free_queues.pop_back();
+    } else {
+        internals.m_queues.emplace_back(new SingleThreadedSchedulerClient(internals.m_pscheduler, "validation callbacks"));
+        queue = internals.m_queues.back().get();
+    }
+    internals.m_listeners.push_back(std::make_shared<ValidationListener>(pwalletIn, strName, queue));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
-    g_signals.m_internals->BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.m_internals->Broadcast.disconnect(boost::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.m_internals->Inventory.disconnect(boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.m_internals->SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.m_internals->TransactionAddedToMempool.disconnect(boost::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, _1));
-    g_signals.m_internals->NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
-    g_signals.m_internals->BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect(boost::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, _1));
-    g_signals.m_internals->UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.m_internals->NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
-    g_signals.m_internals->NotifyHeaderTip.disconnect(boost::bind(&CValidationInterface::NotifyHeaderTip, pwalletIn, _1, _2));
-    g_signals.m_internals->AcceptedBlockHeader.disconnect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_listeners);
+    for (auto it = internals.m_listeners.begin(); it != internals.m_listeners.end(); ++it) {
+        if ((*it)->callbacks == pwalletIn) {
+            (*it)->fActive = false;
+            internals.m_free_queues.push_back((*it)->queue);
+            internals.m_listeners.erase(it);
+            return;
+        }
+    }
 }
 
 void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->BlockChecked.disconnect_all_slots();
-    g_signals.m_internals->Broadcast.disconnect_all_slots();
-    g_signals.m_internals->Inventory.disconnect_all_slots();
-    g_signals.m_internals->SetBestChain.disconnect_all_slots();
-    g_signals.m_internals->TransactionAddedToMempool.disconnect_all_slots();
-    g_signals.m_internals->NotifyTransactionLock.disconnect_all_slots();
-    g_signals.m_internals->BlockConnected.disconnect_all_slots();
-    g_signals.m_internals->BlockDisconnected.disconnect_all_slots();
-    g_signals.m_internals->TransactionRemovedFromMempool.disconnect_all_slots();
-    g_signals.m_internals->UpdatedBlockTip.disconnect_all_slots();
-    g_signals.m_internals->NewPoWValidBlock.disconnect_all_slots();
-    g_signals.m_internals->NotifyHeaderTip.disconnect_all_slots();
-    g_signals.m_internals->AcceptedBlockHeader.disconnect_all_slots();
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_listeners);
+    for (const std::shared_ptr<ValidationListener>& listener : internals.m_listeners) {
+        listener->fActive = false;
+        internals.m_free_queues.push_back(listener->queue);
+    }
+    internals.m_listeners.clear();
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    // Queue a barrier behind the callbacks of every listener, the last one
+    // reached calls func
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_listeners);
+    auto pfunc = std::make_shared<const std::function<void ()>>(std::move(func));
+    auto pnRemaining = std::make_shared<std::atomic<size_t>>(internals.m_queues.size() + 1);
+    auto barrier = [pfunc, pnRemaining] {
+        if (--*pnRemaining == 0) (*pfunc)();
+    };
+    for (const std::unique_ptr<SingleThreadedSchedulerClient>& queue : internals.m_queues) {
+        queue->AddToProcessQueue(barrier);
+    }
+    internals.m_schedulerClient.AddToProcessQueue(barrier);
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -142,76 +210,124 @@ void SyncWithValidationInterfaceQueue() {
     promise.get_future().wait();
 }
 
-void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
+void LimitValidationInterfaceQueue() {
+    AssertLockNotHeld(cs_main);
+    // Only wait for the listeners that fell behind, the others keep going
+    std::list<std::promise<void>> promises;
+    for (const std::shared_ptr<ValidationListener>& listener : g_signals.m_internals->GetListeners()) {
+        size_t nQueued = listener->queue->CallbacksPending();
+        if (nQueued <= MAX_VALIDATION_QUEUE_DEPTH) continue;
+        LogPrint(BCLog::BENCH, "%s: waiting for %s, %u callbacks queued\n", __func__, listener->strName, nQueued);
+        promises.emplace_back();
+        std::promise<void>& promise = promises.back();
+        listener->queue->AddToProcessQueue([&promise] {
+            promise.set_value();
+        });
+    }
+    for (std::promise<void>& promise : promises) {
+        promise.get_future().wait();
+    }
+}
+
+void CMainSignals::MempoolEntryAdded(CTransactionRef ptx, uint64_t nMempoolSequence) {
+    m_internals->Enqueue([ptx, nMempoolSequence](CValidationInterface& listener) {
+        listener.MempoolTransactionAdded(ptx, nMempoolSequence);
+    });
+}
+
+void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface& listener) {
+            listener.TransactionRemovedFromMempool(ptx);
+        });
+    }
+    if (reason != MemPoolRemovalReason::BLOCK) {
+        m_internals->Enqueue([ptx, reason, nMempoolSequence](CValidationInterface& listener) {
+            listener.MempoolTransactionRemoved(ptx, reason, nMempoolSequence);
         });
     }
 }
 
 void CMainSignals::NotifyHeaderTip(const CBlockIndex *pindexNew, bool fInitialDownload) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, fInitialDownload, this] {
-        m_internals->NotifyHeaderTip(pindexNew, fInitialDownload);
+    m_internals->Enqueue([pindexNew, fInitialDownload](CValidationInterface& listener) {
+        listener.NotifyHeaderTip(pindexNew, fInitialDownload);
     });
 }
 
 void CMainSignals::AcceptedBlockHeader(const CBlockIndex *pindexNew) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, this] {
-        m_internals->AcceptedBlockHeader(pindexNew);
+    m_internals->Enqueue([pindexNew](CValidationInterface& listener) {
+        listener.AcceptedBlockHeader(pindexNew);
     });
 }
 
 void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface& listener) {
+        listener.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& listener) {
+        listener.TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::NotifyTransactionLock(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->NotifyTransactionLock(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& listener) {
+        listener.NotifyTransactionLock(ptx);
+    });
+}
+
+void CMainSignals::NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo) {
+    m_internals->Enqueue([outpoint, pinfo](CValidationInterface& listener) {
+        listener.NotifyMasternodeChanged(outpoint, pinfo);
+    });
+}
+
+void CMainSignals::NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee) {
+    m_internals->Enqueue([nBlockHeight, payee](CValidationInterface& listener) {
+        listener.NotifyMasternodePaymentWinner(nBlockHeight, payee);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface& listener) {
+        listener.BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface& listener) {
+        listener.BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::SetBestChain(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->SetBestChain(locator);
+    m_internals->Enqueue([locator](CValidationInterface& listener) {
+        listener.SetBestChain(locator);
     });
 }
 
 void CMainSignals::Inventory(const uint256 &hash) {
-    m_internals->m_schedulerClient.AddToProcessQueue([hash, this] {
-        m_internals->Inventory(hash);
+    m_internals->Enqueue([hash](CValidationInterface& listener) {
+        listener.Inventory(hash);
     });
 }
 
 void CMainSignals::Broadcast(int64_t nBestBlockTime, CConnman* connman) {
-    m_internals->Broadcast(nBestBlockTime, connman);
+    m_internals->Call([nBestBlockTime, connman](CValidationInterface& listener) {
+        listener.ResendWalletTransactions(nBestBlockTime, connman);
+    });
 }
 
 void CMainSignals::BlockChecked(const CBlock& block, const CValidationState& state) {
-    m_internals->BlockChecked(block, state);
+    m_internals->Call([&block, &state](CValidationInterface& listener) {
+        listener.BlockChecked(block, state);
+    });
 }
 
 void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
-    m_internals->NewPoWValidBlock(pindex, block);
+    m_internals->Call([pindex, &block](CValidationInterface& listener) {
+        listener.NewPoWValidBlock(pindex, block);
+    });
 }
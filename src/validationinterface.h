@@ -10,6 +10,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CBlock;
 class CBlockIndex;
@@ -23,11 +25,23 @@ class uint256;
 class CScheduler;
 class CTxMemPool;
 enum class MemPoolRemovalReason;
+struct masternode_info_t;
+
+/** Callbacks a listener may have queued before block connection waits for it to catch up */
+static const size_t MAX_VALIDATION_QUEUE_DEPTH = 10;
+/** -schedulerthreads default, the threads that run the callbacks of the listeners in parallel */
+static const int DEFAULT_SCHEDULER_THREADS = 4;
+/** Maximum number of scheduler threads allowed */
+static const int MAX_SCHEDULER_THREADS = 16;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
+/**
+ * Register a wallet to receive updates from core. Its background callbacks
+ * run in order on a queue of its own, in parallel to those of the other
+ * listeners. strName identifies the queue in getvalidationqueueinfo.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName = "unnamed");
 /** Unregister a wallet from core */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
@@ -52,6 +66,13 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  *     promise.get_future().wait();
  */
 void SyncWithValidationInterfaceQueue();
+/**
+ * Block until no listener has more than MAX_VALIDATION_QUEUE_DEPTH callbacks
+ * queued, waiting only for the listeners that fell behind. Called before
+ * connecting blocks, so a slow listener cannot make the queues grow without
+ * bound.
+ */
+void LimitValidationInterfaceQueue();
 
 class CValidationInterface {
 protected:
@@ -79,6 +100,21 @@ protected:
      * Called on a background thread.
      */
     virtual void NotifyTransactionLock(const CTransactionRef &ptx) {}
+    /**
+     * Notifies listeners of a masternode list entry having been added or
+     * updated, pinfo is null if it was removed. Changes are collected and
+     * reported about once a second by the masternode check thread.
+     *
+     * Called on a background thread.
+     */
+    virtual void NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo) {}
+    /**
+     * Notifies listeners of the payee with the most payment votes for a
+     * block above the tip having changed.
+     *
+     * Called on a background thread.
+     */
+    virtual void NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee) {}
     /**
      * Notifies listeners of a transaction having been added to mempool.
      *
@@ -96,6 +132,23 @@ protected:
      * Called on a background thread.
      */
     virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx) {}
+    /**
+     * Notifies listeners of a transaction having been added to the mempool,
+     * with the mempool sequence number it got (see CTxMemPool::GetSequence).
+     * Unlike TransactionAddedToMempool this is called for every addition,
+     * also of transactions of disconnected blocks.
+     *
+     * Called on a background thread.
+     */
+    virtual void MempoolTransactionAdded(const CTransactionRef &ptx, uint64_t nMempoolSequence) {}
+    /**
+     * Notifies listeners of a transaction having been removed from the
+     * mempool for any reason but its inclusion in a block, conflicts
+     * included, with the mempool sequence number the removal got.
+     *
+     * Called on a background thread.
+     */
+    virtual void MempoolTransactionRemoved(const CTransactionRef &ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -134,9 +187,7 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
-    friend void ::RegisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterAllValidationInterfaces();
+    friend class CMainSignals;
 };
 
 struct MainSignalsInstance;
@@ -144,12 +195,14 @@ class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::LimitValidationInterfaceQueue();
 
-    void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void MempoolEntryAdded(CTransactionRef tx, uint64_t nMempoolSequence);
+    void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
 
 public:
     /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
@@ -159,9 +212,20 @@ public:
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Callbacks queued for all listeners */
     size_t CallbacksPending();
 
-    /** Register with mempool to call TransactionRemovedFromMempool callbacks */
+    /** The queue of a registered listener */
+    struct QueueInfo {
+        std::string strName;
+        //! Callbacks queued now
+        size_t nQueued;
+        //! Most callbacks queued at once since it was registered
+        size_t nMaxQueued;
+    };
+    std::vector<QueueInfo> GetQueueInfo();
+
+    /** Register with mempool to call TransactionRemovedFromMempool and MempoolTransaction* callbacks */
     void RegisterWithMempoolSignals(CTxMemPool& pool);
     /** Unregister with mempool */
     void UnregisterWithMempoolSignals(CTxMemPool& pool);
@@ -170,6 +234,8 @@ public:
     void NotifyHeaderTip(const CBlockIndex *pindexNew, bool fInitialDownload);
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
     void NotifyTransactionLock(const CTransactionRef &);
+    void NotifyMasternodeChanged(const COutPoint &, const std::shared_ptr<const masternode_info_t> &);
+    void NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &);
     void TransactionAddedToMempool(const CTransactionRef &);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>> &);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &);
@@ -10,7 +10,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 80002;
+static const int PROTOCOL_VERSION = 80005;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -43,4 +43,13 @@ static const int SHORT_IDS_BLOCKS_VERSION = 70001;
 //! not banning for invalid compact blocks starts with this version
 static const int INVALID_CB_NO_BAN_VERSION = 70002;
 
+//! "mnldigest" and "mnldiff" masternode list sync starts with this version
+static const int MASTERNODE_LIST_DIGEST_VERSION = 80003;
+
+//! "cmpctref" compact blocks with the header sent by hash start with this version
+static const int COMPACT_BLOCK_REF_VERSION = 80004;
+
+//! "cmpcthdrs" compressed headers start with this version
+static const int COMPRESSED_HEADERS_VERSION = 80005;
+
 #endif // BITCOIN_VERSION_H
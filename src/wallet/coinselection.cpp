@@ -0,0 +1,240 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/coinselection.h>
+
+#include <random.h>
+#include <spork.h>
+#include <util.h>
+#include <utilmoneystr.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/optional.hpp>
+
+namespace {
+
+struct CompareValueOnly
+{
+    bool operator()(const CInputCoin& t1,
+                    const CInputCoin& t2) const
+    {
+        return t1.txout.nValue < t2.txout.nValue;
+    }
+};
+
+void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
+                           std::vector<char>& vfBest, CAmount& nBest, bool fUseInstantSend = false, int iterations = 1000)
+{
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(vValue.size(), true);
+    nBest = nTotalLower;
+
+    FastRandomContext insecure_rand;
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
+    {
+        vfIncluded.assign(vValue.size(), false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vValue.size(); i++)
+            {
+                if (fUseInstantSend && nTotal + vValue[i].txout.nValue > sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN) {
+                    continue;
+                }
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng is fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
+                {
+                    nTotal += vValue[i].txout.nValue;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vValue[i].txout.nValue;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool CBranchAndBoundSelector::Select(const std::vector<CInputCoin>& vCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    std::vector<CInputCoin> vPool(vCoins);
+    std::stable_sort(vPool.begin(), vPool.end(), [](const CInputCoin& a, const CInputCoin& b) {
+        return a.txout.nValue > b.txout.nValue;
+    });
+
+    // What the coins not decided on yet can still add
+    CAmount nAvailable = 0;
+    for (const CInputCoin& coin : vPool)
+        nAvailable += coin.txout.nValue;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    std::vector<bool> vSelection;
+    std::vector<bool> vBest;
+    CAmount nValue = 0;
+    CAmount nBestExcess = std::numeric_limits<CAmount>::max();
+
+    for (size_t nTries = 0; nTries < nMaxTries; nTries++) {
+        bool fBacktrack = false;
+        if (nValue + nAvailable < nTargetValue || nValue > nTargetValue + nCostOfChange) {
+            // Cannot reach the target anymore, or already past the window.
+            fBacktrack = true;
+        } else if (nValue >= nTargetValue) {
+            if (nValue - nTargetValue < nBestExcess) {
+                nBestExcess = nValue - nTargetValue;
+                vBest = vSelection;
+            }
+            if (nBestExcess == 0)
+                break;
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Go back to the last coin included and try the branch without it.
+            while (!vSelection.empty() && !vSelection.back()) {
+                vSelection.pop_back();
+                nAvailable += vPool[vSelection.size()].txout.nValue;
+            }
+            if (vSelection.empty())
+                break; // every branch was searched
+            vSelection.back() = false;
+            nValue -= vPool[vSelection.size() - 1].txout.nValue;
+        } else {
+            const CInputCoin& coin = vPool[vSelection.size()];
+            nAvailable -= coin.txout.nValue;
+            // Leaving out a coin and then taking one of the same value only
+            // repeats a branch already searched.
+            if (!vSelection.empty() && !vSelection.back() && coin.txout.nValue == vPool[vSelection.size() - 1].txout.nValue) {
+                vSelection.push_back(false);
+            } else {
+                vSelection.push_back(true);
+                nValue += coin.txout.nValue;
+            }
+        }
+    }
+
+    if (vBest.empty())
+        return false;
+
+    for (size_t i = 0; i < vBest.size(); i++) {
+        if (vBest[i]) {
+            setCoinsRet.insert(vPool[i]);
+            nValueRet += vPool[i].txout.nValue;
+        }
+    }
+    return true;
+}
+
+bool CKnapsackSelector::Select(const std::vector<CInputCoin>& vCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    // List of values less than target
+    boost::optional<CInputCoin> coinLowestLarger;
+    std::vector<CInputCoin> vValue;
+    CAmount nTotalLower = 0;
+
+    CAmount nTxValueLimit = fUseInstantSend ? sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN : std::numeric_limits<CAmount>::max();
+
+    for (const CInputCoin& coin : vCoins)
+    {
+        if (coin.txout.nValue == nTargetValue)
+        {
+            setCoinsRet.insert(coin);
+            nValueRet += coin.txout.nValue;
+            return true;
+        }
+        else if (coin.txout.nValue < nTargetValue + MIN_CHANGE)
+        {
+            vValue.push_back(coin);
+            nTotalLower += coin.txout.nValue;
+        }
+        else if (!coinLowestLarger || (coin.txout.nValue < coinLowestLarger->txout.nValue && coin.txout.nValue < nTxValueLimit))
+        {
+            coinLowestLarger = coin;
+        }
+    }
+
+    if (nTotalLower == nTargetValue)
+    {
+        for (const auto& input : vValue)
+        {
+            setCoinsRet.insert(input);
+            nValueRet += input.txout.nValue;
+        }
+        return true;
+    }
+
+    if (nTotalLower < nTargetValue)
+    {
+        if (!coinLowestLarger)
+            return false;
+        setCoinsRet.insert(coinLowestLarger.get());
+        nValueRet += coinLowestLarger->txout.nValue;
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
+    std::reverse(vValue.begin(), vValue.end());
+    std::vector<char> vfBest;
+    CAmount nBest;
+
+    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, fUseInstantSend);
+    if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, fUseInstantSend);
+
+    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
+    //                                   or the next bigger coin is closer), return the bigger coin
+    if (coinLowestLarger &&
+        ((nBest != nTargetValue && nBest < nTargetValue + MIN_CHANGE) || (coinLowestLarger->txout.nValue <= nBest && nTxValueLimit <= nBest)))
+    {
+        setCoinsRet.insert(coinLowestLarger.get());
+        nValueRet += coinLowestLarger->txout.nValue;
+    }
+    else {
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(vValue[i]);
+                nValueRet += vValue[i].txout.nValue;
+            }
+
+        if (LogAcceptCategory(BCLog::SELECTCOINS)) {
+            LogPrint(BCLog::SELECTCOINS, "SelectCoins() best subset: ");
+            for (unsigned int i = 0; i < vValue.size(); i++) {
+                if (vfBest[i]) {
+                    LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(vValue[i].txout.nValue));
+                }
+            }
+            LogPrint(BCLog::SELECTCOINS, "total %s\n", FormatMoney(nBest));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2019 The Globaltoken Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include <amount.h>
+#include <wallet/wallet.h>
+
+#include <set>
+#include <vector>
+
+//! Number of branches the branch and bound search may walk before giving up
+static const size_t BNB_MAX_TRIES = 100000;
+
+/** A strategy to pick the inputs of a transaction out of the coins that may be spent */
+class CCoinSelector
+{
+public:
+    virtual ~CCoinSelector() {}
+
+    virtual const char* GetName() const = 0;
+
+    /**
+     * Pick coins from vCoins worth at least nTargetValue. Returns false if
+     * this strategy found no selection, leaving the next one to try.
+     */
+    virtual bool Select(const std::vector<CInputCoin>& vCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const = 0;
+};
+
+/**
+ * Depth first search for a selection worth between the target and the target
+ * plus nCostOfChange, so the transaction needs no change output. Coins are
+ * tried largest first, and the selection wasting the least is kept.
+ */
+class CBranchAndBoundSelector final : public CCoinSelector
+{
+private:
+    CAmount nCostOfChange;
+    size_t nMaxTries;
+
+public:
+    explicit CBranchAndBoundSelector(CAmount nCostOfChangeIn, size_t nMaxTriesIn = BNB_MAX_TRIES) : nCostOfChange(nCostOfChangeIn), nMaxTries(nMaxTriesIn) {}
+
+    const char* GetName() const override { return "bnb"; }
+    bool Select(const std::vector<CInputCoin>& vCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const override;
+};
+
+/**
+ * The stochastic subset sum approximation: prefers an exact match, then the
+ * smallest subset of the smaller coins leaving at least MIN_CHANGE, unless the
+ * smallest coin larger than the target comes closer. With fUseInstantSend the
+ * selection stays within the InstantSend value limit where possible.
+ */
+class CKnapsackSelector final : public CCoinSelector
+{
+private:
+    bool fUseInstantSend;
+
+public:
+    explicit CKnapsackSelector(bool fUseInstantSendIn = false) : fUseInstantSend(fUseInstantSendIn) {}
+
+    const char* GetName() const override { return "knapsack"; }
+    bool Select(const std::vector<CInputCoin>& vCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const override;
+};
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
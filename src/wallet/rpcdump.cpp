@@ -160,6 +160,7 @@ UniValue importprivkey(const JSONRPCRequest& request)
         assert(key.VerifyPubKey(pubkey));
         CKeyID vchAddress = pubkey.GetID();
         {
+            CWalletBatchSession batch(pwallet);
             pwallet->MarkDirty();
             // We don't know which corresponding address will be used; label them all
             for (const auto& dest : GetAllDestinationsForKey(pubkey)) {
@@ -500,6 +501,60 @@ UniValue importpubkey(const JSONRPCRequest& request)
 }
 
 
+/** Keys and scripts importwallet and dumpwallet handle per chunk, with the locks released in between */
+static const size_t WALLET_DUMP_CHUNK_SIZE = 1000;
+
+/** A key or script of a wallet dump file */
+struct DumpEntry
+{
+    bool fScript = false;
+    CKey key;
+    CPubKey pubkey;
+    CScript script;
+    int64_t nTime = 0;
+    std::string strLabel;
+    bool fLabel = true;
+};
+
+/** Parse a line of a wallet dump file, deriving the public key of a private key. Returns false for lines without a key or script. */
+static bool ParseDumpLine(const std::string& line, DumpEntry& entry)
+{
+    if (line.empty() || line[0] == '#')
+        return false;
+
+    std::vector<std::string> vstr;
+    boost::split(vstr, line, boost::is_any_of(" "));
+    if (vstr.size() < 2)
+        return false;
+    CBitcoinSecret vchSecret;
+    if (vchSecret.SetString(vstr[0])) {
+        entry.key = vchSecret.GetKey();
+        entry.pubkey = entry.key.GetPubKey();
+        assert(entry.key.VerifyPubKey(entry.pubkey));
+        entry.nTime = DecodeDumpTime(vstr[1]);
+        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+            if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                break;
+            if (vstr[nStr] == "change=1")
+                entry.fLabel = false;
+            if (vstr[nStr] == "reserve=1")
+                entry.fLabel = false;
+            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                entry.strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                entry.fLabel = true;
+            }
+        }
+        return true;
+    } else if (IsHex(vstr[0])) {
+        std::vector<unsigned char> vData(ParseHex(vstr[0]));
+        entry.fScript = true;
+        entry.script = CScript(vData.begin(), vData.end());
+        entry.nTime = DecodeDumpTime(vstr[1]);
+        return true;
+    }
+    return false;
+}
+
 UniValue importwallet(const JSONRPCRequest& request)
 {
     CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
@@ -530,95 +585,95 @@ UniValue importwallet(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
     }
 
-    int64_t nTimeBegin = 0;
-    bool fGood = true;
     {
-        LOCK2(cs_main, pwallet->cs_wallet);
-
+        LOCK(pwallet->cs_wallet);
         EnsureWalletIsUnlocked(pwallet);
+    }
 
-        std::ifstream file;
-        file.open(request.params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-        if (!file.is_open()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
-        }
-        nTimeBegin = chainActive.Tip()->GetBlockTime();
-
-        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-        file.seekg(0, file.beg);
+    std::ifstream file;
+    file.open(request.params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+    if (!file.is_open()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+    }
+    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+    file.seekg(0, file.beg);
 
-        pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-        while (file.good()) {
-            pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+    int64_t nTimeBegin;
+    {
+        LOCK(cs_main);
+        nTimeBegin = chainActive.Tip()->GetBlockTime();
+    }
+    bool fGood = true;
+    bool fLocked = false;
+
+    // The file is read and its keys derived without locks, then added to the
+    // wallet in chunks, each in one database transaction.
+    pwallet->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+    while (file.good() && !fLocked) {
+        std::vector<DumpEntry> vEntries;
+        while (file.good() && vEntries.size() < WALLET_DUMP_CHUNK_SIZE) {
             std::string line;
             std::getline(file, line);
-            if (line.empty() || line[0] == '#')
-                continue;
+            DumpEntry entry;
+            if (ParseDumpLine(line, entry))
+                vEntries.push_back(std::move(entry));
+        }
+        pwallet->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+        if (vEntries.empty())
+            continue;
 
-            std::vector<std::string> vstr;
-            boost::split(vstr, line, boost::is_any_of(" "));
-            if (vstr.size() < 2)
-                continue;
-            CBitcoinSecret vchSecret;
-            if (vchSecret.SetString(vstr[0])) {
-                CKey key = vchSecret.GetKey();
-                CPubKey pubkey = key.GetPubKey();
-                assert(key.VerifyPubKey(pubkey));
-                CKeyID keyid = pubkey.GetID();
+        LOCK2(cs_main, pwallet->cs_wallet);
+        // The wallet may have been locked again between two chunks.
+        if (pwallet->IsLocked()) {
+            fLocked = true;
+            break;
+        }
+        CWalletBatchSession batch(pwallet);
+        for (const DumpEntry& entry : vEntries) {
+            if (!entry.fScript) {
+                CKeyID keyid = entry.pubkey.GetID();
                 if (pwallet->HaveKey(keyid)) {
                     LogPrintf("Skipping import of %s (key already present)\n", EncodeDestination(keyid));
                     continue;
                 }
-                int64_t nTime = DecodeDumpTime(vstr[1]);
-                std::string strLabel;
-                bool fLabel = true;
-                for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-                    if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                        break;
-                    if (vstr[nStr] == "change=1")
-                        fLabel = false;
-                    if (vstr[nStr] == "reserve=1")
-                        fLabel = false;
-                    if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                        strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                        fLabel = true;
-                    }
-                }
                 LogPrintf("Importing %s...\n", EncodeDestination(keyid));
-                if (!pwallet->AddKeyPubKey(key, pubkey)) {
+                if (!pwallet->AddKeyPubKey(entry.key, entry.pubkey)) {
+                    fGood = false;
+                    continue;
+                }
+                pwallet->mapKeyMetadata[keyid].nCreateTime = entry.nTime;
+                if (entry.fLabel)
+                    pwallet->SetAddressBook(keyid, entry.strLabel, "receive");
+                nTimeBegin = std::min(nTimeBegin, entry.nTime);
+            } else {
+                if (pwallet->HaveCScript(entry.script)) {
+                    LogPrintf("Skipping import of %s (script already present)\n", HexStr(entry.script.begin(), entry.script.end()));
+                    continue;
+                }
+                if (!pwallet->AddCScript(entry.script)) {
+                    LogPrintf("Error importing script %s\n", HexStr(entry.script.begin(), entry.script.end()));
                     fGood = false;
                     continue;
                 }
-                pwallet->mapKeyMetadata[keyid].nCreateTime = nTime;
-                if (fLabel)
-                    pwallet->SetAddressBook(keyid, strLabel, "receive");
-                nTimeBegin = std::min(nTimeBegin, nTime);
-            } else if(IsHex(vstr[0])) {
-               std::vector<unsigned char> vData(ParseHex(vstr[0]));
-               CScript script = CScript(vData.begin(), vData.end());
-               if (pwallet->HaveCScript(script)) {
-                   LogPrintf("Skipping import of %s (script already present)\n", vstr[0]);
-                   continue;
-               }
-               if(!pwallet->AddCScript(script)) {
-                   LogPrintf("Error importing script %s\n", vstr[0]);
-                   fGood = false;
-                   continue;
-               }
-               int64_t birth_time = DecodeDumpTime(vstr[1]);
-               if (birth_time > 0) {
-                   pwallet->m_script_metadata[CScriptID(script)].nCreateTime = birth_time;
-                   nTimeBegin = std::min(nTimeBegin, birth_time);
-               }
+                if (entry.nTime > 0) {
+                    pwallet->m_script_metadata[CScriptID(entry.script)].nCreateTime = entry.nTime;
+                    nTimeBegin = std::min(nTimeBegin, entry.nTime);
+                }
             }
         }
-        file.close();
-        pwallet->ShowProgress("", 100); // hide progress dialog in GUI
+    }
+    file.close();
+    pwallet->ShowProgress("", 100); // hide progress dialog in GUI
+    {
+        LOCK(pwallet->cs_wallet);
         pwallet->UpdateTimeFirstKey(nTimeBegin);
     }
+    // One rescan for all chunks, from the oldest key that was imported.
     pwallet->RescanFromTime(nTimeBegin, reserver, false /* update */);
     pwallet->MarkDirty();
 
+    if (fLocked)
+        throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: The wallet was locked before all keys were imported, unlock it and import the file again.");
     if (!fGood)
         throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys/scripts to wallet");
 
@@ -693,10 +748,6 @@ UniValue dumpwallet(const JSONRPCRequest& request)
             + HelpExampleRpc("dumpwallet", "\"test\"")
         );
 
-    LOCK2(cs_main, pwallet->cs_wallet);
-
-    EnsureWalletIsUnlocked(pwallet);
-
     boost::filesystem::path filepath = request.params[0].get_str();
     filepath = boost::filesystem::absolute(filepath);
 
@@ -709,17 +760,45 @@ UniValue dumpwallet(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, filepath.string() + " already exists. If you are sure this is what you want, move it out of the way first");
     }
 
-    std::ofstream file;
-    file.open(filepath.string().c_str());
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
-
+    // Collect what is dumped, the keys are looked up and written in chunks below.
     std::map<CTxDestination, int64_t> mapKeyBirth;
-    const std::map<CKeyID, int64_t>& mapKeyPool = pwallet->GetAllReserveKeys();
-    pwallet->GetKeyBirthTimes(mapKeyBirth);
+    std::map<CKeyID, int64_t> mapKeyPool;
+    std::set<CScriptID> scripts;
+    std::string strHeader;
+    CKeyID masterKeyID;
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+
+        EnsureWalletIsUnlocked(pwallet);
+
+        mapKeyPool = pwallet->GetAllReserveKeys();
+        pwallet->GetKeyBirthTimes(mapKeyBirth);
 
-    std::set<CScriptID> scripts = pwallet->GetCScripts();
-    // TODO: include scripts in GetKeyBirthTimes() output instead of separate
+        scripts = pwallet->GetCScripts();
+        // TODO: include scripts in GetKeyBirthTimes() output instead of separate
+
+        strHeader += strprintf("# Wallet dump created by Globaltoken %s\n", CLIENT_BUILD);
+        strHeader += strprintf("# * Created on %s\n", EncodeDumpTime(GetTime()));
+        strHeader += strprintf("# * Best block at time of backup was %i (%s),\n", chainActive.Height(), chainActive.Tip()->GetBlockHash().ToString());
+        strHeader += strprintf("#   mined on %s\n", EncodeDumpTime(chainActive.Tip()->GetBlockTime()));
+        strHeader += "\n";
+
+        // add the base58check encoded extended master if the wallet uses HD
+        masterKeyID = pwallet->GetHDChain().masterKeyID;
+        if (!masterKeyID.IsNull())
+        {
+            CKey key;
+            if (pwallet->GetKey(masterKeyID, key)) {
+                CExtKey masterKey;
+                masterKey.SetMaster(key.begin(), key.size());
+
+                CBitcoinExtKey b58extkey;
+                b58extkey.SetKey(masterKey);
+
+                strHeader += "# extended private masterkey: " + b58extkey.ToString() + "\n\n";
+            }
+        }
+    }
 
     // sort time/key pairs
     std::vector<std::pair<int64_t, CKeyID> > vKeyBirth;
@@ -731,65 +810,74 @@ UniValue dumpwallet(const JSONRPCRequest& request)
     mapKeyBirth.clear();
     std::sort(vKeyBirth.begin(), vKeyBirth.end());
 
-    // produce output
-    file << strprintf("# Wallet dump created by Globaltoken %s\n", CLIENT_BUILD);
-    file << strprintf("# * Created on %s\n", EncodeDumpTime(GetTime()));
-    file << strprintf("# * Best block at time of backup was %i (%s),\n", chainActive.Height(), chainActive.Tip()->GetBlockHash().ToString());
-    file << strprintf("#   mined on %s\n", EncodeDumpTime(chainActive.Tip()->GetBlockTime()));
-    file << "\n";
-
-    // add the base58check encoded extended master if the wallet uses HD
-    CKeyID masterKeyID = pwallet->GetHDChain().masterKeyID;
-    if (!masterKeyID.IsNull())
-    {
-        CKey key;
-        if (pwallet->GetKey(masterKeyID, key)) {
-            CExtKey masterKey;
-            masterKey.SetMaster(key.begin(), key.size());
-
-            CBitcoinExtKey b58extkey;
-            b58extkey.SetKey(masterKey);
+    std::ofstream file;
+    file.open(filepath.string().c_str());
+    if (!file.is_open())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
 
-            file << "# extended private masterkey: " << b58extkey.ToString() << "\n\n";
-        }
-    }
-    for (std::vector<std::pair<int64_t, CKeyID> >::const_iterator it = vKeyBirth.begin(); it != vKeyBirth.end(); it++) {
-        const CKeyID &keyid = it->second;
-        std::string strTime = EncodeDumpTime(it->first);
-        std::string strAddr;
-        std::string strLabel;
-        CKey key;
-        if (pwallet->GetKey(keyid, key)) {
-            file << strprintf("%s %s ", CBitcoinSecret(key).ToString(), strTime);
-            if (GetWalletAddressesForKey(pwallet, keyid, strAddr, strLabel)) {
-               file << strprintf("label=%s", strLabel);
-            } else if (keyid == masterKeyID) {
-                file << "hdmaster=1";
-            } else if (mapKeyPool.count(keyid)) {
-                file << "reserve=1";
-            } else if (pwallet->mapKeyMetadata[keyid].hdKeypath == "m") {
-                file << "inactivehdmaster=1";
-            } else {
-                file << "change=1";
+    // produce output
+    file << strHeader;
+    bool fLocked = false;
+    for (size_t nChunk = 0; nChunk < vKeyBirth.size() && !fLocked; nChunk += WALLET_DUMP_CHUNK_SIZE) {
+        std::string strChunk;
+        {
+            LOCK(pwallet->cs_wallet);
+            // The wallet may have been locked again between two chunks.
+            if (pwallet->IsLocked()) {
+                fLocked = true;
+                break;
+            }
+            for (size_t i = nChunk; i < std::min(nChunk + WALLET_DUMP_CHUNK_SIZE, vKeyBirth.size()); i++) {
+                const CKeyID &keyid = vKeyBirth[i].second;
+                std::string strTime = EncodeDumpTime(vKeyBirth[i].first);
+                std::string strAddr;
+                std::string strLabel;
+                CKey key;
+                if (pwallet->GetKey(keyid, key)) {
+                    const std::string strKeypath = pwallet->mapKeyMetadata[keyid].hdKeypath;
+                    strChunk += strprintf("%s %s ", CBitcoinSecret(key).ToString(), strTime);
+                    if (GetWalletAddressesForKey(pwallet, keyid, strAddr, strLabel)) {
+                        strChunk += strprintf("label=%s", strLabel);
+                    } else if (keyid == masterKeyID) {
+                        strChunk += "hdmaster=1";
+                    } else if (mapKeyPool.count(keyid)) {
+                        strChunk += "reserve=1";
+                    } else if (strKeypath == "m") {
+                        strChunk += "inactivehdmaster=1";
+                    } else {
+                        strChunk += "change=1";
+                    }
+                    strChunk += strprintf(" # addr=%s%s\n", strAddr, (strKeypath.size() > 0 ? " hdkeypath="+strKeypath : ""));
+                }
             }
-            file << strprintf(" # addr=%s%s\n", strAddr, (pwallet->mapKeyMetadata[keyid].hdKeypath.size() > 0 ? " hdkeypath="+pwallet->mapKeyMetadata[keyid].hdKeypath : ""));
         }
+        file << strChunk;
+    }
+    if (fLocked) {
+        file.close();
+        boost::filesystem::remove(filepath);
+        throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: The wallet was locked before all keys were dumped, the incomplete dump file was removed.");
     }
     file << "\n";
-    for (const CScriptID &scriptid : scripts) {
-        CScript script;
-        std::string create_time = "0";
-        std::string address = EncodeDestination(scriptid);
-        // get birth times for scripts with metadata
-        auto it = pwallet->m_script_metadata.find(scriptid);
-        if (it != pwallet->m_script_metadata.end()) {
-            create_time = EncodeDumpTime(it->second.nCreateTime);
-        }
-        if(pwallet->GetCScript(scriptid, script)) {
-            file << strprintf("%s %s script=1", HexStr(script.begin(), script.end()), create_time);
-            file << strprintf(" # addr=%s\n", address);
+    std::string strScripts;
+    {
+        LOCK(pwallet->cs_wallet);
+        for (const CScriptID &scriptid : scripts) {
+            CScript script;
+            std::string create_time = "0";
+            std::string address = EncodeDestination(scriptid);
+            // get birth times for scripts with metadata
+            auto it = pwallet->m_script_metadata.find(scriptid);
+            if (it != pwallet->m_script_metadata.end()) {
+                create_time = EncodeDumpTime(it->second.nCreateTime);
+            }
+            if(pwallet->GetCScript(scriptid, script)) {
+                strScripts += strprintf("%s %s script=1", HexStr(script.begin(), script.end()), create_time);
+                strScripts += strprintf(" # addr=%s\n", address);
+            }
         }
     }
+    file << strScripts;
     file << "\n";
     file << "# End of dump\n";
     file.close();
@@ -1221,6 +1309,7 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
             fRescan = false;
         }
 
+        CWalletBatchSession batch(pwallet);
         for (const UniValue& data : requests.getValues()) {
             const int64_t timestamp = std::max(GetImportTimestamp(data, now), minimumTimestamp);
             const UniValue result = ProcessImport(pwallet, data, timestamp);
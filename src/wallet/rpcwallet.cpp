@@ -1772,7 +1772,7 @@ static void MaybePushAddress(UniValue & entry, const CTxDestination &dest)
  * @param  ret        The UniValue into which the result is stored.
  * @param  filter     The "is mine" filter bool.
  */
-void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::string& strAccount, int nMinDepth, bool fLong, UniValue& ret, const isminefilter& filter)
+void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::string& strAccount, int nMinDepth, bool fLong, UniValue& ret, const isminefilter& filter, int* pnSkip)
 {
     CAmount nFee;
     std::string strSentAccount;
@@ -1789,6 +1789,10 @@ void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::s
     {
         for (const COutputEntry& s : listSent)
         {
+            if (pnSkip && *pnSkip > 0) {
+                --*pnSkip;
+                continue;
+            }
             UniValue entry(UniValue::VOBJ);
             if (involvesWatchonly || (::IsMine(*pwallet, s.destination) & ISMINE_WATCH_ONLY)) {
                 entry.pushKV("involvesWatchonly", true);
@@ -1820,6 +1824,10 @@ void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::s
             }
             if (fAllAccounts || (account == strAccount))
             {
+                if (pnSkip && *pnSkip > 0) {
+                    --*pnSkip;
+                    continue;
+                }
                 UniValue entry(UniValue::VOBJ);
                 if (involvesWatchonly || (::IsMine(*pwallet, r.destination) & ISMINE_WATCH_ONLY)) {
                     entry.pushKV("involvesWatchonly", true);
@@ -1852,12 +1860,16 @@ void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::s
     }
 }
 
-void AcentryToJSON(const CAccountingEntry& acentry, const std::string& strAccount, UniValue& ret)
+void AcentryToJSON(const CAccountingEntry& acentry, const std::string& strAccount, UniValue& ret, int* pnSkip = nullptr)
 {
     bool fAllAccounts = (strAccount == std::string("*"));
 
     if (fAllAccounts || acentry.strAccount == strAccount)
     {
+        if (pnSkip && *pnSkip > 0) {
+            --*pnSkip;
+            return;
+        }
         UniValue entry(UniValue::VOBJ);
         entry.pushKV("account", acentry.strAccount);
         entry.pushKV("category", "move");
@@ -1969,36 +1981,25 @@ UniValue listtransactions(const JSONRPCRequest& request)
 
         const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
 
-        // iterate backwards until we have nCount items to return:
-        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
+        // iterate backwards until we have nCount items to return, the nFrom
+        // newest entries are only counted:
+        int nSkip = nFrom;
+        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend() && (int)ret.size() < nCount; ++it)
         {
             CWalletTx *const pwtx = (*it).second.first;
             if (pwtx != nullptr)
-                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter, &nSkip);
             CAccountingEntry *const pacentry = (*it).second.second;
             if (pacentry != nullptr)
-                AcentryToJSON(*pacentry, strAccount, ret);
-
-            if ((int)ret.size() >= (nCount+nFrom)) break;
+                AcentryToJSON(*pacentry, strAccount, ret, &nSkip);
         }
     }
 
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
+    // ret is newest to oldest, and may hold a few more than nCount entries of the last transaction
 
     std::vector<UniValue> arrTmp = ret.getValues();
-
-    std::vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    std::vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
+    if ((int)arrTmp.size() > nCount)
+        arrTmp.resize(nCount);
 
     std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
 
@@ -2207,8 +2208,8 @@ UniValue listsinceblock(const JSONRPCRequest& request)
 
     UniValue transactions(UniValue::VARR);
 
-    for (const std::pair<uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        CWalletTx tx = pairWtx.second;
+    for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
+        const CWalletTx& tx = pairWtx.second;
 
         if (depth == -1 || tx.GetDepthInMainChain(false) < depth) {
             ListTransactions(pwallet, tx, "*", 0, true, transactions, filter);
@@ -2336,7 +2337,7 @@ UniValue gettransaction(const JSONRPCRequest& request)
     ListTransactions(pwallet, wtx, "*", 0, false, details, filter);
     entry.pushKV("details", details);
 
-    std::string strHex = EncodeHexTx(*wtx.tx, RPCSerializationFlags());
+    std::string strHex = EncodeHexTx(*pwallet->GetFullTransaction(wtx), RPCSerializationFlags());
     entry.pushKV("hex", strHex);
 
     return entry;
@@ -3644,7 +3645,6 @@ UniValue signtreasuryproposalswithwallet(const JSONRPCRequest& request)
         );
 
     RPCTypeCheck(request.params, {UniValue::VSTR}, true);
-    UniValue result(UniValue::VARR);
     
     LOCK3(cs_treasury, cs_main, pwallet->cs_wallet);
     EnsureWalletIsUnlocked(pwallet);
@@ -3696,15 +3696,14 @@ UniValue signtreasuryproposalswithwallet(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_WALLET_ERROR, "None of the signers addresses are yours, the transaction cannot be signed.");
     }
     
-    for(size_t i = 0; i < activeTreasury.vTreasuryProposals.size(); i++)
+    // Sign the agreed transactions
+    std::vector<CTreasuryProposal*> vAgreedProposals;
+    for(CTreasuryProposal& proposal : activeTreasury.vTreasuryProposals)
     {
-        if(activeTreasury.vTreasuryProposals[i].IsAgreed())
-        {
-            // Sign the agreed transactions
-            result.push_back(SignTreasuryTransactionPartially(activeTreasury.vTreasuryProposals[i], &keystore, request.params[0]));
-        }
+        if(proposal.IsAgreed())
+            vAgreedProposals.push_back(&proposal);
     }
-    return result;
+    return SignTreasuryTransactionsPartially(vAgreedProposals, &keystore, request.params[0]);
 }
 #endif
 
@@ -3934,14 +3933,15 @@ UniValue generate(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3) {
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4) {
         throw std::runtime_error(strprintf(
-            "generate nblocks ( maxtries )\n"
+            "generate nblocks ( maxtries algo threads )\n"
             "\nMine up to nblocks blocks immediately (before the RPC call returns) to an address in the wallet.\n"
             "\nArguments:\n"
             "1. nblocks      (numeric, required) How many blocks are generated immediately.\n"
             "2. maxtries     (numeric, optional) How many iterations to try (default = 1000000 or 50000 for scrypt, neoscrypt and yescrypt).\n"
             "3. algo         (string, optional) Which mining algorithm to use. (%s)\n"
+            "4. threads      (numeric, optional, default=1) How many threads search the nonce space, 0 or less uses one per core.\n"
             "\nResult:\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
             "\nExamples:\n"
@@ -3983,7 +3983,7 @@ UniValue generate(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "No coinbase script available");
     }
 
-    return generateBlocks(coinbase_script, num_generate, max_tries, true, algo);
+    return generateBlocks(coinbase_script, num_generate, max_tries, true, algo, ParseGenerateThreads(request.params[3]));
 }
 
 UniValue rescanblockchain(const JSONRPCRequest& request)
@@ -4436,7 +4436,7 @@ static const CRPCCommand commands[] =
     
     { "wallet",             "instantsendtoaddress",             &instantsendtoaddress,          {"address","amount","comment","comment_to","subtractfeefromamount","replaceable","conf_target","estimate_mode"} },
 
-    { "generating",         "generate",                         &generate,                      {"nblocks","maxtries","algo"} },
+    { "generating",         "generate",                         &generate,                      {"nblocks","maxtries","algo","threads"} },
     { "mining",             "getauxblock",                      &getauxblock,                   {"algo", "hash", "auxpow", "auxpowversion"} },
 };
 
@@ -5,10 +5,13 @@
 #ifndef BITCOIN_WALLET_RPCWALLET_H
 #define BITCOIN_WALLET_RPCWALLET_H
 
+#include <script/ismine.h>
+
 #include <string>
 
 class CRPCTable;
 class CWallet;
+class CWalletTx;
 class JSONRPCRequest;
 class UniValue;
 
@@ -26,6 +29,12 @@ std::string HelpRequiringPassphrase(CWallet *);
 void EnsureWalletIsUnlocked(CWallet *);
 bool EnsureWalletIsAvailable(CWallet *, bool avoidException);
 
+/**
+ * Add the entries of a wallet transaction to ret. With pnSkip set, that many
+ * of the entries are left out, counting down, without building their JSON.
+ */
+void ListTransactions(CWallet* const pwallet, const CWalletTx& wtx, const std::string& strAccount, int nMinDepth, bool fLong, UniValue& ret, const isminefilter& filter, int* pnSkip = nullptr);
+
 UniValue getaddressinfo(const JSONRPCRequest& request);
 UniValue signrawtransactionwithwallet(const JSONRPCRequest& request);
 #endif //BITCOIN_WALLET_RPCWALLET_H
@@ -14,6 +14,7 @@
 #include <test/test_bitcoin.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
+#include <wallet/coinselection.h>
 #include <wallet/test/wallet_test_fixture.h>
 
 #include <boost/test/unit_test.hpp>
@@ -341,6 +342,73 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+static std::vector<CInputCoin> input_coins()
+{
+    std::vector<CInputCoin> coins;
+    for (const COutput& output : vCoins)
+        coins.emplace_back(output.tx, output.i);
+    return coins;
+}
+
+BOOST_AUTO_TEST_CASE(bnb_search_test)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    add_coin(4 * CENT);
+
+    // exact matches, all the coins or a subset of them
+    BOOST_CHECK(CBranchAndBoundSelector(0).Select(input_coins(), 10 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+    BOOST_CHECK(CBranchAndBoundSelector(0).Select(input_coins(), 5 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // not enough coins, whatever the cost of change
+    BOOST_CHECK(!CBranchAndBoundSelector(5 * CENT).Select(input_coins(), 11 * CENT, setCoinsRet, nValueRet));
+
+    empty_wallet();
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(7 * CENT);
+
+    // 4 cents needs change, unless change worth a cent is not worth having
+    BOOST_CHECK(!CBranchAndBoundSelector(0).Select(input_coins(), 4 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK(!CBranchAndBoundSelector(CENT / 2).Select(input_coins(), 4 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK(CBranchAndBoundSelector(5 * CENT).Select(input_coins(), 4 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+
+    // an exact match beats one within the window
+    BOOST_CHECK(CBranchAndBoundSelector(1 * CENT).Select(input_coins(), 9 * CENT, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 9 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // the search gives up after the given number of tries
+    empty_wallet();
+    for (int i = 0; i < 100; i++)
+        add_coin(2 * CENT + i);
+    BOOST_CHECK(!CBranchAndBoundSelector(0, 10).Select(input_coins(), 2 * CENT + 1, setCoinsRet, nValueRet));
+    BOOST_CHECK(CBranchAndBoundSelector(0).Select(input_coins(), 2 * CENT + 1, setCoinsRet, nValueRet));
+
+    // SelectCoinsMinConf avoids the change the knapsack would have created
+    empty_wallet();
+    add_coin(20 * CENT);
+    add_coin(13 * CENT / 2);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * CENT, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 20 * CENT);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(6 * CENT, 1, 1, 0, vCoins, setCoinsRet, nValueRet, false, 1 * CENT));
+    BOOST_CHECK_EQUAL(nValueRet, 13 * CENT / 2);
+
+    empty_wallet();
+}
+
 BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
 {
     CoinSet setCoinsRet;
@@ -588,6 +656,42 @@ BOOST_AUTO_TEST_CASE(ComputeTimeSmart)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(IsMineScriptSet)
+{
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    CKey key, other;
+    key.MakeNewKey(true);
+    other.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    BOOST_CHECK(wallet.AddKeyPubKey(key, pubkey));
+
+    // The shortcut has to agree with ::IsMine, on scripts it knows and scripts it does not.
+    auto checkIsMine = [&wallet](const CScript& script, isminetype expected) {
+        BOOST_CHECK_EQUAL(wallet.IsMine(CTxOut(0, script)), expected);
+        BOOST_CHECK_EQUAL(::IsMine(wallet, script), expected);
+    };
+    checkIsMine(GetScriptForRawPubKey(pubkey), ISMINE_SPENDABLE);
+    checkIsMine(GetScriptForDestination(pubkey.GetID()), ISMINE_SPENDABLE);
+    checkIsMine(GetScriptForDestination(other.GetPubKey().GetID()), ISMINE_NO);
+
+    // P2WPKH outputs are only ours once their witness script was added.
+    const CScript witness = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+    checkIsMine(witness, ISMINE_NO);
+    checkIsMine(GetScriptForDestination(CScriptID(witness)), ISMINE_NO);
+    BOOST_CHECK(wallet.AddCScript(witness));
+    checkIsMine(witness, ISMINE_SPENDABLE);
+    checkIsMine(GetScriptForDestination(CScriptID(witness)), ISMINE_SPENDABLE);
+
+    // Bare multisig is not in the set but still found.
+    checkIsMine(GetScriptForMultisig(1, {pubkey}), ISMINE_SPENDABLE);
+    checkIsMine(GetScriptForMultisig(1, {pubkey, other.GetPubKey()}), ISMINE_NO);
+
+    const CScript watched = GetScriptForDestination(other.GetPubKey().GetID());
+    BOOST_CHECK(wallet.AddWatchOnly(watched, 0));
+    checkIsMine(watched, ISMINE_WATCH_UNSOLVABLE);
+}
+
 BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
 {
     CTxDestination dest = CKeyID();
@@ -705,4 +809,42 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+// Check that the running balance totals follow transactions being added and
+// coinbases maturing, and agree with summing up the wallet transactions.
+BOOST_FIXTURE_TEST_CASE(IncrementalBalances, ListCoinsTestingSetup)
+{
+    auto check_balances = [this]() {
+        LOCK2(cs_main, wallet->cs_wallet);
+        CAmount nTrusted = 0, nImmature = 0;
+        for (const auto& entry : wallet->mapWallet) {
+            if (entry.second.IsTrusted())
+                nTrusted += entry.second.GetAvailableCredit(false);
+            nImmature += entry.second.GetImmatureCredit(false);
+        }
+        BOOST_CHECK_EQUAL(wallet->GetBalance(), nTrusted);
+        BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), nImmature);
+    };
+
+    check_balances();
+    CAmount nBalance = wallet->GetBalance();
+    CAmount nImmature = wallet->GetImmatureBalance();
+    BOOST_CHECK_EQUAL(nBalance, 50 * COIN);
+
+    // The wallet does not see the new block's coinbase, but the next one of
+    // its coinbases matures.
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), nBalance + 50 * COIN);
+    BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), nImmature - 50 * COIN);
+    check_balances();
+
+    // Spending updates the coins spent and adds the change.
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    check_balances();
+
+    // Forgetting all cached values gives the same totals.
+    nBalance = wallet->GetBalance();
+    wallet->MarkDirty();
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), nBalance);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,15 +7,20 @@
 #include <wallet/wallet.h>
 
 #include <base58.h>
+#include <blockfilterindex.h>
 #include <checkpoints.h>
 #include <chain.h>
 #include <wallet/coincontrol.h>
+#include <wallet/coinselection.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
+#include <crypto/sha256.h>
 #include <fs.h>
 #include <wallet/init.h>
 #include <key.h>
 #include <keystore.h>
+#include <memusage.h>
 #include <validation.h>
 #include <net.h>
 #include <net_processing.h>
@@ -36,7 +41,9 @@
 #include <spork.h>
 
 #include <assert.h>
+#include <deque>
 #include <future>
+#include <limits>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -73,15 +80,6 @@ const uint256 CMerkleTx::ABANDON_HASH(uint256S("00000000000000000000000000000000
  * @{
  */
 
-struct CompareValueOnly
-{
-    bool operator()(const CInputCoin& t1,
-                    const CInputCoin& t2) const
-    {
-        return t1.txout.nValue < t2.txout.nValue;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -148,21 +146,32 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 }
 
 CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
+{
+    return GenerateNewKeys(walletdb, 1, internal).front();
+}
+
+std::vector<CPubKey> CWallet::GenerateNewKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
-    CKey secret;
+    std::vector<CKey> vSecrets;
+    std::vector<CPubKey> vPubKeys;
+    std::vector<CKeyMetadata> vMetadata;
 
     // Create new metadata
     int64_t nCreationTime = GetTime();
-    CKeyMetadata metadata(nCreationTime);
 
     // use HD key derivation if HD was enabled during wallet creation
     if (IsHDEnabled()) {
-        DeriveNewChildKey(walletdb, metadata, secret, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false));
+        DeriveNewChildKeys(walletdb, nKeys, (CanSupportFeature(FEATURE_HD_SPLIT) ? internal : false), nCreationTime, vSecrets, vPubKeys, vMetadata);
     } else {
-        secret.MakeNewKey(fCompressed);
+        vSecrets.resize(nKeys);
+        vPubKeys.resize(nKeys);
+        for (CKey& secret : vSecrets)
+            secret.MakeNewKey(fCompressed);
+        ForEachInputInParallel(nKeys, [&](unsigned int i) { vPubKeys[i] = vSecrets[i].GetPubKey(); });
+        vMetadata.assign(nKeys, CKeyMetadata(nCreationTime));
     }
 
     // Compressed public keys were introduced in version 0.6.0
@@ -170,26 +179,28 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, bool internal)
         SetMinVersion(FEATURE_COMPRPUBKEY);
     }
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
+    // The EC work of checking the keys splits over threads like signing does.
+    std::vector<char> vVerified(nKeys, false);
+    ForEachInputInParallel(nKeys, [&](unsigned int i) { vVerified[i] = vSecrets[i].VerifyPubKey(vPubKeys[i]); });
 
-    mapKeyMetadata[pubkey.GetID()] = metadata;
     UpdateTimeFirstKey(nCreationTime);
-
-    if (!AddKeyPubKeyWithDB(walletdb, secret, pubkey)) {
-        throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+    for (unsigned int i = 0; i < nKeys; i++) {
+        assert(vVerified[i]);
+        mapKeyMetadata[vPubKeys[i].GetID()] = vMetadata[i];
+        if (!AddKeyPubKeyWithDB(walletdb, vSecrets[i], vPubKeys[i])) {
+            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+        }
     }
-    return pubkey;
+    return vPubKeys;
 }
 
-void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal)
+void CWallet::DeriveNewChildKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal, int64_t nCreationTime, std::vector<CKey>& vSecrets, std::vector<CPubKey>& vPubKeys, std::vector<CKeyMetadata>& vMetadata)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
     CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -201,28 +212,38 @@ void CWallet::DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKe
     // use hardened derivation (child keys >= 0x80000000 are hardened after bip32)
     masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
 
-    // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
+    // derive m/0'/0' (external chain) OR m/0'/1' (internal chain), once for all the keys
     assert(internal ? CanSupportFeature(FEATURE_HD_SPLIT) : true);
     accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
 
-    // derive child key at next index, skip keys already known to the wallet
-    do {
-        // always derive hardened keys
-        // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
-        // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
-        if (internal) {
-            chainChildKey.Derive(childKey, hdChain.nInternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/1'/" + std::to_string(hdChain.nInternalChainCounter) + "'";
-            hdChain.nInternalChainCounter++;
-        }
-        else {
-            chainChildKey.Derive(childKey, hdChain.nExternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/0'/" + std::to_string(hdChain.nExternalChainCounter) + "'";
-            hdChain.nExternalChainCounter++;
+    uint32_t& nChainCounter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    while (vSecrets.size() < nKeys) {
+        // derive the child keys at the next indexes in parallel, they do not depend on each other
+        const unsigned int nBatch = nKeys - vSecrets.size();
+        std::vector<CExtKey> vChildKeys(nBatch);
+        std::vector<CPubKey> vChildPubKeys(nBatch);
+        ForEachInputInParallel(nBatch, [&](unsigned int i) {
+            // always derive hardened keys
+            // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
+            // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
+            chainChildKey.Derive(vChildKeys[i], (nChainCounter + i) | BIP32_HARDENED_KEY_LIMIT);
+            vChildPubKeys[i] = vChildKeys[i].key.GetPubKey();
+        });
+
+        // skip keys already known to the wallet, and derive as many more
+        for (unsigned int i = 0; i < nBatch; i++) {
+            const uint32_t nChild = nChainCounter++;
+            if (HaveKey(vChildPubKeys[i].GetID()))
+                continue;
+            CKeyMetadata metadata(nCreationTime);
+            metadata.hdKeypath = (internal ? "m/0'/1'/" : "m/0'/0'/") + std::to_string(nChild) + "'";
+            metadata.hdMasterKeyID = hdChain.masterKeyID;
+            vSecrets.push_back(vChildKeys[i].key);
+            vPubKeys.push_back(vChildPubKeys[i]);
+            vMetadata.push_back(metadata);
         }
-    } while (HaveKey(childKey.key.GetPubKey().GetID()));
-    secret = childKey.key;
-    metadata.hdMasterKeyID = hdChain.masterKeyID;
+    }
+
     // update the chain model in the database
     if (!walletdb.WriteHDChain(hdChain))
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
@@ -244,6 +265,7 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
         return false;
     }
     if (needsDB) pwalletdbEncryption = nullptr;
+    AddOwnedScripts(pubkey);
 
     // check if we need to remove from watch-only
     CScript script;
@@ -266,8 +288,9 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
 {
-    CWalletDB walletdb(*dbw);
-    return CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+    return WriteWalletDB([&](CWalletDB& walletdb) {
+        return CWallet::AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+    });
 }
 
 bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
@@ -275,6 +298,7 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    AddOwnedScripts(vchPubKey);
     {
         LOCK(cs_wallet);
         if (pwalletdbEncryption)
@@ -282,9 +306,9 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
                                                         vchCryptedSecret,
                                                         mapKeyMetadata[vchPubKey.GetID()]);
         else
-            return CWalletDB(*dbw).WriteCryptedKey(vchPubKey,
-                                                            vchCryptedSecret,
-                                                            mapKeyMetadata[vchPubKey.GetID()]);
+            return WriteWalletDB([&](CWalletDB& walletdb) {
+                return walletdb.WriteCryptedKey(vchPubKey, vchCryptedSecret, mapKeyMetadata[vchPubKey.GetID()]);
+            });
     }
 }
 
@@ -304,9 +328,20 @@ bool CWallet::LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata
     return true;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey)
+{
+    if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey))
+        return false;
+    AddOwnedScripts(pubkey);
+    return true;
+}
+
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
+        return false;
+    AddOwnedScripts(vchPubKey);
+    return true;
 }
 
 /**
@@ -329,7 +364,10 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
-    return CWalletDB(*dbw).WriteCScript(Hash160(redeemScript), redeemScript);
+    AddOwnedScripts(redeemScript);
+    return WriteWalletDB([&](CWalletDB& walletdb) {
+        return walletdb.WriteCScript(Hash160(redeemScript), redeemScript);
+    });
 }
 
 bool CWallet::LoadCScript(const CScript& redeemScript)
@@ -345,17 +383,23 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return CCryptoKeyStore::AddCScript(redeemScript);
+    if (!CCryptoKeyStore::AddCScript(redeemScript))
+        return false;
+    AddOwnedScripts(redeemScript);
+    return true;
 }
 
 bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    AddOwnedWatchOnly(dest);
     const CKeyMetadata& meta = m_script_metadata[CScriptID(dest)];
     UpdateTimeFirstKey(meta.nCreateTime);
     NotifyWatchonlyChanged(true);
-    return CWalletDB(*dbw).WriteWatchOnly(dest, meta);
+    return WriteWalletDB([&](CWalletDB& walletdb) {
+        return walletdb.WriteWatchOnly(dest, meta);
+    });
 }
 
 bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
@@ -371,7 +415,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!CWalletDB(*dbw).EraseWatchOnly(dest))
+    if (!WriteWalletDB([&](CWalletDB& walletdb) { return walletdb.EraseWatchOnly(dest); }))
         return false;
 
     return true;
@@ -379,7 +423,54 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
 
 bool CWallet::LoadWatchOnly(const CScript &dest)
 {
-    return CCryptoKeyStore::AddWatchOnly(dest);
+    if (!CCryptoKeyStore::AddWatchOnly(dest))
+        return false;
+    AddOwnedWatchOnly(dest);
+    return true;
+}
+
+SaltedScriptHasher::SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedScriptHasher::operator()(const CScript& script) const
+{
+    return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+}
+
+void CWallet::AddOwnedScripts(const CPubKey& pubkey)
+{
+    {
+        LOCK(cs_KeyStore);
+        setOwnedScripts.insert(GetScriptForRawPubKey(pubkey));
+        setOwnedScripts.insert(GetScriptForDestination(pubkey.GetID()));
+        // ::IsMine only takes P2WPKH outputs of compressed keys (and only
+        // with the witness script added, which AddCScript covers).
+        if (pubkey.IsCompressed())
+            setOwnedScripts.insert(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID())));
+    }
+    nKeyStoreGeneration++;
+}
+
+void CWallet::AddOwnedScripts(const CScript& redeemScript)
+{
+    {
+        LOCK(cs_KeyStore);
+        // The script itself can be a scriptPubKey too, like a P2WPKH one.
+        setOwnedScripts.insert(redeemScript);
+        setOwnedScripts.insert(GetScriptForDestination(CScriptID(redeemScript)));
+        WitnessV0ScriptHash hash;
+        CSHA256().Write(redeemScript.data(), redeemScript.size()).Finalize(hash.begin());
+        setOwnedScripts.insert(GetScriptForDestination(hash));
+    }
+    nKeyStoreGeneration++;
+}
+
+void CWallet::AddOwnedWatchOnly(const CScript& dest)
+{
+    {
+        LOCK(cs_KeyStore);
+        setOwnedScripts.insert(dest);
+    }
+    nKeyStoreGeneration++;
 }
 
 bool CWallet::Unlock(const SecureString& strWalletPassphrase)
@@ -470,6 +561,9 @@ bool CWallet::SetMinVersion(enum WalletFeature nVersion, CWalletDB* pwalletdbIn,
         nWalletMaxVersion = nVersion;
 
     {
+        // An open batch session has to be written through, see CWalletBatchSession
+        if (!pwalletdbIn)
+            pwalletdbIn = pwalletdbBatch;
         CWalletDB* pwalletdb = pwalletdbIn ? pwalletdbIn : new CWalletDB(*dbw);
         if (nWalletVersion > 40000)
             pwalletdb->WriteMinVersion(nWalletVersion);
@@ -569,6 +663,71 @@ void CWallet::SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator> ran
  * Outpoint is spent if any non-conflicted transaction
  * spends it:
  */
+bool CWallet::CheckInstantSendInputs(const CTransactionRef& tx) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Same margin as CTxLockRequest::IsValid, one confirmation less than
+    // coin selection asks for. AcceptToMemoryPool found the inputs unspent.
+    const int nConfirmationsRequired = Params().GetConsensus().nInstantSendConfirmationsRequired - 1;
+    CAmount nValueIn = 0;
+    for (const CTxIn& txin : tx->vin) {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        if (mi == mapWallet.end() || txin.prevout.n >= mi->second.tx->vout.size())
+            return false;
+        if (mi->second.GetDepthInMainChain(false) < nConfirmationsRequired)
+            return false;
+        nValueIn += mi->second.tx->vout[txin.prevout.n].nValue;
+    }
+
+    if (nValueIn > sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN)
+        return false;
+    return nValueIn - tx->GetValueOut() >= CTxLockRequest(tx).GetMinFee();
+}
+
+void CWallet::CompactWalletTxs()
+{
+    LOCK2(cs_main, cs_wallet);
+
+    unsigned int nCompacted = 0;
+    for (std::pair<const uint256, CWalletTx>& item : mapWallet) {
+        CWalletTx& wtx = item.second;
+        if (wtx.fCompactTx || !wtx.tx->HasWitness() || wtx.GetDepthInMainChain() < COMPACT_TX_MIN_DEPTH)
+            continue;
+        bool fSpent = true;
+        for (unsigned int i = 0; i < wtx.tx->vout.size() && fSpent; i++) {
+            if (IsMine(wtx.tx->vout[i]) != ISMINE_NO && !IsSpent(item.first, i))
+                fSpent = false;
+        }
+        if (!fSpent)
+            continue;
+
+        CMutableTransaction tx(*wtx.tx);
+        for (CTxIn& txin : tx.vin)
+            txin.scriptWitness.SetNull();
+        CTransactionRef ptx = MakeTransactionRef(std::move(tx));
+        assert(ptx->GetHash() == item.first);
+        wtx.SetTx(std::move(ptx));
+        wtx.fCompactTx = true;
+        nCompacted++;
+    }
+    if (nCompacted > 0)
+        LogPrint(BCLog::DB, "%s: dropped the witnesses of %u old transactions from memory\n", __func__, nCompacted);
+}
+
+CTransactionRef CWallet::GetFullTransaction(const CWalletTx& wtx) const
+{
+    if (!wtx.fCompactTx)
+        return wtx.tx;
+    CWalletTx wtxStored;
+    if (!CWalletDB(*dbw, "r").ReadTx(wtx.GetHash(), wtxStored)) {
+        LogPrintf("%s: failed to read transaction %s\n", __func__, wtx.GetHash().ToString());
+        return wtx.tx;
+    }
+    return wtxStored.tx;
+}
+
 bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 {
     const COutPoint outpoint(hash, n);
@@ -592,6 +751,11 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
 
+    // The spent output no longer counts as available
+    auto it = mapWallet.find(outpoint.hash);
+    if (it != mapWallet.end())
+        it->second.MarkDirty();
+
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
@@ -870,9 +1034,20 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        fBalancesNeedRebuild = true;
+        fUnspentNeedRebuild = true;
     }
 }
 
+void CWallet::MarkWalletTxDirty(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    if (!fBalancesNeedRebuild)
+        setBalanceDirty.insert(hash);
+    if (!fUnspentNeedRebuild)
+        setUnspentDirty.insert(hash);
+}
+
 bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
 {
     LOCK(cs_wallet);
@@ -956,7 +1131,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         // TODO: Store all versions of the transaction, instead of just one.
         if (wtxIn.tx->HasWitness() && !wtx.tx->HasWitness()) {
             wtx.SetTx(wtxIn.tx);
-            fUpdated = true;
+            // A compacted transaction is still stored with its witnesses.
+            if (wtx.fCompactTx)
+                wtx.fCompactTx = false;
+            else
+                fUpdated = true;
         }
     }
 
@@ -1020,7 +1199,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
  * Abandoned state should probably be more carefully tracked via different
  * posInBlock signals or by checking mempool presence when necessary.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, bool fNotMine)
 {
     const CTransaction& tx = *ptx;
     {
@@ -1041,7 +1220,7 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockI
 
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        if (fExisted || IsMine(tx) || IsFromMe(tx))
+        if (fExisted || (!fNotMine && IsMine(tx)) || IsFromMe(tx))
         {
             /* Check if any keys in the wallet keypool that were supposed to be unused
              * have appeared in a new transaction. If so, remove those keys from the keypool.
@@ -1067,7 +1246,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CBlockI
                 }
             }
 
-            CWalletTx wtx(this, ptx);
+            // A block's transactions may share the arena it was deserialized
+            // into, see CBlockArenaScope, keep a copy of our own instead.
+            CWalletTx wtx(this, pIndex != nullptr ? MakeTransactionRef(tx) : ptx);
 
             // Get merkle branch if transaction was found in a block
             if (pIndex != nullptr)
@@ -1263,6 +1444,9 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     }
 
     m_last_block_processed = pindex;
+
+    if (pindex->nHeight % COMPACT_TX_INTERVAL == 0)
+        CompactWalletTxs();
 }
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
@@ -1335,7 +1519,14 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
-    return ::IsMine(*this, txout.scriptPubKey);
+    const CScript& script = txout.scriptPubKey;
+    // Bare multisig is ours if all of its keys are, it is not in setOwnedScripts.
+    if (script.empty() || script.back() != OP_CHECKMULTISIG) {
+        LOCK(cs_KeyStore);
+        if (!setOwnedScripts.count(script))
+            return ISMINE_NO;
+    }
+    return ::IsMine(*this, script);
 }
 
 CAmount CWallet::GetCredit(const CTxOut& txout, const isminefilter& filter) const
@@ -1551,10 +1742,19 @@ int CWalletTx::GetRequestCount() const
 void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
                            std::list<COutputEntry>& listSent, CAmount& nFee, std::string& strSentAccount, const isminefilter& filter) const
 {
+    strSentAccount = strFromAccount;
+
+    const uint64_t nGeneration = pwallet->GetAmountsGeneration();
+    if (fAmountsCached && filterAmountsCached == filter && nAmountsGenerationCached == nGeneration) {
+        listReceived = listReceivedCached;
+        listSent = listSentCached;
+        nFee = nFeeCached;
+        return;
+    }
+
     nFee = 0;
     listReceived.clear();
     listSent.clear();
-    strSentAccount = strFromAccount;
 
     // Compute fee:
     CAmount nDebit = GetDebit(filter);
@@ -1602,6 +1802,12 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
             listReceived.push_back(output);
     }
 
+    fAmountsCached = true;
+    filterAmountsCached = filter;
+    nAmountsGenerationCached = nGeneration;
+    listReceivedCached = listReceived;
+    listSentCached = listSent;
+    nFeeCached = nFee;
 }
 
 /**
@@ -1674,6 +1880,58 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
             dProgressTip = GuessVerificationProgress(chainParams.TxData(), tip);
         }
         double gvp = dProgressStart;
+
+        // Blocks are read and their outputs matched against the keystore on
+        // threads of their own, ahead of the block being added to the wallet.
+        struct RescanBlock {
+            CBlock block;
+            bool fRead = false;
+            //! Whether each transaction has outputs that are ours, as of nGeneration
+            std::vector<bool> vMine;
+            uint64_t nGeneration = 0;
+        };
+        auto readBlock = [this, &chainParams](const CBlockReadRequest& request) {
+            RescanBlock result;
+            {
+                CBlockArenaScope arena;
+                result.fRead = ReadBlockFromDisk(result.block, request, chainParams.GetConsensus());
+            }
+            if (result.fRead) {
+                result.nGeneration = nKeyStoreGeneration;
+                for (const CTransactionRef& tx : result.block.vtx)
+                    result.vMine.push_back(IsMine(*tx));
+            }
+            return result;
+        };
+        const size_t nReadsAhead = std::max(2, std::min(GetNumCores() * 2, MAX_RESCAN_READS_AHEAD));
+        struct RescanRead {
+            CBlockIndex* pindex;
+            //! Whether the block filter ruled the block out, for the scripts of nGeneration
+            bool fSkipped = false;
+            uint64_t nGeneration = 0;
+            std::future<RescanBlock> result;
+        };
+        std::deque<RescanRead> queueReads;
+
+        // With -blockfilterindex, blocks whose filter matches none of our
+        // scripts are not read at all.
+        CGCSFilter::ElementSet filterScripts;
+        uint64_t nFilterGeneration = std::numeric_limits<uint64_t>::max();
+        auto ruledOutByFilter = [&](const CBlockIndex* pindexFilter) {
+            CBlockFilter filter;
+            if (!pblockfilterindex || !pblockfilterindex->LookUpFilter(pindexFilter, filter))
+                return false;
+            if (nFilterGeneration != nKeyStoreGeneration) {
+                nFilterGeneration = nKeyStoreGeneration;
+                filterScripts = GetFilterScripts();
+            }
+            try {
+                return !filter.GetFilter().MatchAny(filterScripts);
+            } catch (const std::ios_base::failure&) {
+                return false;
+            }
+        };
+
         while (pindex && !fAbortRescan)
         {
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
@@ -1684,8 +1942,51 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            // Blocks read ahead of a reorg are thrown away.
+            if (!queueReads.empty() && queueReads.front().pindex != pindex)
+                queueReads.clear();
+            while (queueReads.size() < nReadsAhead) {
+                RescanRead read;
+                CBlockReadRequest request;
+                {
+                    LOCK(cs_main);
+                    read.pindex = pindex;
+                    if (!queueReads.empty()) {
+                        CBlockIndex* pindexLast = queueReads.back().pindex;
+                        read.pindex = pindexLast == pindexStop ? nullptr : chainActive.Next(pindexLast);
+                    }
+                    if (!read.pindex)
+                        break;
+                    request = GetBlockReadRequest(read.pindex);
+                }
+                if (ruledOutByFilter(read.pindex)) {
+                    read.fSkipped = true;
+                    read.nGeneration = nFilterGeneration;
+                } else {
+                    read.result = std::async(std::launch::async, readBlock, request);
+                }
+                queueReads.push_back(std::move(read));
+            }
+            RescanRead read = std::move(queueReads.front());
+            queueReads.pop_front();
+            // Keys added since the block was ruled out may be in it after all.
+            if (read.fSkipped && read.nGeneration != nKeyStoreGeneration && !ruledOutByFilter(pindex)) {
+                CBlockReadRequest request;
+                {
+                    LOCK(cs_main);
+                    request = GetBlockReadRequest(pindex);
+                }
+                read.fSkipped = false;
+                read.result = std::async(std::launch::deferred, readBlock, request);
+            }
+            RescanBlock result;
+            if (read.fSkipped) {
+                result.fRead = true;
+            } else {
+                result = read.result.get();
+            }
+
+            if (result.fRead) {
                 LOCK2(cs_main, cs_wallet);
                 if (pindex && !chainActive.Contains(pindex)) {
                     // Abort scan if current block is no longer active, to prevent
@@ -1693,8 +1994,10 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                     ret = pindex;
                     break;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                // Keys added since, like keypool top ups, may own outputs the read did not match
+                const bool fMatched = result.nGeneration == nKeyStoreGeneration;
+                for (size_t posInBlock = 0; posInBlock < result.block.vtx.size(); ++posInBlock) {
+                    AddToWalletIfInvolvingMe(result.block.vtx[posInBlock], pindex, posInBlock, fUpdate, fMatched && !result.vMine[posInBlock]);
                 }
             } else {
                 ret = pindex;
@@ -1721,6 +2024,15 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
     return ret;
 }
 
+CGCSFilter::ElementSet CWallet::GetFilterScripts() const
+{
+    CGCSFilter::ElementSet scripts;
+    LOCK(cs_KeyStore);
+    for (const CScript& script : setOwnedScripts)
+        scripts.emplace(script.begin(), script.end());
+    return scripts;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -1761,10 +2073,11 @@ bool CWalletTx::RelayWalletTransaction(CConnman* connman, const std::string& str
         if (InMempool() || AcceptToMemoryPool(maxTxFee, state)) {
             LogPrintf("Relaying wtx %s\n", GetHash().ToString());
             if (strCommand == NetMsgType::TXLOCKREQUEST) {
-                if (instantsend.ProcessTxLockRequest(static_cast<CTxLockRequest>(*this), *connman)) {
-                    instantsend.AcceptLockRequest(static_cast<CTxLockRequest>(*this));
+                const CTxLockRequest txLockRequest(tx);
+                if (instantsend.ProcessTxLockRequest(txLockRequest, *connman, !pwallet->CheckInstantSendInputs(tx))) {
+                    instantsend.AcceptLockRequest(txLockRequest);
                 } else {
-                    instantsend.RejectLockRequest(static_cast<CTxLockRequest>(*this));
+                    instantsend.RejectLockRequest(txLockRequest);
                 }
             }
             
@@ -1949,6 +2262,37 @@ CAmount CWalletTx::GetChange() const
     return nChangeCached;
 }
 
+CWalletBalances CWalletTx::GetBalanceContribution() const
+{
+    CWalletBalances balances;
+    if (IsTrusted()) {
+        balances.nTrusted = GetAvailableCredit();
+        balances.nWatchOnlyTrusted = GetAvailableWatchOnlyCredit();
+    } else if (GetDepthInMainChain() == 0 && InMempool()) {
+        balances.nUntrustedPending = GetAvailableCredit();
+        balances.nWatchOnlyUntrustedPending = GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = GetImmatureCredit();
+    balances.nWatchOnlyImmature = GetImmatureWatchOnlyCredit();
+    return balances;
+}
+
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    fAmountsCached = false;
+    if (pwallet)
+        pwallet->MarkWalletTxDirty(GetHash());
+}
+
 bool CWalletTx::InMempool() const
 {
     return fInMempool;
@@ -2053,94 +2397,100 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+const CWalletBalances& CWallet::UpdateBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip != pindexBalanceTip) {
+        // A longer chain only ages coinbases, anything else may have unwound
+        // conflicts without the transactions involved being marked dirty.
+        if (pindexBalanceTip && pindexTip && pindexTip->GetAncestor(pindexBalanceTip->nHeight) == pindexBalanceTip)
+            setBalanceDirty.insert(setBalanceImmature.begin(), setBalanceImmature.end());
+        else
+            fBalancesNeedRebuild = true;
+        pindexBalanceTip = pindexTip;
+    }
+
+    if (fBalancesNeedRebuild) {
+        cachedBalances = CWalletBalances();
+        mapBalanceContributions.clear();
+        setBalanceUnconfirmed.clear();
+        setBalanceImmature.clear();
+        setBalanceDirty.clear();
         for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+            setBalanceDirty.insert(entry.first);
+        fBalancesNeedRebuild = false;
+    }
+    setBalanceDirty.insert(setBalanceUnconfirmed.begin(), setBalanceUnconfirmed.end());
+
+    for (const uint256& hash : setBalanceDirty) {
+        auto it = mapBalanceContributions.find(hash);
+        if (it != mapBalanceContributions.end()) {
+            cachedBalances -= it->second;
+            mapBalanceContributions.erase(it);
         }
+        setBalanceUnconfirmed.erase(hash);
+        setBalanceImmature.erase(hash);
+
+        auto wit = mapWallet.find(hash);
+        if (wit == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = wit->second;
+        const CWalletBalances contribution = wtx.GetBalanceContribution();
+        cachedBalances += contribution;
+        mapBalanceContributions.emplace(hash, contribution);
+        if (wtx.GetDepthInMainChain(false) == 0)
+            setBalanceUnconfirmed.insert(hash);
+        else if (wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0)
+            setBalanceImmature.insert(hash);
     }
+    setBalanceDirty.clear();
 
-    return nTotal;
+    return cachedBalances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances().nWatchOnlyImmature;
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return UpdateBalances();
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2211,10 +2561,16 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     
     int nInstantSendConfirmationsRequired = Params().GetConsensus().nInstantSendConfirmationsRequired;
 
-    for (const auto& entry : mapWallet)
+    UpdateUnspentOutputs();
+    const std::map<COutPoint, isminetype>& mapOutputs = nCoinType == ONLY_COLLATERAL ? mapCollateralOutputs : mapUnspentOutputs;
+
+    // The outputs of a transaction are next to each other in the index, each
+    // group is checked against the transaction once.
+    for (auto it = mapOutputs.begin(), itNext = it; it != mapOutputs.end(); it = itNext)
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        const uint256& wtxid = it->first.hash;
+        itNext = mapOutputs.upper_bound(COutPoint(wtxid, std::numeric_limits<uint32_t>::max()));
+        const CWalletTx* pcoin = &mapWallet.at(wtxid);
 
         if (!CheckFinalTx(*pcoin->tx))
             continue;
@@ -2276,32 +2632,18 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
         if (nDepth < nMinDepth || nDepth > nMaxDepth)
             continue;
 
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-            bool found = false;
-            if(nCoinType == ONLY_COLLATERAL) {
-                found = pcoin->tx->vout[i].nValue == Params().GetConsensus().nMasternodeColleteralPaymentAmount * COIN;
-            } else {
-                found = true;
-            }
-            if(!found) continue;
-            
+        for (auto itOut = it; itOut != itNext; ++itOut) {
+            const unsigned int i = itOut->first.n;
             if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
-                continue;
-
-            if (IsLockedCoin(entry.first, i) && nCoinType != ONLY_COLLATERAL)
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(itOut->first))
                 continue;
 
-            if (IsSpent(wtxid, i))
+            if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_COLLATERAL)
                 continue;
 
-            isminetype mine = IsMine(pcoin->tx->vout[i]);
-
-            if (mine == ISMINE_NO) {
-                continue;
-            }
+            isminetype mine = itOut->second;
 
             bool fSpendableIn = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO);
             bool fSolvableIn = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO;
@@ -2325,6 +2667,54 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
     }
 }
 
+void CWallet::UpdateUnspentOutputs() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip != pindexUnspentTip) {
+        if (!pindexUnspentTip || !pindexTip || pindexTip->GetAncestor(pindexUnspentTip->nHeight) != pindexUnspentTip)
+            fUnspentNeedRebuild = true;
+        pindexUnspentTip = pindexTip;
+    }
+
+    if (fUnspentNeedRebuild) {
+        mapUnspentOutputs.clear();
+        mapCollateralOutputs.clear();
+        setUnspentDirty.clear();
+        for (const auto& entry : mapWallet)
+            setUnspentDirty.insert(entry.first);
+        fUnspentNeedRebuild = false;
+    }
+
+    const CAmount nCollateral = Params().GetConsensus().nMasternodeColleteralPaymentAmount * COIN;
+    for (const uint256& hash : setUnspentDirty) {
+        auto it = mapUnspentOutputs.lower_bound(COutPoint(hash, 0));
+        while (it != mapUnspentOutputs.end() && it->first.hash == hash)
+            it = mapUnspentOutputs.erase(it);
+        auto itCollateral = mapCollateralOutputs.lower_bound(COutPoint(hash, 0));
+        while (itCollateral != mapCollateralOutputs.end() && itCollateral->first.hash == hash)
+            itCollateral = mapCollateralOutputs.erase(itCollateral);
+
+        auto wit = mapWallet.find(hash);
+        if (wit == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = wit->second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+            if (IsSpent(hash, i))
+                continue;
+            isminetype mine = IsMine(wtx.tx->vout[i]);
+            if (mine == ISMINE_NO)
+                continue;
+            mapUnspentOutputs.emplace_hint(it, COutPoint(hash, i), mine);
+            if (wtx.tx->vout[i].nValue == nCollateral)
+                mapCollateralOutputs.emplace_hint(itCollateral, COutPoint(hash, i), mine);
+        }
+    }
+    setUnspentDirty.clear();
+}
+
 std::map<CTxDestination, std::vector<COutput>> CWallet::ListCoins() const
 {
     // TODO: Add AssertLockHeld(cs_wallet) here.
@@ -2388,67 +2778,13 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
     return ptx->vout[n];
 }
 
-static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
-                                  std::vector<char>& vfBest, CAmount& nBest, bool fUseInstantSend = false, int iterations = 1000)
-{
-    std::vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    FastRandomContext insecure_rand;
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                if (fUseInstantSend && nTotal + vValue[i].txout.nValue > sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN) {
-                    continue;
-                }
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].txout.nValue;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].txout.nValue;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend) const
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend, const CAmount& nCostOfChange) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
-    boost::optional<CInputCoin> coinLowestLarger;
-    std::vector<CInputCoin> vValue;
-    CAmount nTotalLower = 0;
-    
-    CAmount nTxValueLimit = fUseInstantSend ? sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN : std::numeric_limits<CAmount>::max();
+    std::vector<CInputCoin> vCandidates;
 
     random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
 
@@ -2465,87 +2801,23 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
             continue;
 
-        int i = output.i;
-
-        CInputCoin coin = CInputCoin(pcoin, i);
-
-        if (coin.txout.nValue == nTargetValue)
-        {
-            setCoinsRet.insert(coin);
-            nValueRet += coin.txout.nValue;
-            return true;
-        }
-        else if (coin.txout.nValue < nTargetValue + MIN_CHANGE)
-        {
-            vValue.push_back(coin);
-            nTotalLower += coin.txout.nValue;
-        }
-        else if (!coinLowestLarger || (coin.txout.nValue < coinLowestLarger->txout.nValue && coin.txout.nValue < nTxValueLimit))
-        {
-            coinLowestLarger = coin;
-        }
+        vCandidates.push_back(CInputCoin(pcoin, output.i));
     }
 
-    if (nTotalLower == nTargetValue)
-    {
-        for (const auto& input : vValue)
-        {
-            setCoinsRet.insert(input);
-            nValueRet += input.txout.nValue;
-        }
-        return true;
-    }
-
-    if (nTotalLower < nTargetValue)
-    {
-        if (!coinLowestLarger)
-            return false;
-        setCoinsRet.insert(coinLowestLarger.get());
-        nValueRet += coinLowestLarger->txout.nValue;
+    // Try to get away without change first. InstantSend transactions must
+    // stay within the InstantSend value limit, which the knapsack honours.
+    CAmount nTxValueLimit = fUseInstantSend ? sporkManager.GetSporkValue(SPORK_3_INSTANTSEND_MAX_VALUE)*COIN : std::numeric_limits<CAmount>::max();
+    const CBranchAndBoundSelector bnb(nCostOfChange);
+    if (bnb.Select(vCandidates, nTargetValue, setCoinsRet, nValueRet) && nValueRet <= nTxValueLimit) {
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() %s: %d coins, total %s\n", bnb.GetName(), setCoinsRet.size(), FormatMoney(nValueRet));
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
-    std::reverse(vValue.begin(), vValue.end());
-    std::vector<char> vfBest;
-    CAmount nBest;
-
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, fUseInstantSend);
-    if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, fUseInstantSend);
-
-    // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
-    //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger &&
-        ((nBest != nTargetValue && nBest < nTargetValue + MIN_CHANGE) || (coinLowestLarger->txout.nValue <= nBest && nTxValueLimit <= nBest)))
-    {
-        setCoinsRet.insert(coinLowestLarger.get());
-        nValueRet += coinLowestLarger->txout.nValue;
-    }
-    else {
-        for (unsigned int i = 0; i < vValue.size(); i++)
-            if (vfBest[i])
-            {
-                setCoinsRet.insert(vValue[i]);
-                nValueRet += vValue[i].txout.nValue;
-            }
-
-        if (LogAcceptCategory(BCLog::SELECTCOINS)) {
-            LogPrint(BCLog::SELECTCOINS, "SelectCoins() best subset: ");
-            for (unsigned int i = 0; i < vValue.size(); i++) {
-                if (vfBest[i]) {
-                    LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(vValue[i].txout.nValue));
-                }
-            }
-            LogPrint(BCLog::SELECTCOINS, "total %s\n", FormatMoney(nBest));
-        }
-    }
-
-    return true;
+    const CKnapsackSelector knapsack(fUseInstantSend);
+    return knapsack.Select(vCandidates, nTargetValue, setCoinsRet, nValueRet);
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, bool fUseInstantSend) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, bool fUseInstantSend, const CAmount& nCostOfChange) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
 
@@ -2597,13 +2869,13 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, fUseInstantSend)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, fUseInstantSend)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, fUseInstantSend)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, fUseInstantSend)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, fUseInstantSend));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, fUseInstantSend, nCostOfChange));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2620,20 +2892,23 @@ bool CWallet::SignTransaction(CMutableTransaction &tx)
 
     // sign the new tx
     CTransaction txNewConst(tx);
-    int nIn = 0;
+    std::vector<const CTxOut*> vSpent;
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
+        vSpent.push_back(&mi->second.tx->vout[input.prevout.n]);
+    }
+    std::vector<SignatureData> vSigData(tx.vin.size());
+    std::vector<char> vSigned(tx.vin.size(), false);
+    ForEachInputInParallel(tx.vin.size(), [&](unsigned int nIn) {
+        vSigned[nIn] = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, vSpent[nIn]->nValue, SIGHASH_ALL), vSpent[nIn]->scriptPubKey, vSigData[nIn]);
+    });
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+        if (!vSigned[nIn])
             return false;
-        }
-        UpdateTransaction(tx, nIn, sigdata);
-        nIn++;
+        UpdateTransaction(tx, nIn, vSigData[nIn]);
     }
     return true;
 }
@@ -2720,10 +2995,43 @@ OutputType CWallet::TransactionChangeType(OutputType change_type, const std::vec
     return g_address_type;
 }
 
+/**
+ * Virtual size txNew will have once its inputs, which spend setCoins in
+ * order and are not signed yet, are. The inputs are sized without signing
+ * them, the sizes are kept in mapInputSizes by scriptPubKey for the next
+ * estimate.
+ */
+static bool EstimateSignedTxSize(const CKeyStore& keystore, const CMutableTransaction& txNew, const std::set<CInputCoin>& setCoins,
+                                 std::map<CScript, SignedInputSize>& mapInputSizes, unsigned int& nBytesRet)
+{
+    // The empty scriptSigs are serialized as one byte each
+    int64_t nBaseBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) - setCoins.size();
+    int64_t nWitnessBytes = 0;
+    bool fWitness = false;
+    for (const CInputCoin& coin : setCoins) {
+        auto it = mapInputSizes.find(coin.txout.scriptPubKey);
+        if (it == mapInputSizes.end()) {
+            SignedInputSize size;
+            if (!EstimateSignedInputSize(keystore, coin.txout.scriptPubKey, size)) {
+                return false;
+            }
+            it = mapInputSizes.emplace(coin.txout.scriptPubKey, size).first;
+        }
+        nBaseBytes += it->second.nScriptSigBytes;
+        // Inputs without a witness still have its empty stack serialized
+        nWitnessBytes += it->second.nWitnessBytes ? it->second.nWitnessBytes : 1;
+        fWitness |= it->second.nWitnessBytes != 0;
+    }
+    // With a witness the marker and flag bytes come on top
+    const int64_t nWeight = nBaseBytes * WITNESS_SCALE_FACTOR + (fWitness ? 2 + nWitnessBytes : 0);
+    nBytesRet = GetVirtualTransactionSize(nWeight, 0);
+    return true;
+}
+
 bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet,
                                 int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool sign, AvailableCoinsType nCoinType, bool fUseInstantSend)
 {
-    CAmount nFeePay = fUseInstantSend ? CTxLockRequest().GetMinFee() : 0;
+    CAmount nFeePay = fUseInstantSend ? CTxLockRequest::GetMinFee(0) : 0;
     
     CAmount nValue = 0;
     int nChangePosRequest = nChangePosInOut;
@@ -2827,10 +3135,26 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             size_t change_prototype_size = GetSerializeSize(change_prototype_txout, SER_DISK, 0);
 
             CFeeRate discard_rate = GetDiscardRate(::feeEstimator);
+            // Change worth less than this would be dust and go to the fee, a
+            // selection that close to the target needs no change output.
+            const CAmount nCostOfChange = GetDustThreshold(change_prototype_txout, discard_rate);
             nFeeRet = 0;
             if(nFeePay > 0) nFeeRet = nFeePay;
+            // Start from the fee for the recipients' outputs, which the
+            // transaction pays whatever coins are picked, so a sendmany to many
+            // recipients selects enough coins in the first pass already.
+            if (nSubtractFeeFromAmount == 0) {
+                CMutableTransaction txOutputs;
+                txOutputs.nLockTime = txNew.nLockTime;
+                for (const auto& recipient : vecSend) {
+                    txOutputs.vout.push_back(CTxOut(recipient.nAmount, recipient.scriptPubKey));
+                }
+                nFeeRet = std::max(nFeeRet, GetMinimumFee(GetVirtualTransactionSize(txOutputs), coin_control, ::mempool, ::feeEstimator, nullptr));
+            }
             bool pick_new_inputs = true;
             CAmount nValueIn = 0;
+            // Sizes of the signed inputs by the scripts they spend
+            std::map<CScript, SignedInputSize> mapInputSizes;
             // Start with no fee and loop until there is enough fee
             while (true)
             {
@@ -2880,7 +3204,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                 if (pick_new_inputs) {
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, fUseInstantSend))
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, fUseInstantSend, nCostOfChange))
                     {
                         strFailReason = _("Insufficient funds");
                         if (fUseInstantSend) {
@@ -2945,24 +3269,16 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                     txNew.vin.push_back(CTxIn(coin.outpoint,CScript(),
                                               nSequence));
 
-                // Fill in dummy signatures for fee calculation.
-                if (!DummySignTx(txNew, setCoins)) {
+                // Size the transaction as signed for fee calculation.
+                if (!EstimateSignedTxSize(*this, txNew, setCoins, mapInputSizes, nBytes)) {
                     strFailReason = _("Signing transaction failed");
                     return false;
                 }
 
-                nBytes = GetVirtualTransactionSize(txNew);
-
-                // Remove scriptSigs to eliminate the fee calculation dummy signatures
-                for (auto& vin : txNew.vin) {
-                    vin.scriptSig = CScript();
-                    vin.scriptWitness.SetNull();
-                }
-
                 nFeeNeeded = std::max(nFeePay, GetMinimumFee(nBytes, coin_control, ::mempool, ::feeEstimator, &feeCalc));
                 
                 if(fUseInstantSend) {
-                    nFeeNeeded = std::max(nFeeNeeded, CTxLockRequest(txNew).GetMinFee());
+                    nFeeNeeded = std::max(nFeeNeeded, CTxLockRequest::GetMinFee(txNew.vin.size()));
                 }
 
                 // If we made it here and we aren't even able to meet the relay fee on the next pass, give up
@@ -3042,21 +3358,20 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
         if (sign)
         {
             CTransaction txNewConst(txNew);
-            int nIn = 0;
-            for (const auto& coin : setCoins)
+            const std::vector<CInputCoin> vCoins(setCoins.begin(), setCoins.end());
+            std::vector<SignatureData> vSigData(vCoins.size());
+            std::vector<char> vSigned(vCoins.size(), false);
+            ForEachInputInParallel(vCoins.size(), [&](unsigned int nIn) {
+                vSigned[nIn] = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, vCoins[nIn].txout.nValue, SIGHASH_ALL), vCoins[nIn].txout.scriptPubKey, vSigData[nIn]);
+            });
+            for (unsigned int nIn = 0; nIn < vCoins.size(); nIn++)
             {
-                const CScript& scriptPubKey = coin.txout.scriptPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, coin.txout.nValue, SIGHASH_ALL), scriptPubKey, sigdata))
+                if (!vSigned[nIn])
                 {
                     strFailReason = _("Signing transaction failed");
                     return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
                 }
-
-                nIn++;
+                UpdateTransaction(txNew, nIn, vSigData[nIn]);
             }
         }
 
@@ -3262,12 +3577,15 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& s
         mapAddressBook[address].name = strName;
         if (!strPurpose.empty()) /* update purpose only if requested */
             mapAddressBook[address].purpose = strPurpose;
+        nAddressBookGeneration++;
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                              strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
-    if (!strPurpose.empty() && !CWalletDB(*dbw).WritePurpose(EncodeDestination(address), strPurpose))
-        return false;
-    return CWalletDB(*dbw).WriteName(EncodeDestination(address), strName);
+    return WriteWalletDB([&](CWalletDB& walletdb) {
+        if (!strPurpose.empty() && !walletdb.WritePurpose(EncodeDestination(address), strPurpose))
+            return false;
+        return walletdb.WriteName(EncodeDestination(address), strName);
+    });
 }
 
 bool CWallet::DelAddressBook(const CTxDestination& address)
@@ -3282,6 +3600,7 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
             CWalletDB(*dbw).EraseDestData(strAddress, item.first);
         }
         mapAddressBook.erase(address);
+        nAddressBookGeneration++;
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, "", CT_DELETED);
@@ -3341,6 +3660,30 @@ size_t CWallet::KeypoolCountExternalKeys()
     return setExternalKeyPool.size();
 }
 
+size_t CWallet::DynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapWallet);
+    for (const auto& entry : mapWallet) {
+        nUsage += RecursiveDynamicUsage(entry.second.tx) + memusage::DynamicUsage(entry.second.mapValue);
+    }
+    nUsage += memusage::DynamicUsage(mapTxSpends) + memusage::DynamicUsage(wtxOrdered);
+    nUsage += memusage::DynamicUsage(mapBalanceContributions) + memusage::DynamicUsage(setBalanceDirty);
+    nUsage += memusage::DynamicUsage(setBalanceUnconfirmed) + memusage::DynamicUsage(setBalanceImmature);
+    nUsage += memusage::DynamicUsage(mapUnspentOutputs) + memusage::DynamicUsage(mapCollateralOutputs);
+    nUsage += memusage::DynamicUsage(setUnspentDirty);
+    nUsage += memusage::DynamicUsage(mapAddressBook) + memusage::DynamicUsage(mapRequestCount);
+    nUsage += memusage::DynamicUsage(setLockedCoins);
+    nUsage += memusage::DynamicUsage(setInternalKeyPool) + memusage::DynamicUsage(setExternalKeyPool);
+    nUsage += memusage::DynamicUsage(m_pool_key_to_index) + memusage::DynamicUsage(mapKeyMetadata);
+    {
+        LOCK(cs_KeyStore);
+        nUsage += memusage::DynamicUsage(mapKeys) + memusage::DynamicUsage(mapCryptedKeys);
+        nUsage += memusage::DynamicUsage(mapScripts) + memusage::DynamicUsage(setWatchOnly);
+    }
+    return nUsage;
+}
+
 void CWallet::LoadKeyPool(int64_t nIndex, const CKeyPool &keypool)
 {
     AssertLockHeld(cs_wallet);
@@ -3385,28 +3728,31 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
-        CWalletDB walletdb(*dbw);
-        for (int64_t i = missingInternal + missingExternal; i--;)
+        CWalletBatchSession batch(this);
+        CWalletDB& walletdb = batch.GetWalletDB();
+        // The external keys first, each chain derived in one go
+        for (bool internal : {false, true})
         {
-            if (i < missingInternal) {
-                internal = true;
+            const int64_t nMissing = internal ? missingInternal : missingExternal;
+            if (nMissing == 0) {
+                continue;
             }
 
-            assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
-            int64_t index = ++m_max_keypool_index;
+            for (const CPubKey& pubkey : GenerateNewKeys(walletdb, nMissing, internal)) {
+                assert(m_max_keypool_index < std::numeric_limits<int64_t>::max()); // How in the hell did you use so many keys?
+                int64_t index = ++m_max_keypool_index;
 
-            CPubKey pubkey(GenerateNewKey(walletdb, internal));
-            if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
-                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
-            }
+                if (!walletdb.WritePool(index, CKeyPool(pubkey, internal))) {
+                    throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+                }
 
-            if (internal) {
-                setInternalKeyPool.insert(index);
-            } else {
-                setExternalKeyPool.insert(index);
+                if (internal) {
+                    setInternalKeyPool.insert(index);
+                } else {
+                    setExternalKeyPool.insert(index);
+                }
+                m_pool_key_to_index[pubkey.GetID()] = index;
             }
-            m_pool_key_to_index[pubkey.GetID()] = index;
         }
         if (missingInternal + missingExternal > 0) {
             LogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size(), setInternalKeyPool.size());
@@ -3971,7 +4317,10 @@ bool CWallet::AddDestData(const CTxDestination &dest, const std::string &key, co
         return false;
 
     mapAddressBook[dest].destdata.insert(std::make_pair(key, value));
-    return CWalletDB(*dbw).WriteDestData(EncodeDestination(dest), key, value);
+    nAddressBookGeneration++;
+    return WriteWalletDB([&](CWalletDB& walletdb) {
+        return walletdb.WriteDestData(EncodeDestination(dest), key, value);
+    });
 }
 
 bool CWallet::EraseDestData(const CTxDestination &dest, const std::string &key)
@@ -4136,7 +4485,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
     }
 
     walletInstance->m_last_block_processed = chainActive.Tip();
-    RegisterValidationInterface(walletInstance);
+    RegisterValidationInterface(walletInstance, "wallet " + walletFile);
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan)
     {
@@ -4203,6 +4552,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
         }
     }
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
+    walletInstance->CompactWalletTxs();
 
     {
         LOCK(walletInstance->cs_wallet);
@@ -4224,7 +4574,7 @@ void CWallet::postInitProcess(CScheduler& scheduler)
 
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushScheduled.exchange(true)) {
-        scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
+        scheduler.scheduleEvery(MaybeCompactWalletDB, 500, CScheduler::PRIORITY_LOW, "wallet flush");
     }
 }
 
@@ -4417,3 +4767,23 @@ CTxDestination CWallet::AddAndGetDestinationForScript(const CScript& script, Out
     default: assert(false);
     }
 }
+
+CWalletBatchSession::CWalletBatchSession(CWalletRef w) : m_wallet(w)
+{
+    AssertLockHeld(m_wallet->cs_wallet);
+    if (m_wallet->pwalletdbBatch)
+        return;
+    m_walletdb.reset(new CWalletDB(*m_wallet->dbw));
+    // Without a transaction, as for a dummy database, the writes still share one flush.
+    m_walletdb->BeginBatchSession();
+    m_wallet->pwalletdbBatch = m_walletdb.get();
+}
+
+CWalletBatchSession::~CWalletBatchSession()
+{
+    if (!m_walletdb)
+        return;
+    m_wallet->pwalletdbBatch = nullptr;
+    if (m_walletdb->InBatchSession() && !m_walletdb->CommitBatchSession())
+        LogPrintf("%s: committing the writes to wallet %s failed\n", __func__, m_wallet->GetName());
+}
@@ -9,6 +9,7 @@
 
 #include <amount.h>
 #include <auxpow.h> // contains CMerkleTx
+#include <blockfilter.h>
 #include <policy/feerate.h>
 #include <streams.h>
 #include <tinyformat.h>
@@ -24,10 +25,12 @@
 #include <algorithm>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -67,6 +70,12 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! Most blocks a wallet rescan reads and matches against the keystore ahead
+static const int MAX_RESCAN_READS_AHEAD = 16;
+//! Confirmations after which a fully spent transaction is kept in memory without its witnesses
+static const int COMPACT_TX_MIN_DEPTH = 1000;
+//! Blocks between the passes that compact the transactions that got old enough
+static const int COMPACT_TX_INTERVAL = 1000;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -198,6 +207,39 @@ static inline void WriteOrderPos(const int64_t& nOrderPos, mapValue_t& mapValue)
     mapValue["n"] = i64tostr(nOrderPos);
 }
 
+/** What the transactions of a wallet add up to in each of the balances it reports */
+struct CWalletBalances
+{
+    CAmount nTrusted = 0;
+    CAmount nUntrustedPending = 0;
+    CAmount nImmature = 0;
+    CAmount nWatchOnlyTrusted = 0;
+    CAmount nWatchOnlyUntrustedPending = 0;
+    CAmount nWatchOnlyImmature = 0;
+
+    CWalletBalances& operator+=(const CWalletBalances& other)
+    {
+        nTrusted += other.nTrusted;
+        nUntrustedPending += other.nUntrustedPending;
+        nImmature += other.nImmature;
+        nWatchOnlyTrusted += other.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending += other.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature += other.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& other)
+    {
+        nTrusted -= other.nTrusted;
+        nUntrustedPending -= other.nUntrustedPending;
+        nImmature -= other.nImmature;
+        nWatchOnlyTrusted -= other.nWatchOnlyTrusted;
+        nWatchOnlyUntrustedPending -= other.nWatchOnlyUntrustedPending;
+        nWatchOnlyImmature -= other.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 struct COutputEntry
 {
     CTxDestination destination;
@@ -309,6 +351,8 @@ public:
     mutable bool fAvailableWatchCreditCached;
     mutable bool fChangeCached;
     mutable bool fInMempool;
+    //! The witnesses of tx were dropped to save memory, the database still has them, see CWallet::CompactWalletTxs
+    bool fCompactTx;
     mutable CAmount nDebitCached;
     mutable CAmount nCreditCached;
     mutable CAmount nImmatureCreditCached;
@@ -318,6 +362,13 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! GetAmounts of the last filter asked for, valid for the wallet generations it was computed at
+    mutable bool fAmountsCached;
+    mutable isminefilter filterAmountsCached;
+    mutable uint64_t nAmountsGenerationCached;
+    mutable std::list<COutputEntry> listReceivedCached;
+    mutable std::list<COutputEntry> listSentCached;
+    mutable CAmount nFeeCached;
 
     CWalletTx()
     {
@@ -349,6 +400,7 @@ public:
         fAvailableWatchCreditCached = false;
         fChangeCached = false;
         fInMempool = false;
+        fCompactTx = false;
         nDebitCached = 0;
         nCreditCached = 0;
         nImmatureCreditCached = 0;
@@ -358,6 +410,12 @@ public:
         nAvailableWatchCreditCached = 0;
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
+        fAmountsCached = false;
+        filterAmountsCached = ISMINE_NO;
+        nAmountsGenerationCached = 0;
+        listReceivedCached.clear();
+        listSentCached.clear();
+        nFeeCached = 0;
         nOrderPos = -1;
     }
 
@@ -404,19 +462,8 @@ public:
         mapValue.erase("timesmart");
     }
 
-    //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! make sure balances are recalculated, including the wallet totals
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -433,6 +480,9 @@ public:
     CAmount GetAvailableWatchOnlyCredit(const bool fUseCache=true) const;
     CAmount GetChange() const;
 
+    //! What this transaction currently adds to the wallet balances
+    CWalletBalances GetBalanceContribution() const;
+
     void GetAmounts(std::list<COutputEntry>& listReceived,
                     std::list<COutputEntry>& listSent, CAmount& nFee, std::string& strSentAccount, const isminefilter& filter) const;
 
@@ -631,6 +681,19 @@ private:
 
 
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
+
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript& script) const;
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -641,8 +704,24 @@ private:
     static std::atomic<bool> fFlushScheduled;
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet; //controlled by WalletRescanReserver
+    //! Bumped whenever keys or scripts are added, outputs matched before may be ours now
+    std::atomic<uint64_t> nKeyStoreGeneration{0};
+    //! Bumped whenever the address book changes, which outputs are change may be different now
+    std::atomic<uint64_t> nAddressBookGeneration{0};
+    /**
+     * Every output script ::IsMine accepts, except for bare multisig, so
+     * IsMine(const CTxOut&) can turn down anything else with one lookup.
+     * Only grows, scripts that stopped being watched just miss the shortcut.
+     * Guarded by cs_KeyStore.
+     */
+    std::unordered_set<CScript, SaltedScriptHasher> setOwnedScripts;
+    /** Add the scripts paying to a key, a redeem or witness script or a watched script to setOwnedScripts */
+    void AddOwnedScripts(const CPubKey& pubkey);
+    void AddOwnedScripts(const CScript& redeemScript);
+    void AddOwnedWatchOnly(const CScript& dest);
     std::mutex mutexScanning;
     friend class WalletRescanReserver;
+    friend class CWalletBatchSession;
 
 
     /**
@@ -650,9 +729,21 @@ private:
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr, bool fUseInstantSend = true) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr, bool fUseInstantSend = true, const CAmount& nCostOfChange = 0) const;
 
     CWalletDB *pwalletdbEncryption;
+    //! The handle of the open CWalletBatchSession, if any, guarded by cs_wallet
+    CWalletDB *pwalletdbBatch = nullptr;
+
+    /** Write through the handle of the open batch session, or a handle of its own that flushes when done */
+    template <typename F>
+    bool WriteWalletDB(F write)
+    {
+        if (pwalletdbBatch)
+            return write(*pwalletdbBatch);
+        CWalletDB walletdb(*dbw);
+        return write(walletdb);
+    }
 
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
@@ -679,6 +770,43 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Running totals behind GetBalance and friends, together with what each
+     * transaction added to them. Transactions marked dirty are subtracted and
+     * re-added on the next query. Unconfirmed transactions are re-evaluated on
+     * every query, as mempool and InstantSend state can change without them
+     * being marked dirty, and immature coinbases whenever the tip moved on.
+     * Anything else, like a reorg, rebuilds the totals from scratch.
+     * Protected by cs_wallet.
+     */
+    mutable CWalletBalances cachedBalances;
+    mutable std::map<uint256, CWalletBalances> mapBalanceContributions;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceUnconfirmed;
+    mutable std::set<uint256> setBalanceImmature;
+    mutable const CBlockIndex* pindexBalanceTip = nullptr;
+    mutable bool fBalancesNeedRebuild = true;
+
+    /** Bring cachedBalances up to date, requires cs_main and cs_wallet */
+    const CWalletBalances& UpdateBalances() const;
+
+    /**
+     * The outputs of wallet transactions that are ours and not spent, so
+     * AvailableCoins does not have to look at every output the wallet ever
+     * received. Kept up to date like the balance totals: dirty transactions
+     * are re-indexed on the next use, and everything after a reorg, which can
+     * return spenders from conflicted to unconfirmed. Protected by cs_wallet.
+     */
+    mutable std::map<COutPoint, isminetype> mapUnspentOutputs;
+    //! The entries of mapUnspentOutputs worth exactly a masternode collateral, for ONLY_COLLATERAL
+    mutable std::map<COutPoint, isminetype> mapCollateralOutputs;
+    mutable std::set<uint256> setUnspentDirty;
+    mutable const CBlockIndex* pindexUnspentTip = nullptr;
+    mutable bool fUnspentNeedRebuild = true;
+
+    /** Bring mapUnspentOutputs and mapCollateralOutputs up to date, requires cs_main and cs_wallet */
+    void UpdateUnspentOutputs() const;
+
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected.
      * Should be called with pindexBlock and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, const CBlockIndex *pindex = nullptr, int posInBlock = 0);
@@ -687,7 +815,8 @@ private:
     CHDChain hdChain;
 
     /* HD derive new child key (on internal or external chain) */
-    void DeriveNewChildKey(CWalletDB &walletdb, CKeyMetadata& metadata, CKey& secret, bool internal = false);
+    /** Derive the next nKeys keys of an HD chain that the wallet does not have yet, several at a time */
+    void DeriveNewChildKeys(CWalletDB &walletdb, unsigned int nKeys, bool internal, int64_t nCreationTime, std::vector<CKey>& vSecrets, std::vector<CPubKey>& vPubKeys, std::vector<CKeyMetadata>& vMetadata);
 
     std::set<int64_t> setInternalKeyPool;
     std::set<int64_t> setExternalKeyPool;
@@ -726,7 +855,7 @@ public:
      * Main wallet lock.
      * This lock protects all the fields added by CWallet.
      */
-    mutable CCriticalSection cs_wallet;
+    mutable CInstrumentedCriticalSection cs_wallet;
 
     /** Get database handle used by this wallet. Ideally this function would
      * not be necessary.
@@ -834,9 +963,10 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. A selection worth at most nCostOfChange more than the
+     * target, which needs no change output, is preferred (CCoinSelector).
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false, const CAmount& nCostOfChange = 0) const;
 
     /// Get Collateral Payment output and keys which can be used for the Masternode
     bool GetMasternodeOutpointAndKeys(COutPoint& outpointRet, CPubKey& pubKeyRet, CKey& keyRet, const std::string& strTxHash = "", const std::string& strOutputIndex = "");
@@ -844,6 +974,20 @@ public:
     bool GetOutpointAndKeysFromOutput(const COutput& out, COutPoint& outpointRet, CPubKey& pubKeyRet, CKey& keyRet);
     
     bool IsSpent(const uint256& hash, unsigned int n) const;
+    /**
+     * Whether the inputs of tx pass the checks CTxLockRequest::IsValid makes
+     * against the UTXO set, going by the wallet transactions they spend, so
+     * locking a transaction the wallet just created needs no second lookup.
+     */
+    bool CheckInstantSendInputs(const CTransactionRef& tx) const;
+    /**
+     * Drop the witnesses of the transactions that are buried deep enough and
+     * have all of our outputs spent, no history query needs them.
+     * GetFullTransaction reads them back from the database.
+     */
+    void CompactWalletTxs();
+    //! The transaction of wtx with its witnesses, even if they were compacted away
+    CTransactionRef GetFullTransaction(const CWalletTx& wtx) const;
 
     bool IsLockedCoin(uint256 hash, unsigned int n) const;
     void LockCoin(const COutPoint& output);
@@ -863,11 +1007,13 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(CWalletDB& walletdb, bool internal = false);
+    //! Generate and add nKeys keys, the EC operations on several threads
+    std::vector<CPubKey> GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys, bool internal = false);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKeyPubKeyWithDB(CWalletDB &walletdb,const CKey& key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey &pubkey);
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CKeyID& keyID, const CKeyMetadata &metadata);
     bool LoadScriptMetadata(const CScriptID& script_id, const CKeyMetadata &metadata);
@@ -919,14 +1065,21 @@ public:
     bool GetAccountDestination(CTxDestination &dest, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    //! Have the balance totals and the unspent outputs re-evaluate a transaction
+    void MarkWalletTxDirty(const uint256& hash) const;
+    //! Changes whenever the keys, scripts or address book change, and with them what CWalletTx::GetAmounts reports
+    uint64_t GetAmountsGeneration() const { return nKeyStoreGeneration + nAddressBookGeneration; }
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
+    /** fNotMine: the caller already found none of the outputs of tx to be ours */
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, bool fNotMine = false);
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, const WalletRescanReserver& reserver, bool fUpdate = false);
+    /** The output scripts IsMine can accept, apart from bare multisig, to match against block filters */
+    CGCSFilter::ElementSet GetFilterScripts() const;
     void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
@@ -938,6 +1091,8 @@ public:
     CAmount GetWatchOnlyBalance() const;
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
+    /** All of the above at once, under a single lock of cs_main and cs_wallet */
+    CWalletBalances GetBalances() const;
     CAmount GetLegacyBalance(const isminefilter& filter, int minDepth, const std::string* account, bool fAddLockConf) const;
     CAmount GetAvailableBalance(const CCoinControl* coinControl = nullptr) const;
 
@@ -971,6 +1126,8 @@ public:
 
     bool NewKeyPool();
     size_t KeypoolCountExternalKeys();
+    /** Estimated bytes used by the transactions, keys and the indexes and caches over them */
+    size_t DynamicMemoryUsage() const;
     bool TopUpKeyPool(unsigned int kpSize = 0);
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool, bool fRequestedInternal);
     void KeepKey(int64_t nIndex);
@@ -1280,4 +1437,28 @@ public:
     }
 };
 
+/**
+ * RAII object that has the key, script, address book and key pool writes of a
+ * bulk operation, like an import or a key pool refill, go to one database
+ * transaction that is committed and flushed once when it goes out of scope.
+ * Needs cs_wallet held for as long as it lives. Nothing may write to the
+ * wallet database through another handle meanwhile, so no rescans or new
+ * transactions while one is open. A session inside another one joins it.
+ */
+class CWalletBatchSession
+{
+private:
+    CWalletRef m_wallet;
+    std::unique_ptr<CWalletDB> m_walletdb;
+public:
+    explicit CWalletBatchSession(CWalletRef w);
+    ~CWalletBatchSession();
+
+    CWalletBatchSession(const CWalletBatchSession&) = delete;
+    CWalletBatchSession& operator=(const CWalletBatchSession&) = delete;
+
+    //! The handle the writes of the session go to
+    CWalletDB& GetWalletDB() { return *m_wallet->pwalletdbBatch; }
+};
+
 #endif // BITCOIN_WALLET_WALLET_H
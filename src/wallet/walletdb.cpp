@@ -16,7 +16,11 @@
 #include <utiltime.h>
 #include <wallet/wallet.h>
 
+#include <ui_interface.h>
+
 #include <atomic>
+#include <deque>
+#include <future>
 
 #include <boost/thread.hpp>
 
@@ -48,9 +52,24 @@ bool CWalletDB::ErasePurpose(const std::string& strAddress)
 
 bool CWalletDB::WriteTx(const CWalletTx& wtx)
 {
+    if (wtx.fCompactTx) {
+        // Keep the witnesses the wallet dropped from memory in the database.
+        CWalletTx wtxStored;
+        if (!ReadTx(wtx.GetHash(), wtxStored))
+            return false;
+        CWalletTx wtxFull(wtx);
+        wtxFull.SetTx(wtxStored.tx);
+        wtxFull.fCompactTx = false;
+        return WriteIC(std::make_pair(std::string("tx"), wtx.GetHash()), wtxFull);
+    }
     return WriteIC(std::make_pair(std::string("tx"), wtx.GetHash()), wtx);
 }
 
+bool CWalletDB::ReadTx(const uint256& hash, CWalletTx& wtx)
+{
+    return batch.Read(std::make_pair(std::string("tx"), hash), wtx);
+}
+
 bool CWalletDB::EraseTx(uint256 hash)
 {
     return EraseIC(std::make_pair(std::string("tx"), hash));
@@ -240,6 +259,66 @@ public:
     }
 };
 
+/** A "tx" record of the wallet database, decoded apart from the other records */
+struct CLoadedWalletTx
+{
+    uint256 hash;
+    CDataStream ssValue{SER_DISK, CLIENT_VERSION};
+    CWalletTx wtx;
+    bool fValid = false;
+    bool fUpgraded = false;
+    std::string strErr;
+};
+
+/** Deserialize and check a transaction record, needs nothing from the wallet so it can run on any thread */
+static void DecodeWalletTx(CLoadedWalletTx& loaded)
+{
+    try {
+        CDataStream& ssValue = loaded.ssValue;
+        CWalletTx& wtx = loaded.wtx;
+        ssValue >> wtx;
+        CValidationState state;
+        if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == loaded.hash) && state.IsValid()))
+            return;
+
+        // Undo serialize changes in 31600
+        if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+        {
+            if (!ssValue.empty())
+            {
+                char fTmp;
+                char fUnused;
+                ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+                loaded.strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                                          wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, loaded.hash.ToString());
+                wtx.fTimeReceivedIsTxTime = fTmp;
+            }
+            else
+            {
+                loaded.strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, loaded.hash.ToString());
+                wtx.fTimeReceivedIsTxTime = 0;
+            }
+            loaded.fUpgraded = true;
+        }
+        loaded.fValid = true;
+    } catch (...) {
+        loaded.fValid = false;
+    }
+    loaded.ssValue.clear();
+}
+
+/** Add a decoded transaction record to the wallet, in the order of the records */
+static void LoadWalletTx(CWallet* pwallet, CWalletScanState& wss, CLoadedWalletTx& loaded)
+{
+    if (loaded.fUpgraded)
+        wss.vWalletUpgrade.push_back(loaded.hash);
+
+    if (loaded.wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(loaded.wtx);
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr)
@@ -263,38 +342,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(*wtx.tx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            CLoadedWalletTx loaded;
+            ssKey >> loaded.hash;
+            loaded.ssValue = std::move(ssValue);
+            DecodeWalletTx(loaded);
+            strErr = loaded.strErr;
+            if (!loaded.fValid)
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            LoadWalletTx(pwallet, wss, loaded);
         }
         else if (strType == "acentry")
         {
@@ -542,6 +597,40 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // Transaction records are decoded in chunks on other threads while the
+        // cursor moves on, and added to the wallet in the order they were read.
+        const size_t nMaxChunksInFlight = std::max(GetNumCores(), 1);
+        std::deque<std::future<std::vector<CLoadedWalletTx>>> vChunksInFlight;
+        std::vector<CLoadedWalletTx> vChunk;
+        unsigned int nTxRecords = 0;
+        auto loadChunk = [&](std::vector<CLoadedWalletTx> chunk) {
+            for (CLoadedWalletTx& loaded : chunk) {
+                if (!loaded.strErr.empty())
+                    LogPrintf("%s\n", loaded.strErr);
+                if (!loaded.fValid) {
+                    // Rescan if there is a bad transaction record:
+                    fNoncriticalErrors = true;
+                    gArgs.SoftSetBoolArg("-rescan", true);
+                    continue;
+                }
+                LoadWalletTx(pwallet, wss, loaded);
+            }
+        };
+        auto dispatchChunk = [&]() {
+            if (vChunk.empty())
+                return;
+            if (vChunksInFlight.size() >= nMaxChunksInFlight) {
+                loadChunk(vChunksInFlight.front().get());
+                vChunksInFlight.pop_front();
+            }
+            vChunksInFlight.push_back(std::async(std::launch::async, [](std::vector<CLoadedWalletTx> chunk) {
+                for (CLoadedWalletTx& loaded : chunk)
+                    DecodeWalletTx(loaded);
+                return chunk;
+            }, std::move(vChunk)));
+            vChunk.clear();
+        };
+
         while (true)
         {
             // Read next record
@@ -556,8 +645,22 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            CDataStream ssKeyType(ssKey);
+            std::string strType;
+            ssKeyType >> strType;
+            if (strType == "tx") {
+                vChunk.emplace_back();
+                ssKeyType >> vChunk.back().hash;
+                vChunk.back().ssValue = std::move(ssValue);
+                if (vChunk.size() >= LOAD_TX_CHUNK_SIZE)
+                    dispatchChunk();
+                if (++nTxRecords % (LOAD_TX_CHUNK_SIZE * 100) == 0)
+                    uiInterface.InitMessage(strprintf(_("Loading wallet... (%u transactions)"), nTxRecords));
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
+            std::string strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
             {
                 // losing keys is considered a catastrophic error, anything else
@@ -577,6 +680,12 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        dispatchChunk();
+        while (!vChunksInFlight.empty()) {
+            loadChunk(vChunksInFlight.front().get());
+            vChunksInFlight.pop_front();
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -847,6 +956,39 @@ bool CWalletDB::TxnAbort()
     return batch.TxnAbort();
 }
 
+bool CWalletDB::BeginBatchSession()
+{
+    if (fBatchSession || !batch.TxnBegin())
+        return false;
+    fBatchSession = true;
+    nBatchSessionWrites = 0;
+    return true;
+}
+
+bool CWalletDB::CommitBatchSession()
+{
+    if (!fBatchSession)
+        return false;
+    fBatchSession = false;
+    return batch.TxnCommit();
+}
+
+bool CWalletDB::BatchSessionWritten()
+{
+    // A transaction holds the locks of every page it touched until it ends,
+    // so a long session moves on to a new one before the lock table is full.
+    if (!fBatchSession || ++nBatchSessionWrites < BATCH_SESSION_MAX_WRITES)
+        return true;
+    nBatchSessionWrites = 0;
+    if (!batch.TxnCommit()) {
+        fBatchSession = false;
+        return false;
+    }
+    if (!batch.TxnBegin())
+        fBatchSession = false;
+    return true;
+}
+
 bool CWalletDB::ReadVersion(int& nVersion)
 {
     return batch.ReadVersion(nVersion);
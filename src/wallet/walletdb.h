@@ -33,6 +33,10 @@
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
+//! Writes after which a batch session commits and carries on in a new database transaction
+static const unsigned int BATCH_SESSION_MAX_WRITES = 1000;
+//! Transaction records one thread decodes at a time while the wallet loads
+static const size_t LOAD_TX_CHUNK_SIZE = 1000;
 
 class CAccount;
 class CAccountingEntry;
@@ -148,7 +152,7 @@ private:
             return false;
         }
         m_dbw.IncrementUpdateCounter();
-        return true;
+        return BatchSessionWritten();
     }
 
     template <typename K>
@@ -158,9 +162,11 @@ private:
             return false;
         }
         m_dbw.IncrementUpdateCounter();
-        return true;
+        return BatchSessionWritten();
     }
 
+    bool BatchSessionWritten();
+
 public:
     explicit CWalletDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool _fFlushOnClose = true) :
         batch(dbw, pszMode, _fFlushOnClose),
@@ -177,6 +183,7 @@ public:
     bool ErasePurpose(const std::string& strAddress);
 
     bool WriteTx(const CWalletTx& wtx);
+    bool ReadTx(const uint256& hash, CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata &keyMeta);
@@ -239,6 +246,11 @@ public:
     bool TxnCommit();
     //! Abort current transaction
     bool TxnAbort();
+    //! Begin a transaction for the many writes of a bulk operation, see CWalletBatchSession
+    bool BeginBatchSession();
+    //! Commit the writes since BeginBatchSession
+    bool CommitBatchSession();
+    bool InBatchSession() const { return fBatchSession; }
     //! Read wallet version
     bool ReadVersion(int& nVersion);
     //! Write wallet version
@@ -246,6 +258,8 @@ public:
 private:
     CDB batch;
     CWalletDBWrapper& m_dbw;
+    bool fBatchSession = false;
+    unsigned int nBatchSessionWrites = 0;
 };
 
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
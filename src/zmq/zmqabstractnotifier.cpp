@@ -24,4 +24,33 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransactionRef &/*transaction*/)
 {
     return true;
-}
\ No newline at end of file
+}
+bool CZMQAbstractNotifier::NotifyBlockConnect(const uint256 &/*hash*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBlockDisconnect(const uint256 &/*hash*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionAcceptance(const CTransaction &/*transaction*/, uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionRemoval(const CTransaction &/*transaction*/, uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeChanged(const COutPoint &/*outpoint*/, const std::shared_ptr<const masternode_info_t> &/*pinfo*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodePaymentWinner(int /*nBlockHeight*/, const CScript &/*payee*/)
+{
+    return true;
+}
@@ -7,15 +7,25 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <atomic>
+#include <memory>
+
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class CScript;
+class COutPoint;
+class uint256;
+struct masternode_info_t;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** Default for -zmqpub<type>hwm, the messages queued for a subscriber before new ones are dropped */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(nullptr) { }
+    CZMQAbstractNotifier() : psocket(nullptr), nSendHighWaterMark(DEFAULT_ZMQ_SNDHWM), nDroppedMessages(0) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,6 +38,10 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetSendHighWaterMark() const { return nSendHighWaterMark; }
+    void SetSendHighWaterMark(int n) { if (n >= 0) nSendHighWaterMark = n; }
+    /** Messages not sent because a subscriber had nSendHighWaterMark queued */
+    uint64_t GetDroppedMessages() const { return nDroppedMessages; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
@@ -35,11 +49,20 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
     virtual bool NotifyTransactionLock(const CTransactionRef &transaction);
+    // Notifications for the sequence topic, about the mempool and the blocks connected and disconnected
+    virtual bool NotifyBlockConnect(const uint256 &hash);
+    virtual bool NotifyBlockDisconnect(const uint256 &hash);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence);
+    virtual bool NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo);
+    virtual bool NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int nSendHighWaterMark;
+    std::atomic<uint64_t> nDroppedMessages;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -10,6 +10,8 @@
 #include <streams.h>
 #include <util.h>
 
+CZMQNotificationInterface* g_zmq_notification_interface = nullptr;
+
 void zmqError(const char *str)
 {
     LogPrint(BCLog::ZMQ, "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
@@ -35,12 +37,16 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     std::map<std::string, CZMQNotifierFactory> factories;
     std::list<CZMQAbstractNotifier*> notifiers;
 
+    factories["pubblocktemplate"] = CZMQAbstractNotifier::Create<CZMQPublishBlockTemplateNotifier>;
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubhashtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionLockNotifier>;
+    factories["pubmasternode"] = CZMQAbstractNotifier::Create<CZMQPublishMasternodeNotifier>;
+    factories["pubmasternodewinner"] = CZMQAbstractNotifier::Create<CZMQPublishMasternodeWinnerNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -52,6 +58,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(entry.first);
             notifier->SetAddress(address);
+            notifier->SetSendHighWaterMark(static_cast<int>(gArgs.GetArg(arg + "hwm", DEFAULT_ZMQ_SNDHWM)));
             notifiers.push_back(notifier);
         }
     }
@@ -71,6 +78,31 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     return notificationInterface;
 }
 
+std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetActiveNotifiers()
+{
+    LOCK(cs_notifiers);
+    return std::list<const CZMQAbstractNotifier*>(notifiers.begin(), notifiers.end());
+}
+
+template <typename Function>
+void CZMQNotificationInterface::TryForEachAndRemoveFailed(Function func)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (func(notifier))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            LOCK(cs_notifiers);
+            i = notifiers.erase(i);
+        }
+    }
+}
+
 // Called at startup to conditionally set up ZMQ socket(s)
 bool CZMQNotificationInterface::Initialize()
 {
@@ -131,19 +163,9 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, co
     if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
         return;
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    TryForEachAndRemoveFailed([pindexNew](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlock(pindexNew);
+    });
 }
 
 void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
@@ -152,19 +174,9 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
     // all the same external callback.
     const CTransaction& tx = *ptx;
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    TryForEachAndRemoveFailed([&tx](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransaction(tx);
+    });
 }
 
 void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted)
@@ -173,6 +185,12 @@ void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBloc
         // Do a normal notify for each transaction added in the block
         TransactionAddedToMempool(ptx);
     }
+
+    // Then the block itself, for the sequence topic
+    const uint256& hash = pindexConnected->GetBlockHash();
+    TryForEachAndRemoveFailed([&hash](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockConnect(hash);
+    });
 }
 
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock)
@@ -181,21 +199,49 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
         // Do a normal notify for each transaction removed in block disconnection
         TransactionAddedToMempool(ptx);
     }
+
+    // Then the block itself, for the sequence topic
+    const uint256 hash = pblock->GetHash();
+    TryForEachAndRemoveFailed([&hash](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockDisconnect(hash);
+    });
+}
+
+void CZMQNotificationInterface::MempoolTransactionAdded(const CTransactionRef& ptx, uint64_t nMempoolSequence)
+{
+    const CTransaction& tx = *ptx;
+
+    TryForEachAndRemoveFailed([&tx, nMempoolSequence](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionAcceptance(tx, nMempoolSequence);
+    });
+}
+
+void CZMQNotificationInterface::MempoolTransactionRemoved(const CTransactionRef& ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence)
+{
+    const CTransaction& tx = *ptx;
+
+    TryForEachAndRemoveFailed([&tx, nMempoolSequence](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionRemoval(tx, nMempoolSequence);
+    });
 }
 
 void CZMQNotificationInterface::NotifyTransactionLock(const CTransactionRef &ptx)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(ptx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    TryForEachAndRemoveFailed([&ptx](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionLock(ptx);
+    });
+}
+
+void CZMQNotificationInterface::NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo)
+{
+    TryForEachAndRemoveFailed([&outpoint, &pinfo](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyMasternodeChanged(outpoint, pinfo);
+    });
+}
+
+void CZMQNotificationInterface::NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee)
+{
+    TryForEachAndRemoveFailed([nBlockHeight, &payee](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyMasternodePaymentWinner(nBlockHeight, payee);
+    });
 }
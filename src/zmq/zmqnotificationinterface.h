@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include <sync.h>
 #include <validationinterface.h>
 #include <string>
 #include <map>
@@ -20,6 +21,9 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    /** The notifiers that did not fail so far */
+    std::list<const CZMQAbstractNotifier*> GetActiveNotifiers();
+
 protected:
     bool Initialize();
     void Shutdown();
@@ -28,14 +32,26 @@ protected:
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
+    void MempoolTransactionAdded(const CTransactionRef& ptx, uint64_t nMempoolSequence) override;
+    void MempoolTransactionRemoved(const CTransactionRef& ptx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
     void NotifyTransactionLock(const CTransactionRef &ptx) override;
+    void NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo) override;
+    void NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee) override;
 
 private:
     CZMQNotificationInterface();
 
+    /** Call func for every notifier, shut down and drop the ones it returns false for */
+    template <typename Function>
+    void TryForEachAndRemoveFailed(Function func);
+
     void *pcontext;
+    //! Only changed on the validation interface thread, which reads it without cs_notifiers
     std::list<CZMQAbstractNotifier*> notifiers;
+    CCriticalSection cs_notifiers;
 };
 
+extern CZMQNotificationInterface* g_zmq_notification_interface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -2,8 +2,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockview.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <crypto/common.h>
+#include <globaltoken/hardfork.h>
+#include <globaltoken/powalgorithm.h>
+#include <masternode.h>
+#include <miner.h>
+#include <pow.h>
+#include <script/script.h>
+#include <script/standard.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
@@ -12,54 +21,26 @@
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
+static const char *MSG_BLOCKTEMPLATE = "blocktemplate";
 static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_HASHTXLOCK = "hashtxlock";
+static const char *MSG_MASTERNODE = "masternode";
+static const char *MSG_MASTERNODEWINNER = "masternodewinner";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_RAWTXLOCK  = "rawtxlock";
+static const char *MSG_SEQUENCE  = "sequence";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Free the block a rawblock message was sent from, once zmq is done with it
+static void FreeRawBlockView(void * /*data*/, void *hint)
 {
-    va_list args;
-    va_start(args, size);
-
-    while (1)
-    {
-        zmq_msg_t msg;
-
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
-        {
-            zmqError("Unable to initialize ZMQ msg");
-            va_end(args);
-            return -1;
-        }
-
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
-
-        data = va_arg(args, const void*);
-
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
-        {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            va_end(args);
-            return -1;
-        }
-
-        zmq_msg_close(&msg);
-
-        if (!data)
-            break;
+    delete static_cast<CRawBlockView*>(hint);
+}
 
-        size = va_arg(args, size_t);
-    }
-    va_end(args);
-    return 0;
+static void FreeDataStream(void * /*data*/, void *hint)
+{
+    delete static_cast<CDataStream*>(hint);
 }
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
@@ -71,14 +52,41 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 
     if (i==mapPublishNotifiers.end())
     {
+#ifdef ZMQ_XPUB_NODROP
+        // An XPUB socket refuses messages for a subscriber at the high water
+        // mark rather than drop them silently, so the drops can be counted
+        psocket = zmq_socket(pcontext, ZMQ_XPUB);
+#else
         psocket = zmq_socket(pcontext, ZMQ_PUB);
+#endif
         if (!psocket)
         {
             zmqError("Failed to create socket");
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint(BCLog::ZMQ, "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, nSendHighWaterMark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &nSendHighWaterMark, sizeof(nSendHighWaterMark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+#ifdef ZMQ_XPUB_NODROP
+        int nodrop = 1;
+        rc = zmq_setsockopt(psocket, ZMQ_XPUB_NODROP, &nodrop, sizeof(nodrop));
+        if (rc != 0)
+        {
+            zmqError("Failed to set XPUB no drop");
+            zmq_close(psocket);
+            return false;
+        }
+#endif
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -132,15 +140,71 @@ void CZMQAbstractPublishNotifier::Shutdown()
 }
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    zmq_msg_t msg;
+    if (zmq_msg_init_size(&msg, size) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        return false;
+    }
+    memcpy(zmq_msg_data(&msg), data, size);
+    return SendMessageParts(command, msg);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, void* data, size_t size, zmq_free_fn *ffn, void *hint)
+{
+    zmq_msg_t msg;
+    if (zmq_msg_init_data(&msg, data, size, ffn, hint) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        ffn(data, hint);
+        return false;
+    }
+    return SendMessageParts(command, msg);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessageParts(const char *command, zmq_msg_t& msgData)
 {
     assert(psocket);
 
+#ifdef ZMQ_XPUB_NODROP
+    // The XPUB socket queues subscriptions to be read, they are of no use here
+    char buf[256];
+    while (zmq_recv(psocket, buf, sizeof(buf), ZMQ_DONTWAIT) >= 0) {}
+#endif
+
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
     WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
-    if (rc == -1)
+
+    // Only the first part is refused for a subscriber at the high water mark, the others follow it
+    if (zmq_send(psocket, command, strlen(command), ZMQ_SNDMORE | ZMQ_DONTWAIT) == -1)
+    {
+        zmq_msg_close(&msgData);
+        if (errno == EAGAIN)
+        {
+            // Skip the sequence number, so subscribers see the gap
+            nSequence++;
+            nDroppedMessages++;
+            LogPrint(BCLog::ZMQ, "zmq: Dropped %s at %s, a subscriber is at the high water mark\n", command, address);
+            return true;
+        }
+        zmqError("Unable to send ZMQ msg");
+        return false;
+    }
+
+    if (zmq_msg_send(&msgData, psocket, ZMQ_SNDMORE) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msgData);
         return false;
+    }
+
+    if (zmq_send(psocket, msgseq, sizeof(msgseq), 0) == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        return false;
+    }
 
     /* increment memory only sequence number after sending */
     nSequence++;
@@ -158,6 +222,55 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
+bool CZMQPublishBlockTemplateNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() != pindex) {
+            // A newer tip is already connected and will be notified as well
+            return true;
+        }
+
+        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        try {
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE, ALGO_SHA256D);
+        } catch (const std::exception& e) {
+            LogPrint(BCLog::ZMQ, "zmq: Unable to create block template: %s\n", e.what());
+        }
+        if (!pblocktemplate) {
+            // Not a socket error, keep the notifier
+            return true;
+        }
+        const CBlock& block = pblocktemplate->block;
+        LogPrint(BCLog::ZMQ, "zmq: Publish blocktemplate %s\n", block.hashPrevBlock.GetHex());
+
+        ss << block.hashPrevBlock;
+        ss << (int32_t)(pindex->nHeight + 1);
+        ss << block.nTime;
+        ss << block.vtx[0]->GetValueOut();
+        ss << pblocktemplate->vCoinbaseMerkleBranch;
+
+        // The transactions are the same for every algo, only version and target differ
+        std::vector<uint8_t> vAlgos;
+        for (uint8_t nAlgo = 0; nAlgo < NUM_ALGOS_IMPL; nAlgo++) {
+            if (consensusParams.Hardfork2.IsActivated(block.nTime) || IsAlgoAllowedBeforeHF2(nAlgo))
+                vAlgos.push_back(nAlgo);
+        }
+        WriteCompactSize(ss, vAlgos.size());
+        for (uint8_t nAlgo : vAlgos) {
+            CBlockHeader header = block.GetBlockHeader();
+            header.SetAlgo(nAlgo);
+            ss << nAlgo;
+            ss << header.nVersion;
+            ss << GetNextWorkRequired(pindex, &header, consensusParams, nAlgo);
+        }
+    }
+
+    return SendMessage(MSG_BLOCKTEMPLATE, &(*ss.begin()), ss.size());
+}
+
 bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
@@ -183,8 +296,22 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // The stored block is the serialization published unless flags strip the
+    // witness. It is sent from the mapped block file, or the buffer it was
+    // read into, without another copy; zmq frees it once it was sent.
+    if (RPCSerializationFlags() == 0) {
+        std::unique_ptr<CRawBlockView> pview(new CRawBlockView());
+        if (!pview->Read(pindex, Params().MessageStart())) {
+            zmqError("Can't read block from disk");
+            return false;
+        }
+        void *data = const_cast<unsigned char*>(pview->begin());
+        size_t size = pview->size();
+        return SendMessage(MSG_RAWBLOCK, data, size, FreeRawBlockView, pview.release());
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    std::unique_ptr<CDataStream> pss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags()));
     {
         LOCK(cs_main);
         CBlock block;
@@ -194,10 +321,12 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
             return false;
         }
 
-        ss << block;
+        *pss << block;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    void *data = &(*pss->begin());
+    size_t size = pss->size();
+    return SendMessage(MSG_RAWBLOCK, data, size, FreeDataStream, pss.release());
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
@@ -218,3 +347,66 @@ bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransac
     ss << tx;
     return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
 }
+
+// A sequence message: the hash, the label and for mempool changes their mempool sequence number
+static bool SendSequenceMsg(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, const uint64_t* pnMempoolSequence = nullptr)
+{
+    unsigned char data[sizeof(uint256) + sizeof(label) + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(uint256); ++i)
+        data[sizeof(uint256) - 1 - i] = hash.begin()[i];
+    data[sizeof(uint256)] = label;
+    if (pnMempoolSequence)
+        WriteLE64(data + sizeof(uint256) + sizeof(label), *pnMempoolSequence);
+    return notifier.SendMessage(MSG_SEQUENCE, data, pnMempoolSequence ? sizeof(data) : sizeof(uint256) + sizeof(label));
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (C)onnect */ 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (D)isconnect */ 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool acceptance %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Mempool (A)cceptance */ 'A', &nMempoolSequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool removal %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Mempool (R)emoval */ 'R', &nMempoolSequence);
+}
+
+bool CZMQPublishMasternodeNotifier::NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish masternode %s\n", outpoint.ToStringShort());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << outpoint;
+    if (pinfo) {
+        ss << CMasternode::StateToString(pinfo->nActiveState);
+        ss << pinfo->addr;
+        ss << (int32_t)pinfo->nProtocolVersion;
+        ss << GetScriptForDestination(pinfo->pubKeyCollateralAddress.GetID());
+    } else {
+        ss << std::string("REMOVED");
+    }
+    return SendMessage(MSG_MASTERNODE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishMasternodeWinnerNotifier::NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish masternodewinner %d\n", nBlockHeight);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << (int32_t)nBlockHeight;
+    ss << payee;
+    return SendMessage(MSG_MASTERNODEWINNER, &(*ss.begin()), ss.size());
+}
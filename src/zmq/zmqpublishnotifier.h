@@ -14,6 +14,8 @@ class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 private:
     uint32_t nSequence; //!< upcounting per message sequence number
 
+    bool SendMessageParts(const char *command, zmq_msg_t& msgData);
+
 public:
 
     /* send zmq multipart message
@@ -23,6 +25,9 @@ public:
           * message sequence number
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    /* send zmq multipart message without copying data, ffn(data, hint) is
+       called from a zmq thread once it was sent, or before returning false */
+    bool SendMessage(const char *command, void* data, size_t size, zmq_free_fn *ffn, void *hint);
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -34,6 +39,12 @@ public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
 };
 
+class CZMQPublishBlockTemplateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlock(const CBlockIndex *pindex) override;
+};
+
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
@@ -64,4 +75,25 @@ public:
     bool NotifyTransactionLock(const CTransactionRef &ptransaction) override;
 };
 
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const uint256 &hash) override;
+    bool NotifyBlockDisconnect(const uint256 &hash) override;
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t nMempoolSequence) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t nMempoolSequence) override;
+};
+
+class CZMQPublishMasternodeNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeChanged(const COutPoint &outpoint, const std::shared_ptr<const masternode_info_t> &pinfo) override;
+};
+
+class CZMQPublishMasternodeWinnerNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodePaymentWinner(int nBlockHeight, const CScript &payee) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -4,7 +4,7 @@
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 # Test the merge-mining RPC interface:
-# getauxblock, createauxblock, submitauxblock
+# getauxblock, createauxblock, submitauxblock, submitauxblocks
 
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import *
@@ -33,6 +33,7 @@ class AuxpowMiningTest (BitcoinTestFramework):
     # Test with getauxblock and createauxblock/submitauxblock.
     self.test_getauxblock ()
     self.test_create_submit_auxblock ()
+    self.test_submit_auxblocks ()
 
   def test_common (self, create, submit):
     """
@@ -179,5 +180,38 @@ class AuxpowMiningTest (BitcoinTestFramework):
     assert_equal (addr1, coinbaseAddr)
     assert_equal (addr2, coinbaseAddr)
 
+  def test_submit_auxblocks (self):
+    """
+    Test submitting several auxpows at once with submitauxblocks.
+    """
+
+    coinbaseAddr = self.nodes[0].getnewaddress ()
+    auxblock = self.nodes[0].createauxblock (coinbaseAddr)
+    target = auxpow.reverseHex (auxblock['_target'])
+
+    # Unknown hashes and invalid auxpows are reported per entry.
+    bad = auxpow.computeAuxpow (auxblock['hash'], target, False)
+    res = self.nodes[0].submitauxblocks ([
+      {"hash": "00" * 32, "auxpow": bad},
+      {"hash": auxblock['hash'], "auxpow": bad},
+    ])
+    assert_equal (len (res), 2)
+    assert_equal (res[0]['hash'], "00" * 32)
+    assert not res[0]['accepted']
+    assert_equal (res[0]['reason'], "block hash unknown")
+    assert_equal (res[1]['hash'], auxblock['hash'])
+    assert not res[1]['accepted']
+    assert_equal (res[1]['reason'], "high-hash")
+
+    # The valid entry of a batch is accepted.
+    good = auxpow.computeAuxpow (auxblock['hash'], target, True)
+    res = self.nodes[0].submitauxblocks ([
+      {"hash": auxblock['hash'], "auxpow": bad},
+      {"hash": auxblock['hash'], "auxpow": good},
+    ])
+    assert not res[0]['accepted']
+    assert res[1]['accepted']
+    assert_equal (self.nodes[0].getbestblockhash (), auxblock['hash'])
+
 if __name__ == '__main__':
   AuxpowMiningTest ().main ()
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the address, spent and timestamp indexes.
+
+Pay to an address and spend the payment, then check getaddressbalance,
+getaddresstxids, getaddressutxos, getspentinfo and getblockhashes of a node
+with -addressindex -spentindex -timestampindex, and that the indexes follow
+reorgs and survive a restart.
+"""
+from decimal import Decimal
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 assert_raises_rpc_error,
+                                 connect_nodes_bi,
+                                 wait_until,
+                                )
+
+INDEX_ARGS = ["-addressindex", "-spentindex", "-timestampindex"]
+
+class AddressIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], INDEX_ARGS]
+
+    def wait_for_index(self, node):
+        """Wait until the indexes of node caught up with its chain"""
+        def synced():
+            try:
+                node.getblockhashes(1, 0)
+                return True
+            except JSONRPCException:
+                return False
+        wait_until(synced, timeout=60)
+        node.syncwithvalidationinterfacequeue()
+
+    def run_test(self):
+        node, index_node = self.nodes
+
+        node.generate(101)
+        self.sync_all()
+        self.wait_for_index(index_node)
+
+        self.log.info("A payment shows up in the address index")
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, Decimal("10"))
+        node.generate(1)
+        self.sync_all()
+        index_node.syncwithvalidationinterfacequeue()
+        query = {"addresses": [address]}
+        assert_equal(index_node.getaddressbalance(query), {"balance": 1000000000, "received": 1000000000})
+        assert_equal(index_node.getaddresstxids(query), [txid])
+        utxos = index_node.getaddressutxos(query)
+        assert_equal(len(utxos), 1)
+        assert_equal(utxos[0]["txid"], txid)
+        assert_equal(utxos[0]["satoshis"], 1000000000)
+        assert_equal(utxos[0]["height"], 102)
+        vout = utxos[0]["outputIndex"]
+
+        self.log.info("Spending it shows up in the address and spent indexes")
+        other = node.getnewaddress()
+        spend = node.createrawtransaction([{"txid": txid, "vout": vout}], {other: Decimal("9.99")})
+        spend_txid = node.sendrawtransaction(node.signrawtransaction(spend)["hex"])
+        node.generate(1)
+        self.sync_all()
+        index_node.syncwithvalidationinterfacequeue()
+        assert_equal(index_node.getaddressbalance(query), {"balance": 0, "received": 1000000000})
+        assert_equal(index_node.getaddresstxids(query), [txid, spend_txid])
+        assert_equal(index_node.getaddresstxids({"addresses": [address], "start": 103}), [spend_txid])
+        assert_equal(index_node.getaddressutxos(query), [])
+        assert_equal(index_node.getaddressbalance({"addresses": [address, other]})["balance"], 999000000)
+        spent = {"txid": spend_txid, "index": 0, "height": 103}
+        assert_equal(index_node.getspentinfo({"txid": txid, "index": vout}), spent)
+
+        self.log.info("Blocks can be found by timestamp")
+        tip = index_node.getblock(index_node.getbestblockhash())
+        assert tip["hash"] in index_node.getblockhashes(tip["time"] + 1, tip["time"])
+        assert tip["hash"] not in index_node.getblockhashes(tip["time"], tip["time"] - 1)
+
+        self.log.info("Disconnected blocks are removed")
+        index_node.invalidateblock(tip["hash"])
+        index_node.syncwithvalidationinterfacequeue()
+        assert_equal(index_node.getaddressbalance(query), {"balance": 1000000000, "received": 1000000000})
+        assert_equal(len(index_node.getaddressutxos(query)), 1)
+        assert_raises_rpc_error(-5, "Unable to get spent info", index_node.getspentinfo, {"txid": txid, "index": vout})
+        assert tip["hash"] not in index_node.getblockhashes(tip["time"] + 1, tip["time"])
+        index_node.reconsiderblock(tip["hash"])
+        index_node.syncwithvalidationinterfacequeue()
+        assert_equal(index_node.getspentinfo({"txid": txid, "index": vout}), spent)
+
+        self.log.info("The indexes survive a restart")
+        self.restart_node(1, INDEX_ARGS)
+        index_node = self.nodes[1]
+        self.wait_for_index(index_node)
+        assert_equal(index_node.getaddresstxids(query), [txid, spend_txid])
+        connect_nodes_bi(self.nodes, 0, 1)
+        node.generate(1)
+        self.sync_all()
+        index_node.syncwithvalidationinterfacequeue()
+        assert_equal(index_node.getspentinfo({"txid": txid, "index": vout}), spent)
+
+        self.log.info("Nodes without the indexes refuse the calls")
+        assert_raises_rpc_error(-1, "needs -addressindex", node.getaddressbalance, query)
+        assert_raises_rpc_error(-1, "needs -spentindex", node.getspentinfo, {"txid": txid, "index": vout})
+        assert_raises_rpc_error(-1, "needs -timestampindex", node.getblockhashes, 1, 0)
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
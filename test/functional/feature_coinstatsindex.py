@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the coin stats index.
+
+Compare gettxoutsetinfo of a node with -coinstatsindex against a node that
+walks its chainstate, query past blocks, and check the index follows
+reorgs and survives a restart.
+"""
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 assert_raises_rpc_error,
+                                 connect_nodes_bi,
+                                )
+
+class CoinStatsIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-coinstatsindex"]]
+
+    def assert_same_stats(self, walked, indexed):
+        for key in ("height", "bestblock", "txouts", "bogosize", "total_amount"):
+            assert_equal(walked[key], indexed[key])
+
+    def run_test(self):
+        node, index_node = self.nodes
+
+        self.log.info("The index matches walking the chainstate")
+        node.generate(101)
+        address = node.getnewaddress()
+        node.sendtoaddress(address, Decimal("10"))
+        node.sendtoaddress(address, Decimal("20"))
+        node.generate(1)
+        self.sync_all()
+        stats = index_node.gettxoutsetinfo()
+        self.assert_same_stats(node.gettxoutsetinfo(), stats)
+        assert "muhash" in stats
+        assert "hash_serialized_2" not in stats
+
+        self.log.info("Past blocks can be queried by height or hash")
+        genesis = index_node.gettxoutsetinfo(0)
+        assert_equal(genesis["txouts"], 0)
+        assert_equal(genesis["total_amount"], 0)
+        assert "disk_size" not in genesis
+        at_100 = index_node.gettxoutsetinfo(100)
+        assert_equal(index_node.gettxoutsetinfo(index_node.getblockhash(100)), at_100)
+        assert_equal(index_node.gettxoutsetinfo(str(stats["height"]))["muhash"], stats["muhash"])
+        assert_raises_rpc_error(-8, "Block height out of range", index_node.gettxoutsetinfo, 1000)
+        assert_raises_rpc_error(-8, "need -coinstatsindex", node.gettxoutsetinfo, 100)
+
+        self.log.info("Disconnected blocks are reverted")
+        tip = index_node.getbestblockhash()
+        previous = index_node.gettxoutsetinfo(stats["height"] - 1)
+        index_node.invalidateblock(tip)
+        reverted = index_node.gettxoutsetinfo()
+        assert_equal(reverted["muhash"], previous["muhash"])
+        assert_equal(reverted["txouts"], previous["txouts"])
+        index_node.reconsiderblock(tip)
+        assert_equal(index_node.gettxoutsetinfo()["muhash"], stats["muhash"])
+
+        self.log.info("The index survives a restart")
+        self.restart_node(1, ["-coinstatsindex"])
+        assert_equal(self.nodes[1].gettxoutsetinfo()["muhash"], stats["muhash"])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[1].generate(1)
+        self.sync_all()
+        self.assert_same_stats(node.gettxoutsetinfo(), self.nodes[1].gettxoutsetinfo())
+
+        self.log.info("Changing -coinstatsindex needs a reindex")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, [], "You need to rebuild the database using -reindex to change -coinstatsindex")
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
@@ -16,6 +16,12 @@ class ConfArgsTest(BitcoinTestFramework):
 
     def run_test(self):
         self.stop_node(0)
+
+        # Check that an unsupported -socketevents mode fails, select() is always supported
+        self.assert_start_raises_init_error(0, ['-socketevents=invalid'], "Invalid -socketevents mode 'invalid'")
+        self.start_node(0, ['-socketevents=select'])
+        self.stop_node(0)
+
         # Remove the -datadir argument so it doesn't override the config file
         self.nodes[0].args = [arg for arg in self.nodes[0].args if not arg.startswith("-datadir")]
 
@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -headersonly.
+
+A headers-only node follows the best header chain of its peers, but never
+downloads blocks, relays transactions or advertises blocks it could serve.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+NODE_NETWORK = 1
+NODE_NETWORK_LIMITED = 1 << 10
+
+class HeadersOnlyTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-headersonly"]]
+
+    def run_test(self):
+        node, headers_node = self.nodes
+
+        self.log.info("Only headers are synced")
+        node.generate(10)
+        tip = node.getbestblockhash()
+        wait_until(lambda: headers_node.getblockchaininfo()["headers"] == 10, timeout=30)
+        info = headers_node.getblockchaininfo()
+        assert_equal(info["blocks"], 0)
+        assert_equal(info["headersonly"], True)
+        assert_equal(headers_node.getblockheader(tip)["height"], 10)
+        assert_equal(headers_node.getpeerinfo()[0]["inflight"], [])
+
+        self.log.info("No blocks are advertised and no transactions relayed")
+        services = int(headers_node.getnetworkinfo()["localservices"], 16)
+        assert_equal(services & (NODE_NETWORK | NODE_NETWORK_LIMITED), 0)
+        assert_equal(headers_node.getnetworkinfo()["localrelay"], False)
+
+        self.log.info("Incompatible options are refused")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, ["-headersonly", "-txindex=1"], "Headers-only mode is incompatible with -txindex")
+        self.assert_start_raises_init_error(1, ["-headersonly", "-masternode=1"], "Headers-only mode is incompatible with -masternode")
+
+if __name__ == '__main__':
+    HeadersOnlyTest().main()
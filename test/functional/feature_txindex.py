@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test building the transaction index in the background.
+
+Mine a chain with -txindex=0, restart with -txindex=1 and no -reindex, and
+check that the index catches up, that getrawtransaction finds the
+transactions of old and new blocks, and that it survives a restart.
+"""
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+class TxIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-txindex=0"]]
+
+    def wait_for_txindex(self, node):
+        wait_until(lambda: node.getblockchaininfo()["txindex"]["synced"], timeout=60)
+        assert_equal(node.getblockchaininfo()["txindex"]["bestblockheight"], node.getblockcount())
+
+    def check_block_txs(self, node, height):
+        block = node.getblock(node.getblockhash(height))
+        for txid in block["tx"]:
+            assert_equal(node.getrawtransaction(txid, True)["blockhash"], block["hash"])
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+        txid = node.sendtoaddress(node.getnewaddress(), Decimal("10"))
+        node.generate(1)
+        assert "txindex" not in node.getblockchaininfo()
+
+        self.log.info("Enable the transaction index without a reindex")
+        self.restart_node(0, ["-txindex=1"])
+        self.wait_for_txindex(node)
+        for height in (0, 1, 50, node.getblockcount()):
+            self.check_block_txs(node, height)
+        assert_equal(node.getrawtransaction(txid, True)["txid"], txid)
+
+        self.log.info("Blocks connected once the index is synced are indexed with them")
+        txid = node.sendtoaddress(node.getnewaddress(), Decimal("10"))
+        node.generate(1)
+        assert_equal(node.getrawtransaction(txid, True)["blockhash"], node.getbestblockhash())
+        assert_equal(node.getblockchaininfo()["txindex"]["bestblockheight"], node.getblockcount())
+
+        self.log.info("The index continues after a restart")
+        self.restart_node(0, ["-txindex=1"])
+        node.generate(5)
+        self.wait_for_txindex(node)
+        for height in range(node.getblockcount() - 6, node.getblockcount() + 1):
+            self.check_block_txs(node, height)
+
+if __name__ == '__main__':
+    TxIndexTest().main()
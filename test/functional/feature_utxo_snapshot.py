@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumptxoutset and loadtxoutset.
+
+A node syncing headers only loads the chainstate snapshot of another node,
+continues the chain from its base and validates the blocks below it in the
+background. Snapshots of another block or with another MuHash than the caller
+expects are refused. A snapshot whose blocks do not lead to its coins shuts
+the node down once the background validation reaches its base.
+"""
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 assert_raises_rpc_error,
+                                 connect_nodes_bi,
+                                 wait_until,
+                                )
+
+# Offsets in a snapshot file: the message start, version, base block, height,
+# chain work and chain tx count come first, then the coin count, total amount,
+# bogo size and MuHash, then the compact size prefixed states of the algos.
+HEADER_COINS_START = 84
+HEADER_COINS_END = 140
+ALGO_STATE_SIZE = 41
+
+def header_size(data):
+    count = data[HEADER_COINS_END]
+    assert count < 253
+    return HEADER_COINS_END + 1 + count * ALGO_STATE_SIZE
+
+class UTXOSnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-headersonly"], ["-headersonly"]]
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 0, 2)
+
+    def log_contains(self, node, text):
+        log = os.path.join(node.datadir, "regtest", "debug.log")
+        return text in open(log, encoding="utf-8").read()
+
+    def run_test(self):
+        node, snapshot_node, forged_node = self.nodes
+
+        self.log.info("Dump the chainstate at two heights")
+        node.generate(100)
+        previous = node.dumptxoutset("previous.dat")
+        node.generate(1)
+        snapshot = node.dumptxoutset("utxo.dat")
+        assert_equal(snapshot["base_height"], 101)
+        assert_equal(snapshot["base_hash"], node.getbestblockhash())
+        assert_equal(snapshot["txouts"], node.gettxoutsetinfo()["txouts"])
+        assert_raises_rpc_error(-8, "already exists", node.dumptxoutset, "utxo.dat")
+        node.generate(9)
+        wait_until(lambda: snapshot_node.getblockchaininfo()["headers"] == 110, timeout=30)
+        wait_until(lambda: forged_node.getblockchaininfo()["headers"] == 110, timeout=30)
+
+        self.log.info("Snapshots not of the expected block and MuHash are refused")
+        path = snapshot["path"]
+        assert_raises_rpc_error(-1, "not of the expected block", snapshot_node.loadtxoutset, path, previous["base_hash"], snapshot["muhash"])
+        assert_raises_rpc_error(-1, "The MuHash of the snapshot is", snapshot_node.loadtxoutset, path, snapshot["base_hash"], previous["muhash"])
+        assert_equal(snapshot_node.getblockcount(), 0)
+
+        self.log.info("The chain continues from the snapshot and the blocks below it are validated in the background")
+        loaded = snapshot_node.loadtxoutset(path, snapshot["base_hash"], snapshot["muhash"])
+        assert_equal(loaded["base_height"], 101)
+        assert_equal(loaded["muhash"], snapshot["muhash"])
+        wait_until(lambda: snapshot_node.getbestblockhash() == node.getbestblockhash(), timeout=60)
+        wait_until(lambda: self.log_contains(snapshot_node, "the history of the chainstate snapshot at height 101 is valid"), timeout=60)
+        for key in ("txouts", "bogosize", "total_amount"):
+            assert_equal(snapshot_node.gettxoutsetinfo()[key], node.gettxoutsetinfo()[key])
+        assert_raises_rpc_error(-1, "loaded from a snapshot already", snapshot_node.loadtxoutset, path, snapshot["base_hash"], snapshot["muhash"])
+
+        self.log.info("A snapshot whose blocks do not lead to its coins shuts the node down")
+        # The header of the snapshot at height 101 with the coins of height 100,
+        # which still add up to the totals and MuHash in the header.
+        with open(path, "rb") as f:
+            data = f.read()
+        with open(previous["path"], "rb") as f:
+            previous_data = f.read()
+        forged = (data[:HEADER_COINS_START] + previous_data[HEADER_COINS_START:HEADER_COINS_END] +
+                  data[HEADER_COINS_END:header_size(data)] + previous_data[header_size(previous_data):])
+        forged_path = os.path.join(forged_node.datadir, "forged.dat")
+        with open(forged_path, "wb") as f:
+            f.write(forged)
+        loaded = forged_node.loadtxoutset(forged_path, snapshot["base_hash"], previous["muhash"])
+        assert_equal(loaded["base_height"], 101)
+        forged_node.wait_until_stopped(timeout=60)
+        assert self.log_contains(forged_node, "The blocks up to height 101 do not lead to the coins of the chainstate snapshot loaded there")
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()
@@ -266,6 +266,38 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(response_header_json_str)
         assert_equal(len(json_obj), 5) #now we should have 5 header objects
 
+        # headers and blocks by height range
+        tip = self.nodes[0].getblockcount()
+        json_string = http_get_call(url.hostname, url.port, '/rest/headers/height/'+str(tip - 4)+'/10'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal([header['height'] for header in json_obj], list(range(tip - 4, tip + 1)))
+        assert_equal(json_obj[-1]['hash'], self.nodes[0].getbestblockhash())
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip - 2)+'/3'+self.FORMAT_SEPARATOR+'hex', True)
+        assert_equal(response.status, 200)
+        block_hexes = response.read().decode('utf-8').split()
+        assert_equal(block_hexes, [self.nodes[0].getblock(self.nodes[0].getblockhash(height), 0) for height in range(tip - 2, tip + 1)])
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip - 2)+'/3'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(response.read(), hex_str_to_bytes(''.join(block_hexes)))
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip + 1)+'/1'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 404)
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/0/1001'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 400)
+
+        # blocks by algo, the last 5 are the ones just generated
+        json_string = http_get_call(url.hostname, url.port, '/rest/blocksbyalgo/sha256d/5'+self.FORMAT_SEPARATOR+'json')
+        json_obj = json.loads(json_string)
+        assert_equal(len(json_obj), 5)
+        assert_equal(json_obj[-1]['hash'], self.nodes[0].getbestblockhash())
+        assert_equal(json_obj, self.nodes[0].getblocksbyalgo("sha256d", 5))
+        json_string = http_get_call(url.hostname, url.port, '/rest/blocksbyalgo/sha256d/2/1/10'+self.FORMAT_SEPARATOR+'json')
+        assert_equal([block['height'] for block in json.loads(json_string)], [9, 10])
+        response = http_get_call(url.hostname, url.port, '/rest/blocksbyalgo/sha256d/5'+self.FORMAT_SEPARATOR+'bin', True)
+        assert_equal(response.status, 200)
+        assert_equal(len(response.read()), 5 * 32)
+        response = http_get_call(url.hostname, url.port, '/rest/blocksbyalgo/nosuchalgo/5'+self.FORMAT_SEPARATOR+'json', True)
+        assert_equal(response.status, 400)
+
         # do tx test
         tx_hash = block_json_obj['tx'][0]['txid']
         json_string = http_get_call(url.hostname, url.port, '/rest/tx/'+tx_hash+self.FORMAT_SEPARATOR+"json")
@@ -10,6 +10,7 @@ import struct
 from test_framework.test_framework import BitcoinTestFramework, SkipTest
 from test_framework.mininode import CTransaction
 from test_framework.util import (assert_equal,
+                                 assert_raises_rpc_error,
                                  bytes_to_hex_str,
                                  hash256,
                                 )
@@ -122,5 +123,24 @@ class ZMQTest (BitcoinTestFramework):
         hex = self.rawtx.receive()
         assert_equal(payment_txid, bytes_to_hex_str(hash256(hex)))
 
+        self.log.info("Check the active notifications")
+        notifications = self.nodes[0].getzmqnotifications()
+        assert_equal(sorted(n["type"] for n in notifications), ["pubhashblock", "pubhashtx", "pubrawblock", "pubrawtx"])
+        for n in notifications:
+            assert_equal(n["address"], "tcp://127.0.0.1:29319")
+            assert_equal(n["hwm"], 1000)
+            assert_equal(n["dropped"], 0)
+        assert_equal(self.nodes[1].getzmqnotifications(), [])
+
+        self.log.info("Check the mempool sequence")
+        mempool = self.nodes[1].getrawmempool(False, True)
+        assert_equal(mempool["txids"], self.nodes[1].getrawmempool())
+        seq = mempool["mempool_sequence"]
+        txid = self.nodes[1].sendtoaddress(self.nodes[1].getnewaddress(), 1.0)
+        mempool = self.nodes[1].getrawmempool(False, True)
+        assert txid in mempool["txids"]
+        assert_equal(mempool["mempool_sequence"], seq + 1)
+        assert_raises_rpc_error(-8, "Verbose results cannot contain mempool sequence values.", self.nodes[1].getrawmempool, True, True)
+
 if __name__ == '__main__':
     ZMQTest().main()
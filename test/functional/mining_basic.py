@@ -131,5 +131,42 @@ class MiningTest(BitcoinTestFramework):
         bad_block.hashPrevBlock = 123
         assert_template(node, bad_block, 'inconclusive-not-best-prevblk')
 
+        self.log.info("generatetoaddress: Test threaded nonce search")
+        address = node.getnewaddress()
+        height = node.getblockcount()
+        hashes = node.generatetoaddress(3, address, 1000000, "sha256d", 4)
+        assert_equal(len(hashes), 3)
+        assert_equal(node.getblockcount(), height + 3)
+        assert_equal(node.getbestblockhash(), hashes[-1])
+        # Nonpositive thread counts use one thread per core
+        hashes = node.generatetoaddress(1, address, 1000000, "sha256d", 0)
+        assert_equal(node.getblockcount(), height + 4)
+
+        self.log.info("getalgohashratehistory: Test height ranges")
+        tip = node.getblockcount()
+        history = node.getalgohashratehistory("sha256d", 0, tip, 100)
+        assert_equal(len(history), tip // 100 + 1)
+        assert_equal(history[0]["startheight"], 0)
+        assert_equal(history[-1]["endheight"], tip)
+        whole = node.getalgohashratehistory("sha256d", 0, tip)
+        assert_equal(len(whole), 1)
+        assert_equal(sum(entry["blocks"] for entry in history), whole[0]["blocks"])
+        assert_equal(node.getalgohashratehistory("sha256d", tip - 3, tip)[0]["blocks"], 4)
+        assert_equal(whole[0]["difficulty"], node.getblock(node.getbestblockhash())["difficulty"])
+        assert_raises_rpc_error(-8, "Block height out of range", node.getalgohashratehistory, "sha256d", 0, tip + 1)
+        assert_raises_rpc_error(-8, "Invalid interval", node.getalgohashratehistory, "sha256d", 0, tip, 0)
+
+        self.log.info("getblocksbyalgo: Test counts and height ranges")
+        blocks = node.getblocksbyalgo("sha256d", 5)
+        assert_equal([block["height"] for block in blocks], list(range(tip - 4, tip + 1)))
+        assert_equal(blocks[-1]["hash"], node.getbestblockhash())
+        assert_equal(blocks[0]["time"], node.getblock(blocks[0]["hash"])["time"])
+        assert_equal(len(node.getblocksbyalgo("sha256d", 1000, 10, 19)), 10)
+        assert_equal(len(node.getblocksbyalgo("sha256d", 3, 10, 19)), 3)
+        assert_equal(node.getblocksbyalgo("sha256d", 3, 10, 19)[-1]["height"], 19)
+        assert_raises_rpc_error(-8, "Block height out of range", node.getblocksbyalgo, "sha256d", 10, 0, tip + 1)
+        assert_raises_rpc_error(-8, "Invalid count", node.getblocksbyalgo, "sha256d", 0)
+        assert_raises_rpc_error(-8, "Invalid mining algorithm", node.getblocksbyalgo, "nosuchalgo")
+
 if __name__ == '__main__':
     MiningTest().main()
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the built-in stratum server.
+
+Subscribe and authorize a miner, check the job it gets sent matches the
+chain tip, then solve a share that is also a valid block and submit it.
+"""
+import hashlib
+import json
+import socket
+import struct
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 bytes_to_hex_str,
+                                 hex_str_to_bytes,
+                                 p2p_port,
+                                 wait_until,
+                                )
+
+def dsha256(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+class StratumConnection:
+    def __init__(self, port):
+        self.sock = socket.create_connection(("127.0.0.1", port), timeout=30)
+        self.reader = self.sock.makefile("r")
+        self.next_id = 1
+        self.notifications = []
+
+    def read(self):
+        return json.loads(self.reader.readline())
+
+    def call(self, method, params):
+        request_id = self.next_id
+        self.next_id += 1
+        request = {"id": request_id, "method": method, "params": params}
+        self.sock.sendall((json.dumps(request) + "\n").encode())
+        while True:
+            msg = self.read()
+            if msg["id"] is None:
+                self.notifications.append(msg)
+            elif msg["id"] == request_id:
+                return msg
+
+    def wait_for_notification(self, method):
+        while True:
+            for msg in self.notifications:
+                if msg["method"] == method:
+                    self.notifications.remove(msg)
+                    return msg["params"]
+            self.notifications.append(self.read())
+
+class StratumTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def run_test(self):
+        node = self.nodes[0]
+        # Leave initial block download.
+        node.generate(1)
+
+        self.port = p2p_port(1)
+        address = node.getnewaddress()
+        self.restart_node(0, ["-stratum", "-stratumport=%d" % self.port, "-stratumaddress=%s" % address,
+                              "-stratumdifficulty=0.00001", "-acceptdividedcoinbase"])
+        node = self.nodes[0]
+
+        conn = StratumConnection(self.port)
+
+        self.log.info("Authorizing before subscribing fails")
+        reply = conn.call("mining.authorize", ["worker", "x"])
+        assert_equal(reply["error"][0], 25)
+
+        self.log.info("Subscribe and authorize")
+        reply = conn.call("mining.subscribe", [])
+        assert_equal(reply["error"], None)
+        extranonce1 = reply["result"][1]
+        extranonce2_size = reply["result"][2]
+        assert_equal(len(extranonce1), 8)
+        assert_equal(extranonce2_size, 4)
+
+        reply = conn.call("mining.authorize", ["worker", "x,algo=nosuchalgo"])
+        assert_equal(reply["error"][0], 20)
+        reply = conn.call("mining.authorize", ["worker", "x,algo=sha256d"])
+        assert_equal(reply["result"], True)
+
+        difficulty = conn.wait_for_notification("mining.set_difficulty")
+        assert_equal(difficulty[0], 0.00001)
+        job = conn.wait_for_notification("mining.notify")
+
+        prevhash = hex_str_to_bytes(job[1])
+        prevhash = b"".join(prevhash[i:i + 4][::-1] for i in range(0, 32, 4))
+        assert_equal(bytes_to_hex_str(prevhash[::-1]), node.getbestblockhash())
+
+        self.log.info("Unknown jobs and malformed shares are rejected")
+        reply = conn.call("mining.submit", ["worker", "nosuchjob", "00000000", job[7], "00000000"])
+        assert_equal(reply["error"][0], 21)
+        reply = conn.call("mining.submit", ["worker", job[0], "00", job[7], "00000000"])
+        assert_equal(reply["error"][0], 20)
+
+        self.log.info("Solve a share that meets the block target")
+        extranonce2 = "01000000"
+        coinbase = hex_str_to_bytes(job[2] + extranonce1 + extranonce2 + job[3])
+        merkle_root = dsha256(coinbase)
+        for branch in job[4]:
+            merkle_root = dsha256(merkle_root + hex_str_to_bytes(branch))
+        header = struct.pack("<I", int(job[5], 16)) + prevhash + merkle_root + \
+                 struct.pack("<I", int(job[7], 16)) + struct.pack("<I", int(job[6], 16))
+        bits = int(job[6], 16)
+        block_target = (bits & 0xffffff) << (8 * ((bits >> 24) - 3))
+        # Same rounding as the server: diff1 * 2^16 / max(1, difficulty * 2^16)
+        share_target = (0xffff << 224) // max(1, int(difficulty[0] * 65536))
+        target = min(block_target, share_target)
+        nonce = 0
+        while int.from_bytes(dsha256(header + struct.pack("<I", nonce)), "little") > target:
+            nonce += 1
+
+        height = node.getblockcount()
+        reply = conn.call("mining.submit", ["worker", job[0], extranonce2, job[7], "%08x" % nonce])
+        assert_equal(reply["result"], True)
+        wait_until(lambda: node.getblockcount() == height + 1, timeout=30)
+        assert_equal(node.getbestblockhash(), bytes_to_hex_str(dsha256(header + struct.pack("<I", nonce))[::-1]))
+
+        self.log.info("Duplicate shares are rejected")
+        reply = conn.call("mining.submit", ["worker", job[0], extranonce2, job[7], "%08x" % nonce])
+        assert_equal(reply["error"][0] in (21, 22), True)
+
+        self.log.info("A new job is pushed for the new tip")
+        job = conn.wait_for_notification("mining.notify")
+        assert_equal(job[8], True)
+        prevhash = hex_str_to_bytes(job[1])
+        prevhash = b"".join(prevhash[i:i + 4][::-1] for i in range(0, 32, 4))
+        assert_equal(bytes_to_hex_str(prevhash[::-1]), node.getbestblockhash())
+
+if __name__ == '__main__':
+    StratumTest().main()
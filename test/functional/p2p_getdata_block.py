@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test serving blocks in response to getdata.
+
+Witness blocks are sent as they are stored on disk, or from the cache of
+recently sent blocks. Check a peer gets the same block either way, and that
+blocks without witness are still served.
+"""
+
+from test_framework.mininode import (
+    CInv,
+    MSG_WITNESS_FLAG,
+    P2PInterface,
+    mininode_lock,
+    msg_getdata,
+    network_thread_start,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, bytes_to_hex_str
+
+class P2PGetDataBlockTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def request_block(self, blockhash, inv_type):
+        node = self.nodes[0]
+        with mininode_lock:
+            node.p2p.last_message.pop("block", None)
+        msg = msg_getdata()
+        msg.inv.append(CInv(inv_type, int(blockhash, 16)))
+        node.p2p.send_message(msg)
+        node.p2p.wait_for_block(int(blockhash, 16))
+        with mininode_lock:
+            return node.p2p.last_message["block"].block
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.add_p2p_connection(P2PInterface())
+        network_thread_start()
+        node.p2p.wait_for_verack()
+
+        blocks = node.generate(10)
+
+        self.log.info("Witness blocks are served from disk and from the cache")
+        # The first request of a block reads it from disk, the repeated one is cached.
+        for blockhash in [blocks[0], blocks[-1], blocks[0], blocks[-1]]:
+            block = self.request_block(blockhash, 2 | MSG_WITNESS_FLAG)
+            assert_equal(bytes_to_hex_str(block.serialize(with_witness=True)), node.getblock(blockhash, False))
+
+        self.log.info("Blocks without witness are still served")
+        for blockhash in [blocks[0], blocks[-1]]:
+            block = self.request_block(blockhash, 2)
+            assert_equal(block.hash, blockhash)
+
+if __name__ == '__main__':
+    P2PGetDataBlockTest().main()
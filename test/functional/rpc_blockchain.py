@@ -43,6 +43,8 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_getchaintxstats()
         self._test_gettxoutsetinfo()
         self._test_getblockheader()
+        self._test_getblock()
+        self._test_batch()
         self._test_getdifficulty()
         self._test_getnetworkhashps()
         self._test_stopatheight()
@@ -215,6 +217,36 @@ class BlockchainTest(BitcoinTestFramework):
         assert isinstance(int(header['versionHex'], 16), int)
         assert isinstance(header['difficulty'], Decimal)
 
+    def _test_getblock(self):
+        node = self.nodes[0]
+        # A single call is written straight to the reply, a batched one goes through UniValue
+        blockhash = node.getbestblockhash()
+        for verbosity in [1, 2]:
+            block = node.getblock(blockhash, verbosity)
+            batched = node.batch([node.getblock.get_request(blockhash, verbosity)])[0]
+            assert_equal(batched['error'], None)
+            assert_equal(block, batched['result'])
+        assert_equal(node.getblock(blockhash, 2)['tx'][0]['txid'], node.getblock(blockhash)['tx'][0])
+
+    def _test_batch(self):
+        node = self.nodes[0]
+        # Batches of read-only calls run them on several threads, the replies keep their order
+        requests = [node.getblockhash.get_request(height) for height in range(201)]
+        requests.append(node.getblockhash.get_request(1000))
+        for i, request in enumerate(requests):
+            request['id'] = i
+        replies = node.batch(requests)
+        assert_equal([reply['id'] for reply in replies], list(range(len(requests))))
+        for height in range(201):
+            assert_equal(replies[height]['result'], node.getblockhash(height))
+        assert_equal(replies[-1]['error']['code'], -8)
+
+        # A batch with other calls runs them in turn
+        requests = [node.getblockhash.get_request(0), node.getnetworkhashps.get_request(), node.getblockcount.get_request()]
+        replies = node.batch(requests)
+        assert_equal(replies[0]['result'], node.getblockhash(0))
+        assert_equal(replies[2]['result'], 200)
+
     def _test_getdifficulty(self):
         difficulty = self.nodes[0].getdifficulty()
         # 1 hash in 2 should be valid, so difficulty should be 1/2**31
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the slow RPC workers and the startjob and getjobresult RPCs."""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+class RPCJobsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [[], ["-rpcslowthreads=0"]]
+
+    def wait_for_job(self, node, jobid):
+        results = []
+        def job_finished():
+            results.append(node.getjobresult(jobid))
+            return results[-1]["status"] != "running"
+        wait_until(job_finished)
+        return results[-1]
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Slow methods called directly still reply")
+        assert_equal(node.gettxoutsetinfo(), self.nodes[1].gettxoutsetinfo())
+        assert_equal(node.batch([node.gettxoutsetinfo.get_request(), node.getblockcount.get_request()])[1]["result"], 200)
+
+        self.log.info("A job returns the result of its call once")
+        jobid = node.startjob("getblockhash", [10])
+        result = self.wait_for_job(node, jobid)
+        assert_equal(result["method"], "getblockhash")
+        assert_equal(result["status"], "done")
+        assert_equal(result["result"], node.getblockhash(10))
+        assert_raises_rpc_error(-8, "Unknown job", node.getjobresult, jobid)
+
+        jobid = node.startjob("gettxoutsetinfo")
+        assert_equal(self.wait_for_job(node, jobid)["result"], node.gettxoutsetinfo())
+
+        self.log.info("A job returns the error of its call")
+        jobid = node.startjob("getblockhash", [1000])
+        result = self.wait_for_job(node, jobid)
+        assert_equal(result["status"], "failed")
+        assert_equal(result["error"]["code"], -8)
+
+        assert_raises_rpc_error(-8, "Jobs cannot", node.startjob, "getjobresult", [jobid])
+        assert_raises_rpc_error(-8, "Unknown job", node.getjobresult, "00")
+
+        self.log.info("Without slow workers there are no jobs")
+        assert_raises_rpc_error(-1, "Cannot queue the job", self.nodes[1].startjob, "getblockcount")
+
+if __name__ == '__main__':
+    RPCJobsTest().main()
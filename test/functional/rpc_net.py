@@ -21,10 +21,14 @@ class NetTest(BitcoinTestFramework):
     def set_test_params(self):
         self.setup_clean_chain = True
         self.num_nodes = 2
+        # Run one node on the select() fallback, the other on the default socket
+        # events mode and with its peers sharded across message handler threads.
+        self.extra_args = [["-msghandlerthreads=2"], ["-socketevents=select"]]
 
     def run_test(self):
         self._test_connection_count()
         self._test_getnettotals()
+        self._test_getmessagestats()
         self._test_getnetworkinginfo()
         self._test_getaddednodeinfo()
         self._test_getpeerinfo()
@@ -56,6 +60,19 @@ class NetTest(BitcoinTestFramework):
         assert_equal(net_totals['totalbytesrecv'] + 32*2, net_totals_after_ping['totalbytesrecv'])
         assert_equal(net_totals['totalbytessent'] + 32*2, net_totals_after_ping['totalbytessent'])
 
+    def _test_getmessagestats(self):
+        # every peer sent us a version message and pongs for our pings
+        peer_info = self.nodes[0].getpeerinfo()
+        for peer in peer_info:
+            assert_equal(peer['msgstats_per_msg']['version']['count'], 1)
+            assert peer['msgstats_per_msg']['pong']['count'] >= 1
+        msg_stats = self.nodes[0].getmessagestats()
+        assert_equal(msg_stats['version']['count'], 2)
+        assert_equal(msg_stats['pong']['count'],
+                     sum([peer['msgstats_per_msg']['pong']['count'] for peer in peer_info]))
+        assert_equal(sum([bucket['count'] for bucket in msg_stats['pong']['processtime']['histogram']]),
+                     msg_stats['pong']['count'])
+
     def _test_getnetworkinginfo(self):
         assert_equal(self.nodes[0].getnetworkinfo()['networkactive'], True)
         assert_equal(self.nodes[0].getnetworkinfo()['connections'], 2)
@@ -8,6 +8,7 @@ Test the following RPCs:
    - createrawtransaction
    - signrawtransactionwithwallet
    - sendrawtransaction
+   - sendrawtransactions
    - decoderawtransaction
    - getrawtransaction
 """
@@ -323,5 +324,23 @@ class RawTransactionsTest(BitcoinTestFramework):
         decrawtx= self.nodes[0].decoderawtransaction(rawtx)
         assert_equal(decrawtx['vin'][0]['sequence'], 4294967294)
 
+        #################################################
+        # sendrawtransactions with a chain out of order #
+        #################################################
+        utxo = self.nodes[0].listunspent()[0]
+        parent = self.nodes[0].createrawtransaction([{'txid': utxo['txid'], 'vout': utxo['vout']}], {self.nodes[0].getnewaddress(): utxo['amount'] - Decimal('0.001')})
+        parent = self.nodes[0].signrawtransactionwithwallet(parent)['hex']
+        parent_txid = self.nodes[0].decoderawtransaction(parent)['txid']
+        child = self.nodes[0].createrawtransaction([{'txid': parent_txid, 'vout': 0}], {self.nodes[0].getnewaddress(): utxo['amount'] - Decimal('0.002')})
+        child = self.nodes[0].signrawtransactionwithwallet(child, [{'txid': parent_txid, 'vout': 0, 'scriptPubKey': self.nodes[0].decoderawtransaction(parent)['vout'][0]['scriptPubKey']['hex'], 'amount': utxo['amount'] - Decimal('0.001')}])['hex']
+        result = self.nodes[0].sendrawtransactions([child, rawtx, parent, child])
+        assert_equal([entry['accepted'] for entry in result], [True, False, True, True])
+        assert_equal(result[1]['error'], "Missing inputs")
+        assert_equal(result[2]['txid'], parent_txid)
+        assert 'error' not in result[0]
+        assert result[0]['txid'] in self.nodes[0].getrawmempool()
+        assert parent_txid in self.nodes[0].getrawmempool()
+        assert_raises_rpc_error(-22, "TX decode failed for transaction 0", self.nodes[0].sendrawtransactions, ["00"])
+
 if __name__ == '__main__':
     RawTransactionsTest().main()
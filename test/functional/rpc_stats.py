@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the RPC call stats of getrpcstats and /rest/rpcstats."""
+
+import http.client
+import urllib.parse
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_greater_than, assert_raises_rpc_error
+
+class RPCStatsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-rest", "-restrpcstats"], ["-rest"]]
+
+    def get_rest_stats(self, node):
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/rpcstats')
+        return conn.getresponse()
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Calls and errors are counted by method")
+        before = node.getrpcstats().get("getblockhash", {"count": 0, "errors": 0})
+        node.getblockhash(0)
+        node.getblockhash(1)
+        assert_raises_rpc_error(-8, "Block height out of range", node.getblockhash, 1000)
+        stats = node.getrpcstats()["getblockhash"]
+        assert_equal(stats["count"], before["count"] + 3)
+        assert_equal(stats["errors"], before["errors"] + 1)
+        assert_equal(sum(bucket["count"] for bucket in stats["histogram"]), stats["count"])
+        assert stats["maxmicros"] <= stats["totalmicros"]
+        assert "lockwaitmicros" in stats
+        assert_raises_rpc_error(-32601, "Method not found", node.nosuchmethod)
+        assert "nosuchmethod" not in node.getrpcstats()
+
+        self.log.info("/rest/rpcstats serves them in the Prometheus text format")
+        response = self.get_rest_stats(node)
+        assert_equal(response.status, 200)
+        text = response.read().decode('utf-8')
+        assert 'globaltoken_rpc_calls_total{method="getblockhash"} %d' % stats["count"] in text
+        assert 'globaltoken_rpc_errors_total{method="getblockhash"} %d' % stats["errors"] in text
+        assert 'globaltoken_rpc_duration_seconds_bucket{method="getblockhash",le="+Inf"} %d' % stats["count"] in text
+        assert_greater_than(text.count("# TYPE"), 3)
+
+        self.log.info("Without -restrpcstats there is no /rest/rpcstats")
+        assert_equal(self.get_rest_stats(self.nodes[1]).status, 404)
+
+if __name__ == '__main__':
+    RPCStatsTest().main()
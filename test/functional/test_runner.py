@@ -117,6 +117,13 @@ BASE_SCRIPTS= [
     'feature_nulldummy.py',
     'wallet_import_rescan.py',
     'mining_basic.py',
+    'mining_stratum.py',
+    'feature_coinstatsindex.py',
+    'feature_addressindex.py',
+    'feature_txindex.py',
+    'wallet_rescan_blockfilter.py',
+    'feature_headersonly.py',
+    'feature_utxo_snapshot.py',
     'wallet_bumpfee.py',
     'rpc_named_arguments.py',
     'wallet_listsinceblock.py',
@@ -125,9 +132,12 @@ BASE_SCRIPTS= [
     'feature_dersig.py',
     'feature_cltv.py',
     'rpc_uptime.py',
+    'rpc_jobs.py',
+    'rpc_stats.py',
     'wallet_resendwallettransactions.py',
     'feature_minchainwork.py',
     'p2p_fingerprint.py',
+    'p2p_getdata_block.py',
     'feature_uacomment.py',
     'p2p_unrequested_blocks.py',
     'feature_logging.py',
@@ -75,6 +75,9 @@ class WalletTest(BitcoinTestFramework):
         mempool_txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 10)
         memory_after = self.nodes[0].getmemoryinfo()
         assert(memory_before['locked']['used'] + 64 <= memory_after['locked']['used'])
+        # Accepting the transactions cached their script executions for the next block
+        assert(memory_before['scriptcache']['occupied'] + 2 <= memory_after['scriptcache']['occupied'])
+        assert_equal(memory_after['signaturecache']['capacity'] * 32, memory_after['signaturecache']['bytes'])
 
         self.log.info("test gettxout (second part)")
         # utxo spent in mempool should be visible if you exclude mempool
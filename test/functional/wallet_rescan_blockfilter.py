@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Globaltoken Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test wallet rescans skipping blocks with -blockfilterindex.
+
+Import keys into a node that keeps block filters and check the rescan still
+finds the payments to them and the transactions spending those payments,
+before and after the node restarts.
+"""
+from decimal import Decimal
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 connect_nodes_bi,
+                                 wait_until,
+                                )
+
+class WalletRescanBlockFilterTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-blockfilterindex"]]
+
+    def wait_for_filters(self, node_index, times_synced):
+        """Wait until the index of a node caught up with the chain for the given time since the test started"""
+        log = os.path.join(self.nodes[node_index].datadir, "regtest", "debug.log")
+        wait_until(lambda: open(log, encoding="utf-8").read().count("block filter index is synced") >= times_synced, timeout=60)
+
+    def send_and_spend(self, node, amount):
+        """Pay to a new address of node, then spend that output in a later block"""
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, amount)
+        node.generate(1)
+        tx = node.decoderawtransaction(node.gettransaction(txid)["hex"])
+        vout = [out["n"] for out in tx["vout"] if out["value"] == amount][0]
+        spend = node.createrawtransaction([{"txid": txid, "vout": vout}], {node.getnewaddress(): amount - Decimal("0.01")})
+        spend_txid = node.sendrawtransaction(node.signrawtransaction(spend)["hex"])
+        node.generate(1)
+        return address, txid, spend_txid
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Rescanning finds payments and spends with the block filters")
+        node.generate(101)
+        address, txid, spend_txid = self.send_and_spend(node, Decimal("10"))
+        # Blocks paying nothing to the imported key, which the rescan can skip.
+        node.generate(20)
+        self.sync_all()
+        self.wait_for_filters(1, 1)
+
+        self.nodes[1].importprivkey(node.dumpprivkey(address))
+        txids = set(tx["txid"] for tx in self.nodes[1].listtransactions("*", 100, 0, True))
+        assert_equal(txids, {txid, spend_txid})
+        assert_equal(self.nodes[1].getbalance("*", 1, True), 0)
+
+        self.log.info("The filters of new blocks are added, and kept over a restart")
+        address, txid, spend_txid = self.send_and_spend(node, Decimal("5"))
+        self.sync_all()
+        self.restart_node(1, ["-blockfilterindex"])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.wait_for_filters(1, 2)
+
+        self.nodes[1].importprivkey(node.dumpprivkey(address))
+        txids = set(tx["txid"] for tx in self.nodes[1].listtransactions("*", 100, 0, True))
+        assert txid in txids
+        assert spend_txid in txids
+
+        self.log.info("Payments to keys the node already had are found too")
+        received = self.nodes[1].getnewaddress()
+        txid = node.sendtoaddress(received, Decimal("3"))
+        node.generate(1)
+        self.sync_all()
+        self.nodes[1].rescanblockchain()
+        assert_equal(self.nodes[1].getreceivedbyaddress(received), Decimal("3"))
+        assert txid in set(tx["txid"] for tx in self.nodes[1].listtransactions("*", 100, 0, True))
+
+if __name__ == '__main__':
+    WalletRescanBlockFilterTest().main()